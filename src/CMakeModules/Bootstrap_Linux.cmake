@@ -54,6 +54,11 @@ FIND_PACKAGE (OpenAL REQUIRED)
 FIND_PACKAGE (SFML 2 COMPONENTS graphics window system REQUIRED)
 FIND_PACKAGE (X11 REQUIRED)
 
+if (ENABLE_EGL)
+	FIND_PACKAGE (OpenGL REQUIRED COMPONENTS EGL)
+	ADD_DEFINITIONS (-DENABLE_EGL)
+endif ()
+
 if (ENABLE_HTML)
     if (USE_SYSTEM_CEF)
         set(CEF_LIB_PATH "/usr/lib/casparcg-cef-117")
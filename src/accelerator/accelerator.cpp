@@ -1,5 +1,6 @@
 #include "accelerator.h"
 
+#include "cpu/image/image_mixer.h"
 #include "ogl/image/image_mixer.h"
 #include "ogl/util/device.h"
 
@@ -7,35 +8,98 @@
 
 #include <core/mixer/image/image_mixer.h>
 
+#include <map>
 #include <memory>
 #include <mutex>
 #include <utility>
+#include <vector>
 
 namespace caspar { namespace accelerator {
 
+// Presents the devices of several gpus as one to GL INFO and GL GC.
+class device_group : public accelerator_device
+{
+    std::vector<std::shared_ptr<ogl::device>> devices_;
+
+  public:
+    explicit device_group(std::vector<std::shared_ptr<ogl::device>> devices)
+        : devices_(std::move(devices))
+    {
+    }
+
+    boost::property_tree::wptree info() const override
+    {
+        boost::property_tree::wptree info;
+        for (auto& device : devices_) {
+            auto device_info = device->info();
+            device_info.add(L"index", device->index());
+            info.add_child(L"gpu", device_info);
+        }
+        return info;
+    }
+
+    std::future<void> gc() override
+    {
+        std::vector<std::shared_future<void>> futures;
+        for (auto& device : devices_) {
+            futures.push_back(device->gc().share());
+        }
+        return std::async(std::launch::deferred, [futures = std::move(futures)] {
+            for (auto& future : futures) {
+                future.get();
+            }
+        });
+    }
+};
+
 struct accelerator::impl
 {
-    std::shared_ptr<ogl::device>        ogl_device_;
-    const core::video_format_repository format_repository_;
+    std::map<int, std::shared_ptr<ogl::device>> ogl_devices_;
+    std::shared_ptr<device_group>               device_group_;
+    const core::video_format_repository         format_repository_;
 
     impl(const core::video_format_repository format_repository)
         : format_repository_(format_repository)
     {
     }
 
-    std::unique_ptr<core::image_mixer> create_image_mixer(const int channel_id)
+    std::unique_ptr<core::image_mixer>
+    create_image_mixer(
+        const int channel_id, const int gpu, const int proxy_scale, const bool background, const bool analysis)
+    {
+        return std::make_unique<ogl::image_mixer>(spl::make_shared_ptr(get_device(gpu)),
+                                                  channel_id,
+                                                  format_repository_.get_max_video_format_size(),
+                                                  proxy_scale,
+                                                  background,
+                                                  analysis);
+    }
+
+    std::shared_ptr<ogl::device> get_device(int gpu)
     {
-        return std::make_unique<ogl::image_mixer>(
-            spl::make_shared_ptr(get_device()), channel_id, format_repository_.get_max_video_format_size());
+        auto& device = ogl_devices_[gpu];
+        if (!device) {
+            device = std::make_shared<ogl::device>(gpu);
+        }
+
+        return device;
     }
 
-    std::shared_ptr<ogl::device> get_device()
+    std::shared_ptr<accelerator_device> get_device()
     {
-        if (!ogl_device_) {
-            ogl_device_ = std::make_shared<ogl::device>();
+        if (ogl_devices_.size() <= 1) {
+            return get_device(ogl_devices_.empty() ? 0 : ogl_devices_.begin()->first);
         }
 
-        return ogl_device_;
+        // Kept alive here, the AMCP commands only hold it weakly.
+        if (!device_group_) {
+            std::vector<std::shared_ptr<ogl::device>> devices;
+            for (auto& p : ogl_devices_) {
+                devices.push_back(p.second);
+            }
+            device_group_ = std::make_shared<device_group>(std::move(devices));
+        }
+        return device_group_;
     }
 };
 
@@ -46,14 +110,18 @@ accelerator::accelerator(const core::video_format_repository format_repository)
 
 accelerator::~accelerator() {}
 
-std::unique_ptr<core::image_mixer> accelerator::create_image_mixer(const int channel_id)
+std::unique_ptr<core::image_mixer>
+accelerator::create_image_mixer(
+    const int channel_id, const int gpu, const int proxy_scale, const bool background, const bool analysis)
 {
-    return impl_->create_image_mixer(channel_id);
+    return impl_->create_image_mixer(channel_id, gpu, proxy_scale, background, analysis);
 }
 
-std::shared_ptr<accelerator_device> accelerator::get_device() const
+std::unique_ptr<core::image_mixer> accelerator::create_cpu_image_mixer(const int channel_id)
 {
-    return std::dynamic_pointer_cast<accelerator_device>(impl_->get_device());
+    return std::make_unique<cpu::image_mixer>(channel_id);
 }
 
+std::shared_ptr<accelerator_device> accelerator::get_device() const { return impl_->get_device(); }
+
 }} // namespace caspar::accelerator
@@ -27,7 +27,13 @@ class accelerator
 
     accelerator& operator=(accelerator&) = delete;
 
-    std::unique_ptr<caspar::core::image_mixer> create_image_mixer(int channel_id);
+    // gpu selects the device the channel renders on, every index gets its own context and device thread. The work of
+    // a background mixer only runs when the device has nothing else to do. With analysis the mixer measures its frames.
+    std::unique_ptr<caspar::core::image_mixer> create_image_mixer(
+        int channel_id, int gpu = 0, int proxy_scale = 1, bool background = false, bool analysis = false);
+
+    // Mixes on the cpu, without a gpu or OpenGL context, see cpu::image_mixer for what it draws.
+    std::unique_ptr<caspar::core::image_mixer> create_cpu_image_mixer(int channel_id);
 
     std::shared_ptr<accelerator_device> get_device() const;
 
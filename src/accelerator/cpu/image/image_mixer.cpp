@@ -0,0 +1,1035 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "image_mixer.h"
+
+#include "../util/blend.h"
+
+#include <common/array.h>
+#include <common/diagnostics/trace.h>
+#include <common/executor.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/memory_pool.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/geometry.h>
+#include <core/frame/pixel_format.h>
+#include <core/video_format.h>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace cpu {
+
+namespace {
+
+// Rows are drawn in bands of this many, every layer at a time, so that the rows and keys of a band stay in cache.
+const int band_rows = 16;
+
+struct item
+{
+    core::const_frame     frame;
+    core::image_transform transform;
+};
+
+// A layer of a draw_list. Its sublayers follow it in the list, up to end, and are drawn before its items.
+struct layer
+{
+    std::vector<item> items;
+    int               end = 0;
+};
+
+struct draw_list
+{
+    std::vector<layer> layers; // in the order they were pushed, each before its sublayers
+    std::vector<int>   roots;  // the top level layers
+};
+
+// An item placed on the screen. It draws the pixels from x0 to x1 of the rows from y0 to y1, each from the source
+// pixel in columns on the source row row_offset + row_scale * (y + 0.5).
+struct draw_op
+{
+    const item*      source    = nullptr;
+    bool             is_key    = false;
+    bool             clear     = false; // the first key drawn into its buffer, which starts out empty
+    int              key       = -1;    // the buffer a key is drawn into, or the local key an image is drawn through
+    int              layer_key = -1;
+    int              opacity   = 255;
+    int              x0        = 0;
+    int              x1        = 0;
+    int              y0        = 0;
+    int              y1        = 0;
+    std::vector<int> columns;
+    bool             contiguous = false; // the columns follow each other, so bgra rows are blended in place
+    double           row_offset = 0.0;
+    double           row_scale  = 0.0;
+};
+
+array<std::uint8_t> create_buffer(size_t size)
+{
+    auto buffer = create_aligned_buffer(size);
+    auto data   = static_cast<std::uint8_t*>(buffer.get());
+    return array<std::uint8_t>(data, size, std::move(buffer));
+}
+
+std::uint8_t clamp_byte(int value) { return static_cast<std::uint8_t>(std::clamp(value, 0, 255)); }
+
+// Studio range Y'CbCr, BT.709 for hd images and BT.601 for the others like the gl mixer, to bgra.
+void ycbcr_to_bgra(int y, int cb, int cr, int a, bool hd, std::uint8_t* out)
+{
+    const auto c = (y - 16) * 298 + 128;
+    const auto d = cb - 128;
+    const auto e = cr - 128;
+    if (hd) {
+        out[0] = clamp_byte((c + 541 * d) >> 8);
+        out[1] = clamp_byte((c - 55 * d - 137 * e) >> 8);
+        out[2] = clamp_byte((c + 459 * e) >> 8);
+    } else {
+        out[0] = clamp_byte((c + 517 * d) >> 8);
+        out[1] = clamp_byte((c - 100 * d - 208 * e) >> 8);
+        out[2] = clamp_byte((c + 409 * e) >> 8);
+    }
+    out[3] = static_cast<std::uint8_t>(a);
+}
+
+// The width of an image in pixels, which for uyvy and uyva is twice that of its plane of pixel pairs.
+int image_width(const core::pixel_format_desc& desc)
+{
+    const auto width = desc.planes.at(0).width;
+    return desc.format == core::pixel_format::uyvy || desc.format == core::pixel_format::uyva ? width * 2 : width;
+}
+
+bool is_drawable(core::pixel_format format)
+{
+    switch (format) {
+        case core::pixel_format::invalid:
+        case core::pixel_format::bc1:
+        case core::pixel_format::bc3:
+        case core::pixel_format::bc3_ycocg:
+        case core::pixel_format::bc7:
+            return false;
+        default:
+            return true;
+    }
+}
+
+// Reads the pixels of an op on row y of the screen as bgra, either into out or, for bgra images whose columns
+// follow each other, in place.
+const std::uint8_t* fetch_row(const draw_op& op, int y, std::uint8_t* out)
+{
+    const auto& frame  = op.source->frame;
+    const auto& desc   = frame.pixel_format_desc();
+    const auto  height = desc.planes[0].height;
+
+    auto sy = std::clamp(static_cast<int>(std::floor(op.row_offset + op.row_scale * (y + 0.5))), 0, height - 1);
+    if (desc.field == core::video_field::a) {
+        sy &= ~1;
+    } else if (desc.field == core::video_field::b) {
+        sy = std::min(sy | 1, height - 1);
+    }
+
+    auto row = [&](int n, int r) {
+        return frame.image_data(n).data() + static_cast<size_t>(r) * desc.planes[n].linesize;
+    };
+
+    const auto  count   = op.x1 - op.x0;
+    const auto* columns = op.columns.data();
+    const auto  hd      = height > 700;
+
+    switch (desc.format) {
+        case core::pixel_format::bgra: {
+            const auto* src = row(0, sy);
+            if (op.contiguous) {
+                return src + static_cast<size_t>(columns[0]) * 4;
+            }
+            for (int n = 0; n < count; ++n) {
+                std::memcpy(out + n * 4, src + columns[n] * 4, 4);
+            }
+            return out;
+        }
+        case core::pixel_format::rgba:
+        case core::pixel_format::argb:
+        case core::pixel_format::abgr: {
+            // The offsets of b, g, r and a in each pixel.
+            const int  rgba[] = {2, 1, 0, 3};
+            const int  argb[] = {3, 2, 1, 0};
+            const int  abgr[] = {1, 2, 3, 0};
+            const auto order  = desc.format == core::pixel_format::rgba   ? rgba
+                                : desc.format == core::pixel_format::argb ? argb
+                                                                          : abgr;
+            const auto* src = row(0, sy);
+            for (int n = 0; n < count; ++n) {
+                const auto* p = src + columns[n] * 4;
+                for (int c = 0; c < 4; ++c) {
+                    out[n * 4 + c] = p[order[c]];
+                }
+            }
+            return out;
+        }
+        case core::pixel_format::bgr:
+        case core::pixel_format::rgb: {
+            const auto  swap = desc.format == core::pixel_format::rgb;
+            const auto* src  = row(0, sy);
+            for (int n = 0; n < count; ++n) {
+                const auto* p  = src + columns[n] * 3;
+                out[n * 4]     = p[swap ? 2 : 0];
+                out[n * 4 + 1] = p[1];
+                out[n * 4 + 2] = p[swap ? 0 : 2];
+                out[n * 4 + 3] = 255;
+            }
+            return out;
+        }
+        case core::pixel_format::gray:
+        case core::pixel_format::luma: {
+            // Luma is studio range, gray full range.
+            const auto  studio = desc.format == core::pixel_format::luma;
+            const auto* src    = row(0, sy);
+            for (int n = 0; n < count; ++n) {
+                const auto value = studio ? clamp_byte((src[columns[n]] - 16) * 255 / 219) : src[columns[n]];
+                std::memset(out + n * 4, value, 3);
+                out[n * 4 + 3] = 255;
+            }
+            return out;
+        }
+        case core::pixel_format::ycbcr:
+        case core::pixel_format::ycbcra:
+        case core::pixel_format::ycbcr16:
+        case core::pixel_format::ycbcra16: {
+            const auto wide   = core::is_16_bit(desc.format);
+            const auto shift  = wide ? std::max(desc.depth - 8, 0) : 0;
+            const auto alpha  = desc.planes.size() > 3; // ycbcra and ycbcra16
+            const auto width  = desc.planes[0].width;
+            const auto cwidth = desc.planes[1].width;
+            const auto cy     = sy * desc.planes[1].height / height;
+
+            const auto* y_row  = row(0, sy);
+            const auto* cb_row = row(1, cy);
+            const auto* cr_row = row(2, cy);
+            const auto* a_row  = alpha ? row(3, sy) : nullptr;
+
+            auto sample = [&](const std::uint8_t* src, int x) {
+                if (!wide) {
+                    return static_cast<int>(src[x]);
+                }
+                std::uint16_t value;
+                std::memcpy(&value, src + x * 2, 2);
+                return std::min(value >> shift, 255);
+            };
+
+            for (int n = 0; n < count; ++n) {
+                const auto x  = columns[n];
+                const auto cx = x * cwidth / width;
+                ycbcr_to_bgra(sample(y_row, x),
+                              sample(cb_row, cx),
+                              sample(cr_row, cx),
+                              a_row ? sample(a_row, x) : 255,
+                              hd,
+                              out + n * 4);
+            }
+            return out;
+        }
+        case core::pixel_format::nv12:
+        case core::pixel_format::p010: {
+            // p010 keeps its samples in the high bits.
+            const auto wide   = desc.format == core::pixel_format::p010;
+            const auto width  = desc.planes[0].width;
+            const auto cwidth = desc.planes[1].width;
+            const auto cy     = sy * desc.planes[1].height / height;
+
+            const auto* y_row = row(0, sy);
+            const auto* c_row = row(1, cy);
+
+            auto sample = [&](const std::uint8_t* src, int x) {
+                if (!wide) {
+                    return static_cast<int>(src[x]);
+                }
+                std::uint16_t value;
+                std::memcpy(&value, src + x * 2, 2);
+                return value >> 8;
+            };
+
+            for (int n = 0; n < count; ++n) {
+                const auto x  = columns[n];
+                const auto cx = x * cwidth / width;
+                ycbcr_to_bgra(sample(y_row, x), sample(c_row, cx * 2), sample(c_row, cx * 2 + 1), 255, hd, out + n * 4);
+            }
+            return out;
+        }
+        case core::pixel_format::uyvy:
+        case core::pixel_format::uyva: {
+            // Cb Y Cr Y for each pair of pixels, uyva followed by a plane of alpha.
+            const auto* src   = row(0, sy);
+            const auto* a_row = desc.format == core::pixel_format::uyva ? row(1, sy) : nullptr;
+            for (int n = 0; n < count; ++n) {
+                const auto  x = columns[n];
+                const auto* p = src + x / 2 * 4;
+                ycbcr_to_bgra(p[1 + x % 2 * 2], p[0], p[2], a_row ? a_row[x] : 255, hd, out + n * 4);
+            }
+            return out;
+        }
+        default:
+            return nullptr;
+    }
+}
+
+// The features of a transform the cpu mixer doesn't draw, empty if there are none.
+std::wstring ignored_features(const core::image_transform& transform)
+{
+    std::wstring features;
+    auto         add = [&](const wchar_t* feature) {
+        features += (features.empty() ? L"" : L", ") + std::wstring(feature);
+    };
+
+    if (transform.blend_mode != core::blend_mode::normal) {
+        add(L"blend modes");
+    }
+    if (transform.is_mix) {
+        add(L"mixes");
+    }
+    if (transform.contrast != 1.0 || transform.brightness != 1.0 || transform.saturation != 1.0) {
+        add(L"contrast, saturation and brightness");
+    }
+    const auto& levels = transform.levels;
+    if (levels.min_input != 0.0 || levels.max_input != 1.0 || levels.gamma != 1.0 || levels.min_output != 0.0 ||
+        levels.max_output != 1.0) {
+        add(L"levels");
+    }
+    if (transform.chroma.enable) {
+        add(L"chroma keys");
+    }
+    if (transform.invert) {
+        add(L"invert");
+    }
+    const auto& edgeblend = transform.edgeblend;
+    if (edgeblend.left > 0.0 || edgeblend.right > 0.0 || edgeblend.top > 0.0 || edgeblend.bottom > 0.0) {
+        add(L"edge blending");
+    }
+    return features;
+}
+
+// Collects the visited frames into a draw list.
+class layer_builder final : public core::frame_visitor
+{
+    std::vector<core::image_transform> transform_stack_;
+    std::shared_ptr<draw_list>         list_ = std::make_shared<draw_list>();
+    std::vector<int>                   layer_stack_; // the layers open for items, by depth
+
+  public:
+    layer_builder()
+        : transform_stack_(1)
+    {
+    }
+
+    void push(const core::frame_transform& transform) override
+    {
+        auto previous_layer_depth = transform_stack_.back().layer_depth;
+        transform_stack_.push_back(transform_stack_.back() * transform.image_transform);
+        if (previous_layer_depth < transform_stack_.back().layer_depth) {
+            open_layer();
+        }
+    }
+
+    void visit(const core::const_frame& frame) override
+    {
+        if (frame.pixel_format_desc().format == core::pixel_format::invalid ||
+            frame.pixel_format_desc().planes.empty()) {
+            return;
+        }
+
+        // Frames drawn outside of any layer, such as a lone frame read back, get one of their own.
+        if (layer_stack_.empty()) {
+            open_layer();
+        }
+
+        // Hidden items are kept, they still take up the key before them.
+        list_->layers[layer_stack_.back()].items.push_back({frame, transform_stack_.back()});
+    }
+
+    void pop() override
+    {
+        transform_stack_.pop_back();
+        close_layers(static_cast<size_t>(transform_stack_.back().layer_depth));
+    }
+
+    std::shared_ptr<draw_list> take()
+    {
+        close_layers(0);
+
+        auto list = std::move(list_);
+        list_     = std::make_shared<draw_list>();
+        return list;
+    }
+
+  private:
+    void open_layer()
+    {
+        auto index = static_cast<int>(list_->layers.size());
+        list_->layers.emplace_back();
+        if (layer_stack_.empty()) {
+            list_->roots.push_back(index);
+        }
+        layer_stack_.push_back(index);
+    }
+
+    // A layer ends with the last of the layers pushed while it was open.
+    void close_layers(size_t depth)
+    {
+        while (layer_stack_.size() > depth) {
+            list_->layers[layer_stack_.back()].end = static_cast<int>(list_->layers.size());
+            layer_stack_.pop_back();
+        }
+    }
+};
+
+class image_renderer
+{
+    const int channel_id_;
+
+    mutable std::mutex             warnings_mutex_;
+    mutable std::set<std::wstring> warnings_;
+
+  public:
+    explicit image_renderer(int channel_id)
+        : channel_id_(channel_id)
+    {
+    }
+
+    // Draws the layers into a bgra image of the format's size. Safe to call from any thread.
+    array<const std::uint8_t> draw(const draw_list& list, const core::video_format_desc& format_desc) const
+    {
+        std::vector<draw_op> ops;
+        int                  keys      = 0;
+        int                  layer_key = -1;
+        for (auto root : list.roots) {
+            plan(list, root + 1, list.layers[root].end, ops, keys, format_desc);
+            plan(list, list.layers[root], layer_key, ops, keys, format_desc);
+        }
+
+        const auto width  = format_desc.width;
+        const auto height = format_desc.height;
+        auto       image  = create_buffer(static_cast<size_t>(width) * height * 4);
+        auto       target = image.data();
+
+        tbb::parallel_for(
+            tbb::blocked_range<int>(0, (height + band_rows - 1) / band_rows),
+            [&](const tbb::blocked_range<int>& bands) {
+                for (auto band = bands.begin(); band != bands.end(); ++band) {
+                    draw_band(target, width, band * band_rows, std::min((band + 1) * band_rows, height), ops, keys);
+                }
+            },
+            tbb::simple_partitioner());
+
+        return std::move(image);
+    }
+
+    // Scales a bgra image down by averaging the pixels each target pixel covers, the way the gl converter does.
+    static array<const std::uint8_t>
+    scale(const array<const std::uint8_t>& image, int width, int height, int target_width, int target_height)
+    {
+        if (target_width == width && target_height == height) {
+            return image;
+        }
+
+        diagnostics::trace::span span("cpu.scale", -1, -1, "cpu");
+
+        auto result = create_buffer(static_cast<size_t>(target_width) * target_height * 4);
+        auto out    = result.data();
+
+        tbb::parallel_for(tbb::blocked_range<int>(0, target_height), [&](const tbb::blocked_range<int>& rows) {
+            for (auto row = rows.begin(); row != rows.end(); ++row) {
+                const auto top    = row * height / target_height;
+                const auto bottom = std::max(top + 1, (row + 1) * height / target_height);
+                for (int x = 0; x < target_width; ++x) {
+                    const auto left  = x * width / target_width;
+                    const auto right = std::max(left + 1, (x + 1) * width / target_width);
+
+                    int sums[4] = {};
+                    for (auto y = top; y < bottom; ++y) {
+                        const auto* src = image.data() + (static_cast<size_t>(y) * width + left) * 4;
+                        for (auto n = 0; n < (right - left) * 4; ++n) {
+                            sums[n % 4] += src[n];
+                        }
+                    }
+
+                    const auto count = (bottom - top) * (right - left);
+                    auto*      dest  = out + (static_cast<size_t>(row) * target_width + x) * 4;
+                    for (int c = 0; c < 4; ++c) {
+                        dest[c] = static_cast<std::uint8_t>((sums[c] + count / 2) / count);
+                    }
+                }
+            }
+        });
+
+        return std::move(result);
+    }
+
+    // Converts a bgra image of the format's size to one of the output formats, the way the gl converter does.
+    static array<const std::uint8_t> convert(const array<const std::uint8_t>& image,
+                                             core::output_format              format,
+                                             const core::video_format_desc&   format_desc)
+    {
+        const auto width  = format_desc.width;
+        const auto height = format_desc.height;
+
+        switch (format) {
+            case core::output_format::bgra:
+                return image;
+            case core::output_format::texture:
+                return {};
+            default:
+                break;
+        }
+
+        diagnostics::trace::span span("cpu.convert", -1, -1, "cpu");
+
+        if (format == core::output_format::key) {
+            auto       result = create_buffer(image.size());
+            auto       out    = result.data();
+            const auto pixels = image.size() / 4;
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, pixels), [&](const tbb::blocked_range<size_t>& range) {
+                for (auto n = range.begin(); n != range.end(); ++n) {
+                    std::memset(out + n * 4, image.data()[n * 4 + 3], 4);
+                }
+            });
+            return std::move(result);
+        }
+
+        // Matches the BT.709 tagging of the ffmpeg consumer for yuva422 and the SDI convention for the others.
+        const auto hd       = format == core::output_format::yuva422 || height > 700;
+        const auto size     = core::output_format_size(format, width, height);
+        const auto linesize = core::output_format_linesize(format, width);
+        auto       result   = create_buffer(size);
+        auto       out      = result.data();
+        const auto plane    = static_cast<size_t>(width) * height;
+
+        tbb::parallel_for(tbb::blocked_range<int>(0, height), [&](const tbb::blocked_range<int>& rows) {
+            thread_local std::vector<float> ycbcr;
+            ycbcr.resize(static_cast<size_t>(width) * 3);
+            auto* y  = ycbcr.data();
+            auto* cb = y + width;
+            auto* cr = cb + width;
+
+            for (auto row = rows.begin(); row != rows.end(); ++row) {
+                const auto* src = image.data() + static_cast<size_t>(row) * width * 4;
+                to_ycbcr(src, width, hd, y, cb, cr);
+
+                // Chroma of the pair of pixels from the even pixel x, clamped to the line like the gl converter.
+                auto chroma = [&](const float* c, int x) {
+                    return (c[std::min(x, width - 1)] + c[std::min(x + 1, width - 1)]) * 0.5f;
+                };
+                auto luma = [&](int x) { return y[std::min(x, width - 1)]; };
+
+                switch (format) {
+                    case core::output_format::uyvy:
+                    case core::output_format::uyva: {
+                        auto* dest = out + static_cast<size_t>(row) * linesize;
+                        for (int n = 0; n < width / 2; ++n) {
+                            dest[n * 4]     = to_8bit_chroma(chroma(cb, n * 2));
+                            dest[n * 4 + 1] = to_8bit_luma(luma(n * 2));
+                            dest[n * 4 + 2] = to_8bit_chroma(chroma(cr, n * 2));
+                            dest[n * 4 + 3] = to_8bit_luma(luma(n * 2 + 1));
+                        }
+                        if (format == core::output_format::uyva) {
+                            auto* alpha = out + plane * 2 + static_cast<size_t>(row) * width;
+                            for (int x = 0; x < width; ++x) {
+                                alpha[x] = src[x * 4 + 3];
+                            }
+                        }
+                        break;
+                    }
+                    case core::output_format::v210: {
+                        // Every group of 4 words carries 6 pixels, the padding repeats the last pixel of the line.
+                        auto* dest = out + static_cast<size_t>(row) * linesize;
+                        for (int group = 0; group < linesize / 16; ++group) {
+                            const auto    x       = group * 6;
+                            std::uint32_t words[] = {
+                                to_10bit_chroma(chroma(cb, x)) | to_10bit_luma(luma(x)) << 10 |
+                                    to_10bit_chroma(chroma(cr, x)) << 20,
+                                to_10bit_luma(luma(x + 1)) | to_10bit_chroma(chroma(cb, x + 2)) << 10 |
+                                    to_10bit_luma(luma(x + 2)) << 20,
+                                to_10bit_chroma(chroma(cr, x + 2)) | to_10bit_luma(luma(x + 3)) << 10 |
+                                    to_10bit_chroma(chroma(cb, x + 4)) << 20,
+                                to_10bit_luma(luma(x + 4)) | to_10bit_chroma(chroma(cr, x + 4)) << 10 |
+                                    to_10bit_luma(luma(x + 5)) << 20,
+                            };
+                            std::memcpy(dest + group * 16, words, 16);
+                        }
+                        break;
+                    }
+                    case core::output_format::yuva422: {
+                        const auto offset     = static_cast<size_t>(row) * width;
+                        const auto half_width = width / 2;
+                        for (int x = 0; x < width; ++x) {
+                            out[offset + x]             = to_8bit_luma(y[x]);
+                            out[plane * 2 + offset + x] = src[x * 4 + 3];
+                        }
+                        for (int x = 0; x < half_width; ++x) {
+                            out[plane + offset + x]              = to_8bit_chroma(chroma(cb, x * 2));
+                            out[plane + offset + half_width + x] = to_8bit_chroma(chroma(cr, x * 2));
+                        }
+                        break;
+                    }
+                    default:
+                        break;
+                }
+            }
+        });
+
+        // The alpha of uyva is padded to a whole uyvy line.
+        if (format == core::output_format::uyva) {
+            std::memset(out + plane * 3, 0, size - plane * 3);
+        }
+
+        return std::move(result);
+    }
+
+  private:
+    // Places the layers from first to last that are siblings, each after its own sublayers.
+    void plan(const draw_list&               list,
+              int                            first,
+              int                            last,
+              std::vector<draw_op>&          ops,
+              int&                           keys,
+              const core::video_format_desc& format_desc) const
+    {
+        int layer_key = -1;
+        for (auto index = first; index < last; index = list.layers[index].end) {
+            plan(list, index + 1, list.layers[index].end, ops, keys, format_desc);
+            plan(list, list.layers[index], layer_key, ops, keys, format_desc);
+        }
+    }
+
+    // Places the items of a layer, not its sublayers. Keys are drawn into a local key taken by the next image. What
+    // is left of it after the last item keys the layer drawn next, like in the gl mixer.
+    void plan(const draw_list&               list,
+              const layer&                   layer,
+              int&                           layer_key,
+              std::vector<draw_op>&          ops,
+              int&                           keys,
+              const core::video_format_desc& format_desc) const
+    {
+        if (layer.items.empty()) {
+            return;
+        }
+
+        int local_key = -1;
+        for (auto& item : layer.items) {
+            draw_op op;
+            op.source = &item;
+            op.is_key = item.transform.is_key;
+
+            if (op.is_key) {
+                op.clear = local_key < 0;
+                if (op.clear) {
+                    local_key = keys++;
+                }
+                op.key = local_key;
+                // A key that draws nothing still starts its buffer, which then hides what it keys.
+                if (place(op, format_desc) || op.clear) {
+                    ops.push_back(std::move(op));
+                }
+            } else {
+                op.key       = std::exchange(local_key, -1);
+                op.layer_key = layer_key;
+                op.opacity   = static_cast<int>(std::lround(std::clamp(item.transform.opacity, 0.0, 1.0) * 255.0));
+                if (op.opacity > 0 && place(op, format_desc)) {
+                    ops.push_back(std::move(op));
+                }
+            }
+        }
+
+        layer_key = local_key;
+    }
+
+    // Works out the pixels an item covers on the screen and where they are sampled from. Returns false if it draws
+    // nothing.
+    bool place(draw_op& op, const core::video_format_desc& format_desc) const
+    {
+        const auto& transform = op.source->transform;
+        const auto& frame     = op.source->frame;
+        const auto& desc      = frame.pixel_format_desc();
+
+        if (!core::is_visible(transform)) {
+            return false;
+        }
+
+        if (!is_drawable(desc.format)) {
+            warn(L"block compressed images aren't drawn");
+            return false;
+        }
+
+        for (size_t n = 0; n < desc.planes.size(); ++n) {
+            if (frame.image_data(n).size() < static_cast<size_t>(desc.planes[n].size)) {
+                // Drawn on a gpu, there is nothing in host memory.
+                return false;
+            }
+        }
+
+        const auto features = ignored_features(transform);
+        if (!features.empty()) {
+            warn(L"ignores " + features);
+        }
+
+        const auto& pers = transform.perspective;
+        if (std::abs(transform.angle) > 1e-9 || pers.ul != std::array<double, 2>{0.0, 0.0} ||
+            pers.ur != std::array<double, 2>{1.0, 0.0} || pers.lr != std::array<double, 2>{1.0, 1.0} ||
+            pers.ll != std::array<double, 2>{0.0, 1.0}) {
+            warn(L"rotated and perspective images aren't drawn");
+            return false;
+        }
+
+        // Only quads of a rectangle, running from their upper left corner clockwise, map to the screen row by row.
+        const auto& coords = frame.geometry().data();
+        if (coords.size() != 4 || coords[1].vertex_y != coords[0].vertex_y ||
+            coords[3].vertex_x != coords[0].vertex_x || coords[1].vertex_x != coords[2].vertex_x ||
+            coords[3].vertex_y != coords[2].vertex_y || coords[1].texture_y != coords[0].texture_y ||
+            coords[3].texture_x != coords[0].texture_x || coords[1].texture_x != coords[2].texture_x ||
+            coords[3].texture_y != coords[2].texture_y || coords[0].vertex_x == coords[2].vertex_x ||
+            coords[0].vertex_y == coords[2].vertex_y) {
+            warn(L"images of other geometries than rectangles aren't drawn");
+            return false;
+        }
+
+        // Crops only apply to the default geometries, as they do in the gl mixer.
+        const auto is_default = coords == core::frame_geometry::get_default().data() ||
+                                coords == core::frame_geometry::get_default_vflip().data();
+
+        const double vertex[2][2]  = {{coords[0].vertex_x, coords[2].vertex_x},
+                                      {coords[0].vertex_y, coords[2].vertex_y}};
+        const double texture[2][2] = {{coords[0].texture_x, coords[2].texture_x},
+                                      {coords[0].texture_y, coords[2].texture_y}};
+        const int    screen[]      = {format_desc.width, format_desc.height};
+        const int    size[]        = {image_width(desc), desc.planes[0].height};
+
+        int    begin[2];
+        int    end[2];
+        double offset[2];
+        double step[2];
+        for (int n = 0; n < 2; ++n) {
+            auto v0 = vertex[n][0];
+            auto v1 = vertex[n][1];
+            if (is_default) {
+                v0 = std::clamp(v0, transform.crop.ul[n], transform.crop.lr[n]);
+                v1 = std::clamp(v1, transform.crop.ul[n], transform.crop.lr[n]);
+            }
+
+            const auto s0 = transform.fill_translation[n] + (v0 - transform.anchor[n]) * transform.fill_scale[n];
+            const auto s1 = transform.fill_translation[n] + (v1 - transform.anchor[n]) * transform.fill_scale[n];
+            const auto lo = std::max({std::min(s0, s1), transform.clip_translation[n], 0.0});
+            const auto hi = std::min({std::max(s0, s1), transform.clip_translation[n] + transform.clip_scale[n], 1.0});
+
+            // The pixels whose centers are covered.
+            begin[n] = static_cast<int>(std::ceil(lo * screen[n] - 0.5));
+            end[n]   = static_cast<int>(std::ceil(hi * screen[n] - 0.5));
+            if (end[n] <= begin[n]) {
+                return false;
+            }
+
+            // The center of pixel p is at s = (p + 0.5) / screen, which maps back through the fill to the vertex
+            // v = anchor + (s - translation) / scale, and along the quad to the texture.
+            const auto texels = (texture[n][1] - texture[n][0]) / (vertex[n][1] - vertex[n][0]) * size[n];
+            step[n]           = texels / (transform.fill_scale[n] * screen[n]);
+            offset[n]         = texture[n][0] * size[n] +
+                        (transform.anchor[n] - vertex[n][0] - transform.fill_translation[n] / transform.fill_scale[n]) *
+                            texels;
+        }
+
+        op.x0 = begin[0];
+        op.x1 = end[0];
+        op.y0 = begin[1];
+        op.y1 = end[1];
+
+        op.columns.resize(op.x1 - op.x0);
+        op.contiguous = true;
+        for (int x = op.x0; x < op.x1; ++x) {
+            auto& column = op.columns[x - op.x0];
+            column       = std::clamp(static_cast<int>(std::floor(offset[0] + step[0] * (x + 0.5))), 0, size[0] - 1);
+            op.contiguous &= x == op.x0 || column == op.columns[x - op.x0 - 1] + 1;
+        }
+
+        op.row_offset = offset[1];
+        op.row_scale  = step[1];
+
+        return true;
+    }
+
+    // Draws the rows from y0 to y1, with keys of their own.
+    static void draw_band(std::uint8_t*               target,
+                          int                         width,
+                          int                         y0,
+                          int                         y1,
+                          const std::vector<draw_op>& ops,
+                          int                         keys)
+    {
+        thread_local std::vector<std::uint8_t> key_buffers;
+        thread_local std::vector<std::uint8_t> pixels;
+        thread_local std::vector<std::uint8_t> coverage;
+
+        const auto key_size = static_cast<size_t>(width) * (y1 - y0);
+        key_buffers.resize(key_size * keys);
+        pixels.resize(static_cast<size_t>(width) * 4);
+        coverage.resize(width);
+
+        std::memset(target + static_cast<size_t>(y0) * width * 4, 0, key_size * 4);
+
+        for (auto& op : ops) {
+            auto* key       = op.key >= 0 ? key_buffers.data() + op.key * key_size : nullptr;
+            auto* layer_key = op.layer_key >= 0 ? key_buffers.data() + op.layer_key * key_size : nullptr;
+            if (op.clear) {
+                std::memset(key, 0, key_size);
+            }
+
+            const auto count = static_cast<size_t>(op.x1 - op.x0);
+            for (auto y = std::max(op.y0, y0); y < std::min(op.y1, y1); ++y) {
+                const auto* row = fetch_row(op, y, pixels.data());
+                if (!row) {
+                    continue;
+                }
+
+                const auto offset = static_cast<size_t>(y - y0) * width + op.x0;
+                if (op.is_key) {
+                    blend_key(key + offset, row, count);
+                    continue;
+                }
+
+                const std::uint8_t* mask = nullptr;
+                if (key && layer_key) {
+                    for (size_t n = 0; n < count; ++n) {
+                        coverage[n] = static_cast<std::uint8_t>(mul255(key[offset + n], layer_key[offset + n]));
+                    }
+                    mask = coverage.data();
+                } else if (key || layer_key) {
+                    mask = (key ? key : layer_key) + offset;
+                }
+
+                blend_bgra(target + (static_cast<size_t>(y) * width + op.x0) * 4, row, mask, op.opacity, count);
+            }
+        }
+    }
+
+    // Studio range Y'CbCr of a line of bgra, Y' from 0 to 1 and Cb and Cr from -0.5 to 0.5.
+    static void to_ycbcr(const std::uint8_t* src, int width, bool hd, float* y, float* cb, float* cr)
+    {
+        const auto kr = hd ? 0.2126f : 0.299f;
+        const auto kb = hd ? 0.0722f : 0.114f;
+        const auto kg = 1.0f - kr - kb;
+        for (int x = 0; x < width; ++x) {
+            const auto b = src[x * 4] / 255.0f;
+            const auto g = src[x * 4 + 1] / 255.0f;
+            const auto r = src[x * 4 + 2] / 255.0f;
+            y[x]         = kr * r + kg * g + kb * b;
+            cb[x]        = (b - y[x]) / (2.0f * (1.0f - kb));
+            cr[x]        = (r - y[x]) / (2.0f * (1.0f - kr));
+        }
+    }
+
+    static std::uint8_t to_8bit_luma(float y)
+    {
+        return static_cast<std::uint8_t>(std::clamp(std::lround(16.0f + 219.0f * y), 0L, 255L));
+    }
+
+    static std::uint8_t to_8bit_chroma(float c)
+    {
+        return static_cast<std::uint8_t>(std::clamp(std::lround(128.0f + 224.0f * c), 0L, 255L));
+    }
+
+    static std::uint32_t to_10bit_luma(float y)
+    {
+        return static_cast<std::uint32_t>(std::clamp(std::lround(64.0f + 876.0f * y), 4L, 1019L));
+    }
+
+    static std::uint32_t to_10bit_chroma(float c)
+    {
+        return static_cast<std::uint32_t>(std::clamp(std::lround(512.0f + 896.0f * c), 4L, 1019L));
+    }
+
+    // Logs what the mixer can't draw once per channel.
+    void warn(const std::wstring& message) const
+    {
+        std::lock_guard<std::mutex> lock(warnings_mutex_);
+        if (warnings_.insert(message).second) {
+            CASPAR_LOG(warning) << L"[cpu_image_mixer] Channel " << channel_id_ << L": " << message;
+        }
+    }
+};
+
+} // namespace
+
+struct image_mixer::impl : public core::frame_factory
+{
+    const int      channel_id_;
+    image_renderer renderer_;
+    layer_builder  builder_;
+
+    mutable std::mutex        timings_mutex_;
+    core::image_mixer_timings timings_;
+
+    // Declared last, so that nothing it runs outlives the rest.
+    executor executor_;
+
+  public:
+    explicit impl(const int channel_id)
+        : channel_id_(channel_id)
+        , renderer_(channel_id)
+        , executor_(L"cpu_image_mixer[" + std::to_wstring(channel_id) + L"]")
+    {
+        CASPAR_LOG(info) << L"Initialized CPU Image Mixer for channel " << channel_id;
+    }
+
+    void push(const core::frame_transform& transform) { builder_.push(transform); }
+
+    void visit(const core::const_frame& frame) { builder_.visit(frame); }
+
+    void pop() { builder_.pop(); }
+
+    std::future<std::vector<array<const std::uint8_t>>>
+    render(const core::video_format_desc&                 format_desc,
+           const std::vector<core::output_format>&        formats,
+           const std::vector<core::scaled_output_format>& scaled_formats)
+    {
+        auto list = builder_.take();
+        if (formats.empty() && scaled_formats.empty()) { // Nobody is consuming the frame.
+            return make_ready_future(std::vector<array<const std::uint8_t>>{});
+        }
+
+        // Frames are drawn one after the other while the channel goes on with the next.
+        return executor_.begin_invoke([=, list = std::move(list)] {
+            diagnostics::trace::span span("cpu.draw", -1, -1, "cpu");
+
+            const auto start = std::chrono::steady_clock::now();
+            auto       image = renderer_.draw(*list, format_desc);
+            const auto drawn = std::chrono::steady_clock::now();
+
+            std::vector<array<const std::uint8_t>> images;
+            for (auto format : formats) {
+                images.push_back(image_renderer::convert(image, format, format_desc));
+            }
+            for (auto& scaled : scaled_formats) {
+                auto scaled_desc   = format_desc;
+                scaled_desc.width  = scaled.width;
+                scaled_desc.height = scaled.height;
+                scaled_desc.size   = static_cast<size_t>(scaled.width) * scaled.height * 4;
+                images.push_back(image_renderer::convert(
+                    image_renderer::scale(image, format_desc.width, format_desc.height, scaled.width, scaled.height),
+                    scaled.format,
+                    scaled_desc));
+            }
+            const auto converted = std::chrono::steady_clock::now();
+
+            // The time spent mixing, in the place of the gpu time.
+            {
+                std::lock_guard<std::mutex> lock(timings_mutex_);
+                timings_         = {};
+                timings_.total   = std::chrono::duration<double>(converted - start).count();
+                timings_.convert = std::chrono::duration<double>(converted - drawn).count();
+            }
+
+            return images;
+        });
+    }
+
+    // Drawn on the calling thread, apart from the channel's frames.
+    std::future<array<const std::uint8_t>>
+    read(const core::draw_frame& frame, const core::video_format_desc& format_desc, core::output_format format)
+    {
+        layer_builder builder;
+        frame.accept(builder);
+        auto list = builder.take();
+        if (list->layers.empty() || format == core::output_format::texture) {
+            return make_ready_future(array<const std::uint8_t>{});
+        }
+
+        return make_ready_future(image_renderer::convert(renderer_.draw(*list, format_desc), format, format_desc));
+    }
+
+    core::image_mixer_timings timings() const
+    {
+        std::lock_guard<std::mutex> lock(timings_mutex_);
+        return timings_;
+    }
+
+    core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override
+    {
+        core::image_data_t image_data;
+        for (auto& plane : desc.planes) {
+            image_data.push_back(create_array(plane.size));
+        }
+
+        return create_frame(tag, desc, std::move(image_data));
+    }
+
+    array<std::uint8_t> create_array(int size) override { return create_buffer(static_cast<size_t>(size)); }
+
+    // The images are drawn straight from host memory, nothing is committed.
+    core::mutable_frame create_frame(const void*                    tag,
+                                     const core::pixel_format_desc& desc,
+                                     core::image_data_t             image_data) override
+    {
+        return core::mutable_frame(tag, std::move(image_data), array<int32_t>{}, desc);
+    }
+};
+
+image_mixer::image_mixer(const int channel_id)
+    : impl_(std::make_unique<impl>(channel_id))
+{
+}
+image_mixer::~image_mixer() {}
+void image_mixer::push(const core::frame_transform& transform) { impl_->push(transform); }
+void image_mixer::visit(const core::const_frame& frame) { impl_->visit(frame); }
+void image_mixer::pop() { impl_->pop(); }
+std::future<std::vector<array<const std::uint8_t>>>
+image_mixer::operator()(const core::video_format_desc&                 format_desc,
+                        const std::vector<core::output_format>&        formats,
+                        const std::vector<core::scaled_output_format>& scaled_formats,
+                        const std::vector<int>&                        layers)
+{
+    return impl_->render(format_desc, formats, scaled_formats);
+}
+std::future<array<const std::uint8_t>> image_mixer::read(const core::draw_frame&        frame,
+                                                         const core::video_format_desc& format_desc,
+                                                         core::output_format            format)
+{
+    return impl_->read(frame, format_desc, format);
+}
+core::image_mixer_timings image_mixer::timings() const { return impl_->timings(); }
+core::mutable_frame       image_mixer::create_frame(const void* tag, const core::pixel_format_desc& desc)
+{
+    return impl_->create_frame(tag, desc);
+}
+array<std::uint8_t> image_mixer::create_array(int size) { return impl_->create_array(size); }
+core::mutable_frame image_mixer::create_frame(const void*                    tag,
+                                              const core::pixel_format_desc& desc,
+                                              core::image_data_t             image_data)
+{
+    return impl_->create_frame(tag, desc, std::move(image_data));
+}
+
+}}} // namespace caspar::accelerator::cpu
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/array.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/image/image_mixer.h>
+#include <core/video_format.h>
+
+#include <future>
+#include <memory>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace cpu {
+
+// Mixes on the cpu, for channels on machines without a gpu. Frames stay in host memory, nothing is uploaded. Rows
+// are drawn in bands across the cores, each band blending every layer with SIMD kernels.
+//
+// Draws what most channels use: fill, clip, crop and opacity, the local and layer keys, and every pixel format but
+// the block compressed ones. Rotated, perspective and non rectangular images aren't drawn, and blend modes, mixes,
+// levels, contrast, saturation, brightness, chroma keys, inverting and edge blending are ignored. Images are sampled
+// nearest, without filtering.
+class image_mixer final : public core::image_mixer
+{
+  public:
+    explicit image_mixer(int channel_id);
+    image_mixer(const image_mixer&) = delete;
+
+    ~image_mixer();
+
+    image_mixer& operator=(const image_mixer&) = delete;
+
+    std::future<std::vector<array<const std::uint8_t>>>
+                              operator()(const core::video_format_desc&                 format_desc,
+                                         const std::vector<core::output_format>&        formats,
+                                         const std::vector<core::scaled_output_format>& scaled_formats,
+                                         const std::vector<int>&                        layers) override;
+    std::future<array<const std::uint8_t>>
+                              read(const core::draw_frame&        frame,
+                                   const core::video_format_desc& format_desc,
+                                   core::output_format            format) override;
+    core::image_mixer_timings timings() const override;
+    core::mutable_frame       create_frame(const void* tag, const core::pixel_format_desc& desc) override;
+    array<std::uint8_t>       create_array(int size) override;
+    core::mutable_frame       create_frame(const void*                    tag,
+                                           const core::pixel_format_desc& desc,
+                                           core::image_data_t             image_data) override;
+
+    // core::image_mixer
+
+    void push(const core::frame_transform& frame) override;
+    void visit(const core::const_frame& frame) override;
+    void pop() override;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::accelerator::cpu
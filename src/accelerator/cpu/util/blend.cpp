@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "blend.h"
+
+#include <cstring>
+
+#ifdef USE_SIMDE
+#define SIMDE_ENABLE_NATIVE_ALIASES
+#include <simde/x86/ssse3.h>
+#else
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <tmmintrin.h>
+#endif
+#endif
+
+#if !defined(USE_SIMDE) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#define CASPAR_SIMD_DISPATCH
+#include <immintrin.h>
+#endif
+
+#if defined(CASPAR_SIMD_DISPATCH) && defined(_MSC_VER) && !defined(__clang__)
+#define CASPAR_TARGET(isa)
+#elif defined(CASPAR_SIMD_DISPATCH)
+#define CASPAR_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace caspar { namespace accelerator { namespace cpu {
+
+namespace {
+
+using blend_func = void (*)(std::uint8_t*, const std::uint8_t*, const std::uint8_t*, int, std::size_t);
+
+// The pixels left over by the vector kernels.
+void blend_tail(std::uint8_t*       dest,
+                const std::uint8_t* source,
+                const std::uint8_t* coverage,
+                int                 opacity,
+                size_t              count)
+{
+    for (size_t n = 0; n < count; ++n) {
+        const auto k     = coverage ? mul255(coverage[n], opacity) : opacity;
+        const auto alpha = mul255(source[n * 4 + 3], k);
+        for (int c = 0; c < 4; ++c) {
+            const auto value = mul255(source[n * 4 + c], k) + mul255(dest[n * 4 + c], 255 - alpha);
+            dest[n * 4 + c]  = static_cast<std::uint8_t>(value < 255 ? value : 255);
+        }
+    }
+}
+
+// The pixels are widened to 16 bit words, two to a half, and x / 255 is taken as (x + 128) * 257 >> 16.
+inline __m128i div255_sse(__m128i x)
+{
+    return _mm_mulhi_epu16(_mm_add_epi16(x, _mm_set1_epi16(128)), _mm_set1_epi16(257));
+}
+
+void blend_ssse3(std::uint8_t*       dest,
+                 const std::uint8_t* source,
+                 const std::uint8_t* coverage,
+                 int                 opacity,
+                 size_t              count)
+{
+    const __m128i zero    = _mm_setzero_si128();
+    const __m128i max     = _mm_set1_epi16(255);
+    const __m128i alpha   = _mm_set1_epi16(static_cast<short>(opacity));
+    const __m128i lo_mask = _mm_setr_epi8(0, 1, 0, 1, 0, 1, 0, 1, 2, 3, 2, 3, 2, 3, 2, 3);
+    const __m128i hi_mask = _mm_setr_epi8(4, 5, 4, 5, 4, 5, 4, 5, 6, 7, 6, 7, 6, 7, 6, 7);
+
+    size_t n = 0;
+    for (; n + 4 <= count; n += 4) {
+        __m128i k_lo = alpha;
+        __m128i k_hi = alpha;
+        if (coverage) {
+            int bytes;
+            std::memcpy(&bytes, coverage + n, 4);
+            auto k = div255_sse(_mm_mullo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), alpha));
+            k_lo   = _mm_shuffle_epi8(k, lo_mask);
+            k_hi   = _mm_shuffle_epi8(k, hi_mask);
+        }
+
+        auto src = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n * 4));
+        auto dst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dest + n * 4));
+
+        auto s_lo = div255_sse(_mm_mullo_epi16(_mm_unpacklo_epi8(src, zero), k_lo));
+        auto s_hi = div255_sse(_mm_mullo_epi16(_mm_unpackhi_epi8(src, zero), k_hi));
+        auto a_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_lo, 0xFF), 0xFF);
+        auto a_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_hi, 0xFF), 0xFF);
+        auto d_lo = div255_sse(_mm_mullo_epi16(_mm_unpacklo_epi8(dst, zero), _mm_sub_epi16(max, a_lo)));
+        auto d_hi = div255_sse(_mm_mullo_epi16(_mm_unpackhi_epi8(dst, zero), _mm_sub_epi16(max, a_hi)));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n * 4),
+                         _mm_packus_epi16(_mm_add_epi16(s_lo, d_lo), _mm_add_epi16(s_hi, d_hi)));
+    }
+    blend_tail(dest + n * 4, source + n * 4, coverage ? coverage + n : nullptr, opacity, count - n);
+}
+
+#ifdef CASPAR_SIMD_DISPATCH
+
+CASPAR_TARGET("avx2")
+inline __m256i div255_avx2(__m256i x)
+{
+    return _mm256_mulhi_epu16(_mm256_add_epi16(x, _mm256_set1_epi16(128)), _mm256_set1_epi16(257));
+}
+
+CASPAR_TARGET("avx2")
+void blend_avx2(std::uint8_t*       dest,
+                const std::uint8_t* source,
+                const std::uint8_t* coverage,
+                int                 opacity,
+                size_t              count)
+{
+    const __m256i zero  = _mm256_setzero_si256();
+    const __m256i max   = _mm256_set1_epi16(255);
+    const __m256i alpha = _mm256_set1_epi16(static_cast<short>(opacity));
+
+    // Unpacking works within 128 bit lanes, the low half of the second lane holds pixels 4 and 5.
+    const __m256i lo_mask = _mm256_setr_epi8(
+        0, 1, 0, 1, 0, 1, 0, 1, 2, 3, 2, 3, 2, 3, 2, 3, 8, 9, 8, 9, 8, 9, 8, 9, 10, 11, 10, 11, 10, 11, 10, 11);
+    const __m256i hi_mask = _mm256_setr_epi8(
+        4, 5, 4, 5, 4, 5, 4, 5, 6, 7, 6, 7, 6, 7, 6, 7, 12, 13, 12, 13, 12, 13, 12, 13, 14, 15, 14, 15, 14, 15, 14, 15);
+
+    size_t n = 0;
+    for (; n + 8 <= count; n += 8) {
+        __m256i k_lo = alpha;
+        __m256i k_hi = alpha;
+        if (coverage) {
+            auto bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(coverage + n));
+            auto k     = div255_avx2(_mm256_mullo_epi16(_mm256_broadcastsi128_si256(_mm_cvtepu8_epi16(bytes)), alpha));
+            k_lo       = _mm256_shuffle_epi8(k, lo_mask);
+            k_hi       = _mm256_shuffle_epi8(k, hi_mask);
+        }
+
+        auto src = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n * 4));
+        auto dst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dest + n * 4));
+
+        auto s_lo = div255_avx2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(src, zero), k_lo));
+        auto s_hi = div255_avx2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(src, zero), k_hi));
+        auto a_lo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s_lo, 0xFF), 0xFF);
+        auto a_hi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s_hi, 0xFF), 0xFF);
+        auto d_lo = div255_avx2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(dst, zero), _mm256_sub_epi16(max, a_lo)));
+        auto d_hi = div255_avx2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(dst, zero), _mm256_sub_epi16(max, a_hi)));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + n * 4),
+                            _mm256_packus_epi16(_mm256_add_epi16(s_lo, d_lo), _mm256_add_epi16(s_hi, d_hi)));
+    }
+    blend_ssse3(dest + n * 4, source + n * 4, coverage ? coverage + n : nullptr, opacity, count - n);
+}
+
+CASPAR_TARGET("avx512f,avx512bw")
+inline __m512i div255_avx512(__m512i x)
+{
+    return _mm512_mulhi_epu16(_mm512_add_epi16(x, _mm512_set1_epi16(128)), _mm512_set1_epi16(257));
+}
+
+CASPAR_TARGET("avx512f,avx512bw")
+void blend_avx512(std::uint8_t*       dest,
+                  const std::uint8_t* source,
+                  const std::uint8_t* coverage,
+                  int                 opacity,
+                  size_t              count)
+{
+    const __m512i zero  = _mm512_setzero_si512();
+    const __m512i max   = _mm512_set1_epi16(255);
+    const __m512i alpha = _mm512_set1_epi16(static_cast<short>(opacity));
+
+    // Word j of the low halves belongs to pixel 4 * (j / 8) + j % 8 / 4, the high halves are two pixels on.
+    std::uint16_t lo_index[32];
+    std::uint16_t hi_index[32];
+    for (int j = 0; j < 32; ++j) {
+        lo_index[j] = static_cast<std::uint16_t>(4 * (j / 8) + j % 8 / 4);
+        hi_index[j] = static_cast<std::uint16_t>(lo_index[j] + 2);
+    }
+    const __m512i lo_perm = _mm512_loadu_si512(lo_index);
+    const __m512i hi_perm = _mm512_loadu_si512(hi_index);
+
+    size_t n = 0;
+    for (; n + 16 <= count; n += 16) {
+        __m512i k_lo = alpha;
+        __m512i k_hi = alpha;
+        if (coverage) {
+            auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(coverage + n));
+            auto k = _mm512_castsi256_si512(_mm256_cvtepu8_epi16(bytes));
+            k      = div255_avx512(_mm512_mullo_epi16(k, alpha));
+            k_lo   = _mm512_permutexvar_epi16(lo_perm, k);
+            k_hi   = _mm512_permutexvar_epi16(hi_perm, k);
+        }
+
+        auto src = _mm512_loadu_si512(source + n * 4);
+        auto dst = _mm512_loadu_si512(dest + n * 4);
+
+        auto s_lo = div255_avx512(_mm512_mullo_epi16(_mm512_unpacklo_epi8(src, zero), k_lo));
+        auto s_hi = div255_avx512(_mm512_mullo_epi16(_mm512_unpackhi_epi8(src, zero), k_hi));
+        auto a_lo = _mm512_shufflehi_epi16(_mm512_shufflelo_epi16(s_lo, 0xFF), 0xFF);
+        auto a_hi = _mm512_shufflehi_epi16(_mm512_shufflelo_epi16(s_hi, 0xFF), 0xFF);
+        auto d_lo = div255_avx512(_mm512_mullo_epi16(_mm512_unpacklo_epi8(dst, zero), _mm512_sub_epi16(max, a_lo)));
+        auto d_hi = div255_avx512(_mm512_mullo_epi16(_mm512_unpackhi_epi8(dst, zero), _mm512_sub_epi16(max, a_hi)));
+
+        _mm512_storeu_si512(dest + n * 4,
+                            _mm512_packus_epi16(_mm512_add_epi16(s_lo, d_lo), _mm512_add_epi16(s_hi, d_hi)));
+    }
+    blend_ssse3(dest + n * 4, source + n * 4, coverage ? coverage + n : nullptr, opacity, count - n);
+}
+
+enum class cpu_level
+{
+    ssse3,
+    avx2,
+    avx512
+};
+
+cpu_level detect_cpu_level()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return cpu_level::ssse3;
+    }
+    __cpuid(info, 1);
+    const bool os_avx = (info[2] & (1 << 27)) && (_xgetbv(0) & 0x06) == 0x06;
+    const bool os_512 = os_avx && (_xgetbv(0) & 0xE6) == 0xE6;
+    __cpuidex(info, 7, 0);
+    if (os_512 && (info[1] & (1 << 16)) && (info[1] & (1 << 30))) {
+        return cpu_level::avx512;
+    }
+    if (os_avx && (info[1] & (1 << 5))) {
+        return cpu_level::avx2;
+    }
+    return cpu_level::ssse3;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+        return cpu_level::avx512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return cpu_level::avx2;
+    }
+    return cpu_level::ssse3;
+#endif
+}
+
+#endif
+
+blend_func get_blend()
+{
+#ifdef CASPAR_SIMD_DISPATCH
+    switch (detect_cpu_level()) {
+        case cpu_level::avx512:
+            return blend_avx512;
+        case cpu_level::avx2:
+            return blend_avx2;
+        default:
+            break;
+    }
+#endif
+    // simde maps these to NEON on arm.
+    return blend_ssse3;
+}
+
+} // namespace
+
+void blend_bgra(std::uint8_t*       dest,
+                const std::uint8_t* source,
+                const std::uint8_t* coverage,
+                int                 opacity,
+                std::size_t         count)
+{
+    static const auto func = get_blend();
+
+    func(dest, source, coverage, opacity, count);
+}
+
+void blend_key(std::uint8_t* dest, const std::uint8_t* source, std::size_t count)
+{
+    for (size_t n = 0; n < count; ++n) {
+        const auto value = source[n * 4] + mul255(dest[n], 255 - source[n * 4 + 3]);
+        dest[n]          = static_cast<std::uint8_t>(value < 255 ? value : 255);
+    }
+}
+
+}}} // namespace caspar::accelerator::cpu
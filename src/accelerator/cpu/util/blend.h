@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace caspar { namespace accelerator { namespace cpu {
+
+// Blends count premultiplied bgra pixels of source over dest, like the gl mixer's normal blend. Each source pixel is
+// scaled by opacity and, unless coverage is null, by its byte of coverage, both from 0 to 255. Uses the widest
+// instruction set the cpu supports, neither pointer needs to be aligned.
+void blend_bgra(std::uint8_t*       dest,
+                const std::uint8_t* source,
+                const std::uint8_t* coverage,
+                int                 opacity,
+                std::size_t         count);
+
+// Blends count pixels of source into a key, a byte per pixel, the way the gl mixer draws keys into its one channel
+// texture: the blue channel over what is there, by the alpha.
+void blend_key(std::uint8_t* dest, const std::uint8_t* source, std::size_t count);
+
+// x * y / 255, rounded, for x and y from 0 to 255.
+inline int mul255(int x, int y) { return ((x * y + 128) * 257) >> 16; }
+
+}}} // namespace caspar::accelerator::cpu
@@ -0,0 +1,40 @@
+#version 450
+in vec4 TexCoord;
+in vec4 TexCoord2;
+out vec4 fragColor;
+
+// Reduces a block of a mixed BGRA frame to one texel of the grid of frame_analyzer: the average Y' of the block in
+// red and its average difference in Y' to the previous frame in green.
+
+uniform sampler2D source;
+uniform sampler2D previous;
+uniform bool      has_previous;
+uniform vec2      grid;    // columns and rows of blocks
+uniform vec2      samples; // per block, across and down
+
+float luma(vec4 bgra)
+{
+    return dot(bgra.bgr, vec3(0.2126, 0.7152, 0.0722));
+}
+
+void main()
+{
+    // The samples are spread evenly over the block, each filtered from the pixels around it.
+    vec2 block = floor(gl_FragCoord.xy);
+
+    float sum        = 0.0;
+    float difference = 0.0;
+    for (int y = 0; y < int(samples.y); ++y) {
+        for (int x = 0; x < int(samples.x); ++x) {
+            vec2  pos   = (block + (vec2(x, y) + 0.5) / samples) / grid;
+            float value = luma(texture(source, pos));
+            sum += value;
+            if (has_previous) {
+                difference += abs(value - luma(texture(previous, pos)));
+            }
+        }
+    }
+
+    float count = samples.x * samples.y;
+    fragColor   = vec4(sum / count, difference / count, 0.0, 1.0);
+}
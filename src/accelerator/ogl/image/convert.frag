@@ -0,0 +1,209 @@
+#version 450
+in vec4 TexCoord;
+in vec4 TexCoord2;
+out vec4 fragColor;
+
+// Converts a mixed BGRA frame into one of core::output_format. Each fragment writes one texel of the packed
+// target, whose size was chosen by output_converter so that reading it back yields the packed layout. The fields of
+// an interlaced frame, mixed as two frames, are woven on the way, and frames for smaller outputs scaled down.
+
+uniform sampler2D source;
+uniform sampler2D second;
+uniform int       format;
+uniform bool      is_hd;
+// 0 for a frame, otherwise 1 + the parity of the lines taken from second, which holds the other field.
+uniform int       weave;
+// Of the converted image, smaller than the source when it is scaled down.
+uniform ivec2     image_size;
+
+const int FORMAT_UYVY    = 1;
+const int FORMAT_V210    = 2;
+const int FORMAT_YUVA422 = 3;
+const int FORMAT_UYVA    = 4;
+const int FORMAT_KEY     = 6;
+
+// Averages the footprint of an image pixel in the source. Each bilinear tap averages 2x2 texels, so the taps are
+// spread two texels apart.
+vec4 get_scaled_rgba(ivec2 pos)
+{
+    vec2  source_size = vec2(textureSize(source, 0));
+    vec2  scale       = source_size / vec2(image_size);
+    ivec2 taps        = max(ivec2(ceil(scale * 0.5)), ivec2(1));
+    vec4  sum         = vec4(0.0);
+    for (int j = 0; j < taps.y; ++j) {
+        for (int i = 0; i < taps.x; ++i) {
+            vec2 coords = (vec2(pos) + (vec2(i, j) + 0.5) / vec2(taps)) * scale;
+            sum += texture(source, coords / source_size);
+        }
+    }
+    return (sum / float(taps.x * taps.y)).bgra;
+}
+
+vec4 get_rgba(int x, int y)
+{
+    ivec2 pos = ivec2(clamp(x, 0, image_size.x - 1), y);
+    if (image_size != textureSize(source, 0))
+        return get_scaled_rgba(pos);
+    if (weave != 0 && (y & 1) == weave - 1)
+        return texelFetch(second, pos, 0).bgra;
+    return texelFetch(source, pos, 0).bgra;
+}
+
+// Studio range Y'CbCr scaled to [0, 1] for Y and [-0.5, 0.5] for Cb and Cr.
+vec3 rgb_to_ycbcr(vec3 rgb)
+{
+    vec3 coeff = is_hd ? vec3(0.2126, 0.7152, 0.0722) : vec3(0.299, 0.587, 0.114);
+    float y = dot(rgb, coeff);
+    return vec3(y, (rgb.b - y) / (2.0 * (1.0 - coeff.b)), (rgb.r - y) / (2.0 * (1.0 - coeff.r)));
+}
+
+float luma(int x, int y)
+{
+    return rgb_to_ycbcr(get_rgba(x, y).rgb).x;
+}
+
+// Chroma of the pixel pair starting at the even pixel x.
+vec2 chroma(int x, int y)
+{
+    vec3 a = rgb_to_ycbcr(get_rgba(x, y).rgb);
+    vec3 b = rgb_to_ycbcr(get_rgba(x + 1, y).rgb);
+    return (a.yz + b.yz) * 0.5;
+}
+
+float to_8bit_luma(float y)
+{
+    return clamp(round(16.0 + 219.0 * y), 0.0, 255.0);
+}
+
+float to_8bit_chroma(float c)
+{
+    return clamp(round(128.0 + 224.0 * c), 0.0, 255.0);
+}
+
+uint to_10bit_luma(float y)
+{
+    return uint(clamp(round(64.0 + 876.0 * y), 4.0, 1019.0));
+}
+
+uint to_10bit_chroma(float c)
+{
+    return uint(clamp(round(512.0 + 896.0 * c), 4.0, 1019.0));
+}
+
+vec4 uyvy(ivec2 pos)
+{
+    int  x  = pos.x * 2;
+    vec2 cc = chroma(x, pos.y);
+    return vec4(to_8bit_chroma(cc.x),
+                to_8bit_luma(luma(x, pos.y)),
+                to_8bit_chroma(cc.y),
+                to_8bit_luma(luma(x + 1, pos.y))) / 255.0;
+}
+
+vec4 v210(ivec2 pos)
+{
+    // Every group of 4 words carries 6 pixels.
+    int x = pos.x / 4 * 6;
+    int y = pos.y;
+
+    uint c0, c1, c2;
+    switch (pos.x % 4)
+    {
+    case 0:
+        {
+            vec2 cc = chroma(x, y);
+            c0 = to_10bit_chroma(cc.x);
+            c1 = to_10bit_luma(luma(x, y));
+            c2 = to_10bit_chroma(cc.y);
+            break;
+        }
+    case 1:
+        {
+            c0 = to_10bit_luma(luma(x + 1, y));
+            c1 = to_10bit_chroma(chroma(x + 2, y).x);
+            c2 = to_10bit_luma(luma(x + 2, y));
+            break;
+        }
+    case 2:
+        {
+            vec2 cc = chroma(x + 4, y);
+            c0 = to_10bit_chroma(chroma(x + 2, y).y);
+            c1 = to_10bit_luma(luma(x + 3, y));
+            c2 = to_10bit_chroma(cc.x);
+            break;
+        }
+    default:
+        {
+            c0 = to_10bit_luma(luma(x + 4, y));
+            c1 = to_10bit_chroma(chroma(x + 4, y).y);
+            c2 = to_10bit_luma(luma(x + 5, y));
+            break;
+        }
+    }
+
+    uint word = c0 | (c1 << 10) | (c2 << 20);
+    return vec4(word & 0xFFu, (word >> 8) & 0xFFu, (word >> 16) & 0xFFu, word >> 24) / 255.0;
+}
+
+vec4 yuva422(ivec2 pos)
+{
+    int height = image_size.y;
+    int half_width = image_size.x / 2;
+
+    if (pos.y < height)
+        return vec4(to_8bit_luma(luma(pos.x, pos.y)) / 255.0);
+
+    if (pos.y < height * 2) {
+        int y = pos.y - height;
+        if (pos.x < half_width)
+            return vec4(to_8bit_chroma(chroma(pos.x * 2, y).x) / 255.0);
+        return vec4(to_8bit_chroma(chroma((pos.x - half_width) * 2, y).y) / 255.0);
+    }
+
+    return vec4(get_rgba(pos.x, pos.y - height * 2).a);
+}
+
+vec4 uyva(ivec2 pos)
+{
+    ivec2 size = image_size;
+
+    if (pos.y < size.y)
+        return uyvy(pos);
+
+    // Each texel below the uyvy lines carries the next 4 bytes of the alpha plane.
+    int  offset = ((pos.y - size.y) * (size.x / 2) + pos.x) * 4;
+    vec4 alpha;
+    for (int n = 0; n < 4; ++n) {
+        int x = (offset + n) % size.x;
+        int y = (offset + n) / size.x;
+        alpha[n] = y < size.y ? get_rgba(x, y).a : 0.0;
+    }
+    return alpha;
+}
+
+void main()
+{
+    ivec2 pos = ivec2(gl_FragCoord.xy);
+
+    switch (format)
+    {
+    case FORMAT_UYVY:
+        fragColor = uyvy(pos);
+        break;
+    case FORMAT_V210:
+        fragColor = v210(pos);
+        break;
+    case FORMAT_YUVA422:
+        fragColor = yuva422(pos);
+        break;
+    case FORMAT_UYVA:
+        fragColor = uyva(pos);
+        break;
+    case FORMAT_KEY:
+        fragColor = vec4(get_rgba(pos.x, pos.y).a);
+        break;
+    default:
+        fragColor = get_rgba(pos.x, pos.y).bgra;
+        break;
+    }
+}
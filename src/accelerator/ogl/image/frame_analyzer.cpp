@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "frame_analyzer.h"
+
+#include "../util/device.h"
+#include "../util/shader.h"
+#include "../util/texture.h"
+
+#include <common/array.h>
+#include <common/gl/gl_check.h>
+
+#include <core/frame/geometry.h>
+
+#include <GL/glew.h>
+
+#include "ogl_analyze_fragment.h"
+#include "ogl_image_vertex.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+namespace {
+
+// The grid is 4x4 blocks for each cell of the 9x8 thumbnail the hash is taken from.
+const int cell_size    = 4;
+const int hash_columns = 9;
+const int hash_rows    = 8;
+const int grid_columns = hash_columns * cell_size;
+const int grid_rows    = hash_rows * cell_size;
+
+// Grids not read back after this many frames are not waited for, later frames are skipped until they are.
+const size_t max_pending = 4;
+
+struct pending_analysis
+{
+    std::future<array<const std::uint8_t>> grid;
+    bool                                   has_previous = false;
+};
+
+core::image_analysis analyze(const array<const std::uint8_t>& data, bool has_previous)
+{
+    // Red and green of each block, 16 bits each.
+    std::vector<std::uint16_t> grid(grid_columns * grid_rows * 2);
+    std::memcpy(grid.data(), data.data(), std::min(data.size(), grid.size() * sizeof(std::uint16_t)));
+
+    core::image_analysis result;
+    result.valid = true;
+
+    double luma       = 0.0;
+    double difference = 0.0;
+
+    double cells[hash_rows][hash_columns] = {};
+    for (int y = 0; y < grid_rows; ++y) {
+        for (int x = 0; x < grid_columns; ++x) {
+            auto block = &grid[(y * grid_columns + x) * 2];
+            luma += block[0];
+            difference += block[1];
+            cells[y / cell_size][x / cell_size] += block[0];
+        }
+    }
+
+    const double scale = 1.0 / (65535.0 * grid_columns * grid_rows);
+    result.luma        = luma * scale;
+    if (has_previous) {
+        result.difference = difference * scale;
+    }
+
+    // A bit for each pair of neighbouring cells in a row, set where the left one is brighter.
+    for (int y = 0; y < hash_rows; ++y) {
+        for (int x = 0; x + 1 < hash_columns; ++x) {
+            result.hash = result.hash << 1 | (cells[y][x] > cells[y][x + 1] ? 1 : 0);
+        }
+    }
+
+    return result;
+}
+
+} // namespace
+
+struct frame_analyzer::impl
+{
+    spl::shared_ptr<device>      ogl_;
+    std::unique_ptr<shader>      shader_;
+    GLuint                       vao_;
+    GLuint                       vbo_;
+    std::shared_ptr<texture>     previous_;
+    std::deque<pending_analysis> pending_;
+    mutable std::mutex           mutex_;
+    core::image_analysis         analysis_;
+
+    explicit impl(const spl::shared_ptr<device>& ogl)
+        : ogl_(ogl)
+    {
+        ogl_->dispatch_sync([&] {
+            shader_ = std::make_unique<shader>(std::string(vertex_shader), std::string(analyze_fragment_shader));
+            shader_->use();
+            shader_->set("source", 0);
+            shader_->set("previous", 1);
+            shader_->set("grid", static_cast<double>(grid_columns), static_cast<double>(grid_rows));
+
+            auto coords = core::frame_geometry::get_default().data();
+
+            std::vector<core::frame_geometry::coord> coords_triangles{
+                coords[0], coords[1], coords[2], coords[0], coords[2], coords[3]};
+
+            GL(glGenVertexArrays(1, &vao_));
+            GL(glGenBuffers(1, &vbo_));
+
+            GL(glBindVertexArray(vao_));
+            GL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
+            GL(glBufferData(GL_ARRAY_BUFFER,
+                            static_cast<GLsizeiptr>(sizeof(core::frame_geometry::coord)) * coords_triangles.size(),
+                            coords_triangles.data(),
+                            GL_STATIC_DRAW));
+
+            auto stride  = static_cast<GLsizei>(sizeof(core::frame_geometry::coord));
+            auto vtx_loc = shader_->get_attrib_location("Position");
+            auto tex_loc = shader_->get_attrib_location("TexCoordIn");
+
+            GL(glEnableVertexAttribArray(vtx_loc));
+            GL(glEnableVertexAttribArray(tex_loc));
+            GL(glVertexAttribPointer(vtx_loc, 2, GL_DOUBLE, GL_FALSE, stride, nullptr));
+            GL(glVertexAttribPointer(tex_loc, 4, GL_DOUBLE, GL_FALSE, stride, (GLvoid*)(2 * sizeof(GLdouble))));
+
+            GL(glBindVertexArray(0));
+            GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        });
+    }
+
+    ~impl()
+    {
+        ogl_->dispatch_sync([&] {
+            GL(glDeleteVertexArrays(1, &vao_));
+            GL(glDeleteBuffers(1, &vbo_));
+            shader_.reset();
+            previous_.reset();
+        });
+    }
+
+    // Takes the grids that have been read back, without waiting for the ones still in flight.
+    void collect()
+    {
+        while (!pending_.empty() &&
+               pending_.front().grid.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            auto analysis = analyze(pending_.front().grid.get(), pending_.front().has_previous);
+            pending_.pop_front();
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            analysis_ = analysis;
+        }
+    }
+
+    void operator()(const std::shared_ptr<texture>& source)
+    {
+        collect();
+        if (pending_.size() >= max_pending) {
+            previous_ = nullptr;
+            return;
+        }
+
+        // The difference is only taken to a frame of the same size, the first frame after a change has none.
+        auto has_previous = previous_ && previous_->width() == source->width() &&
+                            previous_->height() == source->height();
+
+        auto target = ogl_->create_texture(grid_columns, grid_rows, 2, texture_depth::bit16);
+
+        source->bind(0);
+        (has_previous ? previous_ : source)->bind(1);
+
+        shader_->use();
+        shader_->set("has_previous", has_previous);
+        // Up to 16 samples across and down each block, about one every other pixel of a small frame.
+        shader_->set("samples",
+                     static_cast<double>(std::clamp(source->width() / grid_columns / 2, 1, 16)),
+                     static_cast<double>(std::clamp(source->height() / grid_rows / 2, 1, 16)));
+
+        target->attach();
+        GL(glViewport(0, 0, grid_columns, grid_rows));
+        GL(glDisable(GL_BLEND));
+
+        GL(glBindVertexArray(vao_));
+        GL(glDrawArrays(GL_TRIANGLES, 0, 6));
+        GL(glBindVertexArray(0));
+
+        source->unbind();
+
+        pending_.push_back({ogl_->copy_async(target), has_previous});
+        previous_ = source;
+    }
+
+    core::image_analysis analysis() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return analysis_;
+    }
+};
+
+frame_analyzer::frame_analyzer(const spl::shared_ptr<device>& ogl)
+    : impl_(new impl(ogl))
+{
+}
+frame_analyzer::~frame_analyzer() {}
+void                 frame_analyzer::operator()(const std::shared_ptr<texture>& source) { (*impl_)(source); }
+core::image_analysis frame_analyzer::analysis() const { return impl_->analysis(); }
+
+}}} // namespace caspar::accelerator::ogl
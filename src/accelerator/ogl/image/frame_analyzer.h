@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/mixer/image/image_mixer.h>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+// Reduces mixed BGRA textures to a grid of block averages on the gpu, and reads back only the grid to measure the
+// frames by: the average luma, the difference to the frame before and a perceptual hash.
+class frame_analyzer final
+{
+    frame_analyzer(const frame_analyzer&);
+    frame_analyzer& operator=(const frame_analyzer&);
+
+  public:
+    explicit frame_analyzer(const spl::shared_ptr<class device>& ogl);
+    ~frame_analyzer();
+
+    // Queues the analysis of a frame against the one queued before it. Must be called on the ogl thread.
+    void operator()(const std::shared_ptr<class texture>& source);
+
+    // The analysis of the last frame whose grid has been read back. Safe to call from any thread.
+    core::image_analysis analysis() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::accelerator::ogl
@@ -31,14 +31,19 @@
 
 #include <core/frame/frame_transform.h>
 #include <core/frame/pixel_format.h>
+#include <core/video_format.h>
 
 #include <boost/algorithm/cxx11/all_of.hpp>
 #include <boost/range/adaptor/transformed.hpp>
 
 #include <GL/glew.h>
 
+#include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
@@ -86,40 +91,243 @@ double calc_q(double close_diagonal, double distant_diagonal)
     return (close_diagonal + distant_diagonal) / distant_diagonal;
 }
 
-bool is_above_screen(double y) { return y < 0.0; }
+// Less is not drawn at all.
+const double min_opacity = 0.001;
 
-bool is_below_screen(double y) { return y > 1.0; }
-
-bool is_left_of_screen(double x) { return x < 0.0; }
-
-bool is_right_of_screen(double x) { return x > 1.0; }
-
-bool is_outside_screen(const std::vector<core::frame_geometry::coord>& coords)
+// Where screen is (left, top, right, bottom), true if no part of the quads lies within it.
+bool is_outside(const std::vector<core::frame_geometry::coord>& coords, const std::array<double, 4>& screen)
 {
     auto x_coords =
         coords | boost::adaptors::transformed([](const core::frame_geometry::coord& c) { return c.vertex_x; });
     auto y_coords =
         coords | boost::adaptors::transformed([](const core::frame_geometry::coord& c) { return c.vertex_y; });
 
-    return boost::algorithm::all_of(x_coords, &is_left_of_screen) ||
-           boost::algorithm::all_of(x_coords, &is_right_of_screen) ||
-           boost::algorithm::all_of(y_coords, &is_above_screen) || boost::algorithm::all_of(y_coords, &is_below_screen);
+    return boost::algorithm::all_of(x_coords, [&](double x) { return x < screen[0]; }) ||
+           boost::algorithm::all_of(y_coords, [&](double y) { return y < screen[1]; }) ||
+           boost::algorithm::all_of(x_coords, [&](double x) { return x > screen[2]; }) ||
+           boost::algorithm::all_of(y_coords, [&](double y) { return y > screen[3]; });
+}
+
+bool is_outside_screen(const std::vector<core::frame_geometry::coord>& coords)
+{
+    return is_outside(coords, {0.0, 0.0, 1.0, 1.0});
+}
+
+std::vector<core::frame_geometry::coord>
+transform_coords(const core::image_transform& transform, const core::frame_geometry& geometry, double aspect_ratio)
+{
+    auto coords = geometry.data();
+
+    auto f_p = transform.fill_translation;
+    auto f_s = transform.fill_scale;
+
+    bool is_vflip            = boost::equal(coords, core::frame_geometry::get_default_vflip().data());
+    bool is_default_geometry = boost::equal(coords, core::frame_geometry::get_default().data()) || is_vflip;
+    auto aspect = aspect_ratio;
+    auto angle  = transform.angle;
+    auto anchor = transform.anchor;
+    auto crop   = transform.crop;
+    auto pers   = transform.perspective;
+    pers.ur[0] -= 1.0;
+    pers.lr[0] -= 1.0;
+    pers.lr[1] -= 1.0;
+    pers.ll[1] -= 1.0;
+    std::vector<std::array<double, 2>> pers_corners = {pers.ul, pers.ur, pers.lr, pers.ll};
+
+    auto do_crop = [&](core::frame_geometry::coord& coord) {
+        if (!is_default_geometry) {
+            // TODO implement support for non-default geometry.
+            return;
+        }
+
+        coord.vertex_x  = std::max(coord.vertex_x, crop.ul[0]);
+        coord.vertex_x  = std::min(coord.vertex_x, crop.lr[0]);
+        coord.vertex_y  = std::max(coord.vertex_y, crop.ul[1]);
+        coord.vertex_y  = std::min(coord.vertex_y, crop.lr[1]);
+        coord.texture_x = std::max(coord.texture_x, crop.ul[0]);
+        coord.texture_x = std::min(coord.texture_x, crop.lr[0]);
+        // Flipped textures run bottom up, so the crop of their rows is mirrored too.
+        coord.texture_y = std::max(coord.texture_y, is_vflip ? 1.0 - crop.lr[1] : crop.ul[1]);
+        coord.texture_y = std::min(coord.texture_y, is_vflip ? 1.0 - crop.ul[1] : crop.lr[1]);
+    };
+    auto do_perspective = [=](core::frame_geometry::coord& coord, const std::array<double, 2>& pers_corner) {
+        if (!is_default_geometry) {
+            // TODO implement support for non-default geometry.
+            return;
+        }
+
+        coord.vertex_x += pers_corner[0];
+        coord.vertex_y += pers_corner[1];
+    };
+    auto rotate = [&](core::frame_geometry::coord& coord) {
+        auto orig_x    = (coord.vertex_x - anchor[0]) * f_s[0];
+        auto orig_y    = (coord.vertex_y - anchor[1]) * f_s[1] / aspect;
+        coord.vertex_x = orig_x * std::cos(angle) - orig_y * std::sin(angle);
+        coord.vertex_y = orig_x * std::sin(angle) + orig_y * std::cos(angle);
+        coord.vertex_y *= aspect;
+    };
+    auto move = [&](core::frame_geometry::coord& coord) {
+        coord.vertex_x += f_p[0];
+        coord.vertex_y += f_p[1];
+    };
+
+    int corner = 0;
+    for (auto& coord : coords) {
+        do_crop(coord);
+        do_perspective(coord, pers_corners.at(corner));
+        rotate(coord);
+        move(coord);
+
+        if (++corner == 4) {
+            corner = 0;
+        }
+    }
+
+    return coords;
+}
+
+bool is_drawn(const core::image_transform& transform, const core::frame_geometry& geometry, double aspect_ratio)
+{
+    if (transform.opacity < min_opacity || !core::is_visible(transform)) {
+        return false;
+    }
+
+    auto coords = transform_coords(transform, geometry, aspect_ratio);
+    if (coords.empty()) {
+        return false;
+    }
+
+    // Nothing is drawn outside the clip, which draw() sets as the scissor rect.
+    const auto& m_p = transform.clip_translation;
+    const auto& m_s = transform.clip_scale;
+    return !is_outside(coords,
+                       {std::max(m_p[0], 0.0),
+                        std::max(m_p[1], 0.0),
+                        std::min(m_p[0] + m_s[0], 1.0),
+                        std::min(m_p[1] + m_s[1], 1.0)});
+}
+
+bool covers_screen(const core::image_transform& transform, const core::frame_geometry& geometry, double aspect_ratio)
+{
+    if (transform.opacity < 1.0 || transform.is_key || transform.is_mix || transform.invert ||
+        transform.chroma.enable || transform.blend_mode != core::blend_mode::normal) {
+        return false;
+    }
+
+    // Other geometries can be any set of triangles.
+    if (!boost::equal(geometry.data(), core::frame_geometry::get_default().data()) &&
+        !boost::equal(geometry.data(), core::frame_geometry::get_default_vflip().data())) {
+        return false;
+    }
+
+    for (int n = 0; n < 2; ++n) {
+        if (transform.clip_translation[n] > 0.0 || transform.clip_translation[n] + transform.clip_scale[n] < 1.0) {
+            return false;
+        }
+    }
+
+    // Every corner of the screen is on the inner side of every edge of the quad, which is then convex around them.
+    const auto coords      = transform_coords(transform, geometry, aspect_ratio);
+    double     orientation = 0.0;
+    for (size_t n = 0; n < coords.size(); ++n) {
+        const auto& from = coords[n];
+        const auto& to   = coords[(n + 1) % coords.size()];
+        for (auto corner : {std::array<double, 2>{0.0, 0.0}, {1.0, 0.0}, {1.0, 1.0}, {0.0, 1.0}}) {
+            const auto cross = (to.vertex_x - from.vertex_x) * (corner[1] - from.vertex_y) -
+                               (to.vertex_y - from.vertex_y) * (corner[0] - from.vertex_x);
+            if (std::abs(cross) < 1e-9) {
+                continue;
+            }
+            if (orientation == 0.0) {
+                orientation = cross;
+            } else if ((cross > 0.0) != (orientation > 0.0)) {
+                return false;
+            }
+        }
+    }
+    return orientation != 0.0;
 }
 
+// Mirrors draw_params_block in shader.frag. Every member is a 4 byte scalar so std140 packs them without padding.
+struct draw_uniforms
+{
+    GLint is_hd;
+    GLint has_local_key;
+    GLint has_layer_key;
+    GLint is_key;
+    GLint blend_mode;
+    GLint keyer;
+    GLint pixel_format;
+    GLint field;
+
+    GLint   invert;
+    GLfloat opacity;
+    GLint   levels;
+    GLfloat min_input;
+    GLfloat max_input;
+    GLfloat gamma;
+    GLfloat min_output;
+    GLfloat max_output;
+
+    GLint   csb;
+    GLfloat brt;
+    GLfloat sat;
+    GLfloat con;
+
+    GLint   chroma;
+    GLint   chroma_show_mask;
+    GLfloat chroma_target_hue;
+    GLfloat chroma_hue_width;
+    GLfloat chroma_min_saturation;
+    GLfloat chroma_min_brightness;
+    GLfloat chroma_softness;
+    GLfloat chroma_spill_suppress;
+    GLfloat chroma_spill_suppress_saturation;
+
+    GLint   edgeblend;
+    GLfloat edgeblend_left;
+    GLfloat edgeblend_right;
+    GLfloat edgeblend_top;
+    GLfloat edgeblend_bottom;
+    GLfloat edgeblend_g;
+    GLfloat edgeblend_p;
+    GLfloat edgeblend_a;
+
+    GLint   image_key;
+    GLfloat sample_scale;
+};
+
+static_assert(sizeof(draw_uniforms) == 39 * 4, "draw_uniforms must match the std140 layout of draw_params_block");
+
 struct image_kernel::impl
 {
-    spl::shared_ptr<device> ogl_;
-    spl::shared_ptr<shader> shader_;
-    GLuint                  vao_;
-    GLuint                  vbo_;
+    // Number of draws that fit in the uniform buffer before it is orphaned.
+    static const int uniform_slots = 256;
+
+    spl::shared_ptr<device>                                    ogl_;
+    std::unordered_map<std::uint64_t, std::shared_ptr<shader>> shaders_;
+    GLuint                                                     vao_;
+    GLuint                                                     vbo_;
+    GLuint                                                     ubo_;
+    GLsizeiptr                                                 ubo_slot_size_ = 0;
+    int                                                        ubo_slot_      = 0;
 
     explicit impl(const spl::shared_ptr<device>& ogl)
         : ogl_(ogl)
-        , shader_(ogl_->dispatch_sync([&] { return get_image_shader(ogl); }))
     {
         ogl_->dispatch_sync([&] {
             GL(glGenVertexArrays(1, &vao_));
             GL(glGenBuffers(1, &vbo_));
+
+            GLint alignment = 256;
+            GL(glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment));
+            alignment      = std::max(alignment, 1);
+            ubo_slot_size_ = (static_cast<GLsizeiptr>(sizeof(draw_uniforms)) + alignment - 1) / alignment * alignment;
+
+            GL(glGenBuffers(1, &ubo_));
+            GL(glBindBuffer(GL_UNIFORM_BUFFER, ubo_));
+            GL(glBufferData(GL_UNIFORM_BUFFER, ubo_slot_size_ * uniform_slots, nullptr, GL_STREAM_DRAW));
+            GL(glBindBuffer(GL_UNIFORM_BUFFER, 0));
         });
     }
 
@@ -128,224 +336,179 @@ struct image_kernel::impl
         ogl_->dispatch_sync([&] {
             GL(glDeleteVertexArrays(1, &vao_));
             GL(glDeleteBuffers(1, &vbo_));
+            GL(glDeleteBuffers(1, &ubo_));
         });
     }
 
-    void draw(draw_params params)
+    shader& get_shader(std::uint32_t features, core::pixel_format format)
+    {
+        auto key = static_cast<std::uint64_t>(format) << 32 | features;
+        auto it  = shaders_.find(key);
+
+        if (it == shaders_.end()) {
+            auto shader = get_image_shader(ogl_, features, format);
+
+            // Sampler units never change, so they are set once per variant rather than on every draw.
+            shader->use();
+            shader->set("plane[0]", texture_id::plane0);
+            shader->set("plane[1]", texture_id::plane1);
+            shader->set("plane[2]", texture_id::plane2);
+            shader->set("plane[3]", texture_id::plane3);
+            shader->set("local_key", texture_id::local_key);
+            shader->set("layer_key", texture_id::layer_key);
+            shader->set("background", texture_id::background);
+            shader->set("image_key_plane", texture_id::image_key);
+
+            it = shaders_.emplace(key, std::move(shader)).first;
+        }
+
+        return *it->second;
+    }
+
+    static std::uint32_t get_features(const draw_uniforms& uniforms)
+    {
+        std::uint32_t features = 0;
+        features |= uniforms.chroma ? feature_chroma : 0;
+        features |= uniforms.levels ? feature_levels : 0;
+        features |= uniforms.csb ? feature_csb : 0;
+        features |= uniforms.has_local_key ? feature_local_key : 0;
+        features |= uniforms.has_layer_key ? feature_layer_key : 0;
+        features |= uniforms.invert ? feature_invert : 0;
+        features |= uniforms.blend_mode != static_cast<GLint>(core::blend_mode::normal) ? feature_blend_mode : 0;
+        features |= uniforms.keyer == static_cast<GLint>(keyer::additive) ? feature_additive : 0;
+        features |= uniforms.edgeblend && !uniforms.is_key ? feature_edgeblend : 0;
+        features |= uniforms.image_key ? feature_image_key : 0;
+        return features;
+    }
+
+    void upload(const draw_uniforms& uniforms)
+    {
+        GL(glBindBuffer(GL_UNIFORM_BUFFER, ubo_));
+
+        if (ubo_slot_ == uniform_slots) {
+            // Orphan the storage instead of waiting for the gpu to finish with the slots still in flight.
+            GL(glBufferData(GL_UNIFORM_BUFFER, ubo_slot_size_ * uniform_slots, nullptr, GL_STREAM_DRAW));
+            ubo_slot_ = 0;
+        }
+
+        auto offset = ubo_slot_size_ * ubo_slot_++;
+        GL(glBufferSubData(GL_UNIFORM_BUFFER, offset, sizeof(draw_uniforms), &uniforms));
+        GL(glBindBufferRange(GL_UNIFORM_BUFFER, 0, ubo_, offset, sizeof(draw_uniforms)));
+        GL(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+    }
+
+    // The uniforms of a draw and the triangles it draws, false if it would leave the background as it is.
+    static bool prepare(draw_params&                              params,
+                        draw_uniforms&                            uniforms,
+                        std::vector<core::frame_geometry::coord>& triangles)
     {
         static const double epsilon = 0.001;
 
         CASPAR_ASSERT(params.pix_desc.planes.size() == params.textures.size());
 
         if (params.textures.empty() || !params.background) {
-            return;
+            return false;
         }
 
-        if (params.transform.opacity < epsilon) {
-            return;
+        if (params.transform.opacity < min_opacity) {
+            return false;
         }
 
-        auto coords = params.geometry.data();
-
-        if (coords.empty()) {
-            return;
+        // Only quads are drawn.
+        const auto& geometry = params.geometry.data();
+        if (geometry.empty() || params.geometry.type() != core::frame_geometry::geometry_type::quad) {
+            return false;
         }
 
-        // Calculate transforms
-        auto f_p = params.transform.fill_translation;
-        auto f_s = params.transform.fill_scale;
-
-        bool is_default_geometry = boost::equal(coords, core::frame_geometry::get_default().data()) ||
-                                   boost::equal(coords, core::frame_geometry::get_default_vflip().data());
-        auto aspect = params.aspect_ratio;
-        auto angle  = params.transform.angle;
-        auto anchor = params.transform.anchor;
-        auto crop   = params.transform.crop;
-        auto pers   = params.transform.perspective;
+        auto coords = transform_coords(params.transform, params.geometry, params.aspect_ratio);
+
+        bool is_default_geometry = boost::equal(geometry, core::frame_geometry::get_default().data()) ||
+                                   boost::equal(geometry, core::frame_geometry::get_default_vflip().data());
+        auto crop = params.transform.crop;
+        auto pers = params.transform.perspective;
         pers.ur[0] -= 1.0;
         pers.lr[0] -= 1.0;
         pers.lr[1] -= 1.0;
         pers.ll[1] -= 1.0;
-        std::vector<std::array<double, 2>> pers_corners = {pers.ul, pers.ur, pers.lr, pers.ll};
-
-        auto do_crop = [&](core::frame_geometry::coord& coord) {
-            if (!is_default_geometry) {
-                // TODO implement support for non-default geometry.
-                return;
-            }
-
-            coord.vertex_x  = std::max(coord.vertex_x, crop.ul[0]);
-            coord.vertex_x  = std::min(coord.vertex_x, crop.lr[0]);
-            coord.vertex_y  = std::max(coord.vertex_y, crop.ul[1]);
-            coord.vertex_y  = std::min(coord.vertex_y, crop.lr[1]);
-            coord.texture_x = std::max(coord.texture_x, crop.ul[0]);
-            coord.texture_x = std::min(coord.texture_x, crop.lr[0]);
-            coord.texture_y = std::max(coord.texture_y, crop.ul[1]);
-            coord.texture_y = std::min(coord.texture_y, crop.lr[1]);
-        };
-        auto do_perspective = [=](core::frame_geometry::coord& coord, const std::array<double, 2>& pers_corner) {
-            if (!is_default_geometry) {
-                // TODO implement support for non-default geometry.
-                return;
-            }
-
-            coord.vertex_x += pers_corner[0];
-            coord.vertex_y += pers_corner[1];
-        };
-        auto rotate = [&](core::frame_geometry::coord& coord) {
-            auto orig_x    = (coord.vertex_x - anchor[0]) * f_s[0];
-            auto orig_y    = (coord.vertex_y - anchor[1]) * f_s[1] / aspect;
-            coord.vertex_x = orig_x * std::cos(angle) - orig_y * std::sin(angle);
-            coord.vertex_y = orig_x * std::sin(angle) + orig_y * std::cos(angle);
-            coord.vertex_y *= aspect;
-        };
-        auto move = [&](core::frame_geometry::coord& coord) {
-            coord.vertex_x += f_p[0];
-            coord.vertex_y += f_p[1];
-        };
-
-        int corner = 0;
-        for (auto& coord : coords) {
-            do_crop(coord);
-            do_perspective(coord, pers_corners.at(corner));
-            rotate(coord);
-            move(coord);
-
-            if (++corner == 4) {
-                corner = 0;
-            }
-        }
 
         // Skip drawing if all the coordinates will be outside the screen.
         if (is_outside_screen(coords)) {
-            return;
+            return false;
         }
 
-        // Bind textures
-
-        for (int n = 0; n < params.textures.size(); ++n) {
-            params.textures[n]->bind(n);
-        }
+        // Setup shader
 
-        if (params.local_key) {
-            params.local_key->bind(static_cast<int>(texture_id::local_key));
+        if (params.transform.is_key) {
+            params.blend_mode = core::blend_mode::normal;
         }
 
-        if (params.layer_key) {
-            params.layer_key->bind(static_cast<int>(texture_id::layer_key));
+        uniforms.is_hd         = params.pix_desc.planes.at(0).height > 700 ? 1 : 0;
+        uniforms.has_local_key = params.local_key ? 1 : 0;
+        uniforms.has_layer_key = params.layer_key ? 1 : 0;
+        uniforms.is_key        = params.transform.is_key ? 1 : 0;
+        uniforms.blend_mode    = static_cast<GLint>(params.blend_mode);
+        uniforms.keyer         = static_cast<GLint>(params.keyer);
+        uniforms.pixel_format  = static_cast<GLint>(params.pix_desc.format);
+        uniforms.field         = static_cast<GLint>(params.pix_desc.field);
+        uniforms.invert        = params.transform.invert ? 1 : 0;
+        uniforms.opacity       = static_cast<GLfloat>(params.transform.is_key ? 1.0 : params.transform.opacity);
+        uniforms.image_key     = params.image_key ? static_cast<GLint>(params.image_key_range) : 0;
+        uniforms.sample_scale  = 1.0f;
+
+        // Samples of fewer than 16 bits in 16 bit textures are scaled back up to the full normalized range.
+        if (params.pix_desc.format == core::pixel_format::ycbcr16 ||
+            params.pix_desc.format == core::pixel_format::ycbcra16) {
+            const auto depth      = std::clamp(params.pix_desc.depth, 8, 16);
+            uniforms.sample_scale = static_cast<GLfloat>(65535.0 / ((1 << depth) - 1));
         }
 
-        // Setup shader
-
-        shader_->use();
-
-        shader_->set("plane[0]", texture_id::plane0);
-        shader_->set("plane[1]", texture_id::plane1);
-        shader_->set("plane[2]", texture_id::plane2);
-        shader_->set("plane[3]", texture_id::plane3);
-        shader_->set("local_key", texture_id::local_key);
-        shader_->set("layer_key", texture_id::layer_key);
-        shader_->set("is_hd", params.pix_desc.planes.at(0).height > 700 ? 1 : 0);
-        shader_->set("has_local_key", static_cast<bool>(params.local_key));
-        shader_->set("has_layer_key", static_cast<bool>(params.layer_key));
-        shader_->set("pixel_format", params.pix_desc.format);
-        shader_->set("opacity", params.transform.is_key ? 1.0 : params.transform.opacity);
-
         if (params.transform.chroma.enable) {
-            shader_->set("chroma", true);
-            shader_->set("chroma_show_mask", params.transform.chroma.show_mask);
-            shader_->set("chroma_target_hue", params.transform.chroma.target_hue / 360.0);
-            shader_->set("chroma_hue_width", params.transform.chroma.hue_width);
-            shader_->set("chroma_min_saturation", params.transform.chroma.min_saturation);
-            shader_->set("chroma_min_brightness", params.transform.chroma.min_brightness);
-            shader_->set("chroma_softness", 1.0 + params.transform.chroma.softness);
-            shader_->set("chroma_spill_suppress", params.transform.chroma.spill_suppress / 360.0);
-            shader_->set("chroma_spill_suppress_saturation", params.transform.chroma.spill_suppress_saturation);
-        } else {
-            shader_->set("chroma", false);
+            uniforms.chroma                = 1;
+            uniforms.chroma_show_mask      = params.transform.chroma.show_mask ? 1 : 0;
+            uniforms.chroma_target_hue     = static_cast<GLfloat>(params.transform.chroma.target_hue / 360.0);
+            uniforms.chroma_hue_width      = static_cast<GLfloat>(params.transform.chroma.hue_width);
+            uniforms.chroma_min_saturation = static_cast<GLfloat>(params.transform.chroma.min_saturation);
+            uniforms.chroma_min_brightness = static_cast<GLfloat>(params.transform.chroma.min_brightness);
+            uniforms.chroma_softness       = static_cast<GLfloat>(1.0 + params.transform.chroma.softness);
+            uniforms.chroma_spill_suppress = static_cast<GLfloat>(params.transform.chroma.spill_suppress / 360.0);
+            uniforms.chroma_spill_suppress_saturation =
+                static_cast<GLfloat>(params.transform.chroma.spill_suppress_saturation);
         }
 
         if (params.transform.edgeblend.left > epsilon || params.transform.edgeblend.right > epsilon ||
             params.transform.edgeblend.top > epsilon || params.transform.edgeblend.bottom > epsilon) {
-            shader_->set("edgeblend", true);
-            shader_->set("edgeblend_left", params.transform.edgeblend.left);
-            shader_->set("edgeblend_right", params.transform.edgeblend.right);
-            shader_->set("edgeblend_top", params.transform.edgeblend.top);
-            shader_->set("edgeblend_bottom", params.transform.edgeblend.bottom);
-            shader_->set("edgeblend_g", params.transform.edgeblend.g);
-            shader_->set("edgeblend_p", params.transform.edgeblend.p);
-            shader_->set("edgeblend_a", params.transform.edgeblend.a);
-        } else {
-            shader_->set("edgeblend", false);
+            uniforms.edgeblend        = 1;
+            uniforms.edgeblend_left   = static_cast<GLfloat>(params.transform.edgeblend.left);
+            uniforms.edgeblend_right  = static_cast<GLfloat>(params.transform.edgeblend.right);
+            uniforms.edgeblend_top    = static_cast<GLfloat>(params.transform.edgeblend.top);
+            uniforms.edgeblend_bottom = static_cast<GLfloat>(params.transform.edgeblend.bottom);
+            uniforms.edgeblend_g      = static_cast<GLfloat>(params.transform.edgeblend.g);
+            uniforms.edgeblend_p      = static_cast<GLfloat>(params.transform.edgeblend.p);
+            uniforms.edgeblend_a      = static_cast<GLfloat>(params.transform.edgeblend.a);
         }
 
-        // Setup blend_func
-
-        if (params.transform.is_key) {
-            params.blend_mode = core::blend_mode::normal;
-        }
-
-        params.background->bind(static_cast<int>(texture_id::background));
-        shader_->set("background", texture_id::background);
-        shader_->set("blend_mode", params.blend_mode);
-        shader_->set("keyer", params.keyer);
-        shader_->set("is_key", params.transform.is_key);
-
         // Setup image-adjustements
-        shader_->set("invert", params.transform.invert);
 
         if (params.transform.levels.min_input > epsilon || params.transform.levels.max_input < 1.0 - epsilon ||
             params.transform.levels.min_output > epsilon || params.transform.levels.max_output < 1.0 - epsilon ||
             std::abs(params.transform.levels.gamma - 1.0) > epsilon) {
-            shader_->set("levels", true);
-            shader_->set("min_input", params.transform.levels.min_input);
-            shader_->set("max_input", params.transform.levels.max_input);
-            shader_->set("min_output", params.transform.levels.min_output);
-            shader_->set("max_output", params.transform.levels.max_output);
-            shader_->set("gamma", params.transform.levels.gamma);
-        } else {
-            shader_->set("levels", false);
+            uniforms.levels     = 1;
+            uniforms.min_input  = static_cast<GLfloat>(params.transform.levels.min_input);
+            uniforms.max_input  = static_cast<GLfloat>(params.transform.levels.max_input);
+            uniforms.min_output = static_cast<GLfloat>(params.transform.levels.min_output);
+            uniforms.max_output = static_cast<GLfloat>(params.transform.levels.max_output);
+            uniforms.gamma      = static_cast<GLfloat>(params.transform.levels.gamma);
         }
 
         if (std::abs(params.transform.brightness - 1.0) > epsilon ||
             std::abs(params.transform.saturation - 1.0) > epsilon ||
             std::abs(params.transform.contrast - 1.0) > epsilon) {
-            shader_->set("csb", true);
-
-            shader_->set("brt", params.transform.brightness);
-            shader_->set("sat", params.transform.saturation);
-            shader_->set("con", params.transform.contrast);
-        } else {
-            shader_->set("csb", false);
-        }
-
-        // Setup drawing area
-
-        GL(glViewport(0, 0, params.background->width(), params.background->height()));
-        glDisable(GL_DEPTH_TEST);
-
-        auto m_p = params.transform.clip_translation;
-        auto m_s = params.transform.clip_scale;
-
-        bool scissor = m_p[0] > std::numeric_limits<double>::epsilon() ||
-                       m_p[1] > std::numeric_limits<double>::epsilon() ||
-                       m_s[0] < 1.0 - std::numeric_limits<double>::epsilon() ||
-                       m_s[1] < 1.0 - std::numeric_limits<double>::epsilon();
-
-        if (scissor) {
-            double w = static_cast<double>(params.background->width());
-            double h = static_cast<double>(params.background->height());
-
-            GL(glEnable(GL_SCISSOR_TEST));
-            GL(glScissor(static_cast<int>(m_p[0] * w),
-                         static_cast<int>(m_p[1] * h),
-                         std::max(0, static_cast<int>(m_s[0] * w)),
-                         std::max(0, static_cast<int>(m_s[1] * h))));
+            uniforms.csb = 1;
+            uniforms.brt = static_cast<GLfloat>(params.transform.brightness);
+            uniforms.sat = static_cast<GLfloat>(params.transform.saturation);
+            uniforms.con = static_cast<GLfloat>(params.transform.contrast);
         }
 
-        // Set render target
-        params.background->attach();
-
         // Perspective correction
         double diagonal_intersection_x;
         double diagonal_intersection_y;
@@ -378,7 +541,7 @@ struct image_kernel::impl
 
             std::vector<double> q_values = {ulq, urq, lrq, llq};
 
-            corner = 0;
+            int corner = 0;
             for (auto& coord : coords) {
                 coord.texture_q = q_values[corner];
                 coord.texture_x *= q_values[corner];
@@ -389,46 +552,268 @@ struct image_kernel::impl
             }
         }
 
-        // Draw
-        switch (params.geometry.type()) {
-            case core::frame_geometry::geometry_type::quad: {
-                GL(glBindVertexArray(vao_));
-                GL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
+        triangles = {coords[0], coords[1], coords[2], coords[0], coords[2], coords[3]};
+        return true;
+    }
+
+    static bool has_scissor(const core::image_transform& transform)
+    {
+        auto m_p = transform.clip_translation;
+        auto m_s = transform.clip_scale;
+
+        return m_p[0] > std::numeric_limits<double>::epsilon() || m_p[1] > std::numeric_limits<double>::epsilon() ||
+               m_s[0] < 1.0 - std::numeric_limits<double>::epsilon() ||
+               m_s[1] < 1.0 - std::numeric_limits<double>::epsilon();
+    }
 
-                std::vector<core::frame_geometry::coord> coords_triangles{
-                    coords[0], coords[1], coords[2], coords[0], coords[2], coords[3]};
+    // Draws that can go in one run: the same shader, uniforms, target and keys, and no scissor rect of their own.
+    static bool can_share(const draw_params&   lhs,
+                          const draw_uniforms& lhs_uniforms,
+                          const draw_params&   rhs,
+                          const draw_uniforms& rhs_uniforms)
+    {
+        return lhs.pix_desc.format == rhs.pix_desc.format && lhs.textures.size() == rhs.textures.size() &&
+               lhs.background == rhs.background && lhs.local_key == rhs.local_key && lhs.layer_key == rhs.layer_key &&
+               !has_scissor(lhs.transform) && !has_scissor(rhs.transform) &&
+               std::memcmp(&lhs_uniforms, &rhs_uniforms, sizeof(draw_uniforms)) == 0;
+    }
 
-                GL(glBufferData(GL_ARRAY_BUFFER,
-                                static_cast<GLsizeiptr>(sizeof(core::frame_geometry::coord)) * coords_triangles.size(),
-                                coords_triangles.data(),
-                                GL_STATIC_DRAW));
+    static std::array<double, 4> get_bounds(const core::frame_geometry::coord* triangles)
+    {
+        std::array<double, 4> bounds = {triangles[0].vertex_x,
+                                        triangles[0].vertex_y,
+                                        triangles[0].vertex_x,
+                                        triangles[0].vertex_y};
+        for (int n = 1; n < 6; ++n) {
+            bounds[0] = std::min(bounds[0], triangles[n].vertex_x);
+            bounds[1] = std::min(bounds[1], triangles[n].vertex_y);
+            bounds[2] = std::max(bounds[2], triangles[n].vertex_x);
+            bounds[3] = std::max(bounds[3], triangles[n].vertex_y);
+        }
+        return bounds;
+    }
 
-                auto stride = static_cast<GLsizei>(sizeof(core::frame_geometry::coord));
+    // Where an opaque solid color is drawn as it is, into a rectangle along the axes, the pixels it sets (x, y, width,
+    // height). Such a draw only needs the rectangle cleared to the color, without sampling the image or reading the
+    // background for every pixel of it.
+    static bool get_clear_rect(const draw_params&                 params,
+                               const draw_uniforms&               uniforms,
+                               const core::frame_geometry::coord* triangles,
+                               std::array<int, 4>&                rect)
+    {
+        if (!params.color || (*params.color)[3] != 255 || get_features(uniforms) != 0 || uniforms.is_key ||
+            uniforms.field != static_cast<GLint>(core::video_field::progressive) || uniforms.opacity < 1.0f) {
+            return false;
+        }
 
-                auto vtx_loc = shader_->get_attrib_location("Position");
-                auto tex_loc = shader_->get_attrib_location("TexCoordIn");
+        if (params.background->stride() != 4 || params.background->depth() != texture_depth::bit8) {
+            return false;
+        }
 
-                GL(glEnableVertexAttribArray(vtx_loc));
-                GL(glEnableVertexAttribArray(tex_loc));
+        // The corners of the quad, whose edges have to run along one axis and the other in turn.
+        const core::frame_geometry::coord* corners[] = {&triangles[0], &triangles[1], &triangles[2], &triangles[5]};
+        auto along = [&](int n, bool horizontal) {
+            const auto& from = *corners[n];
+            const auto& to   = *corners[(n + 1) % 4];
+            return horizontal ? from.vertex_y == to.vertex_y : from.vertex_x == to.vertex_x;
+        };
+        auto is_rectangle = [&](bool horizontal) {
+            return along(0, horizontal) && along(1, !horizontal) && along(2, horizontal) && along(3, !horizontal);
+        };
+        if (!is_rectangle(true) && !is_rectangle(false)) {
+            return false;
+        }
 
-                GL(glVertexAttribPointer(vtx_loc, 2, GL_DOUBLE, GL_FALSE, stride, nullptr));
-                GL(glVertexAttribPointer(tex_loc, 4, GL_DOUBLE, GL_FALSE, stride, (GLvoid*)(2 * sizeof(GLdouble))));
+        // The pixels whose centers are inside, like the rasterizer fills them, and inside the scissor rect.
+        const auto width  = params.background->width();
+        const auto height = params.background->height();
+        const auto bounds = get_bounds(triangles);
+        auto       pixel  = [](double pos, int size) {
+            return std::clamp(static_cast<int>(std::ceil(pos * size - 0.5)), 0, size);
+        };
+        auto x0 = pixel(bounds[0], width);
+        auto y0 = pixel(bounds[1], height);
+        auto x1 = pixel(bounds[2], width);
+        auto y1 = pixel(bounds[3], height);
+
+        if (has_scissor(params.transform)) {
+            const auto& m_p = params.transform.clip_translation;
+            const auto& m_s = params.transform.clip_scale;
+
+            const auto left = static_cast<int>(m_p[0] * width);
+            const auto top  = static_cast<int>(m_p[1] * height);
+            x0              = std::max(x0, left);
+            y0              = std::max(y0, top);
+            x1              = std::min(x1, left + std::max(0, static_cast<int>(m_s[0] * width)));
+            y1              = std::min(y1, top + std::max(0, static_cast<int>(m_s[1] * height)));
+        }
 
-                GL(glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(coords_triangles.size())));
-                GL(glTextureBarrier());
+        rect = {x0, y0, std::max(0, x1 - x0), std::max(0, y1 - y0)};
+        return true;
+    }
 
-                GL(glDisableVertexAttribArray(vtx_loc));
-                GL(glDisableVertexAttribArray(tex_loc));
+    void draw(draw_params params)
+    {
+        std::vector<draw_params> batch;
+        batch.push_back(std::move(params));
+        draw(std::move(batch));
+    }
 
-                GL(glBindVertexArray(0));
-                GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    // Blending reads the background, which only the draw writing a pixel may read in between texture barriers. Draws
+    // that don't overlap can therefore share one barrier, and the vertex buffer and uniforms of a run.
+    void draw(std::vector<draw_params> batch)
+    {
+        std::vector<draw_params>                 params;
+        std::vector<draw_uniforms>               uniforms;
+        std::vector<core::frame_geometry::coord> vertices;
+        std::vector<std::array<double, 4>>       bounds;
+
+        auto draw_runs = [&] {
+            draw_all(params, uniforms, vertices, bounds);
+            params.clear();
+            uniforms.clear();
+            vertices.clear();
+            bounds.clear();
+        };
 
-                break;
+        for (auto& item : batch) {
+            draw_uniforms                            item_uniforms = {};
+            std::vector<core::frame_geometry::coord> triangles;
+            if (!prepare(item, item_uniforms, triangles)) {
+                continue;
             }
-            default:
-                break;
+
+            std::array<int, 4> rect;
+            if (get_clear_rect(item, item_uniforms, triangles.data(), rect)) {
+                // The draws before it that it covers have to be done first.
+                const auto area    = get_bounds(triangles.data());
+                const auto overlap = std::any_of(bounds.begin(), bounds.end(), [&](const auto& b) {
+                    return area[0] < b[2] && b[0] < area[2] && area[1] < b[3] && b[1] < area[3];
+                });
+                if (overlap) {
+                    draw_runs();
+                }
+                if (rect[2] > 0 && rect[3] > 0) {
+                    item.background->clear(rect[0], rect[1], rect[2], rect[3], item.color->data());
+                }
+                continue;
+            }
+
+            params.push_back(std::move(item));
+            uniforms.push_back(item_uniforms);
+            vertices.insert(vertices.end(), triangles.begin(), triangles.end());
+            bounds.push_back(get_bounds(&vertices[vertices.size() - 6]));
+        }
+
+        draw_runs();
+    }
+
+    // Draws the prepared draws in runs that share a shader, its uniforms and one texture barrier.
+    void draw_all(const std::vector<draw_params>&                 params,
+                  const std::vector<draw_uniforms>&               uniforms,
+                  const std::vector<core::frame_geometry::coord>& vertices,
+                  const std::vector<std::array<double, 4>>&       bounds)
+    {
+        for (size_t begin = 0, end = 0; begin < params.size(); begin = end) {
+            for (end = begin + 1; end < params.size(); ++end) {
+                if (!can_share(params[begin], uniforms[begin], params[end], uniforms[end])) {
+                    break;
+                }
+
+                const auto& next     = bounds[end];
+                const auto  overlaps = std::any_of(bounds.begin() + begin, bounds.begin() + end, [&](const auto& b) {
+                    return next[0] < b[2] && b[0] < next[2] && next[1] < b[3] && b[1] < next[3];
+                });
+                if (overlaps) {
+                    break;
+                }
+            }
+
+            draw_run(params.data() + begin, end - begin, uniforms[begin], vertices.data() + begin * 6);
+        }
+    }
+
+    void draw_run(const draw_params*                 params,
+                  size_t                             count,
+                  const draw_uniforms&               uniforms,
+                  const core::frame_geometry::coord* vertices)
+    {
+        const auto& first = params[0];
+
+        if (first.local_key) {
+            first.local_key->bind(static_cast<int>(texture_id::local_key));
+        }
+
+        if (first.layer_key) {
+            first.layer_key->bind(static_cast<int>(texture_id::layer_key));
         }
 
+        first.background->bind(static_cast<int>(texture_id::background));
+
+        auto& shader = get_shader(get_features(uniforms), first.pix_desc.format);
+
+        shader.use();
+        upload(uniforms);
+
+        // Setup drawing area
+
+        GL(glViewport(0, 0, first.background->width(), first.background->height()));
+        glDisable(GL_DEPTH_TEST);
+
+        if (has_scissor(first.transform)) {
+            auto m_p = first.transform.clip_translation;
+            auto m_s = first.transform.clip_scale;
+
+            double w = static_cast<double>(first.background->width());
+            double h = static_cast<double>(first.background->height());
+
+            GL(glEnable(GL_SCISSOR_TEST));
+            GL(glScissor(static_cast<int>(m_p[0] * w),
+                         static_cast<int>(m_p[1] * h),
+                         std::max(0, static_cast<int>(m_s[0] * w)),
+                         std::max(0, static_cast<int>(m_s[1] * h))));
+        }
+
+        // Set render target
+        first.background->attach();
+
+        // Draw
+        GL(glBindVertexArray(vao_));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
+
+        GL(glBufferData(GL_ARRAY_BUFFER,
+                        static_cast<GLsizeiptr>(sizeof(core::frame_geometry::coord) * 6 * count),
+                        vertices,
+                        GL_STATIC_DRAW));
+
+        auto stride = static_cast<GLsizei>(sizeof(core::frame_geometry::coord));
+
+        auto vtx_loc = shader.get_attrib_location("Position");
+        auto tex_loc = shader.get_attrib_location("TexCoordIn");
+
+        GL(glEnableVertexAttribArray(vtx_loc));
+        GL(glEnableVertexAttribArray(tex_loc));
+
+        GL(glVertexAttribPointer(vtx_loc, 2, GL_DOUBLE, GL_FALSE, stride, nullptr));
+        GL(glVertexAttribPointer(tex_loc, 4, GL_DOUBLE, GL_FALSE, stride, (GLvoid*)(2 * sizeof(GLdouble))));
+
+        for (size_t n = 0; n < count; ++n) {
+            for (int i = 0; i < params[n].textures.size(); ++i) {
+                params[n].textures[i]->bind(i);
+            }
+            if (params[n].image_key) {
+                params[n].image_key->bind(static_cast<int>(texture_id::image_key));
+            }
+            GL(glDrawArrays(GL_TRIANGLES, static_cast<GLint>(n * 6), 6));
+        }
+        GL(glTextureBarrier());
+
+        GL(glDisableVertexAttribArray(vtx_loc));
+        GL(glDisableVertexAttribArray(tex_loc));
+
+        GL(glBindVertexArray(0));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
         // Cleanup
         GL(glDisable(GL_SCISSOR_TEST));
         GL(glDisable(GL_BLEND));
@@ -441,5 +826,6 @@ image_kernel::image_kernel(const spl::shared_ptr<device>& ogl)
 }
 image_kernel::~image_kernel() {}
 void image_kernel::draw(const draw_params& params) { impl_->draw(params); }
+void image_kernel::draw(std::vector<draw_params> batch) { impl_->draw(std::move(batch)); }
 
 }}} // namespace caspar::accelerator::ogl
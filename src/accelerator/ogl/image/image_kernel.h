@@ -29,6 +29,11 @@
 #include <core/frame/geometry.h>
 #include <core/frame/pixel_format.h>
 
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
 namespace caspar { namespace accelerator { namespace ogl {
 
 enum class keyer
@@ -37,6 +42,15 @@ enum class keyer
     additive,
 };
 
+// How the luma plane of an image key is encoded: full range gray, the luma of ycbcr or the luma pixel format.
+enum class image_key_range
+{
+    none = 0,
+    full,
+    video,
+    luma,
+};
+
 struct draw_params final
 {
     core::pixel_format_desc                     pix_desc = core::pixel_format_desc(core::pixel_format::invalid);
@@ -49,8 +63,27 @@ struct draw_params final
     std::shared_ptr<class texture>              local_key;
     std::shared_ptr<class texture>              layer_key;
     double                                      aspect_ratio = 1.0;
+
+    // The luma plane of a key drawn with the same transform and geometry as the image, sampled at the image's own
+    // coordinates in place of a local key drawn first.
+    std::shared_ptr<class texture> image_key;
+    ogl::image_key_range           image_key_range = ogl::image_key_range::none;
+
+    // The bgra pixel of an image of one, the textures of which aren't sampled when it is drawn as a clear of the
+    // rectangle it covers.
+    std::optional<std::array<std::uint8_t, 4>> color;
 };
 
+// Where draw() puts the vertices of the geometry on the screen, and the texture coordinates it crops them to.
+std::vector<core::frame_geometry::coord>
+transform_coords(const core::image_transform& transform, const core::frame_geometry& geometry, double aspect_ratio);
+
+// False when draw() would leave the background as it is: at no opacity, or with nothing on screen or in the clip.
+bool is_drawn(const core::image_transform& transform, const core::frame_geometry& geometry, double aspect_ratio);
+
+// True when draw() overwrites every pixel of the background with the opaque pixels of an image without alpha.
+bool covers_screen(const core::image_transform& transform, const core::frame_geometry& geometry, double aspect_ratio);
+
 class image_kernel final
 {
     image_kernel(const image_kernel&);
@@ -62,6 +95,10 @@ class image_kernel final
 
     void draw(const draw_params& params);
 
+    // Draws in order, with one texture barrier and uniform upload for each run of draws that share a shader and its
+    // uniforms, render target and keys and don't overlap. Like a multiviewer's sources, drawn one by one otherwise.
+    void draw(std::vector<draw_params> batch);
+
   private:
     struct impl;
     spl::unique_ptr<impl> impl_;
@@ -20,16 +20,22 @@
  */
 #include "image_mixer.h"
 
+#include "frame_analyzer.h"
 #include "image_kernel.h"
+#include "output_converter.h"
 
 #include "../util/buffer.h"
 #include "../util/device.h"
 #include "../util/texture.h"
 
 #include <common/array.h>
+#include <common/diagnostics/trace.h>
+#include <common/env.h>
 #include <common/future.h>
+#include <common/gl/gl_check.h>
 #include <common/log.h>
 
+#include <core/frame/draw_frame.h>
 #include <core/frame/frame.h>
 #include <core/frame/frame_transform.h>
 #include <core/frame/geometry.h>
@@ -38,7 +44,15 @@
 
 #include <GL/glew.h>
 
+#include <algorithm>
 #include <any>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
 #include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
@@ -51,110 +65,857 @@ struct item
     std::vector<future_texture> textures;
     core::image_transform       transform;
     core::frame_geometry        geometry = core::frame_geometry::get_default();
+    array<const std::uint8_t>   image_data;      // first plane, used to bypass the gpu
+    core::const_frame           upload;          // the frame the textures are uploaded from, unless it is occluded
+    bool                        mipmaps = false; // drawn small enough to be sampled from a mip chain
+    future_texture              key;             // luma plane of the key drawn before it, see pack_keys
+    image_key_range             key_range = image_key_range::none;
+    int                         layer     = 0; // index of the layer it was visited in
 };
 
+// Textures uploaded when a frame from the frame factory is committed. They can only be drawn on the device that
+// uploaded them, frames routed from a channel on another device are uploaded again.
+struct device_textures
+{
+    const device*               owner;
+    std::vector<future_texture> textures;
+};
+
+// A layer of a draw_list. Its sublayers follow it in the list, up to end, and are drawn before its items.
 struct layer
 {
-    std::vector<layer> sublayers;
-    std::vector<item>  items;
-    core::blend_mode   blend_mode;
+    core::blend_mode blend_mode = core::blend_mode::normal;
+    int              end        = 0;  // one past its last sublayer
+    int              first_item = 0;  // of its items in draw_list::order
+    int              item_count = 0;
+    int              last_item  = -1; // the item visited last, while the layer is built
+};
+
+// The layers and items of a frame, flat and nested by index. Lists are reused from frame to frame, resetting one
+// only lets go of what its items refer to, so that its vectors and those of its items keep their capacity.
+struct draw_list
+{
+    std::vector<layer> layers; // in the order they were pushed, each before its sublayers
+    std::vector<int>   roots;  // the top level layers
+    std::vector<item>  items;  // in the order they were visited, of which item_count are used
+    std::vector<int>   order;  // the items of each layer in turn
+    int                item_count = 0;
 
-    explicit layer(core::blend_mode blend_mode)
-        : blend_mode(blend_mode)
+    item& add_item()
     {
+        if (item_count == static_cast<int>(items.size())) {
+            items.emplace_back();
+        }
+        return items[item_count++];
+    }
+
+    void remove_item() { release(items[--item_count]); }
+
+    item& get(const layer& layer, int n) { return items[order[layer.first_item + n]]; }
+
+    const item& get(const layer& layer, int n) const { return items[order[layer.first_item + n]]; }
+
+    // Leaves the range of the layer and of its sublayers empty.
+    void clear(int index)
+    {
+        for (int n = index; n < layers[index].end; ++n) {
+            layers[n].item_count = 0;
+        }
+    }
+
+    // Whether the layer or any of its sublayers has items.
+    bool has_items(int index) const
+    {
+        for (int n = index; n < layers[index].end; ++n) {
+            if (layers[n].item_count > 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void reset()
+    {
+        for (int n = 0; n < item_count; ++n) {
+            release(items[n]);
+        }
+        item_count = 0;
+        layers.clear();
+        roots.clear();
+        order.clear();
+    }
+
+  private:
+    static void release(item& item)
+    {
+        item.pix_desc.planes.clear();
+        item.textures.clear();
+        item.image_data = {};
+        item.upload     = {};
+        item.key        = {};
+        item.mipmaps    = false;
+        item.key_range  = image_key_range::none;
+    }
+};
+
+// Draw lists given back once they have been drawn, to be filled again. Shared by the builders of a mixer.
+class draw_list_pool final : public std::enable_shared_from_this<draw_list_pool>
+{
+    std::mutex                              mutex_;
+    std::vector<std::unique_ptr<draw_list>> free_;
+
+    // A list for each frame in flight is enough, more are only needed while routes render frames of their own.
+    static constexpr size_t max_free = 8;
+
+  public:
+    std::shared_ptr<draw_list> get()
+    {
+        std::unique_ptr<draw_list> list;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!free_.empty()) {
+                list = std::move(free_.back());
+                free_.pop_back();
+            }
+        }
+        if (!list) {
+            list = std::make_unique<draw_list>();
+        }
+
+        return std::shared_ptr<draw_list>(list.release(), [weak_self = weak_from_this()](draw_list* ptr) {
+            std::unique_ptr<draw_list> list(ptr);
+            auto                       self = weak_self.lock();
+            if (!self) {
+                return;
+            }
+            list->reset();
+
+            std::lock_guard<std::mutex> lock(self->mutex_);
+            if (self->free_.size() < max_free) {
+                self->free_.push_back(std::move(list));
+            }
+        });
     }
 };
 
+static void collect_textures(const draw_list& list, std::vector<future_texture>& textures)
+{
+    for (auto& layer : list.layers) {
+        for (int n = 0; n < layer.item_count; ++n) {
+            auto& item = list.get(layer, n);
+            textures.insert(textures.end(), item.textures.begin(), item.textures.end());
+            if (item.key.valid()) {
+                textures.push_back(item.key);
+            }
+        }
+    }
+}
+
+// Whether the textures the layers, and those of other if there is one, are drawn from have been uploaded, or drawn by
+// another channel for a route. Until then the device runs other work rather than waiting for them in the middle of the
+// draw.
+static std::function<bool()> textures_ready(const draw_list& list, const draw_list* other = nullptr)
+{
+    auto textures = std::make_shared<std::vector<future_texture>>();
+    collect_textures(list, *textures);
+    if (other) {
+        collect_textures(*other, *textures);
+    }
+    return [textures] {
+        while (!textures->empty()) {
+            if (textures->back().wait_for(std::chrono::seconds(0)) == std::future_status::timeout) {
+                return false;
+            }
+            textures->pop_back();
+        }
+        return true;
+    };
+}
+
+array<const std::uint8_t> create_black_image(core::output_format format, int width, int height)
+{
+    auto data = std::make_shared<std::vector<std::uint8_t>>(core::output_format_size(format, width, height), 0);
+
+    switch (format) {
+        case core::output_format::uyvy:
+        case core::output_format::uyva:
+            // The alpha of uyva stays 0.
+            for (size_t n = 0; n < static_cast<size_t>(width) * 2 * height; n += 2) {
+                (*data)[n]     = 128;
+                (*data)[n + 1] = 16;
+            }
+            break;
+        case core::output_format::v210: {
+            // Cb Y Cr, Y Cb Y, Cr Y Cb, Y Cr Y
+            const std::uint32_t words[] = {512 | 64 << 10 | 512 << 20, 64 | 512 << 10 | 64 << 20};
+            for (size_t n = 0; n + 4 <= data->size(); n += 4) {
+                std::memcpy(data->data() + n, &words[n / 4 % 2], 4);
+            }
+            break;
+        }
+        case core::output_format::yuva422: {
+            auto plane = static_cast<size_t>(width) * height;
+            std::memset(data->data(), 16, plane);
+            std::memset(data->data() + plane, 128, plane);
+            break;
+        }
+        default:
+            break;
+    }
+
+    return array<const std::uint8_t>(data->data(), data->size(), data);
+}
+
+static texture_compression get_compression(core::pixel_format format)
+{
+    switch (format) {
+        case core::pixel_format::bc1:
+            return texture_compression::bc1;
+        case core::pixel_format::bc3:
+        case core::pixel_format::bc3_ycocg:
+            return texture_compression::bc3;
+        case core::pixel_format::bc7:
+            return texture_compression::bc7;
+        default:
+            return texture_compression::none;
+    }
+}
+
+// Uploads plane n of an image, block compressed formats as they are and 16 bit samples to 16 bit textures.
+static future_texture
+copy_plane(device& ogl, const array<const std::uint8_t>& data, const core::pixel_format_desc& desc, int n, bool mipmaps)
+{
+    const auto& plane       = desc.planes.at(n);
+    auto        compression = get_compression(desc.format);
+    if (compression != texture_compression::none) {
+        return ogl.copy_async(data, plane.width, plane.height, compression);
+    }
+    if (core::is_16_bit(desc.format)) {
+        return ogl.copy_async(data, plane.width, plane.height, plane.stride / 2, texture_depth::bit16, mipmaps);
+    }
+    return ogl.copy_async(data, plane.width, plane.height, plane.stride, mipmaps);
+}
+
+// Everything a cached layer's output depends on. Textures are compared by identity, they are never modified after
+// being uploaded, and are held weakly so a texture returned to the pool can't be mistaken for the one cached.
+struct layer_signature
+{
+    std::vector<std::weak_ptr<texture>>                   textures;
+    std::vector<core::pixel_format>                       formats;
+    std::vector<core::video_field>                        fields;
+    std::vector<core::image_transform>                    transforms;
+    std::vector<std::vector<core::frame_geometry::coord>> geometries;
+    std::vector<core::blend_mode>                         blend_modes;
+
+    bool operator==(const layer_signature& other) const
+    {
+        if (textures.size() != other.textures.size()) {
+            return false;
+        }
+        for (size_t n = 0; n < textures.size(); ++n) {
+            auto tex = textures[n].lock();
+            if (!tex || tex != other.textures[n].lock()) {
+                return false;
+            }
+        }
+        return formats == other.formats && fields == other.fields && transforms == other.transforms &&
+               geometries == other.geometries && blend_modes == other.blend_modes;
+    }
+};
+
+struct layer_cache
+{
+    layer_signature          signature;
+    std::shared_ptr<texture> image;
+    core::blend_mode         blend_mode = core::blend_mode::normal;
+};
+
+// GL_TIME_ELAPSED queries of one frame, one per top level layer of each field followed by the output conversion.
+struct pending_timings
+{
+    std::vector<int>    layers;
+    std::vector<GLuint> queries;
+    std::size_t         second_field = 0; // index of the first query of the second field, 0 for frames
+};
+
 class image_renderer
 {
-    spl::shared_ptr<device> ogl_;
-    image_kernel            kernel_;
-    const size_t            max_frame_size_;
+    spl::shared_ptr<device>                              ogl_;
+    image_kernel                                         kernel_;
+    output_converter                                     converter_;
+    std::unique_ptr<frame_analyzer>                      analyzer_;
+    const size_t                                         max_frame_size_;
+    const int                                            proxy_scale_;
+    std::map<core::output_format, array<const uint8_t>> black_images_;
+
+    std::vector<GLuint>         free_queries_;
+    std::deque<pending_timings> pending_timings_;
+    mutable std::mutex          timings_mutex_;
+    core::image_mixer_timings   timings_;
+
+    std::map<int, layer_cache> layer_caches_[2]; // by field, the second is only used for interlaced frames
+    core::video_format_desc    cache_format_desc_;
 
   public:
-    explicit image_renderer(const spl::shared_ptr<device>& ogl, const size_t max_frame_size)
+    image_renderer(const spl::shared_ptr<device>& ogl,
+                   const size_t                   max_frame_size,
+                   const int                      proxy_scale,
+                   const bool                     analysis)
         : ogl_(ogl)
         , kernel_(ogl_)
+        , converter_(ogl_)
+        , analyzer_(analysis ? std::make_unique<frame_analyzer>(ogl_) : nullptr)
         , max_frame_size_(max_frame_size)
+        , proxy_scale_(std::max(1, proxy_scale))
     {
     }
 
-    std::future<array<const std::uint8_t>> operator()(std::vector<layer>             layers,
-                                                      const core::video_format_desc& format_desc)
+    ~image_renderer()
     {
-        if (layers.empty()) { // Bypass GPU with empty frame.
-            static const std::vector<uint8_t> buffer(max_frame_size_, 0);
-            return make_ready_future(array<const std::uint8_t>(buffer.data(), format_desc.size, true));
+        ogl_->dispatch_sync([&] {
+            for (auto& timings : pending_timings_) {
+                free_queries_.insert(free_queries_.end(), timings.queries.begin(), timings.queries.end());
+            }
+            if (!free_queries_.empty()) {
+                GL(glDeleteQueries(static_cast<GLsizei>(free_queries_.size()), free_queries_.data()));
+            }
+        });
+    }
+
+    // Draws the layers, woven as the second field of an interlaced frame with those of first_field if there are any.
+    std::future<std::vector<array<const std::uint8_t>>>
+    operator()(std::shared_ptr<draw_list>                     list,
+               std::shared_ptr<draw_list>                     first_field,
+               const core::video_format_desc&                 format_desc,
+               const std::vector<core::output_format>&        formats,
+               const std::vector<core::scaled_output_format>& scaled_formats,
+               const std::vector<int>&                        layer_ids)
+    {
+        // Frames that are analyzed are always drawn, the analysis is of what the consumers get.
+        if (formats.empty() && scaled_formats.empty() && !analyzer_) { // Nobody is consuming the frame.
+            return make_ready_future(std::vector<array<const std::uint8_t>>{});
+        }
+
+        auto passthrough = analyzer_ || first_field || !scaled_formats.empty()
+                               ? array<const std::uint8_t>{}
+                               : get_passthrough(*list, format_desc, formats);
+        if (passthrough) { // Bypass GPU with the frame of a single full screen layer.
+            {
+                std::lock_guard<std::mutex> lock(timings_mutex_);
+                timings_ = {};
+            }
+            return make_ready_future(std::vector<array<const std::uint8_t>>{std::move(passthrough)});
+        }
+
+        const auto empty = list->layers.empty() && (!first_field || first_field->layers.empty());
+        if (empty && !analyzer_) { // Bypass GPU with empty frame.
+            {
+                std::lock_guard<std::mutex> lock(timings_mutex_);
+                timings_ = {};
+            }
+
+            std::vector<array<const std::uint8_t>> images;
+            for (auto format : formats) {
+                images.push_back(black_image(format, format_desc));
+            }
+            for (auto& scaled : scaled_formats) {
+                images.push_back(create_black_image(scaled.format, scaled.width, scaled.height));
+            }
+            return make_ready_future(std::move(images));
         }
 
-        return flatten(ogl_->dispatch_async([=]() mutable -> std::shared_future<array<const std::uint8_t>> {
-            auto target_texture = ogl_->create_texture(format_desc.width, format_desc.height, 4);
+        auto ready = textures_ready(*list, first_field.get());
+        return flatten(ogl_->dispatch_async(
+            [=]() mutable -> std::shared_future<std::vector<array<const std::uint8_t>>> {
+                diagnostics::trace::span span("ogl.draw", -1, -1, "ogl");
+
+                collect_timings();
+
+                pending_timings timings;
+                timings.layers = layer_ids;
+
+                if (format_desc != cache_format_desc_) {
+                    for (auto& layer_caches : layer_caches_) {
+                        layer_caches.clear();
+                    }
+                    cache_format_desc_ = format_desc;
+                }
+
+                // Each field is drawn as a frame of its own, with the caches of its field, and woven into the lines of
+                // the field while converting for the consumers.
+                std::shared_ptr<texture> first_texture;
+                if (first_field) {
+                    first_texture        = draw(*first_field, format_desc, timings, 0);
+                    timings.second_field = timings.queries.size();
+                }
+                auto target_texture = draw(*list, format_desc, timings, first_field ? 1 : 0);
+
+                if (analyzer_) {
+                    (*analyzer_)(first_texture ? first_texture : target_texture);
+                }
 
-            draw(target_texture, std::move(layers), format_desc);
+                std::shared_ptr<texture> upper;
+                std::shared_ptr<texture> lower;
+                if (first_texture) {
+                    const auto upper_first = core::is_upper_field_first(format_desc);
+                    upper                  = upper_first ? first_texture : target_texture;
+                    lower                  = upper_first ? target_texture : first_texture;
+                }
+
+                // Only the converted textures are read back, bgra included only if a consumer asked for it.
+                std::vector<std::future<array<const std::uint8_t>>> readbacks;
+                timings.queries.push_back(begin_query());
+                std::shared_ptr<texture> woven;
+                auto                     convert = [&](core::output_format format) {
+                    if (!upper) {
+                        return converter_(target_texture, format);
+                    }
+                    if (format != core::output_format::bgra) {
+                        return converter_(upper, lower, format);
+                    }
+                    if (!woven) {
+                        woven = converter_(upper, lower, format);
+                    }
+                    return woven;
+                };
+                for (auto format : formats) {
+                    if (format == core::output_format::texture) {
+                        readbacks.push_back(make_ready_future(share_texture(convert(core::output_format::bgra))));
+                    } else {
+                        readbacks.push_back(ogl_->copy_async(convert(format)));
+                    }
+                }
+                // Scaled from the field drawn first, interlacing doesn't survive a change of height.
+                for (auto& scaled : scaled_formats) {
+                    auto source = first_texture ? first_texture : target_texture;
+                    readbacks.push_back(
+                        ogl_->copy_async(converter_(source, scaled.format, scaled.width, scaled.height)));
+                }
+                GL(glEndQuery(GL_TIME_ELAPSED));
 
-            return ogl_->copy_async(target_texture);
-        }));
+                pending_timings_.push_back(std::move(timings));
+
+                return std::async(std::launch::deferred,
+                                  [readbacks = std::move(readbacks)]() mutable {
+                                      std::vector<array<const std::uint8_t>> images;
+                                      for (auto& readback : readbacks) {
+                                          images.push_back(readback.get());
+                                      }
+                                      return images;
+                                  })
+                    .share();
+            },
+            std::move(ready)));
     }
 
+    // Draws the layers into a texture of their own, without the layer caches of the channel's frames.
+    future_texture render(std::shared_ptr<draw_list> list, const core::video_format_desc& format_desc)
+    {
+        auto ready = textures_ready(*list);
+        return ogl_
+            ->dispatch_async(
+                [=]() mutable {
+                    diagnostics::trace::span span("ogl.render", -1, -1, "ogl");
+
+                    auto target_texture = ogl_->create_texture(format_desc.width, format_desc.height, 4);
+                    draw(target_texture, *list, 0, static_cast<int>(list->layers.size()), format_desc);
+                    return target_texture;
+                },
+                std::move(ready))
+            .share();
+    }
+
+    // Draws the layers like render and converts the texture to the format, read back to host memory.
+    std::future<array<const std::uint8_t>>
+    read(std::shared_ptr<draw_list> list, const core::video_format_desc& format_desc, core::output_format format)
+    {
+        auto ready = textures_ready(*list);
+        return flatten(ogl_->dispatch_async(
+            [=]() mutable {
+                diagnostics::trace::span span("ogl.read", -1, -1, "ogl");
+
+                auto target_texture = ogl_->create_texture(format_desc.width, format_desc.height, 4);
+                draw(target_texture, *list, 0, static_cast<int>(list->layers.size()), format_desc);
+                return ogl_->copy_async(converter_(target_texture, format)).share();
+            },
+            std::move(ready)));
+    }
+
+    core::image_mixer_timings timings() const
+    {
+        std::lock_guard<std::mutex> lock(timings_mutex_);
+        return timings_;
+    }
+
+    core::image_analysis analysis() const { return analyzer_ ? analyzer_->analysis() : core::image_analysis{}; }
+
   private:
+    // Returns the image of a lone untransformed full screen bgra frame, which mixes to itself.
+    static array<const std::uint8_t> get_passthrough(const draw_list&                        list,
+                                                     const core::video_format_desc&          format_desc,
+                                                     const std::vector<core::output_format>& formats)
+    {
+        if (formats.size() != 1 || formats[0] != core::output_format::bgra) {
+            return {};
+        }
+
+        // Layers without anything in them, such as those culled under an opaque layer, draw nothing.
+        int content = -1;
+        for (auto root : list.roots) {
+            if (!list.has_items(root)) {
+                continue;
+            }
+            if (content >= 0) {
+                return {};
+            }
+            content = root;
+        }
+
+        if (content < 0) {
+            return {};
+        }
+
+        auto& layer = list.layers[content];
+        if (layer.item_count != 1 || layer.blend_mode != core::blend_mode::normal) {
+            return {};
+        }
+        for (int n = content + 1; n < layer.end; ++n) {
+            if (list.layers[n].item_count > 0) {
+                return {};
+            }
+        }
+
+        auto& item = list.get(layer, 0);
+        if (item.pix_desc.format != core::pixel_format::bgra || item.pix_desc.planes.size() != 1 || item.key.valid() ||
+            item.pix_desc.planes[0].width != format_desc.width ||
+            item.pix_desc.planes[0].height != format_desc.height || item.image_data.size() != format_desc.size) {
+            return {};
+        }
+
+        auto transform        = item.transform;
+        transform.layer_depth = 0;
+        if (transform != core::image_transform() ||
+            item.geometry.data() != core::frame_geometry::get_default().data()) {
+            return {};
+        }
+
+        return item.image_data;
+    }
+
+    GLuint begin_query()
+    {
+        GLuint query = 0;
+        if (free_queries_.empty()) {
+            GL(glGenQueries(1, &query));
+        } else {
+            query = free_queries_.back();
+            free_queries_.pop_back();
+        }
+        GL(glBeginQuery(GL_TIME_ELAPSED, query));
+        return query;
+    }
+
+    // Reads back the queries of the frames the GPU has finished, without waiting for the ones still in flight.
+    void collect_timings()
+    {
+        while (!pending_timings_.empty()) {
+            auto& pending = pending_timings_.front();
+
+            GLuint available = 0;
+            GL(glGetQueryObjectuiv(pending.queries.back(), GL_QUERY_RESULT_AVAILABLE, &available));
+            if (!available) {
+                break;
+            }
+
+            core::image_mixer_timings timings;
+            for (size_t n = 0; n < pending.queries.size(); ++n) {
+                GLuint64 elapsed = 0;
+                GL(glGetQueryObjectui64v(pending.queries[n], GL_QUERY_RESULT, &elapsed));
+
+                // Both fields of an interlaced frame add to the time of their layer.
+                auto seconds = static_cast<double>(elapsed) * 1e-9;
+                auto layer   = n < pending.second_field ? n : n - pending.second_field;
+                if (n + 1 == pending.queries.size()) {
+                    timings.convert = seconds;
+                } else if (layer < pending.layers.size()) {
+                    timings.layers[pending.layers[layer]] += seconds;
+                }
+                timings.total += seconds;
+            }
+
+            free_queries_.insert(free_queries_.end(), pending.queries.begin(), pending.queries.end());
+            pending_timings_.pop_front();
+
+            std::lock_guard<std::mutex> lock(timings_mutex_);
+            timings_ = std::move(timings);
+        }
+    }
+
+    // Hands the target to consumers drawing in other contexts. The flush makes the fence visible to them, and the
+    // texture only goes back to the pool once they have let go of the frame.
+    array<const std::uint8_t> share_texture(const std::shared_ptr<texture>& target)
+    {
+        auto sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        GL(glFlush());
+
+        auto fence = std::shared_ptr<void>(sync, [ogl = ogl_](void* sync) {
+            ogl->dispatch_async([=] { glDeleteSync(static_cast<GLsync>(sync)); });
+        });
+        return array<const std::uint8_t>(nullptr, 0, shared_texture{target, std::move(fence)});
+    }
+
+    array<const std::uint8_t> black_image(core::output_format format, const core::video_format_desc& format_desc)
+    {
+        if (format == core::output_format::texture) { // Consumers clear to black without a texture.
+            return {};
+        }
+
+        if (format == core::output_format::bgra) {
+            static const std::vector<uint8_t> buffer(max_frame_size_, 0);
+            return array<const std::uint8_t>(buffer.data(), format_desc.size, true);
+        }
+
+        auto size = static_cast<size_t>(core::output_format_size(format, format_desc.width, format_desc.height));
+        auto it   = black_images_.find(format);
+        if (it == black_images_.end() || it->second.size() != size) {
+            auto image = create_black_image(format, format_desc.width, format_desc.height);
+            it         = black_images_.insert_or_assign(format, std::move(image)).first;
+        }
+        return it->second;
+    }
+
+    // Draws the layers into a texture of the format's size, at a fraction of it first with a proxy scale.
+    std::shared_ptr<texture>
+    draw(draw_list& list, const core::video_format_desc& format_desc, pending_timings& timings, int field)
+    {
+        auto target_texture = ogl_->create_texture(format_desc.width, format_desc.height, 4);
+
+        if (proxy_scale_ > 1) {
+            // Layers are mixed at a fraction of the resolution and scaled up once for the consumers.
+            auto proxy_texture = ogl_->create_texture((format_desc.width + proxy_scale_ - 1) / proxy_scale_,
+                                                      (format_desc.height + proxy_scale_ - 1) / proxy_scale_,
+                                                      4);
+            draw(proxy_texture, list, format_desc, timings, layer_caches_[field]);
+            draw(target_texture, std::move(proxy_texture), core::blend_mode::normal);
+        } else {
+            draw(target_texture, list, format_desc, timings, layer_caches_[field]);
+        }
+
+        return target_texture;
+    }
+
+    // Draws the top level layers, timing each of them and compositing unchanged layers from their cache.
+    void draw(std::shared_ptr<texture>&      target_texture,
+              draw_list&                     list,
+              const core::video_format_desc& format_desc,
+              pending_timings&               timings,
+              std::map<int, layer_cache>&    previous_caches)
+    {
+        std::map<int, layer_cache> layer_caches;
+        std::shared_ptr<texture>   layer_key_texture;
+
+        for (size_t n = 0; n < list.roots.size(); ++n) {
+            auto index = list.roots[n];
+
+            timings.queries.push_back(begin_query());
+
+            // A layer keyed by the layer below it changes whenever that one does, so it is never cached.
+            auto cached = !layer_key_texture && n < timings.layers.size() &&
+                          draw_cached(target_texture,
+                                      list,
+                                      index,
+                                      timings.layers[n],
+                                      previous_caches,
+                                      layer_caches,
+                                      format_desc);
+            if (!cached) {
+                draw(target_texture, list, index + 1, list.layers[index].end, format_desc);
+                draw(target_texture, list, index, layer_key_texture, format_desc);
+            }
+
+            GL(glEndQuery(GL_TIME_ELAPSED));
+        }
+
+        previous_caches = std::move(layer_caches);
+    }
+
+    // Draws the layers from first to last that are siblings, each after its own sublayers.
     void draw(std::shared_ptr<texture>&      target_texture,
-              std::vector<layer>             layers,
+              draw_list&                     list,
+              int                            first,
+              int                            last,
               const core::video_format_desc& format_desc)
     {
         std::shared_ptr<texture> layer_key_texture;
 
-        for (auto& layer : layers) {
-            draw(target_texture, layer.sublayers, format_desc);
-            draw(target_texture, std::move(layer), layer_key_texture, format_desc);
+        for (auto index = first; index < last; index = list.layers[index].end) {
+            draw(target_texture, list, index + 1, list.layers[index].end, format_desc);
+            draw(target_texture, list, index, layer_key_texture, format_desc);
         }
     }
 
+    // Returns true if the layer was composited from its cache. A layer is rendered into the cache once it has been
+    // seen unchanged for two frames in a row.
+    bool draw_cached(std::shared_ptr<texture>&      target_texture,
+                     draw_list&                     list,
+                     int                            index,
+                     int                            layer_id,
+                     std::map<int, layer_cache>&    previous_caches,
+                     std::map<int, layer_cache>&    layer_caches,
+                     const core::video_format_desc& format_desc)
+    {
+        layer_signature signature;
+        if (!get_signature(list, index, signature, true)) {
+            return false;
+        }
+
+        auto it = previous_caches.find(layer_id);
+        if (it == previous_caches.end() || !(it->second.signature == signature)) {
+            layer_caches[layer_id].signature = std::move(signature);
+            return false;
+        }
+
+        auto& cache = layer_caches[layer_id] = std::move(it->second);
+        if (!cache.image) {
+            cache.image = ogl_->create_texture(target_texture->width(), target_texture->height(), 4);
+
+            // Non normal blend modes are applied when compositing the cached texture, as the layer texture would be.
+            auto& layer      = list.layers[index];
+            auto  blend_mode = layer.blend_mode;
+            layer.blend_mode = core::blend_mode::normal;
+
+            std::shared_ptr<texture> layer_key_texture;
+            draw(cache.image, list, index + 1, layer.end, format_desc);
+            draw(cache.image, list, index, layer_key_texture, format_desc);
+
+            cache.blend_mode = blend_mode;
+        }
+
+        draw(target_texture, std::shared_ptr<texture>(cache.image), cache.blend_mode);
+
+        return true;
+    }
+
+    // Collects what a layer's output depends on. Returns false for layers whose output also depends on what is
+    // drawn below them: keys, and sublayers blended with anything but normal.
+    static bool get_signature(const draw_list& list, int index, layer_signature& signature, bool top_level)
+    {
+        const auto& layer = list.layers[index];
+        if (!top_level && layer.blend_mode != core::blend_mode::normal) {
+            return false;
+        }
+
+        signature.blend_modes.push_back(layer.blend_mode);
+
+        for (auto sublayer = index + 1; sublayer < layer.end; sublayer = list.layers[sublayer].end) {
+            if (!get_signature(list, sublayer, signature, false)) {
+                return false;
+            }
+        }
+
+        for (int n = 0; n < layer.item_count; ++n) {
+            auto& item = list.get(layer, n);
+            if (item.transform.is_key) {
+                return false;
+            }
+
+            for (auto& future_texture : item.textures) {
+                signature.textures.push_back(future_texture.get());
+            }
+            if (item.key.valid()) {
+                signature.textures.push_back(item.key.get());
+            }
+            signature.formats.push_back(item.pix_desc.format);
+            signature.fields.push_back(item.pix_desc.field);
+            signature.transforms.push_back(item.transform);
+            signature.geometries.push_back(item.geometry.data());
+        }
+
+        return true;
+    }
+
+    // Draws the items of a layer, not its sublayers.
     void draw(std::shared_ptr<texture>&      target_texture,
-              layer                          layer,
+              draw_list&                     list,
+              int                            index,
               std::shared_ptr<texture>&      layer_key_texture,
               const core::video_format_desc& format_desc)
     {
-        if (layer.items.empty())
+        const auto& layer = list.layers[index];
+        if (layer.item_count == 0)
             return;
 
         std::shared_ptr<texture> local_key_texture;
         std::shared_ptr<texture> local_mix_texture;
+        std::vector<draw_params> batch;
+
+        if (layer.blend_mode != core::blend_mode::normal && is_blended_directly(list, layer)) {
+            draw(target_texture,
+                 list.get(layer, 0),
+                 layer_key_texture,
+                 local_key_texture,
+                 local_mix_texture,
+                 batch,
+                 format_desc,
+                 layer.blend_mode);
 
-        if (layer.blend_mode != core::blend_mode::normal) {
+            flush(batch);
+        } else if (layer.blend_mode != core::blend_mode::normal) {
             auto layer_texture = ogl_->create_texture(target_texture->width(), target_texture->height(), 4);
 
-            for (auto& item : layer.items)
+            for (int n = 0; n < layer.item_count; ++n)
                 draw(layer_texture,
-                     std::move(item),
+                     list.get(layer, n),
                      layer_key_texture,
                      local_key_texture,
                      local_mix_texture,
+                     batch,
                      format_desc);
 
+            flush(batch);
             draw(layer_texture, std::move(local_mix_texture), core::blend_mode::normal);
             draw(target_texture, std::move(layer_texture), layer.blend_mode);
         } else // fast path
         {
-            for (auto& item : layer.items)
+            for (int n = 0; n < layer.item_count; ++n)
                 draw(target_texture,
-                     std::move(item),
+                     list.get(layer, n),
                      layer_key_texture,
                      local_key_texture,
                      local_mix_texture,
+                     batch,
                      format_desc);
 
+            flush(batch);
             draw(target_texture, std::move(local_mix_texture), core::blend_mode::normal);
         }
 
         layer_key_texture = std::move(local_key_texture);
     }
 
+    // The kernel blends with what it reads of the background, so a layer of a single item blends the same drawn
+    // straight into the target as through a layer texture of its own, which saves two full frame passes. Edge
+    // blending applies after the blend mode and keys and mixes draw into textures of their own, so those don't.
+    static bool is_blended_directly(const draw_list& list, const layer& layer)
+    {
+        if (layer.item_count != 1) {
+            return false;
+        }
+
+        const auto& transform = list.get(layer, 0).transform;
+        const auto& edgeblend = transform.edgeblend;
+        return !transform.is_key && !transform.is_mix && edgeblend.left <= 0.0 && edgeblend.right <= 0.0 &&
+               edgeblend.top <= 0.0 && edgeblend.bottom <= 0.0;
+    }
+
     void draw(std::shared_ptr<texture>&      target_texture,
-              item                           item,
+              item&                          item,
               std::shared_ptr<texture>&      layer_key_texture,
               std::shared_ptr<texture>&      local_key_texture,
               std::shared_ptr<texture>&      local_mix_texture,
-              const core::video_format_desc& format_desc)
+              std::vector<draw_params>&      batch,
+              const core::video_format_desc& format_desc,
+              core::blend_mode               blend_mode = core::blend_mode::normal)
     {
         draw_params draw_params;
         draw_params.pix_desc  = std::move(item.pix_desc);
@@ -167,6 +928,23 @@ class image_renderer
             draw_params.textures.push_back(spl::make_shared_ptr(future_texture.get()));
         }
 
+        // A frame of one bgra pixel, like those of the color producer, is one color wherever it is drawn.
+        const auto& planes = draw_params.pix_desc.planes;
+        if (draw_params.pix_desc.format == core::pixel_format::bgra && planes.size() == 1 && planes[0].width == 1 &&
+            planes[0].height == 1 && item.image_data.size() >= 4) {
+            draw_params.color.emplace();
+            std::memcpy(draw_params.color->data(), item.image_data.data(), 4);
+        }
+
+        if (item.key.valid()) {
+            draw_params.image_key       = item.key.get();
+            draw_params.image_key_range = item.key_range;
+        }
+
+        if (item.transform.is_key || item.transform.is_mix || local_mix_texture) {
+            flush(batch);
+        }
+
         if (item.transform.is_key) {
             local_key_texture = local_key_texture
                                     ? local_key_texture
@@ -195,8 +973,18 @@ class image_renderer
             draw_params.background = target_texture;
             draw_params.local_key  = std::move(local_key_texture);
             draw_params.layer_key  = layer_key_texture;
+            draw_params.blend_mode = blend_mode;
 
-            kernel_.draw(std::move(draw_params));
+            // Consecutive items drawn straight into the target, such as the tiles of a grid, are drawn together.
+            batch.push_back(std::move(draw_params));
+        }
+    }
+
+    void flush(std::vector<draw_params>& batch)
+    {
+        if (!batch.empty()) {
+            kernel_.draw(std::move(batch));
+            batch.clear();
         }
     }
 
@@ -221,45 +1009,58 @@ class image_renderer
     }
 };
 
-struct image_mixer::impl
-    : public core::frame_factory
-    , public std::enable_shared_from_this<impl>
+// Collects the visited frames into a draw list, uploading the ones without textures on the device.
+class layer_builder final : public core::frame_visitor
 {
     spl::shared_ptr<device>            ogl_;
-    image_renderer                     renderer_;
+    std::shared_ptr<draw_list_pool>    pool_;
     std::vector<core::image_transform> transform_stack_;
-    std::vector<layer>                 layers_; // layer/stream/items
-    std::vector<layer*>                layer_stack_;
+    std::shared_ptr<draw_list>         list_;
+    std::vector<int>                   layer_stack_; // the layers open for items, by depth
+    double                             aspect_ratio_ = 0.0;
+    int                                width_        = 0;
+    int                                height_       = 0;
+
+    // Sources drawn at less than this fraction of their size are uploaded with mipmaps, 0 never does.
+    const double mipmap_scale_ = env::properties().get(L"configuration.ogl.mipmap-scale", 0.5);
 
   public:
-    impl(const spl::shared_ptr<device>& ogl, const int channel_id, const size_t max_frame_size)
+    layer_builder(const spl::shared_ptr<device>& ogl, std::shared_ptr<draw_list_pool> pool)
         : ogl_(ogl)
-        , renderer_(ogl, max_frame_size)
+        , pool_(std::move(pool))
         , transform_stack_(1)
+        , list_(pool_->get())
     {
-        CASPAR_LOG(info) << L"Initialized OpenGL Accelerated GPU Image Mixer for channel " << channel_id;
     }
 
-    void push(const core::frame_transform& transform)
+    void set_format(const core::video_format_desc& format_desc)
+    {
+        aspect_ratio_ = static_cast<double>(format_desc.square_width) / static_cast<double>(format_desc.square_height);
+        width_        = format_desc.width;
+        height_       = format_desc.height;
+    }
+
+    void push(const core::frame_transform& transform) override
     {
         auto previous_layer_depth = transform_stack_.back().layer_depth;
         transform_stack_.push_back(transform_stack_.back() * transform.image_transform);
         auto new_layer_depth = transform_stack_.back().layer_depth;
 
         if (previous_layer_depth < new_layer_depth) {
-            layer new_layer(transform_stack_.back().blend_mode);
+            auto index = static_cast<int>(list_->layers.size());
+
+            layer new_layer;
+            new_layer.blend_mode = transform_stack_.back().blend_mode;
+            list_->layers.push_back(new_layer);
 
             if (layer_stack_.empty()) {
-                layers_.push_back(std::move(new_layer));
-                layer_stack_.push_back(&layers_.back());
-            } else {
-                layer_stack_.back()->sublayers.push_back(std::move(new_layer));
-                layer_stack_.push_back(&layer_stack_.back()->sublayers.back());
+                list_->roots.push_back(index);
             }
+            layer_stack_.push_back(index);
         }
     }
 
-    void visit(const core::const_frame& frame)
+    void visit(const core::const_frame& frame) override
     {
         if (frame.pixel_format_desc().format == core::pixel_format::invalid)
             return;
@@ -267,81 +1068,556 @@ struct image_mixer::impl
         if (frame.pixel_format_desc().planes.empty())
             return;
 
-        item item;
+        // Filled in place, so that the item keeps the capacity it had in the frames before.
+        auto& layer    = list_->layers[layer_stack_.back()];
+        auto& item     = list_->add_item();
         item.pix_desc  = frame.pixel_format_desc();
         item.transform = transform_stack_.back();
         item.geometry  = frame.geometry();
+        item.layer     = layer_stack_.back();
 
-        auto textures_ptr = std::any_cast<std::shared_ptr<std::vector<future_texture>>>(frame.opaque());
+        if (!is_drawn(item)) {
+            // Keys, and the items drawn through them, are kept without textures so the keys apply where they did.
+            if (item.transform.is_key || (layer.last_item >= 0 && list_->items[layer.last_item].transform.is_key)) {
+                item.pix_desc.planes.clear();
+                layer.last_item = list_->item_count - 1;
+            } else {
+                list_->remove_item();
+            }
+            return;
+        }
+
+        item.image_data = frame.image_data(0);
 
-        if (textures_ptr) {
-            item.textures = *textures_ptr;
+        auto textures_ptr = std::any_cast<std::shared_ptr<device_textures>>(&frame.opaque());
+
+        if (textures_ptr && *textures_ptr && (*textures_ptr)->owner == ogl_.get()) {
+            item.textures = (*textures_ptr)->textures;
+        } else if (!item.image_data) { // Rendered on another device, there is nothing to upload.
+            list_->remove_item();
+            return;
         } else {
-            for (int n = 0; n < static_cast<int>(item.pix_desc.planes.size()); ++n) {
-                item.textures.emplace_back(ogl_->copy_async(frame.image_data(n),
-                                                            item.pix_desc.planes[n].width,
-                                                            item.pix_desc.planes[n].height,
-                                                            item.pix_desc.planes[n].stride));
-            }
+            item.upload  = frame;
+            item.mipmaps = needs_mipmaps(item);
         }
 
-        layer_stack_.back()->items.push_back(item);
+        layer.last_item = list_->item_count - 1;
     }
 
-    void pop()
+    void pop() override
     {
         transform_stack_.pop_back();
-        layer_stack_.resize(transform_stack_.back().layer_depth);
+        close_layers(static_cast<size_t>(transform_stack_.back().layer_depth));
     }
 
-    std::future<array<const std::uint8_t>> render(const core::video_format_desc& format_desc)
+    // A layer ends with the last of the layers pushed while it was open.
+    void close_layers(size_t depth)
     {
-        return renderer_(std::move(layers_), format_desc);
+        while (layer_stack_.size() > depth) {
+            list_->layers[layer_stack_.back()].end = static_cast<int>(list_->layers.size());
+            layer_stack_.pop_back();
+        }
+    }
+
+    // Hidden items are left out before anything of them is uploaded. Until the builder has been given the format,
+    // which the position on the screen depends on for rotated items, only the transform is looked at.
+    bool is_drawn(const item& item) const
+    {
+        if (aspect_ratio_ <= 0.0) {
+            return core::is_visible(item.transform);
+        }
+        return ogl::is_drawn(item.transform, item.geometry, aspect_ratio_);
+    }
+
+    // Whether the item is drawn at less than mipmap_scale_ of its size along either axis. The fields of interlaced
+    // images and the packed texels of uyvy and uyva are read row by row and texel by texel, so they never use
+    // mipmaps, and block compressed images are uploaded as they are.
+    bool needs_mipmaps(const item& item) const
+    {
+        if (mipmap_scale_ <= 0.0 || aspect_ratio_ <= 0.0 || item.pix_desc.field != core::video_field::progressive ||
+            item.pix_desc.format == core::pixel_format::uyvy || item.pix_desc.format == core::pixel_format::uyva ||
+            get_compression(item.pix_desc.format) != texture_compression::none) {
+            return false;
+        }
+
+        auto coords = transform_coords(item.transform, item.geometry, aspect_ratio_);
+        if (coords.empty()) {
+            return false;
+        }
+
+        auto vertex_x  = std::minmax_element(coords.begin(), coords.end(), [](const auto& a, const auto& b) {
+            return a.vertex_x < b.vertex_x;
+        });
+        auto vertex_y  = std::minmax_element(coords.begin(), coords.end(), [](const auto& a, const auto& b) {
+            return a.vertex_y < b.vertex_y;
+        });
+        auto texture_x = std::minmax_element(coords.begin(), coords.end(), [](const auto& a, const auto& b) {
+            return a.texture_x < b.texture_x;
+        });
+        auto texture_y = std::minmax_element(coords.begin(), coords.end(), [](const auto& a, const auto& b) {
+            return a.texture_y < b.texture_y;
+        });
+
+        const auto& plane = item.pix_desc.planes.at(0);
+
+        auto screen_width   = (vertex_x.second->vertex_x - vertex_x.first->vertex_x) * width_;
+        auto screen_height  = (vertex_y.second->vertex_y - vertex_y.first->vertex_y) * height_;
+        auto texture_width  = (texture_x.second->texture_x - texture_x.first->texture_x) * plane.width;
+        auto texture_height = (texture_y.second->texture_y - texture_y.first->texture_y) * plane.height;
+
+        return screen_width < texture_width * mipmap_scale_ || screen_height < texture_height * mipmap_scale_;
+    }
+
+    // Drops everything drawn under the topmost item that covers the screen, with an image without alpha: the layers
+    // below it, the sublayers of its own layer and the items before it. Layers are emptied rather than removed, as
+    // they are still timed by their index.
+    void cull_occluded(draw_list& list) const
+    {
+        if (aspect_ratio_ <= 0.0) {
+            return;
+        }
+
+        const auto& roots = list.roots;
+        for (auto n = roots.size(); n-- > 0;) {
+            const auto index = roots[n];
+            auto&      layer = list.layers[index];
+            if (layer.blend_mode != core::blend_mode::normal) {
+                continue;
+            }
+
+            // A key left by the layer below applies to every item.
+            auto below = std::find_if(roots.rbegin() + (roots.size() - n), roots.rend(), [&](int other) {
+                return list.layers[other].item_count > 0;
+            });
+            if (below != roots.rend()) {
+                auto& other = list.layers[*below];
+                if (list.get(other, other.item_count - 1).transform.is_key) {
+                    continue;
+                }
+            }
+
+            for (auto i = layer.item_count; i-- > 0;) {
+                auto& item = list.get(layer, i);
+
+                // Items after a key are drawn through it.
+                if (!has_opaque_pixels(item.pix_desc) || (i > 0 && list.get(layer, i - 1).transform.is_key) ||
+                    !covers_screen(item.transform, item.geometry, aspect_ratio_)) {
+                    continue;
+                }
+
+                for (auto sublayer = index + 1; sublayer < layer.end; ++sublayer) {
+                    list.layers[sublayer].item_count = 0;
+                }
+                layer.first_item += i;
+                layer.item_count -= i;
+                for (size_t m = 0; m < n; ++m) {
+                    list.clear(roots[m]);
+                }
+                return;
+            }
+        }
+    }
+
+    static bool has_opaque_pixels(const core::pixel_format_desc& desc)
+    {
+        if (desc.planes.empty()) {
+            return false;
+        }
+
+        switch (desc.format) {
+            case core::pixel_format::gray:
+            case core::pixel_format::ycbcr:
+            case core::pixel_format::luma:
+            case core::pixel_format::bgr:
+            case core::pixel_format::rgb:
+            case core::pixel_format::uyvy:
+            case core::pixel_format::bc1:
+            case core::pixel_format::bc3_ycocg:
+            case core::pixel_format::nv12:
+            case core::pixel_format::p010:
+            case core::pixel_format::ycbcr16:
+                return true;
+            default:
+                return false;
+        }
     }
 
+    // The images of the frames visited more than once in a tick, by routes, grids or a fill and key drawn from one
+    // source, are uploaded once. Frames made with with_field() share the image they were made from.
+    // An image drawn small anywhere is uploaded with mipmaps for every item drawing it.
+    using upload_key = std::pair<const std::uint8_t*, core::pixel_format>;
+    using uploads_t  = std::map<upload_key, std::vector<future_texture>>;
+
+    static void find_mipmaps(const draw_list& list, std::map<upload_key, bool>& mipmaps)
+    {
+        for (auto& layer : list.layers) {
+            for (int n = 0; n < layer.item_count; ++n) {
+                auto& item = list.get(layer, n);
+                if (item.upload) {
+                    mipmaps[{item.image_data.data(), item.pix_desc.format}] |= item.mipmaps;
+                }
+            }
+        }
+    }
+
+    void upload(draw_list& list, uploads_t& uploads, const std::map<upload_key, bool>& mipmaps)
+    {
+        for (auto& layer : list.layers) {
+            for (int n = 0; n < layer.item_count; ++n) {
+                auto& item = list.get(layer, n);
+                if (!item.upload) {
+                    continue;
+                }
+
+                const upload_key key = {item.image_data.data(), item.pix_desc.format};
+
+                auto& textures = uploads[key];
+                if (textures.empty()) {
+                    for (int plane = 0; plane < static_cast<int>(item.pix_desc.planes.size()); ++plane) {
+                        textures.emplace_back(
+                            copy_plane(*ogl_, item.upload.image_data(plane), item.pix_desc, plane, mipmaps.at(key)));
+                    }
+                }
+                item.textures = textures;
+                item.upload   = {};
+            }
+        }
+    }
+
+    static image_key_range get_key_range(core::pixel_format format)
+    {
+        switch (format) {
+            case core::pixel_format::gray:
+                return image_key_range::full;
+            case core::pixel_format::ycbcr:
+            case core::pixel_format::nv12:
+            case core::pixel_format::p010:
+                return image_key_range::video;
+            case core::pixel_format::luma:
+                return image_key_range::luma;
+            default:
+                return image_key_range::none;
+        }
+    }
+
+    // A key is only drawn into the local key of the item after it. When the key is drawn exactly where its fill is,
+    // such as the two halves of a separated producer, the fill samples the luma of the key itself instead, which
+    // saves drawing the key and a pass over a full frame texture. Keys of ycbcr are taken to be gray, as their
+    // chroma would only tint the local key. The opacity and edge blending of keys are ignored either way.
+    static bool can_pack_key(const item& key, const item& fill)
+    {
+        if (!key.transform.is_key || fill.transform.is_key || fill.transform.is_mix || fill.key.valid() ||
+            get_key_range(key.pix_desc.format) == image_key_range::none || key.textures.empty() ||
+            key.pix_desc.field != fill.pix_desc.field) {
+            return false;
+        }
+
+        auto transform   = key.transform;
+        transform.is_key = false;
+        if (transform != fill.transform || key.geometry.type() != fill.geometry.type() ||
+            key.geometry.data() != fill.geometry.data()) {
+            return false;
+        }
+
+        // What the fill is drawn with applies to the key too.
+        const core::levels plain;
+        const auto&        levels = transform.levels;
+        return transform.contrast == 1.0 && transform.brightness == 1.0 && transform.saturation == 1.0 &&
+               levels.min_input == plain.min_input && levels.max_input == plain.max_input &&
+               levels.gamma == plain.gamma && levels.min_output == plain.min_output &&
+               levels.max_output == plain.max_output && !transform.chroma.enable && !transform.invert;
+    }
+
+    // Packed keys are taken out of the range of their layer, the items after them move down.
+    static void pack_keys(draw_list& list)
+    {
+        for (auto& layer : list.layers) {
+            auto items = list.order.begin() + layer.first_item;
+            for (int n = 0; n + 1 < layer.item_count; ++n) {
+                auto& key  = list.get(layer, n);
+                auto& fill = list.get(layer, n + 1);
+
+                // Consecutive keys add up in the local key.
+                if ((n > 0 && list.get(layer, n - 1).transform.is_key) || !can_pack_key(key, fill)) {
+                    continue;
+                }
+
+                fill.key       = key.textures.at(0);
+                fill.key_range = get_key_range(key.pix_desc.format);
+                std::copy(items + n + 1, items + layer.item_count, items + n);
+                layer.item_count -= 1;
+            }
+        }
+    }
+
+    // Orders the items by layer, keeping the order they were visited in within each layer.
+    static void sort_items(draw_list& list)
+    {
+        for (int n = 0; n < list.item_count; ++n) {
+            list.layers[list.items[n].layer].item_count += 1;
+        }
+
+        int first = 0;
+        for (auto& layer : list.layers) {
+            layer.first_item = first;
+            first += layer.item_count;
+            layer.item_count = 0;
+        }
+
+        list.order.resize(list.item_count);
+        for (int n = 0; n < list.item_count; ++n) {
+            auto& layer = list.layers[list.items[n].layer];
+            list.order[layer.first_item + layer.item_count++] = n;
+        }
+    }
+
+    // Frames are uploaded here, once it is known which of them are occluded.
+    std::shared_ptr<draw_list> take()
+    {
+        close_layers(0);
+
+        auto list = std::move(list_);
+        list_     = pool_->get();
+
+        sort_items(*list);
+        cull_occluded(*list);
+
+        std::map<upload_key, bool> mipmaps;
+        find_mipmaps(*list, mipmaps);
+
+        uploads_t uploads;
+        upload(*list, uploads, mipmaps);
+
+        pack_keys(*list);
+
+        return list;
+    }
+};
+
+struct image_mixer::impl
+    : public core::frame_factory
+    , public std::enable_shared_from_this<impl>
+{
+    spl::shared_ptr<device>         ogl_;
+    std::shared_ptr<device_queue>   queue_;
+    std::shared_ptr<draw_list_pool> lists_;
+    image_renderer                  renderer_;
+    layer_builder                   builder_;
+    std::shared_ptr<draw_list>      first_field_;
+    core::video_format_desc         format_desc_;
+
+  public:
+    impl(const spl::shared_ptr<device>& ogl,
+         const int                      channel_id,
+         const size_t                   max_frame_size,
+         const int                      proxy_scale,
+         const bool                     background,
+         const bool                     analysis)
+        : ogl_(ogl)
+        , queue_(std::make_shared<device_queue>(background))
+        , lists_(std::make_shared<draw_list_pool>())
+        , renderer_(ogl, max_frame_size, proxy_scale, analysis)
+        , builder_(ogl, lists_)
+    {
+        CASPAR_LOG(info) << L"Initialized OpenGL Accelerated GPU Image Mixer for channel " << channel_id;
+        if (proxy_scale > 1) {
+            CASPAR_LOG(info) << L"Channel " << channel_id << L" mixes at 1/" << proxy_scale << L" resolution";
+        }
+        if (background) {
+            CASPAR_LOG(info) << L"Channel " << channel_id << L" renders when the device has nothing else to do";
+        }
+        if (analysis) {
+            CASPAR_LOG(info) << L"Channel " << channel_id << L" analyzes its frames";
+        }
+    }
+
+    void push(const core::frame_transform& transform) { builder_.push(transform); }
+
+    void visit(const core::const_frame& frame) { builder_.visit(frame); }
+
+    void pop() { builder_.pop(); }
+
+    std::future<std::vector<array<const std::uint8_t>>>
+    render(const core::video_format_desc&                 format_desc,
+           const std::vector<core::output_format>&        formats,
+           const std::vector<core::scaled_output_format>& scaled_formats,
+           const std::vector<int>&                        layers)
+    {
+        if (format_desc != format_desc_) {
+            format_desc_ = format_desc;
+            builder_.set_format(format_desc);
+            // Have a few channel sized upload buffers ready before producers start asking for frames.
+            ogl_->reserve_arrays(static_cast<int>(format_desc.size), 4);
+        }
+
+        // The frame is due by the next tick, the uploads and draws of the tick are scheduled by that.
+        queue_->set_deadline(std::chrono::steady_clock::now() +
+                             std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                 std::chrono::duration<double>(1.0 / format_desc.hz)));
+        device_queue::scope scope(queue_);
+
+        return renderer_(builder_.take(), std::move(first_field_), format_desc, formats, scaled_formats, layers);
+    }
+
+    bool end_field()
+    {
+        first_field_ = builder_.take();
+        return true;
+    }
+
+    void prepare(const core::video_format_desc& format_desc)
+    {
+        ogl_->reserve_arrays(static_cast<int>(format_desc.size), 4);
+
+        // Textures go back to the pool when let go of, where the first frames find them instead of creating their own.
+        ogl_->dispatch_async([ogl = ogl_, width = format_desc.width, height = format_desc.height] {
+            std::vector<std::shared_ptr<texture>> textures;
+            for (int n = 0; n < 4; ++n) {
+                textures.push_back(ogl->create_texture(width, height, 4));
+            }
+        });
+    }
+
+    // Safe to call from any thread, the frame is collected apart from the channel's layers and drawn on the device.
+    core::const_frame render(const core::draw_frame& frame, const core::video_format_desc& format_desc)
+    {
+        device_queue::scope scope(queue_);
+
+        layer_builder builder(ogl_, lists_);
+        builder.set_format(format_desc);
+        frame.accept(builder);
+        auto list = builder.take();
+        if (list->layers.empty()) {
+            return {};
+        }
+
+        auto texture = renderer_.render(std::move(list), format_desc);
+
+        core::pixel_format_desc desc(core::pixel_format::bgra);
+        desc.planes.emplace_back(format_desc.width, format_desc.height, 4);
+
+        // The image stays on the gpu, mixers on other devices skip the frame.
+        core::image_data_t image_data(1);
+        return core::const_frame(core::mutable_frame(
+            this,
+            std::move(image_data),
+            array<int32_t>{},
+            desc,
+            [owner = ogl_.get(), texture](core::const_image_data_t) -> std::any {
+                return std::make_shared<device_textures>(device_textures{owner, {texture}});
+            }));
+    }
+
+    std::future<array<const std::uint8_t>>
+    read(const core::draw_frame& frame, const core::video_format_desc& format_desc, core::output_format format)
+    {
+        device_queue::scope scope(queue_);
+
+        layer_builder builder(ogl_, lists_);
+        builder.set_format(format_desc);
+        frame.accept(builder);
+        auto list = builder.take();
+        if (list->layers.empty() || format == core::output_format::texture) {
+            return make_ready_future(array<const std::uint8_t>{});
+        }
+
+        return renderer_.read(std::move(list), format_desc, format);
+    }
+
+    core::image_mixer_timings timings() const { return renderer_.timings(); }
+
+    core::image_analysis analysis() const { return renderer_.analysis(); }
+
     core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override
     {
-        std::vector<array<std::uint8_t>> image_data;
+        core::image_data_t image_data;
         for (auto& plane : desc.planes) {
             image_data.push_back(ogl_->create_array(plane.size));
         }
 
+        return create_frame(tag, desc, std::move(image_data));
+    }
+
+    array<std::uint8_t> create_array(int size) override { return ogl_->create_array(size); }
+
+    core::mutable_frame create_frame(const void*                    tag,
+                                     const core::pixel_format_desc& desc,
+                                     core::image_data_t             image_data) override
+    {
         std::weak_ptr<image_mixer::impl> weak_self = shared_from_this();
         return core::mutable_frame(
             tag,
             std::move(image_data),
             array<int32_t>{},
             desc,
-            [weak_self, desc](std::vector<array<const std::uint8_t>> image_data) -> std::any {
+            [weak_self, desc](core::const_image_data_t image_data) -> std::any {
                 auto self = weak_self.lock();
-                if (!self) {
+                // Audio only frames have nothing to upload.
+                if (!self || desc.planes.empty()) {
                     return std::any{};
                 }
+                // Producers upload on their own threads, as part of the work of the channel.
+                device_queue::scope scope(self->queue_);
+
                 std::vector<future_texture> textures;
                 for (int n = 0; n < static_cast<int>(desc.planes.size()); ++n) {
-                    textures.emplace_back(self->ogl_->copy_async(
-                        image_data[n], desc.planes[n].width, desc.planes[n].height, desc.planes[n].stride));
+                    textures.emplace_back(copy_plane(*self->ogl_, image_data[n], desc, n, false));
                 }
-                return std::make_shared<decltype(textures)>(std::move(textures));
+                return std::make_shared<device_textures>(device_textures{self->ogl_.get(), std::move(textures)});
             });
     }
 };
 
-image_mixer::image_mixer(const spl::shared_ptr<device>& ogl, const int channel_id, const size_t max_frame_size)
-    : impl_(std::make_unique<impl>(ogl, channel_id, max_frame_size))
+image_mixer::image_mixer(const spl::shared_ptr<device>& ogl,
+                         const int                      channel_id,
+                         const size_t                   max_frame_size,
+                         const int                      proxy_scale,
+                         const bool                     background,
+                         const bool                     analysis)
+    : impl_(std::make_unique<impl>(ogl, channel_id, max_frame_size, proxy_scale, background, analysis))
 {
 }
 image_mixer::~image_mixer() {}
 void image_mixer::push(const core::frame_transform& transform) { impl_->push(transform); }
 void image_mixer::visit(const core::const_frame& frame) { impl_->visit(frame); }
 void image_mixer::pop() { impl_->pop(); }
-std::future<array<const std::uint8_t>> image_mixer::operator()(const core::video_format_desc& format_desc)
+std::future<std::vector<array<const std::uint8_t>>>
+image_mixer::operator()(const core::video_format_desc&                 format_desc,
+                        const std::vector<core::output_format>&        formats,
+                        const std::vector<core::scaled_output_format>& scaled_formats,
+                        const std::vector<int>&                        layers)
+{
+    return impl_->render(format_desc, formats, scaled_formats, layers);
+}
+bool image_mixer::end_field() { return impl_->end_field(); }
+void image_mixer::prepare(const core::video_format_desc& format_desc) { impl_->prepare(format_desc); }
+core::const_frame image_mixer::render(const core::draw_frame& frame, const core::video_format_desc& format_desc)
 {
-    return impl_->render(format_desc);
+    return impl_->render(frame, format_desc);
 }
+std::future<array<const std::uint8_t>> image_mixer::read(const core::draw_frame&        frame,
+                                                         const core::video_format_desc& format_desc,
+                                                         core::output_format            format)
+{
+    return impl_->read(frame, format_desc, format);
+}
+bool image_mixer::shares_textures(const core::frame_factory& other) const
+{
+    auto mixer = dynamic_cast<const image_mixer*>(&other);
+    return mixer && mixer->impl_->ogl_.get() == impl_->ogl_.get();
+}
+core::image_mixer_timings image_mixer::timings() const { return impl_->timings(); }
+core::image_analysis      image_mixer::analysis() const { return impl_->analysis(); }
 core::mutable_frame image_mixer::create_frame(const void* tag, const core::pixel_format_desc& desc)
 {
     return impl_->create_frame(tag, desc);
 }
+array<std::uint8_t> image_mixer::create_array(int size) { return impl_->create_array(size); }
+core::mutable_frame image_mixer::create_frame(const void*                    tag,
+                                              const core::pixel_format_desc& desc,
+                                              core::image_data_t             image_data)
+{
+    return impl_->create_frame(tag, desc, std::move(image_data));
+}
 
 }}} // namespace caspar::accelerator::ogl
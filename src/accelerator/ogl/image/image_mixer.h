@@ -30,21 +30,49 @@
 #include <core/video_format.h>
 
 #include <future>
+#include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
 class image_mixer final : public core::image_mixer
 {
   public:
-    image_mixer(const spl::shared_ptr<class device>& ogl, int channel_id, const size_t max_frame_size);
+    // A proxy_scale above 1 mixes the layers at that fraction of the channel's width and height, for previews. A
+    // background mixer only gets the device when no other channel's work is waiting. With analysis every frame of
+    // the channel is measured, see analysis().
+    image_mixer(const spl::shared_ptr<class device>& ogl,
+                int                                  channel_id,
+                const size_t                         max_frame_size,
+                int                                  proxy_scale = 1,
+                bool                                 background  = false,
+                bool                                 analysis    = false);
     image_mixer(const image_mixer&) = delete;
 
     ~image_mixer();
 
     image_mixer& operator=(const image_mixer&) = delete;
 
-    std::future<array<const std::uint8_t>> operator()(const core::video_format_desc& format_desc) override;
-    core::mutable_frame                    create_frame(const void* tag, const core::pixel_format_desc& desc) override;
+    std::future<std::vector<array<const std::uint8_t>>>
+                              operator()(const core::video_format_desc&                 format_desc,
+                                         const std::vector<core::output_format>&        formats,
+                                         const std::vector<core::scaled_output_format>& scaled_formats,
+                                         const std::vector<int>&                        layers) override;
+    bool                      end_field() override;
+    void                      prepare(const core::video_format_desc& format_desc) override;
+    core::const_frame         render(const core::draw_frame&        frame,
+                                     const core::video_format_desc& format_desc) override;
+    std::future<array<const std::uint8_t>>
+                              read(const core::draw_frame&        frame,
+                                   const core::video_format_desc& format_desc,
+                                   core::output_format            format) override;
+    bool                      shares_textures(const core::frame_factory& other) const override;
+    core::image_mixer_timings timings() const override;
+    core::image_analysis      analysis() const override;
+    core::mutable_frame       create_frame(const void* tag, const core::pixel_format_desc& desc) override;
+    array<std::uint8_t>       create_array(int size) override;
+    core::mutable_frame       create_frame(const void*                    tag,
+                                           const core::pixel_format_desc& desc,
+                                           core::image_data_t             image_data) override;
 
     // core::image_mixer
 
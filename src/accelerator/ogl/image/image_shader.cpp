@@ -26,20 +26,58 @@
 #include "ogl_image_fragment.h"
 #include "ogl_image_vertex.h"
 
+#include <common/log.h>
+
+#include <map>
+#include <mutex>
+#include <sstream>
+
 namespace caspar { namespace accelerator { namespace ogl {
 
-std::weak_ptr<shader> g_shader;
-std::mutex            g_shader_mutex;
+std::map<std::uint64_t, std::weak_ptr<shader>> g_shaders;
+std::mutex                                     g_shader_mutex;
+
+std::string specialize_fragment_shader(std::uint32_t features, core::pixel_format format)
+{
+    auto define = [&](std::ostream& out, const char* name, image_shader_feature feature) {
+        out << "#define " << name << " " << ((features & feature) ? "true" : "false") << "\n";
+    };
+
+    std::stringstream defines;
+    defines << "#define SPECIALIZED\n";
+    defines << "#define PIXEL_FORMAT " << static_cast<int>(format) << "\n";
+    define(defines, "FEATURE_CHROMA", feature_chroma);
+    define(defines, "FEATURE_LEVELS", feature_levels);
+    define(defines, "FEATURE_CSB", feature_csb);
+    define(defines, "FEATURE_LOCAL_KEY", feature_local_key);
+    define(defines, "FEATURE_LAYER_KEY", feature_layer_key);
+    define(defines, "FEATURE_INVERT", feature_invert);
+    define(defines, "FEATURE_BLEND_MODE", feature_blend_mode);
+    define(defines, "FEATURE_ADDITIVE", feature_additive);
+    define(defines, "FEATURE_EDGEBLEND", feature_edgeblend);
+    define(defines, "FEATURE_IMAGE_KEY", feature_image_key);
+
+    // Defines have to follow the #version directive.
+    auto source  = std::string(fragment_shader);
+    auto version = source.find('\n') + 1;
+    return source.substr(0, version) + defines.str() + source.substr(version);
+}
 
-std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl)
+std::shared_ptr<shader>
+get_image_shader(const spl::shared_ptr<device>& ogl, std::uint32_t features, core::pixel_format format)
 {
+    auto key = static_cast<std::uint64_t>(format) << 32 | features;
+
     std::lock_guard<std::mutex> lock(g_shader_mutex);
-    auto                        existing_shader = g_shader.lock();
+    auto                        existing_shader = g_shaders[key].lock();
 
     if (existing_shader) {
         return existing_shader;
     }
 
+    CASPAR_LOG(debug) << L"[image_shader] Compiling variant features:" << features
+                      << L" pixel_format:" << static_cast<int>(format);
+
     // The deleter is alive until the weak pointer is destroyed, so we have
     // to weakly reference ogl, to not keep it alive until atexit
     std::weak_ptr<device> weak_ogl = ogl;
@@ -52,9 +90,10 @@ std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl)
         }
     };
 
-    existing_shader.reset(new shader(std::string(vertex_shader), std::string(fragment_shader)), deleter);
+    existing_shader.reset(new shader(std::string(vertex_shader), specialize_fragment_shader(features, format)),
+                          deleter);
 
-    g_shader = existing_shader;
+    g_shaders[key] = existing_shader;
 
     return existing_shader;
 }
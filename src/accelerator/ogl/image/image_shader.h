@@ -23,6 +23,10 @@
 
 #include <common/memory.h>
 
+#include <core/frame/pixel_format.h>
+
+#include <cstdint>
+
 namespace caspar { namespace accelerator { namespace ogl {
 
 class shader;
@@ -36,9 +40,28 @@ enum class texture_id
     plane3,
     local_key,
     layer_key,
-    background
+    background,
+    image_key
+};
+
+// Features a shader variant is compiled with, combined into a bitmask.
+enum image_shader_feature : std::uint32_t
+{
+    feature_chroma     = 1 << 0,
+    feature_levels     = 1 << 1,
+    feature_csb        = 1 << 2,
+    feature_local_key  = 1 << 3,
+    feature_layer_key  = 1 << 4,
+    feature_invert     = 1 << 5,
+    feature_blend_mode = 1 << 6,
+    feature_additive   = 1 << 7,
+    feature_edgeblend  = 1 << 8,
+    feature_image_key  = 1 << 9,
 };
 
-std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl);
+// Returns the image shader specialized for the given features and pixel format, compiling it on first use. Must be
+// called on the ogl thread.
+std::shared_ptr<shader>
+get_image_shader(const spl::shared_ptr<device>& ogl, std::uint32_t features, core::pixel_format format);
 
 }}} // namespace caspar::accelerator::ogl
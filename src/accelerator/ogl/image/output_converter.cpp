@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+
+#include "output_converter.h"
+
+#include "../util/device.h"
+#include "../util/shader.h"
+#include "../util/texture.h"
+
+#include <common/except.h>
+#include <common/gl/gl_check.h>
+
+#include <core/frame/geometry.h>
+
+#include <GL/glew.h>
+
+#include "ogl_convert_fragment.h"
+#include "ogl_image_vertex.h"
+
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+struct output_converter::impl
+{
+    spl::shared_ptr<device> ogl_;
+    std::unique_ptr<shader> shader_;
+    GLuint                  vao_;
+    GLuint                  vbo_;
+
+    explicit impl(const spl::shared_ptr<device>& ogl)
+        : ogl_(ogl)
+    {
+        ogl_->dispatch_sync([&] {
+            shader_ = std::make_unique<shader>(std::string(vertex_shader), std::string(convert_fragment_shader));
+            shader_->use();
+            shader_->set("source", 0);
+            shader_->set("second", 1);
+
+            auto coords = core::frame_geometry::get_default().data();
+
+            std::vector<core::frame_geometry::coord> coords_triangles{
+                coords[0], coords[1], coords[2], coords[0], coords[2], coords[3]};
+
+            GL(glGenVertexArrays(1, &vao_));
+            GL(glGenBuffers(1, &vbo_));
+
+            GL(glBindVertexArray(vao_));
+            GL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
+            GL(glBufferData(GL_ARRAY_BUFFER,
+                            static_cast<GLsizeiptr>(sizeof(core::frame_geometry::coord)) * coords_triangles.size(),
+                            coords_triangles.data(),
+                            GL_STATIC_DRAW));
+
+            auto stride  = static_cast<GLsizei>(sizeof(core::frame_geometry::coord));
+            auto vtx_loc = shader_->get_attrib_location("Position");
+            auto tex_loc = shader_->get_attrib_location("TexCoordIn");
+
+            GL(glEnableVertexAttribArray(vtx_loc));
+            GL(glEnableVertexAttribArray(tex_loc));
+            GL(glVertexAttribPointer(vtx_loc, 2, GL_DOUBLE, GL_FALSE, stride, nullptr));
+            GL(glVertexAttribPointer(tex_loc, 4, GL_DOUBLE, GL_FALSE, stride, (GLvoid*)(2 * sizeof(GLdouble))));
+
+            GL(glBindVertexArray(0));
+            GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        });
+    }
+
+    ~impl()
+    {
+        ogl_->dispatch_sync([&] {
+            GL(glDeleteVertexArrays(1, &vao_));
+            GL(glDeleteBuffers(1, &vbo_));
+            shader_.reset();
+        });
+    }
+
+    std::shared_ptr<texture> convert(const std::shared_ptr<texture>& source,
+                                     const std::shared_ptr<texture>& lower,
+                                     core::output_format             format,
+                                     int                             width,
+                                     int                             height)
+    {
+        if (format == core::output_format::bgra && !lower && width == source->width() &&
+            height == source->height()) {
+            return source;
+        }
+
+        // The target is sized so that one texel is one 32 bit word (uyvy, v210, uyva) or one byte (yuva422) of the
+        // packed layout.
+        std::shared_ptr<texture> target;
+        switch (format) {
+            case core::output_format::bgra:
+            case core::output_format::key:
+                target = ogl_->create_texture(width, height, 4);
+                break;
+            case core::output_format::uyvy:
+            case core::output_format::v210:
+                target = ogl_->create_texture(core::output_format_linesize(format, width) / 4, height, 4);
+                break;
+            case core::output_format::yuva422:
+                target = ogl_->create_texture(width, height * 3, 1);
+                break;
+            case core::output_format::uyva:
+                target = ogl_->create_texture(width / 2, height + (height + 1) / 2, 4);
+                break;
+            default:
+                CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported output format."));
+        }
+
+        source->bind(0);
+        if (lower) {
+            lower->bind(1);
+        }
+
+        shader_->use();
+        shader_->set("format", static_cast<int>(format));
+        shader_->set("weave", lower ? 2 : 0);
+        shader_->set("image_size", width, height);
+        // Matches the BT.709 tagging of the ffmpeg consumer for yuva422 and the SDI convention for the others.
+        shader_->set("is_hd", format == core::output_format::yuva422 || height > 700);
+
+        target->attach();
+        GL(glViewport(0, 0, target->width(), target->height()));
+        GL(glDisable(GL_BLEND));
+
+        GL(glBindVertexArray(vao_));
+        GL(glDrawArrays(GL_TRIANGLES, 0, 6));
+        GL(glBindVertexArray(0));
+
+        source->unbind();
+
+        return target;
+    }
+};
+
+output_converter::output_converter(const spl::shared_ptr<device>& ogl)
+    : impl_(new impl(ogl))
+{
+}
+output_converter::~output_converter() {}
+std::shared_ptr<texture> output_converter::operator()(const std::shared_ptr<texture>& source,
+                                                      core::output_format             format)
+{
+    return impl_->convert(source, nullptr, format, source->width(), source->height());
+}
+std::shared_ptr<texture> output_converter::operator()(const std::shared_ptr<texture>& upper,
+                                                      const std::shared_ptr<texture>& lower,
+                                                      core::output_format             format)
+{
+    return impl_->convert(upper, lower, format, upper->width(), upper->height());
+}
+std::shared_ptr<texture> output_converter::operator()(const std::shared_ptr<texture>& source,
+                                                      core::output_format             format,
+                                                      int                             width,
+                                                      int                             height)
+{
+    return impl_->convert(source, nullptr, format, width, height);
+}
+
+}}} // namespace caspar::accelerator::ogl
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/frame/pixel_format.h>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+// Converts mixed BGRA textures into the packed layouts of core::output_format, so consumers read back and receive
+// frames in the format they send without converting on the cpu.
+class output_converter final
+{
+    output_converter(const output_converter&);
+    output_converter& operator=(const output_converter&);
+
+  public:
+    explicit output_converter(const spl::shared_ptr<class device>& ogl);
+    ~output_converter();
+
+    // Returns a texture that reads back as format. Must be called on the ogl thread.
+    std::shared_ptr<class texture> operator()(const std::shared_ptr<class texture>& source, core::output_format format);
+
+    // Like the above for an interlaced frame, with the even lines from upper and the odd ones from lower. Each of them
+    // is a field mixed as a whole frame.
+    std::shared_ptr<class texture> operator()(const std::shared_ptr<class texture>& upper,
+                                              const std::shared_ptr<class texture>& lower,
+                                              core::output_format                   format);
+
+    // Like the first with the frame scaled to width and height, averaging the source when it is scaled down.
+    std::shared_ptr<class texture>
+    operator()(const std::shared_ptr<class texture>& source, core::output_format format, int width, int height);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::accelerator::ogl
@@ -7,47 +7,72 @@ uniform sampler2D	background;
 uniform sampler2D	plane[4];
 uniform sampler2D	local_key;
 uniform sampler2D	layer_key;
+uniform sampler2D	image_key_plane;
 
-uniform bool		is_hd;
-uniform bool		has_local_key;
-uniform bool		has_layer_key;
-uniform bool        is_key;
-uniform int			blend_mode;
-uniform int			keyer;
-uniform int			pixel_format;
-
-uniform bool        invert;
-uniform float		opacity;
-uniform bool		levels;
-uniform float		min_input;
-uniform float		max_input;
-uniform float		gamma;
-uniform float		min_output;
-uniform float		max_output;
-
-uniform bool		csb;
-uniform float		brt;
-uniform float		sat;
-uniform float		con;
-
-uniform bool		chroma;
-uniform bool		chroma_show_mask;
-uniform float		chroma_target_hue;
-uniform float		chroma_hue_width;
-uniform float		chroma_min_saturation;
-uniform float		chroma_min_brightness;
-uniform float		chroma_softness;
-uniform float		chroma_spill_suppress;
-uniform float		chroma_spill_suppress_saturation;
-
-uniform bool        edgeblend;
-uniform float       edgeblend_left;
-uniform float       edgeblend_right;
-uniform float       edgeblend_top;
-uniform float       edgeblend_bottom;
-uniform float       edgeblend_g;
-uniform float       edgeblend_p;
-uniform float       edgeblend_a;
+// Per draw parameters, uploaded by image_kernel as a single std140 block. Must match draw_uniforms in image_kernel.cpp.
+layout(std140, binding = 0) uniform draw_params_block
+{
+    bool        is_hd;
+    bool        has_local_key;
+    bool        has_layer_key;
+    bool        is_key;
+    int         blend_mode;
+    int         keyer;
+    int         pixel_format;
+    int         field;
+
+    bool        invert;
+    float       opacity;
+    bool        levels;
+    float       min_input;
+    float       max_input;
+    float       gamma;
+    float       min_output;
+    float       max_output;
+
+    bool        csb;
+    float       brt;
+    float       sat;
+    float       con;
+
+    bool        chroma;
+    bool        chroma_show_mask;
+    float       chroma_target_hue;
+    float       chroma_hue_width;
+    float       chroma_min_saturation;
+    float       chroma_min_brightness;
+    float       chroma_softness;
+    float       chroma_spill_suppress;
+    float       chroma_spill_suppress_saturation;
+
+    bool        edgeblend;
+    float       edgeblend_left;
+    float       edgeblend_right;
+    float       edgeblend_top;
+    float       edgeblend_bottom;
+    float       edgeblend_g;
+    float       edgeblend_p;
+    float       edgeblend_a;
+
+    int         image_key;
+    float       sample_scale;
+};
+
+// image_shader.cpp compiles one variant per feature set and pixel format, with SPECIALIZED and the constants below
+// defined after #version, so unused features compile away. Without them every feature is a runtime branch.
+#ifndef SPECIALIZED
+#define PIXEL_FORMAT        pixel_format
+#define FEATURE_CHROMA      chroma
+#define FEATURE_LEVELS      levels
+#define FEATURE_CSB         csb
+#define FEATURE_LOCAL_KEY   has_local_key
+#define FEATURE_LAYER_KEY   has_layer_key
+#define FEATURE_INVERT      invert
+#define FEATURE_BLEND_MODE  (blend_mode != 0)
+#define FEATURE_ADDITIVE    (keyer == 1)
+#define FEATURE_EDGEBLEND   (edgeblend && !is_key)
+#define FEATURE_IMAGE_KEY   (image_key != 0)
+#endif
 
 /*
 ** Contrast, saturation, brightness
@@ -434,13 +459,11 @@ vec3 get_blend_color(vec3 back, vec3 fore)
 vec4 blend(vec4 fore)
 {
     vec4 back = texture(background, TexCoord2.st).bgra;
-    if(blend_mode != 0)
+    if(FEATURE_BLEND_MODE)
         fore.rgb = get_blend_color(back.rgb/(back.a+0.0000001), fore.rgb/(fore.a+0.0000001))*fore.a;
-    switch(keyer)
-    {
-        case 1:  return fore + back; // additive
-        default: return fore + (1.0-fore.a)*back; // linear
-    }
+    if(FEATURE_ADDITIVE)
+        return fore + back; // additive
+    return fore + (1.0-fore.a)*back; // linear
 }
 
 vec4 chroma_key(vec4 c)
@@ -476,14 +499,67 @@ vec4 ycbcra_to_rgba(float y, float cb, float cr, float a)
         return ycbcra_to_rgba_sd(y, cb, cr, a);
 }
 
+// Rows of the field that enclose the image row at y (in texels), and the weight of the lower one. field is 1 for the
+// even lines and 2 for the odd ones.
+void field_rows(float y, int height, out int above, out int below, out float weight)
+{
+    int   parity = field - 1;
+    int   last   = height - 1 - ((height - 1 - parity) & 1);
+    float row    = floor((y - float(parity)) / 2.0) * 2.0 + float(parity);
+    weight       = clamp((y - row) / 2.0, 0.0, 1.0);
+    above        = clamp(int(row), parity, last);
+    below        = clamp(int(row) + 2, parity, last);
+}
+
 vec4 get_sample(sampler2D sampler, vec2 coords)
 {
-    return texture(sampler, coords);
+    if (field == 0)
+        return texture(sampler, coords);
+
+    // Sampling at the centre of the field's rows keeps the other field's lines out of the filter.
+    int   height = textureSize(sampler, 0).y;
+    int   above;
+    int   below;
+    float weight;
+    field_rows(coords.y * float(height) - 0.5, height, above, below, weight);
+    return mix(texture(sampler, vec2(coords.x, (float(above) + 0.5) / float(height))),
+               texture(sampler, vec2(coords.x, (float(below) + 0.5) / float(height))),
+               weight);
+}
+
+// uyvy is uploaded once as a texture of half the image width, each texel holding Cb Y0 Cr Y1 of two pixels. Returns
+// Y Cb Cr of the pixel.
+vec3 uyvy_pixel(ivec2 pos, ivec2 size)
+{
+    pos        = clamp(pos, ivec2(0, 0), ivec2(size.x * 2 - 1, size.y - 1));
+    vec4 texel = texelFetch(plane[0], ivec2(pos.x / 2, pos.y), 0);
+    return vec3((pos.x & 1) == 0 ? texel.g : texel.a, texel.b, texel.r);
+}
+
+vec3 uyvy_sample(vec2 coords)
+{
+    ivec2 size = textureSize(plane[0], 0);
+    vec2  pos  = coords * vec2(size.x * 2, size.y) - 0.5;
+    int   x    = int(floor(pos.x));
+    int   above;
+    int   below;
+    float weight;
+    if (field == 0) {
+        above  = int(floor(pos.y));
+        below  = above + 1;
+        weight = pos.y - floor(pos.y);
+    } else {
+        field_rows(pos.y, size.y, above, below, weight);
+    }
+
+    vec3 top    = mix(uyvy_pixel(ivec2(x, above), size), uyvy_pixel(ivec2(x + 1, above), size), pos.x - float(x));
+    vec3 bottom = mix(uyvy_pixel(ivec2(x, below), size), uyvy_pixel(ivec2(x + 1, below), size), pos.x - float(x));
+    return mix(top, bottom, weight);
 }
 
 vec4 get_rgba_color()
 {
-    switch(pixel_format)
+    switch(PIXEL_FORMAT)
     {
     case 0:		//gray
         return vec4(get_sample(plane[0], TexCoord.st / TexCoord.q).rrr, 1.0);
@@ -519,17 +595,71 @@ vec4 get_rgba_color()
         return vec4(get_sample(plane[0], TexCoord.st / TexCoord.q).bgr, 1.0);
     case 9:		//rgb,
         return vec4(get_sample(plane[0], TexCoord.st / TexCoord.q).rgb, 1.0);
-	case 10:	// uyvy
-		{
-			float y = get_sample(plane[0], TexCoord.st / TexCoord.q).g;
-			float cb = get_sample(plane[1], TexCoord.st / TexCoord.q).b;
-			float cr = get_sample(plane[1], TexCoord.st / TexCoord.q).r;			
-			return ycbcra_to_rgba(y, cb, cr, 1.0);
-		}
+    case 10:	// uyvy
+        {
+            vec3 ycbcr = uyvy_sample(TexCoord.st / TexCoord.q);
+            return ycbcra_to_rgba(ycbcr.x, ycbcr.y, ycbcr.z, 1.0);
+        }
+    case 11:	// uyva
+        {
+            vec3  ycbcr = uyvy_sample(TexCoord.st / TexCoord.q);
+            float a     = get_sample(plane[1], TexCoord.st / TexCoord.q).r;
+            return ycbcra_to_rgba(ycbcr.x, ycbcr.y, ycbcr.z, a);
+        }
+    case 12:	// bc1, block compressed textures sample as rgba
+        return vec4(get_sample(plane[0], TexCoord.st / TexCoord.q).bgr, 1.0);
+    case 13:	// bc3
+        return get_sample(plane[0], TexCoord.st / TexCoord.q).bgra;
+    case 14:	// bc3_ycocg, Co Cg and scale in rgb, Y in alpha
+        {
+            vec4  cocgsy = get_sample(plane[0], TexCoord.st / TexCoord.q);
+            cocgsy.rg -= 0.50196078431373;
+            float scale  = cocgsy.b * (255.0 / 8.0) + 1.0;
+            float co     = cocgsy.r / scale;
+            float cg     = cocgsy.g / scale;
+            float y      = cocgsy.a;
+            return vec4(y - co - cg, y + cg, y + co - cg, 1.0);
+        }
+    case 15:	// bc7
+        return get_sample(plane[0], TexCoord.st / TexCoord.q).bgra;
+    case 16:	// nv12, Cb Cr interleaved in the second plane
+    case 17:	// p010, sampled the same from 16 bit textures
+        {
+            float y    = get_sample(plane[0], TexCoord.st / TexCoord.q).r;
+            vec2  cbcr = get_sample(plane[1], TexCoord.st / TexCoord.q).rg;
+            return ycbcra_to_rgba(y, cbcr.x, cbcr.y, 1.0);
+        }
+    case 18:	// ycbcr16
+        {
+            float y  = get_sample(plane[0], TexCoord.st / TexCoord.q).r * sample_scale;
+            float cb = get_sample(plane[1], TexCoord.st / TexCoord.q).r * sample_scale;
+            float cr = get_sample(plane[2], TexCoord.st / TexCoord.q).r * sample_scale;
+            return ycbcra_to_rgba(y, cb, cr, 1.0);
+        }
+    case 19:	// ycbcra16
+        {
+            float y  = get_sample(plane[0], TexCoord.st / TexCoord.q).r * sample_scale;
+            float cb = get_sample(plane[1], TexCoord.st / TexCoord.q).r * sample_scale;
+            float cr = get_sample(plane[2], TexCoord.st / TexCoord.q).r * sample_scale;
+            float a  = get_sample(plane[3], TexCoord.st / TexCoord.q).r * sample_scale;
+            return ycbcra_to_rgba(y, cb, cr, a);
+        }
     }
     return vec4(0.0, 0.0, 0.0, 0.0);
 }
 
+// The value a key drawn from its luma plane would have left in a local key: 1 for full range, 2 for the luma of
+// ycbcr, 3 for the luma format.
+float get_image_key()
+{
+    float y = get_sample(image_key_plane, TexCoord.st / TexCoord.q).r;
+    if (image_key == 2)
+        return clamp(1.164 * (y * 255.0 - 16.0) / 255.0, 0.0, 1.0);
+    if (image_key == 3)
+        return clamp((y - 0.065) / 0.859, 0.0, 1.0);
+    return y;
+}
+
 float edgeblend_value(float pos, float boundary, float G, float P, float A)
 {
     if (pos > boundary)
@@ -563,22 +693,23 @@ vec3 Edgeblend(vec3 color, float left, float right, float top, float bottom, flo
 void main()
 {
     vec4 color = get_rgba_color();
-    if (chroma)
+    if (FEATURE_CHROMA)
         color = chroma_key(color);
-    if(levels)
+    if(FEATURE_LEVELS)
         color.rgb = LevelsControl(color.rgb, min_input, gamma, max_input, min_output, max_output);
-    if(csb)
+    if(FEATURE_CSB)
         color.rgb = ContrastSaturationBrightness(color, brt, sat, con);
-    if(has_local_key)
+    if(FEATURE_LOCAL_KEY)
         color *= texture(local_key, TexCoord2.st).r;
-    if(has_layer_key)
+    if(FEATURE_IMAGE_KEY)
+        color *= get_image_key();
+    if(FEATURE_LAYER_KEY)
         color *= texture(layer_key, TexCoord2.st).r;
     color *= opacity;
-    if (invert)
+    if (FEATURE_INVERT)
         color = 1.0 - color;
-    if (blend_mode >= 0)
-        color = blend(color);
-    if (edgeblend && !is_key)
+    color = blend(color);
+    if (FEATURE_EDGEBLEND)
         color.rgb = Edgeblend(color.rgb, edgeblend_left, edgeblend_right, edgeblend_top, edgeblend_bottom, edgeblend_g, edgeblend_p, edgeblend_a);
 
     fragColor = color.bgra;
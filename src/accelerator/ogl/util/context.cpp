@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "context.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/gl/gl_check.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <SFML/Window/Context.hpp>
+
+#include <boost/property_tree/ptree.hpp>
+
+#ifdef ENABLE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// EGL_EXT_device_persistent_id, missing from older headers.
+#ifndef EGL_DEVICE_UUID_EXT
+#define EGL_DEVICE_UUID_EXT 0x335C
+typedef EGLBoolean(EGLAPIENTRYP PFNEGLQUERYDEVICEBINARYEXTPROC)(
+    EGLDeviceEXT device, EGLint name, EGLint max_size, void* value, EGLint* size);
+#endif
+#endif
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+#ifdef ENABLE_EGL
+namespace {
+
+template <typename T>
+T egl_proc(const char* name)
+{
+    auto proc = reinterpret_cast<T>(eglGetProcAddress(name));
+    if (!proc) {
+        CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info(std::string("EGL has no ") + name));
+    }
+    return proc;
+}
+
+std::string device_uuid(EGLDeviceEXT device)
+{
+    static const auto query_binary = reinterpret_cast<PFNEGLQUERYDEVICEBINARYEXTPROC>(
+        eglGetProcAddress("eglQueryDeviceBinaryEXT"));
+
+    unsigned char uuid[16];
+    EGLint        size = 0;
+    if (!query_binary || !query_binary(device, EGL_DEVICE_UUID_EXT, sizeof(uuid), uuid, &size) || size <= 0) {
+        return {};
+    }
+
+    std::string result;
+    char        hex[3];
+    for (int n = 0; n < size; ++n) {
+        std::snprintf(hex, sizeof(hex), "%02x", uuid[n]);
+        result += hex;
+    }
+    return result;
+}
+
+// The UUID configured for the gpu, lower case without dashes, empty to pick the device by order.
+std::string configured_uuid(int gpu)
+{
+    auto devices = env::properties().get_child_optional(L"configuration.ogl.egl-devices");
+    if (!devices) {
+        return {};
+    }
+
+    int n = 0;
+    for (auto& device : *devices) {
+        if (n++ == gpu) {
+            auto uuid = u8(device.second.get_value<std::wstring>());
+            boost::erase_all(uuid, "-");
+            boost::to_lower(uuid);
+            return uuid;
+        }
+    }
+    return {};
+}
+
+// Displays are made and initialized once for each gpu and never terminated, which would destroy every context on
+// them.
+EGLDisplay egl_display(int gpu)
+{
+    static std::mutex                mutex;
+    static std::map<int, EGLDisplay> displays;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = displays.find(gpu);
+    if (it != displays.end()) {
+        return it->second;
+    }
+
+    const auto query_devices        = egl_proc<PFNEGLQUERYDEVICESEXTPROC>("eglQueryDevicesEXT");
+    const auto get_platform_display = egl_proc<PFNEGLGETPLATFORMDISPLAYEXTPROC>("eglGetPlatformDisplayEXT");
+
+    EGLint count = 0;
+    if (!query_devices(0, nullptr, &count) || count <= 0) {
+        CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("EGL found no devices."));
+    }
+    std::vector<EGLDeviceEXT> devices(count);
+    query_devices(count, devices.data(), &count);
+    devices.resize(count);
+
+    const auto   uuid   = configured_uuid(gpu);
+    EGLDeviceEXT device = EGL_NO_DEVICE_EXT;
+    for (int n = 0; n < count && device == EGL_NO_DEVICE_EXT; ++n) {
+        if (uuid.empty() ? n == gpu : device_uuid(devices[n]) == uuid) {
+            device = devices[n];
+        }
+    }
+    if (device == EGL_NO_DEVICE_EXT) {
+        CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("EGL found no device " +
+                                                               (uuid.empty() ? std::to_string(gpu) : uuid) + "."));
+    }
+
+    auto display = get_platform_display(EGL_PLATFORM_DEVICE_EXT, device, nullptr);
+
+    EGLint major = 0;
+    EGLint minor = 0;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to initialize the EGL display."));
+    }
+
+    const auto extensions = std::string(eglQueryString(display, EGL_EXTENSIONS));
+    if (extensions.find("EGL_KHR_surfaceless_context") == std::string::npos) {
+        CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("EGL device has no surfaceless contexts."));
+    }
+
+    CASPAR_LOG(info) << L"Initialized EGL " << major << L"." << minor << L" on device " << gpu << L" "
+                     << u16(device_uuid(device));
+
+    displays[gpu] = display;
+    return display;
+}
+
+} // namespace
+#endif
+
+struct context::impl
+{
+    std::unique_ptr<sf::Context> window;
+
+#ifdef ENABLE_EGL
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext egl     = EGL_NO_CONTEXT;
+#endif
+};
+
+context::context(int gpu, const context* shared)
+    : impl_(new impl())
+{
+    const auto type = env::properties().get(L"configuration.ogl.context", L"window");
+
+    if (type == L"egl") {
+#ifdef ENABLE_EGL
+        impl_->display = egl_display(gpu);
+
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("EGL has no OpenGL."));
+        }
+
+        const EGLint config_attributes[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+
+        EGLConfig config = nullptr;
+        EGLint    count  = 0;
+        if (!eglChooseConfig(impl_->display, config_attributes, &config, 1, &count) || count < 1) {
+            CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("EGL has no OpenGL config."));
+        }
+
+        const EGLint context_attributes[] = {EGL_CONTEXT_MAJOR_VERSION,
+                                             4,
+                                             EGL_CONTEXT_MINOR_VERSION,
+                                             5,
+                                             EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                             EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                             EGL_NONE};
+
+        impl_->egl = eglCreateContext(
+            impl_->display, config, shared ? shared->impl_->egl : EGL_NO_CONTEXT, context_attributes);
+        if (impl_->egl == EGL_NO_CONTEXT) {
+            CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to create an OpenGL 4.5 EGL context."));
+        }
+        return;
+#else
+        CASPAR_LOG(warning) << L"OpenGL contexts through EGL are not supported by this build, using a window.";
+#endif
+    }
+
+    impl_->window = std::make_unique<sf::Context>(
+        sf::ContextSettings(0, 0, 0, 4, 5, sf::ContextSettings::Attribute::Core), 1, 1);
+}
+
+context::~context()
+{
+#ifdef ENABLE_EGL
+    if (impl_->egl != EGL_NO_CONTEXT) {
+        eglDestroyContext(impl_->display, impl_->egl);
+    }
+#endif
+}
+
+void context::set_active(bool active)
+{
+#ifdef ENABLE_EGL
+    if (impl_->egl != EGL_NO_CONTEXT) {
+        // The API is bound for each thread.
+        eglBindAPI(EGL_OPENGL_API);
+        if (!eglMakeCurrent(impl_->display, EGL_NO_SURFACE, EGL_NO_SURFACE, active ? impl_->egl : EGL_NO_CONTEXT)) {
+            CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to make the EGL context current."));
+        }
+        return;
+    }
+#endif
+    impl_->window->setActive(active);
+}
+
+}}} // namespace caspar::accelerator::ogl
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+// An OpenGL 4.5 core context, current on one thread at a time. configuration.ogl.context picks how it is made.
+// window, the default, goes through SFML, which on Linux needs an X display. egl makes a surfaceless EGL context
+// on a GPU of its own, without any display, in builds with ENABLE_EGL. Such contexts share nothing with windows,
+// so the screen consumer can't show what they draw.
+class context final
+{
+  public:
+    // gpu picks the EGL device, the one configuration.ogl.egl-devices lists at that index by UUID, or else the gpu-th
+    // one found. An EGL context made with another shares its objects, contexts through SFML always share theirs.
+    explicit context(int gpu, const context* shared = nullptr);
+    ~context();
+
+    context(const context&)            = delete;
+    context& operator=(const context&) = delete;
+
+    void set_active(bool active);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::accelerator::ogl
@@ -21,20 +21,24 @@
 #include "device.h"
 
 #include "buffer.h"
+#include "context.h"
 #include "shader.h"
 #include "texture.h"
 
 #include <common/array.h>
 #include <common/assert.h>
+#include <common/diagnostics/metrics.h>
+#include <common/diagnostics/trace.h>
 #include <common/env.h>
 #include <common/except.h>
 #include <common/gl/gl_check.h>
+#include <common/memshfl.h>
 #include <common/os/thread.h>
+#include <common/scope_exit.h>
+#include <common/utf.h>
 
 #include <GL/glew.h>
 
-#include <SFML/Window/Context.hpp>
-
 #ifdef WIN32
 #include <GL/wglew.h>
 #endif
@@ -46,24 +50,270 @@
 
 #include <tbb/concurrent_queue.h>
 #include <tbb/concurrent_unordered_map.h>
+#include <tbb/parallel_for.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <deque>
+#include <functional>
 #include <future>
+#include <list>
+#include <map>
+#include <mutex>
 #include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
 using namespace boost::asio;
 
+// Unused textures shared by every channel. Textures are keyed by their exact dimensions, stride, levels and
+// compression, and the least recently returned ones are evicted once the pooled textures exceed the budget.
+struct texture_pool
+{
+    using texture_list_t = std::list<std::shared_ptr<texture>>;
+
+    std::mutex                                                        mutex_;
+    texture_list_t                                                    lru_;
+    std::unordered_map<uint64_t, std::list<texture_list_t::iterator>> free_;
+    size_t                                                            size_      = 0;
+    size_t                                                            budget_    = 0;
+    uint64_t                                                          hits_      = 0;
+    uint64_t                                                          misses_    = 0;
+    uint64_t                                                          evictions_ = 0;
+
+    static uint64_t
+    key(int width, int height, int stride, int levels, texture_compression compression, texture_depth depth)
+    {
+        return static_cast<uint64_t>(depth) << 56 | static_cast<uint64_t>(compression) << 48 |
+               static_cast<uint64_t>(levels & 0xFF) << 40 | static_cast<uint64_t>(stride & 0xFF) << 32 |
+               static_cast<uint64_t>(width & 0xFFFF) << 16 | static_cast<uint64_t>(height & 0xFFFF);
+    }
+
+    static uint64_t key(const texture& tex)
+    {
+        return key(tex.width(), tex.height(), tex.stride(), tex.levels(), tex.compression(), tex.depth());
+    }
+
+    // A mip chain adds a third to the memory of the first level.
+    static size_t size(const texture& tex)
+    {
+        auto size = static_cast<size_t>(tex.size());
+        return tex.levels() > 1 ? size + size / 3 : size;
+    }
+
+    std::shared_ptr<texture>
+    pop(int width, int height, int stride, int levels, texture_compression compression, texture_depth depth)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = free_.find(key(width, height, stride, levels, compression, depth));
+        if (it == free_.end() || it->second.empty()) {
+            misses_ += 1;
+            return nullptr;
+        }
+
+        auto tex = std::move(*it->second.front());
+        lru_.erase(it->second.front());
+        it->second.pop_front();
+        if (it->second.empty()) {
+            free_.erase(it);
+        }
+        size_ -= size(*tex);
+        hits_ += 1;
+
+        return tex;
+    }
+
+    // Returns true when the pool has grown past its budget and should be trimmed.
+    bool push(std::shared_ptr<texture> tex)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto k = key(*tex);
+        size_ += size(*tex);
+        lru_.push_front(std::move(tex));
+        free_[k].push_front(lru_.begin());
+
+        return size_ > budget_;
+    }
+
+    // Textures must be deleted on the device thread, so the evicted ones are handed back to the caller.
+    std::vector<std::shared_ptr<texture>> trim(size_t budget)
+    {
+        std::vector<std::shared_ptr<texture>> evicted;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        while (size_ > budget && !lru_.empty()) {
+            auto& tex  = lru_.back();
+            auto  it   = free_.find(key(*tex));
+            auto& list = it->second;
+
+            list.pop_back();
+            if (list.empty())
+                free_.erase(it);
+
+            size_ -= size(*tex);
+            evictions_ += 1;
+            evicted.push_back(std::move(tex));
+            lru_.pop_back();
+        }
+
+        return evicted;
+    }
+};
+
+namespace {
+
+thread_local std::shared_ptr<device_queue> g_current_queue;
+
+} // namespace
+
+device_queue::device_queue(bool background)
+    : deadline_(std::chrono::steady_clock::now().time_since_epoch().count())
+    , background_(background)
+{
+}
+
+void device_queue::set_deadline(std::chrono::steady_clock::time_point deadline)
+{
+    deadline_ = deadline.time_since_epoch().count();
+}
+
+std::chrono::steady_clock::time_point device_queue::deadline() const
+{
+    return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(deadline_.load()));
+}
+
+bool device_queue::background() const { return background_; }
+
+std::shared_ptr<device_queue> device_queue::current() { return g_current_queue; }
+
+device_queue::scope::scope(std::shared_ptr<device_queue> queue)
+    : previous_(std::exchange(g_current_queue, std::move(queue)))
+{
+}
+
+device_queue::scope::~scope() { g_current_queue = std::move(previous_); }
+
+// The tasks waiting for the device thread, by the queue they were dispatched from. Every task scheduled posts one
+// handler to the device thread, which runs whichever task is most urgent by then rather than the one it was posted
+// for, so a burst of uploads from one channel can't hold back the render of another channel that is due earlier.
+// Tasks may tell whether what they wait for is done, such as the textures a render draws, and are passed over until
+// it is.
+struct task_scheduler
+{
+    using clock_t = std::chrono::steady_clock;
+
+    struct task
+    {
+        clock_t::time_point   deadline;
+        uint64_t              sequence;
+        std::function<void()> func;
+        std::function<bool()> ready;
+    };
+
+    struct queue
+    {
+        std::shared_ptr<device_queue> owner;
+        std::deque<task>              tasks;
+    };
+
+    std::mutex                           mutex_;
+    std::map<const device_queue*, queue> queues_;
+    uint64_t                             sequence_ = 0;
+    std::atomic<uint64_t>                late_{0};
+
+    void push(std::function<void()> func, std::function<bool()> ready)
+    {
+        auto owner    = device_queue::current();
+        auto deadline = owner ? owner->deadline() : clock_t::now();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto& queue = queues_[owner.get()];
+        queue.owner = std::move(owner);
+        queue.tasks.push_back(task{deadline, sequence_++, std::move(func), std::move(ready)});
+    }
+
+    // Background queues come last, then the earliest deadline, then the first dispatched.
+    static bool precedes(const queue& a, const queue& b)
+    {
+        auto a_background = a.owner && a.owner->background();
+        auto b_background = b.owner && b.owner->background();
+        return std::tie(a_background, a.tasks.front().deadline, a.tasks.front().sequence) <
+               std::tie(b_background, b.tasks.front().deadline, b.tasks.front().sequence);
+    }
+
+    // The most urgent of the tasks that are ready at the front of their queue. When none are, the first one
+    // dispatched runs as it always did, since everything dispatched before it has already run.
+    std::function<void()> pop()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto next   = queues_.end();
+        auto oldest = queues_.end();
+        for (auto it = queues_.begin(); it != queues_.end(); ++it) {
+            auto& front = it->second.tasks.front();
+            if (oldest == queues_.end() || front.sequence < oldest->second.tasks.front().sequence) {
+                oldest = it;
+            }
+            if (front.ready && !front.ready()) {
+                continue;
+            }
+            if (next == queues_.end() || precedes(it->second, next->second)) {
+                next = it;
+            }
+        }
+
+        if (next == queues_.end()) {
+            next = oldest;
+        }
+        if (next == queues_.end()) {
+            return nullptr;
+        }
+
+        auto task = std::move(next->second.tasks.front());
+        next->second.tasks.pop_front();
+        if (next->second.tasks.empty()) {
+            queues_.erase(next);
+        }
+
+        if (next->first && task.deadline < clock_t::now()) {
+            late_ += 1;
+        }
+
+        return std::move(task.func);
+    }
+};
+
 struct device::impl : public std::enable_shared_from_this<impl>
 {
-    using texture_queue_t = tbb::concurrent_bounded_queue<std::shared_ptr<texture>>;
-    using buffer_queue_t  = tbb::concurrent_bounded_queue<std::shared_ptr<buffer>>;
+    using buffer_queue_t = tbb::concurrent_bounded_queue<std::shared_ptr<buffer>>;
+
+    const int index_;
+    context   device_;
+
+    texture_pool                                                         texture_pool_;
+    std::array<tbb::concurrent_unordered_map<size_t, buffer_queue_t>, 2> host_pools_;
+
+    // Write buffers are kept topped up from a second, shared context so that a producer asking for a frame never
+    // waits for the device thread to finish rendering.
+    static constexpr size_t host_pool_low_water = 2;
+    static constexpr size_t host_pool_ring_size = 4;
 
-    sf::Context device_;
+    // A readback that takes longer than a few frames at the slowest rates means the gpu hung or was lost.
+    static constexpr GLuint64 readback_timeout = 250000000; // ns
 
-    std::array<tbb::concurrent_unordered_map<size_t, texture_queue_t>, 4> device_pools_;
-    std::array<tbb::concurrent_unordered_map<size_t, buffer_queue_t>, 2>  host_pools_;
+    tbb::concurrent_unordered_map<size_t, std::atomic<size_t>> host_pool_pending_;
+
+    std::atomic<uint64_t> readback_count_{0};
+    std::atomic<uint64_t> readback_gpu_time_{0}; // ns
 
     using sync_queue_t = tbb::concurrent_bounded_queue<std::shared_ptr<buffer>>;
 
@@ -73,18 +323,41 @@ struct device::impl : public std::enable_shared_from_this<impl>
 
     std::wstring version_;
 
+    task_scheduler                      scheduler_;
     io_context                          service_;
     decltype(make_work_guard(service_)) work_;
     std::thread                         thread_;
 
-    impl()
-        : device_(sf::ContextSettings(0, 0, 0, 4, 5, sf::ContextSettings::Attribute::Core), 1, 1)
+    io_context                                alloc_service_;
+    decltype(make_work_guard(alloc_service_)) alloc_work_;
+    std::thread                               alloc_thread_;
+
+    io_context                                 upload_service_;
+    decltype(make_work_guard(upload_service_)) upload_work_;
+    std::thread                                upload_thread_;
+
+    io_context                                   readback_service_;
+    decltype(make_work_guard(readback_service_)) readback_work_;
+    std::thread                                  readback_thread_;
+
+    std::shared_ptr<void> metrics_;
+
+    explicit impl(int index)
+        : index_(index)
+        , device_(index)
         , work_(make_work_guard(service_))
+        , alloc_work_(make_work_guard(alloc_service_))
+        , upload_work_(make_work_guard(upload_service_))
+        , readback_work_(make_work_guard(readback_service_))
     {
-        CASPAR_LOG(info) << L"Initializing OpenGL Device.";
+        CASPAR_LOG(info) << L"Initializing OpenGL Device " << index_ << L".";
 
-        device_.setActive(true);
+        texture_pool_.budget_ =
+            env::properties().get<size_t>(L"configuration.ogl.texture-pool-size", 512) * 1024 * 1024;
 
+        device_.set_active(true);
+
+        // Without an X display, as with EGL, GLEW loads the functions of the context and then fails on GLX.
         auto err = glewInit();
         if (err != GLEW_OK && err != GLEW_ERROR_NO_GLX_DISPLAY) {
             std::stringstream str;
@@ -113,43 +386,107 @@ struct device::impl : public std::enable_shared_from_this<impl>
         GL(glCreateFramebuffers(1, &fbo_));
         GL(glBindFramebuffer(GL_FRAMEBUFFER, fbo_));
 
-        device_.setActive(false);
+        device_.set_active(false);
 
         thread_ = std::thread([&] {
-            device_.setActive(true);
-            set_thread_name(L"OpenGL Device");
+            device_.set_active(true);
+            set_thread_name(L"OpenGL Device " + std::to_wstring(index_));
+            set_thread_affinity(thread_role::gpu);
             service_.run();
-            device_.setActive(false);
+            device_.set_active(false);
+        });
+
+        alloc_thread_ = std::thread([&] {
+            context context(index_, &device_);
+            context.set_active(true);
+            set_thread_name(L"OpenGL Allocator");
+            set_thread_affinity(thread_role::gpu);
+            alloc_service_.run();
+            context.set_active(false);
+        });
+
+        if (env::properties().get(L"configuration.ogl.upload-thread", false)) {
+            upload_thread_ = std::thread([&] {
+                context context(index_, &device_);
+                context.set_active(true);
+                set_thread_name(L"OpenGL Upload");
+                set_thread_affinity(thread_role::gpu);
+                upload_service_.run();
+                context.set_active(false);
+            });
+        }
+
+        if (env::properties().get(L"configuration.ogl.readback-thread", false)) {
+            readback_thread_ = std::thread([&] {
+                context context(index_, &device_);
+                context.set_active(true);
+                set_thread_name(L"OpenGL Readback");
+                set_thread_affinity(thread_role::gpu);
+                readback_service_.run();
+                context.set_active(false);
+            });
+        }
+
+        metrics_ = diagnostics::metrics::add_collector([this](std::vector<diagnostics::metrics::sample>& samples) {
+            collect_metrics(samples);
         });
     }
 
     ~impl()
     {
+        metrics_.reset();
+
+        upload_work_.reset();
+        if (upload_thread_.joinable())
+            upload_thread_.join();
+
+        readback_work_.reset();
+        if (readback_thread_.joinable())
+            readback_thread_.join();
+
         work_.reset();
         thread_.join();
 
-        device_.setActive(true);
+        alloc_work_.reset();
+        alloc_thread_.join();
+
+        device_.set_active(true);
 
         for (auto& pool : host_pools_)
             pool.clear();
 
-        for (auto& pool : device_pools_)
-            pool.clear();
+        texture_pool_.trim(0);
 
         sync_queue_.clear();
 
         GL(glDeleteFramebuffers(1, &fbo_));
     }
 
+    // Runs at once when called from the device thread, like boost::asio::dispatch.
+    void schedule(std::function<void()> func, std::function<bool()> ready = nullptr)
+    {
+        if (service_.get_executor().running_in_this_thread()) {
+            func();
+            return;
+        }
+
+        scheduler_.push(std::move(func), std::move(ready));
+        boost::asio::post(service_, [this] {
+            if (auto next = scheduler_.pop()) {
+                next();
+            }
+        });
+    }
+
     template <typename Func>
     auto spawn_async(Func&& func)
     {
         using result_type = decltype(func(std::declval<yield_context>()));
         using task_type   = std::packaged_task<result_type(yield_context)>;
 
-        auto task   = task_type(std::forward<Func>(func));
-        auto future = task.get_future();
-        boost::asio::spawn(service_, std::move(task));
+        auto task   = std::make_shared<task_type>(std::forward<Func>(func));
+        auto future = task->get_future();
+        schedule([this, task] { boost::asio::spawn(service_, std::move(*task)); });
         return future;
     }
 
@@ -159,9 +496,9 @@ struct device::impl : public std::enable_shared_from_this<impl>
         using result_type = decltype(func());
         using task_type   = std::packaged_task<result_type()>;
 
-        auto task   = task_type(std::forward<Func>(func));
-        auto future = task.get_future();
-        boost::asio::dispatch(service_, std::move(task));
+        auto task   = std::make_shared<task_type>(std::forward<Func>(func));
+        auto future = task->get_future();
+        schedule([task] { (*task)(); });
         return future;
     }
 
@@ -173,17 +510,22 @@ struct device::impl : public std::enable_shared_from_this<impl>
 
     std::wstring version() { return version_; }
 
-    std::shared_ptr<texture> create_texture(int width, int height, int stride, bool clear)
+    std::shared_ptr<texture> create_texture(int                 width,
+                                            int                 height,
+                                            int                 stride,
+                                            bool                clear,
+                                            int                 levels      = 1,
+                                            texture_compression compression = texture_compression::none,
+                                            texture_depth       depth       = texture_depth::bit8)
     {
-        CASPAR_VERIFY(stride > 0 && stride < 5);
+        CASPAR_VERIFY(compression != texture_compression::none || (stride > 0 && stride < 5));
         CASPAR_VERIFY(width > 0 && height > 0);
 
-        // TODO (perf) Shared pool.
-        auto pool = &device_pools_[stride - 1][(width << 16 & 0xFFFF0000) | (height & 0x0000FFFF)];
-
-        std::shared_ptr<texture> tex;
-        if (!pool->try_pop(tex)) {
-            tex = std::make_shared<texture>(width, height, stride);
+        auto tex = texture_pool_.pop(width, height, stride, levels, compression, depth);
+        if (!tex) {
+            tex = compression != texture_compression::none
+                      ? std::make_shared<texture>(width, height, compression)
+                      : std::make_shared<texture>(width, height, stride, levels, depth);
         }
 
         if (clear) {
@@ -191,21 +533,30 @@ struct device::impl : public std::enable_shared_from_this<impl>
         }
 
         auto ptr = tex.get();
-        return std::shared_ptr<texture>(
-            ptr, [tex = std::move(tex), pool, self = shared_from_this()](texture*) mutable { pool->push(tex); });
+        return std::shared_ptr<texture>(ptr, [tex = std::move(tex), self = shared_from_this()](texture*) mutable {
+            if (self->texture_pool_.push(std::move(tex))) {
+                self->schedule([self] { self->texture_pool_.trim(self->texture_pool_.budget_); });
+            }
+        });
     }
 
     std::shared_ptr<buffer> create_buffer(int size, bool write)
     {
         CASPAR_VERIFY(size > 0);
 
-        // TODO (perf) Shared pool.
         auto pool = &host_pools_[static_cast<int>(write ? 1 : 0)][size];
 
         std::shared_ptr<buffer> buf;
         if (!pool->try_pop(buf)) {
-            // TODO (perf) Avoid blocking in create_array.
-            dispatch_sync([&] { buf = std::make_shared<buffer>(size, write); });
+            if (service_.get_executor().running_in_this_thread()) {
+                buf = std::make_shared<buffer>(size, write);
+            } else {
+                buf = allocate_buffers(size, write, 1).get().front();
+            }
+        }
+
+        if (write && static_cast<size_t>(pool->size()) < host_pool_low_water) {
+            reserve_buffers(size, host_pool_ring_size);
         }
 
         auto ptr = buf.get();
@@ -214,6 +565,53 @@ struct device::impl : public std::enable_shared_from_this<impl>
         });
     }
 
+    // Must run on the allocator thread.
+    static std::vector<std::shared_ptr<buffer>> make_buffers(int size, bool write, size_t count)
+    {
+        std::vector<std::shared_ptr<buffer>> buffers;
+        for (size_t n = 0; n < count; ++n) {
+            buffers.push_back(std::make_shared<buffer>(size, write));
+        }
+        // The buffers are used from the device context, make sure they are complete before handing them over.
+        GL(glFinish());
+        return buffers;
+    }
+
+    std::future<std::vector<std::shared_ptr<buffer>>> allocate_buffers(int size, bool write, size_t count)
+    {
+        auto task = std::make_shared<std::packaged_task<std::vector<std::shared_ptr<buffer>>()>>(
+            [=] { return make_buffers(size, write, count); });
+        auto future = task->get_future();
+        boost::asio::post(alloc_service_, [task] { (*task)(); });
+        return future;
+    }
+
+    // Grows the write pool for size to count buffers in the background.
+    void reserve_buffers(int size, size_t count)
+    {
+        auto pool    = &host_pools_[1][size];
+        auto pending = &host_pool_pending_[size];
+
+        auto available = static_cast<size_t>(std::max<std::ptrdiff_t>(pool->size(), 0)) + pending->load();
+        if (available >= count) {
+            return;
+        }
+
+        auto missing = count - available;
+        *pending += missing;
+
+        boost::asio::post(alloc_service_, [=] {
+            try {
+                for (auto& buf : make_buffers(size, true, missing)) {
+                    pool->push(std::move(buf));
+                }
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+            *pending -= missing;
+        });
+    }
+
     array<uint8_t> create_array(int size)
     {
         auto buf = create_buffer(size, true);
@@ -221,33 +619,184 @@ struct device::impl : public std::enable_shared_from_this<impl>
         return array<uint8_t>(ptr, buf->size(), buf);
     }
 
+    // A full mip chain, down to a single texel.
+    static int mip_levels(int width, int height)
+    {
+        int levels = 1;
+        while ((std::max(width, height) >> levels) > 0) {
+            ++levels;
+        }
+        return levels;
+    }
+
+    std::shared_ptr<texture> upload(const array<const uint8_t>& source,
+                                    int                         width,
+                                    int                         height,
+                                    int                         stride,
+                                    bool                        mipmaps,
+                                    texture_compression         compression = texture_compression::none,
+                                    texture_depth               depth       = texture_depth::bit8)
+    {
+        diagnostics::trace::span span("ogl.upload", -1, -1, "ogl");
+
+        std::shared_ptr<buffer> buf;
+
+        // Also finds the arrays handed out by create_array that have been wrapped to share them with another owner.
+        if (auto tmp = source.storage<std::shared_ptr<buffer>>()) {
+            buf = *tmp;
+        } else {
+            buf = create_buffer(static_cast<int>(source.size()), true);
+            // Foreign memory, such as a received NDI frame, is copied in parallel with streaming stores since the
+            // upload buffer is never read on the cpu.
+            auto dest = static_cast<uint8_t*>(buf->data());
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, source.size(), 1 << 20), [&](const auto& r) {
+                memcpy_nt(dest + r.begin(), source.data() + r.begin(), r.size());
+            });
+        }
+
+        if (compression != texture_compression::none) {
+            // Blocks are sampled as they are, there is no mip chain to generate from them.
+            auto tex = create_texture(width, height, stride, false, 1, compression);
+            tex->copy_from(*buf);
+            return tex;
+        }
+
+        auto tex = create_texture(
+            width, height, stride, false, mipmaps ? mip_levels(width, height) : 1, texture_compression::none, depth);
+        tex->copy_from(*buf);
+        tex->generate_mipmaps();
+        // TODO (perf) save tex on source
+        return tex;
+    }
+
     std::future<std::shared_ptr<texture>>
-    copy_async(const array<const uint8_t>& source, int width, int height, int stride)
+    copy_async(const array<const uint8_t>& source,
+               int                         width,
+               int                         height,
+               int                         stride,
+               bool                        mipmaps,
+               texture_compression         compression = texture_compression::none,
+               texture_depth               depth       = texture_depth::bit8)
     {
-        return dispatch_async([=] {
-            std::shared_ptr<buffer> buf;
+        if (!upload_thread_.joinable()) {
+            return dispatch_async([=] { return upload(source, width, height, stride, mipmaps, compression, depth); });
+        }
 
-            auto tmp = source.storage<std::shared_ptr<buffer>>();
-            if (tmp) {
-                buf = *tmp;
-            } else {
-                buf = create_buffer(static_cast<int>(source.size()), true);
-                // TODO (perf) Copy inside a TBB worker.
-                std::memcpy(buf->data(), source.data(), source.size());
+        // The texture is only handed to the device thread once the upload context has finished writing it, so the
+        // renderer never waits for uploads queued behind the previous frame's draws.
+        auto task = std::make_shared<std::packaged_task<std::shared_ptr<texture>()>>([=] {
+            auto tex = upload(source, width, height, stride, mipmaps, compression, depth);
+
+            auto fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
             }
+            glDeleteSync(fence);
 
-            auto tex = create_texture(width, height, stride, false);
-            tex->copy_from(*buf);
-            // TODO (perf) save tex on source
             return tex;
         });
+        auto future = task->get_future();
+        boost::asio::post(upload_service_, [task] { (*task)(); });
+        return future;
+    }
+
+    // Copies from the readback context once the draws queued before on the device thread are done. Drivers run the
+    // copies of a context that only transfers on a copy engine, next to the rendering of the following frames, and
+    // the readback thread blocks on its fence instead of the device thread polling it.
+    std::future<array<const uint8_t>> readback_async(const std::shared_ptr<texture>& source)
+    {
+        auto promise = std::make_shared<std::promise<array<const uint8_t>>>();
+        auto future  = promise->get_future();
+
+        schedule([=] {
+            std::shared_ptr<buffer> buf;
+            try {
+                buf = create_buffer(source->size(), false);
+            } catch (...) {
+                promise->set_exception(std::current_exception());
+                return;
+            }
+
+            auto drawn = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            GL(glFlush());
+            sync_queue_.push(nullptr);
+
+            auto readback = [=] {
+                CASPAR_SCOPE_EXIT { glDeleteSync(drawn); };
+                try {
+                    auto begin = diagnostics::trace::clock_t::now();
+
+                    GL(glWaitSync(drawn, 0, GL_TIMEOUT_IGNORED));
+
+                    std::array<GLuint, 2> timestamps;
+                    GL(glGenQueries(2, timestamps.data()));
+                    CASPAR_SCOPE_EXIT { glDeleteQueries(2, timestamps.data()); };
+                    GL(glQueryCounter(timestamps[0], GL_TIMESTAMP));
+                    source->copy_to(*buf);
+                    GL(glQueryCounter(timestamps[1], GL_TIMESTAMP));
+
+                    auto copied = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                    CASPAR_SCOPE_EXIT { glDeleteSync(copied); };
+                    const auto status = glClientWaitSync(copied, GL_SYNC_FLUSH_COMMANDS_BIT, readback_timeout);
+                    if (status == GL_TIMEOUT_EXPIRED) {
+                        CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Readback timed out, the gpu hung."));
+                    }
+                    if (status == GL_WAIT_FAILED) {
+                        CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Readback failed to wait for the gpu."));
+                    }
+
+                    GLuint64 copy_begin = 0;
+                    GLuint64 copy_end   = 0;
+                    GL(glGetQueryObjectui64v(timestamps[0], GL_QUERY_RESULT, &copy_begin));
+                    GL(glGetQueryObjectui64v(timestamps[1], GL_QUERY_RESULT, &copy_end));
+
+                    readback_count_ += 1;
+                    readback_gpu_time_ += copy_end - copy_begin;
+
+                    diagnostics::trace::record(
+                        "ogl.readback", "ogl", begin, diagnostics::trace::clock_t::now(), -1, -1, true);
+
+                    std::shared_ptr<buffer> buf2;
+                    while (sync_queue_.try_pop(buf2) && buf2) {
+                        auto pool = &host_pools_[static_cast<int>(buf2->write() ? 1 : 0)][buf2->size()];
+                        pool->push(std::move(buf2));
+                    }
+
+                    auto ptr  = reinterpret_cast<uint8_t*>(buf->data());
+                    auto size = buf->size();
+                    promise->set_value(array<const uint8_t>(ptr, size, buf));
+                } catch (...) {
+                    promise->set_exception(std::current_exception());
+                }
+            };
+
+            try {
+                boost::asio::post(readback_service_, std::move(readback));
+            } catch (...) {
+                glDeleteSync(drawn);
+                promise->set_exception(std::current_exception());
+            }
+        });
+
+        return future;
     }
 
     std::future<array<const uint8_t>> copy_async(const std::shared_ptr<texture>& source)
     {
+        if (readback_thread_.joinable()) {
+            return readback_async(source);
+        }
+
         return spawn_async([=](yield_context yield) {
+            auto begin = diagnostics::trace::clock_t::now();
+
+            // Timestamps rather than an elapsed query, the image mixer may have one active around its readbacks.
+            std::array<GLuint, 2> timestamps;
+            GL(glGenQueries(2, timestamps.data()));
+
             auto buf = create_buffer(source->size(), false);
+            GL(glQueryCounter(timestamps[0], GL_TIMESTAMP));
             source->copy_to(*buf);
+            GL(glQueryCounter(timestamps[1], GL_TIMESTAMP));
 
             sync_queue_.push(nullptr);
 
@@ -269,6 +818,18 @@ struct device::impl : public std::enable_shared_from_this<impl>
 
             glDeleteSync(fence);
 
+            GLuint64 copy_begin = 0;
+            GLuint64 copy_end   = 0;
+            GL(glGetQueryObjectui64v(timestamps[0], GL_QUERY_RESULT, &copy_begin));
+            GL(glGetQueryObjectui64v(timestamps[1], GL_QUERY_RESULT, &copy_end));
+            GL(glDeleteQueries(2, timestamps.data()));
+
+            readback_count_ += 1;
+            readback_gpu_time_ += copy_end - copy_begin;
+
+            // The readback yields to other work on the device thread while waiting for the fence.
+            diagnostics::trace::record("ogl.readback", "ogl", begin, diagnostics::trace::clock_t::now(), -1, -1, true);
+
             {
                 std::shared_ptr<buffer> buf2;
                 while (sync_queue_.try_pop(buf2) && buf2) {
@@ -314,7 +875,7 @@ struct device::impl : public std::enable_shared_from_this<impl>
     }
 #endif
 
-    boost::property_tree::wptree info() const
+    boost::property_tree::wptree info()
     {
         boost::property_tree::wptree info;
 
@@ -322,26 +883,25 @@ struct device::impl : public std::enable_shared_from_this<impl>
         size_t                       total_pooled_device_buffer_size  = 0;
         size_t                       total_pooled_device_buffer_count = 0;
 
-        for (size_t i = 0; i < device_pools_.size(); ++i) {
-            auto& pools      = device_pools_.at(i);
-            bool  mipmapping = i > 3;
-            auto  stride     = mipmapping ? i - 3 : i + 1;
-
-            for (auto& pool : pools) {
-                auto width  = pool.first >> 16;
-                auto height = pool.first & 0x0000FFFF;
-                auto size   = width * height * stride;
-                auto count  = pool.second.size();
+        {
+            std::lock_guard<std::mutex> lock(texture_pool_.mutex_);
 
-                if (count == 0)
+            for (auto& pool : texture_pool_.free_) {
+                if (pool.second.empty()) {
                     continue;
+                }
+
+                auto& tex   = *pool.second.front();
+                auto  size  = texture_pool::size(*tex);
+                auto  count = pool.second.size();
 
                 boost::property_tree::wptree pool_info;
 
-                pool_info.add(L"stride", stride);
-                pool_info.add(L"mipmapping", mipmapping);
-                pool_info.add(L"width", width);
-                pool_info.add(L"height", height);
+                pool_info.add(L"stride", tex->stride());
+                pool_info.add(L"depth", tex->depth() == texture_depth::bit16 ? 16 : 8);
+                pool_info.add(L"levels", tex->levels());
+                pool_info.add(L"width", tex->width());
+                pool_info.add(L"height", tex->height());
                 pool_info.add(L"size", size);
                 pool_info.add(L"count", count);
 
@@ -350,6 +910,11 @@ struct device::impl : public std::enable_shared_from_this<impl>
 
                 pooled_device_buffers.add_child(L"device_buffer_pool", pool_info);
             }
+
+            info.add(L"gl.summary.pooled_device_buffers.budget", texture_pool_.budget_);
+            info.add(L"gl.summary.pooled_device_buffers.hits", texture_pool_.hits_);
+            info.add(L"gl.summary.pooled_device_buffers.misses", texture_pool_.misses_);
+            info.add(L"gl.summary.pooled_device_buffers.evictions", texture_pool_.evictions_);
         }
 
         info.add_child(L"gl.details.pooled_device_buffers", pooled_device_buffers);
@@ -394,19 +959,49 @@ struct device::impl : public std::enable_shared_from_this<impl>
         info.add(L"gl.summary.pooled_host_buffers.total_write_size", total_write_size);
         info.add_child(L"gl.summary.all_host_buffers", buffer::info());
 
+        auto readback_count = readback_count_.load();
+        info.add(L"gl.summary.readback.count", readback_count);
+        info.add(L"gl.summary.readback.average_gpu_time",
+                 readback_count > 0 ? readback_gpu_time_.load() * 1e-6 / static_cast<double>(readback_count) : 0.0);
+        info.add(L"gl.summary.schedule.late_count", scheduler_.late_.load());
+
         return info;
     }
 
+    // Exports the numbers of the info summary, e.g. gl.summary.pooled_device_buffers.hits becomes
+    // caspar_gpu_pooled_device_buffers_hits.
+    void collect_metrics(std::vector<diagnostics::metrics::sample>& samples)
+    {
+        const diagnostics::metrics::labels_t labels = {{"device", std::to_string(index_)}};
+
+        std::function<void(const std::string&, const boost::property_tree::wptree&)> walk =
+            [&](const std::string& name, const boost::property_tree::wptree& tree) {
+                if (tree.empty()) {
+                    auto value = tree.get_value_optional<double>();
+                    if (value)
+                        samples.push_back({name, "GPU " + name.substr(11), labels, *value});
+                    return;
+                }
+                for (auto& child : tree) {
+                    // Lists of pools repeat the same key, only the totals are exported.
+                    if (tree.count(child.first) > 1)
+                        continue;
+                    walk(name + "_" + u8(child.first), child.second);
+                }
+            };
+
+        auto summary = info().get_child_optional(L"gl.summary");
+        if (summary)
+            walk("caspar_gpu", *summary);
+    }
+
     std::future<void> gc()
     {
         return spawn_async([=](yield_context yield) {
             CASPAR_LOG(info) << " ogl: Running GC.";
 
             try {
-                for (auto& pools : device_pools_) {
-                    for (auto& pool : pools)
-                        pool.second.clear();
-                }
+                texture_pool_.trim(0);
                 for (auto& pools : host_pools_) {
                     for (auto& pool : pools)
                         pool.second.clear();
@@ -418,8 +1013,8 @@ struct device::impl : public std::enable_shared_from_this<impl>
     }
 };
 
-device::device()
-    : impl_(new impl())
+device::device(int index)
+    : impl_(new impl(index))
 {
 }
 device::~device() {}
@@ -427,18 +1022,38 @@ std::shared_ptr<texture> device::create_texture(int width, int height, int strid
 {
     return impl_->create_texture(width, height, stride, true);
 }
+std::shared_ptr<texture> device::create_texture(int width, int height, int stride, texture_depth depth)
+{
+    return impl_->create_texture(width, height, stride, true, 1, texture_compression::none, depth);
+}
 array<uint8_t> device::create_array(int size) { return impl_->create_array(size); }
+void           device::reserve_arrays(int size, int count) { impl_->reserve_buffers(size, count); }
 std::future<std::shared_ptr<texture>>
-device::copy_async(const array<const uint8_t>& source, int width, int height, int stride)
+device::copy_async(const array<const uint8_t>& source, int width, int height, int stride, bool mipmaps)
 {
-    return impl_->copy_async(source, width, height, stride);
+    return impl_->copy_async(source, width, height, stride, mipmaps);
+}
+std::future<std::shared_ptr<texture>> device::copy_async(
+    const array<const uint8_t>& source, int width, int height, int stride, texture_depth depth, bool mipmaps)
+{
+    return impl_->copy_async(source, width, height, stride, mipmaps, texture_compression::none, depth);
+}
+std::future<std::shared_ptr<texture>>
+device::copy_async(const array<const uint8_t>& source, int width, int height, texture_compression compression)
+{
+    auto block_size = compression == texture_compression::bc1 ? 8 : 16;
+    return impl_->copy_async(source, width, height, block_size, false, compression);
 }
 std::future<array<const uint8_t>> device::copy_async(const std::shared_ptr<texture>& source)
 {
     return impl_->copy_async(source);
 }
-void         device::dispatch(std::function<void()> func) { boost::asio::dispatch(impl_->service_, std::move(func)); }
+void device::dispatch(std::function<void()> func, std::function<bool()> ready)
+{
+    impl_->schedule(std::move(func), std::move(ready));
+}
 std::wstring device::version() const { return impl_->version(); }
+int          device::index() const { return impl_->index_; }
 boost::property_tree::wptree device::info() const { return impl_->info(); }
 std::future<void>            device::gc() { return impl_->gc(); }
 }}} // namespace caspar::accelerator::ogl
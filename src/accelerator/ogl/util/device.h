@@ -24,8 +24,12 @@
 #include <accelerator/accelerator.h>
 #include <common/array.h>
 
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <future>
+#include <memory>
+#include <utility>
 
 #ifdef WIN32
 #include <GL/glew.h>
@@ -33,12 +37,52 @@
 
 namespace caspar { namespace accelerator { namespace ogl {
 
+enum class texture_compression;
+enum class texture_depth;
+
+// The work of one channel on the devices. Whatever a thread dispatches while a queue is current on it keeps its order
+// within the queue, and runs before the work of queues due later. Background queues, such as those of thumbnails and
+// preview channels, only run when nothing else is waiting. Work dispatched without a queue is due at once.
+class device_queue final
+{
+  public:
+    explicit device_queue(bool background = false);
+
+    device_queue(const device_queue&)            = delete;
+    device_queue& operator=(const device_queue&) = delete;
+
+    // The time the channel's next frame is due, set by the mixer every tick.
+    void                                  set_deadline(std::chrono::steady_clock::time_point deadline);
+    std::chrono::steady_clock::time_point deadline() const;
+    bool                                  background() const;
+
+    static std::shared_ptr<device_queue> current();
+
+    // Makes a queue current on the calling thread until the scope ends.
+    class scope final
+    {
+      public:
+        explicit scope(std::shared_ptr<device_queue> queue);
+        ~scope();
+
+        scope(const scope&)            = delete;
+        scope& operator=(const scope&) = delete;
+
+      private:
+        std::shared_ptr<device_queue> previous_;
+    };
+
+  private:
+    std::atomic<std::chrono::steady_clock::rep> deadline_;
+    const bool                                  background_;
+};
+
 class device final
     : public std::enable_shared_from_this<device>
     , public accelerator_device
 {
   public:
-    device();
+    explicit device(int index = 0);
     ~device();
 
     device(const device&) = delete;
@@ -46,20 +90,31 @@ class device final
     device& operator=(const device&) = delete;
 
     std::shared_ptr<class texture> create_texture(int width, int height, int stride);
+    std::shared_ptr<class texture> create_texture(int width, int height, int stride, texture_depth depth);
     array<uint8_t>                 create_array(int size);
+    void                           reserve_arrays(int size, int count);
 
+    // With mipmaps the texture gets a full mip chain, for sources drawn at a fraction of their size.
+    std::future<std::shared_ptr<class texture>>
+    copy_async(const array<const uint8_t>& source, int width, int height, int stride, bool mipmaps = false);
+    // With texture_depth::bit16 the source holds two bytes for each of the stride channels.
+    std::future<std::shared_ptr<class texture>> copy_async(
+        const array<const uint8_t>& source, int width, int height, int stride, texture_depth depth, bool mipmaps);
+    // Blocks of a compressed texture, uploaded without mipmaps.
     std::future<std::shared_ptr<class texture>>
-                                      copy_async(const array<const uint8_t>& source, int width, int height, int stride);
+    copy_async(const array<const uint8_t>& source, int width, int height, texture_compression compression);
     std::future<array<const uint8_t>> copy_async(const std::shared_ptr<class texture>& source);
+    // Runs func on the device thread. Until ready returns true other work may run before it, even if it is due
+    // later, so func doesn't hold up the device waiting for work that hasn't run yet.
     template <typename Func>
-    auto dispatch_async(Func&& func)
+    auto dispatch_async(Func&& func, std::function<bool()> ready = nullptr)
     {
         using result_type = decltype(func());
         using task_type   = std::packaged_task<result_type()>;
 
         auto task   = std::make_shared<task_type>(std::forward<Func>(func));
         auto future = task->get_future();
-        dispatch([=] { (*task)(); });
+        dispatch([=] { (*task)(); }, std::move(ready));
         return future;
     }
 
@@ -70,12 +125,13 @@ class device final
     }
 
     std::wstring version() const;
+    int          index() const;
 
     boost::property_tree::wptree info() const;
     std::future<void>            gc();
 
   private:
-    void dispatch(std::function<void()> func);
+    void dispatch(std::function<void()> func, std::function<bool()> ready);
     struct impl;
     std::shared_ptr<impl> impl_;
 };
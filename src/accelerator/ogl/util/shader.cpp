@@ -20,14 +20,117 @@
  */
 #include "shader.h"
 
+#include <common/env.h>
 #include <common/gl/gl_check.h>
+#include <common/log.h>
 
 #include <GL/glew.h>
 
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
 #include <unordered_map>
+#include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
+namespace {
+
+std::uint64_t fnv1a(std::uint64_t hash, const char* str)
+{
+    for (; str != nullptr && *str != 0; ++str) {
+        hash = (hash ^ static_cast<unsigned char>(*str)) * 1099511628211ULL;
+    }
+    return (hash ^ 0xFF) * 1099511628211ULL; // separates the strings
+}
+
+// Where the linked program for these sources is kept, empty when the cache is disabled or the driver can't hand out
+// program binaries. The driver and gpu are part of the key since a binary is only valid for the driver that made it.
+boost::filesystem::path cache_file(const std::string& vertex_source, const std::string& fragment_source)
+{
+    try {
+        if (!GLEW_ARB_get_program_binary || !env::properties().get(L"configuration.ogl.shader-cache", true)) {
+            return {};
+        }
+    } catch (...) {
+        return {};
+    }
+
+    auto hash = 14695981039346656037ULL;
+    hash      = fnv1a(hash, reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+    hash      = fnv1a(hash, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+    hash      = fnv1a(hash, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+    hash      = fnv1a(hash, vertex_source.c_str());
+    hash      = fnv1a(hash, fragment_source.c_str());
+
+    std::stringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << hash << ".bin";
+    return boost::filesystem::path(env::data_folder()) / L"shader-cache" / name.str();
+}
+
+GLuint load_program(const boost::filesystem::path& file)
+{
+    std::ifstream in(file.string(), std::ios::binary);
+    GLenum        format = 0;
+    if (!in.read(reinterpret_cast<char*>(&format), sizeof(format))) {
+        return 0;
+    }
+    std::vector<char> binary((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    auto program = glCreateProgram();
+    glProgramBinary(program, format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+    GLint success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+
+    // Binaries of another driver version are rejected, some drivers also raise an error.
+    while (glGetError() != GL_NO_ERROR) {
+    }
+
+    if (success == GL_FALSE) {
+        glDeleteProgram(program);
+        boost::system::error_code ec;
+        boost::filesystem::remove(file, ec);
+        return 0;
+    }
+    return program;
+}
+
+void save_program(GLuint program, const boost::filesystem::path& file)
+{
+    GLint length = 0;
+    GL(glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length));
+    if (length <= 0) {
+        return;
+    }
+
+    std::vector<char> binary(length);
+    GLenum            format = 0;
+    GL(glGetProgramBinary(program, length, nullptr, &format, binary.data()));
+
+    // Written next to the file and renamed, so that devices compiling the same program never read half a binary.
+    boost::filesystem::create_directories(file.parent_path());
+    auto tmp = boost::filesystem::unique_path(file.string() + ".%%%%-%%%%.tmp");
+    {
+        std::ofstream out(tmp.string(), std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&format), sizeof(format));
+        out.write(binary.data(), binary.size());
+        if (!out) {
+            out.close();
+            boost::filesystem::remove(tmp);
+            return;
+        }
+    }
+    boost::filesystem::rename(tmp, file);
+}
+
+} // namespace
+
 struct shader::impl
 {
     GLuint                                 program_;
@@ -41,6 +144,15 @@ struct shader::impl
     impl(const std::string& vertex_source_str, const std::string& fragment_source_str)
         : program_(0)
     {
+        auto cache = cache_file(vertex_source_str, fragment_source_str);
+        if (!cache.empty()) {
+            program_ = load_program(cache);
+            if (program_ != 0) {
+                GL(glUseProgramObjectARB(program_));
+                return;
+            }
+        }
+
         GLint success;
 
         const char* vertex_source = vertex_source_str.c_str();
@@ -82,6 +194,9 @@ struct shader::impl
         GL(glAttachObjectARB(program_, vertex_shader));
         GL(glAttachObjectARB(program_, fragmemt_shader));
 
+        if (!cache.empty()) {
+            GL(glProgramParameteri(program_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+        }
         GL(glLinkProgramARB(program_));
 
         GL(glDeleteObjectARB(vertex_shader));
@@ -96,6 +211,14 @@ struct shader::impl
             str << "Failed to link shader program:" << std::endl << info << std::endl;
             CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(str.str()));
         }
+
+        if (!cache.empty()) {
+            try {
+                save_program(program_, cache);
+            } catch (...) {
+                CASPAR_LOG(warning) << L"[shader] Could not cache program binary in " << cache.wstring();
+            }
+        }
         GL(glUseProgramObjectARB(program_));
     }
 
@@ -123,6 +246,11 @@ struct shader::impl
 
     void set(const std::string& name, float value) { GL(glUniform1f(get_uniform_location(name.c_str()), value)); }
 
+    void set(const std::string& name, int value0, int value1)
+    {
+        GL(glUniform2i(get_uniform_location(name.c_str()), value0, value1));
+    }
+
     void set(const std::string& name, double value0, double value1)
     {
         GL(glUniform2f(get_uniform_location(name.c_str()), static_cast<float>(value0), static_cast<float>(value1)));
@@ -144,6 +272,7 @@ shader::~shader() {}
 void  shader::set(const std::string& name, bool value) { impl_->set(name, value); }
 void  shader::set(const std::string& name, int value) { impl_->set(name, value); }
 void  shader::set(const std::string& name, float value) { impl_->set(name, value); }
+void  shader::set(const std::string& name, int value0, int value1) { impl_->set(name, value0, value1); }
 void  shader::set(const std::string& name, double value0, double value1) { impl_->set(name, value0, value1); }
 void  shader::set(const std::string& name, double value) { impl_->set(name, value); }
 GLint shader::get_attrib_location(const char* name) { return impl_->get_attrib_location(name); }
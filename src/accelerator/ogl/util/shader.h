@@ -40,6 +40,7 @@ class shader final
     void set(const std::string& name, bool value);
     void set(const std::string& name, int value);
     void set(const std::string& name, float value);
+    void set(const std::string& name, int value0, int value1);
     void set(const std::string& name, double value0, double value1);
     void set(const std::string& name, double value);
 
@@ -32,34 +32,71 @@ static GLenum FORMAT[]          = {0, GL_RED, GL_RG, GL_BGR, GL_BGRA};
 static GLenum INTERNAL_FORMAT[] = {0, GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
 static GLenum TYPE[] = {0, GL_UNSIGNED_BYTE, GL_UNSIGNED_BYTE, GL_UNSIGNED_BYTE, GL_UNSIGNED_INT_8_8_8_8_REV};
 
+// By stride, the textures of texture_depth::bit16.
+static GLenum INTERNAL_FORMAT_16[] = {0, GL_R16, GL_RG16, GL_RGB16, GL_RGBA16};
+static GLenum TYPE_16[]            = {0, GL_UNSIGNED_SHORT, GL_UNSIGNED_SHORT, GL_UNSIGNED_SHORT, GL_UNSIGNED_SHORT};
+
+// By texture_compression, and the bytes of each of their blocks.
+static GLenum COMPRESSED_FORMAT[] = {
+    0, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_COMPRESSED_RGBA_BPTC_UNORM};
+static GLsizei BLOCK_SIZE[] = {0, 8, 16, 16};
+
 struct texture::impl
 {
     GLuint  id_     = 0;
     GLsizei width_  = 0;
     GLsizei height_ = 0;
     GLsizei stride_ = 0;
+    GLsizei levels_ = 1;
     GLsizei size_   = 0;
 
+    texture_depth       depth_       = texture_depth::bit8;
+    texture_compression compression_ = texture_compression::none;
+
     impl(const impl&)            = delete;
     impl& operator=(const impl&) = delete;
 
   public:
-    impl(int width, int height, int stride)
+    impl(int width, int height, int stride, int levels, texture_depth depth)
         : width_(width)
         , height_(height)
         , stride_(stride)
-        , size_(width * height * stride)
+        , levels_(levels)
+        , size_(width * height * stride * (depth == texture_depth::bit16 ? 2 : 1))
+        , depth_(depth)
+    {
+        GL(glCreateTextures(GL_TEXTURE_2D, 1, &id_));
+        GL(glTextureParameteri(id_, GL_TEXTURE_MIN_FILTER, levels_ > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR));
+        GL(glTextureParameteri(id_, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+        GL(glTextureParameteri(id_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+        GL(glTextureParameteri(id_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+        GL(glTextureStorage2D(id_, levels_, internal_format(), width_, height_));
+    }
+
+    impl(int width, int height, texture_compression compression)
+        : width_(width)
+        , height_(height)
+        , stride_(BLOCK_SIZE[static_cast<int>(compression)])
+        , size_((width + 3) / 4 * ((height + 3) / 4) * stride_)
+        , compression_(compression)
     {
         GL(glCreateTextures(GL_TEXTURE_2D, 1, &id_));
         GL(glTextureParameteri(id_, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
         GL(glTextureParameteri(id_, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
         GL(glTextureParameteri(id_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
         GL(glTextureParameteri(id_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-        GL(glTextureStorage2D(id_, 1, INTERNAL_FORMAT[stride_], width_, height_));
+        GL(glTextureStorage2D(id_, 1, COMPRESSED_FORMAT[static_cast<int>(compression_)], width_, height_));
     }
 
     ~impl() { glDeleteTextures(1, &id_); }
 
+    GLenum internal_format() const
+    {
+        return depth_ == texture_depth::bit16 ? INTERNAL_FORMAT_16[stride_] : INTERNAL_FORMAT[stride_];
+    }
+
+    GLenum type() const { return depth_ == texture_depth::bit16 ? TYPE_16[stride_] : TYPE[stride_]; }
+
     void bind() { GL(glBindTexture(GL_TEXTURE_2D, id_)); }
 
     void bind(int index)
@@ -72,7 +109,12 @@ struct texture::impl
 
     void attach() { GL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + 0, GL_TEXTURE_2D, id_, 0)); }
 
-    void clear() { GL(glClearTexImage(id_, 0, FORMAT[stride_], TYPE[stride_], nullptr)); }
+    void clear() { GL(glClearTexImage(id_, 0, FORMAT[stride_], type(), nullptr)); }
+
+    void clear(int x, int y, int width, int height, const void* pixel)
+    {
+        GL(glClearTexSubImage(id_, 0, x, y, 0, width, height, 1, FORMAT[stride_], type(), pixel));
+    }
 
 #ifdef WIN32
     void copy_from(int texture_id)
@@ -86,13 +128,20 @@ struct texture::impl
     {
         src.bind();
 
+        if (compression_ != texture_compression::none) {
+            GL(glCompressedTextureSubImage2D(
+                id_, 0, 0, 0, width_, height_, COMPRESSED_FORMAT[static_cast<int>(compression_)], size_, nullptr));
+            src.unbind();
+            return;
+        }
+
         if (width_ % 16 > 0) {
             glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
         } else {
             glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
         }
 
-        GL(glTextureSubImage2D(id_, 0, 0, 0, width_, height_, FORMAT[stride_], TYPE[stride_], nullptr));
+        GL(glTextureSubImage2D(id_, 0, 0, 0, width_, height_, FORMAT[stride_], type(), nullptr));
 
         src.unbind();
     }
@@ -100,13 +149,24 @@ struct texture::impl
     void copy_to(buffer& dst)
     {
         dst.bind();
-        GL(glGetTextureImage(id_, 0, FORMAT[stride_], TYPE[stride_], size_, nullptr));
+        GL(glGetTextureImage(id_, 0, FORMAT[stride_], type(), size_, nullptr));
         dst.unbind();
     }
+
+    void generate_mipmaps()
+    {
+        if (levels_ > 1) {
+            GL(glGenerateTextureMipmap(id_));
+        }
+    }
 };
 
-texture::texture(int width, int height, int stride)
-    : impl_(new impl(width, height, stride))
+texture::texture(int width, int height, int stride, int levels, texture_depth depth)
+    : impl_(new impl(width, height, stride, levels, depth))
+{
+}
+texture::texture(int width, int height, texture_compression compression)
+    : impl_(new impl(width, height, compression))
 {
 }
 texture::texture(texture&& other)
@@ -123,15 +183,23 @@ void texture::bind(int index) { impl_->bind(index); }
 void texture::unbind() { impl_->unbind(); }
 void texture::attach() { impl_->attach(); }
 void texture::clear() { impl_->clear(); }
+void texture::clear(int x, int y, int width, int height, const void* pixel)
+{
+    impl_->clear(x, y, width, height, pixel);
+}
 #ifdef WIN32
 void texture::copy_from(int source) { impl_->copy_from(source); }
 #endif
 void texture::copy_from(buffer& source) { impl_->copy_from(source); }
 void texture::copy_to(buffer& dest) { impl_->copy_to(dest); }
-int  texture::width() const { return impl_->width_; }
-int  texture::height() const { return impl_->height_; }
-int  texture::stride() const { return impl_->stride_; }
-int  texture::size() const { return impl_->width_ * impl_->height_ * impl_->stride_; }
-int  texture::id() const { return impl_->id_; }
+void texture::generate_mipmaps() { impl_->generate_mipmaps(); }
+int                 texture::width() const { return impl_->width_; }
+int                 texture::height() const { return impl_->height_; }
+int                 texture::stride() const { return impl_->stride_; }
+int                 texture::levels() const { return impl_->levels_; }
+texture_depth       texture::depth() const { return impl_->depth_; }
+texture_compression texture::compression() const { return impl_->compression_; }
+int                 texture::size() const { return impl_->size_; }
+int                 texture::id() const { return impl_->id_; }
 
 }}} // namespace caspar::accelerator::ogl
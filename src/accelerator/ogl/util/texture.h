@@ -25,10 +25,30 @@
 
 namespace caspar { namespace accelerator { namespace ogl {
 
+// Layouts of 4x4 pixel blocks that are uploaded and sampled as they are. The stride of such a texture is the size
+// of a block.
+enum class texture_compression
+{
+    none,
+    bc1,
+    bc3,
+    bc7,
+};
+
+// The size of the channels of an uncompressed texture. Both are sampled as normalized values.
+enum class texture_depth
+{
+    bit8,
+    bit16,
+};
+
 class texture final
 {
   public:
-    texture(int width, int height, int stride);
+    // Textures of more than one level are sampled with trilinear filtering, once generate_mipmaps() has filled them.
+    // The stride is the number of channels, which are of two bytes each with texture_depth::bit16.
+    texture(int width, int height, int stride, int levels = 1, texture_depth depth = texture_depth::bit8);
+    texture(int width, int height, texture_compression compression);
     texture(const texture&) = delete;
     texture(texture&& other);
     ~texture();
@@ -41,21 +61,35 @@ class texture final
 #endif
     void copy_from(class buffer& source);
     void copy_to(class buffer& dest);
+    void generate_mipmaps();
 
     void attach();
     void clear();
+    // Sets a rectangle to one pixel laid out like the uploaded images, such as a bgra one in 4 channels.
+    void clear(int x, int y, int width, int height, const void* pixel);
     void bind(int index);
     void unbind();
 
-    int width() const;
-    int height() const;
-    int stride() const;
-    int size() const;
-    int id() const;
+    int                 width() const;
+    int                 height() const;
+    int                 stride() const;
+    int                 levels() const;
+    texture_depth       depth() const;
+    texture_compression compression() const;
+    int                 size() const;
+    int                 id() const;
 
   private:
     struct impl;
     std::unique_ptr<impl> impl_;
 };
 
+// A mixed frame handed to consumers as core::output_format::texture. SFML shares objects between all of its
+// contexts, so the texture can be drawn from any of them once they have waited for the fence (a GLsync).
+struct shared_texture
+{
+    std::shared_ptr<texture> image;
+    std::shared_ptr<void>    fence;
+};
+
 }}} // namespace caspar::accelerator::ogl
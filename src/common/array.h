@@ -1,19 +1,122 @@
 #pragma once
 
-#include <any>
+#include "memory_pool.h"
+
+#include <atomic>
 #include <cstddef>
 #include <cstdlib>
 #include <cstring>
 #include <memory>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
 #include <vector>
 
 namespace caspar {
 
+template <typename T>
+class array;
+
+namespace detail {
+
+template <typename S>
+struct is_shared_array : std::false_type
+{
+};
+
+template <typename T>
+struct is_shared_array<std::shared_ptr<array<T>>> : std::true_type
+{
+};
+
+// Whatever keeps the memory of an array alive, reference counted in place and tagged with its type so that owners,
+// such as the device, can find their storage again with a pointer comparison.
+class array_storage
+{
+    std::atomic<std::size_t> refs_{1};
+    const std::type_info&    type_;
+
+  protected:
+    explicit array_storage(const std::type_info& type)
+        : type_(type)
+    {
+    }
+
+  public:
+    virtual ~array_storage() = default;
+
+    array_storage(const array_storage&)            = delete;
+    array_storage& operator=(const array_storage&) = delete;
+
+    void add_ref() noexcept { refs_.fetch_add(1, std::memory_order_relaxed); }
+
+    void release() noexcept
+    {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    template <typename S>
+    S* get(const void* data) noexcept;
+
+  private:
+    // The storage of the array this one holds through a shared_ptr, as long as both view the same memory.
+    virtual array_storage* wrapped(const void* data) noexcept = 0;
+};
+
+template <typename S>
+class typed_array_storage final : public array_storage
+{
+  public:
+    template <typename... Args>
+    explicit typed_array_storage(Args&&... args)
+        : array_storage(typeid(S))
+        , value(std::forward<Args>(args)...)
+    {
+    }
+
+    S value;
+
+  private:
+    array_storage* wrapped(const void* data) noexcept override
+    {
+        if constexpr (is_shared_array<S>::value) {
+            if (value && value->data() == data) {
+                return value->storage_;
+            }
+        }
+        return nullptr;
+    }
+};
+
+template <typename S>
+S* array_storage::get(const void* data) noexcept
+{
+    // Type names are unique on the platforms we build for, so this is usually just the pointer comparison.
+    for (auto storage = this; storage != nullptr; storage = storage->wrapped(data)) {
+        if (storage->type_ == typeid(S)) {
+            return &static_cast<typed_array_storage<S>*>(storage)->value;
+        }
+    }
+    return nullptr;
+}
+
+template <typename S>
+array_storage* make_array_storage(S&& value)
+{
+    return new typed_array_storage<std::decay_t<S>>(std::forward<S>(value));
+}
+
+} // namespace detail
+
 template <typename T>
 class array final
 {
     template <typename>
     friend class array;
+    template <typename>
+    friend class detail::typed_array_storage;
 
   public:
     using iterator       = T*;
@@ -25,51 +128,63 @@ class array final
         : size_(size)
     {
         if (size_ > 0) {
-            auto storage = std::shared_ptr<void>(std::malloc(size), std::free);
+            auto storage = create_aligned_buffer(size);
             ptr_         = reinterpret_cast<T*>(storage.get());
             std::memset(ptr_, 0, size_);
-            storage_ = std::make_shared<std::any>(std::move(storage));
+            storage_ = detail::make_array_storage(std::move(storage));
         }
     }
 
     array(std::vector<T> other)
     {
-        auto storage = std::make_shared<std::vector<T>>(std::move(other));
-        ptr_         = storage->data();
-        size_        = storage->size();
-        storage_     = std::make_shared<std::any>(std::move(storage));
+        auto storage = new detail::typed_array_storage<std::vector<T>>(std::move(other));
+        ptr_         = storage->value.data();
+        size_        = storage->value.size();
+        storage_     = storage;
     }
 
     template <typename S>
     explicit array(T* ptr, std::size_t size, S&& storage)
         : ptr_(ptr)
         , size_(size)
-        , storage_(std::make_shared<std::any>(std::forward<S>(storage)))
+        , storage_(detail::make_array_storage(std::forward<S>(storage)))
     {
     }
 
+    ~array()
+    {
+        if (storage_) {
+            storage_->release();
+        }
+    }
+
     array(const array<T>&) = delete;
 
-    array(array&& other)
+    array(array&& other) noexcept
         : ptr_(other.ptr_)
         , size_(other.size_)
-        , storage_(std::move(other.storage_))
+        , storage_(other.storage_)
     {
-        other.ptr_  = nullptr;
-        other.size_ = 0;
+        other.ptr_     = nullptr;
+        other.size_    = 0;
+        other.storage_ = nullptr;
     }
 
     array& operator=(const array<T>&) = delete;
 
-    array& operator=(array&& other)
+    array& operator=(array&& other) noexcept
     {
-        ptr_     = std::move(other.ptr_);
-        size_    = std::move(other.size_);
-        storage_ = std::move(other.storage_);
-
+        array(std::move(other)).swap(*this);
         return *this;
     }
 
+    void swap(array& other) noexcept
+    {
+        std::swap(ptr_, other.ptr_);
+        std::swap(size_, other.size_);
+        std::swap(storage_, other.storage_);
+    }
+
     T*          begin() const { return ptr_; }
     T*          data() const { return ptr_; }
     T*          end() const { return ptr_ + size_; }
@@ -77,21 +192,27 @@ class array final
 
     explicit operator bool() const { return size_ > 0; };
 
+    // The storage the array was created with, also found through a std::shared_ptr<array<U>> viewing the same memory.
     template <typename S>
     S* storage() const
     {
-        return std::any_cast<S>(storage_.get());
+        return storage_ ? storage_->get<S>(ptr_) : nullptr;
     }
 
   private:
-    T*                        ptr_  = nullptr;
-    std::size_t               size_ = 0;
-    std::shared_ptr<std::any> storage_;
+    T*                     ptr_     = nullptr;
+    std::size_t            size_    = 0;
+    detail::array_storage* storage_ = nullptr;
 };
 
 template <typename T>
 class array<const T> final
 {
+    template <typename>
+    friend class array;
+    template <typename>
+    friend class detail::typed_array_storage;
+
   public:
     using iterator       = const T*;
     using const_iterator = const T*;
@@ -102,37 +223,57 @@ class array<const T> final
         : size_(size)
     {
         if (size_ > 0) {
-            auto storage = std::shared_ptr<void>(std::malloc(size), std::free);
+            auto storage = create_aligned_buffer(size);
             ptr_         = reinterpret_cast<T*>(storage.get());
-            std::memset(ptr_, 0, size_);
-            storage_ = std::make_shared<std::any>(storage);
+            std::memset(storage.get(), 0, size_);
+            storage_ = detail::make_array_storage(std::move(storage));
         }
     }
 
     array(const std::vector<T>& other)
     {
-        auto storage = std::make_shared<std::vector<T>>(std::move(other));
-        ptr_         = storage->data();
-        size_        = storage->size();
-        storage_     = std::make_shared<std::any>(std::move(storage));
+        auto storage = new detail::typed_array_storage<std::vector<T>>(other);
+        ptr_         = storage->value.data();
+        size_        = storage->value.size();
+        storage_     = storage;
     }
 
     template <typename S>
     explicit array(const T* ptr, std::size_t size, S&& storage)
         : ptr_(ptr)
         , size_(size)
-        , storage_(std::make_shared<std::any>(std::forward<S>(storage)))
+        , storage_(detail::make_array_storage(std::forward<S>(storage)))
+    {
+    }
+
+    ~array()
+    {
+        if (storage_) {
+            storage_->release();
+        }
+    }
+
+    array(const array& other) noexcept
+        : ptr_(other.ptr_)
+        , size_(other.size_)
+        , storage_(other.storage_)
     {
+        if (storage_) {
+            storage_->add_ref();
+        }
     }
 
-    array(const array& other)
+    array(array&& other) noexcept
         : ptr_(other.ptr_)
         , size_(other.size_)
         , storage_(other.storage_)
     {
+        other.ptr_     = nullptr;
+        other.size_    = 0;
+        other.storage_ = nullptr;
     }
 
-    array(array<T>&& other)
+    array(array<T>&& other) noexcept
         : ptr_(other.ptr_)
         , size_(other.size_)
         , storage_(other.storage_)
@@ -142,14 +283,25 @@ class array<const T> final
         other.storage_ = nullptr;
     }
 
-    array& operator=(const array& other)
+    array& operator=(const array& other) noexcept
     {
-        ptr_     = other.ptr_;
-        size_    = other.size_;
-        storage_ = other.storage_;
+        array(other).swap(*this);
         return *this;
     }
 
+    array& operator=(array&& other) noexcept
+    {
+        array(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    void swap(array& other) noexcept
+    {
+        std::swap(ptr_, other.ptr_);
+        std::swap(size_, other.size_);
+        std::swap(storage_, other.storage_);
+    }
+
     const T*    begin() const { return ptr_; }
     const T*    data() const { return ptr_; }
     const T*    end() const { return ptr_ + size_; }
@@ -157,16 +309,17 @@ class array<const T> final
 
     explicit operator bool() const { return size_ > 0; }
 
+    // The storage the array was created with, also found through a std::shared_ptr<array<U>> viewing the same memory.
     template <typename S>
     S* storage() const
     {
-        return std::any_cast<S>(storage_.get());
+        return storage_ ? storage_->get<S>(ptr_) : nullptr;
     }
 
   private:
-    const T*                  ptr_  = nullptr;
-    std::size_t               size_ = 0;
-    std::shared_ptr<std::any> storage_;
+    const T*               ptr_     = nullptr;
+    std::size_t            size_    = 0;
+    detail::array_storage* storage_ = nullptr;
 };
 
 } // namespace caspar
@@ -20,6 +20,9 @@
  */
 #include "graph.h"
 
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <mutex>
 #include <vector>
 
@@ -81,19 +84,19 @@ struct graph::impl
     void set_value(const std::string& name, double value)
     {
         for (auto& sink : sinks_)
-            sink->set_value(name, value);
+            sink->record_value(name, value);
     }
 
     void set_tag(tag_severity severity, const std::string& name)
     {
         for (auto& sink : sinks_)
-            sink->set_tag(severity, name);
+            sink->record_tag(severity, name);
     }
 
     void set_color(const std::string& name, int color)
     {
         for (auto& sink : sinks_)
-            sink->set_color(name, color);
+            sink->record_color(name, color);
     }
 
     void auto_reset()
@@ -122,6 +125,126 @@ void register_graph(const spl::shared_ptr<graph>& graph) { graph->impl_->activat
 
 namespace spi {
 
+// A bounded ring that any number of recording threads push to and the sink drains (Vyukov's bounded queue), with the
+// line names interned so that a sample is a handful of bytes.
+struct graph_sink::impl
+{
+    static constexpr std::size_t capacity  = 1024;
+    static constexpr std::size_t max_names = 64;
+
+    struct cell
+    {
+        std::atomic<std::size_t> sequence;
+        sample                   data;
+    };
+
+    std::unique_ptr<cell[]>              cells_{new cell[capacity]};
+    alignas(64) std::atomic<std::size_t> enqueue_pos_{0};
+    alignas(64) std::size_t dequeue_pos_ = 0;
+
+    // Append only, so that lookups don't need the lock.
+    std::array<std::string, max_names> names_;
+    std::atomic<std::size_t>           name_count_{0};
+    std::mutex                         names_mutex_;
+
+    impl()
+    {
+        for (std::size_t n = 0; n < capacity; ++n)
+            cells_[n].sequence.store(n, std::memory_order_relaxed);
+    }
+
+    const std::string* intern(const std::string& name)
+    {
+        auto count = name_count_.load(std::memory_order_acquire);
+        for (std::size_t n = 0; n < count; ++n) {
+            if (names_[n] == name)
+                return &names_[n];
+        }
+
+        std::lock_guard<std::mutex> lock(names_mutex_);
+
+        // Another thread may have added it in the meantime.
+        count = name_count_.load(std::memory_order_relaxed);
+        for (std::size_t n = 0; n < count; ++n) {
+            if (names_[n] == name)
+                return &names_[n];
+        }
+        if (count == max_names)
+            return nullptr;
+
+        names_[count] = name;
+        name_count_.store(count + 1, std::memory_order_release);
+        return &names_[count];
+    }
+
+    void push(sample_type type, const std::string& name, double value, int color, tag_severity severity) noexcept
+    {
+        try {
+            auto interned = intern(name);
+            if (!interned)
+                return;
+
+            auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+            while (true) {
+                auto& cell = cells_[pos % capacity];
+                auto  diff = static_cast<std::intptr_t>(cell.sequence.load(std::memory_order_acquire)) -
+                            static_cast<std::intptr_t>(pos);
+                if (diff == 0) {
+                    if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        cell.data = sample{type, interned, value, color, severity};
+                        cell.sequence.store(pos + 1, std::memory_order_release);
+                        return;
+                    }
+                } else if (diff < 0) {
+                    return; // full
+                } else {
+                    pos = enqueue_pos_.load(std::memory_order_relaxed);
+                }
+            }
+        } catch (...) {
+        }
+    }
+
+    void drain(const std::function<void(const sample&)>& func)
+    {
+        while (true) {
+            auto& cell = cells_[dequeue_pos_ % capacity];
+            if (cell.sequence.load(std::memory_order_acquire) != dequeue_pos_ + 1)
+                return;
+
+            auto data = cell.data;
+            cell.sequence.store(dequeue_pos_ + capacity, std::memory_order_release);
+            ++dequeue_pos_;
+
+            func(data);
+        }
+    }
+};
+
+graph_sink::graph_sink()
+    : impl_(new impl)
+{
+}
+
+graph_sink::~graph_sink() {}
+
+void graph_sink::record_value(const std::string& name, double value) noexcept
+{
+    impl_->push(sample_type::value, name, value, 0, tag_severity::SILENT);
+}
+
+void graph_sink::record_tag(tag_severity severity, const std::string& name) noexcept
+{
+    impl_->push(sample_type::tag, name, 0.0, 0, severity);
+}
+
+void graph_sink::record_color(const std::string& name, int color) noexcept
+{
+    impl_->push(sample_type::color, name, 0.0, color, tag_severity::SILENT);
+}
+
+void graph_sink::drain(const std::function<void(const sample&)>& func) { impl_->drain(func); }
+
 void register_sink_factory(sink_factory_t factory)
 {
     std::lock_guard<std::mutex> lock(g_sink_factories_mutex);
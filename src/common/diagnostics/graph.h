@@ -24,6 +24,7 @@
 #include "../memory.h"
 
 #include <functional>
+#include <memory>
 #include <string>
 #include <tuple>
 
@@ -63,20 +64,47 @@ void register_graph(const spl::shared_ptr<graph>& graph);
 
 namespace spi {
 
+enum class sample_type
+{
+    value,
+    tag,
+    color,
+};
+
+struct sample
+{
+    sample_type        type;
+    const std::string* name;
+    double             value;
+    int                color;
+    tag_severity       severity;
+};
+
 class graph_sink
 {
     graph_sink(const graph_sink&)            = delete;
     graph_sink& operator=(const graph_sink&) = delete;
 
   public:
-    graph_sink() = default;
-    virtual ~graph_sink(){};
-    virtual void activate()                                              = 0;
-    virtual void set_text(const std::wstring& value)                     = 0;
-    virtual void set_value(const std::string& name, double value)        = 0;
-    virtual void set_color(const std::string& name, int color)           = 0;
-    virtual void set_tag(tag_severity severity, const std::string& name) = 0;
-    virtual void auto_reset()                                            = 0;
+    graph_sink();
+    virtual ~graph_sink();
+    virtual void activate()                          = 0;
+    virtual void set_text(const std::wstring& value) = 0;
+    virtual void auto_reset()                        = 0;
+
+    // Called by the graph on whichever thread records the sample, a few atomic operations that never block. Samples
+    // are dropped while the sink isn't draining them fast enough.
+    void record_value(const std::string& name, double value) noexcept;
+    void record_tag(tag_severity severity, const std::string& name) noexcept;
+    void record_color(const std::string& name, int color) noexcept;
+
+  protected:
+    // Hands the samples recorded since the last call to func in order. Only one thread may drain at a time.
+    void drain(const std::function<void(const sample&)>& func);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
 };
 
 using sink_factory_t = std::function<spl::shared_ptr<graph_sink>()>;
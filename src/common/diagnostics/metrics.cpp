@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metrics.h"
+
+#include "../log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <tuple>
+
+namespace caspar { namespace diagnostics { namespace metrics {
+
+namespace {
+
+enum class metric_type
+{
+    counter,
+    gauge,
+    histogram
+};
+
+struct series_entry
+{
+    labels_t            labels;
+    std::weak_ptr<void> metric;
+};
+
+struct family
+{
+    std::string               help;
+    metric_type               type;
+    std::vector<series_entry> series;
+};
+
+class registry
+{
+    std::mutex                                           mutex_;
+    std::map<std::string, family>                        families_;
+    std::list<std::function<void(std::vector<sample>&)>> collectors_;
+
+  public:
+    static registry& instance()
+    {
+        static registry r;
+        return r;
+    }
+
+    void add(const std::string& name, const std::string& help, metric_type type, labels_t labels, std::weak_ptr<void> m)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto& f = families_[name];
+        if (f.series.empty()) {
+            f.help = help;
+            f.type = type;
+        }
+
+        // Drop the series of metrics that have gone away while we are here anyway.
+        f.series.erase(std::remove_if(f.series.begin(), f.series.end(), [](auto& s) { return s.metric.expired(); }),
+                       f.series.end());
+        f.series.push_back({std::move(labels), std::move(m)});
+    }
+
+    std::shared_ptr<void> add_collector(std::function<void(std::vector<sample>&)> collector)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = collectors_.insert(collectors_.end(), std::move(collector));
+        return std::shared_ptr<void>(nullptr, [this, it](void*) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            collectors_.erase(it);
+        });
+    }
+
+    std::string write_text();
+};
+
+std::string escape(const std::string& value)
+{
+    std::string result;
+    result.reserve(value.size());
+    for (auto c : value) {
+        if (c == '\\' || c == '"')
+            result += '\\';
+        if (c == '\n') {
+            result += "\\n";
+            continue;
+        }
+        result += c;
+    }
+    return result;
+}
+
+void write_labels(std::ostream& out, const labels_t& labels, const char* le = nullptr)
+{
+    if (labels.empty() && le == nullptr)
+        return;
+
+    out << '{';
+    auto first = true;
+    for (auto& label : labels) {
+        out << (first ? "" : ",") << label.first << "=\"" << escape(label.second) << '"';
+        first = false;
+    }
+    if (le != nullptr)
+        out << (first ? "" : ",") << "le=\"" << le << '"';
+    out << '}';
+}
+
+void write_value(std::ostream& out, double value)
+{
+    if (std::isnan(value))
+        out << "NaN";
+    else if (std::isinf(value))
+        out << (value > 0 ? "+Inf" : "-Inf");
+    else
+        out << value;
+}
+
+std::string registry::write_text()
+{
+    std::ostringstream out;
+    out.precision(9);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto& p : families_) {
+        auto& name = p.first;
+        auto& f    = p.second;
+
+        std::vector<std::pair<const labels_t*, std::shared_ptr<void>>> live;
+        for (auto& s : f.series) {
+            if (auto m = s.metric.lock())
+                live.emplace_back(&s.labels, std::move(m));
+        }
+        if (live.empty())
+            continue;
+
+        static const char* type_names[] = {"counter", "gauge", "histogram"};
+        out << "# HELP " << name << ' ' << f.help << '\n';
+        out << "# TYPE " << name << ' ' << type_names[static_cast<int>(f.type)] << '\n';
+
+        for (auto& s : live) {
+            switch (f.type) {
+                case metric_type::counter:
+                    out << name;
+                    write_labels(out, *s.first);
+                    out << ' ' << static_cast<counter*>(s.second.get())->value() << '\n';
+                    break;
+                case metric_type::gauge:
+                    out << name;
+                    write_labels(out, *s.first);
+                    out << ' ';
+                    write_value(out, static_cast<gauge*>(s.second.get())->value());
+                    out << '\n';
+                    break;
+                case metric_type::histogram: {
+                    auto h = static_cast<histogram*>(s.second.get());
+
+                    // Buckets are updated independently, so make the exported ones cumulative and consistent.
+                    std::uint64_t total = 0;
+                    for (std::size_t n = 0; n < h->bounds().size(); ++n) {
+                        total += h->bucket(n);
+                        std::ostringstream le;
+                        le << h->bounds()[n];
+                        out << name << "_bucket";
+                        write_labels(out, *s.first, le.str().c_str());
+                        out << ' ' << total << '\n';
+                    }
+                    total += h->bucket(h->bounds().size());
+                    out << name << "_bucket";
+                    write_labels(out, *s.first, "+Inf");
+                    out << ' ' << total << '\n';
+                    out << name << "_sum";
+                    write_labels(out, *s.first);
+                    out << ' ';
+                    write_value(out, h->sum());
+                    out << '\n';
+                    out << name << "_count";
+                    write_labels(out, *s.first);
+                    out << ' ' << total << '\n';
+                    break;
+                }
+            }
+        }
+    }
+
+    std::vector<sample> samples;
+    for (auto& collector : collectors_) {
+        try {
+            collector(samples);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+    std::stable_sort(samples.begin(), samples.end(), [](auto& lhs, auto& rhs) {
+        return std::tie(lhs.name, lhs.labels) < std::tie(rhs.name, rhs.labels);
+    });
+
+    // Series must be unique, sum up the ones that collectors reported more than once (e.g. executors sharing a name).
+    std::vector<sample> merged;
+    for (auto& s : samples) {
+        if (!merged.empty() && merged.back().name == s.name && merged.back().labels == s.labels)
+            merged.back().value += s.value;
+        else
+            merged.push_back(std::move(s));
+    }
+
+    for (std::size_t n = 0; n < merged.size(); ++n) {
+        auto& s = merged[n];
+        if (n == 0 || merged[n - 1].name != s.name) {
+            out << "# HELP " << s.name << ' ' << s.help << '\n';
+            out << "# TYPE " << s.name << " gauge\n";
+        }
+        out << s.name;
+        write_labels(out, s.labels);
+        out << ' ';
+        write_value(out, s.value);
+        out << '\n';
+    }
+
+    return out.str();
+}
+
+} // namespace
+
+histogram::histogram(std::vector<double> bounds)
+    : bounds_(std::move(bounds))
+    , buckets_(new std::atomic<std::uint64_t>[bounds_.size() + 1])
+{
+    for (std::size_t n = 0; n <= bounds_.size(); ++n)
+        buckets_[n].store(0, std::memory_order_relaxed);
+}
+
+void histogram::observe(double value) noexcept
+{
+    auto n = static_cast<std::size_t>(std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin());
+    buckets_[n].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+
+    auto sum = sum_.load(std::memory_order_relaxed);
+    while (!sum_.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed)) {
+    }
+}
+
+const std::vector<double>& frame_time_bounds()
+{
+    static const std::vector<double> bounds = {
+        0.001, 0.002, 0.004, 0.008, 0.012, 0.016, 0.020, 0.025, 0.033, 0.040, 0.050, 0.080, 0.160, 0.320};
+    return bounds;
+}
+
+std::shared_ptr<counter> make_counter(const std::string& name, const std::string& help, labels_t labels)
+{
+    auto m = std::make_shared<counter>();
+    registry::instance().add(name, help, metric_type::counter, std::move(labels), m);
+    return m;
+}
+
+std::shared_ptr<gauge> make_gauge(const std::string& name, const std::string& help, labels_t labels)
+{
+    auto m = std::make_shared<gauge>();
+    registry::instance().add(name, help, metric_type::gauge, std::move(labels), m);
+    return m;
+}
+
+std::shared_ptr<histogram>
+make_histogram(const std::string& name, const std::string& help, labels_t labels, std::vector<double> bounds)
+{
+    auto m = std::make_shared<histogram>(std::move(bounds));
+    registry::instance().add(name, help, metric_type::histogram, std::move(labels), m);
+    return m;
+}
+
+std::shared_ptr<void> add_collector(std::function<void(std::vector<sample>&)> collector)
+{
+    return registry::instance().add_collector(std::move(collector));
+}
+
+std::string write_text() { return registry::instance().write_text(); }
+
+}}} // namespace caspar::diagnostics::metrics
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Counters, gauges and histograms for scraping in the Prometheus text format. Creating a metric takes a lock, updating
+// one is a relaxed atomic operation that is safe on the hot path. A metric is exported for as long as it is alive.
+namespace caspar { namespace diagnostics { namespace metrics {
+
+using labels_t = std::vector<std::pair<std::string, std::string>>;
+
+class counter
+{
+    std::atomic<std::uint64_t> value_{0};
+
+  public:
+    void          increment(std::uint64_t n = 1) noexcept { value_.fetch_add(n, std::memory_order_relaxed); }
+    std::uint64_t value() const noexcept { return value_.load(std::memory_order_relaxed); }
+};
+
+class gauge
+{
+    std::atomic<double> value_{0.0};
+
+  public:
+    void   set(double value) noexcept { value_.store(value, std::memory_order_relaxed); }
+    double value() const noexcept { return value_.load(std::memory_order_relaxed); }
+};
+
+class histogram
+{
+    const std::vector<double>                      bounds_;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> buckets_;
+    std::atomic<std::uint64_t>                     count_{0};
+    std::atomic<double>                            sum_{0.0};
+
+  public:
+    explicit histogram(std::vector<double> bounds);
+
+    void observe(double value) noexcept;
+
+    const std::vector<double>& bounds() const noexcept { return bounds_; }
+    // Non cumulative count of the bucket, the one past the last bound counts everything above it.
+    std::uint64_t bucket(std::size_t n) const noexcept { return buckets_[n].load(std::memory_order_relaxed); }
+    std::uint64_t count() const noexcept { return count_.load(std::memory_order_relaxed); }
+    double        sum() const noexcept { return sum_.load(std::memory_order_relaxed); }
+};
+
+// Bucket bounds in seconds for timings around a frame duration.
+const std::vector<double>& frame_time_bounds();
+
+std::shared_ptr<counter> make_counter(const std::string& name, const std::string& help, labels_t labels = {});
+std::shared_ptr<gauge>   make_gauge(const std::string& name, const std::string& help, labels_t labels = {});
+std::shared_ptr<histogram> make_histogram(const std::string&  name,
+                                          const std::string&  help,
+                                          labels_t            labels = {},
+                                          std::vector<double> bounds = frame_time_bounds());
+
+struct sample
+{
+    std::string name;
+    std::string help;
+    labels_t    labels;
+    double      value;
+};
+
+// Collectors provide gauges that are cheaper to read when scraped than to keep up to date, such as queue sizes. The
+// collector is removed when the returned token is released, which waits for a scrape that is calling it.
+std::shared_ptr<void> add_collector(std::function<void(std::vector<sample>&)> collector);
+
+// Returns every live metric in the Prometheus text exposition format.
+std::string write_text();
+
+}}} // namespace caspar::diagnostics::metrics
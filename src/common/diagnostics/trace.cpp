@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "trace.h"
+
+#include "../except.h"
+
+#include <boost/filesystem/fstream.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace caspar { namespace diagnostics { namespace trace {
+
+static std::atomic<bool> g_enabled{false};
+static std::mutex        g_mutex;
+static std::vector<event> g_events;
+static std::size_t        g_next = 0;
+static const time_point_t g_epoch = clock_t::now();
+
+static std::int64_t thread_id()
+{
+    static std::atomic<std::int64_t> next{1};
+    thread_local std::int64_t        id = next++;
+    return id;
+}
+
+void set_capacity(std::size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_events.clear();
+    g_events.shrink_to_fit();
+    g_events.reserve(capacity);
+    g_next    = 0;
+    g_enabled = capacity > 0;
+}
+
+std::size_t capacity()
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    return g_events.capacity();
+}
+
+bool enabled() { return g_enabled.load(std::memory_order_relaxed); }
+
+void record(const char*  name,
+            const char*  category,
+            time_point_t begin,
+            time_point_t end,
+            std::int64_t frame,
+            std::int64_t id,
+            bool         async)
+{
+    if (!enabled()) {
+        return;
+    }
+
+    event e{name, category, begin, end, frame, id, thread_id(), async};
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (g_events.capacity() == 0) {
+        return;
+    }
+    if (g_events.size() < g_events.capacity()) {
+        g_events.push_back(e);
+    } else {
+        g_events[g_next] = e;
+    }
+    g_next = (g_next + 1) % g_events.capacity();
+}
+
+std::vector<event> events()
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+
+    std::vector<event> result;
+    result.reserve(g_events.size());
+    if (g_events.size() < g_events.capacity()) {
+        result.insert(result.end(), g_events.begin(), g_events.end());
+    } else {
+        result.insert(result.end(), g_events.begin() + g_next, g_events.end());
+        result.insert(result.end(), g_events.begin(), g_events.begin() + g_next);
+    }
+    return result;
+}
+
+std::size_t write(const std::wstring& path, double seconds)
+{
+    auto events = trace::events();
+
+    auto from = seconds > 0.0 ? clock_t::now() - std::chrono::duration_cast<clock_t::duration>(
+                                                      std::chrono::duration<double>(seconds))
+                              : time_point_t::min();
+
+    boost::filesystem::ofstream out(path);
+    if (!out) {
+        CASPAR_THROW_EXCEPTION(io_error() << msg_info(L"Failed to open " + path));
+    }
+
+    auto us = [](time_point_t t) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(t - g_epoch).count();
+    };
+
+    auto write_args = [&](const event& e) {
+        out << ",\"args\":{";
+        auto first = true;
+        if (e.frame >= 0) {
+            out << "\"frame\":" << e.frame;
+            first = false;
+        }
+        if (e.id >= 0) {
+            out << (first ? "" : ",") << "\"id\":" << e.id;
+        }
+        out << "}";
+    };
+
+    std::size_t count = 0;
+    out << "{\"traceEvents\":[";
+    for (auto& e : events) {
+        if (e.end < from) {
+            continue;
+        }
+
+        auto begin_event = [&](const char* phase, time_point_t ts) {
+            out << (count == 0 && phase[0] != 'e' ? "\n" : ",\n");
+            out << "{\"name\":\"" << e.name << "\",\"cat\":\"" << e.category << "\",\"ph\":\"" << phase
+                << "\",\"ts\":" << us(ts) << ",\"pid\":1,\"tid\":" << e.tid;
+        };
+
+        if (e.async) {
+            // Async spans may overlap other work on the same thread, emit them as begin/end pairs.
+            begin_event("b", e.begin);
+            out << ",\"id\":" << count;
+            write_args(e);
+            out << "}";
+            begin_event("e", e.end);
+            out << ",\"id\":" << count << "}";
+        } else {
+            begin_event("X", e.begin);
+            out << ",\"dur\":" << us(e.end) - us(e.begin);
+            write_args(e);
+            out << "}";
+        }
+        ++count;
+    }
+    out << "\n]}\n";
+
+    return count;
+}
+
+}}} // namespace caspar::diagnostics::trace
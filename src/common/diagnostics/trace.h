@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace diagnostics { namespace trace {
+
+using clock_t      = std::chrono::steady_clock;
+using time_point_t = clock_t::time_point;
+
+struct event
+{
+    const char*  name;
+    const char*  category;
+    time_point_t begin;
+    time_point_t end;
+    std::int64_t frame;
+    std::int64_t id;
+    std::int64_t tid;
+    bool         async;
+};
+
+// Keeps the last capacity spans in a ring buffer, 0 disables tracing.
+void        set_capacity(std::size_t capacity);
+std::size_t capacity();
+bool        enabled();
+
+// Records a completed span. name and category must be string literals (or otherwise outlive the recorder).
+// frame and id are optional (-1) and end up as arguments in the trace.
+void record(const char*  name,
+            const char*  category,
+            time_point_t begin,
+            time_point_t end,
+            std::int64_t frame = -1,
+            std::int64_t id    = -1,
+            bool         async = false);
+
+// Returns a copy of the recorded spans, oldest first.
+std::vector<event> events();
+
+// Writes the spans of the last seconds (all spans if <= 0) as Chrome trace JSON. Returns the number of spans written.
+std::size_t write(const std::wstring& path, double seconds = 0.0);
+
+// Records the lifetime of the object as a span on the calling thread.
+class span
+{
+    const char*  name_;
+    const char*  category_;
+    std::int64_t frame_;
+    std::int64_t id_;
+    bool         enabled_;
+    time_point_t begin_;
+
+  public:
+    explicit span(const char* name, std::int64_t frame = -1, std::int64_t id = -1, const char* category = "caspar")
+        : name_(name)
+        , category_(category)
+        , frame_(frame)
+        , id_(id)
+        , enabled_(trace::enabled())
+    {
+        if (enabled_) {
+            begin_ = clock_t::now();
+        }
+    }
+
+    ~span()
+    {
+        if (enabled_) {
+            record(name_, category_, begin_, clock_t::now(), frame_, id_);
+        }
+    }
+
+    span(const span&)            = delete;
+    span& operator=(const span&) = delete;
+};
+
+}}} // namespace caspar::diagnostics::trace
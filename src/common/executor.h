@@ -21,30 +21,196 @@
 
 #pragma once
 
+#include "diagnostics/metrics.h"
 #include "except.h"
 #include "log.h"
 #include "os/thread.h"
+#include "utf.h"
 
 #include <tbb/concurrent_queue.h>
 
+#include <algorithm>
 #include <atomic>
-#include <functional>
+#include <condition_variable>
+#include <cstddef>
 #include <future>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
 
 namespace caspar {
 
+// High priority tasks run before every normal one that is still queued, for work such as the stage tick that must not
+// wait behind control commands.
+enum class task_priority
+{
+    normal = 0,
+    high,
+};
+
+// A move only task that keeps callables of up to inline_size bytes, such as a packaged_task or a lambda capturing a
+// few pointers, inside itself so queuing it doesn't allocate.
+class executor_task final
+{
+    static constexpr std::size_t inline_size = 48;
+
+    struct ops_t
+    {
+        void (*invoke)(void* storage);
+        void (*move)(void* from, void* to) noexcept;
+        void (*destroy)(void* storage) noexcept;
+    };
+
+    template <typename F>
+    static constexpr bool is_inline = sizeof(F) <= inline_size && alignof(F) <= alignof(std::max_align_t) &&
+                                      std::is_nothrow_move_constructible_v<F>;
+
+    template <typename F>
+    static const ops_t* inline_ops()
+    {
+        static const ops_t ops = {[](void* storage) { (*static_cast<F*>(storage))(); },
+                                  [](void* from, void* to) noexcept {
+                                      new (to) F(std::move(*static_cast<F*>(from)));
+                                      static_cast<F*>(from)->~F();
+                                  },
+                                  [](void* storage) noexcept { static_cast<F*>(storage)->~F(); }};
+        return &ops;
+    }
+
+    template <typename F>
+    static const ops_t* heap_ops()
+    {
+        static const ops_t ops = {[](void* storage) { (**static_cast<F**>(storage))(); },
+                                  [](void* from, void* to) noexcept {
+                                      *static_cast<F**>(to) = *static_cast<F**>(from);
+                                  },
+                                  [](void* storage) noexcept { delete *static_cast<F**>(storage); }};
+        return &ops;
+    }
+
+    alignas(std::max_align_t) unsigned char storage_[inline_size];
+    const ops_t* ops_ = nullptr;
+
+  public:
+    executor_task() = default;
+
+    template <typename Func,
+              typename F = std::decay_t<Func>,
+              typename   = std::enable_if_t<!std::is_same_v<F, executor_task>>>
+    executor_task(Func&& func)
+    {
+        if constexpr (is_inline<F>) {
+            new (storage_) F(std::forward<Func>(func));
+            ops_ = inline_ops<F>();
+        } else {
+            *reinterpret_cast<F**>(storage_) = new F(std::forward<Func>(func));
+            ops_                             = heap_ops<F>();
+        }
+    }
+
+    executor_task(executor_task&& other) noexcept
+        : ops_(other.ops_)
+    {
+        if (ops_) {
+            ops_->move(other.storage_, storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    executor_task& operator=(executor_task&& other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            if (other.ops_) {
+                other.ops_->move(other.storage_, storage_);
+                ops_       = other.ops_;
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    executor_task(const executor_task&)            = delete;
+    executor_task& operator=(const executor_task&) = delete;
+
+    ~executor_task() { reset(); }
+
+    void operator()() { ops_->invoke(storage_); }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    void reset() noexcept
+    {
+        if (ops_) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+};
+
+// Counts queued tasks without a lock, the mutex is only taken to put the worker to sleep or wake it up.
+class task_semaphore final
+{
+    std::atomic<int>        count_{0};
+    int                     wakeups_ = 0;
+    std::mutex              mutex_;
+    std::condition_variable cond_;
+
+  public:
+    void post()
+    {
+        if (count_.fetch_add(1, std::memory_order_release) < 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++wakeups_;
+            cond_.notify_one();
+        }
+    }
+
+    void wait()
+    {
+        if (count_.fetch_sub(1, std::memory_order_acquire) > 0) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [&] { return wakeups_ > 0; });
+        --wakeups_;
+    }
+};
+
 class executor final
 {
     executor(const executor&);
     executor& operator=(const executor&);
 
-    using task_t  = std::function<void()>;
-    using queue_t = tbb::concurrent_bounded_queue<task_t>;
+    using queue_t = tbb::concurrent_queue<executor_task>;
+
+  public:
+    using size_type = std::ptrdiff_t;
 
+  private:
     std::wstring      name_;
     std::atomic<bool> is_running_{true};
-    queue_t           queue_;
-    std::thread       thread_;
+    queue_t           queues_[2]; // by task_priority
+    task_semaphore    pending_;
+
+    // Only bounded executors lock when pushing, to block while full.
+    std::atomic<size_type>  size_{0};
+    std::atomic<size_type>  capacity_{std::numeric_limits<size_type>::max()};
+    std::mutex              space_mutex_;
+    std::condition_variable space_cond_;
+
+    std::thread thread_;
+
+    // Declared after the queue so that it is released, and no longer scraped, before the queue goes away.
+    const std::shared_ptr<void> metrics_ = caspar::diagnostics::metrics::add_collector([this](auto& samples) {
+        samples.push_back({"caspar_executor_queue_size",
+                           "Tasks waiting in the executor queue",
+                           {{"executor", u8(name_)}},
+                           static_cast<double>(size())});
+    });
 
   public:
     executor(const std::wstring& name)
@@ -56,7 +222,7 @@ class executor final
     ~executor() { stop_and_wait(); }
 
     template <typename Func>
-    auto begin_invoke(Func&& func)
+    auto begin_invoke(Func&& func, task_priority priority = task_priority::normal)
     {
         if (!is_running_) {
             CASPAR_THROW_EXCEPTION(invalid_operation() << msg_info("executor not running."));
@@ -64,39 +230,60 @@ class executor final
 
         using result_type = decltype(func());
 
-        auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<Func>(func));
+        std::packaged_task<result_type()> task(std::forward<Func>(func));
+        auto                              future = task.get_future();
 
-        queue_.push([=]() mutable { (*task)(); });
+        push(executor_task(std::move(task)), priority);
 
-        return task->get_future();
+        return future;
     }
 
     template <typename Func>
-    auto invoke(Func&& func)
+    auto invoke(Func&& func, task_priority priority = task_priority::normal)
     {
         if (is_current()) { // Avoids potential deadlock.
             return func();
         }
 
-        return begin_invoke(std::forward<Func>(func)).get();
+        return begin_invoke(std::forward<Func>(func), priority).get();
     }
 
     template <typename Func>
-    typename std::enable_if<std::is_same<void, decltype(std::declval<Func>())>::value, void>::type invoke(Func&& func)
+    typename std::enable_if<std::is_same<void, decltype(std::declval<Func>())>::value, void>::type
+    invoke(Func&& func, task_priority priority = task_priority::normal)
     {
         if (is_current()) { // Avoids potential deadlock.
             func();
             return;
         }
 
-        begin_invoke(std::forward<Func>(func)).wait();
+        begin_invoke(std::forward<Func>(func), priority).wait();
     }
 
-    void set_capacity(queue_t::size_type capacity) { queue_.set_capacity(capacity); }
+    void set_capacity(size_type capacity)
+    {
+        capacity_ = capacity;
+        std::lock_guard<std::mutex> lock(space_mutex_);
+        space_cond_.notify_all();
+    }
 
-    queue_t::size_type capacity() const { return queue_.capacity(); }
+    size_type capacity() const { return capacity_; }
 
-    void clear() { queue_.clear(); }
+    // Drops the queued tasks, their futures throw std::future_error.
+    void clear()
+    {
+        executor_task task;
+        for (auto& queue : queues_) {
+            while (queue.try_pop(task)) {
+                if (!task) { // Keep the stop request.
+                    queue.push(std::move(task));
+                    break;
+                }
+                task.reset();
+                release_slot();
+            }
+        }
+    }
 
     void stop()
     {
@@ -104,7 +291,13 @@ class executor final
             return;
         }
         is_running_ = false;
-        queue_.push(nullptr);
+        {
+            std::lock_guard<std::mutex> lock(space_mutex_);
+            space_cond_.notify_all();
+        }
+        // Queued behind the normal tasks, which still run, and not counted against the capacity.
+        queues_[static_cast<int>(task_priority::normal)].push(executor_task());
+        pending_.post();
     }
 
     void stop_and_wait()
@@ -120,7 +313,7 @@ class executor final
         invoke([] {});
     }
 
-    queue_t::size_type size() const { return queue_.size(); }
+    size_type size() const { return std::max<size_type>(size_.load(std::memory_order_relaxed), 0); }
 
     bool is_running() const { return is_running_; }
 
@@ -129,22 +322,57 @@ class executor final
     const std::wstring& name() const { return name_; }
 
   private:
+    void push(executor_task&& task, task_priority priority)
+    {
+        if (capacity_.load(std::memory_order_relaxed) == std::numeric_limits<size_type>::max()) {
+            size_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            std::unique_lock<std::mutex> lock(space_mutex_);
+            space_cond_.wait(lock, [&] { return size_ < capacity_ || !is_running_; });
+            size_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        queues_[static_cast<int>(priority)].push(std::move(task));
+        pending_.post();
+    }
+
+    void release_slot()
+    {
+        size_.fetch_sub(1, std::memory_order_relaxed);
+        if (capacity_.load(std::memory_order_relaxed) != std::numeric_limits<size_type>::max()) {
+            std::lock_guard<std::mutex> lock(space_mutex_);
+            space_cond_.notify_one();
+        }
+    }
+
+    bool pop(executor_task& task)
+    {
+        return queues_[static_cast<int>(task_priority::high)].try_pop(task) ||
+               queues_[static_cast<int>(task_priority::normal)].try_pop(task);
+    }
+
     void run()
     {
         set_thread_name(name_);
 
-        task_t task;
+        executor_task task;
 
-        while (is_running_) {
+        while (true) {
             try {
-                queue_.pop(task);
-                do {
-                    if (!task) {
-                        return;
-                    }
-                    task();
-                } while (queue_.try_pop(task));
+                pending_.wait();
+
+                // Nothing is queued after clear has dropped the task this wake up was for.
+                if (!pop(task)) {
+                    continue;
+                }
+                if (!task) {
+                    return;
+                }
+                release_slot();
+                task();
+                task.reset();
             } catch (...) {
+                task.reset();
                 CASPAR_LOG_CURRENT_EXCEPTION();
             }
         }
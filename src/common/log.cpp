@@ -20,6 +20,7 @@
  */
 #include "log.h"
 
+#include "diagnostics/metrics.h"
 #include "except.h"
 
 #include <boost/algorithm/string/predicate.hpp>
@@ -41,8 +42,13 @@
 #include <boost/smart_ptr/make_shared_object.hpp>
 #include <boost/smart_ptr/shared_ptr.hpp>
 
+#include <tbb/concurrent_queue.h>
+
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
 
 namespace logging  = boost::log;
 namespace src      = boost::log::sources;
@@ -168,9 +174,116 @@ void my_formatter(bool print_all_characters, const boost::log::record_view& rec,
     }
 }
 
+// Queueing strategy for the file sink that never blocks the logging thread. When the disk can't keep up the oldest
+// records are dropped, and the sink thread reports how many at most once a second.
+class drop_oldest_queue
+{
+    static constexpr std::size_t capacity = 8192;
+
+    tbb::concurrent_queue<logging::record_view>    queue_;
+    std::atomic<std::size_t>                       size_{0};
+    std::atomic<std::uint64_t>                     dropped_{0};
+    std::shared_ptr<diagnostics::metrics::counter> dropped_total_ =
+        diagnostics::metrics::make_counter("caspar_log_dropped_total", "Log records dropped by the file sink");
+
+    // Only for sleeping while the queue is empty, the logging threads don't touch it otherwise.
+    std::mutex              mutex_;
+    std::condition_variable cond_;
+    std::atomic<bool>       waiting_{false};
+    bool                    interrupted_ = false;
+
+    std::chrono::steady_clock::time_point last_report_;
+
+  protected:
+    drop_oldest_queue() = default;
+
+    template <typename ArgsT>
+    explicit drop_oldest_queue(ArgsT const&)
+    {
+    }
+
+    void enqueue(logging::record_view const& rec)
+    {
+        queue_.push(rec);
+        if (size_.fetch_add(1) >= capacity) {
+            logging::record_view oldest;
+            if (queue_.try_pop(oldest)) {
+                size_.fetch_sub(1);
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                dropped_total_->increment();
+            }
+        }
+
+        if (waiting_) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cond_.notify_one();
+        }
+    }
+
+    bool try_enqueue(logging::record_view const& rec)
+    {
+        enqueue(rec);
+        return true;
+    }
+
+    bool try_dequeue_ready(logging::record_view& rec) { return try_dequeue(rec); }
+
+    bool try_dequeue(logging::record_view& rec)
+    {
+        if (!queue_.try_pop(rec)) {
+            return false;
+        }
+        size_.fetch_sub(1);
+        report_dropped();
+        return true;
+    }
+
+    bool dequeue_ready(logging::record_view& rec)
+    {
+        while (!try_dequeue(rec)) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            waiting_ = true;
+            if (size_ == 0 && !interrupted_) {
+                cond_.wait(lock);
+            }
+            waiting_ = false;
+            if (interrupted_) {
+                interrupted_ = false;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void interrupt_dequeue()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        interrupted_ = true;
+        cond_.notify_one();
+    }
+
+  private:
+    void report_dropped()
+    {
+        if (dropped_.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_report_ < std::chrono::seconds(1)) {
+            return;
+        }
+        last_report_ = now;
+
+        // Goes through this queue like any other record, we are the only one dequeuing so it can't deadlock.
+        CASPAR_LOG(warning) << L"[log] Dropped " << dropped_.exchange(0, std::memory_order_relaxed)
+                            << L" records, the log file can't keep up.";
+    }
+};
+
 void add_file_sink(const std::wstring& file)
 {
-    using file_sink_type = boost::log::sinks::synchronous_sink<boost::log::sinks::text_file_backend>;
+    using file_sink_type = sinks::asynchronous_sink<sinks::text_file_backend, drop_oldest_queue>;
 
     try {
         if (!boost::filesystem::is_directory(boost::filesystem::path(file).parent_path())) {
@@ -237,6 +350,16 @@ bool set_log_level(const std::wstring& lvl)
 
 std::wstring& get_log_level() { return current_config.current_level; }
 
+void flush() { boost::log::core::get()->flush(); }
+
+std::wstring suppressed_prefix(std::uint32_t suppressed)
+{
+    if (suppressed == 0) {
+        return L"";
+    }
+    return L"[" + std::to_wstring(suppressed) + L" similar suppressed] ";
+}
+
 void set_log_column_alignment(bool align_columns) { current_config.align_columns = align_columns; }
 
 }} // namespace caspar::log
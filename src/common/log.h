@@ -32,6 +32,8 @@
 #include <boost/stacktrace.hpp>
 
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <string>
 
 namespace caspar { namespace log {
@@ -58,6 +60,43 @@ using caspar_logger = boost::log::sources::wseverity_logger<boost::log::trivial:
 BOOST_LOG_INLINE_GLOBAL_LOGGER_DEFAULT(logger, caspar_logger)
 #define CASPAR_LOG(lvl) BOOST_LOG_SEV(::caspar::log::logger::get(), boost::log::trivial::severity_level::lvl)
 
+// Lets the first message of a call site through and then at most one per interval, counting the ones in between.
+class rate_limiter
+{
+    std::atomic<std::int64_t>  next_{0};
+    std::atomic<std::uint32_t> suppressed_{0};
+
+  public:
+    bool allow(std::chrono::steady_clock::duration interval, std::uint32_t& suppressed) noexcept
+    {
+        auto now  = std::chrono::steady_clock::now().time_since_epoch().count();
+        auto next = next_.load(std::memory_order_relaxed);
+        if (now < next || !next_.compare_exchange_strong(next, now + interval.count(), std::memory_order_relaxed)) {
+            suppressed_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+};
+
+std::wstring suppressed_prefix(std::uint32_t suppressed);
+
+// A limiter of its own for every place the macro is expanded.
+#define CASPAR_LOG_RATE_LIMITER()                                                                                      \
+    ([]() -> ::caspar::log::rate_limiter& {                                                                            \
+        static ::caspar::log::rate_limiter limiter;                                                                    \
+        return limiter;                                                                                                \
+    }())
+
+// For warnings that can repeat every frame, such as late frames or full queues. Logs at most once every interval
+// seconds per call site and mentions how many were suppressed since.
+#define CASPAR_LOG_RATE_LIMITED(lvl, interval)                                                                         \
+    if (std::uint32_t caspar_log_suppressed = 0;                                                                       \
+        !CASPAR_LOG_RATE_LIMITER().allow(std::chrono::seconds(interval), caspar_log_suppressed)) {                     \
+    } else                                                                                                             \
+        CASPAR_LOG(lvl) << ::caspar::log::suppressed_prefix(caspar_log_suppressed)
+
 struct logging_config
 {
     std::atomic<bool> align_columns = {false};
@@ -69,6 +108,8 @@ void          add_cout_sink();
 bool          set_log_level(const std::wstring& lvl);
 std::wstring& get_log_level();
 void          set_log_column_alignment(bool align_columns);
+// Writes out the records still queued for the asynchronous sinks, call before exiting.
+void flush();
 
 inline std::wstring get_stack_trace()
 {
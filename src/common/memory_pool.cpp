@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "memory_pool.h"
+
+#include "diagnostics/metrics.h"
+#include "log.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace caspar {
+
+namespace {
+
+// Audio and other small buffers aren't worth keeping around.
+constexpr std::size_t min_pooled_size = 512 * 1024;
+constexpr std::size_t page_size       = 64 * 1024;
+constexpr std::size_t huge_page_size  = 2 * 1024 * 1024;
+
+std::size_t round_up(std::size_t size, std::size_t multiple) { return (size + multiple - 1) / multiple * multiple; }
+
+void* allocate_pages(std::size_t capacity, huge_pages mode)
+{
+#ifdef _MSC_VER
+    if (mode == huge_pages::reserved) {
+        // Needs SeLockMemoryPrivilege, there are no transparent huge pages to fall back to.
+        auto ptr = VirtualAlloc(nullptr, capacity, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (ptr) {
+            return ptr;
+        }
+    }
+    return VirtualAlloc(nullptr, capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    if (mode == huge_pages::reserved) {
+        auto ptr = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            return ptr;
+        }
+
+        static std::once_flag warned;
+        std::call_once(warned, [] {
+            CASPAR_LOG(warning) << L"[memory_pool] The reserved huge pages have run out, see vm.nr_hugepages. Using "
+                                   L"transparent huge pages instead.";
+        });
+    }
+
+    auto ptr = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return nullptr;
+    }
+    if (mode != huge_pages::off) {
+        madvise(ptr, capacity, MADV_HUGEPAGE);
+    }
+    return ptr;
+#endif
+}
+
+void free_pages(void* ptr, std::size_t capacity)
+{
+#ifdef _MSC_VER
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+    munmap(ptr, capacity);
+#endif
+}
+
+class memory_pool
+{
+    std::atomic<huge_pages>  mode_{huge_pages::off};
+    std::atomic<std::size_t> max_free_bytes_{256 * 1024 * 1024};
+
+    std::mutex                                 mutex_;
+    std::map<std::size_t, std::vector<void*>> free_; // by capacity
+    std::size_t                                free_bytes_ = 0;
+    std::atomic<std::size_t>                   used_bytes_{0};
+
+    std::shared_ptr<void> metrics_;
+
+  public:
+    memory_pool()
+    {
+        metrics_ = diagnostics::metrics::add_collector([this](std::vector<diagnostics::metrics::sample>& samples) {
+            std::size_t free_bytes;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                free_bytes = free_bytes_;
+            }
+            samples.push_back({"caspar_memory_pool_free_bytes",
+                               "Bytes of frame buffers kept for reuse",
+                               {},
+                               static_cast<double>(free_bytes)});
+            samples.push_back({"caspar_memory_pool_used_bytes",
+                               "Bytes of pooled frame buffers in use",
+                               {},
+                               static_cast<double>(used_bytes_.load(std::memory_order_relaxed))});
+        });
+    }
+
+    void configure(huge_pages mode, std::size_t max_free_bytes)
+    {
+        mode_           = mode;
+        max_free_bytes_ = max_free_bytes;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        trim();
+    }
+
+    std::shared_ptr<void> create(std::size_t size)
+    {
+        auto mode     = mode_.load(std::memory_order_relaxed);
+        auto capacity = round_up(size, mode == huge_pages::off ? page_size : huge_page_size);
+
+        void* ptr = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto                        it = free_.find(capacity);
+            if (it != free_.end() && !it->second.empty()) {
+                ptr = it->second.back();
+                it->second.pop_back();
+                free_bytes_ -= capacity;
+            }
+        }
+
+        if (!ptr) {
+            ptr = allocate_pages(capacity, mode);
+            if (!ptr) {
+                throw std::bad_alloc();
+            }
+        }
+        used_bytes_ += capacity;
+
+        return std::shared_ptr<void>(ptr, [this, capacity](void* ptr) { release(ptr, capacity); });
+    }
+
+  private:
+    void release(void* ptr, std::size_t capacity)
+    {
+        used_bytes_ -= capacity;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_[capacity].push_back(ptr);
+        free_bytes_ += capacity;
+        trim();
+    }
+
+    // Frees the buffers of the largest sizes first, they are the ones least likely to be asked for again.
+    void trim()
+    {
+        for (auto it = free_.rbegin(); it != free_.rend() && free_bytes_ > max_free_bytes_; ++it) {
+            while (!it->second.empty() && free_bytes_ > max_free_bytes_) {
+                free_pages(it->second.back(), it->first);
+                it->second.pop_back();
+                free_bytes_ -= it->first;
+            }
+        }
+    }
+};
+
+// Never destroyed, buffers can be released by threads that outlive static destruction.
+memory_pool& pool()
+{
+    static auto instance = new memory_pool();
+    return *instance;
+}
+
+} // namespace
+
+void configure_memory_pool(huge_pages mode, std::size_t max_free_bytes) { pool().configure(mode, max_free_bytes); }
+
+std::shared_ptr<void> create_aligned_buffer(std::size_t size)
+{
+    if (size >= min_pooled_size) {
+        return pool().create(size);
+    }
+
+#ifdef _MSC_VER
+    return std::shared_ptr<void>(_aligned_malloc(size, 64), _aligned_free);
+#else
+    return std::shared_ptr<void>(std::aligned_alloc(64, round_up(size, 64)), std::free);
+#endif
+}
+
+} // namespace caspar
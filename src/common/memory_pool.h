@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+namespace caspar {
+
+enum class huge_pages
+{
+    off,         // 4 KiB pages
+    transparent, // ask the kernel to back the buffers with transparent huge pages
+    reserved,    // 2 MiB pages from the reserved pool, transparent ones when it runs out
+};
+
+// Frame sized buffers are recycled through a pool, optionally backed by huge pages to cut TLB misses when a frame is
+// swept line by line. max_free_bytes bounds the memory kept for reuse. Call before the channels start.
+void configure_memory_pool(huge_pages mode, std::size_t max_free_bytes);
+
+// At least 64 byte aligned. Buffers of a frame's size come from the pool and go back to it when released, smaller ones
+// are allocated as usual.
+std::shared_ptr<void> create_aligned_buffer(std::size_t size);
+
+} // namespace caspar
@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "memshfl.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if !defined(USE_SIMDE) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#define CASPAR_SIMD_DISPATCH
+#include <immintrin.h>
+#endif
+
+#if defined(CASPAR_SIMD_DISPATCH) && defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define CASPAR_TARGET(isa)
+#elif defined(CASPAR_SIMD_DISPATCH)
+#define CASPAR_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace caspar {
+
+namespace {
+
+using shfl_func = void (*)(std::uint8_t*, const std::uint8_t*, size_t, const std::uint8_t*);
+using copy_func = void (*)(std::uint8_t*, const std::uint8_t*, size_t);
+
+// Byte n of the mask, as _mm_set_epi32(m1, m2, m3, m4) lays it out.
+void mask_bytes(std::uint8_t* bytes, int m1, int m2, int m3, int m4)
+{
+    const int words[] = {m4, m3, m2, m1};
+    for (int n = 0; n < 16; ++n) {
+        bytes[n] = static_cast<std::uint8_t>(words[n / 4] >> (n % 4 * 8));
+    }
+}
+
+// The last partial block, byte by byte with the semantics of pshufb.
+void shfl_tail(std::uint8_t* dest, const std::uint8_t* source, size_t count, const std::uint8_t* mask)
+{
+    for (size_t n = 0; n < count; ++n) {
+        const auto index = mask[n];
+        dest[n]          = (index & 0x80) || (index & 0x0F) >= count ? 0 : source[index & 0x0F];
+    }
+}
+
+void shfl_ssse3(std::uint8_t* dest, const std::uint8_t* source, size_t count, const std::uint8_t* mask)
+{
+    const __m128i mask128 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask));
+    const bool    aligned = reinterpret_cast<std::uintptr_t>(dest) % 16 == 0;
+
+    size_t n = 0;
+    for (; n + 16 <= count; n += 16) {
+        auto xmm0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n)), mask128);
+        if (aligned) {
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dest + n), xmm0);
+        } else {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n), xmm0);
+        }
+    }
+    _mm_sfence();
+    shfl_tail(dest + n, source + n, count - n, mask);
+}
+
+void copy_sse2(std::uint8_t* dest, const std::uint8_t* source, size_t count)
+{
+    // Streaming stores need an aligned destination, everything else is left to memcpy.
+    const auto head = std::min(count, (16 - reinterpret_cast<std::uintptr_t>(dest) % 16) % 16);
+    std::memcpy(dest, source, head);
+
+    size_t n = head;
+    for (; n + 64 <= count; n += 64) {
+        auto xmm0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n));
+        auto xmm1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n + 16));
+        auto xmm2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n + 32));
+        auto xmm3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n + 48));
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dest + n), xmm0);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dest + n + 16), xmm1);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dest + n + 32), xmm2);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dest + n + 48), xmm3);
+    }
+    _mm_sfence();
+    std::memcpy(dest + n, source + n, count - n);
+}
+
+#ifdef CASPAR_SIMD_DISPATCH
+
+CASPAR_TARGET("avx2")
+void shfl_avx2(std::uint8_t* dest, const std::uint8_t* source, size_t count, const std::uint8_t* mask)
+{
+    // pshufb works within 128 bit lanes, so the same mask goes into both.
+    const __m256i mask256 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask)));
+    const bool    aligned = reinterpret_cast<std::uintptr_t>(dest) % 32 == 0;
+
+    size_t n = 0;
+    for (; n + 32 <= count; n += 32) {
+        auto ymm0 = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n)), mask256);
+        if (aligned) {
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + n), ymm0);
+        } else {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + n), ymm0);
+        }
+    }
+    _mm_sfence();
+    shfl_ssse3(dest + n, source + n, count - n, mask);
+}
+
+CASPAR_TARGET("avx2")
+void copy_avx2(std::uint8_t* dest, const std::uint8_t* source, size_t count)
+{
+    const auto head = std::min(count, (32 - reinterpret_cast<std::uintptr_t>(dest) % 32) % 32);
+    std::memcpy(dest, source, head);
+
+    size_t n = head;
+    for (; n + 64 <= count; n += 64) {
+        auto ymm0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n));
+        auto ymm1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n + 32));
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + n), ymm0);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + n + 32), ymm1);
+    }
+    _mm_sfence();
+    std::memcpy(dest + n, source + n, count - n);
+}
+
+CASPAR_TARGET("avx512f,avx512bw")
+void shfl_avx512(std::uint8_t* dest, const std::uint8_t* source, size_t count, const std::uint8_t* mask)
+{
+    std::uint8_t lanes[64];
+    for (int n = 0; n < 4; ++n) {
+        std::memcpy(lanes + n * 16, mask, 16);
+    }
+    const __m512i mask512 = _mm512_loadu_si512(lanes);
+    const bool    aligned = reinterpret_cast<std::uintptr_t>(dest) % 64 == 0;
+
+    size_t n = 0;
+    for (; n + 64 <= count; n += 64) {
+        auto zmm0 = _mm512_shuffle_epi8(_mm512_loadu_si512(source + n), mask512);
+        if (aligned) {
+            _mm512_stream_si512(reinterpret_cast<__m512i*>(dest + n), zmm0);
+        } else {
+            _mm512_storeu_si512(dest + n, zmm0);
+        }
+    }
+    _mm_sfence();
+    shfl_ssse3(dest + n, source + n, count - n, mask);
+}
+
+enum class cpu_level
+{
+    ssse3,
+    avx2,
+    avx512
+};
+
+cpu_level detect_cpu_level()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return cpu_level::ssse3;
+    }
+    __cpuid(info, 1);
+    const bool os_avx = (info[2] & (1 << 27)) && (_xgetbv(0) & 0x06) == 0x06;
+    const bool os_512 = os_avx && (_xgetbv(0) & 0xE6) == 0xE6;
+    __cpuidex(info, 7, 0);
+    if (os_512 && (info[1] & (1 << 16)) && (info[1] & (1 << 30))) {
+        return cpu_level::avx512;
+    }
+    if (os_avx && (info[1] & (1 << 5))) {
+        return cpu_level::avx2;
+    }
+    return cpu_level::ssse3;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+        return cpu_level::avx512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return cpu_level::avx2;
+    }
+    return cpu_level::ssse3;
+#endif
+}
+
+#endif
+
+shfl_func get_shfl()
+{
+#ifdef CASPAR_SIMD_DISPATCH
+    switch (detect_cpu_level()) {
+        case cpu_level::avx512:
+            return shfl_avx512;
+        case cpu_level::avx2:
+            return shfl_avx2;
+        default:
+            break;
+    }
+#endif
+    // simde maps these to NEON on arm.
+    return shfl_ssse3;
+}
+
+copy_func get_copy()
+{
+#ifdef CASPAR_SIMD_DISPATCH
+    if (detect_cpu_level() != cpu_level::ssse3) {
+        return copy_avx2;
+    }
+#endif
+    return copy_sse2;
+}
+
+} // namespace
+
+void* memshfl(void* dest, const void* source, size_t count, int m1, int m2, int m3, int m4)
+{
+    static const auto func = get_shfl();
+
+    std::uint8_t mask[16];
+    mask_bytes(mask, m1, m2, m3, m4);
+    func(static_cast<std::uint8_t*>(dest), static_cast<const std::uint8_t*>(source), count, mask);
+    return dest;
+}
+
+void* memcpy_nt(void* dest, const void* source, size_t count)
+{
+    static const auto func = get_copy();
+
+    func(static_cast<std::uint8_t*>(dest), static_cast<const std::uint8_t*>(source), count);
+    return dest;
+}
+
+} // namespace caspar
@@ -21,6 +21,11 @@
 
 #pragma once
 
+#include "memory_pool.h"
+
+#include <cstddef>
+#include <memory>
+
 #ifdef USE_SIMDE
 #define SIMDE_ENABLE_NATIVE_ALIASES
 #include <simde/x86/ssse3.h>
@@ -34,38 +39,11 @@
 
 namespace caspar {
 
-#ifdef _MSC_VER
-static std::shared_ptr<void> create_aligned_buffer(size_t size)
-{
-    return std::shared_ptr<void>(_aligned_malloc(size, 64), _aligned_free);
-}
-#else
-static std::shared_ptr<void> create_aligned_buffer(size_t size)
-{
-    return std::shared_ptr<void>(aligned_alloc(64, size), free);
-}
-#endif
-
-static void* aligned_memshfl(void* dest, const void* source, size_t count, int m1, int m2, int m3, int m4)
-{
-    __m128i*       dest128   = reinterpret_cast<__m128i*>(dest);
-    const __m128i* source128 = reinterpret_cast<const __m128i*>(source);
-
-    count /= 16; // 128 bit
-
-    const __m128i mask128 = _mm_set_epi32(m1, m2, m3, m4);
-    for (size_t n = 0; n < count / 4; ++n) {
-        __m128i xmm0 = _mm_load_si128(source128++);
-        __m128i xmm1 = _mm_load_si128(source128++);
-        __m128i xmm2 = _mm_load_si128(source128++);
-        __m128i xmm3 = _mm_load_si128(source128++);
+// Shuffles each 16 byte block of source like pshufb with the mask _mm_set_epi32(m1, m2, m3, m4), using the widest
+// instruction set the cpu supports. Neither pointer needs to be aligned and count needn't be a multiple of 16.
+void* memshfl(void* dest, const void* source, size_t count, int m1, int m2, int m3, int m4);
 
-        _mm_stream_si128(dest128++, _mm_shuffle_epi8(xmm0, mask128));
-        _mm_stream_si128(dest128++, _mm_shuffle_epi8(xmm1, mask128));
-        _mm_stream_si128(dest128++, _mm_shuffle_epi8(xmm2, mask128));
-        _mm_stream_si128(dest128++, _mm_shuffle_epi8(xmm3, mask128));
-    }
-    return dest;
-}
+// memcpy with streaming stores, for large copies into memory the cpu won't read back.
+void* memcpy_nt(void* dest, const void* source, size_t count);
 
 } // namespace caspar
@@ -2,10 +2,21 @@
 #include "../../utf.h"
 #include <pthread.h>
 #include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
 
 namespace caspar {
 
-void set_thread_name(const std::wstring& name) { pthread_setname_np(pthread_self(), u8(name).c_str()); }
+void set_thread_name(const std::wstring& name)
+{
+    // Names are at most 15 characters, longer ones are cut rather than refused.
+    pthread_setname_np(pthread_self(), u8(name).substr(0, 15).c_str());
+    register_thread(name);
+}
 
 void set_thread_realtime_priority()
 {
@@ -18,4 +29,105 @@ void set_thread_realtime_priority()
     pthread_setschedparam(handle, SCHED_FIFO, &param);
 }
 
+void set_thread_background_priority()
+{
+    struct sched_param param = {};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+}
+
+std::vector<int> numa_node_cpus(int node)
+{
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string   list;
+    if (!std::getline(file, list)) {
+        return {};
+    }
+    return parse_cpu_list(u16(list));
+}
+
+int gpu_numa_node()
+{
+    // -1 on machines with a single node, and for devices the firmware doesn't place.
+    std::ifstream file("/sys/class/drm/card0/device/numa_node");
+    int           node = -1;
+    if (!(file >> node)) {
+        return -1;
+    }
+    return node;
+}
+
+void set_thread_affinity(const std::vector<int>& cpus, int numa_node)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    if (numa_node >= 0 && numa_node < 1024) {
+        // MPOL_PREFERRED, without depending on libnuma. Pages come from other nodes once this one is full.
+        constexpr int bits_per_word = 8 * sizeof(unsigned long);
+        unsigned long nodes[1024 / bits_per_word] = {};
+        nodes[numa_node / bits_per_word] |= 1UL << (numa_node % bits_per_word);
+        syscall(SYS_set_mempolicy, 1, nodes, 1024 + 1);
+    }
+}
+
+std::int64_t current_thread_id() { return static_cast<std::int64_t>(syscall(SYS_gettid)); }
+
+bool sample_thread(std::int64_t id, thread_usage& usage)
+{
+    const auto task = "/proc/self/task/" + std::to_string(id);
+
+    // The name in parentheses may contain spaces, utime and stime are the 12th and 13th fields after it.
+    std::ifstream stat_file(task + "/stat");
+    std::string   stat;
+    if (!std::getline(stat_file, stat)) {
+        return false;
+    }
+    auto end = stat.rfind(')');
+    if (end == std::string::npos) {
+        return false;
+    }
+    std::istringstream fields(stat.substr(end + 1));
+    std::string        field;
+    for (int n = 0; n < 11; ++n) {
+        fields >> field;
+    }
+    unsigned long long utime = 0;
+    unsigned long long stime = 0;
+    if (!(fields >> utime >> stime)) {
+        return false;
+    }
+    static const auto ticks = static_cast<double>(sysconf(_SC_CLK_TCK));
+    usage.user_seconds      = utime / ticks;
+    usage.system_seconds    = stime / ticks;
+
+    std::ifstream status(task + "/status");
+    std::string   line;
+    while (std::getline(status, line)) {
+        std::istringstream values(line);
+        std::string        key;
+        values >> key;
+        if (key == "voluntary_ctxt_switches:") {
+            values >> usage.voluntary_switches;
+        } else if (key == "nonvoluntary_ctxt_switches:") {
+            values >> usage.involuntary_switches;
+        }
+    }
+
+    // Nanoseconds on the cpu and waiting on a run queue, only there with schedstats in the kernel.
+    std::ifstream      schedstat(task + "/schedstat");
+    unsigned long long run_ns  = 0;
+    unsigned long long wait_ns = 0;
+    if (schedstat >> run_ns >> wait_ns) {
+        usage.run_delay_seconds = wait_ns / 1e9;
+    }
+
+    return true;
+}
+
 } // namespace caspar
@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "thread.h"
+
+#include "../diagnostics/metrics.h"
+#include "../except.h"
+#include "../log.h"
+#include "../utf.h"
+
+#include <boost/algorithm/string.hpp>
+
+#include <map>
+#include <mutex>
+
+namespace caspar {
+
+namespace {
+
+struct affinity_policy
+{
+    std::vector<int> cpus;
+    int              numa_node = -1;
+};
+
+std::mutex      g_affinity_mutex;
+affinity_policy g_affinity[static_cast<int>(thread_role::count)];
+
+const wchar_t* role_name(thread_role role)
+{
+    static const wchar_t* names[] = {L"channel", L"gpu", L"producer", L"consumer"};
+    return names[static_cast<int>(role)];
+}
+
+const wchar_t* subsystem_of(const std::wstring& name)
+{
+    static const std::pair<const wchar_t*, const wchar_t*> prefixes[] = {
+        {L"channel-", L"channel"},
+        {L"stage ", L"channel"},
+        {L"batch stage ", L"channel"},
+        {L"sync-group-", L"channel"},
+        {L"cpu_image_mixer", L"channel"},
+        {L"OpenGL", L"gpu"},
+        {L"asio ", L"amcp"},
+        {L"AMCPCommandQueue", L"amcp"},
+        {L"amcp", L"amcp"},
+        {L"[ffmpeg", L"ffmpeg"},
+        {L"decklink", L"decklink"},
+    };
+    for (auto& prefix : prefixes) {
+        if (boost::starts_with(name, prefix.first)) {
+            return prefix.second;
+        }
+    }
+    return L"other";
+}
+
+void accumulate(thread_usage& total, const thread_usage& usage)
+{
+    total.user_seconds += usage.user_seconds;
+    total.system_seconds += usage.system_seconds;
+    total.voluntary_switches += usage.voluntary_switches;
+    total.involuntary_switches += usage.involuntary_switches;
+    total.run_delay_seconds += usage.run_delay_seconds;
+}
+
+class thread_registry
+{
+    std::mutex                           mutex_;
+    std::map<std::int64_t, std::wstring> threads_;
+    std::map<std::wstring, thread_usage> exited_; // by subsystem
+    std::shared_ptr<void>                metrics_;
+
+  public:
+    // Never destroyed, threads may exit after static destruction has begun.
+    static thread_registry& instance()
+    {
+        static auto r = new thread_registry();
+        return *r;
+    }
+
+    thread_registry()
+    {
+        metrics_ = diagnostics::metrics::add_collector([](std::vector<diagnostics::metrics::sample>& samples) {
+            for (auto& usage : subsystem_usages()) {
+                auto subsystem = u8(usage.subsystem);
+                samples.push_back({"caspar_thread_cpu_seconds",
+                                   "Cpu time used by the threads of a subsystem",
+                                   {{"subsystem", subsystem}, {"mode", "user"}},
+                                   usage.user_seconds});
+                samples.push_back({"caspar_thread_cpu_seconds",
+                                   "Cpu time used by the threads of a subsystem",
+                                   {{"subsystem", subsystem}, {"mode", "system"}},
+                                   usage.system_seconds});
+                samples.push_back({"caspar_thread_context_switches",
+                                   "Context switches of the threads of a subsystem",
+                                   {{"subsystem", subsystem}, {"kind", "voluntary"}},
+                                   static_cast<double>(usage.voluntary_switches)});
+                samples.push_back({"caspar_thread_context_switches",
+                                   "Context switches of the threads of a subsystem",
+                                   {{"subsystem", subsystem}, {"kind", "involuntary"}},
+                                   static_cast<double>(usage.involuntary_switches)});
+                samples.push_back({"caspar_thread_run_delay_seconds",
+                                   "Time the threads of a subsystem were runnable but waited for a cpu",
+                                   {{"subsystem", subsystem}},
+                                   usage.run_delay_seconds});
+            }
+        });
+    }
+
+    void add(std::int64_t id, const std::wstring& name)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads_[id] = name;
+    }
+
+    // Called by the exiting thread, which can still sample itself.
+    void remove(std::int64_t id)
+    {
+        thread_usage usage;
+        auto         sampled = sample_thread(id, usage);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto                        it = threads_.find(id);
+        if (it == threads_.end()) {
+            return;
+        }
+        if (sampled) {
+            auto  subsystem = subsystem_of(it->second);
+            auto& total     = exited_[subsystem];
+            total.name      = subsystem;
+            total.subsystem = subsystem;
+            accumulate(total, usage);
+        }
+        threads_.erase(it);
+    }
+
+    std::vector<thread_usage> usages()
+    {
+        std::map<std::int64_t, std::wstring> threads;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            threads = threads_;
+        }
+
+        std::vector<thread_usage> result;
+        for (auto& thread : threads) {
+            thread_usage usage;
+            if (sample_thread(thread.first, usage)) {
+                usage.name      = thread.second;
+                usage.subsystem = subsystem_of(thread.second);
+                result.push_back(std::move(usage));
+            }
+        }
+        return result;
+    }
+
+    std::map<std::wstring, thread_usage> exited()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return exited_;
+    }
+};
+
+struct thread_registration
+{
+    std::int64_t id = -1;
+    std::wstring name;
+
+    ~thread_registration()
+    {
+        if (id >= 0) {
+            thread_registry::instance().remove(id);
+        }
+    }
+};
+
+thread_local thread_registration g_registration;
+
+} // namespace
+
+void register_thread(const std::wstring& name)
+{
+    auto& registration = g_registration;
+    if (registration.id >= 0 && registration.name == name) {
+        return;
+    }
+    registration.id   = current_thread_id();
+    registration.name = name;
+    thread_registry::instance().add(registration.id, name);
+}
+
+std::vector<thread_usage> thread_usages() { return thread_registry::instance().usages(); }
+
+std::vector<thread_usage> subsystem_usages(const std::vector<thread_usage>& threads)
+{
+    auto totals = thread_registry::instance().exited();
+    for (auto& usage : threads) {
+        auto& total     = totals[usage.subsystem];
+        total.name      = usage.subsystem;
+        total.subsystem = usage.subsystem;
+        accumulate(total, usage);
+    }
+
+    std::vector<thread_usage> result;
+    for (auto& total : totals) {
+        result.push_back(total.second);
+    }
+    return result;
+}
+
+std::vector<int> parse_cpu_list(const std::wstring& list)
+{
+    std::vector<int> cpus;
+
+    std::vector<std::wstring> ranges;
+    boost::split(ranges, list, boost::is_any_of(L","));
+    for (auto range : ranges) {
+        boost::trim(range);
+        if (range.empty()) {
+            continue;
+        }
+
+        auto dash = range.find(L'-');
+        try {
+            auto first = std::stoi(range.substr(0, dash));
+            auto last  = dash == std::wstring::npos ? first : std::stoi(range.substr(dash + 1));
+            if (first < 0 || last < first) {
+                throw std::out_of_range("cpu range");
+            }
+            for (auto cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        } catch (std::logic_error&) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid cpu list: " + list));
+        }
+    }
+
+    return cpus;
+}
+
+void configure_thread_affinity(thread_role role, const std::wstring& value)
+{
+    affinity_policy policy;
+
+    auto spec = boost::trim_copy(value);
+    if (spec == L"gpu") {
+        policy.numa_node = gpu_numa_node();
+        if (policy.numa_node < 0) {
+            CASPAR_LOG(warning) << L"[thread-affinity] The NUMA node of the gpu isn't known, " << role_name(role)
+                                << L" threads will float.";
+        }
+    } else if (boost::starts_with(spec, L"node:")) {
+        try {
+            policy.numa_node = std::stoi(spec.substr(5));
+        } catch (std::logic_error&) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid NUMA node: " + spec));
+        }
+    } else {
+        policy.cpus = parse_cpu_list(spec);
+    }
+
+    if (policy.numa_node >= 0) {
+        policy.cpus = numa_node_cpus(policy.numa_node);
+        if (policy.cpus.empty()) {
+            CASPAR_LOG(warning) << L"[thread-affinity] NUMA node " << policy.numa_node << L" has no cpus, "
+                                << role_name(role) << L" threads will float.";
+            policy.numa_node = -1;
+        }
+    }
+
+    if (!policy.cpus.empty()) {
+        auto node = policy.numa_node >= 0 ? L" of NUMA node " + std::to_wstring(policy.numa_node) : L"";
+        CASPAR_LOG(info) << L"[thread-affinity] " << role_name(role) << L" threads run on " << policy.cpus.size()
+                         << L" cpus" << node << L".";
+    }
+
+    std::lock_guard<std::mutex> lock(g_affinity_mutex);
+    g_affinity[static_cast<int>(role)] = std::move(policy);
+}
+
+void set_thread_affinity(thread_role role)
+{
+    affinity_policy policy;
+    {
+        std::lock_guard<std::mutex> lock(g_affinity_mutex);
+        policy = g_affinity[static_cast<int>(role)];
+    }
+
+    if (!policy.cpus.empty()) {
+        set_thread_affinity(policy.cpus, policy.numa_node);
+    }
+}
+
+} // namespace caspar
@@ -1,9 +1,67 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace caspar {
 
+// Also registers the thread for thread_usages under the full name, which the os may truncate.
 void set_thread_name(const std::wstring& name);
 void set_thread_realtime_priority();
+// Lets the calling thread only run when the cpus would otherwise idle, for background work next to playout.
+void set_thread_background_priority();
+
+// Kinds of threads that can be kept on their own cpus, see configure_thread_affinity.
+enum class thread_role
+{
+    channel,  // channel ticks, mixing and sync groups
+    gpu,      // OpenGL device, allocator and upload threads
+    producer, // decoding, the threads ffmpeg starts for a decoder inherit it
+    consumer, // encoding and sending to cards and the network
+    count,
+};
+
+// Sets where the threads of a role run from a configuration value, empty to let them float. The value is a cpu list
+// such as 0-7,16-23, node:N for the cpus of a NUMA node or gpu for the node nearest the first gpu. Threads bound to a
+// node also prefer memory from it, so the buffers they allocate and first touch stay local. Takes effect for threads
+// started after the call.
+void configure_thread_affinity(thread_role role, const std::wstring& value);
+
+// Pins the calling thread to the cpus of its role, if any were configured.
+void set_thread_affinity(thread_role role);
+
+// Parses a cpu list such as 0-3,8,10-11. Throws on malformed input.
+std::vector<int> parse_cpu_list(const std::wstring& list);
+
+// Cpu time and scheduling of a thread, from when it started. Switches and run_delay are 0 where the os doesn't count
+// them.
+struct thread_usage
+{
+    std::wstring  name;
+    std::wstring  subsystem; // channel, gpu, amcp, ffmpeg, decklink or other, from the name
+    double        user_seconds         = 0.0;
+    double        system_seconds       = 0.0;
+    std::uint64_t voluntary_switches   = 0; // the thread blocked
+    std::uint64_t involuntary_switches = 0; // the thread was preempted
+    double        run_delay_seconds    = 0.0; // runnable, waiting for a cpu
+};
+
+// Counts the calling thread in thread_usages until it exits. Only needed for threads that others start and that
+// aren't given a name, such as the callback threads of the DeckLink driver.
+void register_thread(const std::wstring& name);
+
+// Samples the registered threads that are running.
+std::vector<thread_usage> thread_usages();
+
+// The usage of the threads of each subsystem summed, counting those that have exited, with name set to the subsystem.
+std::vector<thread_usage> subsystem_usages(const std::vector<thread_usage>& threads = thread_usages());
+
+// Platform parts of the above. numa_node_cpus is empty and gpu_numa_node -1 when it isn't known.
+std::vector<int> numa_node_cpus(int node);
+int              gpu_numa_node();
+void             set_thread_affinity(const std::vector<int>& cpus, int numa_node);
+std::int64_t     current_thread_id();
+bool             sample_thread(std::int64_t id, thread_usage& usage);
+
 } // namespace caspar
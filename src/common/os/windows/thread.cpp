@@ -31,8 +31,73 @@ inline void SetThreadName(DWORD dwThreadID, LPCSTR szThreadName)
     }
 }
 
-void set_thread_name(const std::wstring& name) { SetThreadName(GetCurrentThreadId(), u8(name).c_str()); }
+void set_thread_name(const std::wstring& name)
+{
+    SetThreadName(GetCurrentThreadId(), u8(name).c_str());
+    register_thread(name);
+}
 
 void set_thread_realtime_priority() { SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL); }
 
+// Background mode also lowers the priority of the thread's disk and memory accesses.
+void set_thread_background_priority() { SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN); }
+
+std::vector<int> numa_node_cpus(int node)
+{
+    ULONGLONG mask = 0;
+    if (node < 0 || !GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask)) {
+        return {};
+    }
+
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < 64; ++cpu) {
+        if (mask & (1ULL << cpu)) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+// DXGI doesn't tell which node an adapter is attached to.
+int gpu_numa_node() { return -1; }
+
+void set_thread_affinity(const std::vector<int>& cpus, int numa_node)
+{
+    // Only the first processor group is supported. Memory is allocated from the node of the cpu the thread runs on.
+    DWORD_PTR mask = 0;
+    for (auto cpu : cpus) {
+        if (cpu < static_cast<int>(sizeof(DWORD_PTR) * 8)) {
+            mask |= static_cast<DWORD_PTR>(1) << cpu;
+        }
+    }
+    if (mask != 0) {
+        SetThreadAffinityMask(GetCurrentThread(), mask);
+    }
+}
+
+std::int64_t current_thread_id() { return GetCurrentThreadId(); }
+
+// Windows doesn't count context switches per thread outside of tracing, only the times are filled in.
+bool sample_thread(std::int64_t id, thread_usage& usage)
+{
+    auto handle = OpenThread(THREAD_QUERY_LIMITED_INFORMATION, FALSE, static_cast<DWORD>(id));
+    if (handle == nullptr) {
+        return false;
+    }
+
+    FILETIME creation, exit, kernel, user;
+    auto     result = GetThreadTimes(handle, &creation, &exit, &kernel, &user);
+    CloseHandle(handle);
+    if (!result) {
+        return false;
+    }
+
+    auto seconds = [](const FILETIME& time) {
+        return (static_cast<ULONGLONG>(time.dwHighDateTime) << 32 | time.dwLowDateTime) / 1e7;
+    };
+    usage.user_seconds   = seconds(user);
+    usage.system_seconds = seconds(kernel);
+    return true;
+}
+
 } // namespace caspar
@@ -55,33 +55,41 @@
 
 #include <algorithm>
 #include <cmath>
-#include <functional>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 namespace caspar {
 
-using tweener_t = std::function<double(double, double, double, double)>;
+// The parameters appended to a tween name, such as the period and amplitude of easeinelastic:0.5:2.
+struct tween_params
+{
+    const double* values;
+    int           count;
+
+    bool        empty() const { return count == 0; }
+    std::size_t size() const { return static_cast<std::size_t>(count); }
+    double      operator[](std::size_t n) const { return values[n]; }
+};
 
 static const double PI   = std::atan(1.0) * 4.0;
 static const double H_PI = std::atan(1.0) * 2.0;
 
-double ease_none(double t, double b, double c, double d, const std::vector<double>& params) { return c * t / d + b; }
+double ease_none(double t, double b, double c, double d, const tween_params& params) { return c * t / d + b; }
 
-double ease_in_quad(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_quad(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d;
     return c * t * t + b;
 }
 
-double ease_out_quad(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_quad(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d;
     return -c * t * (t - 2) + b;
 }
 
-double ease_in_out_quad(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_quad(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d / 2;
     if (t < 1)
@@ -90,7 +98,7 @@ double ease_in_out_quad(double t, double b, double c, double d, const std::vecto
     return -c / 2 * ((t - 1) * (t - 3) - 1) + b;
 }
 
-double ease_out_in_quad(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_in_quad(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_quad(t * 2, b, c / 2, d, params);
@@ -98,19 +106,19 @@ double ease_out_in_quad(double t, double b, double c, double d, const std::vecto
     return ease_in_quad(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-double ease_in_cubic(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_cubic(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d;
     return c * t * t * t + b;
 }
 
-double ease_out_cubic(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_cubic(double t, double b, double c, double d, const tween_params& params)
 {
     t = t / d - 1;
     return c * (t * t * t + 1) + b;
 }
 
-double ease_in_out_cubic(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_cubic(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d / 2;
     if (t < 1)
@@ -120,26 +128,26 @@ double ease_in_out_cubic(double t, double b, double c, double d, const std::vect
     return c / 2 * (t * t * t + 2) + b;
 }
 
-double ease_out_in_cubic(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_in_cubic(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_cubic(t * 2, b, c / 2, d, params);
     return ease_in_cubic(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-double ease_in_quart(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_quart(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d;
     return c * t * t * t * t + b;
 }
 
-double ease_out_quart(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_quart(double t, double b, double c, double d, const tween_params& params)
 {
     t = t / d - 1;
     return -c * (t * t * t * t - 1) + b;
 }
 
-double ease_in_out_quart(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_quart(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d / 2;
     if (t < 1)
@@ -149,7 +157,7 @@ double ease_in_out_quart(double t, double b, double c, double d, const std::vect
     return -c / 2 * (t * t * t * t - 2) + b;
 }
 
-double ease_out_in_quart(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_in_quart(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_quart(t * 2, b, c / 2, d, params);
@@ -157,19 +165,19 @@ double ease_out_in_quart(double t, double b, double c, double d, const std::vect
     return ease_in_quart(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-double ease_in_quint(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_quint(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d;
     return c * t * t * t * t * t + b;
 }
 
-double ease_out_quint(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_quint(double t, double b, double c, double d, const tween_params& params)
 {
     t = t / d - 1;
     return c * (t * t * t * t * t + 1) + b;
 }
 
-double ease_in_out_quint(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_quint(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d / 2;
     if (t < 1)
@@ -179,7 +187,7 @@ double ease_in_out_quint(double t, double b, double c, double d, const std::vect
     return c / 2 * (t * t * t * t * t + 2) + b;
 }
 
-double ease_out_in_quint(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_in_quint(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_quint(t * 2, b, c / 2, d, params);
@@ -187,22 +195,22 @@ double ease_out_in_quint(double t, double b, double c, double d, const std::vect
     return ease_in_quint(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-double ease_in_sine(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_sine(double t, double b, double c, double d, const tween_params& params)
 {
     return -c * std::cos(t / d * (PI / 2)) + c + b;
 }
 
-double ease_out_sine(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_sine(double t, double b, double c, double d, const tween_params& params)
 {
     return c * std::sin(t / d * (PI / 2)) + b;
 }
 
-double ease_in_out_sine(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_sine(double t, double b, double c, double d, const tween_params& params)
 {
     return -c / 2 * (std::cos(PI * t / d) - 1) + b;
 }
 
-double ease_out_in_sine(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_in_sine(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_sine(t * 2, b, c / 2, d, params);
@@ -210,17 +218,17 @@ double ease_out_in_sine(double t, double b, double c, double d, const std::vecto
     return ease_in_sine(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-double ease_in_expo(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_expo(double t, double b, double c, double d, const tween_params& params)
 {
     return t == 0 ? b : c * std::pow(2, 10 * (t / d - 1)) + b - c * 0.001;
 }
 
-double ease_out_expo(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_expo(double t, double b, double c, double d, const tween_params& params)
 {
     return t == d ? b + c : c * 1.001 * (-std::pow(2, -10 * t / d) + 1) + b;
 }
 
-double ease_in_out_expo(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_expo(double t, double b, double c, double d, const tween_params& params)
 {
     if (t == 0)
         return b;
@@ -233,7 +241,7 @@ double ease_in_out_expo(double t, double b, double c, double d, const std::vecto
     return c / 2 * 1.0005 * (-std::pow(2, -10 * (t - 1)) + 2) + b;
 }
 
-double ease_out_in_expo(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_in_expo(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_expo(t * 2, b, c / 2, d, params);
@@ -241,19 +249,19 @@ double ease_out_in_expo(double t, double b, double c, double d, const std::vecto
     return ease_in_expo(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-double ease_in_circ(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_circ(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d;
     return -c * (std::sqrt(1 - t * t) - 1) + b;
 }
 
-double ease_out_circ(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_circ(double t, double b, double c, double d, const tween_params& params)
 {
     t = t / d - 1;
     return c * std::sqrt(1 - t * t) + b;
 }
 
-double ease_in_out_circ(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_circ(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d / 2;
     if (t < 1)
@@ -263,14 +271,14 @@ double ease_in_out_circ(double t, double b, double c, double d, const std::vecto
     return c / 2 * (std::sqrt(1 - t * t) + 1) + b;
 }
 
-double ease_out_in_circ(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_in_circ(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_circ(t * 2, b, c / 2, d, params);
     return ease_in_circ(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-double ease_in_elastic(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_elastic(double t, double b, double c, double d, const tween_params& params)
 {
     if (t == 0)
         return b;
@@ -293,7 +301,7 @@ double ease_in_elastic(double t, double b, double c, double d, const std::vector
     return -(a * std::pow(2, 10 * t) * std::sin((t * d - s) * (2 * PI) / p)) + b;
 }
 
-double ease_out_elastic(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_elastic(double t, double b, double c, double d, const tween_params& params)
 {
     if (t == 0)
         return b;
@@ -315,7 +323,7 @@ double ease_out_elastic(double t, double b, double c, double d, const std::vecto
     return a * std::pow(2, -10 * t) * std::sin((t * d - s) * (2 * PI) / p) + c + b;
 }
 
-double ease_in_out_elastic(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_elastic(double t, double b, double c, double d, const tween_params& params)
 {
     if (t == 0)
         return b;
@@ -340,14 +348,14 @@ double ease_in_out_elastic(double t, double b, double c, double d, const std::ve
     return a * std::pow(2, -10 * t) * std::sin((t * d - s) * (2 * PI) / p) * .5 + c + b;
 }
 
-double ease_out_in_elastic(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_in_elastic(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_elastic(t * 2, b, c / 2, d, params);
     return ease_in_elastic(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-double ease_in_back(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_back(double t, double b, double c, double d, const tween_params& params)
 {
     // var s:Number = !Boolean(p_params) || isNaN(p_params.overshoot) ? 1.70158 : p_params.overshoot;
     double s = !params.empty() ? params[0] : 1.70158;
@@ -355,7 +363,7 @@ double ease_in_back(double t, double b, double c, double d, const std::vector<do
     return c * t * t * ((s + 1) * t - s) + b;
 }
 
-double ease_out_back(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_back(double t, double b, double c, double d, const tween_params& params)
 {
     // var s:Number = !Boolean(p_params) || isNaN(p_params.overshoot) ? 1.70158 : p_params.overshoot;
     double s = !params.empty() ? params[0] : 1.70158;
@@ -363,7 +371,7 @@ double ease_out_back(double t, double b, double c, double d, const std::vector<d
     return c * (t * t * ((s + 1) * t + s) + 1) + b;
 }
 
-double ease_in_out_back(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_back(double t, double b, double c, double d, const tween_params& params)
 {
     // var s:Number = !Boolean(p_params) || isNaN(p_params.overshoot) ? 1.70158 : p_params.overshoot;
     double s = !params.empty() ? params[0] : 1.70158;
@@ -375,14 +383,14 @@ double ease_in_out_back(double t, double b, double c, double d, const std::vecto
     return c / 2 * (t * t * ((s + 1) * t + s) + 2) + b;
 }
 
-double ease_out_int_back(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_int_back(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_back(t * 2, b, c / 2, d, params);
     return ease_in_back(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-double ease_out_bounce(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_bounce(double t, double b, double c, double d, const tween_params& params)
 {
     t /= d;
     if (t < 1 / 2.75)
@@ -399,111 +407,248 @@ double ease_out_bounce(double t, double b, double c, double d, const std::vector
     return c * (7.5625 * t * t + .984375) + b;
 }
 
-double ease_in_bounce(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_bounce(double t, double b, double c, double d, const tween_params& params)
 {
     return c - ease_out_bounce(d - t, 0, c, d, params) + b;
 }
 
-double ease_in_out_bounce(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_in_out_bounce(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_in_bounce(t * 2, 0, c, d, params) * .5 + b;
     return ease_out_bounce(t * 2 - d, 0, c, d, params) * .5 + c * .5 + b;
 }
 
-double ease_out_in_bounce(double t, double b, double c, double d, const std::vector<double>& params)
+double ease_out_in_bounce(double t, double b, double c, double d, const tween_params& params)
 {
     if (t < d / 2)
         return ease_out_bounce(t * 2, b, c / 2, d, params);
     return ease_in_bounce(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-using tween_t = std::function<double(double, double, double, double, const std::vector<double>&)>;
-
-const std::unordered_map<std::wstring, tween_t>& get_tweens()
-{
-    static const std::unordered_map<std::wstring, tween_t> tweens = {{L"", ease_none},
-                                                                     {L"linear", ease_none},
-                                                                     {L"easenone", ease_none},
-                                                                     {L"easeinquad", ease_in_quad},
-                                                                     {L"easeoutquad", ease_out_quad},
-                                                                     {L"easeinoutquad", ease_in_out_quad},
-                                                                     {L"easeoutinquad", ease_out_in_quad},
-                                                                     {L"easeincubic", ease_in_cubic},
-                                                                     {L"easeoutcubic", ease_out_cubic},
-                                                                     {L"easeinoutcubic", ease_in_out_cubic},
-                                                                     {L"easeoutincubic", ease_out_in_cubic},
-                                                                     {L"easeinquart", ease_in_quart},
-                                                                     {L"easeoutquart", ease_out_quart},
-                                                                     {L"easeinoutquart", ease_in_out_quart},
-                                                                     {L"easeoutinquart", ease_out_in_quart},
-                                                                     {L"easeinquint", ease_in_quint},
-                                                                     {L"easeoutquint", ease_out_quint},
-                                                                     {L"easeinoutquint", ease_in_out_quint},
-                                                                     {L"easeoutinquint", ease_out_in_quint},
-                                                                     {L"easeinsine", ease_in_sine},
-                                                                     {L"easeoutsine", ease_out_sine},
-                                                                     {L"easeinoutsine", ease_in_out_sine},
-                                                                     {L"easeoutinsine", ease_out_in_sine},
-                                                                     {L"easeinexpo", ease_in_expo},
-                                                                     {L"easeoutexpo", ease_out_expo},
-                                                                     {L"easeinoutexpo", ease_in_out_expo},
-                                                                     {L"easeoutinexpo", ease_out_in_expo},
-                                                                     {L"easeincirc", ease_in_circ},
-                                                                     {L"easeoutcirc", ease_out_circ},
-                                                                     {L"easeinoutcirc", ease_in_out_circ},
-                                                                     {L"easeoutincirc", ease_out_in_circ},
-                                                                     {L"easeinelastic", ease_in_elastic},
-                                                                     {L"easeoutelastic", ease_out_elastic},
-                                                                     {L"easeinoutelastic", ease_in_out_elastic},
-                                                                     {L"easeoutinelastic", ease_out_in_elastic},
-                                                                     {L"easeinback", ease_in_back},
-                                                                     {L"easeoutback", ease_out_back},
-                                                                     {L"easeinoutback", ease_in_out_back},
-                                                                     {L"easeoutintback", ease_out_int_back},
-                                                                     {L"easeoutbounce", ease_out_bounce},
-                                                                     {L"easeinbounce", ease_in_bounce},
-                                                                     {L"easeinoutbounce", ease_in_out_bounce},
-                                                                     {L"easeoutinbounce", ease_out_in_bounce}};
+enum class tween_type
+{
+    none,
+    in_quad,
+    out_quad,
+    in_out_quad,
+    out_in_quad,
+    in_cubic,
+    out_cubic,
+    in_out_cubic,
+    out_in_cubic,
+    in_quart,
+    out_quart,
+    in_out_quart,
+    out_in_quart,
+    in_quint,
+    out_quint,
+    in_out_quint,
+    out_in_quint,
+    in_sine,
+    out_sine,
+    in_out_sine,
+    out_in_sine,
+    in_expo,
+    out_expo,
+    in_out_expo,
+    out_in_expo,
+    in_circ,
+    out_circ,
+    in_out_circ,
+    out_in_circ,
+    in_elastic,
+    out_elastic,
+    in_out_elastic,
+    out_in_elastic,
+    in_back,
+    out_back,
+    in_out_back,
+    out_int_back,
+    out_bounce,
+    in_bounce,
+    in_out_bounce,
+    out_in_bounce,
+};
+
+const std::unordered_map<std::wstring, tween_type>& get_tweens()
+{
+    static const std::unordered_map<std::wstring, tween_type> tweens = {
+        {L"", tween_type::none},
+        {L"linear", tween_type::none},
+        {L"easenone", tween_type::none},
+        {L"easeinquad", tween_type::in_quad},
+        {L"easeoutquad", tween_type::out_quad},
+        {L"easeinoutquad", tween_type::in_out_quad},
+        {L"easeoutinquad", tween_type::out_in_quad},
+        {L"easeincubic", tween_type::in_cubic},
+        {L"easeoutcubic", tween_type::out_cubic},
+        {L"easeinoutcubic", tween_type::in_out_cubic},
+        {L"easeoutincubic", tween_type::out_in_cubic},
+        {L"easeinquart", tween_type::in_quart},
+        {L"easeoutquart", tween_type::out_quart},
+        {L"easeinoutquart", tween_type::in_out_quart},
+        {L"easeoutinquart", tween_type::out_in_quart},
+        {L"easeinquint", tween_type::in_quint},
+        {L"easeoutquint", tween_type::out_quint},
+        {L"easeinoutquint", tween_type::in_out_quint},
+        {L"easeoutinquint", tween_type::out_in_quint},
+        {L"easeinsine", tween_type::in_sine},
+        {L"easeoutsine", tween_type::out_sine},
+        {L"easeinoutsine", tween_type::in_out_sine},
+        {L"easeoutinsine", tween_type::out_in_sine},
+        {L"easeinexpo", tween_type::in_expo},
+        {L"easeoutexpo", tween_type::out_expo},
+        {L"easeinoutexpo", tween_type::in_out_expo},
+        {L"easeoutinexpo", tween_type::out_in_expo},
+        {L"easeincirc", tween_type::in_circ},
+        {L"easeoutcirc", tween_type::out_circ},
+        {L"easeinoutcirc", tween_type::in_out_circ},
+        {L"easeoutincirc", tween_type::out_in_circ},
+        {L"easeinelastic", tween_type::in_elastic},
+        {L"easeoutelastic", tween_type::out_elastic},
+        {L"easeinoutelastic", tween_type::in_out_elastic},
+        {L"easeoutinelastic", tween_type::out_in_elastic},
+        {L"easeinback", tween_type::in_back},
+        {L"easeoutback", tween_type::out_back},
+        {L"easeinoutback", tween_type::in_out_back},
+        {L"easeoutintback", tween_type::out_int_back},
+        {L"easeoutbounce", tween_type::out_bounce},
+        {L"easeinbounce", tween_type::in_bounce},
+        {L"easeinoutbounce", tween_type::in_out_bounce},
+        {L"easeoutinbounce", tween_type::out_in_bounce}};
 
     return tweens;
 }
 
-tweener_t get_tweener(std::wstring name)
-{
-    std::transform(name.begin(), name.end(), name.begin(), std::towlower);
-
-    if (name == L"linear")
-        return [](double t, double b, double c, double d) { return ease_none(t, b, c, d, std::vector<double>()); };
+// A switch the compiler can inline the common tweens into, instead of a call through two std::functions.
+double evaluate(tween_type type, double t, double b, double c, double d, const tween_params& params)
+{
+    switch (type) {
+        case tween_type::none:
+            return ease_none(t, b, c, d, params);
+        case tween_type::in_quad:
+            return ease_in_quad(t, b, c, d, params);
+        case tween_type::out_quad:
+            return ease_out_quad(t, b, c, d, params);
+        case tween_type::in_out_quad:
+            return ease_in_out_quad(t, b, c, d, params);
+        case tween_type::out_in_quad:
+            return ease_out_in_quad(t, b, c, d, params);
+        case tween_type::in_cubic:
+            return ease_in_cubic(t, b, c, d, params);
+        case tween_type::out_cubic:
+            return ease_out_cubic(t, b, c, d, params);
+        case tween_type::in_out_cubic:
+            return ease_in_out_cubic(t, b, c, d, params);
+        case tween_type::out_in_cubic:
+            return ease_out_in_cubic(t, b, c, d, params);
+        case tween_type::in_quart:
+            return ease_in_quart(t, b, c, d, params);
+        case tween_type::out_quart:
+            return ease_out_quart(t, b, c, d, params);
+        case tween_type::in_out_quart:
+            return ease_in_out_quart(t, b, c, d, params);
+        case tween_type::out_in_quart:
+            return ease_out_in_quart(t, b, c, d, params);
+        case tween_type::in_quint:
+            return ease_in_quint(t, b, c, d, params);
+        case tween_type::out_quint:
+            return ease_out_quint(t, b, c, d, params);
+        case tween_type::in_out_quint:
+            return ease_in_out_quint(t, b, c, d, params);
+        case tween_type::out_in_quint:
+            return ease_out_in_quint(t, b, c, d, params);
+        case tween_type::in_sine:
+            return ease_in_sine(t, b, c, d, params);
+        case tween_type::out_sine:
+            return ease_out_sine(t, b, c, d, params);
+        case tween_type::in_out_sine:
+            return ease_in_out_sine(t, b, c, d, params);
+        case tween_type::out_in_sine:
+            return ease_out_in_sine(t, b, c, d, params);
+        case tween_type::in_expo:
+            return ease_in_expo(t, b, c, d, params);
+        case tween_type::out_expo:
+            return ease_out_expo(t, b, c, d, params);
+        case tween_type::in_out_expo:
+            return ease_in_out_expo(t, b, c, d, params);
+        case tween_type::out_in_expo:
+            return ease_out_in_expo(t, b, c, d, params);
+        case tween_type::in_circ:
+            return ease_in_circ(t, b, c, d, params);
+        case tween_type::out_circ:
+            return ease_out_circ(t, b, c, d, params);
+        case tween_type::in_out_circ:
+            return ease_in_out_circ(t, b, c, d, params);
+        case tween_type::out_in_circ:
+            return ease_out_in_circ(t, b, c, d, params);
+        case tween_type::in_elastic:
+            return ease_in_elastic(t, b, c, d, params);
+        case tween_type::out_elastic:
+            return ease_out_elastic(t, b, c, d, params);
+        case tween_type::in_out_elastic:
+            return ease_in_out_elastic(t, b, c, d, params);
+        case tween_type::out_in_elastic:
+            return ease_out_in_elastic(t, b, c, d, params);
+        case tween_type::in_back:
+            return ease_in_back(t, b, c, d, params);
+        case tween_type::out_back:
+            return ease_out_back(t, b, c, d, params);
+        case tween_type::in_out_back:
+            return ease_in_out_back(t, b, c, d, params);
+        case tween_type::out_int_back:
+            return ease_out_int_back(t, b, c, d, params);
+        case tween_type::out_bounce:
+            return ease_out_bounce(t, b, c, d, params);
+        case tween_type::in_bounce:
+            return ease_in_bounce(t, b, c, d, params);
+        case tween_type::in_out_bounce:
+            return ease_in_out_bounce(t, b, c, d, params);
+        case tween_type::out_in_bounce:
+            return ease_out_in_bounce(t, b, c, d, params);
+    }
+    return ease_none(t, b, c, d, params);
+}
 
-    std::vector<double> params;
+tweener::tweener(const std::wstring& name)
+    : name_(name)
+{
+    auto lowered = name;
+    std::transform(lowered.begin(), lowered.end(), lowered.begin(), std::towlower);
 
     static const boost::wregex expr(
         LR"((?<NAME>\w*)(:(?<V0>\d+\.?\d?))?(:(?<V1>\d+\.?\d?))?)"); // boost::regex has no repeated captures?
     boost::wsmatch what;
-    if (boost::regex_match(name, what, expr)) {
-        name = what["NAME"].str();
+    if (lowered != L"linear" && boost::regex_match(lowered, what, expr)) {
+        lowered = what["NAME"].str();
         if (what["V0"].matched)
-            params.push_back(std::stod(what["V0"].str()));
+            params_[param_count_++] = std::stod(what["V0"].str());
         if (what["V1"].matched)
-            params.push_back(std::stod(what["V1"].str()));
+            params_[param_count_++] = std::stod(what["V1"].str());
     }
 
-    auto it = get_tweens().find(name);
+    auto it = get_tweens().find(lowered);
     if (it == get_tweens().end())
-        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Could not find tween " + name));
-
-    auto tween = it->second;
-    return [=](double t, double b, double c, double d) { return tween(t, b, c, d, params); };
-};
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Could not find tween " + lowered));
+    type_ = it->second;
+}
 
-tweener::tweener(const std::wstring& name)
-    : func_(get_tweener(name))
-    , name_(name)
+double tweener::operator()(double t, double b, double c, double d) const
 {
+    return evaluate(type_, t, b, c, d, {params_.data(), param_count_});
 }
 
-double tweener::operator()(double t, double b, double c, double d) const { return func_(t, b, c, d); }
+std::optional<double> tweener::fraction(double t, double d) const
+{
+    // An elastic tween given an amplitude swings by the amplitude relative to the distance, the others scale with it.
+    const auto elastic = type_ == tween_type::in_elastic || type_ == tween_type::out_elastic ||
+                         type_ == tween_type::in_out_elastic || type_ == tween_type::out_in_elastic;
+    if (elastic && param_count_ > 1 && params_[1] != 0.0)
+        return {};
+
+    return (*this)(t, 0.0, 1.0, d);
+}
 
 bool tweener::operator==(const tweener& other) const { return name_ == other.name_; }
 
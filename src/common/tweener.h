@@ -21,12 +21,15 @@
 
 #pragma once
 
-#include <functional>
+#include <array>
+#include <optional>
 #include <string>
 #include <vector>
 
 namespace caspar {
 
+enum class tween_type;
+
 /**
  * A tweener can be used for creating any kind of (image position, image fade
  * in/out, audio volume etc) transition, by invoking it for each temporal
@@ -71,12 +74,25 @@ class tweener
      */
     double operator()(double t, double b, double c, double d) const;
 
+    /**
+     * The fraction of the way from b to b + c at time t, which is the same
+     * for every b and c with most tweens. Evaluating it once and moving every
+     * value of a transform by it is much cheaper than tweening each value.
+     *
+     * @return operator()(t, 0, 1, d), or nothing for the tweens where the
+     *         fraction depends on c, which then have to be evaluated for
+     *         every value.
+     */
+    std::optional<double> fraction(double t, double d) const;
+
     bool operator==(const tweener& other) const;
     bool operator!=(const tweener& other) const;
 
   private:
-    std::function<double(double, double, double, double)> func_;
-    std::wstring                                          name_;
+    tween_type            type_;
+    std::array<double, 2> params_      = {0.0, 0.0};
+    int                   param_count_ = 0;
+    std::wstring          name_;
 };
 
 } // namespace caspar
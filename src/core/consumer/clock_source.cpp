@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+#include "clock_source.h"
+
+#include "../video_format.h"
+
+#include <common/log.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace caspar { namespace core {
+
+namespace {
+
+std::int64_t now_nanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// The time from the first frame to the start of frame n, exact for fractional rates such as 59.94.
+std::int64_t frames_to_nanos(std::int64_t frames, const video_format_desc& format_desc)
+{
+    const auto ticks = frames * format_desc.duration;
+    const auto scale = static_cast<std::int64_t>(format_desc.time_scale);
+    return ticks / scale * 1000000000 + ticks % scale * 1000000000 / scale;
+}
+
+class system_clock final : public clock_source
+{
+    // Sleeping is only accurate to the scheduler's tick, the last part of the wait spins.
+    static constexpr std::int64_t spin_nanos = 1000000;
+
+    video_format_desc format_desc_;
+    std::int64_t      start_   = 0;
+    std::int64_t      frames_  = 0;
+    bool              started_ = false;
+
+  public:
+    explicit system_clock(const video_format_desc& format_desc)
+        : format_desc_(format_desc)
+    {
+    }
+
+    void wait() override
+    {
+        auto now = now_nanos();
+
+        if (!started_) {
+            start_   = now;
+            frames_  = 0;
+            started_ = true;
+            return;
+        }
+
+        const auto due = start_ + frames_to_nanos(++frames_, format_desc_);
+
+        // Far behind after a stall, start over rather than rushing frames out to catch up.
+        if (now - due > frames_to_nanos(2, format_desc_)) {
+            start_  = now;
+            frames_ = 0;
+            return;
+        }
+
+        if (due - now > spin_nanos) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(due - now - spin_nanos));
+        }
+        while (now_nanos() < due) {
+            std::this_thread::yield();
+        }
+    }
+
+    void reset(const video_format_desc& format_desc) override
+    {
+        format_desc_ = format_desc;
+        started_     = false;
+    }
+
+    std::wstring print() const override { return L"system clock"; }
+};
+
+} // namespace
+
+hardware_clock::hardware_clock(std::wstring name)
+    : name_(std::move(name))
+{
+}
+
+void hardware_clock::tick()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Ticks the output didn't wait for, while it was busy, may let it catch up by a frame but no more.
+        ticks_ = std::min(ticks_ + 1, 2);
+    }
+    cond_.notify_one();
+}
+
+void hardware_clock::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    // Once the ticks have stopped, keep the nominal rate until they come back.
+    const auto timeout = std::chrono::nanoseconds(timed_out_ ? frame_nanos_ : frame_nanos_ * 2);
+    if (!cond_.wait_for(lock, timeout, [&] { return ticks_ > 0; })) {
+        if (!timed_out_) {
+            CASPAR_LOG(warning) << print() << L" Stopped ticking, pacing on the system clock.";
+            timed_out_ = true;
+        }
+        return;
+    }
+
+    --ticks_;
+    if (timed_out_) {
+        CASPAR_LOG(info) << print() << L" Ticking again.";
+        timed_out_ = false;
+    }
+}
+
+void hardware_clock::reset(const video_format_desc& format_desc)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ticks_       = 0;
+    frame_nanos_ = frames_to_nanos(1, format_desc);
+}
+
+std::wstring hardware_clock::print() const { return name_ + L" clock"; }
+
+spl::shared_ptr<clock_source> create_system_clock(const video_format_desc& format_desc)
+{
+    return spl::make_shared<system_clock>(format_desc);
+}
+
+}} // namespace caspar::core
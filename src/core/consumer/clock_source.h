@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+
+#pragma once
+
+#include "../monitor/monitor.h"
+
+#include <common/memory.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace caspar { namespace core {
+
+struct video_format_desc;
+
+// Paces an output, which calls wait() once for every channel frame it has sent.
+class clock_source
+{
+  public:
+    clock_source()                               = default;
+    clock_source(const clock_source&)            = delete;
+    clock_source& operator=(const clock_source&) = delete;
+    virtual ~clock_source()                      = default;
+
+    // Blocks until the next frame is due.
+    virtual void wait() = 0;
+
+    // Starts over at a new format, the next frame is due right away.
+    virtual void reset(const video_format_desc& format_desc) = 0;
+
+    // How well the clock keeps time, for clocks that measure it.
+    virtual monitor::state state() const { return {}; }
+
+    virtual std::wstring print() const = 0;
+};
+
+// A clock a consumer ticks from its hardware callbacks, such as a card completing a frame. Missing ticks for two
+// frames, while the device is stopped or reconfigured, it falls back to pacing at the nominal frame rate.
+class hardware_clock final : public clock_source
+{
+  public:
+    explicit hardware_clock(std::wstring name);
+
+    // Called once per channel frame the device has taken.
+    void tick();
+
+    void         wait() override;
+    void         reset(const video_format_desc& format_desc) override;
+    std::wstring print() const override;
+
+  private:
+    const std::wstring      name_;
+    std::mutex              mutex_;
+    std::condition_variable cond_;
+    int                     ticks_       = 0;
+    std::int64_t            frame_nanos_ = 40000000;
+    bool                    timed_out_   = false;
+};
+
+// Paces at the nominal frame rate of the format on the system clock. Frames are due at exact multiples of the frame
+// duration from the first one, so rounding and late wake-ups don't accumulate into drift.
+spl::shared_ptr<clock_source> create_system_clock(const video_format_desc& format_desc);
+
+}} // namespace caspar::core
@@ -24,16 +24,19 @@
 #include "frame_consumer.h"
 
 #include <common/except.h>
-#include <common/future.h>
 
 #include <core/frame/frame.h>
 #include <core/video_format.h>
 
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/circular_buffer.hpp>
 #include <boost/property_tree/ptree.hpp>
 
-#include <future>
+#include <condition_variable>
 #include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include <vector>
 
 namespace caspar { namespace core {
@@ -111,7 +114,7 @@ class destroy_consumer_proxy : public frame_consumer
         }).detach();
     }
 
-    std::future<bool> send(const core::video_field field, const_frame frame) override
+    send_result send(const core::video_field field, const_frame frame) override
     {
         return consumer_->send(field, std::move(frame));
     }
@@ -123,7 +126,12 @@ class destroy_consumer_proxy : public frame_consumer
     std::wstring         name() const override { return consumer_->name(); }
     bool                 has_synchronization_clock() const override { return consumer_->has_synchronization_clock(); }
     int                  index() const override { return consumer_->index(); }
+    std::shared_ptr<clock_source> clock() const override { return consumer_->clock(); }
     core::monitor::state state() const override { return consumer_->state(); }
+    output_format        preferred_output_format() const override { return consumer_->preferred_output_format(); }
+    std::pair<int, int>  preferred_output_size() const override { return consumer_->preferred_output_size(); }
+    void                 paced(bool value) override { consumer_->paced(value); }
+    memory_usage         memory() const override { return consumer_->memory(); }
 };
 
 class print_consumer_proxy : public frame_consumer
@@ -144,7 +152,7 @@ class print_consumer_proxy : public frame_consumer
         CASPAR_LOG(info) << str << L" Uninitialized.";
     }
 
-    std::future<bool> send(const core::video_field field, const_frame frame) override
+    send_result send(const core::video_field field, const_frame frame) override
     {
         return consumer_->send(field, std::move(frame));
     }
@@ -157,7 +165,194 @@ class print_consumer_proxy : public frame_consumer
     std::wstring         name() const override { return consumer_->name(); }
     bool                 has_synchronization_clock() const override { return consumer_->has_synchronization_clock(); }
     int                  index() const override { return consumer_->index(); }
+    std::shared_ptr<clock_source> clock() const override { return consumer_->clock(); }
     core::monitor::state state() const override { return consumer_->state(); }
+    output_format        preferred_output_format() const override { return consumer_->preferred_output_format(); }
+    std::pair<int, int>  preferred_output_size() const override { return consumer_->preferred_output_size(); }
+    void                 paced(bool value) override { consumer_->paced(value); }
+    memory_usage         memory() const override { return consumer_->memory(); }
+};
+
+class queued_consumer_proxy : public frame_consumer
+{
+    enum class policy
+    {
+        drop,
+        repeat
+    };
+
+    struct queued_frame
+    {
+        core::video_field field;
+        const_frame       frame;
+    };
+
+    std::shared_ptr<frame_consumer> consumer_;
+    const policy                    policy_;
+
+    mutable std::mutex                   mutex_;
+    std::condition_variable              cond_;
+    boost::circular_buffer<queued_frame> queue_;
+    std::optional<std::pair<video_format_desc, int>> pending_format_desc_;
+    bool                                             initialized_ = false;
+    bool                                             abort_       = false;
+
+    std::atomic<bool>     failed_{false};
+    std::atomic<bool>     paced_{true};
+    std::atomic<uint64_t> dropped_{0};
+
+    std::thread thread_;
+
+  public:
+    queued_consumer_proxy(spl::shared_ptr<frame_consumer>&& consumer, int depth, const std::wstring& policy)
+        : consumer_(std::move(consumer))
+        , policy_(boost::iequals(policy, L"repeat") ? policy::repeat : policy::drop)
+        , queue_(depth)
+    {
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~queued_consumer_proxy()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    send_result send(const core::video_field field, const_frame frame) override
+    {
+        if (failed_) {
+            return false;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!paced_) {
+                // Nothing may be lost while rendering offline, wait for the consumer to make room instead.
+                cond_.wait(lock, [&] { return abort_ || failed_ || !queue_.full(); });
+            }
+            if (queue_.full()) {
+                dropped_++;
+                if (policy_ == policy::repeat) {
+                    // Keep what is queued, the consumer repeats its last frame in place of this one.
+                    return true;
+                }
+                // push_back on a full circular_buffer overwrites the oldest frame.
+            }
+            queue_.push_back(queued_frame{field, std::move(frame)});
+        }
+        cond_.notify_one();
+
+        return true;
+    }
+
+    void initialize(const video_format_desc& format_desc, int channel_index) override
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!initialized_) {
+            // Nothing is queued yet, initialize synchronously so errors reach the caller.
+            lock.unlock();
+            consumer_->initialize(format_desc, channel_index);
+            lock.lock();
+            initialized_ = true;
+            return;
+        }
+
+        // Frames of the previous format are useless, let the worker re-initialize before sending anything new.
+        queue_.clear();
+        pending_format_desc_ = std::make_pair(format_desc, channel_index);
+        lock.unlock();
+        cond_.notify_one();
+    }
+
+    std::wstring print() const override { return consumer_->print(); }
+    std::wstring name() const override { return consumer_->name(); }
+
+    // The queue decouples the consumer from the channel, so its clock can no longer pace the channel.
+    bool                has_synchronization_clock() const override { return false; }
+    int                 index() const override { return consumer_->index(); }
+    output_format       preferred_output_format() const override { return consumer_->preferred_output_format(); }
+    std::pair<int, int> preferred_output_size() const override { return consumer_->preferred_output_size(); }
+
+    void paced(bool value) override
+    {
+        paced_ = value;
+        consumer_->paced(value);
+    }
+
+    memory_usage memory() const override
+    {
+        auto usage = consumer_->memory();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& queued : queue_) {
+            usage += frame_memory(queued.frame);
+        }
+        return usage;
+    }
+
+    core::monitor::state state() const override
+    {
+        auto state = consumer_->state();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        state["queue/depth"]    = static_cast<int>(queue_.size());
+        state["queue/capacity"] = static_cast<int>(queue_.capacity());
+        state["queue/dropped"]  = dropped_.load();
+        return state;
+    }
+
+  private:
+    // Under the lock, so a send() waiting for room can't miss it.
+    void fail()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            failed_ = true;
+        }
+        cond_.notify_all();
+    }
+
+    void run()
+    {
+        while (true) {
+            std::optional<std::pair<video_format_desc, int>> format_desc;
+            std::optional<queued_frame>                      frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [&] { return abort_ || !queue_.empty() || pending_format_desc_; });
+
+                if (abort_) {
+                    return;
+                }
+
+                if (pending_format_desc_) {
+                    format_desc = std::move(pending_format_desc_);
+                    pending_format_desc_.reset();
+                } else {
+                    frame = std::move(queue_.front());
+                    queue_.pop_front();
+                }
+            }
+            cond_.notify_all();
+
+            try {
+                if (format_desc) {
+                    consumer_->initialize(format_desc->first, format_desc->second);
+                } else if (!consumer_->send(frame->field, std::move(frame->frame)).get()) {
+                    fail();
+                    return;
+                }
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                fail();
+                return;
+            }
+        }
+    }
 };
 
 spl::shared_ptr<core::frame_consumer>
@@ -198,8 +393,15 @@ frame_consumer_registry::create_consumer(const std::wstring&
         CASPAR_THROW_EXCEPTION(user_error()
                                << msg_info(L"No consumer factory registered for element name " + element_name));
 
-    return spl::make_shared<destroy_consumer_proxy>(
-        spl::make_shared<print_consumer_proxy>(found->second(element, format_repository, channels)));
+    auto consumer = found->second(element, format_repository, channels);
+
+    auto queue_depth = element.get(L"send-queue-depth", 0);
+    if (queue_depth > 0) {
+        consumer = spl::make_shared<queued_consumer_proxy>(
+            std::move(consumer), queue_depth, element.get(L"send-queue-policy", L"drop"));
+    }
+
+    return spl::make_shared<destroy_consumer_proxy>(spl::make_shared<print_consumer_proxy>(std::move(consumer)));
 }
 
 const spl::shared_ptr<frame_consumer>& frame_consumer::empty()
@@ -207,7 +409,7 @@ const spl::shared_ptr<frame_consumer>& frame_consumer::empty()
     class empty_frame_consumer : public frame_consumer
     {
       public:
-        std::future<bool> send(const core::video_field field, const_frame) override { return make_ready_future(false); }
+        send_result send(const core::video_field field, const_frame) override { return false; }
         void              initialize(const video_format_desc&, int) override {}
         std::wstring      print() const override { return L"empty"; }
         std::wstring      name() const override { return L"empty"; }
@@ -21,6 +21,8 @@
 
 #pragma once
 
+#include "../frame/frame.h"
+#include "../frame/pixel_format.h"
 #include "../fwd.h"
 #include "../monitor/monitor.h"
 
@@ -33,10 +35,33 @@
 #include <functional>
 #include <future>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace caspar { namespace core {
 
+// What a send() completes with. Consumers done when send() returns give the value right away, without the shared
+// state of a future, the ones finishing on a thread of their own give a future for it.
+class send_result final
+{
+    std::future<bool> future_;
+    bool              value_ = true;
+
+  public:
+    send_result(bool value)
+        : value_(value)
+    {
+    }
+
+    send_result(std::future<bool> future)
+        : future_(std::move(future))
+    {
+    }
+
+    // Waits for a consumer finishing asynchronously.
+    bool get() { return future_.valid() ? future_.get() : value_; }
+};
+
 class frame_consumer
 {
     frame_consumer(const frame_consumer&);
@@ -48,8 +73,8 @@ class frame_consumer
     frame_consumer() {}
     virtual ~frame_consumer() {}
 
-    virtual std::future<bool> send(const core::video_field field, const_frame frame)              = 0;
-    virtual void              initialize(const video_format_desc& format_desc, int channel_index) = 0;
+    virtual send_result send(const core::video_field field, const_frame frame)              = 0;
+    virtual void        initialize(const video_format_desc& format_desc, int channel_index) = 0;
 
     virtual core::monitor::state state() const = 0;
 
@@ -57,6 +82,27 @@ class frame_consumer
     virtual std::wstring name() const  = 0;
     virtual bool         has_synchronization_clock() const { return false; }
     virtual int          index() const = 0;
+
+    // A clock driven by the consumer's device for the output to pace the channel with, instead of relying on send()
+    // blocking. Only consumers with a synchronization clock provide one.
+    virtual std::shared_ptr<clock_source> clock() const { return nullptr; }
+
+    // The layout the consumer wants the mixer to convert frames to on the gpu, read with
+    // const_frame::image_data(output_format). Consumers asking for anything else than bgra must handle frames
+    // where only bgra is available, which happens briefly after the set of consumers changes.
+    virtual output_format preferred_output_format() const { return output_format::bgra; }
+
+    // The width and height the consumer wants the mixer to scale frames to on the gpu, before converting them to the
+    // preferred output format, read with const_frame::image_data(scaled_output_format). 0 or the channel's size for
+    // the channel's size. Consumers asking for another size must also handle frames of the channel's size.
+    virtual std::pair<int, int> preferred_output_size() const { return {0, 0}; }
+
+    // Whether the channel is paced by a clock. Unpaced, it renders as fast as it can, and consumers writing files
+    // should block in send() until they have room rather than dropping frames.
+    virtual void paced(bool value) {}
+
+    // The memory the consumer holds in frames it queued, buffer pools and the like.
+    virtual memory_usage memory() const { return {}; }
 };
 
 using consumer_factory_t =
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+
+#include "latency.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace caspar { namespace core {
+
+namespace {
+
+const std::vector<double>& latency_bounds()
+{
+    static const std::vector<double> bounds = {
+        0.005, 0.010, 0.020, 0.040, 0.060, 0.080, 0.100, 0.120, 0.160, 0.200, 0.300, 0.500, 1.000};
+    return bounds;
+}
+
+} // namespace
+
+struct latency_histogram::impl
+{
+    const std::shared_ptr<diagnostics::metrics::histogram> histogram_;
+
+    mutable std::mutex      mutex_;
+    std::array<double, 256> recent_{};
+    std::size_t             count_ = 0;
+
+    explicit impl(diagnostics::metrics::labels_t labels)
+        : histogram_(diagnostics::metrics::make_histogram("caspar_consumer_latency_seconds",
+                                                          "Time from the capture of a frame to its output",
+                                                          std::move(labels),
+                                                          latency_bounds()))
+    {
+    }
+
+    void observe(std::chrono::steady_clock::time_point capture_time, std::chrono::steady_clock::time_point output_time)
+    {
+        if (capture_time == std::chrono::steady_clock::time_point()) {
+            return;
+        }
+
+        const auto seconds = std::chrono::duration<double>(output_time - capture_time).count();
+        histogram_->observe(seconds);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        recent_[count_++ % recent_.size()] = seconds;
+    }
+
+    monitor::state state() const
+    {
+        std::vector<double> recent;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            recent.assign(recent_.begin(), recent_.begin() + std::min(count_, recent_.size()));
+        }
+
+        monitor::state state;
+
+        const auto&                bounds = histogram_->bounds();
+        std::vector<double>        bounds_ms;
+        std::vector<std::uint64_t> buckets;
+        for (std::size_t n = 0; n < bounds.size(); ++n) {
+            bounds_ms.push_back(bounds[n] * 1000.0);
+            buckets.push_back(histogram_->bucket(n));
+        }
+        buckets.push_back(histogram_->bucket(bounds.size()));
+
+        state["bounds"]  = bounds_ms;
+        state["buckets"] = buckets;
+        state["count"]   = histogram_->count();
+
+        if (!recent.empty()) {
+            std::sort(recent.begin(), recent.end());
+            state["p50"] = recent[recent.size() / 2] * 1000.0;
+            state["p99"] = recent[recent.size() * 99 / 100] * 1000.0;
+            state["max"] = recent.back() * 1000.0;
+        }
+
+        return state;
+    }
+};
+
+latency_histogram::latency_histogram(diagnostics::metrics::labels_t labels)
+    : impl_(new impl(std::move(labels)))
+{
+}
+latency_histogram::~latency_histogram() {}
+void latency_histogram::observe(std::chrono::steady_clock::time_point capture_time,
+                                std::chrono::steady_clock::time_point output_time)
+{
+    impl_->observe(capture_time, output_time);
+}
+monitor::state latency_histogram::state() const { return impl_->state(); }
+
+}} // namespace caspar::core
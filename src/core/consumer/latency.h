@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+
+#pragma once
+
+#include <common/diagnostics/metrics.h>
+
+#include <core/monitor/monitor.h>
+
+#include <chrono>
+#include <memory>
+
+namespace caspar { namespace core {
+
+// How long after their capture a consumer put out the frames of live sources, see const_frame::capture_time(). Kept
+// as caspar_consumer_latency_seconds and, in milliseconds, in the consumer's monitor state.
+class latency_histogram final
+{
+  public:
+    explicit latency_histogram(diagnostics::metrics::labels_t labels);
+    ~latency_histogram();
+
+    latency_histogram(const latency_histogram&)            = delete;
+    latency_histogram& operator=(const latency_histogram&) = delete;
+
+    // Frames that were not captured are ignored.
+    void observe(std::chrono::steady_clock::time_point capture_time,
+                 std::chrono::steady_clock::time_point output_time = std::chrono::steady_clock::now());
+
+    // bounds, buckets and count since the consumer started, p50, p99 and max over the last few seconds.
+    monitor::state state() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::core
@@ -20,41 +20,60 @@
  */
 #include "output.h"
 
+#include "clock_source.h"
 #include "frame_consumer.h"
+#include "sync_group.h"
 
 #include "../frame/frame.h"
+#include "../frame/pixel_format.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/trace.h>
 #include <common/except.h>
 #include <common/memory.h>
 
-#include <chrono>
+#include <boost/container/small_vector.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <future>
 #include <map>
+#include <mutex>
 #include <optional>
-#include <thread>
 #include <utility>
+#include <vector>
 
 namespace caspar { namespace core {
 
-using time_point_t = decltype(std::chrono::high_resolution_clock::now());
-
 struct output::impl
 {
     monitor::state                      state_;
+    memory_usage                        memory_;
     spl::shared_ptr<diagnostics::graph> graph_;
     const int                           channel_index_;
     video_format_desc                   format_desc_;
 
-    std::mutex                                     consumers_mutex_;
+    mutable std::mutex                             consumers_mutex_;
     std::map<int, spl::shared_ptr<frame_consumer>> consumers_;
 
-    std::optional<time_point_t> time_;
+    const spl::shared_ptr<clock_source> default_clock_;
+    const std::shared_ptr<sync_group>   sync_group_;
+    const std::shared_ptr<clock_source> group_clock_;
+    std::shared_ptr<clock_source>       clock_;
+    std::atomic<bool>                   paced_{true};
 
   public:
-    impl(const spl::shared_ptr<diagnostics::graph>& graph, video_format_desc format_desc, int channel_index)
+    impl(const spl::shared_ptr<diagnostics::graph>& graph,
+         video_format_desc                          format_desc,
+         int                                        channel_index,
+         std::shared_ptr<sync_group>                sync_group,
+         std::shared_ptr<clock_source>              clock)
         : graph_(graph)
         , channel_index_(channel_index)
         , format_desc_(std::move(format_desc))
+        , default_clock_(clock ? spl::make_shared_ptr(std::move(clock)) : create_system_clock(format_desc_))
+        , sync_group_(std::move(sync_group))
+        , group_clock_(sync_group_ ? std::shared_ptr<clock_source>(sync_group_->clock(channel_index_)) : nullptr)
     {
     }
 
@@ -62,9 +81,15 @@ struct output::impl
     {
         remove(index);
 
-        consumer->initialize(format_desc_, channel_index_);
+        video_format_desc format_desc;
+        {
+            std::lock_guard<std::mutex> lock(consumers_mutex_);
+            format_desc = format_desc_;
+        }
+        consumer->initialize(format_desc, channel_index_);
 
         std::lock_guard<std::mutex> lock(consumers_mutex_);
+        consumer->paced(paced_);
         consumers_.emplace(index, std::move(consumer));
     }
 
@@ -79,6 +104,69 @@ struct output::impl
 
     bool remove(const spl::shared_ptr<frame_consumer>& consumer) { return remove(consumer->index()); }
 
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(consumers_mutex_);
+        consumers_.clear();
+    }
+
+    void paced(bool value)
+    {
+        if (paced_.exchange(value) == value) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(consumers_mutex_);
+        for (auto& p : consumers_) {
+            p.second->paced(value);
+        }
+    }
+
+    // The size the consumer gets its frames in, given as a scaled format only if it isn't the channel's.
+    std::optional<scaled_output_format> scaled_output_format_of(const frame_consumer& consumer) const
+    {
+        const auto format = consumer.preferred_output_format();
+        const auto size   = consumer.preferred_output_size();
+        if (format == output_format::texture || size.first <= 0 || size.second <= 0 ||
+            (size.first == format_desc_.width && size.second == format_desc_.height)) {
+            return {};
+        }
+        return scaled_output_format{format, size.first, size.second};
+    }
+
+    std::vector<output_format> output_formats() const
+    {
+        std::vector<output_format> formats;
+
+        std::lock_guard<std::mutex> lock(consumers_mutex_);
+        for (auto& p : consumers_) {
+            if (scaled_output_format_of(*p.second)) {
+                continue;
+            }
+            auto format = p.second->preferred_output_format();
+            if (std::find(formats.begin(), formats.end(), format) == formats.end()) {
+                formats.push_back(format);
+            }
+        }
+
+        return formats;
+    }
+
+    std::vector<scaled_output_format> scaled_output_formats() const
+    {
+        std::vector<scaled_output_format> formats;
+
+        std::lock_guard<std::mutex> lock(consumers_mutex_);
+        for (auto& p : consumers_) {
+            auto format = scaled_output_format_of(*p.second);
+            if (format && std::find(formats.begin(), formats.end(), *format) == formats.end()) {
+                formats.push_back(*format);
+            }
+        }
+
+        return formats;
+    }
+
     void operator()(const const_frame&             input_frame1,
                     const const_frame&             input_frame2,
                     const core::video_format_desc& format_desc)
@@ -87,31 +175,17 @@ struct output::impl
             return;
         }
 
-        auto time = std::move(time_);
-
         if (format_desc_ != format_desc) {
-            std::lock_guard<std::mutex> lock(consumers_mutex_);
-            for (auto it = consumers_.begin(); it != consumers_.end();) {
-                try {
-                    it->second->initialize(format_desc, it->first);
-                    ++it;
-                } catch (...) {
-                    CASPAR_LOG_CURRENT_EXCEPTION();
-                    it = consumers_.erase(it);
-                }
-            }
-            format_desc_ = format_desc;
-            time_        = {};
-            return;
+            switch_format(format_desc);
         }
 
         if (input_frame1.size() != format_desc_.size) {
-            CASPAR_LOG(warning) << print() << L" Invalid input frame size.";
+            CASPAR_LOG_RATE_LIMITED(warning, 5) << print() << L" Invalid input frame size.";
             return;
         }
 
         if (input_frame2 && input_frame2.size() != format_desc_.size) {
-            CASPAR_LOG(warning) << print() << L" Invalid input frame size.";
+            CASPAR_LOG_RATE_LIMITED(warning, 5) << print() << L" Invalid input frame size.";
             return;
         }
 
@@ -122,11 +196,21 @@ struct output::impl
         }
 
         auto do_send = [this, &consumers](core::video_field field, const core::const_frame& frame) {
-            std::map<int, std::future<bool>> futures;
+            boost::container::small_vector<std::pair<int, send_result>, 8> results;
 
             for (auto it = consumers.begin(); it != consumers.end();) {
+                // The frame was mixed before this consumer was added and has nothing it can use.
+                auto scaled = scaled_output_format_of(*it->second);
+                if (!(scaled && frame.image_data(*scaled)) &&
+                    !frame.image_data(it->second->preferred_output_format()) &&
+                    !frame.image_data(output_format::bgra)) {
+                    ++it;
+                    continue;
+                }
+
                 try {
-                    futures.emplace(it->first, it->second->send(field, frame));
+                    diagnostics::trace::span span("output.send", -1, it->first);
+                    results.emplace_back(it->first, it->second->send(field, frame));
                     ++it;
                 } catch (...) {
                     CASPAR_LOG_CURRENT_EXCEPTION();
@@ -138,8 +222,9 @@ struct output::impl
                 }
             }
 
-            for (auto& p : futures) {
+            for (auto& p : results) {
                 try {
+                    diagnostics::trace::span span("output.wait", -1, p.first);
                     if (!p.second.get()) {
                         consumers.erase(p.first);
 
@@ -164,25 +249,102 @@ struct output::impl
         }
 
         monitor::state state;
+        memory_usage   memory;
         for (auto& p : consumers) {
-            state["port"][p.first]             = p.second->state();
-            state["port"][p.first]["consumer"] = p.second->name();
+            auto usage                              = p.second->memory();
+            state["port"][p.first]                  = p.second->state();
+            state["port"][p.first]["consumer"]      = p.second->name();
+            state["port"][p.first]["memory/host"]   = usage.host;
+            state["port"][p.first]["memory/device"] = usage.device;
+            memory += usage;
+        }
+        if (clock_) {
+            state["clock"] = clock_->state();
+        }
+        state_  = std::move(state);
+        memory_ = memory;
+
+        auto clock = select_clock(consumers);
+        if (clock != clock_) {
+            if (clock) {
+                clock->reset(format_desc_);
+                CASPAR_LOG(debug) << print() << L" Paced by " << clock->print() << L".";
+            }
+            clock_ = clock;
+        }
+        if (clock_) {
+            clock_->wait();
         }
-        state_ = std::move(state);
+    }
 
-        const auto needs_sync = std::all_of(
-            consumers.begin(), consumers.end(), [](auto& p) { return !p.second->has_synchronization_clock(); });
+    // Initializes the consumers for the format of the frame, all at once rather than one after the other, since some
+    // take a while to reopen their device. Consumers are added and removed as usual meanwhile, those added get the new
+    // format. The frame is then sent like any other, only the clock starts over.
+    void switch_format(const core::video_format_desc& format_desc)
+    {
+        decltype(consumers_) consumers;
+        {
+            std::lock_guard<std::mutex> lock(consumers_mutex_);
+            consumers    = consumers_;
+            format_desc_ = format_desc;
+        }
+
+        std::vector<std::pair<int, std::future<void>>> results;
+        for (auto& p : consumers) {
+            results.emplace_back(p.first, std::async(std::launch::async, [&, consumer = p.second] {
+                                     consumer->initialize(format_desc, channel_index_);
+                                 }));
+        }
+
+        for (auto& p : results) {
+            try {
+                p.second.get();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
 
-        if (needs_sync) {
-            if (!time) {
-                time = std::chrono::high_resolution_clock::now();
-            } else {
-                std::this_thread::sleep_until(*time);
+                std::lock_guard<std::mutex> lock(consumers_mutex_);
+                auto                        it = consumers_.find(p.first);
+                if (it != consumers_.end() && it->second == consumers.at(p.first)) {
+                    consumers_.erase(it);
+                }
             }
-            time_ = *time + std::chrono::microseconds(static_cast<int>(1e6 / format_desc_.hz));
-        } else {
-            time_.reset();
         }
+
+        clock_.reset();
+    }
+
+    // The clock of the first consumer providing one. Without any, consumers with a synchronization clock pace the
+    // channel by blocking in send(), and only when there are none the default clock does it. In a sync group the
+    // consumer's clock is offered to the group instead, which ticks all its channels together.
+    std::shared_ptr<clock_source> select_clock(const decltype(consumers_)& consumers) const
+    {
+        if (!paced_) {
+            return nullptr;
+        }
+
+        std::shared_ptr<clock_source> device_clock;
+        for (auto& p : consumers) {
+            if ((device_clock = p.second->clock())) {
+                break;
+            }
+        }
+
+        if (sync_group_ && sync_group_->accepts(format_desc_)) {
+            sync_group_->offer(channel_index_, device_clock);
+            return group_clock_;
+        }
+        if (sync_group_) {
+            sync_group_->offer(channel_index_, nullptr);
+        }
+
+        if (device_clock) {
+            return device_clock;
+        }
+
+        const auto needs_sync = std::all_of(
+            consumers.begin(), consumers.end(), [](auto& p) { return !p.second->has_synchronization_clock(); });
+
+        return needs_sync ? std::shared_ptr<clock_source>(default_clock_) : nullptr;
     }
 
     std::wstring print() const { return L"output[" + std::to_wstring(channel_index_) + L"]"; }
@@ -190,8 +352,10 @@ struct output::impl
 
 output::output(const spl::shared_ptr<diagnostics::graph>& graph,
                const video_format_desc&                   format_desc,
-               int                                        channel_index)
-    : impl_(new impl(graph, format_desc, channel_index))
+               int                                        channel_index,
+               std::shared_ptr<sync_group>                sync_group,
+               std::shared_ptr<clock_source>              clock)
+    : impl_(new impl(graph, format_desc, channel_index, std::move(sync_group), std::move(clock)))
 {
 }
 output::~output() {}
@@ -203,5 +367,10 @@ void output::operator()(const const_frame& frame, const const_frame& frame2, con
 {
     return (*impl_)(frame, frame2, format_desc);
 }
-core::monitor::state output::state() const { return impl_->state_; }
+void                       output::clear() { impl_->clear(); }
+void                       output::paced(bool value) { impl_->paced(value); }
+std::vector<output_format> output::output_formats() const { return impl_->output_formats(); }
+std::vector<scaled_output_format> output::scaled_output_formats() const { return impl_->scaled_output_formats(); }
+core::monitor::state       output::state() const { return impl_->state_; }
+memory_usage               output::memory() const { return impl_->memory_; }
 }} // namespace caspar::core
@@ -27,9 +27,12 @@
 #include <common/forward.h>
 #include <common/memory.h>
 
+#include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
 #include <core/video_format.h>
 
 #include <memory>
+#include <vector>
 
 FORWARD2(caspar, diagnostics, class graph);
 
@@ -38,9 +41,13 @@ namespace caspar { namespace core {
 class output final
 {
   public:
+    // Channels in a sync group pace their output with the group's clock while they run at its frame rate. Without
+    // consumer clocks the output paces with clock, or the system clock when there is none.
     explicit output(const spl::shared_ptr<diagnostics::graph>& graph,
                     const video_format_desc&                   format_desc,
-                    int                                        channel_index);
+                    int                                        channel_index,
+                    std::shared_ptr<sync_group>                sync_group = nullptr,
+                    std::shared_ptr<clock_source>              clock      = nullptr);
 
     output(const output&)            = delete;
     output& operator=(const output&) = delete;
@@ -53,9 +60,24 @@ class output final
     void add(int index, const spl::shared_ptr<frame_consumer>& consumer);
     bool remove(const spl::shared_ptr<frame_consumer>& consumer);
     bool remove(int index);
+    void clear();
+
+    // Unpaced, frames are sent as fast as they are mixed and neither clocks nor sync groups are waited for. Offline
+    // channels render like this, consumers blocking in send() still hold them back to their own pace.
+    void paced(bool value);
+
+    // The distinct output formats the current consumers prefer, for the mixer to convert to.
+    std::vector<output_format> output_formats() const;
+
+    // The distinct formats and sizes the current consumers asking for another size than the channel's prefer, for the
+    // mixer to scale and convert to. Those consumers are left out of output_formats.
+    std::vector<scaled_output_format> scaled_output_formats() const;
 
     core::monitor::state state() const;
 
+    // Held by the consumers, as of the last frame sent.
+    memory_usage memory() const;
+
   private:
     struct impl;
     std::unique_ptr<impl> impl_;
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ptp_clock.h"
+
+#include "../video_format.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace caspar { namespace core {
+
+namespace {
+
+constexpr std::int64_t nanos_per_second = 1000000000;
+
+std::int64_t steady_nanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+#ifdef __linux__
+// The clock id of a dynamic clock opened as a file, as in linux/posix-timers.h which isn't exported to user space.
+clockid_t fd_to_clockid(int fd) { return static_cast<clockid_t>((static_cast<unsigned int>(~fd) << 3) | 3); }
+#endif
+
+class ptp_clock final : public clock_source
+{
+    // Sleeping is only accurate to the scheduler's tick, the last part of the wait spins.
+    static constexpr std::int64_t spin_nanos = 1000000;
+
+    const std::wstring device_;
+    video_format_desc  format_desc_;
+    std::int64_t       last_offset_ = 0;
+    bool               failed_      = false;
+
+#ifdef __linux__
+    int       fd_       = -1;
+    clockid_t clock_id_ = CLOCK_REALTIME;
+#endif
+
+    std::atomic<std::int64_t> frame_{-1};
+    std::atomic<std::int64_t> offset_{0};
+    std::atomic<double>       jitter_{0.0};
+    std::atomic<std::int64_t> skipped_{0};
+
+  public:
+    ptp_clock(std::wstring device, const video_format_desc& format_desc)
+        : device_(std::move(device))
+        , format_desc_(format_desc)
+    {
+#ifdef __linux__
+        if (device_ != L"realtime") {
+            fd_ = ::open(u8(device_).c_str(), O_RDONLY);
+            if (fd_ < 0) {
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Could not open PTP clock " + device_));
+            }
+            clock_id_ = fd_to_clockid(fd_);
+        }
+#else
+        if (device_ != L"realtime") {
+            CASPAR_THROW_EXCEPTION(not_supported()
+                                   << msg_info(L"PTP hardware clocks are only supported on Linux: " + device_));
+        }
+#endif
+    }
+
+    ~ptp_clock() override
+    {
+#ifdef __linux__
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+#endif
+    }
+
+    void wait() override
+    {
+        std::int64_t ptp    = 0;
+        std::int64_t steady = 0;
+        if (!sample(ptp, steady)) {
+            // Keep the nominal rate on the steady clock until the PTP clock can be read again.
+            if (!failed_) {
+                CASPAR_LOG(warning) << print() << L" Could not be read, pacing on the system clock.";
+                failed_ = true;
+            }
+            frame_ = -1;
+            std::this_thread::sleep_for(std::chrono::nanoseconds(frame_start(1)));
+            return;
+        }
+        if (failed_) {
+            CASPAR_LOG(info) << print() << L" Readable again.";
+            failed_ = false;
+        }
+
+        const auto frame = frame_at(ptp) + 1;
+        const auto due   = frame_start(frame);
+
+        // Sleep and spin on the steady clock, which is cheaper to read than a hardware clock, and check the PTP
+        // clock only once it should be due.
+        const auto steady_due = steady + (due - ptp);
+        if (steady_due - steady_nanos() > spin_nanos) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(steady_due - steady_nanos() - spin_nanos));
+        }
+        while (steady_nanos() < steady_due) {
+            std::this_thread::yield();
+        }
+        while (read(ptp) && ptp < due) {
+            std::this_thread::yield();
+        }
+
+        const auto last = frame_.exchange(frame);
+        if (last >= 0 && frame - last > 1) {
+            skipped_ += frame - last - 1;
+        }
+
+        // Jitter is smoothed over the changes of the offset between frames, as RTP does for arrival times.
+        const auto offset = ptp - due;
+        if (last >= 0) {
+            const auto jitter = jitter_.load();
+            jitter_           = jitter + (std::abs(static_cast<double>(offset - last_offset_)) - jitter) / 16.0;
+        }
+        offset_      = offset;
+        last_offset_ = offset;
+    }
+
+    void reset(const video_format_desc& format_desc) override
+    {
+        format_desc_ = format_desc;
+        frame_       = -1;
+    }
+
+    monitor::state state() const override
+    {
+        monitor::state state;
+        state["ptp/device"]  = u8(device_);
+        state["ptp/frame"]   = frame_.load();
+        state["ptp/offset"]  = offset_.load();
+        state["ptp/jitter"]  = static_cast<std::int64_t>(jitter_.load());
+        state["ptp/skipped"] = skipped_.load();
+        return state;
+    }
+
+    std::wstring print() const override { return L"ptp clock[" + device_ + L"]"; }
+
+  private:
+    bool read(std::int64_t& nanos) const
+    {
+#ifdef __linux__
+        timespec ts{};
+        if (::clock_gettime(clock_id_, &ts) != 0) {
+            return false;
+        }
+        nanos = static_cast<std::int64_t>(ts.tv_sec) * nanos_per_second + ts.tv_nsec;
+#else
+        nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::system_clock::now().time_since_epoch())
+                    .count();
+#endif
+        return true;
+    }
+
+    // The PTP time and the steady time halfway through reading it.
+    bool sample(std::int64_t& ptp, std::int64_t& steady) const
+    {
+        const auto before = steady_nanos();
+        if (!read(ptp)) {
+            return false;
+        }
+        steady = before + (steady_nanos() - before) / 2;
+        return true;
+    }
+
+    // The frame period a time falls in, counted from the epoch. The products are split to stay within 64 bits for
+    // any date and frame rate.
+    std::int64_t frame_at(std::int64_t nanos) const
+    {
+        const auto duration   = static_cast<std::int64_t>(format_desc_.duration);
+        const auto time_scale = static_cast<std::int64_t>(format_desc_.time_scale);
+        const auto seconds    = nanos / nanos_per_second * time_scale;
+        const auto rest       = seconds % duration * nanos_per_second + nanos % nanos_per_second * time_scale;
+        return seconds / duration + rest / (duration * nanos_per_second);
+    }
+
+    // The first nanosecond of a frame period, rounded up so that frame_at gives the frame back.
+    std::int64_t frame_start(std::int64_t frame) const
+    {
+        const auto ticks      = frame * format_desc_.duration;
+        const auto time_scale = static_cast<std::int64_t>(format_desc_.time_scale);
+        const auto rest       = ticks % time_scale * nanos_per_second;
+        return ticks / time_scale * nanos_per_second + (rest + time_scale - 1) / time_scale;
+    }
+};
+
+} // namespace
+
+spl::shared_ptr<clock_source> create_ptp_clock(const std::wstring& device, const video_format_desc& format_desc)
+{
+    return spl::make_shared<ptp_clock>(device, format_desc);
+}
+
+}} // namespace caspar::core
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "clock_source.h"
+
+#include <common/memory.h>
+
+#include <string>
+
+namespace caspar { namespace core {
+
+struct video_format_desc;
+
+// Paces at the nominal frame rate on PTP time, read from a PTP hardware clock such as /dev/ptp0 kept by ptp4l, or
+// with "realtime" from the system clock when phc2sys disciplines it. Frame n is due exactly n frame durations after
+// the epoch, so servers locked to the same grandmaster tick the same logical frame number in the same frame period
+// without anything passing between them. A channel that falls behind skips to the current period instead of being
+// a frame late from then on. Hardware clocks are only supported on Linux.
+spl::shared_ptr<clock_source> create_ptp_clock(const std::wstring& device, const video_format_desc& format_desc);
+
+}} // namespace caspar::core
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+#include "sync_group.h"
+
+#include "clock_source.h"
+
+#include <common/log.h>
+#include <common/os/thread.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace caspar { namespace core {
+
+struct sync_group::impl
+{
+    class member_clock;
+
+    const std::wstring                  name_;
+    const video_format_desc             format_desc_;
+    const spl::shared_ptr<clock_source> default_clock_;
+
+    mutable std::mutex                           mutex_;
+    std::condition_variable                      cond_;
+    std::uint64_t                                generation_ = 0;
+    std::map<int, std::shared_ptr<clock_source>> sources_;
+    std::shared_ptr<clock_source>                current_;
+
+    std::atomic<bool> abort_request_{false};
+    std::thread       thread_;
+
+    impl(std::wstring name, const video_format_desc& format_desc, std::shared_ptr<clock_source> clock)
+        : name_(std::move(name))
+        , format_desc_(format_desc)
+        , default_clock_(clock ? spl::make_shared_ptr(std::move(clock)) : create_system_clock(format_desc_))
+    {
+        thread_ = std::thread([this] {
+            set_thread_realtime_priority();
+            set_thread_name(L"sync-group-" + name_);
+            set_thread_affinity(thread_role::channel);
+
+            std::shared_ptr<clock_source> current;
+            while (!abort_request_) {
+                std::shared_ptr<clock_source> source;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    source = sources_.empty() ? default_clock_ : sources_.begin()->second;
+                }
+                if (source != current) {
+                    source->reset(format_desc_);
+                    CASPAR_LOG(info) << print() << L" Ticking from " << source->print() << L".";
+                    current = source;
+
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    current_ = source;
+                }
+
+                source->wait();
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    ++generation_;
+                }
+                cond_.notify_all();
+            }
+        });
+    }
+
+    ~impl()
+    {
+        abort_request_ = true;
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    void offer(int channel_index, std::shared_ptr<clock_source> source)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (source) {
+            sources_[channel_index] = std::move(source);
+        } else {
+            sources_.erase(channel_index);
+        }
+    }
+
+    std::uint64_t generation()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return generation_;
+    }
+
+    // Waits for the tick after seen. A channel that missed ticks joins the latest rather than catching up.
+    void wait(std::uint64_t& seen)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [&] { return generation_ > seen || abort_request_; });
+        seen = generation_;
+    }
+
+    monitor::state state() const
+    {
+        std::shared_ptr<clock_source> current;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            current = current_;
+        }
+        return current ? current->state() : monitor::state();
+    }
+
+    std::wstring print() const { return L"sync_group[" + name_ + L"]"; }
+};
+
+class sync_group::impl::member_clock final : public clock_source
+{
+    const spl::shared_ptr<impl> group_;
+    const int                   channel_index_;
+    std::uint64_t               seen_ = 0;
+
+  public:
+    member_clock(spl::shared_ptr<impl> group, int channel_index)
+        : group_(std::move(group))
+        , channel_index_(channel_index)
+    {
+    }
+
+    ~member_clock() override { group_->offer(channel_index_, nullptr); }
+
+    void wait() override { group_->wait(seen_); }
+
+    void reset(const video_format_desc&) override { seen_ = group_->generation(); }
+
+    monitor::state state() const override { return group_->state(); }
+
+    std::wstring print() const override { return group_->print(); }
+};
+
+sync_group::sync_group(std::wstring name, const video_format_desc& format_desc, std::shared_ptr<clock_source> clock)
+    : impl_(spl::make_shared<impl>(std::move(name), format_desc, std::move(clock)))
+{
+}
+
+sync_group::~sync_group() {}
+
+bool sync_group::accepts(const video_format_desc& format_desc) const
+{
+    const auto& group = impl_->format_desc_;
+    return static_cast<std::int64_t>(format_desc.duration) * group.time_scale ==
+               static_cast<std::int64_t>(group.duration) * format_desc.time_scale &&
+           format_desc.field_count == group.field_count;
+}
+
+spl::shared_ptr<clock_source> sync_group::clock(int channel_index)
+{
+    return spl::make_shared<impl::member_clock>(impl_, channel_index);
+}
+
+void sync_group::offer(int channel_index, std::shared_ptr<clock_source> source)
+{
+    impl_->offer(channel_index, std::move(source));
+}
+
+std::wstring sync_group::print() const { return impl_->print(); }
+
+}} // namespace caspar::core
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+
+#pragma once
+
+#include "../video_format.h"
+
+#include <common/memory.h>
+
+#include <string>
+
+namespace caspar { namespace core {
+
+class clock_source;
+
+// Channels of a sync group tick together from one clock thread, so their stages run in parallel and routes between
+// them stay frame aligned. The group ticks from the device clock of its lowest channel that offers one, else from
+// the given clock or, without one, the system clock.
+class sync_group final
+{
+  public:
+    sync_group(std::wstring name, const video_format_desc& format_desc, std::shared_ptr<clock_source> clock = nullptr);
+    ~sync_group();
+
+    sync_group(const sync_group&)            = delete;
+    sync_group& operator=(const sync_group&) = delete;
+
+    // Whether a channel running format_desc can tick with the group.
+    bool accepts(const video_format_desc& format_desc) const;
+
+    // The clock the output of a channel paces with while it is in the group.
+    spl::shared_ptr<clock_source> clock(int channel_index);
+
+    // The device clock the channel would pace with on its own, or null.
+    void offer(int channel_index, std::shared_ptr<clock_source> source);
+
+    std::wstring print() const;
+
+  private:
+    struct impl;
+    spl::shared_ptr<impl> impl_;
+};
+
+}} // namespace caspar::core
@@ -27,24 +27,24 @@
 
 #include "call_context.h"
 
+#include <common/env.h>
 #include <common/executor.h>
-#include <common/timer.h>
 
 #include <SFML/Graphics.hpp>
 
 #include <boost/circular_buffer.hpp>
-
-#include <tbb/concurrent_unordered_map.h>
+#include <boost/property_tree/ptree.hpp>
 
 #include <GL/glew.h>
 
-#include <atomic>
+#include <algorithm>
+#include <chrono>
 #include <list>
+#include <map>
 #include <memory>
 #include <mutex>
-#include <optional>
 #include <thread>
-#include <tuple>
+#include <vector>
 
 namespace caspar { namespace core { namespace diagnostics { namespace osd {
 
@@ -52,10 +52,15 @@ static const int PREFERRED_VERTICAL_GRAPHS = 8;
 static const int RENDERING_WIDTH           = 1024;
 static const int RENDERING_HEIGHT          = RENDERING_WIDTH / PREFERRED_VERTICAL_GRAPHS;
 
+static const unsigned int TEXT_SIZE   = 15;
+static const float        TEXT_MARGIN = 2.0f;
+static const float        TEXT_OFFSET = (TEXT_SIZE + TEXT_MARGIN * 2) * 2;
+
+// The samples kept of each line, one for each frame drawn.
+static const int LINE_RESOLUTION = 1024;
+
 sf::Color get_sfml_color(int color)
 {
-    auto c = caspar::diagnostics::color(color);
-
     return {static_cast<sf::Uint8>(color >> 24 & 255),
             static_cast<sf::Uint8>(color >> 16 & 255),
             static_cast<sf::Uint8>(color >> 8 & 255),
@@ -74,41 +79,319 @@ sf::Font& get_default_font()
     return DEFAULT_FONT;
 }
 
-struct drawable
-    : public sf::Drawable
-    , public sf::Transformable
+// What the window shows in a frame, in the order it is drawn. All the graphs are drawn with one call for each.
+struct batch
 {
-    virtual ~drawable() {}
-    virtual void render(sf::RenderTarget& target, sf::RenderStates states) = 0;
+    sf::VertexArray quads{sf::Triangles};
+    sf::VertexArray dashes{sf::Lines};
+    sf::VertexArray lines{sf::Lines};
+    sf::VertexArray glyphs{sf::Triangles}; // from the glyph texture of the font at TEXT_SIZE
 
-    void draw(sf::RenderTarget& target, sf::RenderStates states) const override
+    void clear()
     {
-        states.transform *= getTransform();
-        const_cast<drawable*>(this)->render(target, states);
+        quads.clear();
+        dashes.clear();
+        lines.clear();
+        glyphs.clear();
     }
 };
 
-class context : public drawable
+void append_rect(sf::VertexArray& target, float left, float top, float right, float bottom, sf::Color color)
+{
+    target.append(sf::Vertex(sf::Vector2f(left, top), color));
+    target.append(sf::Vertex(sf::Vector2f(right, top), color));
+    target.append(sf::Vertex(sf::Vector2f(left, bottom), color));
+    target.append(sf::Vertex(sf::Vector2f(left, bottom), color));
+    target.append(sf::Vertex(sf::Vector2f(right, top), color));
+    target.append(sf::Vertex(sf::Vector2f(right, bottom), color));
+}
+
+// Italic text in the font at TEXT_SIZE, laid out like sf::Text once and copied into the batch every frame.
+class text_layout
+{
+    std::vector<sf::Vertex> vertices_;
+
+  public:
+    static float width(const sf::String& str)
+    {
+        auto&      font     = get_default_font();
+        float      x        = 0.0f;
+        sf::Uint32 previous = 0;
+        for (auto c : str) {
+            x += font.getKerning(previous, c, TEXT_SIZE) + font.getGlyph(c, TEXT_SIZE, false).advance;
+            previous = c;
+        }
+        return x;
+    }
+
+    void clear() { vertices_.clear(); }
+
+    // Adds a line of text with its top left corner at x, y and returns its width.
+    float add(const sf::String& str, sf::Color color, float x, float y)
+    {
+        static const float italic_shear = 0.209f;
+
+        auto&       font     = get_default_font();
+        const float baseline = y + TEXT_SIZE;
+        const float start    = x;
+        sf::Uint32  previous = 0;
+
+        for (auto c : str) {
+            x += font.getKerning(previous, c, TEXT_SIZE);
+            previous = c;
+
+            const auto& glyph  = font.getGlyph(c, TEXT_SIZE, false);
+            const auto& bounds = glyph.bounds;
+            const auto& rect   = glyph.textureRect;
+
+            const float top    = bounds.top;
+            const float bottom = bounds.top + bounds.height;
+            const float left   = x + bounds.left;
+            const float right  = left + bounds.width;
+            const float u0     = static_cast<float>(rect.left);
+            const float v0     = static_cast<float>(rect.top);
+            const float u1     = static_cast<float>(rect.left + rect.width);
+            const float v1     = static_cast<float>(rect.top + rect.height);
+
+            const sf::Vertex upper_left({left - italic_shear * top, baseline + top}, color, {u0, v0});
+            const sf::Vertex upper_right({right - italic_shear * top, baseline + top}, color, {u1, v0});
+            const sf::Vertex lower_left({left - italic_shear * bottom, baseline + bottom}, color, {u0, v1});
+            const sf::Vertex lower_right({right - italic_shear * bottom, baseline + bottom}, color, {u1, v1});
+            vertices_.insert(vertices_.end(),
+                             {upper_left, upper_right, lower_left, lower_left, upper_right, lower_right});
+
+            x += glyph.advance;
+        }
+
+        return x - start;
+    }
+
+    void append(sf::VertexArray& target, float x, float y) const
+    {
+        for (auto vertex : vertices_) {
+            vertex.position.x += x;
+            vertex.position.y += y;
+            target.append(vertex);
+        }
+    }
+};
+
+class line
+{
+    struct point
+    {
+        float     y;
+        sf::Color color;
+        bool      tag;
+    };
+
+    // The newest at the right edge of the graph.
+    boost::circular_buffer<point> points_{LINE_RESOLUTION};
+
+    float value_ = -1.0f; // below -0.5 while the line only has tags
+    bool  tag_   = false;
+    int   color_ = static_cast<int>(0xFFFFFFFF);
+
+  public:
+    void set_value(float value) { value_ = value; }
+
+    void set_tag() { tag_ = true; }
+
+    void set_color(int color) { color_ = color; }
+
+    int get_color() const { return color_; }
+
+    // Adds the point of this frame.
+    void tick()
+    {
+        auto color = get_sfml_color(color_);
+        color.a    = 255 * 0.8;
+        points_.push_back({std::max(0.1f, std::min(0.9f, (1.0f - value_) * 0.8f + 0.1f)), color, tag_});
+        tag_ = false;
+    }
+
+    // The line, or the tags of a line without values, drawn into the rectangle at left, top.
+    void append(batch& batch, float left, float top, float width, float height) const
+    {
+        if (points_.empty()) {
+            return;
+        }
+
+        const float dx    = width / static_cast<float>(LINE_RESOLUTION - 1);
+        const float first = left + width - dx * static_cast<float>(points_.size() - 1);
+
+        if (value_ > -0.5f) {
+            for (size_t n = 1; n < points_.size(); ++n) {
+                const auto& from = points_[n - 1];
+                const auto& to   = points_[n];
+                batch.lines.append(sf::Vertex(sf::Vector2f(first + dx * (n - 1), top + from.y * height), from.color));
+                batch.lines.append(sf::Vertex(sf::Vector2f(first + dx * n, top + to.y * height), to.color));
+            }
+        } else {
+            for (size_t n = 0; n < points_.size(); ++n) {
+                if (points_[n].tag) {
+                    const float x = first + dx * (static_cast<float>(n) - 1.0f);
+                    batch.dashes.append(sf::Vertex(sf::Vector2f(x, top), points_[n].color));
+                    batch.dashes.append(sf::Vertex(sf::Vector2f(x, top + height), points_[n].color));
+                }
+            }
+        }
+    }
+};
+
+struct graph
+    : public caspar::diagnostics::spi::graph_sink
+    , public std::enable_shared_from_this<graph>
+{
+    call_context context_ = call_context::for_thread();
+
+    // Only touched by the osd thread, which drains the recorded samples into it every frame.
+    std::map<std::string, line> lines_;
+    std::wstring                shown_text_;
+    text_layout                 layout_;
+    bool                        layout_dirty_ = true;
+
+    std::mutex   mutex_;
+    std::wstring text_;
+    bool         auto_reset_ = false;
+
+    graph() {}
+
+    void activate() override;
+
+    void set_text(const std::wstring& value) override
+    {
+        auto                        temp = value;
+        std::lock_guard<std::mutex> lock(mutex_);
+        text_ = std::move(temp);
+    }
+
+    void auto_reset() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto_reset_ = true;
+    }
+
+    // Takes the samples recorded since the last frame and adds the point of this one to every line.
+    void tick()
+    {
+        drain([this](const caspar::diagnostics::spi::sample& sample) {
+            auto it = lines_.find(*sample.name);
+            if (it == lines_.end()) {
+                it            = lines_.emplace(*sample.name, line()).first;
+                layout_dirty_ = true;
+            }
+            switch (sample.type) {
+                case caspar::diagnostics::spi::sample_type::value:
+                    it->second.set_value(static_cast<float>(sample.value));
+                    break;
+                case caspar::diagnostics::spi::sample_type::tag:
+                    it->second.set_tag();
+                    break;
+                case caspar::diagnostics::spi::sample_type::color:
+                    layout_dirty_ |= it->second.get_color() != sample.color;
+                    it->second.set_color(sample.color);
+                    break;
+            }
+        });
+
+        bool auto_reset;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (text_ != shown_text_) {
+                shown_text_   = text_;
+                layout_dirty_ = true;
+            }
+            auto_reset = auto_reset_;
+        }
+
+        for (auto& line : lines_) {
+            line.second.tick();
+            if (auto_reset)
+                line.second.set_value(0.0f);
+        }
+
+        if (layout_dirty_) {
+            layout();
+        }
+    }
+
+    void append(batch& batch, float top) const
+    {
+        static const sf::Color background_color(255, 255, 255, 51);
+        static const sf::Color guide_color(255, 255, 255, 127);
+
+        append_rect(batch.quads, 0.0f, top + 1.0f, RENDERING_WIDTH, top + RENDERING_HEIGHT - 1.0f, background_color);
+
+        const float lines_top    = top + TEXT_OFFSET;
+        const float lines_height = RENDERING_HEIGHT - TEXT_OFFSET;
+        for (auto y : {0.5f, 0.9f, 0.1f}) {
+            batch.dashes.append(sf::Vertex(sf::Vector2f(0.0f, lines_top + y * lines_height), guide_color));
+            batch.dashes.append(sf::Vertex(sf::Vector2f(RENDERING_WIDTH, lines_top + y * lines_height), guide_color));
+        }
+
+        for (auto& line : lines_) {
+            line.second.append(batch, 0.0f, lines_top, RENDERING_WIDTH, lines_height);
+        }
+
+        layout_.append(batch.glyphs, 0.0f, top);
+    }
+
+  private:
+    // The text, the channel and layer it was created on and the names of the lines in their colors.
+    void layout()
+    {
+        layout_.clear();
+        layout_.add(shown_text_, sf::Color::White, TEXT_MARGIN, TEXT_MARGIN);
+
+        if (context_.video_channel != -1) {
+            auto ctx_str = std::to_string(context_.video_channel);
+
+            if (context_.layer != -1)
+                ctx_str += "-" + std::to_string(context_.layer);
+
+            const float x = RENDERING_WIDTH - TEXT_MARGIN - 5 - text_layout::width(ctx_str);
+            layout_.add(ctx_str, sf::Color::White, x, TEXT_MARGIN);
+        }
+
+        float x_offset = TEXT_MARGIN;
+        for (auto& line : lines_) {
+            x_offset += layout_.add(line.first,
+                                    get_sfml_color(line.second.get_color()),
+                                    x_offset,
+                                    TEXT_MARGIN + TEXT_OFFSET / 2);
+            x_offset += TEXT_MARGIN * 2;
+        }
+
+        layout_dirty_ = false;
+    }
+};
+
+class context
 {
     std::unique_ptr<sf::RenderWindow> window_;
     sf::View                          view_;
 
-    std::list<std::weak_ptr<drawable>> drawables_;
-    caspar::timer                      display_time_;
-    bool                               calculate_view_  = true;
-    int                                scroll_position_ = 0;
-    bool                               dragging_        = false;
-    int                                last_mouse_y_    = 0;
+    std::list<std::weak_ptr<graph>> graphs_;
+    batch                           batch_;
+    bool                            calculate_view_  = true;
+    int                             scroll_position_ = 0;
+    bool                            dragging_        = false;
+    int                             last_mouse_y_    = 0;
+
+    // The window is drawn at a rate of its own, whatever the rates of the channels, without waiting for vsync.
+    std::chrono::steady_clock::duration   frame_period_ = std::chrono::milliseconds(40);
+    std::chrono::steady_clock::time_point next_frame_;
 
     executor executor_{L"diagnostics"};
 
   public:
-    static void register_drawable(const std::shared_ptr<drawable>& drawable)
+    static void register_graph(const std::shared_ptr<graph>& graph)
     {
-        if (!drawable)
+        if (!graph)
             return;
 
-        get_instance()->executor_.begin_invoke([=] { get_instance()->do_register_drawable(drawable); });
+        get_instance()->executor_.begin_invoke([=] { get_instance()->do_register_graph(graph); });
     }
 
     static void show(bool value)
@@ -129,13 +412,18 @@ class context : public drawable
                     new sf::RenderWindow(sf::VideoMode(RENDERING_WIDTH, RENDERING_WIDTH), "CasparCG Diagnostics"));
                 window_->setPosition(sf::Vector2i(0, 0));
                 window_->setActive();
-                window_->setVerticalSyncEnabled(true);
+                window_->setVerticalSyncEnabled(false);
                 calculate_view_ = true;
                 glEnable(GL_BLEND);
                 glEnable(GL_LINE_SMOOTH);
                 glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
                 glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+                auto fps      = std::clamp(env::properties().get(L"configuration.diagnostics.osd-fps", 25), 1, 60);
+                frame_period_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(1.0 / fps));
+                next_frame_ = std::chrono::steady_clock::now();
+
                 tick();
             }
         } else
@@ -183,9 +471,10 @@ class context : public drawable
 
         window_->clear();
 
+        int window_height = static_cast<int>(window_->getSize().y);
+
         if (calculate_view_) {
-            int content_height      = static_cast<int>(RENDERING_HEIGHT * drawables_.size());
-            int window_height       = static_cast<int>(window_->getSize().y);
+            int content_height      = static_cast<int>(RENDERING_HEIGHT * graphs_.size());
             int not_visible         = std::max(0, content_height - window_height);
             int min_scroll_position = -not_visible;
             int max_scroll_position = 0;
@@ -200,43 +489,65 @@ class context : public drawable
         }
 
         CASPAR_LOG(trace) << "osd_graph::tick()";
-        window_->draw(*this);
+        render(-scroll_position_, window_height - scroll_position_);
         window_->display();
 
-        display_time_.restart();
         if (executor_.is_running()) {
             executor_.begin_invoke([this] { tick(); });
         }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(40));
+        // Late frames aren't made up for, the next one is then a whole period away.
+        next_frame_ = std::max(next_frame_ + frame_period_, std::chrono::steady_clock::now());
+        std::this_thread::sleep_until(next_frame_);
     }
 
-    void render(sf::RenderTarget& target, sf::RenderStates states) override
+    // Every graph takes its samples, only those between top and bottom of the view are drawn.
+    void render(int top, int bottom)
     {
+        batch_.clear();
+
         int n = 0;
+        for (auto it = graphs_.begin(); it != graphs_.end(); ++n) {
+            auto graph = it->lock();
+            if (!graph) {
+                it = graphs_.erase(it);
+                continue;
+            }
 
-        for (auto it = drawables_.begin(); it != drawables_.end(); ++n) {
-            auto drawable = it->lock();
-            if (drawable) {
-                float target_y = n * RENDERING_HEIGHT;
-                drawable->setPosition(0.0f, target_y);
-                target.draw(*drawable, states);
-                ++it;
-            } else
-                it = drawables_.erase(it);
+            graph->tick();
+
+            const auto graph_top = n * RENDERING_HEIGHT;
+            if (graph_top < bottom && graph_top + RENDERING_HEIGHT > top) {
+                graph->append(batch_, static_cast<float>(graph_top));
+            }
+            ++it;
         }
+
+        window_->draw(batch_.quads);
+
+        glEnable(GL_LINE_STIPPLE);
+        glLineStipple(3, 0xAAAA);
+        window_->draw(batch_.dashes);
+        glDisable(GL_LINE_STIPPLE);
+
+        window_->draw(batch_.lines);
+
+        sf::RenderStates text_states;
+        text_states.texture = &get_default_font().getTexture(TEXT_SIZE);
+        window_->draw(batch_.glyphs, text_states);
     }
 
-    void do_register_drawable(const std::shared_ptr<drawable>& drawable)
+    void do_register_graph(const std::shared_ptr<graph>& graph)
     {
-        drawables_.push_back(drawable);
-        auto it = drawables_.begin();
-        while (it != drawables_.end()) {
+        graphs_.push_back(graph);
+        auto it = graphs_.begin();
+        while (it != graphs_.end()) {
             if (it->lock())
                 ++it;
             else
-                it = drawables_.erase(it);
+                it = graphs_.erase(it);
         }
+        calculate_view_ = true;
     }
 
     static std::unique_ptr<context>& get_instance()
@@ -246,248 +557,7 @@ class context : public drawable
     }
 };
 
-class line : public drawable
-{
-    size_t                                                 res_{1024};
-    boost::circular_buffer<sf::Vertex>                     line_data_{res_};
-    boost::circular_buffer<std::optional<sf::VertexArray>> line_tags_{res_};
-
-    std::atomic<float> tick_data_;
-    std::atomic<bool>  tick_tag_;
-    std::atomic<int>   color_;
-
-    double x_delta_ = 1.0 / (static_cast<double>(res_) - 1.0);
-
-  public:
-    line()
-        : tick_data_(-1.0f)
-        , tick_tag_(false)
-        , color_(0xFFFFFFFF)
-    {
-    }
-
-    line(const line& other)
-        : res_(other.res_)
-        , line_data_(other.line_data_)
-        , line_tags_(other.line_tags_)
-        , tick_data_(other.tick_data_.load())
-        , tick_tag_(other.tick_tag_.load())
-        , color_(other.color_.load())
-        , x_delta_(other.x_delta_)
-    {
-    }
-
-    void set_value(float value) { tick_data_ = value; }
-
-    void set_tag() { tick_tag_ = true; }
-
-    void set_color(int color) { color_ = color; }
-
-    int get_color() { return color_; }
-
-    void render(sf::RenderTarget& target, sf::RenderStates states) override
-    {
-        /*states.transform.translate(x_pos_, 0.f);
-
-        if (line_data_.size() == res_)
-            x_pos_ = -get_insertion_xcoord() + 1.0 - x_delta_; // Otherwise the graph will drift because of floating
-        point precision else x_pos_ -= x_delta_;*/
-
-        for (auto& vertex : line_data_)
-            vertex.position.x -= x_delta_;
-
-        for (auto& tag : line_tags_) {
-            if (tag) {
-                (*tag)[0].position.x -= x_delta_;
-                (*tag)[1].position.x -= x_delta_;
-            }
-        }
-
-        auto color = get_sfml_color(color_);
-        color.a    = 255 * 0.8;
-        line_data_.push_back(sf::Vertex(
-            sf::Vector2f(get_insertion_xcoord(), std::max(0.1f, std::min(0.9f, (1.0f - tick_data_) * 0.8f + 0.1f))),
-            color));
-
-        if (tick_tag_) {
-            sf::VertexArray vertical_dash(sf::LinesStrip);
-            vertical_dash.append(sf::Vertex(sf::Vector2f(get_insertion_xcoord() - x_delta_, 0.f), color));
-            vertical_dash.append(sf::Vertex(sf::Vector2f(get_insertion_xcoord() - x_delta_, 1.f), color));
-            line_tags_.push_back(vertical_dash);
-        } else
-            line_tags_.push_back({});
-
-        tick_tag_ = false;
-
-        if (tick_data_ > -0.5) {
-            auto array_one = line_data_.array_one();
-            auto array_two = line_data_.array_two();
-            // since boost::circular_buffer guarantees two contigous views of the buffer we can provide raw access to
-            // SFML, which can use glDrawArrays.
-            target.draw(array_one.first, static_cast<unsigned int>(array_one.second), sf::LinesStrip, states);
-            target.draw(array_two.first, static_cast<unsigned int>(array_two.second), sf::LinesStrip, states);
-
-            if (array_one.second > 0 && array_two.second > 0) {
-                // Connect the gap between the arrays
-                sf::VertexArray connecting_line(sf::LinesStrip);
-                connecting_line.append(*(array_one.first + array_one.second - 1));
-                connecting_line.append(*array_two.first);
-                target.draw(connecting_line, states);
-            }
-        } else {
-            glEnable(GL_LINE_STIPPLE);
-            glLineStipple(3, 0xAAAA);
-
-            for (size_t n = 0; n < line_tags_.size(); ++n) {
-                if (line_tags_[n]) {
-                    target.draw(*line_tags_[n], states);
-                }
-            }
-
-            glDisable(GL_LINE_STIPPLE);
-        }
-    }
-
-  private:
-    double get_insertion_xcoord() const { return line_data_.empty() ? 1.0 : line_data_.back().position.x + x_delta_; }
-};
-
-struct graph
-    : public drawable
-    , public caspar::diagnostics::spi::graph_sink
-    , public std::enable_shared_from_this<graph>
-{
-    call_context                                     context_ = call_context::for_thread();
-    tbb::concurrent_unordered_map<std::string, line> lines_;
-
-    std::mutex   mutex_;
-    std::wstring text_;
-    bool         auto_reset_ = false;
-
-    graph() {}
-
-    void activate() override { context::register_drawable(shared_from_this()); }
-
-    void set_text(const std::wstring& value) override
-    {
-        auto                        temp = value;
-        std::lock_guard<std::mutex> lock(mutex_);
-        text_ = std::move(temp);
-    }
-
-    void set_value(const std::string& name, double value) override
-    {
-        lines_[name].set_value(static_cast<float>(value));
-    }
-
-    void set_tag(caspar::diagnostics::tag_severity /*severity*/, const std::string& name) override
-    {
-        lines_[name].set_tag();
-    }
-
-    void set_color(const std::string& name, int color) override { lines_[name].set_color(color); }
-
-    void auto_reset() override
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        auto_reset_ = true;
-    }
-
-  private:
-    void render(sf::RenderTarget& target, sf::RenderStates states) override
-    {
-        const size_t text_size   = 15;
-        const size_t text_margin = 2;
-        const size_t text_offset = (text_size + text_margin * 2) * 2;
-
-        std::wstring text_str;
-        bool         auto_reset;
-
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            text_str   = text_;
-            auto_reset = auto_reset_;
-        }
-
-        sf::Text text(text_str.c_str(), get_default_font(), text_size);
-        text.setStyle(sf::Text::Italic);
-        text.move(text_margin, text_margin);
-
-        target.draw(text, states);
-
-        if (context_.video_channel != -1) {
-            auto ctx_str = std::to_string(context_.video_channel);
-
-            if (context_.layer != -1)
-                ctx_str += "-" + std::to_string(context_.layer);
-
-            sf::Text context_text(ctx_str, get_default_font(), text_size);
-            context_text.setStyle(sf::Text::Italic);
-            context_text.move(RENDERING_WIDTH - text_margin - 5 - context_text.getLocalBounds().width, text_margin);
-
-            target.draw(context_text, states);
-        }
-
-        float x_offset = text_margin;
-
-        for (auto it = lines_.begin(); it != lines_.end(); ++it) {
-            sf::Text line_text(it->first, get_default_font(), text_size);
-            line_text.setPosition(x_offset, text_margin + text_offset / 2);
-            line_text.setColor(get_sfml_color(it->second.get_color()));
-            target.draw(line_text, states);
-            x_offset += line_text.getLocalBounds().width + text_margin * 2;
-        }
-
-        static const auto rect = []() {
-            sf::RectangleShape r(sf::Vector2f(RENDERING_WIDTH, RENDERING_HEIGHT - 2));
-            r.setFillColor(sf::Color(255, 255, 255, 51));
-            r.setOutlineThickness(0.00f);
-            r.move(0, 1);
-            return r;
-        }();
-        target.draw(rect, states);
-
-        states.transform.translate(0, text_offset)
-            .scale(RENDERING_WIDTH,
-                   RENDERING_HEIGHT *
-                       (static_cast<float>(RENDERING_HEIGHT - text_offset) / static_cast<float>(RENDERING_HEIGHT)));
-
-        static const sf::Color       guide_color(255, 255, 255, 127);
-        static const sf::VertexArray middle_guide = []() {
-            sf::VertexArray result(sf::LinesStrip);
-            result.append(sf::Vertex(sf::Vector2f(0.0f, 0.5f), guide_color));
-            result.append(sf::Vertex(sf::Vector2f(1.0f, 0.5f), guide_color));
-            return result;
-        }();
-        static const sf::VertexArray bottom_guide = []() {
-            sf::VertexArray result(sf::LinesStrip);
-            result.append(sf::Vertex(sf::Vector2f(0.0f, 0.9f), guide_color));
-            result.append(sf::Vertex(sf::Vector2f(1.0f, 0.9f), guide_color));
-            return result;
-        }();
-        static const sf::VertexArray top_guide = []() {
-            sf::VertexArray result(sf::LinesStrip);
-            result.append(sf::Vertex(sf::Vector2f(0.0f, 0.1f), guide_color));
-            result.append(sf::Vertex(sf::Vector2f(1.0f, 0.1f), guide_color));
-            return result;
-        }();
-
-        glEnable(GL_LINE_STIPPLE);
-        glLineStipple(3, 0xAAAA);
-
-        target.draw(middle_guide, states);
-        target.draw(bottom_guide, states);
-        target.draw(top_guide, states);
-
-        glDisable(GL_LINE_STIPPLE);
-
-        for (auto it = lines_.begin(); it != lines_.end(); ++it) {
-            target.draw(it->second, states);
-            if (auto_reset)
-                it->second.set_value(0.0f);
-        }
-    }
-};
+void graph::activate() { context::register_graph(shared_from_this()); }
 
 void register_sink()
 {
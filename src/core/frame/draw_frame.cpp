@@ -24,11 +24,102 @@
 #include "frame_transform.h"
 #include "frame_visitor.h"
 
+#include <boost/container/small_vector.hpp>
 #include <boost/variant.hpp>
 
+#include <cstddef>
+#include <new>
+#include <set>
+
 namespace caspar { namespace core {
 
-using frame_t = boost::variant<boost::blank, const_frame, std::vector<draw_frame>>;
+// push, over and mask nodes have one or two children, keep them inline.
+using frames_t = boost::container::small_vector<draw_frame, 2>;
+using frame_t  = boost::variant<boost::blank, const_frame, frames_t>;
+
+namespace {
+
+// Every layer builds several draw_frame nodes per tick which are released again once the mixer has visited them, so
+// node storage is recycled through a per thread free list instead of going to the heap each time. Nodes are often
+// released on another thread than the one that built them, each thread keeps at most max_free_ nodes.
+template <std::size_t Size>
+class node_pool
+{
+    struct node
+    {
+        node* next;
+    };
+
+    static constexpr std::size_t max_free_ = 4096;
+
+    node*       free_  = nullptr;
+    std::size_t count_ = 0;
+
+    // Trivially destructible, so it can still be read while static draw_frames are destroyed after the pool.
+    static thread_local bool destroyed_;
+
+  public:
+    ~node_pool()
+    {
+        destroyed_ = true;
+        while (free_ != nullptr) {
+            auto next = free_->next;
+            ::operator delete(free_);
+            free_ = next;
+        }
+    }
+
+    static node_pool* local()
+    {
+        if (destroyed_)
+            return nullptr;
+        thread_local node_pool pool;
+        return &pool;
+    }
+
+    static void* allocate()
+    {
+        auto pool = local();
+        return pool ? pool->pop() : ::operator new(Size);
+    }
+
+    static void deallocate(void* p) noexcept
+    {
+        auto pool = local();
+        if (pool)
+            pool->push(p);
+        else
+            ::operator delete(p);
+    }
+
+  private:
+    void* pop()
+    {
+        if (free_ == nullptr)
+            return ::operator new(Size);
+        auto result = free_;
+        free_       = free_->next;
+        --count_;
+        return result;
+    }
+
+    void push(void* p) noexcept
+    {
+        if (count_ >= max_free_) {
+            ::operator delete(p);
+            return;
+        }
+        auto n  = static_cast<node*>(p);
+        n->next = free_;
+        free_   = n;
+        ++count_;
+    }
+};
+
+template <std::size_t Size>
+thread_local bool node_pool<Size>::destroyed_ = false;
+
+} // namespace
 
 struct draw_frame::impl
 {
@@ -43,6 +134,20 @@ struct draw_frame::impl
     {
     }
 
+    static void* operator new(std::size_t size)
+    {
+        static_assert(sizeof(impl) >= sizeof(void*), "");
+        return size == sizeof(impl) ? node_pool<sizeof(impl)>::allocate() : ::operator new(size);
+    }
+
+    static void operator delete(void* p, std::size_t size) noexcept
+    {
+        if (size == sizeof(impl))
+            node_pool<sizeof(impl)>::deallocate(p);
+        else
+            ::operator delete(p);
+    }
+
     void accept(frame_visitor& visitor) const
     {
         struct accept_visitor : public boost::static_visitor<void>
@@ -58,7 +163,7 @@ struct draw_frame::impl
 
             void operator()(const const_frame& frame) const { visitor.visit(frame); }
 
-            void operator()(const std::vector<draw_frame>& frames) const
+            void operator()(const frames_t& frames) const
             {
                 for (auto& frame : frames) {
                     frame.accept(visitor);
@@ -78,10 +183,8 @@ draw_frame::draw_frame()
 {
 }
 draw_frame::draw_frame(const draw_frame& other)
-    : impl_(new impl())
+    : impl_(new impl(*other.impl_))
 {
-    impl_->frame_     = other.impl_->frame_;
-    impl_->transform_ = other.impl_->transform_;
 }
 
 draw_frame::draw_frame(draw_frame&& other)
@@ -97,7 +200,7 @@ draw_frame::draw_frame(mutable_frame&& frame)
 {
 }
 draw_frame::draw_frame(std::vector<draw_frame> frames)
-    : impl_(new impl(std::move(frames)))
+    : impl_(new impl(frames_t(std::make_move_iterator(frames.begin()), std::make_move_iterator(frames.end()))))
 {
 }
 draw_frame::~draw_frame() {}
@@ -119,10 +222,12 @@ draw_frame draw_frame::over(draw_frame frame1, draw_frame frame2)
         return draw_frame{};
     }
 
-    std::vector<draw_frame> frames;
+    frames_t frames;
     frames.push_back(std::move(frame1));
     frames.push_back(std::move(frame2));
-    return draw_frame(std::move(frames));
+    draw_frame result;
+    result.impl_->frame_ = std::move(frames);
+    return result;
 }
 
 draw_frame draw_frame::mask(draw_frame fill, draw_frame key)
@@ -131,26 +236,28 @@ draw_frame draw_frame::mask(draw_frame fill, draw_frame key)
         return draw_frame{};
     }
 
-    std::vector<draw_frame> frames;
+    frames_t frames;
     key.transform().image_transform.is_key = true;
     frames.push_back(std::move(key));
     frames.push_back(std::move(fill));
-    return draw_frame(std::move(frames));
+    draw_frame result;
+    result.impl_->frame_ = std::move(frames);
+    return result;
 }
 
 draw_frame draw_frame::push(draw_frame frame)
 {
-    std::vector<draw_frame> frames;
+    frames_t frames;
     frames.push_back(std::move(frame));
-    return draw_frame(std::move(frames));
+    draw_frame result;
+    result.impl_->frame_ = std::move(frames);
+    return result;
 }
 
 draw_frame draw_frame::push(draw_frame frame, const frame_transform& transform)
 {
-    std::vector<draw_frame> frames;
-    frames.push_back(std::move(frame));
-    auto result        = draw_frame(std::move(frames));
-    result.transform() = std::move(transform);
+    auto result        = push(std::move(frame));
+    result.transform() = transform;
     return result;
 }
 
@@ -167,8 +274,42 @@ draw_frame draw_frame::still(draw_frame frame)
     return frame;
 }
 
-draw_frame draw_frame::empty() { return draw_frame(std::vector<draw_frame>{}); }
+draw_frame draw_frame::empty()
+{
+    draw_frame result;
+    result.impl_->frame_ = frames_t{};
+    return result;
+}
 
 draw_frame::operator bool() const { return impl_ && impl_->frame_.which() != 0; }
 
+namespace {
+
+class memory_visitor final : public frame_visitor
+{
+    std::set<const_frame> frames_;
+
+  public:
+    memory_usage usage;
+
+    void push(const frame_transform&) override {}
+    void pop() override {}
+
+    void visit(const const_frame& frame) override
+    {
+        if (frames_.insert(frame).second) {
+            usage += frame_memory(frame);
+        }
+    }
+};
+
+} // namespace
+
+memory_usage frame_memory(const draw_frame& frame)
+{
+    memory_visitor visitor;
+    frame.accept(visitor);
+    return visitor.usage;
+}
+
 }} // namespace caspar::core
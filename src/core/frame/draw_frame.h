@@ -64,4 +64,7 @@ class draw_frame final
     std::unique_ptr<impl> impl_;
 };
 
+// The memory of the frames drawn, each counted once.
+struct memory_usage frame_memory(const draw_frame& frame);
+
 }} // namespace caspar::core
@@ -26,29 +26,149 @@
 #include <common/array.h>
 #include <common/except.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <functional>
+#include <limits>
+#include <mutex>
 #include <vector>
 
 namespace caspar { namespace core {
 
+using steady_time_point = std::chrono::steady_clock::time_point;
+
+// Blocks of one size kept once freed for the next frame, as frames are made and dropped by every producer and mixer
+// each tick. Never destroyed, frames may outlive static destruction.
+template <std::size_t Size>
+class block_pool
+{
+    std::mutex         mutex_;
+    std::vector<void*> free_;
+
+    // More than the frames that are alive at a time with a few channels, the rest go back to the heap.
+    static constexpr std::size_t max_free = 1024;
+
+  public:
+    static block_pool& instance()
+    {
+        static auto pool = new block_pool();
+        return *pool;
+    }
+
+    void* allocate()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!free_.empty()) {
+                auto block = free_.back();
+                free_.pop_back();
+                return block;
+            }
+        }
+        return ::operator new(Size);
+    }
+
+    void deallocate(void* block)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (free_.size() < max_free) {
+                free_.push_back(block);
+                return;
+            }
+        }
+        ::operator delete(block);
+    }
+};
+
+// Allocates the impls of const frames, together with their shared_ptr control blocks, from a block_pool.
+template <typename T>
+struct pool_allocator
+{
+    using value_type = T;
+
+    pool_allocator() = default;
+
+    template <typename U>
+    pool_allocator(const pool_allocator<U>&)
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        if (n != 1) {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T*>(block_pool<sizeof(T)>::instance().allocate());
+    }
+
+    void deallocate(T* ptr, std::size_t n)
+    {
+        if (n != 1) {
+            ::operator delete(ptr);
+        } else {
+            block_pool<sizeof(T)>::instance().deallocate(ptr);
+        }
+    }
+
+    template <typename U>
+    bool operator==(const pool_allocator<U>&) const
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const pool_allocator<U>&) const
+    {
+        return false;
+    }
+};
+
+static array<const float> to_float(const array<const std::int32_t>& samples)
+{
+    auto result = std::vector<float>(samples.size());
+    for (std::size_t n = 0; n < samples.size(); ++n) {
+        result[n] = static_cast<float>(samples.data()[n] / 2147483648.0);
+    }
+    return array<float>(std::move(result));
+}
+
+static array<const std::int32_t> to_s32(const array<const float>& samples)
+{
+    const auto min = static_cast<double>(std::numeric_limits<std::int32_t>::min());
+    const auto max = static_cast<double>(std::numeric_limits<std::int32_t>::max());
+
+    auto result = std::vector<std::int32_t>(samples.size());
+    for (std::size_t n = 0; n < samples.size(); ++n) {
+        result[n] = static_cast<std::int32_t>(std::min(std::max(samples.data()[n] * 2147483648.0, min), max));
+    }
+    return array<std::int32_t>(std::move(result));
+}
+
 struct mutable_frame::impl
 {
-    std::vector<array<std::uint8_t>> image_data_;
-    array<std::int32_t>              audio_data_;
-    const core::pixel_format_desc    desc_;
-    const void*                      tag_;
-    frame_geometry                   geometry_ = frame_geometry::get_default();
-    mutable_frame::commit_t          commit_;
+    image_data_t                  image_data_;
+    array<std::int32_t>           audio_data_;
+    array<float>                  audio_data_float_;
+    const core::pixel_format_desc desc_;
+    const void*                   tag_;
+    frame_geometry                geometry_ = frame_geometry::get_default();
+    mutable_frame::commit_t       commit_;
+    steady_time_point             capture_time_;
+    int                           audio_channels_ = 0;
 
     impl(const impl&)            = delete;
     impl& operator=(const impl&) = delete;
 
-    impl(const void*                      tag,
-         std::vector<array<std::uint8_t>> image_data,
-         array<std::int32_t>              audio_data,
-         const core::pixel_format_desc&   desc,
-         commit_t                         commit)
+    static void* operator new(std::size_t size) { return block_pool<sizeof(impl)>::instance().allocate(); }
+    static void  operator delete(void* block) { block_pool<sizeof(impl)>::instance().deallocate(block); }
+
+    impl(const void*                    tag,
+         image_data_t                   image_data,
+         array<std::int32_t>            audio_data,
+         const core::pixel_format_desc& desc,
+         commit_t                       commit)
         : image_data_(std::move(image_data))
         , audio_data_(std::move(audio_data))
         , desc_(desc)
@@ -58,11 +178,11 @@ struct mutable_frame::impl
     }
 };
 
-mutable_frame::mutable_frame(const void*                      tag,
-                             std::vector<array<std::uint8_t>> image_data,
-                             array<int32_t>                   audio_data,
-                             const core::pixel_format_desc&   desc,
-                             commit_t                         commit)
+mutable_frame::mutable_frame(const void*                    tag,
+                             image_data_t                   image_data,
+                             array<int32_t>                 audio_data,
+                             const core::pixel_format_desc& desc,
+                             commit_t                       commit)
     : impl_(new impl(tag, std::move(image_data), std::move(audio_data), desc, std::move(commit)))
 {
 }
@@ -82,22 +202,34 @@ const array<std::uint8_t>& mutable_frame::image_data(std::size_t index) const {
 const array<std::int32_t>& mutable_frame::audio_data() const { return impl_->audio_data_; }
 array<std::uint8_t>&       mutable_frame::image_data(std::size_t index) { return impl_->image_data_.at(index); }
 array<std::int32_t>&       mutable_frame::audio_data() { return impl_->audio_data_; }
+const array<float>&        mutable_frame::audio_data_float() const { return impl_->audio_data_float_; }
+array<float>&              mutable_frame::audio_data_float() { return impl_->audio_data_float_; }
 std::size_t                mutable_frame::width() const { return impl_->desc_.planes.at(0).width; }
 std::size_t                mutable_frame::height() const { return impl_->desc_.planes.at(0).height; }
 const frame_geometry&      mutable_frame::geometry() const { return impl_->geometry_; }
 frame_geometry&            mutable_frame::geometry() { return impl_->geometry_; }
+steady_time_point&         mutable_frame::capture_time() { return impl_->capture_time_; }
+const steady_time_point&   mutable_frame::capture_time() const { return impl_->capture_time_; }
+int&                       mutable_frame::audio_channels() { return impl_->audio_channels_; }
+int                        mutable_frame::audio_channels() const { return impl_->audio_channels_; }
 
 struct const_frame::impl
 {
-    std::vector<array<const std::uint8_t>> image_data_;
-    array<const std::int32_t>              audio_data_;
-    core::pixel_format_desc                desc_     = core::pixel_format_desc(pixel_format::invalid);
-    frame_geometry                         geometry_ = frame_geometry::get_default();
-    std::any                               opaque_;
+    const_image_data_t        image_data_;
+    array<const std::int32_t> audio_data_;
+    array<const float>        audio_data_float_;
+    audio_sample_format       audio_format_   = audio_sample_format::s32;
+    int                       audio_channels_ = 0;
+    std::once_flag            audio_convert_once_;
+    core::pixel_format_desc   desc_     = core::pixel_format_desc(pixel_format::invalid);
+    frame_geometry            geometry_ = frame_geometry::get_default();
+    std::any                  opaque_;
+    steady_time_point         capture_time_;
 
-    impl(std::vector<array<const std::uint8_t>> image_data,
-         array<const std::int32_t>              audio_data,
-         const core::pixel_format_desc&         desc)
+    std::map<output_format, array<const std::uint8_t>>        converted_data_;
+    std::map<scaled_output_format, array<const std::uint8_t>> scaled_data_;
+
+    impl(const_image_data_t image_data, array<const std::int32_t> audio_data, const core::pixel_format_desc& desc)
         : image_data_(std::move(image_data))
         , audio_data_(std::move(audio_data))
         , desc_(desc)
@@ -107,9 +239,18 @@ struct const_frame::impl
         }
     }
 
-    impl(std::vector<array<std::uint8_t>>&& image_data,
-         array<const std::int32_t>          audio_data,
-         const core::pixel_format_desc&     desc)
+    impl(const_image_data_t image_data, array<const float> audio_data, const core::pixel_format_desc& desc)
+        : image_data_(std::move(image_data))
+        , audio_data_float_(std::move(audio_data))
+        , audio_format_(audio_sample_format::flt)
+        , desc_(desc)
+    {
+        if (desc_.planes.size() != image_data_.size()) {
+            CASPAR_THROW_EXCEPTION(invalid_argument());
+        }
+    }
+
+    impl(image_data_t&& image_data, array<const std::int32_t> audio_data, const core::pixel_format_desc& desc)
         : image_data_(std::make_move_iterator(image_data.begin()), std::make_move_iterator(image_data.end()))
         , audio_data_(std::move(audio_data))
         , desc_(desc)
@@ -123,8 +264,12 @@ struct const_frame::impl
         : image_data_(std::make_move_iterator(other.impl_->image_data_.begin()),
                       std::make_move_iterator(other.impl_->image_data_.end()))
         , audio_data_(std::move(other.impl_->audio_data_))
+        , audio_data_float_(std::move(other.impl_->audio_data_float_))
+        , audio_format_(audio_data_float_ ? audio_sample_format::flt : audio_sample_format::s32)
+        , audio_channels_(other.impl_->audio_channels_)
         , desc_(std::move(other.impl_->desc_))
         , geometry_(std::move(other.impl_->geometry_))
+        , capture_time_(other.impl_->capture_time_)
     {
         if (desc_.planes.size() != image_data_.size() && !other.impl_->commit_) {
             CASPAR_THROW_EXCEPTION(invalid_argument());
@@ -136,6 +281,53 @@ struct const_frame::impl
 
     const array<const std::uint8_t>& image_data(std::size_t index) const { return image_data_.at(index); }
 
+    const array<const std::uint8_t>& image_data(output_format format) const
+    {
+        static const array<const std::uint8_t> empty;
+
+        if (format == output_format::bgra && desc_.format == pixel_format::bgra) {
+            return image_data_.at(0);
+        }
+
+        auto it = converted_data_.find(format);
+        return it != converted_data_.end() ? it->second : empty;
+    }
+
+    const array<const std::uint8_t>& image_data(const scaled_output_format& format) const
+    {
+        static const array<const std::uint8_t> empty;
+
+        auto it = scaled_data_.find(format);
+        return it != scaled_data_.end() ? it->second : empty;
+    }
+
+    void convert_audio()
+    {
+        std::call_once(audio_convert_once_, [&] {
+            if (audio_format_ == audio_sample_format::flt) {
+                audio_data_ = to_s32(audio_data_float_);
+            } else {
+                audio_data_float_ = to_float(audio_data_);
+            }
+        });
+    }
+
+    const array<const std::int32_t>& audio_data()
+    {
+        if (audio_format_ != audio_sample_format::s32) {
+            convert_audio();
+        }
+        return audio_data_;
+    }
+
+    const array<const float>& audio_data_float()
+    {
+        if (audio_format_ != audio_sample_format::flt) {
+            convert_audio();
+        }
+        return audio_data_float_;
+    }
+
     std::size_t width() const { return desc_.planes.at(0).width; }
 
     std::size_t height() const { return desc_.planes.at(0).height; }
@@ -144,14 +336,32 @@ struct const_frame::impl
 };
 
 const_frame::const_frame() {}
-const_frame::const_frame(std::vector<array<const std::uint8_t>> image_data,
-                         array<const std::int32_t>              audio_data,
-                         const core::pixel_format_desc&         desc)
-    : impl_(new impl(std::move(image_data), std::move(audio_data), desc))
+const_frame::const_frame(const_image_data_t             image_data,
+                         array<const std::int32_t>      audio_data,
+                         const core::pixel_format_desc& desc)
+    : impl_(std::allocate_shared<impl>(pool_allocator<impl>(), std::move(image_data), std::move(audio_data), desc))
+{
+}
+const_frame::const_frame(const_image_data_t             image_data,
+                         array<const float>             audio_data,
+                         const core::pixel_format_desc& desc)
+    : impl_(std::allocate_shared<impl>(pool_allocator<impl>(), std::move(image_data), std::move(audio_data), desc))
+{
+}
+const_frame::const_frame(const_image_data_t                                        image_data,
+                         array<const std::int32_t>                                 audio_data,
+                         const core::pixel_format_desc&                            desc,
+                         std::map<output_format, array<const std::uint8_t>>        converted_data,
+                         steady_time_point                                         capture_time,
+                         std::map<scaled_output_format, array<const std::uint8_t>> scaled_data)
+    : impl_(std::allocate_shared<impl>(pool_allocator<impl>(), std::move(image_data), std::move(audio_data), desc))
 {
+    impl_->converted_data_ = std::move(converted_data);
+    impl_->capture_time_   = capture_time;
+    impl_->scaled_data_    = std::move(scaled_data);
 }
 const_frame::const_frame(mutable_frame&& other)
-    : impl_(new impl(std::move(other)))
+    : impl_(std::allocate_shared<impl>(pool_allocator<impl>(), std::move(other)))
 {
 }
 const_frame::const_frame(const const_frame& other)
@@ -170,11 +380,61 @@ bool const_frame::operator<(const const_frame& other) const { return impl_ < oth
 bool const_frame::               operator>(const const_frame& other) const { return impl_ > other.impl_; }
 const pixel_format_desc&         const_frame::pixel_format_desc() const { return impl_->desc_; }
 const array<const std::uint8_t>& const_frame::image_data(std::size_t index) const { return impl_->image_data(index); }
-const array<const std::int32_t>& const_frame::audio_data() const { return impl_->audio_data_; }
+const array<const std::uint8_t>& const_frame::image_data(output_format format) const
+{
+    return impl_->image_data(format);
+}
+const array<const std::uint8_t>& const_frame::image_data(const scaled_output_format& format) const
+{
+    return impl_->image_data(format);
+}
+const array<const std::int32_t>& const_frame::audio_data() const { return impl_->audio_data(); }
+const array<const float>&        const_frame::audio_data_float() const { return impl_->audio_data_float(); }
+audio_sample_format              const_frame::audio_format() const { return impl_->audio_format_; }
+int                              const_frame::audio_channels() const { return impl_->audio_channels_; }
 std::size_t                      const_frame::width() const { return impl_->width(); }
 std::size_t                      const_frame::height() const { return impl_->height(); }
 std::size_t                      const_frame::size() const { return impl_->size(); }
 const frame_geometry&            const_frame::geometry() const { return impl_->geometry_; }
 const std::any&                  const_frame::opaque() const { return impl_->opaque_; }
+steady_time_point                const_frame::capture_time() const
+{
+    return impl_ ? impl_->capture_time_ : steady_time_point();
+}
+const_frame const_frame::with_field(video_field field, array<const std::int32_t> audio_data, int audio_channels) const
+{
+    auto desc  = impl_->desc_;
+    desc.field = field;
+
+    const_frame frame(impl_->image_data_, std::move(audio_data), desc);
+    frame.impl_->geometry_       = impl_->geometry_;
+    frame.impl_->opaque_         = impl_->opaque_;
+    frame.impl_->capture_time_   = impl_->capture_time_;
+    frame.impl_->audio_channels_ = audio_channels;
+    return frame;
+}
 const_frame::operator bool() const { return impl_ != nullptr && impl_->desc_.format != core::pixel_format::invalid; }
+
+memory_usage frame_memory(const const_frame& frame)
+{
+    memory_usage usage;
+    if (!frame) {
+        return usage;
+    }
+
+    const auto& desc = frame.pixel_format_desc();
+    for (std::size_t n = 0; n < desc.planes.size(); ++n) {
+        usage.host += frame.image_data(n).size();
+        if (frame.opaque().has_value()) {
+            usage.device += desc.planes[n].size;
+        }
+    }
+    if (frame.audio_format() == audio_sample_format::flt) {
+        usage.host += frame.audio_data_float().size() * sizeof(float);
+    } else {
+        usage.host += frame.audio_data().size() * sizeof(std::int32_t);
+    }
+    return usage;
+}
+
 }} // namespace caspar::core
@@ -2,27 +2,45 @@
 
 #include <common/array.h>
 
+#include <boost/container/small_vector.hpp>
+
 #include <any>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <functional>
+#include <map>
 #include <memory>
 #include <vector>
 
 namespace caspar { namespace core {
 
+enum class output_format;
+enum class video_field;
+struct scaled_output_format;
+
+// The planes of an image, inline up to the four of ycbcra.
+using image_data_t       = boost::container::small_vector<array<std::uint8_t>, 4>;
+using const_image_data_t = boost::container::small_vector<array<const std::uint8_t>, 4>;
+
+enum class audio_sample_format
+{
+    s32,
+    flt, // normalized to [-1, 1]
+};
+
 class mutable_frame final
 {
     friend class const_frame;
 
   public:
-    using commit_t = std::function<std::any(std::vector<array<const std::uint8_t>>)>;
+    using commit_t = std::function<std::any(const_image_data_t)>;
 
-    explicit mutable_frame(const void*                      tag,
-                           std::vector<array<std::uint8_t>> image_data,
-                           array<std::int32_t>              audio_data,
-                           const struct pixel_format_desc&  desc,
-                           commit_t                         commit = nullptr);
+    explicit mutable_frame(const void*                     tag,
+                           image_data_t                    image_data,
+                           array<std::int32_t>             audio_data,
+                           const struct pixel_format_desc& desc,
+                           commit_t                        commit = nullptr);
     mutable_frame(const mutable_frame&) = delete;
     mutable_frame(mutable_frame&& other) noexcept;
 
@@ -41,6 +59,10 @@ class mutable_frame final
     array<std::int32_t>&       audio_data();
     const array<std::int32_t>& audio_data() const;
 
+    // Alternative to audio_data() for producers that already have float samples. Set one of them.
+    array<float>&       audio_data_float();
+    const array<float>& audio_data_float() const;
+
     std::size_t width() const;
 
     std::size_t height() const;
@@ -48,6 +70,14 @@ class mutable_frame final
     class frame_geometry&       geometry();
     const class frame_geometry& geometry() const;
 
+    // When the source of a live input arrived, left at the epoch by producers that are not fed in real time.
+    std::chrono::steady_clock::time_point&       capture_time();
+    const std::chrono::steady_clock::time_point& capture_time() const;
+
+    // The channel count of the interleaved audio, if it isn't the one of the channel. The mixer maps it.
+    int& audio_channels();
+    int  audio_channels() const;
+
   private:
     struct impl;
     std::unique_ptr<impl> impl_;
@@ -57,9 +87,18 @@ class const_frame final
 {
   public:
     const_frame();
-    explicit const_frame(std::vector<array<const std::uint8_t>> image_data,
-                         array<const std::int32_t>              audio_data,
-                         const struct pixel_format_desc&        desc);
+    explicit const_frame(const_image_data_t              image_data,
+                         array<const std::int32_t>       audio_data,
+                         const struct pixel_format_desc& desc);
+    explicit const_frame(const_image_data_t              image_data,
+                         array<const float>              audio_data,
+                         const struct pixel_format_desc& desc);
+    explicit const_frame(const_image_data_t                                 image_data,
+                         array<const std::int32_t>                          audio_data,
+                         const struct pixel_format_desc&                    desc,
+                         std::map<output_format, array<const std::uint8_t>> converted_data,
+                         std::chrono::steady_clock::time_point              capture_time = {},
+                         std::map<scaled_output_format, array<const std::uint8_t>> scaled_data = {});
     const_frame(const const_frame& other);
     const_frame(mutable_frame&& other);
 
@@ -71,7 +110,20 @@ class const_frame final
 
     const array<const std::uint8_t>& image_data(std::size_t index) const;
 
+    // The image in one of the layouts the mixer converts to, empty if no consumer asked for it when it was mixed.
+    // For output_format::bgra this is plane 0 of a mixer frame.
+    const array<const std::uint8_t>& image_data(output_format format) const;
+
+    // The image scaled and converted by the mixer, empty if no consumer asked for it when it was mixed.
+    const array<const std::uint8_t>& image_data(const scaled_output_format& format) const;
+
+    // The audio is converted on first access if the frame was created with the other sample format.
     const array<const std::int32_t>& audio_data() const;
+    const array<const float>&        audio_data_float() const;
+    audio_sample_format              audio_format() const;
+
+    // 0 when the audio is laid out like the channel.
+    int audio_channels() const;
 
     std::size_t width() const;
 
@@ -83,6 +135,12 @@ class const_frame final
 
     const class frame_geometry& geometry() const;
 
+    // For a mixer frame, the capture time of the oldest live source drawn into it.
+    std::chrono::steady_clock::time_point capture_time() const;
+
+    // A frame sharing the image and the textures uploaded for it, drawn from one field only, with audio of its own.
+    const_frame with_field(video_field field, array<const std::int32_t> audio_data, int audio_channels = 0) const;
+
     bool operator==(const const_frame& other) const;
     bool operator!=(const const_frame& other) const;
     bool operator<(const const_frame& other) const;
@@ -95,4 +153,22 @@ class const_frame final
     std::shared_ptr<impl> impl_;
 };
 
+// Bytes held in host memory, and in gpu memory by uploaded textures. Frames sharing an image are counted by each
+// holder, an estimate that tells what holds memory rather than an exact total.
+struct memory_usage
+{
+    std::int64_t host   = 0;
+    std::int64_t device = 0;
+
+    memory_usage& operator+=(const memory_usage& other)
+    {
+        host += other.host;
+        device += other.device;
+        return *this;
+    }
+};
+
+// The image and audio of the frame, and the textures referenced by its opaque() if it was uploaded.
+memory_usage frame_memory(const const_frame& frame);
+
 }} // namespace caspar::core
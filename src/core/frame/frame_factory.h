@@ -21,6 +21,13 @@
 
 #pragma once
 
+#include "frame.h"
+
+#include <common/array.h>
+
+#include <cstdint>
+#include <vector>
+
 namespace caspar { namespace core {
 
 class frame_factory
@@ -33,6 +40,15 @@ class frame_factory
     frame_factory(const frame_factory&) = delete;
 
     virtual class mutable_frame create_frame(const void* video_stream_tag, const struct pixel_format_desc& desc) = 0;
+
+    // Memory a frame can later be built on without copying, so producers can decode straight into upload buffers.
+    virtual array<std::uint8_t> create_array(int size) = 0;
+
+    // Creates a frame on planes allocated with create_array. A plane may be larger than its description. Planes in
+    // other memory are copied when they are uploaded, and held until the frame is released.
+    virtual class mutable_frame create_frame(const void*                     video_stream_tag,
+                                             const struct pixel_format_desc& desc,
+                                             image_data_t                    image_data) = 0;
 };
 
 }} // namespace caspar::core
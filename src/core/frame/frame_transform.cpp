@@ -24,6 +24,10 @@
 #include <boost/range/algorithm/equal.hpp>
 
 #include <cmath>
+#include <cstring>
+#include <optional>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 
 namespace caspar { namespace core {
@@ -51,38 +55,78 @@ void transform_corners(corners& self, const corners& other)
     // TODO (fix) figure out the math to compose perspective transforms correctly.
 }
 
+// The groups of an image_transform that can be skipped when they hold their defaults. Multiplying by a default group
+// changes nothing and tweening between identical groups gives the same group, so layers with default transforms, and
+// transforms that only animate one thing, don't pay for the rest.
+enum transform_group : unsigned
+{
+    group_color       = 1 << 0,
+    group_geometry    = 1 << 1,
+    group_crop        = 1 << 2,
+    group_perspective = 1 << 3,
+};
+
+unsigned non_default_groups(const image_transform& t)
+{
+    unsigned groups = 0;
+    if (t.opacity != 1.0 || t.contrast != 1.0 || t.brightness != 1.0 || t.saturation != 1.0)
+        groups |= group_color;
+    if (t.anchor[0] != 0.0 || t.anchor[1] != 0.0 || t.fill_translation[0] != 0.0 || t.fill_translation[1] != 0.0 ||
+        t.fill_scale[0] != 1.0 || t.fill_scale[1] != 1.0 || t.clip_translation[0] != 0.0 ||
+        t.clip_translation[1] != 0.0 || t.clip_scale[0] != 1.0 || t.clip_scale[1] != 1.0 || t.angle != 0.0)
+        groups |= group_geometry;
+    if (t.crop.ul[0] != 0.0 || t.crop.ul[1] != 0.0 || t.crop.lr[0] != 1.0 || t.crop.lr[1] != 1.0)
+        groups |= group_crop;
+    const corners identity;
+    if (t.perspective.ul != identity.ul || t.perspective.ur != identity.ur || t.perspective.lr != identity.lr ||
+        t.perspective.ll != identity.ll)
+        groups |= group_perspective;
+    return groups;
+}
+
 image_transform& image_transform::operator*=(const image_transform& other)
 {
-    opacity *= other.opacity;
-    brightness *= other.brightness;
-    contrast *= other.contrast;
-    saturation *= other.saturation;
-
-    // TODO (fix)
-    auto aspect_ratio = 1.0;
-
-    std::array<double, 2> rotated{};
-
-    auto orig_x = other.fill_translation[0];
-    auto orig_y = other.fill_translation[1] / aspect_ratio;
-    rotated[0]  = orig_x * std::cos(angle) - orig_y * std::sin(angle);
-    rotated[1]  = orig_x * std::sin(angle) + orig_y * std::cos(angle);
-    rotated[1] *= aspect_ratio;
-
-    anchor[0] += other.anchor[0] * fill_scale[0];
-    anchor[1] += other.anchor[1] * fill_scale[1];
-    fill_translation[0] += rotated[0] * fill_scale[0];
-    fill_translation[1] += rotated[1] * fill_scale[1];
-    fill_scale[0] *= other.fill_scale[0];
-    fill_scale[1] *= other.fill_scale[1];
-    clip_translation[0] += other.clip_translation[0] * clip_scale[0];
-    clip_translation[1] += other.clip_translation[1] * clip_scale[1];
-    clip_scale[0] *= other.clip_scale[0];
-    clip_scale[1] *= other.clip_scale[1];
-    angle += other.angle;
-
-    transform_rect(crop, other.crop);
-    transform_corners(perspective, other.perspective);
+    // Levels, chroma and edgeblend clamp against the other transform even at its defaults, they are always applied.
+    const auto groups = non_default_groups(other);
+
+    if (groups & group_color) {
+        opacity *= other.opacity;
+        brightness *= other.brightness;
+        contrast *= other.contrast;
+        saturation *= other.saturation;
+    }
+
+    if (groups & group_geometry) {
+        // TODO (fix)
+        auto aspect_ratio = 1.0;
+
+        std::array<double, 2> rotated{other.fill_translation[0], other.fill_translation[1]};
+
+        if (angle != 0.0) {
+            auto orig_x = other.fill_translation[0];
+            auto orig_y = other.fill_translation[1] / aspect_ratio;
+            rotated[0]  = orig_x * std::cos(angle) - orig_y * std::sin(angle);
+            rotated[1]  = orig_x * std::sin(angle) + orig_y * std::cos(angle);
+            rotated[1] *= aspect_ratio;
+        }
+
+        anchor[0] += other.anchor[0] * fill_scale[0];
+        anchor[1] += other.anchor[1] * fill_scale[1];
+        fill_translation[0] += rotated[0] * fill_scale[0];
+        fill_translation[1] += rotated[1] * fill_scale[1];
+        fill_scale[0] *= other.fill_scale[0];
+        fill_scale[1] *= other.fill_scale[1];
+        clip_translation[0] += other.clip_translation[0] * clip_scale[0];
+        clip_translation[1] += other.clip_translation[1] * clip_scale[1];
+        clip_scale[0] *= other.clip_scale[0];
+        clip_scale[1] *= other.clip_scale[1];
+        angle += other.angle;
+    }
+
+    if (groups & group_crop)
+        transform_rect(crop, other.crop);
+    if (groups & group_perspective)
+        transform_corners(perspective, other.perspective);
 
     levels.min_input  = std::max(levels.min_input, other.levels.min_input);
     levels.max_input  = std::min(levels.max_input, other.levels.max_input);
@@ -120,86 +164,122 @@ image_transform image_transform::operator*(const image_transform& other) const
     return image_transform(*this) *= other;
 }
 
-double do_tween(double time, double source, double dest, double duration, const tweener& tween)
+// Tweens the values of a transform for one point in time. When the tween moves every value by the same fraction of its
+// distance, which is all but elastic tweens with an amplitude, it is evaluated once for the whole transform and each
+// value is a multiply-add.
+class batched_tween
+{
+    const tweener&        tween_;
+    double                time_;
+    double                duration_;
+    std::optional<double> fraction_;
+
+  public:
+    batched_tween(double time, double duration, const tweener& tween)
+        : tween_(tween)
+        , time_(time)
+        , duration_(duration)
+        , fraction_(tween.fraction(time, duration))
+    {
+    }
+
+    double operator()(double source, double dest) const
+    {
+        return fraction_ ? source + (dest - source) * *fraction_ : tween_(time_, source, dest - source, duration_);
+    }
+};
+
+// Exact comparison of plain aggregates of doubles. Padding may make equal values compare unequal, which only means
+// they get tweened.
+template <typename T>
+bool identical(const T& lhs, const T& rhs)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "identical requires a trivially copyable type");
+    return std::memcmp(&lhs, &rhs, sizeof(T)) == 0;
+}
+
+auto color_of(const image_transform& t) { return std::tie(t.opacity, t.contrast, t.brightness, t.saturation); }
+
+auto geometry_of(const image_transform& t)
 {
-    return tween(time, source, dest - source, duration);
+    return std::tie(t.anchor, t.fill_translation, t.fill_scale, t.clip_translation, t.clip_scale, t.angle);
 }
 
 template <typename Rect>
-void do_tween_rectangle(const Rect&    source,
-                        const Rect&    dest,
-                        Rect&          out,
-                        double         time,
-                        double         duration,
-                        const tweener& tweener)
+void do_tween_rectangle(const Rect& source, const Rect& dest, Rect& out, const batched_tween& tween)
 {
-    out.ul[0] = do_tween(time, source.ul[0], dest.ul[0], duration, tweener);
-    out.ul[1] = do_tween(time, source.ul[1], dest.ul[1], duration, tweener);
-    out.lr[0] = do_tween(time, source.lr[0], dest.lr[0], duration, tweener);
-    out.lr[1] = do_tween(time, source.lr[1], dest.lr[1], duration, tweener);
+    out.ul[0] = tween(source.ul[0], dest.ul[0]);
+    out.ul[1] = tween(source.ul[1], dest.ul[1]);
+    out.lr[0] = tween(source.lr[0], dest.lr[0]);
+    out.lr[1] = tween(source.lr[1], dest.lr[1]);
 }
 
-void do_tween_corners(const corners& source,
-                      const corners& dest,
-                      corners&       out,
-                      double         time,
-                      double         duration,
-                      const tweener& tweener)
+void do_tween_corners(const corners& source, const corners& dest, corners& out, const batched_tween& tween)
 {
-    do_tween_rectangle(source, dest, out, time, duration, tweener);
+    do_tween_rectangle(source, dest, out, tween);
 
-    out.ur[0] = do_tween(time, source.ur[0], dest.ur[0], duration, tweener);
-    out.ur[1] = do_tween(time, source.ur[1], dest.ur[1], duration, tweener);
-    out.ll[0] = do_tween(time, source.ll[0], dest.ll[0], duration, tweener);
-    out.ll[1] = do_tween(time, source.ll[1], dest.ll[1], duration, tweener);
+    out.ur[0] = tween(source.ur[0], dest.ur[0]);
+    out.ur[1] = tween(source.ur[1], dest.ur[1]);
+    out.ll[0] = tween(source.ll[0], dest.ll[0]);
+    out.ll[1] = tween(source.ll[1], dest.ll[1]);
 }
 
 image_transform image_transform::tween(double                 time,
                                        const image_transform& source,
                                        const image_transform& dest,
                                        double                 duration,
-                                       const tweener&         tween)
+                                       const tweener&         easing)
 {
-    image_transform result;
-
-    result.brightness          = do_tween(time, source.brightness, dest.brightness, duration, tween);
-    result.contrast            = do_tween(time, source.contrast, dest.contrast, duration, tween);
-    result.saturation          = do_tween(time, source.saturation, dest.saturation, duration, tween);
-    result.opacity             = do_tween(time, source.opacity, dest.opacity, duration, tween);
-    result.anchor[0]           = do_tween(time, source.anchor[0], dest.anchor[0], duration, tween);
-    result.anchor[1]           = do_tween(time, source.anchor[1], dest.anchor[1], duration, tween);
-    result.fill_translation[0] = do_tween(time, source.fill_translation[0], dest.fill_translation[0], duration, tween);
-    result.fill_translation[1] = do_tween(time, source.fill_translation[1], dest.fill_translation[1], duration, tween);
-    result.fill_scale[0]       = do_tween(time, source.fill_scale[0], dest.fill_scale[0], duration, tween);
-    result.fill_scale[1]       = do_tween(time, source.fill_scale[1], dest.fill_scale[1], duration, tween);
-    result.clip_translation[0] = do_tween(time, source.clip_translation[0], dest.clip_translation[0], duration, tween);
-    result.clip_translation[1] = do_tween(time, source.clip_translation[1], dest.clip_translation[1], duration, tween);
-    result.clip_scale[0]       = do_tween(time, source.clip_scale[0], dest.clip_scale[0], duration, tween);
-    result.clip_scale[1]       = do_tween(time, source.clip_scale[1], dest.clip_scale[1], duration, tween);
-    result.angle               = do_tween(time, source.angle, dest.angle, duration, tween);
-    result.levels.max_input    = do_tween(time, source.levels.max_input, dest.levels.max_input, duration, tween);
-    result.levels.min_input    = do_tween(time, source.levels.min_input, dest.levels.min_input, duration, tween);
-    result.levels.max_output   = do_tween(time, source.levels.max_output, dest.levels.max_output, duration, tween);
-    result.levels.min_output   = do_tween(time, source.levels.min_output, dest.levels.min_output, duration, tween);
-    result.levels.gamma        = do_tween(time, source.levels.gamma, dest.levels.gamma, duration, tween);
-    result.edgeblend.bottom        = do_tween(time, source.edgeblend.bottom, dest.edgeblend.bottom, duration, tween);
-    result.edgeblend.top        = do_tween(time, source.edgeblend.top, dest.edgeblend.top, duration, tween);
-    result.edgeblend.right        = do_tween(time, source.edgeblend.right, dest.edgeblend.right, duration, tween);
-    result.edgeblend.left        = do_tween(time, source.edgeblend.left, dest.edgeblend.left, duration, tween);
-    result.edgeblend.g        = do_tween(time, source.edgeblend.g, dest.edgeblend.g, duration, tween);
-    result.edgeblend.p        = do_tween(time, source.edgeblend.p, dest.edgeblend.p, duration, tween);
-    result.edgeblend.a        = do_tween(time, source.edgeblend.a, dest.edgeblend.a, duration, tween);
-    result.chroma.target_hue   = do_tween(time, source.chroma.target_hue, dest.chroma.target_hue, duration, tween);
-    result.chroma.hue_width    = do_tween(time, source.chroma.hue_width, dest.chroma.hue_width, duration, tween);
-    result.chroma.min_saturation =
-        do_tween(time, source.chroma.min_saturation, dest.chroma.min_saturation, duration, tween);
-    result.chroma.min_brightness =
-        do_tween(time, source.chroma.min_brightness, dest.chroma.min_brightness, duration, tween);
-    result.chroma.softness = do_tween(time, source.chroma.softness, dest.chroma.softness, duration, tween);
-    result.chroma.spill_suppress =
-        do_tween(time, source.chroma.spill_suppress, dest.chroma.spill_suppress, duration, tween);
-    result.chroma.spill_suppress_saturation =
-        do_tween(time, source.chroma.spill_suppress_saturation, dest.chroma.spill_suppress_saturation, duration, tween);
+    const batched_tween tween(time, duration, easing);
+
+    // Tweening between equal values gives back those values, so groups that don't animate are copied as they are.
+    image_transform result = dest;
+
+    if (color_of(source) != color_of(dest)) {
+        result.brightness = tween(source.brightness, dest.brightness);
+        result.contrast   = tween(source.contrast, dest.contrast);
+        result.saturation = tween(source.saturation, dest.saturation);
+        result.opacity    = tween(source.opacity, dest.opacity);
+    }
+    if (geometry_of(source) != geometry_of(dest)) {
+        result.anchor[0]           = tween(source.anchor[0], dest.anchor[0]);
+        result.anchor[1]           = tween(source.anchor[1], dest.anchor[1]);
+        result.fill_translation[0] = tween(source.fill_translation[0], dest.fill_translation[0]);
+        result.fill_translation[1] = tween(source.fill_translation[1], dest.fill_translation[1]);
+        result.fill_scale[0]       = tween(source.fill_scale[0], dest.fill_scale[0]);
+        result.fill_scale[1]       = tween(source.fill_scale[1], dest.fill_scale[1]);
+        result.clip_translation[0] = tween(source.clip_translation[0], dest.clip_translation[0]);
+        result.clip_translation[1] = tween(source.clip_translation[1], dest.clip_translation[1]);
+        result.clip_scale[0]       = tween(source.clip_scale[0], dest.clip_scale[0]);
+        result.clip_scale[1]       = tween(source.clip_scale[1], dest.clip_scale[1]);
+        result.angle               = tween(source.angle, dest.angle);
+    }
+    if (!identical(source.levels, dest.levels)) {
+        result.levels.max_input  = tween(source.levels.max_input, dest.levels.max_input);
+        result.levels.min_input  = tween(source.levels.min_input, dest.levels.min_input);
+        result.levels.max_output = tween(source.levels.max_output, dest.levels.max_output);
+        result.levels.min_output = tween(source.levels.min_output, dest.levels.min_output);
+        result.levels.gamma      = tween(source.levels.gamma, dest.levels.gamma);
+    }
+    if (!identical(source.edgeblend, dest.edgeblend)) {
+        result.edgeblend.bottom = tween(source.edgeblend.bottom, dest.edgeblend.bottom);
+        result.edgeblend.top    = tween(source.edgeblend.top, dest.edgeblend.top);
+        result.edgeblend.right  = tween(source.edgeblend.right, dest.edgeblend.right);
+        result.edgeblend.left   = tween(source.edgeblend.left, dest.edgeblend.left);
+        result.edgeblend.g      = tween(source.edgeblend.g, dest.edgeblend.g);
+        result.edgeblend.p      = tween(source.edgeblend.p, dest.edgeblend.p);
+        result.edgeblend.a      = tween(source.edgeblend.a, dest.edgeblend.a);
+    }
+    if (!identical(source.chroma, dest.chroma)) {
+        result.chroma.target_hue                = tween(source.chroma.target_hue, dest.chroma.target_hue);
+        result.chroma.hue_width                 = tween(source.chroma.hue_width, dest.chroma.hue_width);
+        result.chroma.min_saturation            = tween(source.chroma.min_saturation, dest.chroma.min_saturation);
+        result.chroma.min_brightness            = tween(source.chroma.min_brightness, dest.chroma.min_brightness);
+        result.chroma.softness                  = tween(source.chroma.softness, dest.chroma.softness);
+        result.chroma.spill_suppress            = tween(source.chroma.spill_suppress, dest.chroma.spill_suppress);
+        result.chroma.spill_suppress_saturation =
+            tween(source.chroma.spill_suppress_saturation, dest.chroma.spill_suppress_saturation);
+    }
     result.chroma.enable    = dest.chroma.enable;
     result.chroma.show_mask = dest.chroma.show_mask;
     result.is_key           = source.is_key || dest.is_key;
@@ -208,8 +288,10 @@ image_transform image_transform::tween(double                 time,
     result.blend_mode       = std::max(source.blend_mode, dest.blend_mode);
     result.layer_depth      = dest.layer_depth;
 
-    do_tween_rectangle(source.crop, dest.crop, result.crop, time, duration, tween);
-    do_tween_corners(source.perspective, dest.perspective, result.perspective, time, duration, tween);
+    if (!identical(source.crop, dest.crop))
+        do_tween_rectangle(source.crop, dest.crop, result.crop, tween);
+    if (!identical(source.perspective, dest.perspective))
+        do_tween_corners(source.perspective, dest.perspective, result.perspective, tween);
 
     return result;
 }
@@ -256,6 +338,28 @@ bool operator==(const image_transform& lhs, const image_transform& rhs)
 
 bool operator!=(const image_transform& lhs, const image_transform& rhs) { return !(lhs == rhs); }
 
+bool is_visible(const image_transform& transform)
+{
+    if (transform.opacity < 5e-8) {
+        return false;
+    }
+
+    for (int n = 0; n < 2; ++n) {
+        if (std::abs(transform.fill_scale[n]) < 5e-8 || transform.crop.lr[n] - transform.crop.ul[n] < 5e-8) {
+            return false;
+        }
+
+        // The clip is a scissor rect in channel coordinates.
+        const auto clip_begin = transform.clip_translation[n];
+        const auto clip_end   = clip_begin + transform.clip_scale[n];
+        if (transform.clip_scale[n] < 5e-8 || clip_end < 5e-8 || clip_begin > 1.0 - 5e-8) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 // audio_transform
 
 audio_transform& audio_transform::operator*=(const audio_transform& other)
@@ -276,7 +380,7 @@ audio_transform audio_transform::tween(double                 time,
                                        const tweener&         tween)
 {
     audio_transform result;
-    result.volume = do_tween(time, source.volume, dest.volume, duration, tween);
+    result.volume = tween(time, source.volume, dest.volume - source.volume, duration);
 
     return result;
 }
@@ -334,6 +438,8 @@ tweened_transform::tweened_transform(const frame_transform& source,
 
 const frame_transform& tweened_transform::dest() const { return dest_; }
 
+bool tweened_transform::done() const { return time_ == duration_; }
+
 frame_transform tweened_transform::fetch()
 {
     return time_ == duration_
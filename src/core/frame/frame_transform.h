@@ -122,6 +122,9 @@ struct image_transform final
 bool operator==(const image_transform& lhs, const image_transform& rhs);
 bool operator!=(const image_transform& lhs, const image_transform& rhs);
 
+// False when nothing drawn with the transform can show: at no opacity, scaled or cropped to nothing, or clipped away.
+bool is_visible(const image_transform& transform);
+
 struct audio_transform final
 {
     double volume = 1.0;
@@ -174,6 +177,7 @@ class tweened_transform
     tweened_transform(const frame_transform& source, const frame_transform& dest, int duration, tweener tween);
 
     const frame_transform& dest() const;
+    bool                   done() const; // the tween has reached its destination
 
     frame_transform fetch();
     void            tick(int num);
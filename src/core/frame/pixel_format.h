@@ -21,6 +21,11 @@
 
 #pragma once
 
+#include "../video_format.h"
+
+#include <boost/container/small_vector.hpp>
+
+#include <tuple>
 #include <vector>
 
 namespace caspar { namespace core {
@@ -38,6 +43,15 @@ enum class pixel_format
     bgr,
     rgb,
     uyvy,
+    uyva,
+    bc1,       // block compressed as DXT1 without alpha, the texture of Hap
+    bc3,       // DXT5, Hap Alpha
+    bc3_ycocg, // DXT5 of scaled YCoCg with Y in alpha, Hap Q
+    bc7,       // BPTC, Hap R
+    nv12,      // 8 bit Y plane and a plane of interleaved Cb Cr, as hardware decoders output it
+    p010,      // nv12 of 16 bit samples with the value in the high bits
+    ycbcr16,   // ycbcr of 16 bit samples with the value in the low depth bits
+    ycbcra16,  // ycbcra of 16 bit samples with the value in the low depth bits
     count,
     invalid,
 };
@@ -62,6 +76,18 @@ struct pixel_format_desc final
             , stride(stride)
         {
         }
+
+        // A plane of 4x4 pixel blocks of block_size bytes each, uploaded as it is to a block compressed texture.
+        static plane blocks(int width, int height, int block_size)
+        {
+            plane result;
+            result.width    = width;
+            result.height   = height;
+            result.stride   = block_size;
+            result.linesize = (width + 3) / 4 * block_size;
+            result.size     = result.linesize * ((height + 3) / 4);
+            return result;
+        }
     };
 
     pixel_format_desc() = default;
@@ -71,8 +97,86 @@ struct pixel_format_desc final
     {
     }
 
-    pixel_format       format = pixel_format::invalid;
-    std::vector<plane> planes;
+    pixel_format                             format = pixel_format::invalid;
+    boost::container::small_vector<plane, 4> planes; // inline up to four, so copying a description doesn't allocate
+
+    // The bits of each sample of ycbcr16 and ycbcra16, such as 10 for the planar formats ProRes decodes to. The
+    // other formats fill their samples.
+    int depth = 8;
+
+    // Interlaced images are drawn from one of their fields, video_field::a being the even lines and video_field::b
+    // the odd ones. The mixer interpolates the lines between them.
+    video_field field = video_field::progressive;
+};
+
+// Formats of 16 bit samples, whose planes have twice the stride of their 8 bit counterparts.
+inline bool is_16_bit(pixel_format format)
+{
+    return format == pixel_format::p010 || format == pixel_format::ycbcr16 || format == pixel_format::ycbcra16;
+}
+
+// Layouts the mixer can convert its output to on the gpu, requested by consumers through
+// frame_consumer::preferred_output_format.
+enum class output_format
+{
+    bgra = 0, // 8 bit BGRA, the native mixer output
+    uyvy,     // 8 bit 4:2:2 packed as Cb Y Cr Y
+    v210,     // 10 bit 4:2:2 packed, 6 pixels in 16 bytes, lines padded to 128 bytes
+    yuva422,  // 8 bit 4:2:2 planar with alpha. Y lines, then Cb and Cr side by side on each line, then A lines.
+    uyva,     // uyvy lines followed by A lines of width bytes, as NDI sends it. Padded to a whole uyvy line.
+    texture,  // The mixed bgra texture itself for consumers drawing with OpenGL, nothing is read back. The image
+              // holds no bytes, its storage is an accelerator::ogl::shared_texture.
+    key,      // 8 bit BGRA with the alpha of the mix in all four bytes, the key signal of fill and key outputs.
+    count,
+};
+
+inline int output_format_linesize(output_format format, int width)
+{
+    switch (format) {
+        case output_format::uyvy:
+        case output_format::uyva:
+            return width * 2;
+        case output_format::v210:
+            return (width + 47) / 48 * 128;
+        case output_format::yuva422:
+            return width;
+        case output_format::texture:
+            return 0;
+        default:
+            return width * 4;
+    }
+}
+
+inline int output_format_size(output_format format, int width, int height)
+{
+    switch (format) {
+        case output_format::yuva422:
+            return output_format_linesize(format, width) * height * 3;
+        case output_format::uyva:
+            return output_format_linesize(format, width) * (height + (height + 1) / 2);
+        default:
+            return output_format_linesize(format, width) * height;
+    }
+}
+
+// An output format at a size of its own, for consumers sending frames smaller than the channel's, requested through
+// frame_consumer::preferred_output_size. Each is scaled and converted on the gpu once per frame, for all the consumers
+// asking for it.
+struct scaled_output_format
+{
+    output_format format = output_format::bgra;
+    int           width  = 0;
+    int           height = 0;
 };
 
+inline bool operator==(const scaled_output_format& lhs, const scaled_output_format& rhs)
+{
+    return lhs.format == rhs.format && lhs.width == rhs.width && lhs.height == rhs.height;
+}
+
+inline bool operator<(const scaled_output_format& lhs, const scaled_output_format& rhs)
+{
+    return std::tie(lhs.format, lhs.width, lhs.height) < std::tie(rhs.format, rhs.width, rhs.height);
+}
+
 }} // namespace caspar::core
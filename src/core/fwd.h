@@ -33,6 +33,8 @@ FORWARD2(caspar, core, struct video_format_desc);
 FORWARD2(caspar, core, class frame_factory);
 FORWARD2(caspar, core, class frame_producer);
 FORWARD2(caspar, core, class frame_consumer);
+FORWARD2(caspar, core, class clock_source);
+FORWARD2(caspar, core, class sync_group);
 FORWARD2(caspar, core, class draw_frame);
 FORWARD2(caspar, core, class mutable_frame);
 FORWARD2(caspar, core, class const_frame);
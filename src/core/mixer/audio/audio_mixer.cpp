@@ -28,24 +28,267 @@
 #include <core/monitor/monitor.h>
 
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/metrics.h>
 
 #include <boost/container/flat_map.hpp>
 #include <boost/range/algorithm.hpp>
 
+#ifdef USE_SIMDE
+#define SIMDE_ENABLE_NATIVE_ALIASES
+#include <simde/x86/sse2.h>
+#else
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <emmintrin.h>
+#endif
+#endif
+
+#include <algorithm>
 #include <atomic>
+#include <limits>
+#include <optional>
 #include <stack>
+#include <string>
 #include <vector>
 
 namespace caspar { namespace core {
 
 using namespace boost::container;
 
+static void load4_pd(const int32_t* samples, __m128d& lo, __m128d& hi)
+{
+    auto xmm0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples));
+    lo        = _mm_cvtepi32_pd(xmm0);
+    hi        = _mm_cvtepi32_pd(_mm_srli_si128(xmm0, 8));
+}
+
+static void load4_pd(const float* samples, __m128d& lo, __m128d& hi)
+{
+    auto xmm0 = _mm_loadu_ps(samples);
+    lo        = _mm_cvtps_pd(xmm0);
+    hi        = _mm_cvtps_pd(_mm_movehl_ps(xmm0, xmm0));
+}
+
+static void load2_pd(const int32_t* samples, __m128d& pair)
+{
+    pair = _mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(samples)));
+}
+
+static void load2_pd(const float* samples, __m128d& pair)
+{
+    pair = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(samples))));
+}
+
+// A source channel of an item feeding a channel of the mix.
+struct channel_tap
+{
+    int    dest;
+    int    source;
+    double gain;
+};
+
+// How an item with another channel count than the channel is mixed. Adjacent taps with the same gain, such as the
+// front pair of a stereo clip, are mixed together.
+struct channel_map
+{
+    std::vector<channel_tap> pairs;
+    std::vector<channel_tap> singles;
+};
+
+// The layouts are the ffmpeg defaults for the channel count, FL FR FC LFE BL BR SL SR for the first eight. Mono feeds
+// the front pair, 5.1 and 7.1 are downmixed to stereo without the LFE, anything else maps channel to channel and
+// drops or pads the rest.
+static channel_map make_channel_map(int source_channels, int channels)
+{
+    std::vector<channel_tap> taps;
+    if (source_channels == 1) {
+        for (int ch = 0; ch < std::min(channels, 2); ++ch) {
+            taps.push_back({ch, 0, 1.0});
+        }
+    } else if (channels == 1) {
+        taps.push_back({0, 0, 0.5});
+        taps.push_back({0, 1, 0.5});
+    } else if (channels == 2 && (source_channels == 6 || source_channels == 8)) {
+        const auto center = 0.7071067811865476;
+        taps.push_back({0, 0, 1.0});
+        taps.push_back({1, 1, 1.0});
+        taps.push_back({0, 2, center});
+        taps.push_back({1, 2, center});
+        for (int ch = 4; ch < source_channels; ch += 2) {
+            taps.push_back({0, ch, center});
+            taps.push_back({1, ch + 1, center});
+        }
+    } else {
+        for (int ch = 0; ch < std::min(source_channels, channels); ++ch) {
+            taps.push_back({ch, ch, 1.0});
+        }
+    }
+
+    channel_map map;
+    for (size_t n = 0; n < taps.size(); ++n) {
+        const auto& tap = taps[n];
+        if (n + 1 < taps.size() && taps[n + 1].dest == tap.dest + 1 && taps[n + 1].source == tap.source + 1 &&
+            taps[n + 1].gain == tap.gain) {
+            map.pairs.push_back(tap);
+            ++n;
+        } else {
+            map.singles.push_back(tap);
+        }
+    }
+    return map;
+}
+
+// Adds the samples of an item with source_channels channels to mixed through map, in the same pass. Items shorter
+// than the mix repeat their last sample frame.
+template <typename T>
+static void accumulate(double*            mixed,
+                       size_t             size,
+                       const T*           samples,
+                       size_t             nb_samples,
+                       double             volume,
+                       int                channels,
+                       int                source_channels,
+                       const channel_map& map)
+{
+    const auto frames        = size / channels;
+    const auto source_frames = nb_samples / source_channels;
+    if (source_frames == 0) {
+        return;
+    }
+
+    for (size_t frame = 0; frame < frames; ++frame) {
+        const auto dest   = mixed + frame * channels;
+        const auto source = samples + std::min(frame, source_frames - 1) * source_channels;
+
+        for (auto& tap : map.pairs) {
+            __m128d pair;
+            load2_pd(source + tap.source, pair);
+            auto out = dest + tap.dest;
+            _mm_storeu_pd(out, _mm_add_pd(_mm_loadu_pd(out), _mm_mul_pd(pair, _mm_set1_pd(tap.gain * volume))));
+        }
+        for (auto& tap : map.singles) {
+            dest[tap.dest] += static_cast<double>(source[tap.source]) * tap.gain * volume;
+        }
+    }
+}
+
+// Adds samples * volume to mixed. Items shorter than the mix repeat their last sample frame.
+template <typename T>
+static void accumulate(double* mixed, size_t size, const T* samples, size_t nb_samples, double volume, int channels)
+{
+    const auto count = std::min(size, nb_samples);
+    const auto gain  = _mm_set1_pd(volume);
+
+    size_t n = 0;
+    for (; n + 4 <= count; n += 4) {
+        __m128d lo;
+        __m128d hi;
+        load4_pd(samples + n, lo, hi);
+        lo = _mm_mul_pd(lo, gain);
+        hi = _mm_mul_pd(hi, gain);
+        _mm_storeu_pd(mixed + n, _mm_add_pd(_mm_loadu_pd(mixed + n), lo));
+        _mm_storeu_pd(mixed + n + 2, _mm_add_pd(_mm_loadu_pd(mixed + n + 2), hi));
+    }
+    for (; n < count; ++n) {
+        mixed[n] += static_cast<double>(samples[n]) * volume;
+    }
+
+    if (nb_samples < static_cast<size_t>(channels)) {
+        return;
+    }
+    for (; n < size; ++n) {
+        auto offset = nb_samples - (channels - (n % channels));
+        mixed[n] += static_cast<double>(samples[offset]) * volume;
+    }
+}
+
+// Applies the master volume, saturates to int32 and tracks the per channel peak in a single pass.
+static void
+finalize(const double* mixed, int32_t* result, size_t size, int channels, double master_volume, double* peak)
+{
+    const auto min = static_cast<double>(std::numeric_limits<int32_t>::min());
+    const auto max = static_cast<double>(std::numeric_limits<int32_t>::max());
+
+    size_t n = 0;
+
+    // Sample pairs belong to the same channel pair as long as the channel count is even.
+    if (channels % 2 == 0) {
+        const auto gain      = _mm_set1_pd(master_volume);
+        const auto min_pd    = _mm_set1_pd(min);
+        const auto max_pd    = _mm_set1_pd(max);
+        const auto sign_mask = _mm_set1_pd(-0.0);
+
+        int ch = 0;
+        for (; n + 2 <= size; n += 2) {
+            auto sample = _mm_mul_pd(_mm_loadu_pd(mixed + n), gain);
+            sample      = _mm_min_pd(_mm_max_pd(sample, min_pd), max_pd);
+
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(result + n), _mm_cvttpd_epi32(sample));
+            _mm_storeu_pd(peak + ch, _mm_max_pd(_mm_loadu_pd(peak + ch), _mm_andnot_pd(sign_mask, sample)));
+
+            ch += 2;
+            if (ch == channels) {
+                ch = 0;
+            }
+        }
+    }
+
+    for (; n < size; ++n) {
+        auto sample = std::min(std::max(mixed[n] * master_volume, min), max);
+        result[n]   = static_cast<int32_t>(sample);
+
+        auto& channel_peak = peak[n % channels];
+        channel_peak       = std::max(channel_peak, std::abs(sample));
+    }
+}
+
 struct audio_item
 {
     audio_transform      transform;
     array<const int32_t> samples;
+    array<const float>   samples_float;
+    int                  channels = 0;
+    int                  layer    = 0;
+};
+
+struct loudness_metrics
+{
+    std::shared_ptr<diagnostics::metrics::gauge> momentary;
+    std::shared_ptr<diagnostics::metrics::gauge> short_term;
+    std::shared_ptr<diagnostics::metrics::gauge> integrated;
+    std::shared_ptr<diagnostics::metrics::gauge> true_peak;
+
+    explicit loudness_metrics(int channel_index)
+    {
+        namespace metrics = diagnostics::metrics;
+
+        const metrics::labels_t labels = {{"channel", std::to_string(channel_index)}};
+        momentary  = metrics::make_gauge("caspar_channel_loudness_momentary_lufs", "Momentary loudness", labels);
+        short_term = metrics::make_gauge("caspar_channel_loudness_short_term_lufs", "Short-term loudness", labels);
+        integrated = metrics::make_gauge("caspar_channel_loudness_integrated_lufs", "Integrated loudness", labels);
+        true_peak  = metrics::make_gauge("caspar_channel_true_peak_dbtp", "Highest true peak", labels);
+    }
+
+    void set(const loudness& value)
+    {
+        momentary->set(value.momentary);
+        short_term->set(value.short_term);
+        integrated->set(value.integrated);
+        true_peak->set(value.true_peak);
+    }
 };
 
+static monitor::state loudness_state(const loudness& value)
+{
+    monitor::state state;
+    state["momentary"]  = value.momentary;
+    state["short-term"] = value.short_term;
+    state["integrated"] = value.integrated;
+    state["true-peak"]  = value.true_peak;
+    return state;
+}
+
 using audio_buffer_ps = std::vector<double>;
 
 struct audio_mixer::impl
@@ -55,13 +298,29 @@ struct audio_mixer::impl
     std::vector<audio_item>             items_;
     std::atomic<float>                  master_volume_{1.0f};
     spl::shared_ptr<diagnostics::graph> graph_;
+    int                                 layer_ = 0;
+
+    // By the channel counts of the item and of the channel.
+    flat_map<std::pair<int, int>, channel_map> channel_maps_;
+
+    const loudness_metering         metering_;
+    std::optional<loudness_metrics> metrics_;
+    std::optional<loudness_meter>   meter_;
+    flat_map<int, loudness_meter>   layer_meters_;
+    std::vector<int>                layers_;       // visited since the last mix
+    std::pair<int, int>             meter_format_; // the channels and sample rate the meters measure
+    std::atomic<bool>               reset_loudness_{false};
 
     impl(const impl&)            = delete;
     impl& operator=(const impl&) = delete;
 
-    impl(spl::shared_ptr<diagnostics::graph> graph)
+    impl(spl::shared_ptr<diagnostics::graph> graph, int channel_index, loudness_metering metering)
         : graph_(std::move(graph))
+        , metering_(metering)
     {
+        if (metering_ != loudness_metering::none) {
+            metrics_.emplace(channel_index);
+        }
         graph_->set_color("volume", diagnostics::color(1.0f, 0.8f, 0.1f));
         graph_->set_color("audio-clipping", diagnostics::color(0.3f, 0.6f, 0.3f));
         transform_stack_.push(core::audio_transform());
@@ -74,18 +333,36 @@ struct audio_mixer::impl
 
     void visit(const const_frame& frame)
     {
-        if (transform_stack_.top().volume < 0.002 || !frame.audio_data())
+        if (transform_stack_.top().volume < 0.002)
             return;
 
+        // Mix the samples in whichever format the producer delivered, so they are only converted once.
         audio_item item;
         item.transform = transform_stack_.top();
-        item.samples   = frame.audio_data();
+        item.channels  = frame.audio_channels();
+        item.layer     = layer_;
+        if (frame.audio_format() == audio_sample_format::flt) {
+            item.samples_float = frame.audio_data_float();
+        } else {
+            item.samples = frame.audio_data();
+        }
+
+        if (!item.samples && !item.samples_float)
+            return;
 
         items_.push_back(std::move(item));
     }
 
     void pop() { transform_stack_.pop(); }
 
+    void begin_layer(int layer)
+    {
+        layer_ = layer;
+        if (metering_ == loudness_metering::layers) {
+            layers_.push_back(layer);
+        }
+    }
+
     void set_master_volume(float volume) { master_volume_ = volume; }
 
     float get_master_volume() { return master_volume_; }
@@ -96,60 +373,139 @@ struct audio_mixer::impl
         auto items    = std::move(items_);
         auto result   = std::vector<int32_t>(nb_samples * channels, 0);
 
-        auto mixed = std::vector<double>(nb_samples * channels, 0.0f);
+        auto mixed = std::vector<double>(nb_samples * channels, 0.0);
+
+        // Layers are mixed on their own first when they are measured, and then added to the rest.
+        flat_map<int, std::vector<double>> layer_mixes;
+        if (metering_ == loudness_metering::layers) {
+            for (auto layer : layers_) {
+                layer_mixes.emplace(layer, std::vector<double>(mixed.size(), 0.0));
+            }
+        }
 
         for (auto& item : items) {
-            auto ptr  = item.samples.data();
-            auto size = result.size();
-            for (auto n = 0; n < size; ++n) {
-                if (n < item.samples.size()) {
-                    mixed[n] = static_cast<double>(ptr[n]) * item.transform.volume + mixed[n];
+            auto layer_mix = layer_mixes.find(item.layer);
+            auto dest      = layer_mix != layer_mixes.end() ? layer_mix->second.data() : mixed.data();
+
+            if (item.channels > 0 && item.channels != channels) {
+                auto key = std::make_pair(item.channels, channels);
+                auto it  = channel_maps_.find(key);
+                if (it == channel_maps_.end()) {
+                    it = channel_maps_.emplace(key, make_channel_map(item.channels, channels)).first;
+                }
+
+                if (item.samples_float) {
+                    accumulate(dest,
+                               mixed.size(),
+                               item.samples_float.data(),
+                               item.samples_float.size(),
+                               item.transform.volume * 2147483648.0,
+                               channels,
+                               item.channels,
+                               it->second);
                 } else {
-                    auto offset = (item.samples.size()) - (channels - (n % channels));
-                    mixed[n]    = static_cast<double>(ptr[offset]) * item.transform.volume + mixed[n];
+                    accumulate(dest,
+                               mixed.size(),
+                               item.samples.data(),
+                               item.samples.size(),
+                               item.transform.volume,
+                               channels,
+                               item.channels,
+                               it->second);
                 }
+            } else if (item.samples_float) {
+                // Float samples are mixed in the int32 range, 2^31 * volume.
+                accumulate(dest,
+                           mixed.size(),
+                           item.samples_float.data(),
+                           item.samples_float.size(),
+                           item.transform.volume * 2147483648.0,
+                           channels);
+            } else {
+                accumulate(
+                    dest, mixed.size(), item.samples.data(), item.samples.size(), item.transform.volume, channels);
             }
         }
 
-        auto master_volume = master_volume_.load();
-        for (auto n = 0; n < mixed.size(); ++n) {
-            auto sample = mixed[n] * master_volume;
-            if (sample > std::numeric_limits<int32_t>::max()) {
-                result[n] = std::numeric_limits<int32_t>::max();
-            } else if (sample < std::numeric_limits<int32_t>::min()) {
-                result[n] = std::numeric_limits<int32_t>::min();
-            } else {
-                result[n] = static_cast<int32_t>(sample);
-            }
+        if (metering_ != loudness_metering::none) {
+            measure(mixed, layer_mixes, format_desc);
         }
 
-        auto max = std::vector<int32_t>(channels, std::numeric_limits<int32_t>::min());
-        for (size_t n = 0; n < result.size(); n += channels) {
-            for (int ch = 0; ch < channels; ++ch) {
-                max[ch] = std::max(max[ch], std::abs(result[n + ch]));
-            }
+        auto peak = std::vector<double>(channels, 0.0);
+        finalize(mixed.data(), result.data(), result.size(), channels, master_volume_.load(), peak.data());
+
+        auto max = std::vector<int32_t>(channels);
+        for (int ch = 0; ch < channels; ++ch) {
+            max[ch] = static_cast<int32_t>(std::min(peak[ch], static_cast<double>(std::numeric_limits<int32_t>::max())));
         }
 
         if (boost::range::count_if(max, [](auto val) { return val >= std::numeric_limits<int32_t>::max(); }) > 0) {
             graph_->set_tag(diagnostics::tag_severity::WARNING, "audio-clipping");
         }
 
-        state_["volume"] = std::move(max);
-
         graph_->set_value("volume",
                           static_cast<double>(*boost::max_element(max)) / std::numeric_limits<int32_t>::max());
 
+        monitor::state state;
+        state["volume"] = std::move(max);
+        if (meter_) {
+            auto value = meter_->get();
+            metrics_->set(value);
+            state["loudness"] = loudness_state(value);
+            for (auto& p : layer_meters_) {
+                state["layer"][p.first]["loudness"] = loudness_state(p.second.get());
+            }
+        }
+        state_ = std::move(state);
+
         return std::move(result);
     }
+
+    // Feeds each layer's mix to its meter and adds it to the channel's, which is measured with the master volume.
+    void measure(std::vector<double>&                      mixed,
+                 const flat_map<int, std::vector<double>>& layer_mixes,
+                 const video_format_desc&                  format_desc)
+    {
+        const auto channels = format_desc.audio_channels;
+        const auto frames   = mixed.size() / std::max(channels, 1);
+        const auto format   = std::make_pair(channels, format_desc.audio_sample_rate);
+        const auto reset    = reset_loudness_.exchange(false);
+        if (reset || !meter_ || meter_format_ != format) {
+            meter_.emplace(channels, format_desc.audio_sample_rate);
+            layer_meters_.clear();
+            meter_format_ = format;
+        }
+
+        // Meters of the layers that are gone are dropped, one starts over once a layer is back.
+        for (auto it = layer_meters_.begin(); it != layer_meters_.end();) {
+            it = layer_mixes.count(it->first) > 0 ? std::next(it) : layer_meters_.erase(it);
+        }
+        for (auto& p : layer_mixes) {
+            auto meter = layer_meters_.find(p.first);
+            if (meter == layer_meters_.end()) {
+                meter = layer_meters_.emplace(p.first, loudness_meter(channels, format_desc.audio_sample_rate)).first;
+            }
+            meter->second(p.second.data(), frames, 1.0 / 2147483648.0);
+
+            for (size_t n = 0; n < mixed.size(); ++n) {
+                mixed[n] += p.second[n];
+            }
+        }
+        layers_.clear();
+
+        (*meter_)(mixed.data(), frames, master_volume_.load() / 2147483648.0);
+    }
 };
 
-audio_mixer::audio_mixer(spl::shared_ptr<diagnostics::graph> graph)
-    : impl_(new impl(std::move(graph)))
+audio_mixer::audio_mixer(spl::shared_ptr<diagnostics::graph> graph, int channel_index, loudness_metering metering)
+    : impl_(new impl(std::move(graph), channel_index, metering))
 {
 }
 void                 audio_mixer::push(const frame_transform& transform) { impl_->push(transform); }
 void                 audio_mixer::visit(const const_frame& frame) { impl_->visit(frame); }
 void                 audio_mixer::pop() { impl_->pop(); }
+void                 audio_mixer::begin_layer(int layer) { impl_->begin_layer(layer); }
+void                 audio_mixer::reset_loudness() { impl_->reset_loudness_ = true; }
 void                 audio_mixer::set_master_volume(float volume) { impl_->set_master_volume(volume); }
 float                audio_mixer::get_master_volume() { return impl_->get_master_volume(); }
 array<const int32_t> audio_mixer::operator()(const video_format_desc& format_desc, int nb_samples)
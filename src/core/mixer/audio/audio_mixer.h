@@ -26,6 +26,7 @@
 #include <common/memory.h>
 
 #include <core/frame/frame_visitor.h>
+#include <core/mixer/audio/loudness_meter.h>
 #include <core/monitor/monitor.h>
 #include <core/video_format.h>
 
@@ -41,13 +42,24 @@ class audio_mixer final : public frame_visitor
     audio_mixer& operator=(const audio_mixer&);
 
   public:
-    audio_mixer(spl::shared_ptr<::caspar::diagnostics::graph> graph);
+    // With metering the loudness of the mix is sent in the state as loudness/momentary, short-term and integrated in
+    // LUFS and loudness/true-peak in dBTP, and exported as metrics. Metering layers adds the same for each layer as
+    // layer/<index>/loudness/..., measured before the master volume.
+    audio_mixer(spl::shared_ptr<::caspar::diagnostics::graph> graph,
+                int                                           channel_index = 0,
+                loudness_metering                             metering      = loudness_metering::none);
 
     array<const int32_t> operator()(const struct video_format_desc& format_desc, int nb_samples);
     void                 set_master_volume(float volume);
     float                get_master_volume();
     core::monitor::state state() const;
 
+    // The frames visited from now on are of this stage layer.
+    void begin_layer(int layer);
+
+    // Starts the integrated loudness and the true peak over, as of the next mix.
+    void reset_loudness();
+
     void push(const struct frame_transform& transform) override;
     void visit(const class const_frame& frame) override;
     void pop() override;
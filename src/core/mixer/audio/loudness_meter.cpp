@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../../StdAfx.h"
+
+#include "loudness_meter.h"
+
+#ifdef USE_SIMDE
+#define SIMDE_ENABLE_NATIVE_ALIASES
+#include <simde/x86/sse2.h>
+#else
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <emmintrin.h>
+#endif
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace caspar { namespace core {
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+
+// Gating blocks are sorted into steps of 0.1 LU from the absolute gate up to +30 LUFS, louder ones into the last.
+const double ABSOLUTE_GATE = -70.0;
+const int    GATE_STEPS    = 1000;
+
+// The true peak is found between the samples at 4 times the rate, by interpolating at the three points between each
+// pair of samples from the 12 around them.
+const int TAPS   = 12;
+const int PHASES = 3;
+
+double to_lufs(double energy)
+{
+    return energy > 0.0 ? -0.691 + 10.0 * std::log10(energy) : -std::numeric_limits<double>::infinity();
+}
+
+// Windowed sinc interpolators for the points a quarter, half and three quarters past the middle of the taps.
+const std::array<std::array<double, TAPS>, PHASES>& interpolators()
+{
+    static const auto taps = [] {
+        std::array<std::array<double, TAPS>, PHASES> result;
+        for (int phase = 0; phase < PHASES; ++phase) {
+            double sum = 0.0;
+            for (int k = 0; k < TAPS; ++k) {
+                const auto d      = k - (TAPS / 2 - 1) - (phase + 1) / 4.0;
+                const auto sinc   = std::sin(PI * d) / (PI * d);
+                const auto window = 0.5 * (1.0 + std::cos(PI * d / (TAPS / 2)));
+                result[phase][k]  = sinc * window;
+                sum += result[phase][k];
+            }
+            for (auto& tap : result[phase]) {
+                tap /= sum;
+            }
+        }
+        return result;
+    }();
+    return taps;
+}
+
+} // namespace
+
+loudness_meter::loudness_meter(int channels, int sample_rate)
+    : channels_(std::max(channels, 1))
+    , pairs_(channels_ / 2)
+    , block_frames_(std::max(sample_rate / 10, 1))
+    , weights_(channels_, 1.0)
+    , state_(channels_ * 4, 0.0)
+    , energy_(channels_, 0.0)
+    , history_(channels_ * TAPS * 2, 0.0)
+    , peak_(channels_, 0.0)
+    , gate_counts_(GATE_STEPS, 0)
+    , gate_energy_(GATE_STEPS, 0.0)
+    , integrated_(-std::numeric_limits<double>::infinity())
+{
+    if (channels_ == 6 || channels_ == 8) {
+        weights_[3] = 0.0;
+        for (int ch = 4; ch < channels_; ++ch) {
+            weights_[ch] = 1.41;
+        }
+    }
+
+    // The K-weighting of BS.1770, a high shelf for the head followed by a high pass, at the rate of the channel.
+    const auto rate = static_cast<double>(std::max(sample_rate, 1));
+    {
+        const auto K  = std::tan(PI * 1681.974450955533 / rate);
+        const auto Q  = 0.7071752369554196;
+        const auto Vh = std::pow(10.0, 3.999843853973347 / 20.0);
+        const auto Vb = std::pow(Vh, 0.4996667741545416);
+        const auto a0 = 1.0 + K / Q + K * K;
+        shelf_        = {(Vh + Vb * K / Q + K * K) / a0,
+                         2.0 * (K * K - Vh) / a0,
+                         (Vh - Vb * K / Q + K * K) / a0,
+                         2.0 * (K * K - 1.0) / a0,
+                         (1.0 - K / Q + K * K) / a0};
+    }
+    {
+        const auto K  = std::tan(PI * 38.13547087602444 / rate);
+        const auto Q  = 0.5003270373238773;
+        const auto a0 = 1.0 + K / Q + K * K;
+        high_pass_    = {1.0, -2.0, 1.0, 2.0 * (K * K - 1.0) / a0, (1.0 - K / Q + K * K) / a0};
+    }
+}
+
+void loudness_meter::operator()(const double* samples, std::size_t frames, double scale)
+{
+    const auto& taps = interpolators();
+
+    while (frames > 0) {
+        const auto count = std::min(frames, block_frames_ - block_filled_);
+
+        // Both filters in transposed direct form II, two channels to a register.
+        auto filter = [&](auto load, auto store, auto set1, auto add, auto sub, auto mul, int ch) {
+            const auto scale_v = set1(scale);
+            const auto s_b0    = set1(shelf_.b0);
+            const auto s_b1    = set1(shelf_.b1);
+            const auto s_b2    = set1(shelf_.b2);
+            const auto s_a1    = set1(shelf_.a1);
+            const auto s_a2    = set1(shelf_.a2);
+            const auto h_a1    = set1(high_pass_.a1);
+            const auto h_a2    = set1(high_pass_.a2);
+            const auto two     = set1(2.0);
+
+            auto s1     = load(&state_[ch]);
+            auto s2     = load(&state_[channels_ + ch]);
+            auto h1     = load(&state_[channels_ * 2 + ch]);
+            auto h2     = load(&state_[channels_ * 3 + ch]);
+            auto energy = load(&energy_[ch]);
+
+            for (std::size_t n = 0; n < count; ++n) {
+                const auto x = mul(load(samples + n * channels_ + ch), scale_v);
+                const auto y = add(mul(s_b0, x), s1);
+                s1           = sub(add(mul(s_b1, x), s2), mul(s_a1, y));
+                s2           = sub(mul(s_b2, x), mul(s_a2, y));
+
+                // The high pass has b = 1, -2, 1.
+                const auto z = add(y, h1);
+                h1           = sub(sub(h2, mul(two, y)), mul(h_a1, z));
+                h2           = sub(y, mul(h_a2, z));
+
+                energy = add(energy, mul(z, z));
+            }
+
+            store(&state_[ch], s1);
+            store(&state_[channels_ + ch], s2);
+            store(&state_[channels_ * 2 + ch], h1);
+            store(&state_[channels_ * 3 + ch], h2);
+            store(&energy_[ch], energy);
+        };
+
+        for (int pair = 0; pair < pairs_; ++pair) {
+            filter([](const double* p) { return _mm_loadu_pd(p); },
+                   [](double* p, __m128d v) { _mm_storeu_pd(p, v); },
+                   [](double v) { return _mm_set1_pd(v); },
+                   [](__m128d a, __m128d b) { return _mm_add_pd(a, b); },
+                   [](__m128d a, __m128d b) { return _mm_sub_pd(a, b); },
+                   [](__m128d a, __m128d b) { return _mm_mul_pd(a, b); },
+                   pair * 2);
+        }
+        for (int ch = pairs_ * 2; ch < channels_; ++ch) {
+            filter([](const double* p) { return *p; },
+                   [](double* p, double v) { *p = v; },
+                   [](double v) { return v; },
+                   [](double a, double b) { return a + b; },
+                   [](double a, double b) { return a - b; },
+                   [](double a, double b) { return a * b; },
+                   ch);
+        }
+
+        // The last TAPS sample frames are kept twice in a row, so that they are always in one piece behind the newest.
+        const auto sign_mask = _mm_set1_pd(-0.0);
+        for (std::size_t n = 0; n < count; ++n) {
+            const auto source = samples + n * channels_;
+            auto       first  = history_.data() + history_pos_ * channels_;
+            auto       second = first + TAPS * channels_;
+            for (int ch = 0; ch < channels_; ++ch) {
+                first[ch] = second[ch] = source[ch] * scale;
+            }
+            history_pos_ = (history_pos_ + 1) % TAPS;
+
+            const auto window = history_.data() + history_pos_ * channels_;
+            for (int pair = 0; pair < pairs_; ++pair) {
+                const auto ch   = pair * 2;
+                auto       peak = _mm_andnot_pd(sign_mask, _mm_loadu_pd(second + ch));
+                for (int phase = 0; phase < PHASES; ++phase) {
+                    auto sum = _mm_setzero_pd();
+                    for (int k = 0; k < TAPS; ++k) {
+                        const auto tap = _mm_set1_pd(taps[phase][k]);
+                        sum            = _mm_add_pd(sum, _mm_mul_pd(tap, _mm_loadu_pd(window + k * channels_ + ch)));
+                    }
+                    peak = _mm_max_pd(peak, _mm_andnot_pd(sign_mask, sum));
+                }
+                _mm_storeu_pd(&peak_[ch], _mm_max_pd(_mm_loadu_pd(&peak_[ch]), peak));
+            }
+            for (int ch = pairs_ * 2; ch < channels_; ++ch) {
+                auto peak = std::abs(second[ch]);
+                for (int phase = 0; phase < PHASES; ++phase) {
+                    double sum = 0.0;
+                    for (int k = 0; k < TAPS; ++k) {
+                        sum += taps[phase][k] * window[k * channels_ + ch];
+                    }
+                    peak = std::max(peak, std::abs(sum));
+                }
+                peak_[ch] = std::max(peak_[ch], peak);
+            }
+        }
+
+        samples += count * channels_;
+        frames -= count;
+        block_filled_ += count;
+        if (block_filled_ == block_frames_) {
+            end_block();
+        }
+    }
+}
+
+void loudness_meter::end_block()
+{
+    double energy = 0.0;
+    for (int ch = 0; ch < channels_; ++ch) {
+        energy += weights_[ch] * energy_[ch] / static_cast<double>(block_frames_);
+        energy_[ch] = 0.0;
+    }
+    block_filled_ = 0;
+
+    blocks_[blocks_pos_] = energy;
+    blocks_pos_          = (blocks_pos_ + 1) % blocks_.size();
+    if (++blocks_count_ < 4) {
+        return;
+    }
+
+    // Gating blocks are 400 ms long and start every 100 ms.
+    double gating = 0.0;
+    for (std::size_t n = 1; n <= 4; ++n) {
+        gating += blocks_[(blocks_pos_ + blocks_.size() - n) % blocks_.size()] / 4.0;
+    }
+    const auto lufs = to_lufs(gating);
+    if (!(lufs > ABSOLUTE_GATE)) {
+        return;
+    }
+    const auto step = std::min(static_cast<int>((lufs - ABSOLUTE_GATE) * 10.0), GATE_STEPS - 1);
+    gate_counts_[step] += 1;
+    gate_energy_[step] += gating;
+
+    // The mean of the blocks above the absolute gate gives the relative gate 10 LU below it, and the mean of the
+    // blocks above that the integrated loudness.
+    std::uint64_t count = 0;
+    double        sum   = 0.0;
+    for (int n = 0; n < GATE_STEPS; ++n) {
+        count += gate_counts_[n];
+        sum += gate_energy_[n];
+    }
+    const auto relative = to_lufs(sum / static_cast<double>(count)) - 10.0;
+    const auto first    = std::max(0, static_cast<int>(std::ceil((relative - ABSOLUTE_GATE) * 10.0)));
+
+    count = 0;
+    sum   = 0.0;
+    for (int n = first; n < GATE_STEPS; ++n) {
+        count += gate_counts_[n];
+        sum += gate_energy_[n];
+    }
+    integrated_ = count > 0 ? to_lufs(sum / static_cast<double>(count)) : -std::numeric_limits<double>::infinity();
+}
+
+loudness loudness_meter::get() const
+{
+    auto mean = [&](std::size_t count) {
+        double sum = 0.0;
+        for (std::size_t n = 1; n <= count; ++n) {
+            sum += blocks_[(blocks_pos_ + blocks_.size() - n) % blocks_.size()];
+        }
+        return sum / static_cast<double>(count);
+    };
+
+    const auto peak = *std::max_element(peak_.begin(), peak_.end());
+
+    loudness result;
+    result.momentary  = to_lufs(mean(4));
+    result.short_term = to_lufs(mean(blocks_.size()));
+    result.integrated = integrated_;
+    result.true_peak  = peak > 0.0 ? 20.0 * std::log10(peak) : -std::numeric_limits<double>::infinity();
+    return result;
+}
+
+}} // namespace caspar::core
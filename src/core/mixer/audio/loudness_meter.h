@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace caspar { namespace core {
+
+// What the audio mixer of a channel measures the loudness of.
+enum class loudness_metering
+{
+    none,
+    channel, // the mix as it leaves the channel
+    layers,  // the mix and each layer on its own
+};
+
+struct loudness
+{
+    double momentary  = 0.0; // LUFS over the last 400 ms
+    double short_term = 0.0; // LUFS over the last 3 s
+    double integrated = 0.0; // gated LUFS since the meter started
+    double true_peak  = 0.0; // highest dBTP since the meter started
+};
+
+// Loudness and true peak after ITU-R BS.1770-4 and EBU R 128, measured as the audio goes by without keeping any of it.
+// The channels are taken to be in the ffmpeg default layout of their count, so 5.1 and 7.1 leave out the LFE and weigh
+// the surround channels higher. The levels are -inf while silent.
+class loudness_meter final
+{
+  public:
+    loudness_meter(int channels, int sample_rate);
+
+    // Interleaved samples, scale times which gives them from -1 to 1.
+    void operator()(const double* samples, std::size_t frames, double scale);
+
+    loudness get() const;
+
+  private:
+    struct biquad
+    {
+        double b0, b1, b2, a1, a2;
+    };
+
+    void end_block();
+
+    int                 channels_;
+    int                 pairs_; // channels filtered two at a time, the rest one at a time
+    std::size_t         block_frames_;
+    std::vector<double> weights_;
+    biquad              shelf_;
+    biquad              high_pass_;
+
+    // Filter states and energies of each channel, and the last sample frames for the true peak.
+    std::vector<double> state_;
+    std::vector<double> energy_;
+    std::vector<double> history_;
+    std::vector<double> peak_;
+    std::size_t         history_pos_  = 0;
+    std::size_t         block_filled_ = 0;
+
+    // The weighted mean square of the last 30 blocks of 100 ms, the last at blocks_pos_ - 1.
+    std::array<double, 30> blocks_{};
+    std::size_t            blocks_pos_   = 0;
+    std::uint64_t          blocks_count_ = 0;
+
+    // The gating blocks of 400 ms by their loudness in steps of 0.1 LU from -70 LUFS, each with its energy.
+    std::vector<std::uint64_t> gate_counts_;
+    std::vector<double>        gate_energy_;
+    double                     integrated_ = 0.0;
+};
+
+}} // namespace caspar::core
@@ -24,12 +24,32 @@
 #include <core/frame/frame.h>
 #include <core/frame/frame_factory.h>
 #include <core/frame/frame_visitor.h>
+#include <core/frame/pixel_format.h>
 
 #include <cstdint>
 #include <future>
+#include <map>
+#include <vector>
 
 namespace caspar { namespace core {
 
+// GPU time in seconds spent on a mixed frame.
+struct image_mixer_timings
+{
+    double                total   = 0.0;
+    double                convert = 0.0;
+    std::map<int, double> layers;
+};
+
+// Measures of a mixed frame, for telling black and frozen output and comparing the output of two servers.
+struct image_analysis
+{
+    bool          valid      = false;
+    double        luma       = 0.0;  // average Y' of the frame, from 0 to 1
+    double        difference = -1.0; // average difference in Y' to the frame before, negative without one
+    std::uint64_t hash       = 0;    // difference hash of a 9x8 thumbnail of Y', the same for frames that look alike
+};
+
 class image_mixer
     : public frame_visitor
     , public frame_factory
@@ -45,9 +65,59 @@ class image_mixer
     void visit(const class const_frame& frame) override     = 0;
     void pop() override                                     = 0;
 
-    virtual std::future<array<const uint8_t>> operator()(const struct video_format_desc& format_desc) = 0;
+    // Renders the visited frames and returns one image per requested format, in the same order, followed by one per
+    // scaled format, which are empty from mixers that can't scale. layers holds the stage layer index of every visited
+    // top level frame and is only used to label the timings.
+    virtual std::future<std::vector<array<const uint8_t>>>
+    operator()(const struct video_format_desc&          format_desc,
+               const std::vector<output_format>&        formats,
+               const std::vector<scaled_output_format>& scaled_formats,
+               const std::vector<int>&                  layers) = 0;
+
+    // Ends the first field of an interlaced frame: the next call to operator() draws the frames visited before as the
+    // first field and those visited after as the second, and weaves them into each image, the first field on the lines
+    // is_upper_field_first gives it. Returns false for mixers that can't, which go on collecting the frames as one.
+    virtual bool end_field() { return false; }
+
+    // Gets what mixing in another format needs ready ahead of the first frame in it, such as buffers and images of its
+    // size, so the tick that switches to it doesn't wait for them. A hint only, safe to call while the channel is
+    // mixing.
+    virtual void prepare(const struct video_format_desc& format_desc) {}
+
+    // Draws a frame into a bgra image of the format's size on the gpu, for frames shown again by other channels. The
+    // image is only drawn by the mixers for which shares_textures is true. Empty if the mixer can't or there is
+    // nothing to draw. Safe to call while the channel is mixing.
+    virtual const_frame render(const class draw_frame& frame, const struct video_format_desc& format_desc)
+    {
+        return {};
+    }
+
+    // Draws a frame like render and reads the image back in one of the output formats, for frames leaving the gpu such
+    // as those sent to other servers. Empty if the mixer can't or there is nothing to draw. Safe to call while the
+    // channel is mixing.
+    virtual std::future<array<const uint8_t>>
+    read(const class draw_frame& frame, const struct video_format_desc& format_desc, output_format format)
+    {
+        std::promise<array<const uint8_t>> empty;
+        empty.set_value({});
+        return empty.get_future();
+    }
+
+    // Whether the mixer behind the frame factory can draw the images from render.
+    virtual bool shares_textures(const frame_factory& other) const { return false; }
+
+    // Timings of the most recent frame whose GPU work has completed, which lags rendering by a few frames.
+    virtual image_mixer_timings timings() const { return {}; }
+
+    // Analysis of the most recent frame read back, like timings lagging rendering. Invalid unless the mixer was
+    // created to analyze its frames.
+    virtual image_analysis analysis() const { return {}; }
 
     class mutable_frame create_frame(const void* tag, const struct pixel_format_desc& desc) override = 0;
+    array<std::uint8_t> create_array(int size) override                                               = 0;
+    class mutable_frame create_frame(const void*                     tag,
+                                     const struct pixel_format_desc& desc,
+                                     image_data_t                    image_data) override             = 0;
 };
 
 }} // namespace caspar::core
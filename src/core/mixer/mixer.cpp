@@ -29,63 +29,236 @@
 #include "image/image_mixer.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/env.h>
 
 #include <core/frame/draw_frame.h>
 #include <core/frame/frame_transform.h>
+#include <core/frame/frame_visitor.h>
 #include <core/frame/pixel_format.h>
 #include <core/video_format.h>
 
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
 #include <unordered_map>
 #include <vector>
 
 namespace caspar { namespace core {
 
+// The oldest capture time of the live sources drawn into a channel frame.
+class capture_time_visitor final : public frame_visitor
+{
+  public:
+    std::chrono::steady_clock::time_point oldest;
+
+    void push(const frame_transform& transform) override {}
+    void pop() override {}
+
+    void visit(const const_frame& frame) override
+    {
+        const auto capture_time = frame.capture_time();
+        if (capture_time != std::chrono::steady_clock::time_point() &&
+            (oldest == std::chrono::steady_clock::time_point() || capture_time < oldest)) {
+            oldest = capture_time;
+        }
+    }
+};
+
 struct mixer::impl
 {
     monitor::state                       state_;
     int                                  channel_index_;
     spl::shared_ptr<diagnostics::graph>  graph_;
-    audio_mixer                          audio_mixer_{graph_};
+    audio_mixer                          audio_mixer_;
     spl::shared_ptr<image_mixer>         image_mixer_;
     std::queue<std::future<const_frame>> buffer_;
 
+    // Frames mixed ahead of the one handed to the consumers, each with its readback in flight on the device.
+    const int readback_depth_ = std::max(0, env::properties().get(L"configuration.mixer.readback-depth", 0));
+
+    // Both fields of interlaced frames are drawn before they are read back as one woven image.
+    const bool weave_fields_ = env::properties().get(L"configuration.mixer.weave-fields", false);
+
     impl(const impl&)            = delete;
     impl& operator=(const impl&) = delete;
 
-    impl(int channel_index, spl::shared_ptr<diagnostics::graph> graph, spl::shared_ptr<image_mixer> image_mixer)
+    impl(int                                 channel_index,
+         spl::shared_ptr<diagnostics::graph> graph,
+         spl::shared_ptr<image_mixer>        image_mixer,
+         loudness_metering                   metering)
         : channel_index_(channel_index)
         , graph_(std::move(graph))
+        , audio_mixer_(graph_, channel_index, metering)
         , image_mixer_(std::move(image_mixer))
     {
+        graph_->set_color("gpu-time", diagnostics::color(0.6f, 0.3f, 0.9f, 0.8f));
     }
 
-    const_frame operator()(std::vector<draw_frame> frames, const video_format_desc& format_desc, int nb_samples)
+    const_frame operator()(std::vector<draw_frame>                  frames,
+                           const std::vector<int>&                  layers,
+                           const video_format_desc&                 format_desc,
+                           int                                      nb_samples,
+                           const std::vector<output_format>&        formats,
+                           const std::vector<scaled_output_format>& scaled_formats)
     {
-        for (auto& frame : frames) {
+        capture_time_visitor capture_time;
+        visit(frames, layers, capture_time);
+
+        auto image = (*image_mixer_)(format_desc, formats, scaled_formats, layers).share();
+        auto audio = audio_mixer_(format_desc, nb_samples);
+        update_state(format_desc);
+
+        push(std::move(image), std::move(audio), format_desc, formats, scaled_formats, capture_time.oldest);
+
+        // Frames from before a change to a shallower depth are handed on one per tick all the same.
+        const auto depth = static_cast<size_t>(readback_depth_ > 0 ? readback_depth_ : format_desc.field_count);
+        if (buffer_.size() <= depth) {
+            return const_frame{};
+        }
+        return pop();
+    }
+
+    std::pair<const_frame, const_frame> operator()(std::vector<draw_frame>                  frames,
+                                                   std::vector<draw_frame>                  frames2,
+                                                   const std::vector<int>&                  layers,
+                                                   const video_format_desc&                 format_desc,
+                                                   int                                      nb_samples,
+                                                   const std::vector<output_format>&        formats,
+                                                   const std::vector<scaled_output_format>& scaled_formats)
+    {
+        if (!weave_fields_) {
+            auto frame1 = (*this)(std::move(frames), layers, format_desc, nb_samples, formats, scaled_formats);
+            auto frame2 = (*this)(std::move(frames2), layers, format_desc, nb_samples, formats, scaled_formats);
+            return {std::move(frame1), std::move(frame2)};
+        }
+
+        capture_time_visitor capture_time;
+        visit(frames, layers, capture_time);
+        auto audio1 = audio_mixer_(format_desc, nb_samples);
+
+        // Mixers that can't weave draw and read back the first field as a frame of its own.
+        std::shared_future<std::vector<array<const std::uint8_t>>> image1;
+        if (!image_mixer_->end_field()) {
+            image1 = (*image_mixer_)(format_desc, formats, scaled_formats, layers).share();
+        }
+        const auto capture_time1 = capture_time.oldest;
+
+        visit(frames2, layers, capture_time);
+        auto image2 = (*image_mixer_)(format_desc, formats, scaled_formats, layers).share();
+        auto audio2 = audio_mixer_(format_desc, nb_samples);
+        update_state(format_desc);
+
+        // Woven, both fields hold the whole image and each the audio of its field.
+        const auto woven = !image1.valid();
+        push(woven ? image2 : std::move(image1),
+             std::move(audio1),
+             format_desc,
+             formats,
+             scaled_formats,
+             woven ? capture_time.oldest : capture_time1);
+        push(std::move(image2), std::move(audio2), format_desc, formats, scaled_formats, capture_time.oldest);
+
+        // Counted in fields like above, a pair of them is handed on once more than the depth are in flight.
+        const auto depth = static_cast<size_t>(readback_depth_ > 0 ? readback_depth_ : format_desc.field_count);
+        if (buffer_.size() <= depth + 1) {
+            return {};
+        }
+        auto frame1 = pop();
+        auto frame2 = pop();
+        return {std::move(frame1), std::move(frame2)};
+    }
+
+    void visit(std::vector<draw_frame>& frames, const std::vector<int>& layers, capture_time_visitor& capture_time)
+    {
+        for (size_t n = 0; n < frames.size(); ++n) {
+            auto& frame = frames[n];
+            audio_mixer_.begin_layer(n < layers.size() ? layers[n] : 0);
             frame.accept(audio_mixer_);
             frame.transform().image_transform.layer_depth = 1;
             frame.accept(*image_mixer_);
+            frame.accept(capture_time);
         }
+    }
 
-        auto image = (*image_mixer_)(format_desc);
-        auto audio = audio_mixer_(format_desc, nb_samples);
+    void update_state(const video_format_desc& format_desc)
+    {
+        auto timings = image_mixer_->timings();
+        graph_->set_value("gpu-time", timings.total * format_desc.hz * 0.5);
+
+        monitor::state gpu;
+        gpu["time"]    = timings.total * 1000.0;
+        gpu["convert"] = timings.convert * 1000.0;
+        for (auto& p : timings.layers) {
+            gpu["layer"][p.first] = p.second * 1000.0;
+        }
 
         state_["audio"] = audio_mixer_.state();
+        state_["gpu"]   = gpu;
+
+        // Sent with every tick, so that monitoring compares the output of a main and a backup without decoding it.
+        auto analysis = image_mixer_->analysis();
+        if (analysis.valid) {
+            monitor::state image;
+            image["luma"] = analysis.luma;
+            if (analysis.difference >= 0.0) {
+                image["difference"] = analysis.difference;
+            }
+            image["hash"]      = analysis.hash;
+            state_["analysis"] = image;
+        }
+    }
 
+    void push(std::shared_future<std::vector<array<const std::uint8_t>>> image,
+              array<const int32_t>                                        audio,
+              const video_format_desc&                                    format_desc,
+              const std::vector<output_format>&                           formats,
+              const std::vector<scaled_output_format>&                    scaled_formats,
+              std::chrono::steady_clock::time_point                       capture_time)
+    {
         buffer_.push(std::async(
             std::launch::deferred,
-            [image = std::move(image), audio = std::move(audio), graph = graph_, format_desc, tag = this]() mutable {
+            [image = std::move(image),
+             audio = std::move(audio),
+             format_desc,
+             formats,
+             scaled_formats,
+             capture_time]() mutable {
                 auto desc = pixel_format_desc(pixel_format::bgra);
                 desc.planes.push_back(pixel_format_desc::plane(format_desc.width, format_desc.height, 4));
-                std::vector<array<const uint8_t>> image_data;
-                image_data.emplace_back(std::move(image.get()));
-                return const_frame(std::move(image_data), std::move(audio), desc);
-            }));
 
-        if (buffer_.size() <= format_desc.field_count) {
-            return const_frame{};
-        }
+                // Plane 0 stays empty when no consumer wants bgra, the converted images are all they read.
+                const_image_data_t                                 image_data(1);
+                std::map<output_format, array<const std::uint8_t>> converted_data;
+
+                auto images = image.get();
+                for (size_t n = 0; n < formats.size(); ++n) {
+                    if (formats[n] == output_format::bgra) {
+                        image_data[0] = std::move(images[n]);
+                    } else {
+                        converted_data.emplace(formats[n], std::move(images[n]));
+                    }
+                }
 
+
+                // The scaled images follow those of the channel's size.
+                std::map<scaled_output_format, array<const std::uint8_t>> scaled_data;
+                for (size_t n = 0; n < scaled_formats.size() && formats.size() + n < images.size(); ++n) {
+                    scaled_data.emplace(scaled_formats[n], std::move(images[formats.size() + n]));
+                }
+
+                return const_frame(std::move(image_data),
+                                   std::move(audio),
+                                   desc,
+                                   std::move(converted_data),
+                                   capture_time,
+                                   std::move(scaled_data));
+            }));
+    }
+
+    const_frame pop()
+    {
         auto frame = std::move(buffer_.front().get());
         buffer_.pop();
         return frame;
@@ -94,17 +267,38 @@ struct mixer::impl
     void set_master_volume(float volume) { audio_mixer_.set_master_volume(volume); }
 
     float get_master_volume() { return audio_mixer_.get_master_volume(); }
+
+    void reset_loudness() { audio_mixer_.reset_loudness(); }
 };
 
-mixer::mixer(int channel_index, spl::shared_ptr<diagnostics::graph> graph, spl::shared_ptr<image_mixer> image_mixer)
-    : impl_(new impl(channel_index, std::move(graph), std::move(image_mixer)))
+mixer::mixer(int                                 channel_index,
+             spl::shared_ptr<diagnostics::graph> graph,
+             spl::shared_ptr<image_mixer>        image_mixer,
+             loudness_metering                   metering)
+    : impl_(new impl(channel_index, std::move(graph), std::move(image_mixer), metering))
 {
 }
 void        mixer::set_master_volume(float volume) { impl_->set_master_volume(volume); }
 float       mixer::get_master_volume() { return impl_->get_master_volume(); }
-const_frame mixer::operator()(std::vector<draw_frame> frames, const video_format_desc& format_desc, int nb_samples)
+void        mixer::reset_loudness() { impl_->reset_loudness(); }
+const_frame mixer::operator()(std::vector<draw_frame>                  frames,
+                              const std::vector<int>&                  layers,
+                              const video_format_desc&                 format_desc,
+                              int                                      nb_samples,
+                              const std::vector<output_format>&        formats,
+                              const std::vector<scaled_output_format>& scaled_formats)
+{
+    return (*impl_)(std::move(frames), layers, format_desc, nb_samples, formats, scaled_formats);
+}
+std::pair<const_frame, const_frame> mixer::operator()(std::vector<draw_frame>                  frames,
+                                                      std::vector<draw_frame>                  frames2,
+                                                      const std::vector<int>&                  layers,
+                                                      const video_format_desc&                 format_desc,
+                                                      int                                      nb_samples,
+                                                      const std::vector<output_format>&        formats,
+                                                      const std::vector<scaled_output_format>& scaled_formats)
 {
-    return (*impl_)(std::move(frames), format_desc, nb_samples);
+    return (*impl_)(std::move(frames), std::move(frames2), layers, format_desc, nb_samples, formats, scaled_formats);
 }
 mutable_frame mixer::create_frame(const void* tag, const pixel_format_desc& desc)
 {
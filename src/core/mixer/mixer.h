@@ -25,8 +25,13 @@
 #include <common/memory.h>
 
 #include <core/fwd.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/audio/loudness_meter.h>
 #include <core/monitor/monitor.h>
 
+#include <utility>
+#include <vector>
+
 FORWARD2(caspar, diagnostics, class graph);
 
 namespace caspar { namespace core {
@@ -39,13 +44,34 @@ class mixer final
   public:
     explicit mixer(int                                         channel_index,
                    spl::shared_ptr<caspar::diagnostics::graph> graph,
-                   spl::shared_ptr<image_mixer>                image_mixer);
+                   spl::shared_ptr<image_mixer>                image_mixer,
+                   loudness_metering                           metering = loudness_metering::none);
+
+    // Mixes the frames, with the image converted to each of the formats for the consumers, and scaled and converted
+    // to each of the scaled formats. layers holds the stage layer index of each frame.
+    const_frame operator()(std::vector<draw_frame>                  frames,
+                           const std::vector<int>&                  layers,
+                           const video_format_desc&                 format_desc,
+                           int                                      nb_samples,
+                           const std::vector<output_format>&        formats,
+                           const std::vector<scaled_output_format>& scaled_formats);
 
-    const_frame operator()(std::vector<draw_frame> frames, const video_format_desc& format_desc, int nb_samples);
+    // Mixes both fields of an interlaced frame. With configuration.mixer.weave-fields they are woven into one image,
+    // see image_mixer::end_field, which both frames hold with the audio of their field.
+    std::pair<const_frame, const_frame> operator()(std::vector<draw_frame>                  frames,
+                                                   std::vector<draw_frame>                  frames2,
+                                                   const std::vector<int>&                  layers,
+                                                   const video_format_desc&                 format_desc,
+                                                   int                                      nb_samples,
+                                                   const std::vector<output_format>&        formats,
+                                                   const std::vector<scaled_output_format>& scaled_formats);
 
     void  set_master_volume(float volume);
     float get_master_volume();
 
+    // Starts the integrated loudness and true peak of the channel and its layers over.
+    void reset_loudness();
+
     mutable_frame create_frame(const void* tag, const pixel_format_desc& desc);
 
     core::monitor::state state() const;
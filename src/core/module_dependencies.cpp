@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StdAfx.h"
+
+#include "module_dependencies.h"
+
+#include <common/env.h>
+
+#include <boost/property_tree/ptree.hpp>
+
+namespace caspar { namespace core {
+
+module_init get_module_init()
+{
+    const auto value = env::properties().get(L"configuration.module-init", L"background");
+    if (value == L"eager") {
+        return module_init::eager;
+    }
+    return value == L"lazy" ? module_init::lazy : module_init::background;
+}
+
+}} // namespace caspar::core
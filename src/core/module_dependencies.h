@@ -49,4 +49,16 @@ struct module_dependencies
     }
 };
 
+// When a module starts what is slow to start or holds much memory, such as a browser or a driver, by
+// configuration.module-init. Eager starts it with the module, lazy when its producer or consumer is first created, and
+// background likewise except for modules with a section in the configuration, which start off the boot thread.
+enum class module_init
+{
+    eager,
+    lazy,
+    background
+};
+
+module_init get_module_init();
+
 }} // namespace caspar::core
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2013 Sveriges Television AB http://casparcg.com/
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "monitor.h"
+
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace caspar { namespace core { namespace monitor {
+
+namespace {
+
+const std::string& empty_string()
+{
+    static const std::string empty;
+    return empty;
+}
+
+// Every key ever built. The set is node based so the strings never move, and keys are never removed, since the same
+// paths come back on every tick.
+struct intern_table
+{
+    std::mutex                      mutex;
+    std::unordered_set<std::string> strings;
+};
+
+intern_table& table()
+{
+    static intern_table instance;
+    return instance;
+}
+
+struct join_hash
+{
+    std::size_t operator()(const std::pair<const std::string*, const std::string*>& p) const
+    {
+        auto h = std::hash<const std::string*>()(p.first);
+        return h ^ (std::hash<const std::string*>()(p.second) + 0x9e3779b9 + (h << 6) + (h >> 2));
+    }
+};
+
+} // namespace
+
+key::key()
+    : str_(&empty_string())
+{
+}
+
+key key::intern(std::string_view str)
+{
+    if (str.empty())
+        return key();
+
+    // Each thread looks its keys up without taking the lock once it has seen them.
+    thread_local std::unordered_map<std::string_view, const std::string*> cache;
+
+    auto it = cache.find(str);
+    if (it != cache.end())
+        return key(it->second);
+
+    const std::string* interned;
+    {
+        auto&                       t = table();
+        std::lock_guard<std::mutex> lock(t.mutex);
+        interned = &*t.strings.emplace(str).first;
+    }
+
+    cache.emplace(std::string_view(*interned), interned);
+    return key(interned);
+}
+
+key key::join(key parent, key child)
+{
+    thread_local std::unordered_map<std::pair<const std::string*, const std::string*>, const std::string*, join_hash>
+        cache;
+
+    auto it = cache.find(std::make_pair(parent.str_, child.str_));
+    if (it != cache.end())
+        return key(it->second);
+
+    std::string joined;
+    joined.reserve(parent.str().size() + 1 + child.str().size());
+    joined += parent.str();
+    joined += '/';
+    joined += child.str();
+
+    auto result = intern(joined);
+    cache.emplace(std::make_pair(parent.str_, child.str_), result.str_);
+    return result;
+}
+
+}}} // namespace caspar::core::monitor
@@ -23,8 +23,12 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/variant.hpp>
 
+#include <charconv>
 #include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
 #include <boost/container/flat_map.hpp>
@@ -32,92 +36,157 @@
 
 namespace caspar { namespace core { namespace monitor {
 
+/**
+ * A path like "stage/layer/10/foreground/producer". Keys are interned, so building the same path again on the next
+ * tick is a table lookup instead of a string concatenation, and equal keys share one string for the life of the
+ * process.
+ */
+class key
+{
+    const std::string* str_;
+
+    explicit key(const std::string* str)
+        : str_(str)
+    {
+    }
+
+  public:
+    key();
+
+    static key intern(std::string_view str);
+    static key join(key parent, key child); // parent + "/" + child
+
+    template <typename T>
+    static key segment(const T& value)
+    {
+        if constexpr (std::is_same_v<T, key>) {
+            return value;
+        } else if constexpr (std::is_integral_v<T> && !std::is_same_v<T, bool>) {
+            char buffer[24];
+            auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+            return intern(std::string_view(buffer, result.ptr - buffer));
+        } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+            return intern(std::string_view(value));
+        } else {
+            return intern(boost::lexical_cast<std::string>(value));
+        }
+    }
+
+    const std::string& str() const { return *str_; }
+    const char*        c_str() const { return str_->c_str(); }
+    bool               empty() const { return str_->empty(); }
+
+    operator const std::string&() const { return *str_; }
+
+    friend bool operator==(key lhs, key rhs) { return lhs.str_ == rhs.str_; }
+    friend bool operator!=(key lhs, key rhs) { return lhs.str_ != rhs.str_; }
+    friend bool operator<(key lhs, key rhs) { return lhs.str_ != rhs.str_ && *lhs.str_ < *rhs.str_; }
+};
+
 using data_t = boost::
     variant<bool, std::int32_t, std::int64_t, std::uint32_t, std::uint64_t, float, double, std::string, std::wstring>;
 using vector_t   = boost::container::small_vector<data_t, 2>;
-using data_map_t = boost::container::flat_map<std::string, vector_t>;
+using data_map_t = boost::container::flat_map<key, vector_t>;
 
+/**
+ * Copies share their data until one of them is written to, so handing the state of a layer, the stage or a channel
+ * on each tick does not copy it.
+ */
 class state
 {
-    data_map_t data_;
+    std::shared_ptr<data_map_t> data_;
+
+    data_map_t& mutable_data()
+    {
+        if (!data_)
+            data_ = std::make_shared<data_map_t>();
+        else if (data_.use_count() > 1)
+            data_ = std::make_shared<data_map_t>(*data_);
+        return *data_;
+    }
+
+    static const data_map_t& empty_data()
+    {
+        static const data_map_t empty;
+        return empty;
+    }
+
+    const data_map_t& data() const { return data_ ? *data_ : empty_data(); }
 
     class state_proxy
     {
-        std::string key_;
-        data_map_t& data_;
+        key    key_;
+        state& state_;
 
       public:
-        state_proxy(const std::string& key, data_map_t& data)
-            : key_(key)
-            , data_(data)
+        state_proxy(key path, state& owner)
+            : key_(path)
+            , state_(owner)
         {
         }
 
         state_proxy& operator=(data_t data)
         {
-            data_[key_] = {std::move(data)};
+            state_.mutable_data()[key_] = {std::move(data)};
             return *this;
         }
 
         state_proxy& operator=(vector_t data)
         {
-            data_[key_] = std::move(data);
+            state_.mutable_data()[key_] = std::move(data);
             return *this;
         }
 
         template <typename T>
-        state_proxy operator[](const T& key)
+        state_proxy operator[](const T& name)
         {
-            return state_proxy(key_ + "/" + boost::lexical_cast<std::string>(key), data_);
+            return state_proxy(key::join(key_, key::segment(name)), state_);
         }
 
         template <typename T>
         state_proxy& operator=(const std::vector<T>& data)
         {
-            data_[key_] = vector_t(data.begin(), data.end());
+            state_.mutable_data()[key_] = vector_t(data.begin(), data.end());
             return *this;
         }
 
         state_proxy& operator=(std::initializer_list<data_t> data)
         {
-            data_[key_] = vector_t(std::move(data));
+            state_.mutable_data()[key_] = vector_t(std::move(data));
             return *this;
         }
 
         state_proxy& operator=(const state& other)
         {
+            auto& data = state_.mutable_data();
+            data.reserve(data.size() + other.data().size());
             for (auto& p : other) {
-                data_[key_ + "/" + p.first] = std::move(p.second);
+                data[key::join(key_, p.first)] = p.second;
             }
             return *this;
         }
     };
 
   public:
-    state() = default;
-    state(const state& other)
-        : data_(other.data_)
-    {
-    }
+    state()                   = default;
+    state(const state& other) = default;
+    state(state&& other)      = default;
     state(data_map_t data)
-        : data_(std::move(data))
-    {
-    }
-    state& operator=(const state& other)
+        : data_(std::make_shared<data_map_t>(std::move(data)))
     {
-        data_ = other.data_;
-        return *this;
     }
+    state& operator=(const state& other) = default;
+    state& operator=(state&& other)      = default;
 
     template <typename T>
-    state_proxy operator[](const T& key)
+    state_proxy operator[](const T& name)
     {
-        return state_proxy(boost::lexical_cast<std::string>(key), data_);
+        return state_proxy(key::segment(name), *this);
     }
 
-    data_map_t::const_iterator begin() const { return data_.begin(); }
+    data_map_t::const_iterator begin() const { return data().begin(); }
 
-    data_map_t::const_iterator end() const { return data_.end(); }
+    data_map_t::const_iterator end() const { return data().end(); }
 };
 
 }}} // namespace caspar::core::monitor
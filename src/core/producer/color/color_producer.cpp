@@ -85,6 +85,7 @@ class color_producer : public frame_producer
     color_producer(const spl::shared_ptr<core::frame_factory>& frame_factory, uint32_t value)
         : frame_(create_color_frame(this, frame_factory, value))
     {
+        set_static(true);
         CASPAR_LOG(info) << print() << L" Initialized";
     }
 
@@ -92,6 +93,7 @@ class color_producer : public frame_producer
         : color_str_(boost::join(colors, L", "))
         , frame_(create_color_frame(this, frame_factory, colors))
     {
+        set_static(true);
         CASPAR_LOG(info) << print() << L" Initialized";
     }
 
@@ -34,12 +34,38 @@
 #include <common/future.h>
 #include <common/memory.h>
 
+#include <boost/algorithm/string/case_conv.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <limits>
+#include <map>
+#include <mutex>
 
 namespace caspar { namespace core {
+struct registered_factory
+{
+    producer_factory_t    factory;
+    producer_factory_keys keys;
+
+    bool is_keyed() const { return !keys.keywords.empty() || !keys.schemes.empty() || !keys.extensions.empty(); }
+};
+
 struct frame_producer_registry::impl
 {
-    std::vector<producer_factory_t> producer_factories;
+    std::vector<registered_factory>     producer_factories;
+    std::vector<media_info_extractor_t> media_info_extractors;
+    std::vector<thumbnail_extractor_t>  thumbnail_extractors;
+    std::vector<thumbnail_writer_t>     thumbnail_writers;
+    media_resolver_t                    media_resolver;
+
+    // Names whose _A and _ALPHA keys recently had no producer, with when to look for them again.
+    std::mutex                                                     missing_keys_mutex;
+    std::map<std::wstring, std::chrono::steady_clock::time_point> missing_keys;
 };
 
 frame_producer_registry::frame_producer_registry()
@@ -49,7 +75,87 @@ frame_producer_registry::frame_producer_registry()
 
 void frame_producer_registry::register_producer_factory(std::wstring name, const producer_factory_t& factory)
 {
-    impl_->producer_factories.push_back(factory);
+    impl_->producer_factories.push_back({factory, {}});
+}
+
+void frame_producer_registry::register_producer_factory(std::wstring                 name,
+                                                        const producer_factory_t&    factory,
+                                                        const producer_factory_keys& keys)
+{
+    auto lowered = keys;
+    for (auto& scheme : lowered.schemes)
+        boost::to_lower(scheme);
+    for (auto& extension : lowered.extensions)
+        boost::to_lower(extension);
+    impl_->producer_factories.push_back({factory, std::move(lowered)});
+}
+
+void frame_producer_registry::set_media_resolver(const media_resolver_t& resolver) { impl_->media_resolver = resolver; }
+
+void frame_producer_registry::register_media_info_extractor(const media_info_extractor_t& extractor)
+{
+    impl_->media_info_extractors.push_back(extractor);
+}
+
+bool frame_producer_registry::extract_media_info(const std::wstring& file, media_info& info) const
+{
+    for (auto& extractor : impl_->media_info_extractors) {
+        try {
+            if (extractor(file, info))
+                return true;
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+
+    return false;
+}
+
+void frame_producer_registry::register_thumbnail_extractor(const thumbnail_extractor_t& extractor)
+{
+    impl_->thumbnail_extractors.push_back(extractor);
+}
+
+void frame_producer_registry::register_thumbnail_writer(const thumbnail_writer_t& writer)
+{
+    impl_->thumbnail_writers.push_back(writer);
+}
+
+bool frame_producer_registry::has_thumbnail_support() const
+{
+    return !impl_->thumbnail_extractors.empty() && !impl_->thumbnail_writers.empty();
+}
+
+const_frame frame_producer_registry::extract_thumbnail(const std::wstring& file, frame_factory& frame_factory) const
+{
+    for (auto& extractor : impl_->thumbnail_extractors) {
+        try {
+            auto frame = extractor(file, frame_factory);
+            if (frame)
+                return frame;
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+
+    return {};
+}
+
+bool frame_producer_registry::write_thumbnail(const array<const std::uint8_t>& bgra,
+                                              int                              width,
+                                              int                              height,
+                                              const std::wstring&              file) const
+{
+    for (auto& writer : impl_->thumbnail_writers) {
+        try {
+            if (writer(bgra, width, height, file))
+                return true;
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+
+    return false;
 }
 
 frame_producer_dependencies::frame_producer_dependencies(
@@ -100,13 +206,106 @@ const spl::shared_ptr<frame_producer>& frame_producer::empty()
     return producer;
 }
 
-std::shared_ptr<executor>& producer_destroyer()
+// Destroying a producer can take a long time (joining decoder threads, closing devices or browsers), so it is done on
+// a few worker threads instead of the channel thread that released the last reference. Handing producers over never
+// blocks or throws. When more producers are pending than the workers are expected to get through, new producers are
+// held back while they are being created instead, where waiting doesn't cost a channel a frame.
+class producer_destroyer
 {
-    static auto destroyer = [] {
-        auto result = std::make_shared<executor>(L"Producer destroyer");
-        result->set_capacity(std::numeric_limits<unsigned int>::max());
-        return result;
-    }();
+    static constexpr std::size_t workers_count_    = 4;
+    static constexpr std::size_t capacity_         = 16;
+    static constexpr int         max_wait_seconds_ = 5;
+
+    std::mutex              mutex_;
+    std::condition_variable drained_;
+    std::size_t             pending_ = 0;
+
+    // Last, so the workers are joined, destroying what is still queued, while the rest is alive.
+    std::vector<std::unique_ptr<executor>> workers_;
+
+  public:
+    producer_destroyer()
+    {
+        for (std::size_t n = 0; n < workers_count_; ++n) {
+            workers_.push_back(std::make_unique<executor>(L"Producer destroyer " + std::to_wstring(n)));
+            workers_.back()->set_capacity(std::numeric_limits<unsigned int>::max());
+        }
+    }
+
+    void destroy(std::shared_ptr<frame_producer>&& producer) noexcept
+    {
+        // Shared with the task, so a producer that can't be handed to a worker is still released here.
+        std::shared_ptr<std::shared_ptr<frame_producer>> holder;
+        bool                                             counted = false;
+        try {
+            holder = std::make_shared<std::shared_ptr<frame_producer>>(std::move(producer));
+
+            auto worker = std::min_element(workers_.begin(), workers_.end(), [](auto& lhs, auto& rhs) {
+                return lhs->size() < rhs->size();
+            });
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (++pending_ == capacity_ + 1)
+                    CASPAR_LOG(warning) << L"More than " << capacity_
+                                        << L" producers waiting to be destroyed, holding back new producers.";
+                counted = true;
+            }
+
+            (*worker)->begin_invoke([this, holder] {
+                auto str = (*holder)->print();
+                try {
+                    if (holder->use_count() != 1)
+                        CASPAR_LOG(debug) << str << L" Not destroyed on asynchronous destruction thread: "
+                                          << holder->use_count();
+                    else
+                        CASPAR_LOG(debug) << str << L" Destroying on asynchronous destruction thread.";
+                } catch (...) {
+                }
+
+                try {
+                    holder->reset();
+                    CASPAR_LOG(info) << str << L" Destroyed.";
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+
+                release();
+            });
+        } catch (...) {
+            // Only when shutting down, the producer is then destroyed on the calling thread.
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            holder.reset();
+            if (counted)
+                release();
+        }
+    }
+
+    void wait_for_capacity()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (pending_ <= capacity_)
+            return;
+
+        if (!drained_.wait_for(lock, std::chrono::seconds(max_wait_seconds_), [this] { return pending_ <= capacity_; }))
+            CASPAR_LOG(warning) << L"Producers are destroyed slower than they are created, " << pending_
+                                << L" still pending.";
+    }
+
+  private:
+    void release()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --pending_;
+        }
+        drained_.notify_all();
+    }
+};
+
+std::shared_ptr<producer_destroyer>& destroyer()
+{
+    static auto destroyer = std::make_shared<producer_destroyer>();
 
     return destroyer;
 }
@@ -121,8 +320,14 @@ std::atomic<bool>& destroy_producers_in_separate_thread()
 void destroy_producers_synchronously()
 {
     destroy_producers_in_separate_thread() = false;
-    // Join destroyer, executing rest of producers in queue synchronously.
-    producer_destroyer().reset();
+    // Join destroyers, executing rest of producers in queue synchronously.
+    destroyer().reset();
+}
+
+void destroy_producers_asynchronously()
+{
+    if (!destroyer())
+        destroyer() = std::make_shared<producer_destroyer>();
 }
 
 class destroy_producer_proxy : public frame_producer
@@ -133,6 +338,7 @@ class destroy_producer_proxy : public frame_producer
     destroy_producer_proxy(spl::shared_ptr<frame_producer>&& producer)
         : producer_(std::move(producer))
     {
+        set_static(producer_->is_static());
         destroy_producers_in_separate_thread() = true;
     }
 
@@ -141,34 +347,12 @@ class destroy_producer_proxy : public frame_producer
         if (producer_ == core::frame_producer::empty() || !destroy_producers_in_separate_thread())
             return;
 
-        auto destroyer = producer_destroyer();
+        auto pool = destroyer();
 
-        if (!destroyer)
+        if (!pool)
             return;
 
-        CASPAR_VERIFY(destroyer->size() < 8);
-
-        auto producer = new spl::shared_ptr<frame_producer>(std::move(producer_));
-
-        destroyer->begin_invoke([=] {
-            std::unique_ptr<spl::shared_ptr<frame_producer>> pointer_guard(producer);
-            auto                                             str = (*producer)->print();
-            try {
-                if (!producer->unique())
-                    CASPAR_LOG(debug) << str << L" Not destroyed on asynchronous destruction thread: "
-                                      << producer->use_count();
-                else
-                    CASPAR_LOG(debug) << str << L" Destroying on asynchronous destruction thread.";
-            } catch (...) {
-            }
-
-            try {
-                pointer_guard.reset();
-                CASPAR_LOG(info) << str << L" Destroyed.";
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
-            }
-        });
+        pool->destroy(std::move(producer_));
     }
 
     draw_frame receive_impl(const core::video_field field, int nb_samples) override
@@ -182,11 +366,13 @@ class destroy_producer_proxy : public frame_producer
     {
         return producer_->leading_producer(producer);
     }
+    void render_transform(const frame_transform& transform) override { producer_->render_transform(transform); }
     uint32_t             frame_number() const override { return producer_->frame_number(); }
     uint32_t             nb_frames() const override { return producer_->nb_frames(); }
     draw_frame           last_frame(const core::video_field field) override { return producer_->last_frame(field); }
     draw_frame           first_frame(const core::video_field field) override { return producer_->first_frame(field); }
     core::monitor::state state() const override { return producer_->state(); }
+    memory_usage         memory() const override { return producer_->memory(); }
     bool                 is_ready() override { return producer_->is_ready(); }
 };
 
@@ -195,9 +381,65 @@ spl::shared_ptr<core::frame_producer> create_destroy_proxy(spl::shared_ptr<core:
     return spl::make_shared<destroy_producer_proxy>(std::move(producer));
 }
 
+// How long a key name that had no producer is not looked up again, unless the media index knows about it.
+const int missing_key_seconds = 10;
+
+std::optional<std::wstring> resolve_media(const media_resolver_t& resolver, const std::wstring& name)
+{
+    if (!resolver)
+        return {};
+    try {
+        return resolver(name);
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        return {};
+    }
+}
+
+// The factories that may accept params, in the order they were registered. Keyed factories are left out when the
+// first parameter is known to match none of their keys, when nothing is known about it every factory is asked.
+std::vector<const producer_factory_t*> find_factories(const std::vector<registered_factory>& factories,
+                                                      const media_resolver_t&                resolver,
+                                                      const std::wstring&                    first)
+{
+    auto keyword_match = [&](const registered_factory& f) {
+        return std::any_of(f.keys.keywords.begin(), f.keys.keywords.end(), [&](const std::wstring& keyword) {
+            return boost::iequals(keyword, first);
+        });
+    };
+
+    std::wstring scheme;
+    std::wstring extension;
+    auto         known = std::any_of(factories.begin(), factories.end(), keyword_match);
+
+    auto scheme_end = first.find(L"://");
+    if (scheme_end != std::wstring::npos) {
+        scheme = boost::to_lower_copy(first.substr(0, scheme_end));
+        known  = true;
+    } else {
+        auto file = resolve_media(resolver, first);
+        if (file && !file->empty()) {
+            extension = boost::to_lower_copy(boost::filesystem::path(*file).extension().wstring());
+            known     = true;
+        }
+    }
+
+    std::vector<const producer_factory_t*> result;
+    for (auto& f : factories) {
+        if (!known || !f.is_keyed() || keyword_match(f) ||
+            (!scheme.empty() &&
+             std::find(f.keys.schemes.begin(), f.keys.schemes.end(), scheme) != f.keys.schemes.end()) ||
+            (!extension.empty() &&
+             std::find(f.keys.extensions.begin(), f.keys.extensions.end(), extension) != f.keys.extensions.end()))
+            result.push_back(&f.factory);
+    }
+    return result;
+}
+
 spl::shared_ptr<core::frame_producer> do_create_producer(const frame_producer_dependencies&     dependencies,
                                                          const std::vector<std::wstring>&       params,
-                                                         const std::vector<producer_factory_t>& factories,
+                                                         const std::vector<registered_factory>& factories,
+                                                         const media_resolver_t&                resolver,
                                                          bool                                   throw_on_fail = false)
 {
     if (params.empty()) {
@@ -214,9 +456,10 @@ spl::shared_ptr<core::frame_producer> do_create_producer(const frame_producer_de
         return producer;
     }
 
-    if (std::any_of(factories.begin(), factories.end(), [&](const producer_factory_t& factory) -> bool {
+    auto candidates = find_factories(factories, resolver, params.at(0));
+    if (std::any_of(candidates.begin(), candidates.end(), [&](const producer_factory_t* factory) -> bool {
             try {
-                producer = factory(dependencies, params);
+                producer = (*factory)(dependencies, params);
             } catch (user_error&) {
                 throw;
             } catch (...) {
@@ -236,21 +479,58 @@ spl::shared_ptr<core::frame_producer>
 frame_producer_registry::create_producer(const frame_producer_dependencies& dependencies,
                                          const std::vector<std::wstring>&   params) const
 {
+    if (auto pool = destroyer())
+        pool->wait_for_capacity();
+
     auto& producer_factories = impl_->producer_factories;
-    auto  producer           = do_create_producer(dependencies, params, producer_factories);
+    auto& resolver           = impl_->media_resolver;
+    auto  producer           = do_create_producer(dependencies, params, producer_factories, resolver);
     auto  key_producer       = frame_producer::empty();
 
-    if (!params.empty() && !boost::contains(params.at(0), L"://")) {
-        try // to find a key file.
-        {
-            auto params_copy = params;
-            params_copy[0] += L"_A";
-            key_producer = do_create_producer(dependencies, params_copy, producer_factories);
+    if (producer != frame_producer::empty() && !boost::contains(params.at(0), L"://")) {
+        const std::array<std::wstring, 2> key_names = {params.at(0) + L"_A", params.at(0) + L"_ALPHA"};
+        const auto                        now       = std::chrono::steady_clock::now();
+
+        // Key files are media files, so what the media index knows about them can be trusted. Otherwise a recent
+        // miss saves trying every factory again.
+        auto indexed = 0;
+        auto missing = 0;
+        for (auto& name : key_names) {
+            if (auto file = resolve_media(resolver, name)) {
+                ++indexed;
+                missing += file->empty() ? 1 : 0;
+            }
+        }
+
+        auto skip = missing == static_cast<int>(key_names.size());
+        if (!skip && indexed == 0) {
+            std::lock_guard<std::mutex> lock(impl_->missing_keys_mutex);
+            auto                        it = impl_->missing_keys.find(params.at(0));
+            skip                           = it != impl_->missing_keys.end() && now < it->second;
+        }
+
+        if (!skip) {
+            try // to find a key file.
+            {
+                auto params_copy = params;
+                for (auto& name : key_names) {
+                    params_copy[0] = name;
+                    key_producer   = do_create_producer(dependencies, params_copy, producer_factories, resolver);
+                    if (key_producer != frame_producer::empty())
+                        break;
+                }
+            } catch (...) {
+            }
+
+            std::lock_guard<std::mutex> lock(impl_->missing_keys_mutex);
             if (key_producer == frame_producer::empty()) {
-                params_copy[0] += L"LPHA";
-                key_producer = do_create_producer(dependencies, params_copy, producer_factories);
+                // Forget expired misses while here, so the cache only holds what was loaded recently.
+                for (auto it = impl_->missing_keys.begin(); it != impl_->missing_keys.end();)
+                    it = it->second < now ? impl_->missing_keys.erase(it) : std::next(it);
+                impl_->missing_keys[params.at(0)] = now + std::chrono::seconds(missing_key_seconds);
+            } else {
+                impl_->missing_keys.erase(params.at(0));
             }
-        } catch (...) {
         }
     }
 
@@ -28,6 +28,7 @@
 #include <common/memory.h>
 
 #include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
 #include <core/video_format.h>
 
 #include <cstdint>
@@ -48,7 +49,8 @@ class frame_producer
     uint32_t         frame_number_ = 0;
     core::draw_frame last_frame_;
     core::draw_frame first_frame_;
-    bool             is_ready_ = false;
+    bool             is_ready_  = false;
+    bool             is_static_ = false;
 
   public:
     static const spl::shared_ptr<frame_producer>& empty();
@@ -107,11 +109,34 @@ class frame_producer
     virtual spl::shared_ptr<frame_producer> following_producer() const { return core::frame_producer::empty(); }
     virtual std::optional<int64_t>          auto_play_delta() const { return {}; }
 
+    // The memory the producer holds, by default the frames kept for last_frame() and first_frame(). Producers add
+    // what they buffer and cache, and those wrapping others add theirs.
+    virtual memory_usage memory() const
+    {
+        auto usage = frame_memory(last_frame_);
+        if (first_frame_ != last_frame_) {
+            usage += frame_memory(first_frame_);
+        }
+        return usage;
+    }
+
+    // The transform the stage draws the frames of the layer with, set before every foreground frame. Producers may
+    // use it to produce no more detail than is shown.
+    virtual void render_transform(const frame_transform&) {}
+
     /**
      * Some producers take a couple of frames before they produce frames.
      * While this returns false, the previous producer will be left running for a limited number of frames.
      */
     virtual bool is_ready() = 0;
+
+    // A static producer returns the same frame and state on every receive, whatever the field and the transform it
+    // is rendered with, and has no end. Its layer reuses the last frame and state instead of receiving again.
+    bool is_static() const { return is_static_; }
+
+  protected:
+    // Set at construction, before the producer is received from.
+    void set_static(bool value) { is_static_ = value; }
 };
 
 class const_producer : public core::frame_producer
@@ -124,6 +149,7 @@ class const_producer : public core::frame_producer
         : frame1_(std::move(frame1))
         , frame2_(std::move(frame2))
     {
+        set_static(frame1_ == frame2_);
     }
 
     // frame_producer
@@ -175,11 +201,55 @@ struct frame_producer_dependencies
 using producer_factory_t = std::function<spl::shared_ptr<core::frame_producer>(const frame_producer_dependencies&,
                                                                                const std::vector<std::wstring>&)>;
 
+// What CLS and CINF report for a media file.
+struct media_info
+{
+    std::wstring clip_type;                 // MOVIE, STILL or AUDIO
+    std::int64_t duration              = 0; // in periods of the time base
+    std::int64_t time_base_numerator   = 0;
+    std::int64_t time_base_denominator = 1;
+};
+
+// Fills in info and returns true if the file can be played by the module registering it.
+using media_info_extractor_t = std::function<bool(const std::wstring& file, media_info& info)>;
+
+// Decodes the picture a thumbnail of file is made from, a keyframe a little way in, as a frame of frame_factory for the
+// gpu to scale. An empty frame when the module can't read the file or it has no picture.
+using thumbnail_extractor_t = std::function<const_frame(const std::wstring& file, frame_factory& frame_factory)>;
+
+// Writes width x height bgra pixels, top row first, as the png file. Returns false when the module can't.
+using thumbnail_writer_t = std::function<
+    bool(const array<const std::uint8_t>& bgra, int width, int height, const std::wstring& file)>;
+
+// What a producer factory accepts, so it is only asked about parameters it can handle. Factories registered without
+// any keys are asked about everything.
+struct producer_factory_keys
+{
+    std::vector<std::wstring> keywords;   // first parameters such as DECKLINK or [HTML], compared case insensitively
+    std::vector<std::wstring> schemes;    // schemes such as http of first parameters like http://host/path
+    std::vector<std::wstring> extensions; // file extensions such as .png of the media the first parameter names
+};
+
+// Resolves a media name such as AMB or FOLDER/CLIP to the file it names. Returns std::nullopt when it can't tell and
+// an empty path when there is no such media.
+using media_resolver_t = std::function<std::optional<std::wstring>(const std::wstring& name)>;
+
 class frame_producer_registry
 {
   public:
     frame_producer_registry();
     void register_producer_factory(std::wstring name, const producer_factory_t& factoryr); // Not thread-safe.
+    void register_producer_factory(std::wstring                 name,
+                                   const producer_factory_t&    factory,
+                                   const producer_factory_keys& keys); // Not thread-safe.
+    void register_media_info_extractor(const media_info_extractor_t& extractor);          // Not thread-safe.
+    void register_thumbnail_extractor(const thumbnail_extractor_t& extractor);            // Not thread-safe.
+    void register_thumbnail_writer(const thumbnail_writer_t& writer);                     // Not thread-safe.
+    void set_media_resolver(const media_resolver_t& resolver);                            // Not thread-safe.
+    bool extract_media_info(const std::wstring& file, media_info& info) const;
+    bool has_thumbnail_support() const;
+    const_frame extract_thumbnail(const std::wstring& file, frame_factory& frame_factory) const;
+    bool write_thumbnail(const array<const std::uint8_t>& bgra, int width, int height, const std::wstring& file) const;
     spl::shared_ptr<core::frame_producer> create_producer(const frame_producer_dependencies&,
                                                           const std::vector<std::wstring>& params) const;
     spl::shared_ptr<core::frame_producer> create_producer(const frame_producer_dependencies&,
@@ -195,5 +265,7 @@ class frame_producer_registry
 
 spl::shared_ptr<core::frame_producer> create_destroy_proxy(spl::shared_ptr<core::frame_producer> producer);
 void                                  destroy_producers_synchronously();
+// Brings the destroyers back after destroy_producers_synchronously, call while no channels are running.
+void destroy_producers_asynchronously();
 
 }} // namespace caspar::core
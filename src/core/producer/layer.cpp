@@ -28,6 +28,11 @@
 #include "../frame/draw_frame.h"
 #include "../video_format.h"
 
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <thread>
+
 namespace caspar { namespace core {
 
 struct layer::impl
@@ -40,6 +45,12 @@ struct layer::impl
 
     bool auto_play_ = false;
     bool paused_    = false;
+    bool starved_   = false; // the foreground ran dry before its end while its frames were waited for
+
+    memory_usage memory_; // of both producers, as of the last frame
+
+    // The frame of each field the state and memory above are of, reused while the layer can't change.
+    draw_frame frames_[2];
 
   public:
     impl(const core::video_format_desc format_desc)
@@ -47,14 +58,31 @@ struct layer::impl
     {
     }
 
-    void pause() { paused_ = true; }
+    void pause()
+    {
+        paused_ = true;
+        invalidate();
+    }
+
+    void resume()
+    {
+        paused_ = false;
+        invalidate();
+    }
+
+    void invalidate()
+    {
+        frames_[0] = draw_frame{};
+        frames_[1] = draw_frame{};
+    }
 
-    void resume() { paused_ = false; }
+    draw_frame& cached_frame(const video_field field) { return frames_[field == video_field::b ? 1 : 0]; }
 
     void load(spl::shared_ptr<frame_producer> producer, bool preview_producer, bool auto_play)
     {
         background_ = std::move(producer);
         auto_play_  = auto_play;
+        invalidate();
 
         if (auto_play_ && foreground_ == frame_producer::empty()) {
             play();
@@ -90,24 +118,83 @@ struct layer::impl
 
             foreground_ = std::move(background_);
             background_ = frame_producer::empty();
+            starved_    = false;
 
             auto_play_ = false;
         }
 
         paused_ = false;
+        invalidate();
     }
 
     void stop()
     {
         foreground_ = frame_producer::empty();
         auto_play_  = false;
+        starved_    = false;
+        invalidate();
+    }
+
+    // Nothing but a paused or static foreground, and the frames already received from it.
+    bool is_static() const
+    {
+        return background_ == frame_producer::empty() && (paused_ || foreground_->is_static());
+    }
+
+    std::optional<int64_t> frames_left() const
+    {
+        const auto duration = foreground_->nb_frames();
+        if (duration == std::numeric_limits<uint32_t>::max()) {
+            return {};
+        }
+        if (starved_) {
+            return 0;
+        }
+        return std::max<int64_t>(0, static_cast<int64_t>(duration) - foreground_->frame_number());
     }
 
-    draw_frame receive(const video_field field, int nb_samples)
+    // Waits for a producer with an end that is late rather than repeating its last frame, up to a bound in case it
+    // never gets to the end it reports. Live producers have no end and aren't waited for.
+    draw_frame wait_for_frame(const video_field field, int nb_samples)
+    {
+        if (!frames_left()) {
+            return draw_frame{};
+        }
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!starved_ && foreground_->frame_number() < foreground_->nb_frames()) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                CASPAR_LOG(warning) << foreground_->print() << L" Gave up waiting for a frame.";
+                starved_ = true;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            if (auto frame = foreground_->receive(field, nb_samples)) {
+                return frame;
+            }
+        }
+        return draw_frame{};
+    }
+
+    draw_frame receive(const video_field field, int nb_samples, bool wait)
     {
         try {
+            auto& cached = cached_frame(field);
+            if (cached && is_static()) {
+                if (!paused_) {
+                    return cached;
+                }
+                // A paused producer can still be seeked, only its state is reused while it shows the same frame.
+                auto frame = foreground_->last_frame(field);
+                if (frame == cached) {
+                    return frame;
+                }
+            }
+
             if (foreground_->following_producer() != core::frame_producer::empty() && field != video_field::b) {
                 foreground_ = foreground_->following_producer();
+                starved_    = false;
+                invalidate();
             }
 
             int64_t frames_left = 0;
@@ -124,22 +211,40 @@ struct layer::impl
             }
 
             auto frame = paused_ ? core::draw_frame{} : foreground_->receive(field, nb_samples);
+            if (!frame && wait && !paused_) {
+                frame = wait_for_frame(field, nb_samples);
+            }
             if (!frame) {
                 frame = foreground_->last_frame(field);
             }
 
-            state_                           = {};
-            state_["foreground"]             = foreground_->state();
-            state_["foreground"]["producer"] = foreground_->name();
-            state_["foreground"]["paused"]   = paused_;
+            const auto foreground_memory = foreground_->memory();
+            const auto background_memory = background_->memory();
+            memory_                      = foreground_memory;
+            memory_ += background_memory;
+
+            state_                                = {};
+            state_["foreground"]                  = foreground_->state();
+            state_["foreground"]["producer"]      = foreground_->name();
+            state_["foreground"]["paused"]        = paused_;
+            state_["foreground"]["memory/host"]   = foreground_memory.host;
+            state_["foreground"]["memory/device"] = foreground_memory.device;
 
             if (frames_left > 0) {
                 state_["foreground"]["frames_left"] = frames_left;
             }
 
-            state_["background"]             = background_->state();
-            state_["background"]["producer"] = background_->name();
+            state_["background"]                  = background_->state();
+            state_["background"]["producer"]      = background_->name();
+            state_["background"]["memory/host"]   = background_memory.host;
+            state_["background"]["memory/device"] = background_memory.device;
 
+            // Lets automation wait for a loaded clip to have pre-rolled before playing it.
+            if (background_ != frame_producer::empty()) {
+                state_["background"]["ready"] = background_->is_ready();
+            }
+
+            cached = frame;
             return frame;
         } catch (...) {
             CASPAR_LOG_CURRENT_EXCEPTION();
@@ -184,7 +289,10 @@ void       layer::preview() { impl_->preview(false); }
 void       layer::pause() { impl_->pause(); }
 void       layer::resume() { impl_->resume(); }
 void       layer::stop() { impl_->stop(); }
-draw_frame layer::receive(const video_field field, int nb_samples) { return impl_->receive(field, nb_samples); }
+draw_frame layer::receive(const video_field field, int nb_samples, bool wait)
+{
+    return impl_->receive(field, nb_samples, wait);
+}
 draw_frame layer::receive_background(const video_field field, int nb_samples)
 {
     return impl_->receive_background(field, nb_samples);
@@ -192,5 +300,8 @@ draw_frame layer::receive_background(const video_field field, int nb_samples)
 spl::shared_ptr<frame_producer> layer::foreground() const { return impl_->foreground_; }
 spl::shared_ptr<frame_producer> layer::background() const { return impl_->background_; }
 bool                            layer::has_background() const { return impl_->background_ != frame_producer::empty(); }
+bool                            layer::is_static() const { return impl_->is_static(); }
+std::optional<int64_t>          layer::frames_left() const { return impl_->frames_left(); }
+memory_usage                    layer::memory() const { return impl_->memory_; }
 core::monitor::state            layer::state() const { return impl_->state_; }
 }} // namespace caspar::core
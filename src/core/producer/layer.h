@@ -28,6 +28,9 @@
 
 #include <common/memory.h>
 
+#include <cstdint>
+#include <optional>
+
 namespace caspar { namespace core {
 
 class layer final
@@ -50,7 +53,8 @@ class layer final
     void resume();
     void stop();
 
-    draw_frame receive(const video_field field, int nb_samples);
+    // With wait, a late foreground is waited for instead of repeating its last frame, as offline channels do.
+    draw_frame receive(const video_field field, int nb_samples, bool wait = false);
     draw_frame receive_background(const video_field field, int nb_samples);
 
     core::monitor::state state() const;
@@ -59,6 +63,15 @@ class layer final
     spl::shared_ptr<frame_producer> background() const;
     bool                            has_background() const;
 
+    // Whether the foreground is paused or static, with nothing loaded behind it.
+    bool is_static() const;
+
+    // Frames until the foreground ends, none while it plays without an end.
+    std::optional<int64_t> frames_left() const;
+
+    // Held by the foreground and background producers, as of the last frame received.
+    memory_usage memory() const;
+
   private:
     struct impl;
     spl::shared_ptr<impl> impl_;
@@ -21,6 +21,7 @@
 #include "route_producer.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/metrics.h>
 #include <common/param.h>
 #include <common/timer.h>
 
@@ -38,12 +39,20 @@
 
 namespace caspar { namespace core {
 
+static diagnostics::metrics::labels_t route_labels(int source_channel, int source_layer)
+{
+    return {{"source_channel", std::to_string(source_channel)}, {"source_layer", std::to_string(source_layer)}};
+}
+
 class route_producer
     : public frame_producer
     , public route_control
 {
     spl::shared_ptr<diagnostics::graph> graph_;
 
+    const std::shared_ptr<diagnostics::metrics::counter> late_frames_;
+    const std::shared_ptr<diagnostics::metrics::counter> dropped_frames_;
+
     tbb::concurrent_bounded_queue<std::pair<core::draw_frame, core::draw_frame>> buffer_;
 
     caspar::timer produce_timer_;
@@ -71,7 +80,13 @@ class route_producer
 
   public:
     route_producer(std::shared_ptr<route> route, int buffer, int source_channel, int source_layer)
-        : route_(route)
+        : late_frames_(diagnostics::metrics::make_counter("caspar_route_late_frames_total",
+                                                          "Ticks the route had no frame from its source",
+                                                          route_labels(source_channel, source_layer)))
+        , dropped_frames_(diagnostics::metrics::make_counter("caspar_route_dropped_frames_total",
+                                                             "Source frames dropped because the route buffer was full",
+                                                             route_labels(source_channel, source_layer)))
+        , route_(route)
         , source_channel_(source_channel)
         , source_layer_(source_layer)
         , connection_(route_->signal.connect([this](const core::draw_frame& frame1, const core::draw_frame& frame2) {
@@ -88,6 +103,7 @@ class route_producer
 
             if (!buffer_.try_push(std::make_pair(frame1b, frame2b))) {
                 graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+                dropped_frames_->increment();
             }
             graph_->set_value("produce-time", produce_timer_.elapsed() * route_->format_desc.fps * 0.5);
             produce_timer_.restart();
@@ -131,6 +147,7 @@ class route_producer
             std::pair<core::draw_frame, core::draw_frame> frame;
             if (!buffer_.try_pop(frame)) {
                 graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+                late_frames_->increment();
             } else {
                 frame_ = frame;
             }
@@ -201,7 +218,10 @@ spl::shared_ptr<core::frame_producer> create_route_producer(const core::frame_pr
 
     auto buffer = get_param(L"BUFFER", params, 0);
 
-    return spl::make_shared<route_producer>((*channel_it)->route(layer, mode), buffer, channel, layer);
+    // Channels of another size get frames scaled by the source channel, shared with every route of that size.
+    auto route = (*channel_it)->route(layer, mode, dependencies.format_desc, *dependencies.frame_factory);
+
+    return spl::make_shared<route_producer>(route, buffer, channel, layer);
 }
 
 }} // namespace caspar::core
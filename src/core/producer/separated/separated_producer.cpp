@@ -135,6 +135,13 @@ class separated_producer : public frame_producer
 
     core::monitor::state state() const override { return state_; }
 
+    memory_usage memory() const override
+    {
+        auto usage = fill_producer_->memory();
+        usage += key_producer_->memory();
+        return usage;
+    }
+
     bool is_ready() override { return key_producer_->is_ready() && fill_producer_->is_ready(); }
 };
 
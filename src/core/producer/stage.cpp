@@ -28,28 +28,56 @@
 #include "../frame/draw_frame.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/trace.h>
 #include <common/executor.h>
 #include <common/future.h>
 
 #include <core/frame/frame_transform.h>
 #include <core/producer/route/route_producer.h>
 
-#include <boost/range/adaptors.hpp>
+#include <tbb/parallel_for.h>
 
+#include <algorithm>
+#include <cstdint>
 #include <functional>
 #include <future>
 #include <map>
+#include <memory>
+#include <optional>
+#include <set>
 #include <vector>
 
 namespace caspar { namespace core {
 
 struct stage::impl : public std::enable_shared_from_this<impl>
 {
+    // A layer index with its layer and transform. Transforms can be set on indices without a layer, and clearing a
+    // layer keeps its transform, so either part may be missing.
+    struct layer_slot
+    {
+        int                           index;
+        std::optional<core::layer>    layer;
+        tweened_transform             tween;
+        std::weak_ptr<frame_producer> routed_foreground; // the foreground the route ordering was worked out for
+    };
+
     int                                 channel_index_;
     spl::shared_ptr<diagnostics::graph> graph_;
+    const bool                          offline_; // layers wait for late producers
     monitor::state                      state_;
-    std::map<int, layer>                layers_;
-    std::map<int, tweened_transform>    tweens_;
+    std::vector<layer_slot>             slots_; // sorted by index
+
+    // Bumped whenever slots or layers are added, removed or swapped, which invalidates the cached route ordering.
+    std::uint64_t layout_version_ = 0;
+    std::uint64_t waves_version_  = ~std::uint64_t(0);
+
+    // Slot positions to receive per tick, see update_waves.
+    std::vector<std::vector<std::pair<std::size_t, bool>>> waves_;
+    std::vector<layer_frame>                               frames_;
+
+    // The transforms of the last tick sorted by index, published for queries so they never wait behind the executor.
+    using transforms_t = std::vector<std::pair<int, frame_transform>>;
+    std::shared_ptr<const transforms_t> transforms_ = std::make_shared<transforms_t>();
     std::set<int>                       routeSources;
 
     mutable std::mutex      format_desc_mutex_;
@@ -58,8 +86,21 @@ struct stage::impl : public std::enable_shared_from_this<impl>
     executor   executor_{L"stage " + std::to_wstring(channel_index_)};
     std::mutex lock_;
 
+    struct pending_transforms
+    {
+        std::vector<stage::transform_tuple_t> transforms;
+        std::shared_ptr<std::promise<void>>   applied;
+        bool from_current = false; // transforms the current value rather than the destination, see apply_transform
+    };
+
+    // Transforms waiting for the start of the next tick, so those sent for a layer within one frame make one tween.
+    // Commands that replace or move tweens apply the ones sent before them first.
+    std::mutex                      pending_mutex_;
+    std::vector<pending_transforms> pending_;
+
   private:
     void orderSourceLayers(std::vector<std::pair<int, bool>>&        layerVec,
+                           std::set<int>&                            ordered,
                            const std::map<int, std::pair<int, int>>& routed_layers,
                            int                                       l,
                            int                                       depth)
@@ -67,20 +108,21 @@ struct stage::impl : public std::enable_shared_from_this<impl>
         if (0 == depth)
             routeSources.clear();
 
-        if (std::find_if(layerVec.begin(), layerVec.end(), [l](std::pair<int, bool> p) { return p.first == l; }) !=
-            layerVec.end()) {
+        if (ordered.count(l) != 0) {
             return;
         }
 
         auto routeIt = routed_layers.find(l);
         if (routed_layers.end() == routeIt) {
             layerVec.push_back(std::make_pair(l, true));
+            ordered.insert(l);
             return;
         }
 
         std::pair<int, int> routeSrc(routeIt->second);
         if (channel_index_ != routeSrc.first) {
             layerVec.push_back(std::make_pair(l, true));
+            ordered.insert(l);
             return;
         }
 
@@ -88,30 +130,199 @@ struct stage::impl : public std::enable_shared_from_this<impl>
         routeSources.emplace(routeSrc.second);
         bool layerOK = true;
         if (routeSources.find(l) == routeSources.end()) {
-            orderSourceLayers(layerVec, routed_layers, routeSrc.second, ++depth);
+            orderSourceLayers(layerVec, ordered, routed_layers, routeSrc.second, ++depth);
         } else {
             layerOK = false;
         }
 
-        if (std::find_if(layerVec.begin(), layerVec.end(), [l](std::pair<int, bool> p) { return p.first == l; }) ==
-            layerVec.end()) {
+        if (ordered.insert(l).second) {
             layerVec.push_back(std::make_pair(l, layerOK));
         }
     }
 
+    // Works out which layers are fed by route producers and groups the layers into waves, where every layer only
+    // depends on layers of earlier waves. Route sources on this channel must have been received (and pushed to their
+    // routes) before the layers routing them, everything else is independent and can be received in parallel. This
+    // only has to be redone when the slots or a foreground producer changed.
+    void update_waves()
+    {
+        auto changed = waves_version_ != layout_version_;
+        for (auto& slot : slots_) {
+            if (!slot.layer)
+                continue;
+            std::shared_ptr<frame_producer> producer = slot.layer->foreground();
+            // Comparing owners is safe against a new producer reusing the address of a released one.
+            if (slot.routed_foreground.owner_before(producer) || producer.owner_before(slot.routed_foreground)) {
+                slot.routed_foreground = producer;
+                changed                = true;
+            }
+        }
+        if (!changed)
+            return;
+
+        // build a map of layers that are sourced from route producers
+        std::map<int, std::pair<int, int>> routed_layers;
+        for (auto& slot : slots_) {
+            if (!slot.layer)
+                continue;
+            auto producer = slot.layer->foreground();
+            if (0 == producer->name().compare(L"route")) {
+                try {
+                    auto rc       = spl::dynamic_pointer_cast<core::route_control>(producer);
+                    auto srcChan  = rc->get_source_channel();
+                    auto srcLayer = rc->get_source_layer();
+                    routed_layers.emplace(slot.index, std::make_pair(srcChan, srcLayer));
+                    rc->set_cross_channel(channel_index_ != srcChan);
+                } catch (std::bad_cast) {
+                    CASPAR_LOG(error) << "Failed to cast route producer";
+                }
+            }
+        }
+
+        // sort layer order so that sources get pulled before routes
+        std::vector<std::pair<int, bool>> layerVec;
+        std::set<int>                     ordered;
+        for (auto& slot : slots_) {
+            if (slot.layer)
+                orderSourceLayers(layerVec, ordered, routed_layers, slot.index, 0);
+        }
+
+        std::map<int, int> wave_index;
+        waves_.clear();
+        for (auto& l : layerVec) {
+            auto wave    = 0;
+            auto routeIt = routed_layers.find(l.first);
+            if (routeIt != routed_layers.end() && routeIt->second.first == channel_index_) {
+                auto srcIt = wave_index.find(routeIt->second.second);
+                if (srcIt != wave_index.end()) {
+                    wave = srcIt->second + 1;
+                }
+            }
+            wave_index[l.first] = wave;
+
+            auto slot = find_slot(l.first);
+            if (slot == nullptr || !slot->layer)
+                continue;
+
+            if (waves_.size() <= static_cast<size_t>(wave)) {
+                waves_.resize(wave + 1);
+            }
+            waves_[wave].emplace_back(static_cast<std::size_t>(slot - slots_.data()), l.second);
+        }
+
+        waves_version_ = layout_version_;
+    }
+
+    std::vector<pending_transforms> take_pending()
+    {
+        std::vector<pending_transforms> pending;
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            pending.swap(pending_);
+        }
+        return pending;
+    }
+
+    std::future<void> queue_transforms(std::vector<stage::transform_tuple_t> transforms, bool from_current)
+    {
+        auto promise = std::make_shared<std::promise<void>>();
+        auto applied = promise->get_future();
+
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        pending_.push_back(pending_transforms{std::move(transforms), std::move(promise), from_current});
+        return applied;
+    }
+
+    // The transforms of each layer are played through in the order they were sent, and only the tween they end
+    // with replaces the layer's. A batch that fails stops at the transform that threw, as if applied on its own.
+    // Tweens that would hold a layer where it already rests are dropped.
+    void apply(std::vector<pending_transforms> pending)
+    {
+        std::map<int, tweened_transform> tweens;
+
+        for (auto& batch : pending) {
+            try {
+                for (auto& transform : batch.transforms) {
+                    auto index = std::get<0>(transform);
+                    auto it    = tweens.find(index);
+                    if (it == tweens.end()) {
+                        auto slot = find_slot(index);
+                        it        = tweens.emplace(index, slot ? slot->tween : tweened_transform()).first;
+                    }
+
+                    auto& tween = it->second;
+                    auto  src   = tween.fetch();
+                    auto  dst   = std::get<1>(transform)(batch.from_current ? src : tween.dest());
+                    tween       = tweened_transform(src, dst, std::get<2>(transform), std::get<3>(transform));
+                }
+                batch.applied->set_value();
+            } catch (...) {
+                batch.applied->set_exception(std::current_exception());
+            }
+        }
+
+        for (auto& [index, tween] : tweens) {
+            auto slot = find_slot(index);
+            if (slot ? slot->tween.done() && slot->tween.dest() == tween.dest() : tween.dest() == frame_transform{}) {
+                continue;
+            }
+            get_slot(index).tween = std::move(tween);
+        }
+    }
+
+    layer_slot* find_slot(int index)
+    {
+        auto it = std::lower_bound(
+            slots_.begin(), slots_.end(), index, [](const layer_slot& slot, int index) { return slot.index < index; });
+        return it != slots_.end() && it->index == index ? &*it : nullptr;
+    }
+
+    // References are only valid until the next slot is added.
+    layer_slot& get_slot(int index)
+    {
+        auto it = std::lower_bound(
+            slots_.begin(), slots_.end(), index, [](const layer_slot& slot, int index) { return slot.index < index; });
+        if (it == slots_.end() || it->index != index) {
+            it = slots_.insert(it, layer_slot{index});
+            ++layout_version_;
+        }
+        return *it;
+    }
+
     layer& get_layer(int index)
     {
-        auto it = layers_.find(index);
-        if (it == std::end(layers_)) {
-            it = layers_.emplace(index, layer(video_format_desc())).first;
+        auto& slot = get_slot(index);
+        if (!slot.layer) {
+            slot.layer.emplace(video_format_desc());
+            ++layout_version_;
+        }
+        return *slot.layer;
+    }
+
+    void clear_layer(int index)
+    {
+        auto slot = find_slot(index);
+        if (slot != nullptr && slot->layer) {
+            slot->layer.reset();
+            ++layout_version_;
         }
-        return it->second;
+    }
+
+    void clear_layers()
+    {
+        for (auto& slot : slots_)
+            slot.layer.reset();
+        ++layout_version_;
     }
 
   public:
-    impl(int channel_index, spl::shared_ptr<diagnostics::graph> graph, const core::video_format_desc& format_desc)
+    impl(int                                 channel_index,
+         spl::shared_ptr<diagnostics::graph> graph,
+         const core::video_format_desc&      format_desc,
+         bool                                offline)
         : channel_index_(channel_index)
         , graph_(std::move(graph))
+        , offline_(offline)
         , format_desc_(format_desc)
     {
     }
@@ -120,121 +331,132 @@ struct stage::impl : public std::enable_shared_from_this<impl>
                                   std::vector<int>&                            fetch_background,
                                   std::function<void(int, const layer_frame&)> routesCb)
     {
-        return executor_.invoke([=] {
-            std::map<int, layer_frame> frames;
-            stage_frames               result = {};
+        return executor_.invoke(
+            [=] {
+                stage_frames result = {};
 
-            result.format_desc = video_format_desc();
-            result.nb_samples =
-                result.format_desc.audio_cadence[frame_number % result.format_desc.audio_cadence.size()];
+                result.format_desc = video_format_desc();
+                result.nb_samples =
+                    result.format_desc.audio_cadence[frame_number % result.format_desc.audio_cadence.size()];
 
-            auto is_interlaced = format_desc_.field_count == 2;
-            auto field1        = is_interlaced ? video_field::a : video_field::progressive;
+                auto is_interlaced = format_desc_.field_count == 2;
+                auto field1        = is_interlaced ? video_field::a : video_field::progressive;
 
-            try {
-                for (auto& t : tweens_)
-                    t.second.tick(1);
-
-                // build a map of layers that are sourced from route producers
-                std::map<int, std::pair<int, int>> routed_layers;
-                for (auto& p : layers_) {
-                    auto producer = std::move(p.second.foreground());
-                    if (0 == producer->name().compare(L"route")) {
-                        try {
-                            auto rc       = spl::dynamic_pointer_cast<core::route_control>(producer);
-                            auto srcChan  = rc->get_source_channel();
-                            auto srcLayer = rc->get_source_layer();
-                            routed_layers.emplace(p.first, std::make_pair(srcChan, srcLayer));
-                            rc->set_cross_channel(channel_index_ != srcChan);
-                        } catch (std::bad_cast) {
-                            CASPAR_LOG(error) << "Failed to cast route producer";
-                        }
-                    }
-                }
+                try {
+                    apply(take_pending());
+
+                    for (auto& slot : slots_)
+                        slot.tween.tick(1);
 
-                // sort layer order so that sources get pulled before routes
-                std::vector<std::pair<int, bool>> layerVec;
-                for (auto& p : layers_)
-                    orderSourceLayers(layerVec, routed_layers, p.first, 0);
+                    update_waves();
 
-                // when running interlaced, both fields are be pulled at once.
-                // This will risk some stutter for freshly created producers, but it lets us tick at 25hz and avoids
-                // amcp changes starting on the second field
+                    // The layers only touch their own entries while receiving.
+                    frames_.clear();
+                    frames_.resize(slots_.size());
 
-                for (auto& l : layerVec) {
-                    auto p = layers_.find(l.first);
-                    if (p == layers_.end())
-                        continue;
+                    // when running interlaced, both fields are be pulled at once.
+                    // This will risk some stutter for freshly created producers, but it lets us tick at 25hz and avoids
+                    // amcp changes starting on the second field
 
-                    auto& layer = p->second;
-                    auto& tween = tweens_[p->first];
+                    auto receive_layer = [&](const std::pair<std::size_t, bool>& l) {
+                        auto& slot = slots_[l.first];
 
-                    auto has_background_route =
-                        std::find(fetch_background.begin(), fetch_background.end(), p->first) != fetch_background.end();
+                        diagnostics::trace::span span("stage.receive", frame_number, slot.index);
 
-                    layer_frame res = {};
-                    if (l.second)
-                        res.foreground1 = draw_frame::push(layer.receive(field1, result.nb_samples), tween.fetch());
+                        auto& layer = *slot.layer;
+                        auto& tween = slot.tween;
 
-                    res.has_background = layer.has_background();
-                    if (has_background_route)
-                        res.background1 = layer.receive_background(field1, result.nb_samples);
+                        auto has_background_route =
+                            std::find(fetch_background.begin(), fetch_background.end(), slot.index) !=
+                            fetch_background.end();
 
-                    if (is_interlaced) {
-                        res.is_interlaced = true;
+                        // Paused and static producers show what they already drew, whatever it is drawn with.
+                        if (l.second && !layer.is_static())
+                            layer.foreground()->render_transform(tween.fetch());
+
+                        layer_frame res = {};
                         if (l.second)
-                            res.foreground2 =
-                                draw_frame::push(layer.receive(video_field::b, result.nb_samples), tween.fetch());
+                            res.foreground1 =
+                                draw_frame::push(layer.receive(field1, result.nb_samples, offline_), tween.fetch());
+
+                        res.has_background = layer.has_background();
                         if (has_background_route)
-                            res.background2 = layer.receive_background(video_field::b, result.nb_samples);
-                    }
+                            res.background1 = layer.receive_background(field1, result.nb_samples);
+
+                        if (is_interlaced) {
+                            res.is_interlaced = true;
+                            if (l.second)
+                                res.foreground2 = draw_frame::push(
+                                    layer.receive(video_field::b, result.nb_samples, offline_), tween.fetch());
+                            if (has_background_route)
+                                res.background2 = layer.receive_background(video_field::b, result.nb_samples);
+                        }
 
-                    frames[p->first] = res;
+                        // push received foreground frame to any configured route producer
+                        routesCb(slot.index, res);
 
-                    // push received foreground frame to any configured route producer
-                    routesCb(p->first, res);
-                }
+                        frames_[l.first] = std::move(res);
+                    };
 
-                for (auto& p : frames) {
-                    result.frames.push_back(p.second.foreground1);
+                    for (auto& wave : waves_) {
+                        if (wave.size() == 1) {
+                            receive_layer(wave[0]);
+                        } else {
+                            tbb::parallel_for(static_cast<size_t>(0), wave.size(), [&](size_t i) {
+                                receive_layer(wave[i]);
+                            });
+                        }
+                    }
+
+                    for (std::size_t n = 0; n < slots_.size(); ++n) {
+                        if (!slots_[n].layer)
+                            continue;
+                        result.memory += slots_[n].layer->memory();
+                        if (auto frames_left = slots_[n].layer->frames_left()) {
+                            result.frames_left = std::max(result.frames_left.value_or(0), *frames_left);
+                        }
+                        result.layers.push_back(slots_[n].index);
+                        result.frames.push_back(std::move(frames_[n].foreground1));
+                        if (is_interlaced)
+                            result.frames2.push_back(std::move(frames_[n].foreground2));
+                    }
+                    frames_.clear();
+
+                    // push stage_frames to support any channel routes that have been set
+                    layer_frame chan_lf   = {};
+                    chan_lf.is_interlaced = is_interlaced;
+                    chan_lf.foreground1   = draw_frame(result.frames);
                     if (is_interlaced)
-                        result.frames2.push_back(p.second.foreground2);
-                }
+                        chan_lf.foreground2 = draw_frame(result.frames2);
+                    routesCb(-1, chan_lf);
+
+                    monitor::state state;
+                    for (auto& slot : slots_) {
+                        if (slot.layer)
+                            state["layer"][slot.index] = slot.layer->state();
+                    }
+                    state_ = std::move(state);
 
-                // push stage_frames to support any channel routes that have been set
-                layer_frame chan_lf   = {};
-                chan_lf.is_interlaced = is_interlaced;
-                chan_lf.foreground1   = draw_frame(result.frames);
-                if (is_interlaced)
-                    chan_lf.foreground2 = draw_frame(result.frames2);
-                routesCb(-1, chan_lf);
-
-                monitor::state state;
-                for (auto& p : layers_) {
-                    state["layer"][p.first] = p.second.state();
+                    auto transforms = std::make_shared<transforms_t>();
+                    transforms->reserve(slots_.size());
+                    for (auto& slot : slots_) {
+                        transforms->emplace_back(slot.index, slot.tween.fetch());
+                    }
+                    std::atomic_store(&transforms_, std::shared_ptr<const transforms_t>(transforms));
+                } catch (...) {
+                    clear_layers();
+                    CASPAR_LOG_CURRENT_EXCEPTION();
                 }
-                state_ = std::move(state);
-            } catch (...) {
-                layers_.clear();
-                CASPAR_LOG_CURRENT_EXCEPTION();
-            }
 
-            return result;
-        });
+                return result;
+            },
+            task_priority::high);
     }
 
     std::future<void>
     apply_transforms(const std::vector<std::tuple<int, stage::transform_func_t, unsigned int, tweener>>& transforms)
     {
-        return executor_.begin_invoke([=] {
-            for (auto& transform : transforms) {
-                auto& tween = tweens_[std::get<0>(transform)];
-                auto  src   = tween.fetch();
-                auto  dst   = std::get<1>(transform)(tween.dest());
-                tweens_[std::get<0>(transform)] =
-                    tweened_transform(src, dst, std::get<2>(transform), std::get<3>(transform));
-            }
-        });
+        return queue_transforms(transforms, false);
     }
 
     std::future<void> apply_transform(int                            index,
@@ -242,26 +464,47 @@ struct stage::impl : public std::enable_shared_from_this<impl>
                                       unsigned int                   mix_duration,
                                       const tweener&                 tween)
     {
-        return executor_.begin_invoke([=] {
-            auto src       = tweens_[index].fetch();
-            auto dst       = transform(src);
-            tweens_[index] = tweened_transform(src, dst, mix_duration, tween);
-        });
+        return queue_transforms({stage::transform_tuple_t(index, transform, mix_duration, tween)}, true);
     }
 
     std::future<void> clear_transforms(int index)
     {
-        return executor_.begin_invoke([=] { tweens_.erase(index); });
+        auto pending = std::make_shared<std::vector<pending_transforms>>(take_pending());
+        return executor_.begin_invoke([=] {
+            apply(std::move(*pending));
+
+            auto slot = find_slot(index);
+            if (slot == nullptr)
+                return;
+            slot->tween = tweened_transform();
+            if (!slot->layer) {
+                slots_.erase(slots_.begin() + (slot - slots_.data()));
+                ++layout_version_;
+            }
+        });
     }
 
     std::future<void> clear_transforms()
     {
-        return executor_.begin_invoke([=] { tweens_.clear(); });
+        auto pending = std::make_shared<std::vector<pending_transforms>>(take_pending());
+        return executor_.begin_invoke([=] {
+            apply(std::move(*pending));
+
+            for (auto& slot : slots_)
+                slot.tween = tweened_transform();
+            slots_.erase(std::remove_if(slots_.begin(), slots_.end(), [](auto& slot) { return !slot.layer; }),
+                         slots_.end());
+            ++layout_version_;
+        });
     }
 
     std::future<frame_transform> get_current_transform(int index)
     {
-        return executor_.begin_invoke([=] { return tweens_[index].fetch(); });
+        auto transforms = std::atomic_load(&transforms_);
+        auto it         = std::lower_bound(transforms->begin(), transforms->end(), index, [](auto& entry, int index) {
+            return entry.first < index;
+        });
+        return make_ready_future(it != transforms->end() && it->first == index ? it->second : frame_transform{});
     }
 
     std::future<void> load(int index, const spl::shared_ptr<frame_producer>& producer, bool preview, bool auto_play)
@@ -296,12 +539,12 @@ struct stage::impl : public std::enable_shared_from_this<impl>
 
     std::future<void> clear(int index)
     {
-        return executor_.begin_invoke([=] { layers_.erase(index); });
+        return executor_.begin_invoke([=] { clear_layer(index); });
     }
 
     std::future<void> clear()
     {
-        return executor_.begin_invoke([=] { layers_.clear(); });
+        return executor_.begin_invoke([=] { clear_layers(); });
     }
 
     std::future<void> swap_layers(const std::shared_ptr<stage>& other, bool swap_transforms)
@@ -312,14 +555,31 @@ struct stage::impl : public std::enable_shared_from_this<impl>
             return make_ready_future();
         }
 
-        auto func = [=] {
-            auto layers       = layers_ | boost::adaptors::map_values;
-            auto other_layers = other_impl->layers_ | boost::adaptors::map_values;
+        auto pending       = std::make_shared<std::vector<pending_transforms>>();
+        auto other_pending = std::make_shared<std::vector<pending_transforms>>();
+        if (swap_transforms) {
+            *pending       = take_pending();
+            *other_pending = other_impl->take_pending();
+        }
 
-            std::swap(layers_, other_impl->layers_);
+        auto func = [=] {
+            if (swap_transforms) {
+                apply(std::move(*pending));
+                other_impl->apply(std::move(*other_pending));
+                std::swap(slots_, other_impl->slots_);
+            } else {
+                std::vector<int> indices;
+                for (auto& slot : slots_)
+                    indices.push_back(slot.index);
+                for (auto& slot : other_impl->slots_)
+                    indices.push_back(slot.index);
+
+                for (auto index : indices)
+                    std::swap(get_slot(index).layer, other_impl->get_slot(index).layer);
+            }
 
-            if (swap_transforms)
-                std::swap(tweens_, other_impl->tweens_);
+            ++layout_version_;
+            ++other_impl->layout_version_;
         };
 
         return invoke_both(other, func);
@@ -327,11 +587,24 @@ struct stage::impl : public std::enable_shared_from_this<impl>
 
     std::future<void> swap_layer(int index, int other_index, bool swap_transforms)
     {
+        auto pending = std::make_shared<std::vector<pending_transforms>>();
+        if (swap_transforms) {
+            *pending = take_pending();
+        }
+
         return executor_.begin_invoke([=] {
-            std::swap(get_layer(index), get_layer(other_index));
+            apply(std::move(*pending));
+
+            // Create both first, adding a slot moves the others.
+            get_layer(index);
+            get_layer(other_index);
 
+            auto& slot       = *find_slot(index);
+            auto& other_slot = *find_slot(other_index);
+            std::swap(slot.layer, other_slot.layer);
             if (swap_transforms)
-                std::swap(tweens_[index], tweens_[other_index]);
+                std::swap(slot.tween, other_slot.tween);
+            ++layout_version_;
         });
     }
 
@@ -341,17 +614,31 @@ struct stage::impl : public std::enable_shared_from_this<impl>
 
         if (other_impl.get() == this)
             return swap_layer(index, other_index, swap_transforms);
+
+        auto pending       = std::make_shared<std::vector<pending_transforms>>();
+        auto other_pending = std::make_shared<std::vector<pending_transforms>>();
+        if (swap_transforms) {
+            *pending       = take_pending();
+            *other_pending = other_impl->take_pending();
+        }
+
         auto func = [=] {
-            auto& my_layer    = get_layer(index);
-            auto& other_layer = other_impl->get_layer(other_index);
+            apply(std::move(*pending));
+            other_impl->apply(std::move(*other_pending));
 
-            std::swap(my_layer, other_layer);
+            get_layer(index);
+            other_impl->get_layer(other_index);
 
-            if (swap_transforms) {
-                auto& my_tween    = tweens_[index];
-                auto& other_tween = other_impl->tweens_[other_index];
-                std::swap(my_tween, other_tween);
-            }
+            auto& my_slot    = *find_slot(index);
+            auto& other_slot = *other_impl->find_slot(other_index);
+
+            std::swap(my_slot.layer, other_slot.layer);
+
+            if (swap_transforms)
+                std::swap(my_slot.tween, other_slot.tween);
+
+            ++layout_version_;
+            ++other_impl->layout_version_;
         };
 
         return invoke_both(other, func);
@@ -405,13 +692,16 @@ struct stage::impl : public std::enable_shared_from_this<impl>
                 format_desc_ = format_desc;
             }
 
-            layers_.clear();
+            clear_layers();
         });
     }
 };
 
-stage::stage(int channel_index, spl::shared_ptr<diagnostics::graph> graph, const core::video_format_desc& format_desc)
-    : impl_(new impl(channel_index, std::move(graph), format_desc))
+stage::stage(int                                 channel_index,
+             spl::shared_ptr<diagnostics::graph> graph,
+             const core::video_format_desc&      format_desc,
+             bool                                offline)
+    : impl_(new impl(channel_index, std::move(graph), format_desc, offline))
 {
 }
 std::future<std::wstring> stage::call(int index, const std::vector<std::wstring>& params)
@@ -477,6 +767,26 @@ std::future<void>       stage::video_format_desc(const core::video_format_desc&
     return impl_->video_format_desc(format_desc);
 }
 std::unique_lock<std::mutex> stage::get_lock() const { return impl_->get_lock(); }
+std::future<void> stage::apply_transforms(const std::vector<stage_transforms_t>& batch)
+{
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for (auto& entry : batch)
+        locks.emplace_back(entry.first->impl_->pending_mutex_);
+
+    std::vector<std::shared_future<void>> applied;
+    for (auto& entry : batch) {
+        auto promise = std::make_shared<std::promise<void>>();
+        applied.push_back(promise->get_future().share());
+        entry.first->impl_->pending_.push_back(impl::pending_transforms{entry.second, std::move(promise)});
+    }
+
+    locks.clear();
+
+    return std::async(std::launch::deferred, [applied] {
+        for (auto& f : applied)
+            f.get();
+    });
+}
 std::future<void>            stage::execute(std::function<void()> func)
 {
     func();
@@ -502,7 +812,32 @@ std::future<std::wstring> stage_delayed::callbg(int index, const std::vector<std
 }
 std::future<void> stage_delayed::apply_transforms(const std::vector<stage_delayed::transform_tuple_t>& transforms)
 {
-    return executor_.begin_invoke([=]() { return stage_->apply_transforms(transforms).get(); });
+    std::lock_guard<std::mutex> lock(transforms_mutex_);
+    transforms_.insert(transforms_.end(), transforms.begin(), transforms.end());
+
+    auto applied = transforms_future_;
+    return std::async(std::launch::deferred, [applied] { applied.get(); });
+}
+bool stage_delayed::has_transforms() const
+{
+    std::lock_guard<std::mutex> lock(transforms_mutex_);
+    return !transforms_.empty();
+}
+stage::stage_transforms_t stage_delayed::take_transforms()
+{
+    std::vector<transform_tuple_t> transforms;
+    {
+        std::lock_guard<std::mutex> lock(transforms_mutex_);
+        transforms.swap(transforms_);
+    }
+    return std::make_pair(stage_, std::move(transforms));
+}
+void stage_delayed::transforms_applied(std::exception_ptr error)
+{
+    if (error)
+        transforms_applied_.set_exception(error);
+    else
+        transforms_applied_.set_value();
 }
 std::future<void>
 stage_delayed::apply_transform(int                                                                index,
@@ -30,13 +30,16 @@
 #include <common/tweener.h>
 
 #include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
 #include <core/video_format.h>
 
 #include <functional>
 #include <future>
 #include <map>
 #include <mutex>
+#include <optional>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 FORWARD2(caspar, diagnostics, class graph);
@@ -59,6 +62,9 @@ struct stage_frames
     int                     nb_samples;
     std::vector<draw_frame> frames;
     std::vector<draw_frame> frames2;
+    std::vector<int>        layers;      // layer index of each frame
+    std::optional<int64_t>  frames_left; // until the longest foreground with an end has ended
+    memory_usage            memory;      // held by the producers of all layers
 };
 
 /**
@@ -111,9 +117,13 @@ class stage final : public stage_base
     stage& operator=(const stage&);
 
   public:
+    using stage_transforms_t = std::pair<std::shared_ptr<stage>, std::vector<transform_tuple_t>>;
+
+    // Offline stages wait for late producers instead of repeating their last frame.
     explicit stage(int                                         channel_index,
                    spl::shared_ptr<caspar::diagnostics::graph> graph,
-                   const core::video_format_desc&              format_desc);
+                   const core::video_format_desc&              format_desc,
+                   bool                                        offline = false);
 
     const stage_frames operator()(uint64_t                                     frame_number,
                                   std::vector<int>&                            fetch_background,
@@ -153,6 +163,14 @@ class stage final : public stage_base
     std::future<void>            execute(std::function<void()> k) override;
     std::unique_lock<std::mutex> get_lock() const;
 
+    /**
+     * Queues the transforms of every stage in the batch so each of them is applied at the start of its next tick,
+     * in one go and before the tweens advance. All queues are held while the batch is added, so no channel starts a
+     * tick with only part of it. Each stage may appear at most once. The future completes once every stage applied
+     * its share.
+     */
+    static std::future<void> apply_transforms(const std::vector<stage_transforms_t>& batch);
+
     core::video_format_desc video_format_desc() const;
     std::future<void>       video_format_desc(const core::video_format_desc& format_desc);
 
@@ -175,6 +193,12 @@ class stage_delayed final : public stage_base
     void    abort() { executor_.clear(); }
     void    wait() { executor_.stop_and_wait(); }
 
+    // Transforms are not queued on the executor but collected, to be handed to stage::apply_transforms for the
+    // whole batch at once. transforms_applied() must be called once that has completed.
+    bool                      has_transforms() const;
+    stage::stage_transforms_t take_transforms();
+    void                      transforms_applied(std::exception_ptr error = nullptr);
+
     std::future<void>            apply_transforms(const std::vector<transform_tuple_t>& transforms) override;
     std::future<void>            apply_transform(int                     index,
                                                  const transform_func_t& transform,
@@ -213,6 +237,11 @@ class stage_delayed final : public stage_base
     std::promise<void>      waiter_;
     std::shared_ptr<stage>& stage_;
     executor                executor_;
+
+    mutable std::mutex             transforms_mutex_;
+    std::vector<transform_tuple_t> transforms_;
+    std::promise<void>             transforms_applied_;
+    std::shared_future<void>       transforms_future_ = transforms_applied_.get_future().share();
 };
 
 }} // namespace caspar::core
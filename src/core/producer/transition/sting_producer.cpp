@@ -30,7 +30,12 @@
 
 #include <common/scope_exit.h>
 
+#include <tbb/parallel_for.h>
+
+#include <cmath>
+#include <functional>
 #include <future>
+#include <vector>
 
 namespace caspar { namespace core {
 
@@ -68,6 +73,8 @@ class sting_producer : public frame_producer
     frame_pair overlay_;
 
     const sting_info info_;
+    const uint32_t   max_preroll_wait_;
+    uint32_t         preroll_wait_ = 0;
 
     spl::shared_ptr<frame_producer> dst_producer_     = frame_producer::empty();
     spl::shared_ptr<frame_producer> src_producer_     = frame_producer::empty();
@@ -78,8 +85,10 @@ class sting_producer : public frame_producer
     sting_producer(const spl::shared_ptr<frame_producer>& dest,
                    const sting_info&                      info,
                    const spl::shared_ptr<frame_producer>& mask,
-                   const spl::shared_ptr<frame_producer>& overlay)
+                   const spl::shared_ptr<frame_producer>& overlay,
+                   uint32_t                               max_preroll_wait)
         : info_(info)
+        , max_preroll_wait_(max_preroll_wait)
         , dst_producer_(dest)
         , mask_producer_(mask)
         , overlay_producer_(overlay)
@@ -90,6 +99,22 @@ class sting_producer : public frame_producer
 
     void leading_producer(const spl::shared_ptr<frame_producer>& producer) override { src_producer_ = producer; }
 
+    memory_usage memory() const override
+    {
+        auto usage = frame_producer::memory();
+        usage += src_producer_->memory();
+        usage += dst_producer_->memory();
+        usage += mask_producer_->memory();
+        usage += overlay_producer_->memory();
+        return usage;
+    }
+
+    void render_transform(const frame_transform& transform) override
+    {
+        src_producer_->render_transform(transform);
+        dst_producer_->render_transform(transform);
+    }
+
     spl::shared_ptr<frame_producer> following_producer() const override
     {
         auto duration = target_duration();
@@ -137,19 +162,50 @@ class sting_producer : public frame_producer
             return dst_producer_->receive(field, nb_samples);
         }
 
+        bool started_dst       = current_frame_ >= info_.trigger_point;
+        bool expecting_overlay = overlay_producer_ != core::frame_producer::empty();
+
+        // Don't start before the mask and overlay have pre-rolled, or their first frames are late. The source keeps
+        // playing meanwhile, for at most max_preroll_wait_ ticks in case a producer never reports ready.
+        bool prerolled = current_frame_ > 0 || preroll_wait_ >= max_preroll_wait_ ||
+                         (mask_producer_->is_ready() && (!expecting_overlay || overlay_producer_->is_ready()));
+        if (!prerolled && field != video_field::b)
+            preroll_wait_ += 1;
+
+        // The producers are independent, receive the ones that have no frame for this field yet in parallel.
+        std::vector<std::function<void()>> receives;
+
         auto src = src_.get(field);
         if (!src) {
-            src = src_producer_->receive(field, nb_samples);
+            receives.emplace_back([&] { src = src_producer_->receive(field, nb_samples); });
+        }
+        auto dst = dst_.get(field);
+        if (!dst && started_dst && prerolled) {
+            receives.emplace_back([&] { dst = dst_producer_->receive(field, nb_samples); });
+        }
+        auto mask = mask_.get(field);
+        if (!mask && prerolled) {
+            receives.emplace_back([&] { mask = mask_producer_->receive(field, nb_samples); });
+        }
+        auto overlay = overlay_.get(field);
+        if (expecting_overlay && !overlay && prerolled) {
+            receives.emplace_back([&] { overlay = overlay_producer_->receive(field, nb_samples); });
+        }
+
+        if (receives.size() == 1) {
+            receives[0]();
+        } else if (receives.size() > 1) {
+            tbb::parallel_for(std::size_t(0), receives.size(), [&](std::size_t n) { receives[n](); });
+        }
+
+        if (!src_.get(field)) {
             src_.set(field, src);
             if (!src) {
                 src = src_producer_->last_frame(field);
             }
         }
 
-        bool started_dst = current_frame_ >= info_.trigger_point;
-        auto dst         = dst_.get(field);
-        if (!dst && started_dst) {
-            dst = dst_producer_->receive(field, nb_samples);
+        if (!dst_.get(field) && started_dst && prerolled) {
             dst_.set(field, dst);
             if (!dst) {
                 dst = dst_producer_->last_frame(field);
@@ -161,17 +217,8 @@ class sting_producer : public frame_producer
             }
         }
 
-        auto mask = mask_.get(field);
-        if (!mask) {
-            mask = mask_producer_->receive(field, nb_samples);
-            mask_.set(field, mask);
-        }
-        bool expecting_overlay = overlay_producer_ != core::frame_producer::empty();
-        auto overlay           = overlay_.get(field);
-        if (expecting_overlay && !overlay) {
-            overlay = overlay_producer_->receive(field, nb_samples);
-            overlay_.set(field, overlay);
-        }
+        mask_.set(field, mask);
+        overlay_.set(field, overlay);
 
         // Not started, and mask or overlay is not ready
         bool mask_and_overlay_valid = mask && (!expecting_overlay || overlay);
@@ -265,7 +312,11 @@ class sting_producer : public frame_producer
 
     monitor::state state() const override { return state_; }
 
-    bool is_ready() override { return dst_producer_->is_ready(); }
+    bool is_ready() override
+    {
+        return dst_producer_->is_ready() && mask_producer_->is_ready() &&
+               (overlay_producer_ == core::frame_producer::empty() || overlay_producer_->is_ready());
+    }
 };
 
 spl::shared_ptr<frame_producer> create_sting_producer(const frame_producer_dependencies&     dependencies,
@@ -281,7 +332,10 @@ spl::shared_ptr<frame_producer> create_sting_producer(const frame_producer_depen
         overlay_producer = dependencies.producer_registry->create_producer(dependencies, info.overlay_filename);
     }
 
-    return spl::make_shared<sting_producer>(destination, info, mask_producer, overlay_producer);
+    // Wait up to a second for the mask and overlay to pre-roll once the transition starts.
+    auto max_preroll_wait = static_cast<uint32_t>(std::ceil(dependencies.format_desc.fps));
+
+    return spl::make_shared<sting_producer>(destination, info, mask_producer, overlay_producer, max_preroll_wait);
 }
 
 }} // namespace caspar::core
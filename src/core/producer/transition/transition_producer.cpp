@@ -89,6 +89,20 @@ class transition_producer : public frame_producer
 
     void leading_producer(const spl::shared_ptr<frame_producer>& producer) override { src_producer_ = producer; }
 
+    memory_usage memory() const override
+    {
+        auto usage = frame_producer::memory();
+        usage += src_producer_->memory();
+        usage += dst_producer_->memory();
+        return usage;
+    }
+
+    void render_transform(const frame_transform& transform) override
+    {
+        src_producer_->render_transform(transform);
+        dst_producer_->render_transform(transform);
+    }
+
     [[nodiscard]] spl::shared_ptr<frame_producer> following_producer() const override
     {
         return current_frame_ >= info_.duration && dst_is_ready_ ? dst_producer_ : core::frame_producer::empty();
@@ -30,18 +30,27 @@
 #include "frame/draw_frame.h"
 #include "frame/frame.h"
 #include "frame/frame_factory.h"
+#include "frame/frame_transform.h"
+#include "frame/frame_visitor.h"
+#include "frame/pixel_format.h"
 #include "mixer/mixer.h"
 #include "producer/stage.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/metrics.h>
+#include <common/diagnostics/trace.h>
 #include <common/executor.h>
 #include <common/timer.h>
 
 #include <core/diagnostics/call_context.h>
 #include <core/mixer/image/image_mixer.h>
 
+#include <algorithm>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
+#include <tuple>
 #include <unordered_map>
 #include <utility>
 
@@ -49,9 +58,88 @@ namespace caspar { namespace core {
 
 bool operator<(const route_id& a, const route_id& b) { return a.mode + (a.index << 2) < b.mode + (b.index << 2); }
 
+namespace {
+
+struct channel_metrics
+{
+    std::shared_ptr<caspar::diagnostics::metrics::histogram> produce;
+    std::shared_ptr<caspar::diagnostics::metrics::histogram> mix;
+    std::shared_ptr<caspar::diagnostics::metrics::histogram> consume;
+    std::shared_ptr<caspar::diagnostics::metrics::histogram> frame;
+    std::shared_ptr<caspar::diagnostics::metrics::gauge>     producer_host;
+    std::shared_ptr<caspar::diagnostics::metrics::gauge>     producer_device;
+    std::shared_ptr<caspar::diagnostics::metrics::gauge>     consumer_host;
+    std::shared_ptr<caspar::diagnostics::metrics::gauge>     consumer_device;
+
+    explicit channel_metrics(int index)
+    {
+        namespace metrics = caspar::diagnostics::metrics;
+
+        const metrics::labels_t labels = {{"channel", std::to_string(index)}};
+        produce = metrics::make_histogram("caspar_channel_produce_seconds", "Time to produce a tick", labels);
+        mix     = metrics::make_histogram("caspar_channel_mix_seconds", "Time to mix a tick", labels);
+        consume = metrics::make_histogram("caspar_channel_consume_seconds", "Time to consume a tick", labels);
+        frame   = metrics::make_histogram("caspar_channel_frame_seconds", "Time of a whole tick", labels);
+
+        auto memory = [&](const char* holder, const char* kind) {
+            auto memory_labels = labels;
+            memory_labels.emplace_back("holder", holder);
+            memory_labels.emplace_back("memory", kind);
+            return metrics::make_gauge(
+                "caspar_channel_memory_bytes", "Bytes held by the producers or consumers of a channel", memory_labels);
+        };
+        producer_host   = memory("producers", "host");
+        producer_device = memory("producers", "device");
+        consumer_host   = memory("consumers", "host");
+        consumer_device = memory("consumers", "device");
+    }
+};
+
+// Copies a frame with the audio only, so it can be played next to an image rendered from it.
+class audio_only_visitor final : public frame_visitor
+{
+    std::vector<std::pair<frame_transform, std::vector<draw_frame>>> stack_ = {{}};
+
+  public:
+    void push(const frame_transform& transform) override
+    {
+        frame_transform audio;
+        audio.audio_transform = transform.audio_transform;
+        stack_.emplace_back(audio, std::vector<draw_frame>{});
+    }
+
+    void visit(const const_frame& frame) override
+    {
+        const pixel_format_desc no_image(pixel_format::invalid);
+        if (frame.audio_format() == audio_sample_format::flt) {
+            if (frame.audio_data_float()) {
+                stack_.back().second.emplace_back(const_frame({}, frame.audio_data_float(), no_image));
+            }
+        } else if (frame.audio_data()) {
+            stack_.back().second.emplace_back(const_frame({}, frame.audio_data(), no_image));
+        }
+    }
+
+    void pop() override
+    {
+        auto node = std::move(stack_.back());
+        stack_.pop_back();
+        if (!node.second.empty()) {
+            draw_frame frame(std::move(node.second));
+            frame.transform() = node.first;
+            stack_.back().second.push_back(std::move(frame));
+        }
+    }
+
+    draw_frame take() { return draw_frame(std::move(stack_.front().second)); }
+};
+
+} // namespace
+
 struct video_channel::impl final
 {
-    monitor::state state_;
+    // Published once per tick and never changed after, so queries read it without waiting for the channel.
+    std::shared_ptr<const monitor::state> state_ = std::make_shared<monitor::state>();
 
     const int index_;
 
@@ -70,50 +158,176 @@ struct video_channel::impl final
 
     std::function<void(core::monitor::state)> tick_;
 
+    struct scaled_route
+    {
+        route_id                   id;
+        std::weak_ptr<core::route> route;
+    };
+
+    // The routes by source layer. Replaced whenever a route is added or released, so the tick reads it without
+    // locking and only looks at the routes of the layers it produces.
+    struct route_table
+    {
+        struct entry
+        {
+            route_id                   id;
+            std::weak_ptr<core::route> route;
+            bool                       scaled;
+        };
+
+        std::unordered_map<int, std::vector<entry>> layers;
+        std::vector<int>                            background_layers;
+    };
+
     std::map<route_id, std::weak_ptr<core::route>> routes_;
+    std::vector<scaled_route>                      scaled_routes_;
     std::mutex                                     routes_mutex_;
+    std::shared_ptr<const route_table>             route_table_ = std::make_shared<route_table>();
+    std::shared_ptr<const route_table>             tick_routes_; // the table of the tick being produced
+    const std::shared_ptr<std::atomic<bool>>       routes_released_ = std::make_shared<std::atomic<bool>>(false);
+
+    // Runs mix and consume of tick N while the channel thread produces tick N + 1.
+    std::optional<caspar::executor> pipeline_executor_;
+    std::atomic<double>             mix_consume_time_{0.0};
+
+    // Offline channels render as fast as they can while anything with an end plays, see mix_and_consume.
+    const bool offline_;
+    bool       offline_rendering_ = false;
+    uint64_t   offline_frames_    = 0;
+
+    const channel_metrics metrics_{index_};
+
+    // Held by the producers and consumers as of the last tick, for the memory budget of loads.
+    std::atomic<int64_t> memory_host_{0};
+    std::atomic<int64_t> memory_device_{0};
 
     std::atomic<bool> abort_request_{false};
     std::thread       thread_;
 
+    static std::pair<draw_frame, draw_frame> route_frames(const route_id& id, const layer_frame& layer_frame)
+    {
+        if (id.index == -1) {
+            return {layer_frame.foreground1, layer_frame.foreground2};
+        } else if (id.mode == route_mode::background || (id.mode == route_mode::next && layer_frame.has_background)) {
+            return {draw_frame::pop(layer_frame.background1), draw_frame::pop(layer_frame.background2)};
+        } else {
+            return {draw_frame::pop(layer_frame.foreground1), draw_frame::pop(layer_frame.foreground2)};
+        }
+    }
+
+    // The image is drawn at the size of the format on the gpu, the audio is passed on as it is.
+    draw_frame scale(const draw_frame& frame, const video_format_desc& format_desc)
+    {
+        if (!frame) {
+            return frame;
+        }
+
+        audio_only_visitor audio;
+        frame.accept(audio);
+
+        auto image = image_mixer_->render(frame, format_desc);
+        if (!image) {
+            return audio.take();
+        }
+        return draw_frame::over(draw_frame(std::move(image)), audio.take());
+    }
+
     std::function<void(int, const layer_frame&)> routesCb = [&](int layer, const layer_frame& layer_frame) {
-        std::lock_guard<std::mutex> lock(routes_mutex_);
-        for (auto& r : routes_) {
-            // if this layer is the source for this route, push the frame to the route producers
-            if (layer == r.first.index) {
-                auto route = r.second.lock();
-                if (!route)
-                    continue;
-
-                if (r.first.index == -1) {
-                    route->signal(layer_frame.foreground1, layer_frame.foreground2);
-                } else if (r.first.mode == route_mode::background ||
-                           (r.first.mode == route_mode::next && layer_frame.has_background)) {
-                    route->signal(draw_frame::pop(layer_frame.background1), draw_frame::pop(layer_frame.background2));
-                } else {
-                    route->signal(draw_frame::pop(layer_frame.foreground1), draw_frame::pop(layer_frame.foreground2));
-                }
+        // if this layer is the source for any route, push the frame to the route producers
+        auto it = tick_routes_->layers.find(layer);
+        if (it == tick_routes_->layers.end())
+            return;
+
+        for (auto& entry : it->second) {
+            auto route = entry.route.lock();
+            if (!route)
+                continue;
+
+            auto frames = route_frames(entry.id, layer_frame);
+            if (!entry.scaled) {
+                route->signal(frames.first, frames.second);
+                continue;
             }
+
+            // Rendered once for every format, whatever the number of route producers sharing it.
+            auto frame1 = scale(frames.first, route->format_desc);
+            auto frame2 = frames.second == frames.first ? frame1 : scale(frames.second, route->format_desc);
+            route->signal(frame1, frame2);
         }
     };
 
+    // Routes flag the table for a rebuild once the last route producer has let go of them.
+    std::shared_ptr<core::route> make_route()
+    {
+        return std::shared_ptr<core::route>(new core::route(), [released = routes_released_](core::route* route) {
+            delete route;
+            *released = true;
+        });
+    }
+
+    // Called with routes_mutex_ held.
+    void publish_routes()
+    {
+        auto table = std::make_shared<route_table>();
+
+        for (auto it = routes_.begin(); it != routes_.end();) {
+            if (it->second.expired()) {
+                it = routes_.erase(it);
+            } else {
+                table->layers[it->first.index].push_back({it->first, it->second, false});
+                ++it;
+            }
+        }
+
+        scaled_routes_.erase(std::remove_if(scaled_routes_.begin(),
+                                            scaled_routes_.end(),
+                                            [](const scaled_route& r) { return r.route.expired(); }),
+                             scaled_routes_.end());
+        for (auto& r : scaled_routes_) {
+            table->layers[r.id.index].push_back({r.id, r.route, true});
+        }
+
+        // Determine all layers that need a frame from the background producer
+        for (auto& layer : table->layers) {
+            for (auto& entry : layer.second) {
+                if (entry.id.mode != route_mode::foreground) {
+                    table->background_layers.push_back(layer.first);
+                    break;
+                }
+            }
+        }
+
+        std::atomic_store(&route_table_, std::shared_ptr<const route_table>(std::move(table)));
+    }
+
   public:
     impl(int                                       index,
          const core::video_format_desc&            format_desc,
          std::unique_ptr<image_mixer>              image_mixer,
-         std::function<void(core::monitor::state)> tick)
+         std::function<void(core::monitor::state)> tick,
+         bool                                      pipelined,
+         std::shared_ptr<core::sync_group>         sync_group,
+         bool                                      offline,
+         std::shared_ptr<core::clock_source>       clock,
+         loudness_metering                         loudness)
         : index_(index)
-        , output_(graph_, format_desc, index)
+        , output_(graph_, format_desc, index, std::move(sync_group), std::move(clock))
         , image_mixer_(std::move(image_mixer))
-        , mixer_(index, graph_, image_mixer_)
-        , stage_(std::make_shared<core::stage>(index, graph_, format_desc))
+        , mixer_(index, graph_, image_mixer_, loudness)
+        , stage_(std::make_shared<core::stage>(index, graph_, format_desc, offline))
         , tick_(std::move(tick))
+        , offline_(offline)
     {
         graph_->set_color("produce-time", caspar::diagnostics::color(0.0f, 1.0f, 0.0f));
         graph_->set_color("mix-time", caspar::diagnostics::color(1.0f, 0.0f, 0.9f, 0.8f));
         graph_->set_color("consume-time", caspar::diagnostics::color(1.0f, 0.4f, 0.0f, 0.8f));
         graph_->set_color("frame-time", caspar::diagnostics::color(1.0f, 0.4f, 0.4f, 0.8f));
         graph_->set_color("osc-time", caspar::diagnostics::color(0.3f, 0.4f, 0.0f, 0.8f));
+        if (pipelined) {
+            graph_->set_color("overlap-time", caspar::diagnostics::color(0.4f, 0.6f, 1.0f, 0.8f));
+            pipeline_executor_.emplace(L"channel-pipeline-" + std::to_wstring(index_));
+            pipeline_executor_->begin_invoke([] { set_thread_affinity(thread_role::channel); });
+        }
         graph_->set_text(print());
         caspar::diagnostics::register_graph(graph_);
 
@@ -122,6 +336,10 @@ struct video_channel::impl final
         thread_ = std::thread([=] {
             set_thread_realtime_priority();
             set_thread_name(L"channel-" + std::to_wstring(index_));
+            set_thread_affinity(thread_role::channel);
+
+            // Mix and consume of the previous tick, when running pipelined.
+            std::future<void> pending;
 
             while (!abort_request_) {
                 try {
@@ -131,68 +349,168 @@ struct video_channel::impl final
 
                     caspar::timer frame_timer;
 
-                    // Determine all layers that need a frame from the background producer
-                    std::vector<int> background_routes = {};
-                    {
+                    if (routes_released_->exchange(false)) {
                         std::lock_guard<std::mutex> lock(routes_mutex_);
-
-                        for (auto& r : routes_) {
-                            // Ensure pointer is still valid
-                            if (!r.second.lock())
-                                continue;
-
-                            if (r.first.mode != route_mode::foreground) {
-                                background_routes.push_back(r.first.index);
-                            }
-                        }
+                        publish_routes();
                     }
+                    tick_routes_           = std::atomic_load(&route_table_);
+                    auto background_routes = tick_routes_->background_layers;
 
                     // Produce
                     caspar::timer produce_timer;
-                    auto          stage_frames = (*stage_)(frame_counter_, background_routes, routesCb);
-                    graph_->set_value("produce-time", produce_timer.elapsed() * format_desc.hz * 0.5);
-
-                    // Mix
-                    caspar::timer mix_timer;
-                    auto mixed_frame = mixer_(stage_frames.frames, stage_frames.format_desc, stage_frames.nb_samples);
-                    auto mixed_frame2 =
-                        stage_frames.format_desc.field_count == 2
-                            ? mixer_(stage_frames.frames2, stage_frames.format_desc, stage_frames.nb_samples)
-                            : const_frame{};
-                    graph_->set_value("mix-time", mix_timer.elapsed() * format_desc.hz * 0.5);
-
-                    // Consume
-                    caspar::timer consume_timer;
-                    output_(mixed_frame, mixed_frame2, stage_frames.format_desc);
-                    graph_->set_value("consume-time", consume_timer.elapsed() * stage_frames.format_desc.hz * 0.5);
-
-                    graph_->set_value("frame-time", frame_timer.elapsed() * stage_frames.format_desc.hz * 0.5);
-
-                    monitor::state state = {};
-                    state["stage"]       = stage_->state();
-                    state["mixer"]       = mixer_.state();
-                    state["output"]      = output_.state();
-                    state["framerate"]   = {stage_frames.format_desc.framerate.numerator() *
-                                                stage_frames.format_desc.field_count,
-                                            stage_frames.format_desc.framerate.denominator()};
-                    state["format"]      = stage_frames.format_desc.name;
-                    state_               = state;
-
-                    caspar::timer osc_timer;
-                    tick_(state_);
-                    graph_->set_value("osc-time", osc_timer.elapsed() * stage_frames.format_desc.hz * 0.5);
+                    auto          stage_frames = [&] {
+                        caspar::diagnostics::trace::span span("channel.produce", frame_counter_, index_);
+                        return (*stage_)(frame_counter_, background_routes, routesCb);
+                    }();
+                    auto produce_time = produce_timer.elapsed();
+                    auto          hz           = stage_frames.format_desc.hz;
+                    graph_->set_value("produce-time", produce_time * format_desc.hz * 0.5);
+                    metrics_.produce->observe(produce_time);
+
+                    if (!pipeline_executor_) {
+                        mix_and_consume(stage_frames, frame_counter_);
+                    } else {
+                        // Wait for the previous tick to leave the output before handing over the next one. The
+                        // previous mix/consume started as this produce did, so they overlapped for the shorter of
+                        // the two.
+                        if (pending.valid()) {
+                            pending.get();
+                        }
+                        auto overlap_time = std::min(produce_time, mix_consume_time_.load());
+                        graph_->set_value("overlap-time", overlap_time * hz * 0.5);
+
+                        pending = pipeline_executor_->begin_invoke(
+                            [this, stage_frames = std::move(stage_frames), frame_number = frame_counter_] {
+                                mix_and_consume(stage_frames, frame_number);
+                            });
+                    }
+
+                    auto frame_time = frame_timer.elapsed();
+                    graph_->set_value("frame-time", frame_time * hz * 0.5);
+                    metrics_.frame->observe(frame_time);
                 } catch (...) {
                     CASPAR_LOG_CURRENT_EXCEPTION();
                 }
             }
+
+            if (pending.valid()) {
+                pending.wait();
+            }
         });
     }
 
+    void mix_and_consume(const stage_frames& stage_frames, uint64_t frame_number)
+    {
+        try {
+            caspar::timer mix_consume_timer;
+
+            // Mix
+            caspar::timer mix_timer;
+            const_frame   mixed_frame;
+            const_frame   mixed_frame2;
+            {
+                caspar::diagnostics::trace::span span("channel.mix", frame_number, index_);
+                auto formats        = output_.output_formats();
+                auto scaled_formats = output_.scaled_output_formats();
+                if (stage_frames.format_desc.field_count == 2) {
+                    std::tie(mixed_frame, mixed_frame2) = mixer_(stage_frames.frames,
+                                                                 stage_frames.frames2,
+                                                                 stage_frames.layers,
+                                                                 stage_frames.format_desc,
+                                                                 stage_frames.nb_samples,
+                                                                 formats,
+                                                                 scaled_formats);
+                } else {
+                    mixed_frame = mixer_(stage_frames.frames,
+                                         stage_frames.layers,
+                                         stage_frames.format_desc,
+                                         stage_frames.nb_samples,
+                                         formats,
+                                         scaled_formats);
+                }
+            }
+            auto mix_time = mix_timer.elapsed();
+            graph_->set_value("mix-time", mix_time * stage_frames.format_desc.hz * 0.5);
+            metrics_.mix->observe(mix_time);
+
+            // Offline, the output is unpaced while a producer with an end plays and idles on its clock otherwise.
+            const auto rendering = offline_ && stage_frames.frames_left.value_or(0) > 0;
+            if (offline_) {
+                output_.paced(!rendering);
+            }
+
+            // Consume
+            caspar::timer consume_timer;
+            {
+                caspar::diagnostics::trace::span span("channel.consume", frame_number, index_);
+                output_(mixed_frame, mixed_frame2, stage_frames.format_desc);
+            }
+            auto consume_time = consume_timer.elapsed();
+            graph_->set_value("consume-time", consume_time * stage_frames.format_desc.hz * 0.5);
+            metrics_.consume->observe(consume_time);
+
+            mix_consume_time_ = mix_consume_timer.elapsed();
+
+            if (offline_) {
+                if (rendering && !offline_rendering_) {
+                    offline_frames_ = 0;
+                    CASPAR_LOG(info) << print() << L" Rendering offline.";
+                }
+                if (rendering || offline_rendering_) {
+                    offline_frames_ += 1;
+                }
+                // The longest producer has sent its last frame, removing the consumers closes their files.
+                if (offline_rendering_ && !rendering) {
+                    CASPAR_LOG(info) << print() << L" Rendered " << offline_frames_ << L" frames offline.";
+                    output_.clear();
+                }
+                offline_rendering_ = rendering;
+            }
+
+            const auto consumer_memory = output_.memory();
+            auto       memory          = stage_frames.memory;
+            memory += consumer_memory;
+            memory_host_   = memory.host;
+            memory_device_ = memory.device;
+            metrics_.producer_host->set(static_cast<double>(stage_frames.memory.host));
+            metrics_.producer_device->set(static_cast<double>(stage_frames.memory.device));
+            metrics_.consumer_host->set(static_cast<double>(consumer_memory.host));
+            metrics_.consumer_device->set(static_cast<double>(consumer_memory.device));
+
+            monitor::state state = {};
+            state["stage"]       = stage_->state();
+            state["mixer"]       = mixer_.state();
+            state["output"]      = output_.state();
+            state["framerate"]   = {stage_frames.format_desc.framerate.numerator() * stage_frames.format_desc.field_count,
+                                    stage_frames.format_desc.framerate.denominator()};
+            state["format"]      = stage_frames.format_desc.name;
+            state["pipelined"]   = static_cast<bool>(pipeline_executor_);
+
+            state["memory/host"]   = memory.host;
+            state["memory/device"] = memory.device;
+            if (offline_) {
+                state["offline/rendering"] = offline_rendering_;
+                state["offline/frame"]     = offline_frames_;
+                if (rendering) {
+                    state["offline/frames_left"] = *stage_frames.frames_left;
+                }
+            }
+            std::atomic_store(&state_, std::shared_ptr<const monitor::state>(std::make_shared<monitor::state>(state)));
+
+            caspar::timer osc_timer;
+            tick_(std::move(state));
+            graph_->set_value("osc-time", osc_timer.elapsed() * stage_frames.format_desc.hz * 0.5);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+
     ~impl()
     {
         CASPAR_LOG(info) << print() << " Uninitializing.";
         abort_request_ = true;
         thread_.join();
+        pipeline_executor_.reset();
     }
 
     std::shared_ptr<core::route> route(int index = -1, route_mode mode = route_mode::foreground)
@@ -205,7 +523,7 @@ struct video_channel::impl final
 
         auto route = routes_[id].lock();
         if (!route) {
-            route              = std::make_shared<core::route>();
+            route              = make_route();
             route->format_desc = stage_->video_format_desc(); // TODO this needs updating whenever the videomode changes
             route->name        = std::to_wstring(index_);
             if (index != -1) {
@@ -217,24 +535,96 @@ struct video_channel::impl final
                 route->name += L"/next";
             }
             routes_[id] = route;
+            publish_routes();
+        }
+
+        return route;
+    }
+
+    std::shared_ptr<core::route> route(int                            index,
+                                       route_mode                     mode,
+                                       const core::video_format_desc& format_desc,
+                                       const core::frame_factory&     destination)
+    {
+        auto source = stage_->video_format_desc();
+        if ((format_desc.width == source.width && format_desc.height == source.height) ||
+            !image_mixer_->shares_textures(destination)) {
+            return route(index, mode);
+        }
+
+        std::lock_guard<std::mutex> lock(routes_mutex_);
+
+        for (auto& r : scaled_routes_) {
+            auto route = r.route.lock();
+            if (route && r.id == route_id{index, mode} && route->format_desc.width == format_desc.width &&
+                route->format_desc.height == format_desc.height) {
+                return route;
+            }
+        }
+
+        auto route         = make_route();
+        route->format_desc = format_desc;
+        route->name        = std::to_wstring(index_);
+        if (index != -1) {
+            route->name += L"/" + std::to_wstring(index);
+        }
+        if (mode == route_mode::background) {
+            route->name += L"/background";
+        } else if (mode == route_mode::next) {
+            route->name += L"/next";
         }
+        route->name += L"@" + std::to_wstring(format_desc.width) + L"x" + std::to_wstring(format_desc.height);
+        scaled_routes_.push_back({{index, mode}, route});
+        publish_routes();
 
         return route;
     }
 
+    std::future<void> switch_format(const core::video_format_desc& format_desc)
+    {
+        image_mixer_->prepare(format_desc);
+        return stage_->video_format_desc(format_desc);
+    }
+
+    std::future<array<const std::uint8_t>> read(const draw_frame& frame, output_format format)
+    {
+        return image_mixer_->read(frame, stage_->video_format_desc(), format);
+    }
+
     std::wstring print() const
     {
         return L"video_channel[" + std::to_wstring(index_) + L"|" + stage_->video_format_desc().name + L"]";
     }
 
     int index() const { return index_; }
+
+    memory_usage memory() const
+    {
+        memory_usage usage;
+        usage.host   = memory_host_;
+        usage.device = memory_device_;
+        return usage;
+    }
 };
 
 video_channel::video_channel(int                                       index,
                              const core::video_format_desc&            format_desc,
                              std::unique_ptr<image_mixer>              image_mixer,
-                             std::function<void(core::monitor::state)> tick)
-    : impl_(new impl(index, format_desc, std::move(image_mixer), std::move(tick)))
+                             std::function<void(core::monitor::state)> tick,
+                             bool                                      pipelined,
+                             std::shared_ptr<core::sync_group>         sync_group,
+                             bool                                      offline,
+                             std::shared_ptr<core::clock_source>       clock,
+                             loudness_metering                         loudness)
+    : impl_(new impl(index,
+                     format_desc,
+                     std::move(image_mixer),
+                     std::move(tick),
+                     pipelined,
+                     std::move(sync_group),
+                     offline,
+                     std::move(clock),
+                     loudness))
 {
 }
 video_channel::~video_channel() {}
@@ -245,9 +635,25 @@ mixer&                              video_channel::mixer() { return impl_->mixer
 const output&                       video_channel::output() const { return impl_->output_; }
 output&                             video_channel::output() { return impl_->output_; }
 spl::shared_ptr<frame_factory>      video_channel::frame_factory() { return impl_->image_mixer_; }
+std::future<void> video_channel::switch_format(const video_format_desc& format_desc)
+{
+    return impl_->switch_format(format_desc);
+}
 int                                 video_channel::index() const { return impl_->index(); }
-core::monitor::state                video_channel::state() const { return impl_->state_; }
+memory_usage                        video_channel::memory() const { return impl_->memory(); }
+std::future<array<const std::uint8_t>> video_channel::read(const draw_frame& frame, output_format format)
+{
+    return impl_->read(frame, format);
+}
+core::monitor::state                video_channel::state() const { return *std::atomic_load(&impl_->state_); }
 
 std::shared_ptr<route> video_channel::route(int index, route_mode mode) { return impl_->route(index, mode); }
+std::shared_ptr<route> video_channel::route(int                        index,
+                                            route_mode                 mode,
+                                            const video_format_desc&   format_desc,
+                                            const core::frame_factory& destination)
+{
+    return impl_->route(index, mode, format_desc, destination);
+}
 
 }} // namespace caspar::core
@@ -24,6 +24,8 @@
 #include "fwd.h"
 #include "video_format.h"
 
+#include "frame/frame.h"
+#include "mixer/audio/loudness_meter.h"
 #include "monitor/monitor.h"
 
 #include <common/memory.h>
@@ -31,6 +33,7 @@
 #include <boost/signals2.hpp>
 
 #include <functional>
+#include <future>
 
 namespace caspar { namespace core {
 
@@ -72,7 +75,12 @@ class video_channel final
     explicit video_channel(int                                       index,
                            const video_format_desc&                  format_desc,
                            std::unique_ptr<image_mixer>              image_mixer,
-                           std::function<void(core::monitor::state)> on_tick);
+                           std::function<void(core::monitor::state)> on_tick,
+                           bool                                      pipelined  = false,
+                           std::shared_ptr<sync_group>               sync_group = nullptr,
+                           bool                                      offline    = false,
+                           std::shared_ptr<clock_source>             clock      = nullptr,
+                           loudness_metering                         loudness   = loudness_metering::none);
     ~video_channel();
 
     core::monitor::state state() const;
@@ -86,10 +94,29 @@ class video_channel final
 
     spl::shared_ptr<core::frame_factory> frame_factory();
 
+    // Switches the channel to another format, clearing its layers. Their first frame in it is produced by the next
+    // tick, the mixer gets ready for it meanwhile.
+    std::future<void> switch_format(const video_format_desc& format_desc);
+
     int index() const;
 
+    // Held by the producers and consumers of the channel, as of the last tick.
+    memory_usage memory() const;
+
     std::shared_ptr<core::route> route(int index = -1, route_mode mode = route_mode::foreground);
 
+    // A route with the frames drawn at the size of the format by this channel's gpu, rendered once per tick for every
+    // format and shared by all the routes asking for it. The route above when the size is the same or the mixer behind
+    // the destination frame factory can't draw this channel's textures.
+    std::shared_ptr<core::route> route(int                        index,
+                                       route_mode                 mode,
+                                       const video_format_desc&   format_desc,
+                                       const core::frame_factory& destination);
+
+    // Draws a frame, such as one from a route, at the size of the channel by its gpu and reads it back in the format.
+    // For routes leaving the server, empty if there is nothing to draw.
+    std::future<array<const std::uint8_t>> read(const draw_frame& frame, output_format format);
+
   private:
     struct impl;
     spl::unique_ptr<impl> impl_;
@@ -269,4 +269,6 @@ std::wostream& operator<<(std::wostream& out, const video_format_desc& format_de
     return out;
 }
 
+bool is_upper_field_first(const video_format_desc& format_desc) { return format_desc.format != video_format::ntsc; }
+
 }} // namespace caspar::core
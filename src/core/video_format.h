@@ -126,6 +126,9 @@ bool operator!=(const video_format_desc& rhs, const video_format_desc& lhs);
 
 std::wostream& operator<<(std::wostream& out, const video_format_desc& format_desc);
 
+// Whether the first field of an interlaced format is on the even lines, as SDI sends it. NTSC is lower field first.
+bool is_upper_field_first(const video_format_desc& format_desc);
+
 class video_format_repository
 {
   public:
@@ -25,7 +25,6 @@
 // ^^ This is needed to avoid a conflict between boost asio and other header files defining NOMINMAX
 
 #include <common/array.h>
-#include <common/future.h>
 #include <common/log.h>
 #include <common/ptree.h>
 #include <common/utf.h>
@@ -39,11 +38,22 @@
 #include <boost/locale/encoding_utf.hpp>
 #include <boost/property_tree/ptree.hpp>
 
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cerrno>
 #include <cmath>
+#include <cstring>
 #include <thread>
 #include <utility>
 #include <vector>
 
+#if defined(__linux__)
+#include <sys/socket.h>
+#endif
+
 using namespace boost::asio;
 using namespace boost::asio::ip;
 
@@ -51,7 +61,9 @@ namespace caspar { namespace artnet {
 
 struct configuration
 {
-    int refreshRate = 10;
+    int                 refreshRate = 10;
+    int                 keepAlive   = 1000; // ms before an unchanged universe is sent again
+    bool                artSync     = true;
     std::vector<sender> senders;
 };
 
@@ -112,12 +124,12 @@ struct artnet_consumer : public core::frame_consumer
             thread_.join();
     }
 
-    std::future<bool> send(core::video_field field, core::const_frame frame) override
+    core::send_result send(core::video_field field, core::const_frame frame) override
     {
         std::lock_guard<std::mutex> lock(frame_mutex_);
         last_frame_ = frame;
 
-        return make_ready_future(true);
+        return true;
     }
 
     std::wstring print() const override { return L"artnet[]"; }
@@ -129,9 +141,11 @@ struct artnet_consumer : public core::frame_consumer
     core::monitor::state state() const override
     {
         core::monitor::state state;
-        state["artnet/computed-senders"]  = computed_senders.size();
-        state["artnet/senders"]           = config.senders.size();
-        state["artnet/refresh-rate"]      = config.refreshRate;
+        state["artnet/computed-senders"]   = computed_senders.size();
+        state["artnet/senders"]            = config.senders.size();
+        state["artnet/refresh-rate"]       = config.refreshRate;
+        state["artnet/packets-per-second"] = packets_per_second_.load();
+        state["artnet/suppressed-packets"] = suppressed_packets_.load();
 
         return state;
     }
@@ -147,40 +161,121 @@ struct artnet_consumer : public core::frame_consumer
     udp::socket   socket;
     udp::endpoint remote_endpoint;
 
+    using packet = std::array<std::uint8_t, 18 + 512>;
+
+    struct datagram
+    {
+        const std::uint8_t* data;
+        std::size_t         size;
+        udp::endpoint       endpoint;
+    };
+
+    int spans_width_  = 0;
+    int spans_height_ = 0;
+
+    // What each universe last sent and when, to only send changes and keep-alives.
+    std::vector<packet>                                last_packets_;
+    std::vector<std::chrono::steady_clock::time_point> last_sends_;
+
+    std::atomic<int>                      packets_per_second_{0};
+    std::atomic<std::int64_t>             suppressed_packets_{0};
+    int                                   packets_in_second_ = 0;
+    std::chrono::steady_clock::time_point second_start_      = std::chrono::steady_clock::now();
+
     void send_computed_senders(core::const_frame frame)
     {
-        for (auto computed_sender : computed_senders)
-            send_computed_sender(computed_sender, frame);
+        const auto width  = static_cast<int>(frame.width());
+        const auto height = static_cast<int>(frame.height());
+        if (width != spans_width_ || height != spans_height_) {
+            for (auto& computed_sender : computed_senders) {
+                for (auto& computed_fixture : computed_sender.fixtures)
+                    computed_fixture.spans = compute_spans(computed_fixture.rectangle, width, height);
+            }
+            spans_width_  = width;
+            spans_height_ = height;
+        }
+
+        std::vector<packet> packets(computed_senders.size());
+        for (size_t n = 0; n < computed_senders.size(); n++)
+            compute_packet(computed_senders[n], frame, packets[n]);
+
+        const auto now = std::chrono::steady_clock::now();
+        if (last_packets_.size() != packets.size()) {
+            last_packets_.assign(packets.size(), packet{});
+            last_sends_.assign(packets.size(), std::chrono::steady_clock::time_point{});
+        }
+
+        std::vector<datagram> datagrams;
+        for (size_t n = 0; n < packets.size(); n++) {
+            if (last_sends_[n] != std::chrono::steady_clock::time_point{} && packets[n] == last_packets_[n] &&
+                now - last_sends_[n] < std::chrono::milliseconds(config.keepAlive)) {
+                suppressed_packets_++;
+                continue;
+            }
+
+            last_packets_[n] = packets[n];
+            last_sends_[n]   = now;
+            datagrams.push_back(
+                datagram{last_packets_[n].data(), last_packets_[n].size(), computed_senders[n].endpoint});
+        }
+
+        // ArtSync latches the universes sent before it together, once to each node that got one.
+        static const std::uint8_t sync[] = {65, 114, 116, 45, 78, 101, 116, 0, 0, 82, 0, 14, 0, 0};
+        if (config.artSync && !datagrams.empty()) {
+            std::vector<udp::endpoint> nodes;
+            for (auto& datagram : datagrams)
+                nodes.push_back(datagram.endpoint);
+            std::sort(nodes.begin(), nodes.end());
+            nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+            for (auto& node : nodes)
+                datagrams.push_back(datagram{sync, sizeof(sync), node});
+        }
+
+        send_datagrams(datagrams);
+
+        packets_in_second_ += static_cast<int>(datagrams.size());
+        if (now - second_start_ >= std::chrono::seconds(1)) {
+            std::chrono::duration<double> elapsed = now - second_start_;
+            packets_per_second_ = static_cast<int>(packets_in_second_ / elapsed.count() + 0.5);
+            packets_in_second_  = 0;
+            second_start_       = now;
+        }
     }
 
-    void send_computed_sender(computed_sender sender, core::const_frame frame) {
+    void compute_packet(const computed_sender& sender, const core::const_frame& frame, packet& packet)
+    {
         uint8_t dmx_data[512];
         memset(dmx_data, 0, 512);
 
-        for (auto computed_fixture : sender.fixtures) {
-            auto     color = average_color(frame, computed_fixture.rectangle);
-            uint8_t* ptr   = dmx_data + computed_fixture.address;
-
-            switch (computed_fixture.type) {
-                case FixtureType::DIMMER:
-                    ptr[0] = (uint8_t)(0.279 * color.r + 0.547 * color.g + 0.106 * color.b);
-                    break;
-                case FixtureType::RGB:
-                    ptr[0] = color.r;
-                    ptr[1] = color.g;
-                    ptr[2] = color.b;
-                    break;
-                case FixtureType::RGBW:
-                    uint8_t w = std::min(std::min(color.r, color.g), color.b);
-                    ptr[0]    = color.r - w;
-                    ptr[1]    = color.g - w;
-                    ptr[2]    = color.b - w;
-                    ptr[3]    = w;
-                    break;
+        // Fixtures only write their own channels, so they can be averaged side by side.
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, sender.fixtures.size()), [&](const auto& range) {
+            for (auto i = range.begin(); i != range.end(); ++i) {
+                const auto& computed_fixture = sender.fixtures[i];
+
+                auto     color = average_color(frame, computed_fixture.spans);
+                uint8_t* ptr   = dmx_data + computed_fixture.address;
+
+                switch (computed_fixture.type) {
+                    case FixtureType::DIMMER:
+                        ptr[0] = (uint8_t)(0.279 * color.r + 0.547 * color.g + 0.106 * color.b);
+                        break;
+                    case FixtureType::RGB:
+                        ptr[0] = color.r;
+                        ptr[1] = color.g;
+                        ptr[2] = color.b;
+                        break;
+                    case FixtureType::RGBW:
+                        uint8_t w = std::min(std::min(color.r, color.g), color.b);
+                        ptr[0]    = color.r - w;
+                        ptr[1]    = color.g - w;
+                        ptr[2]    = color.b - w;
+                        ptr[3]    = w;
+                        break;
+                }
             }
-        }
+        });
 
-        send_dmx_data(sender, dmx_data, 512);
+        write_dmx_packet(sender, dmx_data, 512, packet);
     }
 
     std::vector<computed_fixture> compute_fixtures(sender sender)
@@ -216,7 +311,8 @@ struct artnet_consumer : public core::frame_consumer
         }
     }
 
-    void send_dmx_data(computed_sender sender, const std::uint8_t* data, std::size_t length)
+    static void
+    write_dmx_packet(const computed_sender& sender, const std::uint8_t* data, std::size_t length, packet& buffer)
     {
         int universe = sender.universe;
 
@@ -227,7 +323,6 @@ struct artnet_consumer : public core::frame_consumer
         std::uint8_t lLen = (length & 0xff);
 
         std::uint8_t header[] = {65, 114, 116, 45, 78, 101, 116, 0, 0, 80, 0, 14, 0, 0, lUni, hUni, hLen, lLen};
-        std::uint8_t buffer[18 + 512];
 
         for (int i = 0; i < 18 + 512; i++) {
             if (i < 18) {
@@ -242,11 +337,46 @@ struct artnet_consumer : public core::frame_consumer
 
             buffer[i] = 0;
         }
+    }
+
+    // Sends the universes of a tick with one system call where the platform has one.
+    void send_datagrams(const std::vector<datagram>& datagrams)
+    {
+#if defined(__linux__)
+        std::vector<udp::endpoint> endpoints(datagrams.size());
+        std::vector<mmsghdr>       messages(datagrams.size());
+        std::vector<iovec>         vectors(datagrams.size());
+        for (size_t n = 0; n < datagrams.size(); n++) {
+            vectors[n].iov_base = const_cast<std::uint8_t*>(datagrams[n].data);
+            vectors[n].iov_len  = datagrams[n].size;
+
+            endpoints[n]                    = datagrams[n].endpoint;
+            messages[n].msg_hdr             = {};
+            messages[n].msg_hdr.msg_name    = endpoints[n].data();
+            messages[n].msg_hdr.msg_namelen = static_cast<socklen_t>(endpoints[n].size());
+            messages[n].msg_hdr.msg_iov     = &vectors[n];
+            messages[n].msg_hdr.msg_iovlen  = 1;
+        }
 
-        boost::system::error_code err;
-        socket.send_to(boost::asio::buffer(buffer), sender.endpoint, 0, err);
-        if (err)
-            CASPAR_THROW_EXCEPTION(io_error() << msg_info(err.message()));
+        size_t sent = 0;
+        while (sent < messages.size()) {
+            auto result = ::sendmmsg(
+                socket.native_handle(), messages.data() + sent, static_cast<unsigned int>(messages.size() - sent), 0);
+            if (result < 0) {
+                if (errno == EINTR)
+                    continue;
+                CASPAR_THROW_EXCEPTION(io_error() << msg_info(std::strerror(errno)));
+            }
+            sent += result;
+        }
+#else
+        for (auto& datagram : datagrams) {
+            boost::system::error_code err;
+            socket.send_to(boost::asio::buffer(datagram.data, datagram.size), datagram.endpoint, 0, err);
+            if (err)
+                CASPAR_THROW_EXCEPTION(io_error() << msg_info(err.message()));
+        }
+#endif
     }
 };
 
@@ -348,6 +478,8 @@ create_preconfigured_consumer(const boost::property_tree::wptree&
 {
     configuration config;
     config.refreshRate = ptree.get(L"refresh-rate", config.refreshRate);
+    config.keepAlive   = ptree.get(L"keep-alive", config.keepAlive);
+    config.artSync     = ptree.get(L"art-sync", config.artSync);
 
     if (config.refreshRate < 1)
         CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Refresh rate must be at least 1"));
@@ -84,10 +84,8 @@ rect compute_rect(box fixtureBox, int index, int count)
     return rectangle;
 }
 
-color average_color(const core::const_frame& frame, rect& rectangle)
+std::vector<span> compute_spans(const rect& rectangle, int width, int height)
 {
-    int width  = (int)frame.width();
-    int height = (int)frame.height();
 
     float x_values[] = {rectangle.p1.x, rectangle.p2.x, rectangle.p3.x, rectangle.p4.x};
     float y_values[] = {rectangle.p1.y, rectangle.p2.y, rectangle.p3.y, rectangle.p4.y};
@@ -119,8 +117,8 @@ color average_color(const core::const_frame& frame, rect& rectangle)
         }
     }
 
-    // Below is a rasterization algorithm that goes through the pixels in rectangle
-    // and calculates the average color
+    // Below is a rasterization algorithm that goes through the lines of the rectangle
+    // and collects the pixels inside it, so average_color only has to sum them
 
     // Which lines to use for the rasterization
     // in the format [a, b, c, d] => a -> b, c -> d
@@ -135,16 +133,7 @@ color average_color(const core::const_frame& frame, rect& rectangle)
     int y_min = std::max(0, std::min(height - 1, (int)y_values[0]));
     int y_max = std::max(0, std::min(height - 1, (int)y_values[3]));
 
-    const array<const std::uint8_t>& values    = frame.image_data(0);
-    const std::uint8_t*              value_ptr = values.data();
-
-    // Total color values, as well as the number of pixels in the rectangle
-    // used to calculate the average without loss of precision
-    unsigned long long tr = 0;
-    unsigned long long tg = 0;
-    unsigned long long tb = 0;
-
-    unsigned long long count = 0;
+    std::vector<span> spans;
 
     // Go through the vertical lines of the rectangle, and then through the pixels in the line
     // that are inside the rectangle
@@ -193,28 +182,62 @@ color average_color(const core::const_frame& frame, rect& rectangle)
         int min_x = std::min(x1, x2);
         int max_x = std::max(x1, x2);
 
-        // Go through the pixels in the line
-        for (int x = min_x; x <= max_x; x++) {
-            int                 pos      = y * width + x;
-            const std::uint8_t* base_ptr = value_ptr + pos * 4;
+        spans.push_back(span{y, min_x, max_x});
+    }
 
-            float a = (float)base_ptr[3] / 255.0f;
+    return spans;
+}
 
-            float r = (float)base_ptr[2] * a;
-            float g = (float)base_ptr[1] * a;
-            float b = (float)base_ptr[0] * a;
+color average_color(const core::const_frame& frame, const std::vector<span>& spans)
+{
+    const auto                       width     = static_cast<int>(frame.width());
+    const array<const std::uint8_t>& values    = frame.image_data(0);
+    const std::uint8_t*              value_ptr = values.data();
 
-            tr += (unsigned long long)(r);
-            tg += (unsigned long long)(g);
-            tb += (unsigned long long)(b);
+    // Total color values, weighted by alpha, as well as the number of pixels in the rectangle
+    // used to calculate the average without loss of precision
+    unsigned long long tr = 0;
+    unsigned long long tg = 0;
+    unsigned long long tb = 0;
+
+    unsigned long long count = 0;
+
+    for (const auto& span : spans) {
+        const std::uint8_t* base_ptr = value_ptr + (static_cast<size_t>(span.y) * width + span.begin) * 4;
+        const int           length   = span.end - span.begin + 1;
 
-            count++;
+        // Sums of a line fit 32 bits for any width below 66000, which lets the compiler vectorize the loop.
+        std::uint32_t r = 0;
+        std::uint32_t g = 0;
+        std::uint32_t b = 0;
+        for (int x = 0; x < length; x++) {
+            const std::uint32_t a = base_ptr[x * 4 + 3];
+
+            r += base_ptr[x * 4 + 2] * a;
+            g += base_ptr[x * 4 + 1] * a;
+            b += base_ptr[x * 4 + 0] * a;
         }
+
+        tr += r;
+        tg += g;
+        tb += b;
+
+        count += length;
     }
 
+    if (count == 0)
+        return color{0, 0, 0};
+
+    count *= 255;
+
     color c{(std::uint8_t)(tr / count), (std::uint8_t)(tg / count), (std::uint8_t)(tb / count)};
 
     return c;
 }
 
+color average_color(const core::const_frame& frame, rect& rectangle)
+{
+    return average_color(frame, compute_spans(rectangle, (int)frame.width(), (int)frame.height()));
+}
+
 }} // namespace caspar::artnet
\ No newline at end of file
@@ -54,12 +54,21 @@ struct rect
     point p4;
 };
 
+// The pixels of one line a fixture covers, from begin up to and including end.
+struct span
+{
+    int y;
+    int begin;
+    int end;
+};
+
 struct computed_fixture
 {
     FixtureType    type;
     unsigned short address;
 
-    rect rectangle;
+    rect              rectangle;
+    std::vector<span> spans; // Rasterized for the frame size of the channel
 };
 
 struct color
@@ -104,7 +113,9 @@ struct computed_sender {
     std::vector<computed_fixture>       fixtures;
 };
 
-rect  compute_rect(box fixtureBox, int index, int count);
-color average_color(const core::const_frame& frame, rect& rectangle);
+rect              compute_rect(box fixtureBox, int index, int count);
+std::vector<span> compute_spans(const rect& rectangle, int width, int height);
+color             average_color(const core::const_frame& frame, const std::vector<span>& spans);
+color             average_color(const core::const_frame& frame, rect& rectangle);
 
 }} // namespace caspar::artnet
\ No newline at end of file
@@ -68,16 +68,19 @@ std::vector<std::wstring> device_list()
 
 void init(const core::module_dependencies& dependencies)
 {
-    try {
-        bvc_wrapper blue;
-        int         num_cards = 0;
-        blue.enumerate(&num_cards);
-    } catch (...) {
+    // Otherwise the driver is loaded by the first consumer or producer of a card.
+    if (core::get_module_init() == core::module_init::eager) {
+        try {
+            bvc_wrapper blue;
+            int         num_cards = 0;
+            blue.enumerate(&num_cards);
+        } catch (...) {
+        }
     }
 
     dependencies.consumer_registry->register_consumer_factory(L"Bluefish Consumer", create_consumer);
     dependencies.consumer_registry->register_preconfigured_consumer_factory(L"bluefish", create_preconfigured_consumer);
-    dependencies.producer_registry->register_producer_factory(L"Bluefish Producer", create_producer);
+    dependencies.producer_registry->register_producer_factory(L"Bluefish Producer", create_producer, {{L"BLUEFISH"}});
 }
 
 }} // namespace caspar::bluefish
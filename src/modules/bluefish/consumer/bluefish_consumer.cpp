@@ -186,6 +186,7 @@ struct bluefish_consumer
 
     unsigned int mode_; // ie bf video mode / format
     bool         interlaced_ = false;
+    int          card_type_  = CRD_INVALID; // queried once, the hanc of every frame is encoded for it
 
     std::array<blue_dma_buffer_ptr, BLUEFISH_MAX_SOFTWARE_BUFFERS> all_frames_;
     tbb::concurrent_bounded_queue<blue_dma_buffer_ptr>             reserved_frames_;
@@ -194,9 +195,6 @@ struct bluefish_consumer
     std::atomic<int64_t> audio_frames_filled_{0};
     blue_dma_buffer_ptr  last_field_buf_ = nullptr;
 
-    std::vector<uint32_t> tmp_audio_buf_;
-    unsigned int          tmp_audio_buf_contains_samples = 0;
-
     std::shared_ptr<std::thread> dma_present_thread_;
     std::shared_ptr<std::thread> hardware_watchdog_thread_;
     std::atomic<bool>            end_hardware_watchdog_thread_;
@@ -240,6 +238,7 @@ struct bluefish_consumer
         setup_hardware_output_channel(); // ie stream id
 
         model_name_ = get_card_desc(*blue_.get(), (int)config_.device_index);
+        blue_->query_card_type(&card_type_, config_.device_index);
 
         // disable the video output while we do all the config.
         disable_video_output();
@@ -304,10 +303,10 @@ struct bluefish_consumer
         boost::range::generate(
             all_frames_, [&] { return std::make_shared<blue_dma_buffer>(static_cast<int>(format_desc_.size), n++); });
 
-        for (size_t i = 0; i < all_frames_.size(); i++)
+        for (size_t i = 0; i < all_frames_.size(); i++) {
+            all_frames_[i]->audio_data().reserve(SIZE_TEMP_AUDIO_BUFFER);
             reserved_frames_.push(all_frames_[i]);
-
-        tmp_audio_buf_.reserve(SIZE_TEMP_AUDIO_BUFFER);
+        }
 
         // start the thread if required.
         if (dma_present_thread_ == nullptr) {
@@ -660,6 +659,14 @@ struct bluefish_consumer
             if (live_frames_.try_pop(buf) && (blue_->video_playback_allocate(&buffer_id, &underrun) == 0)) {
                 // Send and display
                 if (config_.embedded_audio) {
+                    // The hanc is encoded here rather than on the consumer thread, which only queues the frames.
+                    if (buf->audio_samples() > 0) {
+                        encode_hanc(reinterpret_cast<BLUE_U32*>(buf->hanc_data()),
+                                    reinterpret_cast<void*>(buf->audio_data().data()),
+                                    buf->audio_samples(),
+                                    static_cast<int>(format_desc_.audio_channels));
+                    }
+
                     // Do video first, then do hanc DMA...
                     blue_->system_buffer_write(const_cast<uint8_t*>(buf->image_data()),
                                                static_cast<unsigned long>(buf->image_size()),
@@ -684,6 +691,7 @@ struct bluefish_consumer
                 }
 
                 ++scheduled_frames_completed_;
+                buf->reset();
                 reserved_frames_.push(buf);
             }
 
@@ -716,65 +724,59 @@ struct bluefish_consumer
             if (!last_field_buf_) // field 1
             {
                 if (reserved_frames_.try_pop(last_field_buf_)) {
-                    // copy video data into holding buf
-                    void* dest = last_field_buf_->image_data();
-                    if (frame.image_data(0).size()) {
-                        std::memcpy(dest, frame.image_data(0).begin(), frame.image_data(0).size());
-                    } else
-                        std::memset(dest, 0, last_field_buf_->image_size());
+                    // hold on to the video data, or copy it into the holding buf
+                    if (!last_field_buf_->set_frame(frame)) {
+                        void* dest = last_field_buf_->image_data();
+                        if (frame.image_data(0).size()) {
+                            std::memcpy(dest, frame.image_data(0).begin(), frame.image_data(0).size());
+                        } else
+                            std::memset(dest, 0, last_field_buf_->image_size());
+                    }
 
                     // now copy Some of the Audio bytes that we need
                     if (config_.embedded_audio) {
-                        auto audio_size = frame.audio_data().size() * 4;
-                        if (audio_size) {
-                            tmp_audio_buf_.insert(
-                                tmp_audio_buf_.end(), frame.audio_data().begin(), frame.audio_data().end());
-                        }
+                        auto& audio = last_field_buf_->audio_data();
+                        audio.insert(audio.end(), frame.audio_data().begin(), frame.audio_data().end());
                     }
                 }
             } else // field 2
             {
-                // we have already done the video... just grab the last bit of audio, encode and push to Q.
+                // we have already done the video... just grab the last bit of audio and push to Q for encoding.
                 if (config_.embedded_audio) {
-                    auto audio_size = frame.audio_data().size() * 4;
-                    if (audio_size) {
-                        tmp_audio_buf_.insert(
-                            tmp_audio_buf_.end(), frame.audio_data().begin(), frame.audio_data().end());
-
-                        encode_hanc(reinterpret_cast<BLUE_U32*>(last_field_buf_->hanc_data()),
-                                    reinterpret_cast<void*>(tmp_audio_buf_.data()),
-                                    audio_samples_for_next_frame,
-                                    static_cast<int>(format_desc_.audio_channels));
+                    if (frame.audio_data().size()) {
+                        auto& audio = last_field_buf_->audio_data();
+                        audio.insert(audio.end(), frame.audio_data().begin(), frame.audio_data().end());
+                        last_field_buf_->set_audio_samples(audio_samples_for_next_frame);
                         ++audio_frames_filled_;
                     }
                 }
                 // push to in use Q.
                 live_frames_.push(last_field_buf_);
                 last_field_buf_ = nullptr;
-                tmp_audio_buf_.clear();
             }
         } else {
             blue_dma_buffer_ptr buf = nullptr;
             // Copy to local buffers
             if (reserved_frames_.try_pop(buf)) {
-                void* dest = buf->image_data();
-                if (frame.image_data(0).size()) {
-                    if (config_.uhd_mode == uhd_output_option::force_2si) {
-                        // Do the Square Division top 2si conversion here.
-                        blue_->convert_sq_to_2si(
-                            (int)frame.width(), (int)frame.height(), (void*)frame.image_data(0).begin(), dest);
+                // The 2si conversion needs the buffer's own memory, otherwise the frame is DMA'd as it is.
+                if (config_.uhd_mode == uhd_output_option::force_2si || !buf->set_frame(frame)) {
+                    void* dest = buf->image_data();
+                    if (frame.image_data(0).size()) {
+                        if (config_.uhd_mode == uhd_output_option::force_2si) {
+                            // Do the Square Division top 2si conversion here.
+                            blue_->convert_sq_to_2si(
+                                (int)frame.width(), (int)frame.height(), (void*)frame.image_data(0).begin(), dest);
+                        } else
+                            std::memcpy(dest, frame.image_data(0).begin(), frame.image_data(0).size());
                     } else
-                        std::memcpy(dest, frame.image_data(0).begin(), frame.image_data(0).size());
-                } else
-                    std::memset(dest, 0, buf->image_size());
+                        std::memset(dest, 0, buf->image_size());
+                }
 
-                // encode and copy hanc data
+                // copy the audio for the hanc, which is encoded by the dma thread
                 if (config_.embedded_audio) {
                     if (frame.audio_data().size()) {
-                        encode_hanc(reinterpret_cast<BLUE_U32*>(buf->hanc_data()),
-                                    (void*)frame.audio_data().data(),
-                                    audio_samples_for_next_frame,
-                                    static_cast<int>(format_desc_.audio_channels));
+                        buf->audio_data().assign(frame.audio_data().begin(), frame.audio_data().end());
+                        buf->set_audio_samples(audio_samples_for_next_frame);
                         ++audio_frames_filled_;
                     }
                 }
@@ -814,10 +816,18 @@ struct bluefish_consumer
         hanc_stream_info.hanc_data_ptr    = hanc_data;
         hanc_stream_info.video_mode       = get_bluefish_video_format(format_desc_.format);
 
-        int card_type = CRD_INVALID;
-        blue_->query_card_type(&card_type, config_.device_index);
         blue_->encode_hanc_frame(
-            card_type, &hanc_stream_info, audio_data, audio_nchannels, audio_samples, sample_type, emb_audio_flag);
+            card_type_, &hanc_stream_info, audio_data, audio_nchannels, audio_samples, sample_type, emb_audio_flag);
+    }
+
+    // The software buffers, allocated up front.
+    std::int64_t memory() const
+    {
+        std::int64_t bytes = 0;
+        for (auto& buf : all_frames_) {
+            bytes += buf ? buf->memory() : 0;
+        }
+        return bytes;
     }
 
     std::wstring print() const
@@ -835,6 +845,7 @@ struct bluefish_consumer_proxy : public core::frame_consumer
     const configuration                config_;
     std::unique_ptr<bluefish_consumer> consumer_;
     core::video_format_desc            format_desc_;
+    std::atomic<std::int64_t>          memory_{0}; // of consumer_
     executor                           executor_;
 
   public:
@@ -856,10 +867,11 @@ struct bluefish_consumer_proxy : public core::frame_consumer
         executor_.invoke([=] {
             consumer_.reset();
             consumer_.reset(new bluefish_consumer(config_, format_desc, channel_index));
+            memory_ = consumer_->memory();
         });
     }
 
-    std::future<bool> send(core::video_field field, core::const_frame frame) override
+    core::send_result send(core::video_field field, core::const_frame frame) override
     {
         return executor_.begin_invoke([=] { return consumer_->send(field, frame); });
     }
@@ -872,6 +884,13 @@ struct bluefish_consumer_proxy : public core::frame_consumer
 
     bool has_synchronization_clock() const override { return true; }
 
+    core::memory_usage memory() const override
+    {
+        core::memory_usage usage;
+        usage.host = memory_;
+        return usage;
+    }
+
     core::monitor::state state() const override
     {
         core::monitor::state state;
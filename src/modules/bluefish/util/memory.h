@@ -23,7 +23,12 @@
 #pragma once
 
 #include <Windows.h>
+
+#include <core/frame/frame.h>
+
 #include <boost/align.hpp>
+
+#include <cstdint>
 #include <vector>
 
 namespace caspar { namespace bluefish {
@@ -45,18 +50,53 @@ struct blue_dma_buffer
 
     int id() const { return id_; }
 
-    PBYTE image_data() { return image_buffer_.data(); }
+    // The image is DMA'd straight from the frame's memory while the frame is held, and from the buffer's own
+    // memory otherwise.
+    PBYTE image_data() { return frame_ ? const_cast<PBYTE>(frame_.image_data(0).data()) : image_buffer_.data(); }
     PBYTE hanc_data() { return hanc_buffer_.data(); }
 
     size_t image_size() const { return image_size_; }
     size_t hanc_size() const { return hanc_size_; }
 
+    // Bytes of the buffer's own memory, a frame it holds on to is counted by the mixer.
+    size_t memory() const
+    {
+        return image_buffer_.capacity() + hanc_buffer_.capacity() + audio_buffer_.capacity() * sizeof(std::uint32_t);
+    }
+
+    // Holds on to the frame instead of copying it, if its image fills the buffer and is aligned like it.
+    bool set_frame(const core::const_frame& frame)
+    {
+        const auto& image = frame.image_data(0);
+        if (image.size() != image_size_ || reinterpret_cast<std::uintptr_t>(image.data()) % 64 != 0) {
+            return false;
+        }
+        frame_ = frame;
+        return true;
+    }
+
+    // The samples the HANC is encoded from, just before the buffer is DMA'd.
+    std::vector<std::uint32_t>& audio_data() { return audio_buffer_; }
+    int                         audio_samples() const { return audio_samples_; }
+    void                        set_audio_samples(int samples) { audio_samples_ = samples; }
+
+    // Releases the frame and the samples once the buffer has been DMA'd.
+    void reset()
+    {
+        frame_         = core::const_frame{};
+        audio_samples_ = 0;
+        audio_buffer_.clear();
+    }
+
   private:
     int                                                              id_;
     size_t                                                           image_size_;
     size_t                                                           hanc_size_;
     std::vector<BYTE, boost::alignment::aligned_allocator<BYTE, 64>> image_buffer_;
     std::vector<BYTE, boost::alignment::aligned_allocator<BYTE, 64>> hanc_buffer_;
+    core::const_frame                                                frame_;
+    std::vector<std::uint32_t>                                       audio_buffer_;
+    int                                                              audio_samples_ = 0;
 };
 using blue_dma_buffer_ptr = std::shared_ptr<blue_dma_buffer>;
 
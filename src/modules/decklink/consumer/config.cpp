@@ -24,6 +24,8 @@
 #include <common/param.h>
 #include <common/ptree.h>
 
+#include <algorithm>
+
 namespace caspar { namespace decklink {
 
 port_configuration parse_output_config(const boost::property_tree::wptree&  ptree,
@@ -106,6 +108,19 @@ configuration parse_xml_config(const boost::property_tree::wptree&  ptree,
 
     config.embedded_audio    = ptree.get(L"embedded-audio", config.embedded_audio);
     config.base_buffer_depth = ptree.get(L"buffer-depth", config.base_buffer_depth);
+    config.adaptive_buffer   = ptree.get(L"adaptive-buffer", config.adaptive_buffer);
+    config.min_buffer_depth  = std::max(1, ptree.get(L"min-buffer-depth", config.min_buffer_depth));
+    config.max_buffer_depth =
+        std::max(config.min_buffer_depth, ptree.get(L"max-buffer-depth", config.max_buffer_depth));
+
+    auto pixel_format = ptree.get(L"pixel-format", L"bgra");
+    if (pixel_format == L"yuv8") {
+        config.pixel_format = configuration::pixel_format_t::yuv8;
+    } else if (pixel_format == L"yuv10") {
+        config.pixel_format = configuration::pixel_format_t::yuv10;
+    } else if (pixel_format != L"bgra") {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid pixel-format: " + pixel_format));
+    }
 
     if (ptree.get_child_optional(L"ports")) {
         for (auto& xml_port : ptree | witerate_children(L"ports") | welement_context_iteration) {
@@ -146,8 +161,15 @@ configuration parse_amcp_config(const std::vector<std::wstring>&     params,
         config.latency = configuration::latency_t::low_latency;
     }
 
+    if (contains_param(L"YUV8", params)) {
+        config.pixel_format = configuration::pixel_format_t::yuv8;
+    } else if (contains_param(L"YUV10", params)) {
+        config.pixel_format = configuration::pixel_format_t::yuv10;
+    }
+
     config.embedded_audio   = contains_param(L"EMBEDDED_AUDIO", params);
     config.primary.key_only = contains_param(L"KEY_ONLY", params);
+    config.adaptive_buffer  = contains_param(L"ADAPTIVE_BUFFER", params);
 
     return config;
 }
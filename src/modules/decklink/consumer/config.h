@@ -42,6 +42,13 @@ struct port_configuration
     {
         return src_x != 0 || src_y != 0 || region_w != 0 || region_h != 0 || dest_x != 0 || dest_y != 0;
     }
+
+    // Whether a frame converts the same for both ports, given that they output the same format.
+    [[nodiscard]] bool converts_like(const port_configuration& other) const
+    {
+        return key_only == other.key_only && src_x == other.src_x && src_y == other.src_y && dest_x == other.dest_x &&
+               dest_y == other.dest_y && region_w == other.region_w && region_h == other.region_h;
+    }
 };
 
 struct configuration
@@ -75,6 +82,13 @@ struct configuration
         disabled,
     };
 
+    enum class pixel_format_t
+    {
+        bgra,
+        yuv8,  // 8 bit 4:2:2, converted by the mixer
+        yuv10, // 10 bit 4:2:2 (v210), converted by the mixer
+    };
+
     bool                 embedded_audio              = false;
     keyer_t              keyer                       = keyer_t::default_keyer;
     duplex_t             duplex                      = duplex_t::default_duplex;
@@ -82,6 +96,13 @@ struct configuration
     wait_for_reference_t wait_for_reference          = wait_for_reference_t::automatic;
     int                  wait_for_reference_duration = 10; // seconds
     int                  base_buffer_depth           = 3;
+    pixel_format_t       pixel_format                = pixel_format_t::bgra;
+
+    // Moves the number of frames scheduled ahead between the bounds, by the completion results and the time frames
+    // take to be scheduled, starting at buffer_depth().
+    bool adaptive_buffer  = false;
+    int  min_buffer_depth = 2;
+    int  max_buffer_depth = 8;
 
     port_configuration              primary;
     std::vector<port_configuration> secondaries;
@@ -31,13 +31,16 @@
 #include "../decklink.h"
 #include "../util/util.h"
 
+#include <core/consumer/clock_source.h>
 #include <core/consumer/frame_consumer.h>
+#include <core/consumer/latency.h>
 #include <core/diagnostics/call_context.h>
 #include <core/frame/frame.h>
 #include <core/mixer/audio/audio_mixer.h>
 #include <core/video_format.h>
 
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/metrics.h>
 #include <common/except.h>
 #include <common/executor.h>
 #include <common/timer.h>
@@ -46,7 +49,9 @@
 
 #include <boost/circular_buffer.hpp>
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <common/memshfl.h>
 #include <common/prec_timer.h>
 #include <condition_variable>
@@ -191,18 +196,149 @@ core::video_format_desc get_decklink_format(const port_configuration&      confi
     return fallback_format_desc;
 }
 
+// Packed YUV from the mixer can only be used for a single fill port showing the whole channel, as it carries no key.
+// A single key only port like that shows the key the mixer draws once for all the consumers asking for it.
+core::output_format get_output_format(const configuration& config, const core::video_format_desc& channel_format_desc)
+{
+    if (!config.secondaries.empty() || config.primary.has_subregion_geometry() ||
+        get_decklink_format(config.primary, channel_format_desc).format != channel_format_desc.format) {
+        return core::output_format::bgra;
+    }
+
+    if (config.primary.key_only) {
+        return core::output_format::key;
+    }
+
+    if (config.pixel_format == configuration::pixel_format_t::bgra) {
+        return core::output_format::bgra;
+    }
+
+    return config.pixel_format == configuration::pixel_format_t::yuv10 ? core::output_format::v210
+                                                                        : core::output_format::uyvy;
+}
+
+// The format the primary port is fed. When the mixer can't convert for it, its BGRA frame is packed on the cpu. Key
+// only ports stay BGRA.
+core::output_format get_card_format(const configuration& config)
+{
+    if (config.pixel_format == configuration::pixel_format_t::bgra || config.primary.key_only) {
+        return core::output_format::bgra;
+    }
+
+    return config.pixel_format == configuration::pixel_format_t::yuv10 ? core::output_format::v210
+                                                                        : core::output_format::uyvy;
+}
+
+BMDPixelFormat get_bmd_pixel_format(core::output_format format)
+{
+    switch (format) {
+        case core::output_format::uyvy:
+            return bmdFormat8BitYUV;
+        case core::output_format::v210:
+            return bmdFormat10BitYUV;
+        default:
+            return bmdFormat8BitBGRA;
+    }
+}
+
+// Picks the number of frames scheduled ahead of the card. A late or dropped frame adds one right away. A window of
+// frames completed in time, with the slowest of them leaving more than half a frame to spare at one frame less, takes
+// one away. After growing it waits longer before shrinking again, so a recurring stall doesn't make it oscillate.
+class adaptive_buffer
+{
+    const int    min_depth_;
+    const int    max_depth_;
+    const int    window_;
+    const double frame_duration_;
+    int          depth_;
+    int          frames_left_;
+    double       max_wait_    = 0.0;
+    double       max_convert_ = 0.0;
+
+  public:
+    adaptive_buffer(int depth, int min_depth, int max_depth, const core::video_format_desc& format_desc)
+        : min_depth_(min_depth)
+        , max_depth_(max_depth)
+        , window_(static_cast<int>(format_desc.fps * 10.0))
+        , frame_duration_(static_cast<double>(format_desc.duration) / format_desc.time_scale)
+        , depth_(depth)
+        , frames_left_(window_)
+    {
+    }
+
+    int depth() const { return depth_; }
+
+    // The change to make to the depth when scheduling the next frame, -1, 0 or 1.
+    template <typename Print>
+    int update(BMDOutputFrameCompletionResult result, const Print& print)
+    {
+        if (result == bmdOutputFrameDisplayedLate || result == bmdOutputFrameDropped) {
+            restart(window_ * 6);
+            if (depth_ == max_depth_) {
+                return 0;
+            }
+            CASPAR_LOG(info) << print() << L" Buffer depth " << depth_ << L" -> " << depth_ + 1 << L" after a "
+                             << (result == bmdOutputFrameDropped ? L"dropped" : L"late") << L" frame.";
+            ++depth_;
+            return 1;
+        }
+
+        if (frames_left_ > 0) {
+            return 0;
+        }
+
+        const auto busy = max_wait_ + max_convert_;
+        const auto wait = max_wait_;
+        const auto conv = max_convert_;
+        restart(window_);
+        if (depth_ == min_depth_ || busy + frame_duration_ * 0.5 >= (depth_ - 2) * frame_duration_) {
+            return 0;
+        }
+        CASPAR_LOG(info) << print() << L" Buffer depth " << depth_ << L" -> " << depth_ - 1 << L", slowest frame "
+                         << static_cast<int>(wait * 1000.0) << L" ms waiting for the channel and "
+                         << static_cast<int>(conv * 1000.0) << L" ms converting.";
+        --depth_;
+        return -1;
+    }
+
+    // Time the last frame took to arrive from the channel and to be converted and scheduled.
+    void record(double wait, double convert)
+    {
+        max_wait_    = std::max(max_wait_, wait);
+        max_convert_ = std::max(max_convert_, convert);
+        --frames_left_;
+    }
+
+  private:
+    void restart(int frames)
+    {
+        frames_left_ = frames;
+        max_wait_    = 0.0;
+        max_convert_ = 0.0;
+    }
+};
+
 class decklink_frame : public IDeckLinkVideoFrame
 {
     core::video_format_desc format_desc_;
+    core::output_format     format_;
     std::shared_ptr<void>   data_;
     std::atomic<int>        ref_count_{0};
     int                     nb_samples_;
 
+    std::chrono::steady_clock::time_point capture_time_;
+
   public:
-    decklink_frame(std::shared_ptr<void> data, core::video_format_desc format_desc, int nb_samples)
+    decklink_frame(std::shared_ptr<void>                 data,
+                   core::video_format_desc               format_desc,
+                   int                                   nb_samples,
+                   core::output_format                   format       = core::output_format::bgra,
+                   std::chrono::steady_clock::time_point capture_time = {})
         : format_desc_(std::move(format_desc))
+        , format_(format)
         , data_(std::move(data))
         , nb_samples_(nb_samples)
+        , capture_time_(capture_time)
     {
     }
 
@@ -227,8 +363,11 @@ class decklink_frame : public IDeckLinkVideoFrame
 
     long STDMETHODCALLTYPE           GetWidth() override { return static_cast<long>(format_desc_.width); }
     long STDMETHODCALLTYPE           GetHeight() override { return static_cast<long>(format_desc_.height); }
-    long STDMETHODCALLTYPE           GetRowBytes() override { return static_cast<long>(format_desc_.width) * 4; }
-    BMDPixelFormat STDMETHODCALLTYPE GetPixelFormat() override { return bmdFormat8BitBGRA; }
+    long STDMETHODCALLTYPE           GetRowBytes() override
+    {
+        return static_cast<long>(core::output_format_linesize(format_, format_desc_.width));
+    }
+    BMDPixelFormat STDMETHODCALLTYPE GetPixelFormat() override { return get_bmd_pixel_format(format_); }
     BMDFrameFlags STDMETHODCALLTYPE  GetFlags() override { return bmdFrameFlagDefault; }
 
     HRESULT STDMETHODCALLTYPE GetBytes(void** buffer) override
@@ -245,6 +384,8 @@ class decklink_frame : public IDeckLinkVideoFrame
     HRESULT STDMETHODCALLTYPE GetAncillaryData(IDeckLinkVideoFrameAncillary** ancillary) override { return S_FALSE; }
 
     [[nodiscard]] int nb_samples() const { return nb_samples_; }
+
+    [[nodiscard]] std::chrono::steady_clock::time_point capture_time() const { return capture_time_; }
 };
 
 struct decklink_secondary_port final : public IDeckLinkVideoOutputCallback
@@ -268,6 +409,8 @@ struct decklink_secondary_port final : public IDeckLinkVideoOutputCallback
     com_ptr<IDeckLinkDisplayMode> mode_ =
         get_display_mode(output_, decklink_format_desc_.format, bmdFormat8BitBGRA, bmdSupportedVideoModeDefault);
 
+    frame_pool pool_;
+
     decklink_secondary_port(const configuration&           config,
                             port_configuration             output_config,
                             core::video_format_desc        channel_format_desc,
@@ -309,6 +452,8 @@ struct decklink_secondary_port final : public IDeckLinkVideoOutputCallback
                                    << boost::errinfo_api_function("SetScheduledFrameCompletionCallback"));
     }
 
+    [[nodiscard]] std::int64_t memory() const { return pool_.memory(); }
+
     ~decklink_secondary_port()
     {
         if (output_) {
@@ -347,13 +492,27 @@ struct decklink_secondary_port final : public IDeckLinkVideoOutputCallback
         }
     }
 
-    void schedule_frame(core::const_frame frame, BMDTimeValue display_time)
+    [[nodiscard]] bool converts_like(const port_configuration&      config,
+                                     const core::video_format_desc& format_desc,
+                                     BMDFieldDominance              field_dominance) const
+    {
+        return decklink_format_desc_.format == format_desc.format && mode_->GetFieldDominance() == field_dominance &&
+               output_config_.converts_like(config);
+    }
+
+    [[nodiscard]] bool converts_like(const decklink_secondary_port& other) const
+    {
+        return converts_like(other.output_config_, other.decklink_format_desc_, other.mode_->GetFieldDominance());
+    }
+
+    // The image of the port, or nothing while an interlaced port waits for the second field.
+    std::shared_ptr<void> convert_frame(core::const_frame frame)
     {
         bool isInterlaced = decklink_format_desc_.field_count != 1;
         if (isInterlaced && !first_field_.has_value()) {
             // If this is interlaced it needs a pair of frames at a time
             first_field_ = frame;
-            return;
+            return nullptr;
         }
 
         // Figure out which frame is which
@@ -367,10 +526,13 @@ struct decklink_secondary_port final : public IDeckLinkVideoOutputCallback
             frame1 = frame;
         }
 
-        auto image_data = convert_frame_for_port(
-            channel_format_desc_, decklink_format_desc_, output_config_, frame1, frame2, mode_->GetFieldDominance());
-
-        schedule_next_video(image_data, 0, display_time);
+        return convert_frame_for_port(channel_format_desc_,
+                                      decklink_format_desc_,
+                                      output_config_,
+                                      frame1,
+                                      frame2,
+                                      mode_->GetFieldDominance(),
+                                      pool_);
     }
 
     void schedule_next_video(std::shared_ptr<void> image_data, int nb_samples, BMDTimeValue display_time)
@@ -404,8 +566,10 @@ struct decklink_secondary_port final : public IDeckLinkVideoOutputCallback
 
 struct decklink_consumer final : public IDeckLinkVideoOutputCallback
 {
-    const int           channel_index_;
-    const configuration config_;
+    const int                                      channel_index_;
+    const configuration                            config_;
+    const std::shared_ptr<core::hardware_clock>    clock_;
+    const std::shared_ptr<core::latency_histogram> latency_;
 
     com_ptr<IDeckLink>                        decklink_      = get_device(config_.primary.device_index);
     com_iface_ptr<IDeckLinkOutput>            output_        = iface_cast<IDeckLinkOutput>(decklink_);
@@ -419,35 +583,71 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
     const std::wstring            model_name_ = get_model_name(decklink_);
     const core::video_format_desc channel_format_desc_;
     const core::video_format_desc decklink_format_desc_;
+    const core::output_format     output_format_ = get_output_format(config_, channel_format_desc_);
+    const core::output_format     card_format_   = get_card_format(config_);
+
+    frame_pool pool_;
 
     std::mutex                    buffer_mutex_;
     std::condition_variable       buffer_cond_;
     std::queue<core::const_frame> buffer_;
     int                           buffer_capacity_ = channel_format_desc_.field_count;
 
-    const int buffer_size_ = config_.buffer_depth(); // Minimum buffer-size 3.
+    // Minimum buffer-size 3.
+    const int buffer_size_ =
+        config_.adaptive_buffer
+            ? std::clamp(config_.buffer_depth(), config_.min_buffer_depth, config_.max_buffer_depth)
+            : config_.buffer_depth();
+    const int max_buffer_size_ = config_.adaptive_buffer ? config_.max_buffer_depth : buffer_size_;
+
+    std::optional<adaptive_buffer> adaptive_buffer_;
 
     long long video_scheduled_ = 0;
     long long audio_scheduled_ = 0;
 
-    boost::circular_buffer<std::vector<int32_t>> audio_container_{static_cast<unsigned long>(buffer_size_ + 1)};
+    // A frame repeated to grow the buffer schedules its audio separately.
+    boost::circular_buffer<std::vector<int32_t>> audio_container_{static_cast<unsigned long>(max_buffer_size_ + 2)};
 
     spl::shared_ptr<diagnostics::graph> graph_;
     caspar::timer                       tick_timer_;
+
+    const diagnostics::metrics::labels_t metric_labels_ = {{"channel", std::to_string(channel_index_)},
+                                                           {"consumer", "decklink"},
+                                                           {"device", std::to_string(config_.primary.device_index)}};
+    const std::shared_ptr<diagnostics::metrics::counter> late_frames_ = diagnostics::metrics::make_counter(
+        "caspar_consumer_late_frames_total", "Frames the output displayed late", metric_labels_);
+    const std::shared_ptr<diagnostics::metrics::counter> dropped_frames_ = diagnostics::metrics::make_counter(
+        "caspar_consumer_dropped_frames_total", "Frames the output dropped", metric_labels_);
+    const std::shared_ptr<diagnostics::metrics::gauge> buffered_frames_ = diagnostics::metrics::make_gauge(
+        "caspar_consumer_buffered_frames", "Frames queued in the output", metric_labels_);
+
     reference_signal_detector           reference_signal_detector_{output_};
     // std::atomic<int64_t>                                  scheduled_frames_completed_{0};
     std::vector<std::unique_ptr<decklink_secondary_port>> secondary_port_contexts_;
     int                                                   device_sync_group_ = 0;
 
-    com_ptr<IDeckLinkDisplayMode> mode_ =
-        get_display_mode(output_, decklink_format_desc_.format, bmdFormat8BitBGRA, bmdSupportedVideoModeDefault);
+    // Secondary ports that convert like the primary one schedule its image, the others are grouped by how they
+    // convert, and only the first port of a group converts.
+    std::vector<decklink_secondary_port*>              primary_group_;
+    std::vector<std::vector<decklink_secondary_port*>> secondary_groups_;
+
+    com_ptr<IDeckLinkDisplayMode> mode_ = get_display_mode(output_,
+                                                           decklink_format_desc_.format,
+                                                           get_bmd_pixel_format(card_format_),
+                                                           bmdSupportedVideoModeDefault);
 
     std::atomic<bool> abort_request_{false};
 
   public:
-    decklink_consumer(const configuration& config, core::video_format_desc channel_format_desc, int channel_index)
+    decklink_consumer(const configuration&                     config,
+                      core::video_format_desc                  channel_format_desc,
+                      int                                      channel_index,
+                      std::shared_ptr<core::hardware_clock>    clock,
+                      std::shared_ptr<core::latency_histogram> latency)
         : channel_index_(channel_index)
         , config_(config)
+        , clock_(std::move(clock))
+        , latency_(std::move(latency))
         , channel_format_desc_(std::move(channel_format_desc))
         , decklink_format_desc_(get_decklink_format(config.primary, channel_format_desc_))
     {
@@ -458,6 +658,11 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
         graph_->set_color("buffered-audio", diagnostics::color(0.9f, 0.9f, 0.5f));
         graph_->set_color("buffered-video", diagnostics::color(0.2f, 0.9f, 0.9f));
 
+        if (config.adaptive_buffer) {
+            adaptive_buffer_.emplace(
+                buffer_size_, config.min_buffer_depth, config.max_buffer_depth, decklink_format_desc_);
+        }
+
         if (config.duplex != configuration::duplex_t::default_duplex) {
             set_duplex(iface_cast<IDeckLinkAttributes_v10_11>(decklink_),
                        iface_cast<IDeckLinkConfiguration_v10_11>(decklink_),
@@ -496,6 +701,7 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
                                                                                          print(),
                                                                                          device_sync_group_));
         }
+        group_secondary_ports();
 
         enable_video();
 
@@ -514,13 +720,17 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
             auto nb_samples = decklink_format_desc_.audio_cadence[n % decklink_format_desc_.audio_cadence.size()] *
                               decklink_format_desc_.field_count;
             if (config.embedded_audio) {
-                schedule_next_audio(std::vector<int32_t>(nb_samples * decklink_format_desc_.audio_channels),
-                                    nb_samples);
+                schedule_next_silence(nb_samples);
             }
 
-            std::shared_ptr<void> image_data = create_aligned_buffer(decklink_format_desc_.size);
+            std::shared_ptr<void> image_data = card_format_ == core::output_format::bgra
+                                                   ? create_aligned_buffer(decklink_format_desc_.size)
+                                                   : create_black_frame(decklink_format_desc_, card_format_);
 
             schedule_next_video(image_data, nb_samples, video_scheduled_);
+            if (card_format_ != core::output_format::bgra) {
+                image_data = create_aligned_buffer(decklink_format_desc_.size);
+            }
             for (auto& context : secondary_port_contexts_) {
                 context->schedule_next_video(image_data, 0, video_scheduled_);
             }
@@ -550,6 +760,8 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
             output_->DisableVideoOutput();
         }
 
+        primary_group_.clear();
+        secondary_groups_.clear();
         secondary_port_contexts_.clear();
     }
 
@@ -607,6 +819,36 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
         CASPAR_LOG(info) << print() << L" Enabled embedded-audio.";
     }
 
+    void group_secondary_ports()
+    {
+        // Only a plain BGRA image of the primary port is laid out like the image of a secondary one.
+        const bool primary_is_bgra =
+            output_format_ == core::output_format::bgra && card_format_ == core::output_format::bgra;
+
+        for (auto& context : secondary_port_contexts_) {
+            if (primary_is_bgra &&
+                context->converts_like(config_.primary, decklink_format_desc_, mode_->GetFieldDominance())) {
+                primary_group_.push_back(context.get());
+                continue;
+            }
+
+            auto group = std::find_if(secondary_groups_.begin(), secondary_groups_.end(), [&](const auto& other) {
+                return context->converts_like(*other.front());
+            });
+            if (group != secondary_groups_.end()) {
+                group->push_back(context.get());
+            } else {
+                secondary_groups_.push_back({context.get()});
+            }
+        }
+
+        const auto shared = secondary_port_contexts_.size() - secondary_groups_.size() - primary_group_.size();
+        if (!primary_group_.empty() || shared > 0) {
+            CASPAR_LOG(info) << print() << L" " << primary_group_.size() + shared
+                             << L" secondary ports share the conversion of another port.";
+        }
+    }
+
     void enable_video()
     {
         if (FAILED(output_->EnableVideoOutput(mode_->GetDisplayMode(),
@@ -657,8 +899,11 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
             // set_thread_realtime_priority();
             set_thread_name(L"decklink_consumer[" + std::to_wstring(config_.primary.device_index) +
                             L"]-ScheduledFrameCompleted");
+            set_thread_affinity(thread_role::consumer);
         }
         try {
+            caspar::timer schedule_timer;
+
             auto tick_time = tick_timer_.elapsed() * decklink_format_desc_.hz * 0.5;
             graph_->set_value("tick-time", tick_time);
             tick_timer_.restart();
@@ -683,28 +928,44 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
 
             if (result == bmdOutputFrameDisplayedLate) {
                 graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+                late_frames_->increment();
                 video_scheduled_ += decklink_format_desc_.duration;
                 audio_scheduled_ += dframe->nb_samples();
             } else if (result == bmdOutputFrameDropped) {
                 graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+                dropped_frames_->increment();
             } else if (result == bmdOutputFrameFlushed) {
                 graph_->set_tag(diagnostics::tag_severity::WARNING, "flushed-frame");
             }
 
+            // The card is done with the frame once its successor is on screen, so it went out one frame earlier.
+            if (result == bmdOutputFrameCompleted || result == bmdOutputFrameDisplayedLate) {
+                const auto duration = std::chrono::duration<double>(1.0 / decklink_format_desc_.fps);
+                latency_->observe(dframe->capture_time(),
+                                  std::chrono::steady_clock::now() -
+                                      std::chrono::duration_cast<std::chrono::steady_clock::duration>(duration));
+            }
+
+            const auto change = adaptive_buffer_ ? adaptive_buffer_->update(result, [this] { return print(); }) : 0;
+
             {
                 UINT32 buffered;
                 output_->GetBufferedVideoFrameCount(&buffered);
-                graph_->set_value("buffered-video", static_cast<double>(buffered) / config_.buffer_depth());
+                graph_->set_value("buffered-video", static_cast<double>(buffered) / max_buffer_size_);
+                buffered_frames_->set(buffered);
 
                 if (config_.embedded_audio) {
                     output_->GetBufferedAudioSampleFrameCount(&buffered);
                     graph_->set_value("buffered-audio",
                                       static_cast<double>(buffered) /
                                           (decklink_format_desc_.audio_cadence[0] * decklink_format_desc_.field_count *
-                                           config_.buffer_depth()));
+                                           max_buffer_size_));
                 }
             }
 
+            // The card has taken a frame, let the channel produce the one to replace it.
+            clock_->tick();
+
             core::const_frame frame1 = pop();
             core::const_frame frame2;
 
@@ -717,10 +978,23 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
             if (abort_request_)
                 return E_FAIL;
 
+            const auto wait_time = schedule_timer.elapsed();
+
+            if (change < 0) {
+                // Skipping the channel's frame leaves one frame less scheduled ahead.
+                return S_OK;
+            }
+
             BMDTimeValue video_display_time = video_scheduled_;
             video_scheduled_ += decklink_format_desc_.duration;
 
-            std::vector<std::int32_t> audio_data;
+            // Growing the buffer shows the frame twice.
+            BMDTimeValue repeat_display_time = video_scheduled_;
+            if (change > 0) {
+                video_scheduled_ += decklink_format_desc_.duration;
+            }
+
+            auto audio_data = next_audio_buffer();
             if (config_.embedded_audio) {
                 audio_data.insert(audio_data.end(), frame1.audio_data().begin(), frame1.audio_data().end());
                 if (isInterlaced) {
@@ -731,27 +1005,64 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
             const int nb_samples = static_cast<int>(audio_data.size()) / decklink_format_desc_.audio_channels;
 
             // Schedule video
-            tbb::parallel_for(-1, static_cast<int>(secondary_port_contexts_.size()), [&](int i) {
+            tbb::parallel_for(-1, static_cast<int>(secondary_groups_.size()), [&](int i) {
                 if (i == -1) {
                     // Primary port
-                    std::shared_ptr<void> image_data = convert_frame_for_port(channel_format_desc_,
-                                                                              decklink_format_desc_,
-                                                                              config_.primary,
-                                                                              frame1,
-                                                                              frame2,
-                                                                              mode_->GetFieldDominance());
+                    std::shared_ptr<void> image_data =
+                        output_format_ == core::output_format::bgra
+                            ? convert_frame_for_port(channel_format_desc_,
+                                                     decklink_format_desc_,
+                                                     config_.primary,
+                                                     frame1,
+                                                     frame2,
+                                                     mode_->GetFieldDominance(),
+                                                     pool_)
+                            : convert_packed_frame_for_port(decklink_format_desc_,
+                                                            output_format_,
+                                                            frame1,
+                                                            frame2,
+                                                            mode_->GetFieldDominance(),
+                                                            pool_);
+
+                    if (output_format_ == core::output_format::bgra && card_format_ != output_format_) {
+                        image_data = pack_frame(image_data, decklink_format_desc_, card_format_, pool_);
+                    }
 
-                    schedule_next_video(image_data, nb_samples, video_display_time);
+                    schedule_next_video(image_data, nb_samples, video_display_time, frame1.capture_time());
+                    if (change > 0) {
+                        schedule_next_video(image_data, nb_samples, repeat_display_time);
+                    }
 
                     if (config_.embedded_audio) {
                         schedule_next_audio(std::move(audio_data), nb_samples);
+                        if (change > 0) {
+                            schedule_next_silence(nb_samples);
+                        }
+                    }
+                    for (auto context : primary_group_) {
+                        context->schedule_next_video(image_data, 0, video_display_time);
+                        if (change > 0) {
+                            context->schedule_next_video(image_data, 0, repeat_display_time);
+                        }
                     }
                 } else {
-                    // Send frame to secondary ports
-                    auto& context = secondary_port_contexts_[i];
-                    context->schedule_frame(frame1, video_display_time);
-                    if (isInterlaced) {
-                        context->schedule_frame(frame2, video_display_time);
+                    // Send frame to secondary ports, converting once for each group
+                    auto& group          = secondary_groups_[i];
+                    auto  schedule_frame = [&](const core::const_frame& frame, BMDTimeValue display_time) {
+                        if (auto image_data = group.front()->convert_frame(frame)) {
+                            for (auto context : group) {
+                                context->schedule_next_video(image_data, 0, display_time);
+                            }
+                        }
+                    };
+                    for (auto display_time : {video_display_time, repeat_display_time}) {
+                        schedule_frame(frame1, display_time);
+                        if (isInterlaced) {
+                            schedule_frame(frame2, display_time);
+                        }
+                        if (change <= 0) {
+                            break;
+                        }
                     }
 
                     if (config_.embedded_audio) {
@@ -760,6 +1071,10 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
                 }
             });
 
+            if (adaptive_buffer_) {
+                adaptive_buffer_->record(wait_time, schedule_timer.elapsed() - wait_time);
+            }
+
         } catch (...) {
             std::lock_guard<std::mutex> lock(exception_mutex_);
             exception_ = std::current_exception();
@@ -784,6 +1099,26 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
         return frame;
     }
 
+    // The oldest buffer has long been played by the card when the container is full, and its storage is reused
+    // rather than allocating for every frame.
+    std::vector<std::int32_t> next_audio_buffer()
+    {
+        std::vector<std::int32_t> audio;
+        if (audio_container_.full()) {
+            audio = std::move(audio_container_.front());
+            audio_container_.pop_front();
+            audio.clear();
+        }
+        return audio;
+    }
+
+    void schedule_next_silence(int nb_samples)
+    {
+        auto audio = next_audio_buffer();
+        audio.resize(static_cast<size_t>(nb_samples) * decklink_format_desc_.audio_channels);
+        schedule_next_audio(std::move(audio), nb_samples);
+    }
+
     void schedule_next_audio(std::vector<std::int32_t> audio, int nb_samples)
     {
         // TODO (refactor) does ScheduleAudioSamples copy data?
@@ -801,10 +1136,14 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
         audio_scheduled_ += nb_samples; // TODO - what if there are too many/few samples in this frame?
     }
 
-    void schedule_next_video(std::shared_ptr<void> image_data, int nb_samples, BMDTimeValue display_time)
+    // A frame with a capture time is counted for the latency once it's displayed, repeated frames have none.
+    void schedule_next_video(std::shared_ptr<void>                 image_data,
+                             int                                   nb_samples,
+                             BMDTimeValue                          display_time,
+                             std::chrono::steady_clock::time_point capture_time = {})
     {
-        auto fill_frame = wrap_raw<com_ptr, IDeckLinkVideoFrame>(
-            new decklink_frame(std::move(image_data), decklink_format_desc_, nb_samples));
+        auto fill_frame = wrap_raw<com_ptr, IDeckLinkVideoFrame>(new decklink_frame(
+            std::move(image_data), decklink_format_desc_, nb_samples, card_format_, capture_time));
         if (FAILED(output_->ScheduleVideoFrame(
                 get_raw(fill_frame), display_time, decklink_format_desc_.duration, decklink_format_desc_.time_scale))) {
             CASPAR_LOG(error) << print() << L" Failed to schedule primary video.";
@@ -820,6 +1159,12 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
             }
         }
 
+        if (frame && output_format_ != core::output_format::bgra && !frame.image_data(output_format_)) {
+            // Mixed before the channel knew this consumer wanted packed YUV or a key. Both fields of a frame are mixed
+            // together, so dropping them keeps the field order.
+            return !abort_request_;
+        }
+
         if (frame) {
             std::unique_lock<std::mutex> lock(buffer_mutex_);
             if (field != core::video_field::b) {
@@ -833,6 +1178,22 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
         return !abort_request_;
     }
 
+    // The buffers allocated for the cards, and the frames waiting to be scheduled.
+    [[nodiscard]] core::memory_usage memory()
+    {
+        core::memory_usage usage;
+        usage.host = pool_.memory();
+        for (auto& context : secondary_port_contexts_) {
+            usage.host += context->memory();
+        }
+
+        std::lock_guard<std::mutex> lock(buffer_mutex_);
+        for (auto frames = buffer_; !frames.empty(); frames.pop()) {
+            usage += core::frame_memory(frames.front());
+        }
+        return usage;
+    }
+
     [[nodiscard]] std::wstring print() const
     {
         std::wstringstream buffer;
@@ -850,17 +1211,27 @@ struct decklink_consumer final : public IDeckLinkVideoOutputCallback
 
 struct decklink_consumer_proxy : public core::frame_consumer
 {
-    const configuration                config_;
-    std::unique_ptr<decklink_consumer> consumer_;
-    core::video_format_desc            format_desc_;
-    executor                           executor_;
+    const configuration                         config_;
+    const std::shared_ptr<core::hardware_clock> clock_;
+    std::shared_ptr<core::latency_histogram>    latency_;
+    std::unique_ptr<decklink_consumer>          consumer_;
+    core::video_format_desc                     format_desc_;
+    std::atomic<core::output_format>            output_format_{core::output_format::bgra};
+    std::atomic<std::int64_t>                   memory_host_{0}; // of consumer_, as of the last frame sent
+    std::atomic<std::int64_t>                   memory_device_{0};
+    executor                                    executor_;
 
   public:
     explicit decklink_consumer_proxy(const configuration& config)
         : config_(config)
+        , clock_(std::make_shared<core::hardware_clock>(L"decklink[" + std::to_wstring(config.primary.device_index) +
+                                                        L"]"))
         , executor_(L"decklink_consumer[" + std::to_wstring(config.primary.device_index) + L"]")
     {
-        executor_.begin_invoke([=] { com_initialize(); });
+        executor_.begin_invoke([=] {
+            set_thread_affinity(thread_role::consumer);
+            com_initialize();
+        });
     }
 
     ~decklink_consumer_proxy() override
@@ -874,16 +1245,37 @@ struct decklink_consumer_proxy : public core::frame_consumer
 
     void initialize(const core::video_format_desc& format_desc, int channel_index) override
     {
-        format_desc_ = format_desc;
+        format_desc_   = format_desc;
+        output_format_ = get_output_format(config_, format_desc);
         executor_.invoke([=] {
             consumer_.reset();
-            consumer_ = std::make_unique<decklink_consumer>(config_, format_desc, channel_index);
+            auto latency = std::make_shared<core::latency_histogram>(
+                diagnostics::metrics::labels_t{{"channel", std::to_string(channel_index)},
+                                               {"consumer", "decklink"},
+                                               {"device", std::to_string(config_.primary.device_index)}});
+            consumer_ = std::make_unique<decklink_consumer>(config_, format_desc, channel_index, clock_, latency);
+            std::atomic_store(&latency_, std::move(latency));
         });
     }
 
-    std::future<bool> send(core::video_field field, core::const_frame frame) override
+    core::send_result send(core::video_field field, core::const_frame frame) override
     {
-        return executor_.begin_invoke([=] { return consumer_->send(field, frame); });
+        return executor_.begin_invoke([=] {
+            auto result = consumer_->send(field, frame);
+
+            const auto usage = consumer_->memory();
+            memory_host_     = usage.host;
+            memory_device_   = usage.device;
+            return result;
+        });
+    }
+
+    [[nodiscard]] core::memory_usage memory() const override
+    {
+        core::memory_usage usage;
+        usage.host   = memory_host_;
+        usage.device = memory_device_;
+        return usage;
     }
 
     [[nodiscard]] std::wstring print() const override
@@ -897,7 +1289,18 @@ struct decklink_consumer_proxy : public core::frame_consumer
 
     [[nodiscard]] bool has_synchronization_clock() const override { return true; }
 
-    [[nodiscard]] core::monitor::state state() const override { return get_state_for_config(config_, format_desc_); }
+    [[nodiscard]] std::shared_ptr<core::clock_source> clock() const override { return clock_; }
+
+    [[nodiscard]] core::output_format preferred_output_format() const override { return output_format_; }
+
+    [[nodiscard]] core::monitor::state state() const override
+    {
+        auto state = get_state_for_config(config_, format_desc_);
+        if (auto latency = std::atomic_load(&latency_)) {
+            state["latency"] = latency->state();
+        }
+        return state;
+    }
 };
 
 spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&     params,
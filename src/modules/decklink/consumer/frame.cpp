@@ -25,15 +25,45 @@
 
 #include <common/memshfl.h>
 
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 #include <tbb/scalable_allocator.h>
 
+#include <cstring>
+#include <vector>
+
 namespace caspar { namespace decklink {
 
-std::shared_ptr<void> convert_to_key_only(const std::shared_ptr<void>& image_data, std::size_t byte_count)
+std::shared_ptr<void> frame_pool::get(std::size_t size)
 {
-    auto key_data = create_aligned_buffer(byte_count);
+    std::shared_ptr<void> buffer;
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        auto&                       free = impl_->free[size];
+        if (!free.empty()) {
+            buffer = std::move(free.back());
+            free.pop_back();
+        }
+    }
+    if (!buffer) {
+        buffer = create_aligned_buffer(size);
+        impl_->allocated += size;
+    }
 
-    aligned_memshfl(key_data.get(), image_data.get(), byte_count, 0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303);
+    auto pool = impl_;
+    auto ptr  = buffer.get();
+    return std::shared_ptr<void>(ptr, [pool, size, buffer = std::move(buffer)](void*) mutable {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->free[size].push_back(std::move(buffer));
+    });
+}
+
+std::shared_ptr<void>
+convert_to_key_only(const std::shared_ptr<void>& image_data, std::size_t byte_count, frame_pool& pool)
+{
+    auto key_data = pool.get(byte_count);
+
+    memshfl(key_data.get(), image_data.get(), byte_count, 0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303);
 
     return key_data;
 }
@@ -56,9 +86,9 @@ void convert_frame(const core::video_format_desc& channel_format_desc,
         // Fast path
         size_t byte_count_line = (size_t)decklink_format_desc.width * 4;
         for (int y = firstLine; y < decklink_format_desc.height; y += decklink_format_desc.field_count) {
-            std::memcpy(reinterpret_cast<char*>(image_data.get()) + (long long)y * byte_count_line,
-                        frame.image_data(0).data() + (long long)y * byte_count_line,
-                        byte_count_line);
+            memcpy_nt(reinterpret_cast<char*>(image_data.get()) + (long long)y * byte_count_line,
+                      frame.image_data(0).data() + (long long)y * byte_count_line,
+                      byte_count_line);
         }
     } else {
         // Take a sub-region
@@ -84,46 +114,55 @@ void convert_frame(const core::video_format_desc& channel_format_desc,
         if (config.region_h > 0) // If the user chose a height, respect that
             copy_line_count = std::min(copy_line_count, config.region_h);
 
-        for (int y = firstLine; y < y_skip_dest_lines; y += decklink_format_desc.field_count) {
-            // Fill the line with black
-            std::memset(
-                reinterpret_cast<char*>(image_data.get()) + (byte_count_dest_line * y), 0, byte_count_dest_line);
-        }
+        auto dest   = reinterpret_cast<char*>(image_data.get());
+        auto source = frame.image_data(0).data();
 
-        int firstFillLine = y_skip_dest_lines;
-        if (decklink_format_desc.field_count != 1 && firstFillLine % 2 != firstLine)
-            firstFillLine += 1;
-        for (int y = firstFillLine; y < y_skip_dest_lines + copy_line_count; y += decklink_format_desc.field_count) {
-            auto line_start_ptr   = reinterpret_cast<char*>(image_data.get()) + (long long)y * byte_count_dest_line;
-            auto line_content_ptr = line_start_ptr + byte_offset_dest_line; // Future
+        // Each line of the field is independent, copy them in parallel as one large frame is more than a
+        // single core can push through memory.
+        const int field_line_count =
+            (decklink_format_desc.height - firstLine + decklink_format_desc.field_count - 1) /
+            decklink_format_desc.field_count;
+        tbb::parallel_for(tbb::blocked_range<int>(0, field_line_count, 16), [&](const tbb::blocked_range<int>& r) {
+            for (int n = r.begin(); n != r.end(); ++n) {
+                int  y              = firstLine + n * decklink_format_desc.field_count;
+                auto line_start_ptr = dest + (long long)y * byte_count_dest_line;
 
-            // Fill the start with black
-            if (byte_offset_dest_line > 0) {
-                std::memset(line_start_ptr, 0, byte_offset_dest_line);
-            }
+                if (y < y_skip_dest_lines || y >= y_skip_dest_lines + copy_line_count) {
+                    // Fill the line with black
+                    std::memset(line_start_ptr, 0, byte_count_dest_line);
+                    continue;
+                }
+
+                auto line_content_ptr = line_start_ptr + byte_offset_dest_line;
 
-            // Copy the pixels
-            std::memcpy(line_content_ptr,
-                        frame.image_data(0).data() + (long long)(y + y_skip_src_lines) * byte_count_src_line +
-                            byte_offset_src_line,
-                        byte_copy_per_line);
+                // Fill the start with black
+                if (byte_offset_dest_line > 0) {
+                    std::memset(line_start_ptr, 0, byte_offset_dest_line);
+                }
 
-            // Fill the end with black
-            if (byte_pad_end_of_line > 0) {
-                std::memset(line_content_ptr + byte_copy_per_line, 0, byte_pad_end_of_line);
+                // Copy the pixels
+                memcpy_nt(line_content_ptr,
+                          source + (long long)(y + y_skip_src_lines) * byte_count_src_line + byte_offset_src_line,
+                          byte_copy_per_line);
+
+                // Fill the end with black
+                if (byte_pad_end_of_line > 0) {
+                    std::memset(line_content_ptr + byte_copy_per_line, 0, byte_pad_end_of_line);
+                }
             }
-        }
+        });
+    }
+}
 
-        // Calculate the first line number to fill with black
-        int firstPadEndLine = y_skip_dest_lines + copy_line_count;
-        if (decklink_format_desc.field_count != 1 && firstPadEndLine % 2 != firstLine)
-            firstPadEndLine += 1;
-        for (int y = firstPadEndLine; y < decklink_format_desc.height; y += decklink_format_desc.field_count) {
-            // Fill the line with black
-            std::memset(
-                reinterpret_cast<char*>(image_data.get()) + (byte_count_dest_line * y), 0, byte_count_dest_line);
-        }
+// Whether the mixer already wove both fields into the image both frames share. Black fields share one image too,
+// which is the same either way.
+static bool is_woven(const core::const_frame& frame1, const core::const_frame& frame2, core::output_format format)
+{
+    if (!frame1 || !frame2) {
+        return false;
     }
+    auto data = frame1.image_data(format).data();
+    return data != nullptr && data == frame2.image_data(format).data();
 }
 
 std::shared_ptr<void> convert_frame_for_port(const core::video_format_desc& channel_format_desc,
@@ -131,11 +170,12 @@ std::shared_ptr<void> convert_frame_for_port(const core::video_format_desc& chan
                                              const port_configuration&      config,
                                              const core::const_frame&       frame1,
                                              const core::const_frame&       frame2,
-                                             BMDFieldDominance              field_dominance)
+                                             BMDFieldDominance              field_dominance,
+                                             frame_pool&                    pool)
 {
-    std::shared_ptr<void> image_data = create_aligned_buffer(decklink_format_desc.size);
+    std::shared_ptr<void> image_data = pool.get(decklink_format_desc.size);
 
-    if (field_dominance != bmdProgressiveFrame) {
+    if (field_dominance != bmdProgressiveFrame && !is_woven(frame1, frame2, core::output_format::bgra)) {
         convert_frame(channel_format_desc,
                       decklink_format_desc,
                       config,
@@ -155,10 +195,171 @@ std::shared_ptr<void> convert_frame_for_port(const core::video_format_desc& chan
     }
 
     if (config.key_only) {
-        image_data = convert_to_key_only(image_data, decklink_format_desc.size);
+        image_data = convert_to_key_only(image_data, decklink_format_desc.size, pool);
     }
 
     return image_data;
 }
 
+static void fill_black(std::uint8_t* dest, std::size_t size, core::output_format format)
+{
+    if (format == core::output_format::uyvy) {
+        for (size_t n = 0; n < size; n += 2) {
+            dest[n]     = 128;
+            dest[n + 1] = 16;
+        }
+    } else if (format == core::output_format::v210) {
+        // Cb Y Cr, Y Cb Y, Cr Y Cb, Y Cr Y
+        const std::uint32_t words[] = {512 | 64 << 10 | 512 << 20, 64 | 512 << 10 | 64 << 20};
+        for (size_t n = 0; n + 4 <= size; n += 4) {
+            std::memcpy(dest + n, &words[n / 4 % 2], 4);
+        }
+    } else {
+        std::memset(dest, 0, size);
+    }
+}
+
+std::shared_ptr<void> convert_packed_frame_for_port(const core::video_format_desc& format_desc,
+                                                    core::output_format            format,
+                                                    const core::const_frame&       frame1,
+                                                    const core::const_frame&       frame2,
+                                                    BMDFieldDominance              field_dominance,
+                                                    frame_pool&                    pool)
+{
+    if (field_dominance == bmdProgressiveFrame || is_woven(frame1, frame2, format)) {
+        auto frame = std::make_shared<core::const_frame>(frame1);
+        return std::shared_ptr<void>(frame, const_cast<std::uint8_t*>(frame->image_data(format).data()));
+    }
+
+    auto linesize   = static_cast<size_t>(core::output_format_linesize(format, format_desc.width));
+    auto size       = static_cast<size_t>(core::output_format_size(format, format_desc.width, format_desc.height));
+    auto image_data = pool.get(size);
+    auto dest       = reinterpret_cast<std::uint8_t*>(image_data.get());
+
+    if (!frame1 || !frame2) {
+        fill_black(dest, size, format);
+    }
+
+    for (int y = 0; y < format_desc.height; ++y) {
+        auto& frame = (y % 2 == 0) == (field_dominance == bmdUpperFieldFirst) ? frame1 : frame2;
+        if (frame) {
+            std::memcpy(dest + y * linesize, frame.image_data(format).data() + y * linesize, linesize);
+        }
+    }
+
+    return image_data;
+}
+
+// BT.709 video levels in 10 bits from 8 bit BGRA, with 13 fractional bits. The chroma rows sum to zero.
+static const short Y_R = 5983, Y_G = 20127, Y_B = 2032;
+static const short CB_R = -3298, CB_G = -11094, CB_B = 14392;
+static const short CR_R = 14392, CR_G = -13073, CR_B = -1319;
+
+// Converts a line of BGRA into 10 bit Y for every pixel and Cb, Cr for every pair, four pixels at a time.
+static void
+bgra_to_ycbcr10_line(const std::uint8_t* src, int width, std::uint16_t* y, std::uint16_t* cb, std::uint16_t* cr)
+{
+    const __m128i zero    = _mm_setzero_si128();
+    const __m128i y_coef  = _mm_setr_epi16(Y_B, Y_G, Y_R, 0, Y_B, Y_G, Y_R, 0);
+    const __m128i cb_coef = _mm_setr_epi16(CB_B, CB_G, CB_R, 0, CB_B, CB_G, CB_R, 0);
+    const __m128i cr_coef = _mm_setr_epi16(CR_B, CR_G, CR_R, 0, CR_B, CR_G, CR_R, 0);
+    const __m128i y_round = _mm_set1_epi32((1 << 12) + (64 << 13));
+    const __m128i c_round = _mm_set1_epi32((1 << 13) + (512 << 14));
+
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        const __m128i lo = _mm_unpacklo_epi8(px, zero);
+        const __m128i hi = _mm_unpackhi_epi8(px, zero);
+
+        __m128i luma = _mm_hadd_epi32(_mm_madd_epi16(lo, y_coef), _mm_madd_epi16(hi, y_coef));
+        luma         = _mm_srai_epi32(_mm_add_epi32(luma, y_round), 13);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(y + x), _mm_packs_epi32(luma, luma));
+
+        // Both halves of every pixel, then of every pair: cb01 cb23 cr01 cr23.
+        const __m128i blue   = _mm_madd_epi16(lo, cb_coef);
+        const __m128i red    = _mm_madd_epi16(lo, cr_coef);
+        const __m128i blue2  = _mm_madd_epi16(hi, cb_coef);
+        const __m128i red2   = _mm_madd_epi16(hi, cr_coef);
+        __m128i       chroma = _mm_hadd_epi32(_mm_hadd_epi32(blue, blue2), _mm_hadd_epi32(red, red2));
+        chroma               = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(chroma, c_round), 14), zero);
+
+        const auto cb_pair = _mm_cvtsi128_si32(chroma);
+        const auto cr_pair = _mm_cvtsi128_si32(_mm_srli_si128(chroma, 4));
+        std::memcpy(cb + x / 2, &cb_pair, 4);
+        std::memcpy(cr + x / 2, &cr_pair, 4);
+    }
+
+    for (; x < width; x += 2) {
+        const auto p0 = src + x * 4;
+        const auto p1 = x + 1 < width ? p0 + 4 : p0;
+
+        y[x] = static_cast<std::uint16_t>(((Y_R * p0[2] + Y_G * p0[1] + Y_B * p0[0] + (1 << 12)) >> 13) + 64);
+        if (x + 1 < width) {
+            y[x + 1] = static_cast<std::uint16_t>(((Y_R * p1[2] + Y_G * p1[1] + Y_B * p1[0] + (1 << 12)) >> 13) + 64);
+        }
+
+        const int b = CB_R * (p0[2] + p1[2]) + CB_G * (p0[1] + p1[1]) + CB_B * (p0[0] + p1[0]);
+        const int r = CR_R * (p0[2] + p1[2]) + CR_G * (p0[1] + p1[1]) + CR_B * (p0[0] + p1[0]);
+        cb[x / 2]   = static_cast<std::uint16_t>(((b + (1 << 13) + (512 << 14)) >> 14));
+        cr[x / 2]   = static_cast<std::uint16_t>(((r + (1 << 13) + (512 << 14)) >> 14));
+    }
+}
+
+std::shared_ptr<void> pack_frame(const std::shared_ptr<void>&   bgra,
+                                 const core::video_format_desc& format_desc,
+                                 core::output_format            format,
+                                 frame_pool&                    pool)
+{
+    const auto width    = format_desc.width;
+    const auto linesize = static_cast<size_t>(core::output_format_linesize(format, width));
+    auto       packed   = pool.get(linesize * format_desc.height);
+
+    // v210 lines are padded to groups of 48 pixels, the padding is black.
+    const auto pixels = format == core::output_format::v210 ? static_cast<int>(linesize / 16 * 6) : width;
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, format_desc.height), [&](const tbb::blocked_range<int>& lines) {
+        std::vector<std::uint16_t> y(pixels + 4, 64);
+        std::vector<std::uint16_t> cb(pixels / 2 + 2, 512);
+        std::vector<std::uint16_t> cr(pixels / 2 + 2, 512);
+
+        for (auto line = lines.begin(); line != lines.end(); ++line) {
+            const auto src  = reinterpret_cast<const std::uint8_t*>(bgra.get()) + static_cast<size_t>(line) * width * 4;
+            const auto dest = reinterpret_cast<std::uint8_t*>(packed.get()) + line * linesize;
+
+            bgra_to_ycbcr10_line(src, width, y.data(), cb.data(), cr.data());
+
+            if (format == core::output_format::v210) {
+                auto words = reinterpret_cast<std::uint32_t*>(dest);
+                for (int x = 0; x < pixels; x += 6, words += 4) {
+                    const auto c = x / 2;
+                    words[0]     = cb[c] | y[x] << 10 | cr[c] << 20;
+                    words[1]     = y[x + 1] | cb[c + 1] << 10 | y[x + 2] << 20;
+                    words[2]     = cr[c + 1] | y[x + 3] << 10 | cb[c + 2] << 20;
+                    words[3]     = y[x + 4] | cr[c + 2] << 10 | y[x + 5] << 20;
+                }
+            } else {
+                for (int x = 0; x < width; x += 2) {
+                    dest[x * 2]     = static_cast<std::uint8_t>((cb[x / 2] + 2) >> 2);
+                    dest[x * 2 + 1] = static_cast<std::uint8_t>((y[x] + 2) >> 2);
+                    dest[x * 2 + 2] = static_cast<std::uint8_t>((cr[x / 2] + 2) >> 2);
+                    dest[x * 2 + 3] = static_cast<std::uint8_t>((y[x + 1] + 2) >> 2);
+                }
+            }
+        }
+    });
+
+    return packed;
+}
+
+std::shared_ptr<void> create_black_frame(const core::video_format_desc& format_desc, core::output_format format)
+{
+    auto size       = static_cast<size_t>(core::output_format_size(format, format_desc.width, format_desc.height));
+    auto image_data = create_aligned_buffer(size);
+
+    fill_black(reinterpret_cast<std::uint8_t*>(image_data.get()), size, format);
+
+    return image_data;
+}
+
 }} // namespace caspar::decklink
\ No newline at end of file
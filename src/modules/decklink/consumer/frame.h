@@ -28,17 +28,62 @@
 #include "../decklink_api.h"
 
 #include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
 #include <core/video_format.h>
 
+#include <atomic>
+#include <cstdint>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 namespace caspar { namespace decklink {
 
+// Recycles the aligned frame buffers of a port. A buffer returns to the pool once the card releases the decklink_frame
+// holding it, so scheduling allocates nothing once as many buffers as the card keeps in flight exist.
+class frame_pool
+{
+    struct impl
+    {
+        std::mutex                                               mutex;
+        std::map<std::size_t, std::vector<std::shared_ptr<void>>> free;
+        std::atomic<std::int64_t>                                 allocated{0};
+    };
+
+    std::shared_ptr<impl> impl_ = std::make_shared<impl>();
+
+  public:
+    std::shared_ptr<void> get(std::size_t size);
+
+    // Bytes of all the buffers allocated, in the pool or in flight.
+    std::int64_t memory() const { return impl_->allocated; }
+};
+
 std::shared_ptr<void> convert_frame_for_port(const core::video_format_desc& channel_format_desc,
                                              const core::video_format_desc& decklink_format_desc,
                                              const port_configuration&      config,
                                              const core::const_frame&       frame1,
                                              const core::const_frame&       frame2,
-                                             BMDFieldDominance              field_dominance);
+                                             BMDFieldDominance              field_dominance,
+                                             frame_pool&                    pool);
+
+// Packed YUV and key frames converted by the mixer are already in the layout of the card. Progressive frames, and
+// interlaced ones the mixer wove, are passed on without copying, other interlaced ones only have their fields
+// interleaved.
+std::shared_ptr<void> convert_packed_frame_for_port(const core::video_format_desc& format_desc,
+                                                    core::output_format            format,
+                                                    const core::const_frame&       frame1,
+                                                    const core::const_frame&       frame2,
+                                                    BMDFieldDominance              field_dominance,
+                                                    frame_pool&                    pool);
+
+// Packs a BGRA frame of the port into uyvy or v210 on the cpu, for ports the mixer can't convert for.
+std::shared_ptr<void> pack_frame(const std::shared_ptr<void>&   bgra,
+                                 const core::video_format_desc& format_desc,
+                                 core::output_format            format,
+                                 frame_pool&                    pool);
+
+std::shared_ptr<void> create_black_frame(const core::video_format_desc& format_desc, core::output_format format);
 
 }} // namespace caspar::decklink
\ No newline at end of file
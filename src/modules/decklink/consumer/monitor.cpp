@@ -70,6 +70,12 @@ core::monitor::state get_state_for_config(const configuration& config, const cor
         state["decklink/latency"] = std::wstring(L"normal");
     }
 
+    if (config.pixel_format == configuration::pixel_format_t::yuv8) {
+        state["decklink/pixel-format"] = std::wstring(L"yuv8");
+    } else if (config.pixel_format == configuration::pixel_format_t::yuv10) {
+        state["decklink/pixel-format"] = std::wstring(L"yuv10");
+    }
+
     int index = 0;
     for (auto& port_config : config.secondaries) {
         state["decklink/ports"][index++] = get_state_for_port(port_config, channel_format);
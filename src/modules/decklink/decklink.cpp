@@ -71,7 +71,7 @@ void init(const core::module_dependencies& dependencies)
 {
     dependencies.consumer_registry->register_consumer_factory(L"Decklink Consumer", create_consumer);
     dependencies.consumer_registry->register_preconfigured_consumer_factory(L"decklink", create_preconfigured_consumer);
-    dependencies.producer_registry->register_producer_factory(L"Decklink Producer", create_producer);
+    dependencies.producer_registry->register_producer_factory(L"Decklink Producer", create_producer, {{L"DECKLINK"}});
 }
 
 }} // namespace caspar::decklink
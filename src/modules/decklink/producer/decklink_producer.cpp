@@ -26,9 +26,11 @@
 #include "../util/util.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/env.h>
 #include <common/except.h>
 #include <common/executor.h>
 #include <common/log.h>
+#include <common/os/thread.h>
 #include <common/param.h>
 #include <common/scope_exit.h>
 #include <common/timer.h>
@@ -39,10 +41,12 @@
 #include <core/diagnostics/call_context.h>
 #include <core/frame/draw_frame.h>
 #include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
 #include <core/monitor/monitor.h>
 #include <core/producer/frame_producer.h>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/property_tree/ptree.hpp>
 #include <boost/range/adaptor/transformed.hpp>
 
 #ifdef _MSC_VER
@@ -67,6 +71,12 @@ extern "C" {
 
 #include <boost/format.hpp>
 
+#include <tbb/parallel_for.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <map>
 #include <mutex>
 
 #include "../decklink_api.h"
@@ -316,6 +326,88 @@ static com_ptr<IDeckLinkDisplayMode> get_display_mode(const com_iface_ptr<IDeckL
     return get_display_mode(device, get_decklink_video_format(fmt), pix_fmt, flag);
 }
 
+// Capture buffers for the card to DMA into. While the producer runs direct they are upload buffers of the mixer, so
+// captured frames reach the gpu without being copied by the cpu. Otherwise they are host memory that avfilter reads.
+class capture_allocator : public IDeckLinkMemoryAllocator
+{
+    struct capture_buffer
+    {
+        std::shared_ptr<array<std::uint8_t>> data;
+        bool                                 upload;
+    };
+
+    spl::shared_ptr<core::frame_factory> frame_factory_;
+    std::atomic<int>                     ref_count_{1};
+    std::atomic<bool>                    upload_{false};
+    std::mutex                           mutex_;
+    std::map<void*, capture_buffer>      buffers_;
+
+  public:
+    explicit capture_allocator(spl::shared_ptr<core::frame_factory> frame_factory)
+        : frame_factory_(std::move(frame_factory))
+    {
+    }
+
+    // Buffers allocated from now on are upload buffers, the card allocates them when the video input is enabled.
+    void set_upload(bool upload) { upload_ = upload; }
+
+    // The upload buffer that the frame's bytes are in, nullptr if they aren't in one.
+    std::shared_ptr<array<std::uint8_t>> find_upload(const void* bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto                        it = buffers_.find(const_cast<void*>(bytes));
+        return it != buffers_.end() && it->second.upload ? it->second.data : nullptr;
+    }
+
+    // IUnknown
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, LPVOID*) override { return E_NOINTERFACE; }
+
+    ULONG STDMETHODCALLTYPE AddRef() override { return ++ref_count_; }
+
+    ULONG STDMETHODCALLTYPE Release() override
+    {
+        if (--ref_count_ == 0) {
+            delete this;
+
+            return 0;
+        }
+
+        return ref_count_;
+    }
+
+    // IDeckLinkMemoryAllocator
+
+    HRESULT STDMETHODCALLTYPE AllocateBuffer(unsigned int size, void** buffer) override
+    {
+        try {
+            capture_buffer capture{nullptr, upload_};
+            capture.data = std::make_shared<array<std::uint8_t>>(
+                capture.upload ? frame_factory_->create_array(static_cast<int>(size)) : array<std::uint8_t>(size));
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            *buffer = capture.data->data();
+            buffers_.emplace(*buffer, std::move(capture));
+            return S_OK;
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            return E_OUTOFMEMORY;
+        }
+    }
+
+    HRESULT STDMETHODCALLTYPE ReleaseBuffer(void* buffer) override
+    {
+        // Frames still being drawn hold on to their buffer.
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffers_.erase(buffer);
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE Commit() override { return S_OK; }
+
+    HRESULT STDMETHODCALLTYPE Decommit() override { return S_OK; }
+};
+
 class decklink_producer : public IDeckLinkInputCallback
 {
     const int                           device_index_;
@@ -361,6 +453,18 @@ class decklink_producer : public IDeckLinkInputCallback
     Filter video_filter_;
     Filter audio_filter_;
 
+    // Captured frames go straight to the mixer, which deinterlaces them, instead of through video_filter_.
+    const bool gpu_deinterlace_ = env::properties().get(L"configuration.decklink.producer.gpu-deinterlace", false);
+    bool       direct_          = false;
+
+    // Images of captured frames waiting for their audio, with the field each is drawn from.
+    std::deque<std::pair<core::const_frame, core::video_field>> fields_;
+
+    // When the frames written to video_filter_ arrived, by pts, for the capture times of the frames it outputs.
+    std::deque<std::pair<std::int64_t, std::chrono::steady_clock::time_point>> arrivals_;
+
+    com_ptr<capture_allocator> allocator_;
+
   public:
     decklink_producer(core::video_format_desc                     format_desc,
                       int                                         device_index,
@@ -387,6 +491,7 @@ class decklink_producer : public IDeckLinkInputCallback
         mode_         = get_display_mode(input_, input_format.format, bmdFormat8BitYUV, bmdSupportedVideoModeDefault);
         video_filter_ = Filter(vfilter_, AVMEDIA_TYPE_VIDEO, format_desc_, mode_);
         audio_filter_ = Filter(afilter_, AVMEDIA_TYPE_AUDIO, format_desc_, mode_);
+        direct_       = is_direct();
 
         boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
 
@@ -411,6 +516,15 @@ class decklink_producer : public IDeckLinkInputCallback
             flags = 0;
         }
 
+        if (gpu_deinterlace_) {
+            allocator_ = wrap_raw<com_ptr>(new capture_allocator(frame_factory_), true);
+            allocator_->set_upload(direct_);
+            if (FAILED(input_->SetVideoInputFrameMemoryAllocator(get_raw(allocator_)))) {
+                CASPAR_LOG(warning) << print() << L" Could not capture into upload buffers.";
+                allocator_ = nullptr;
+            }
+        }
+
         if (FAILED(input_->EnableVideoInput(mode_->GetDisplayMode(), bmdFormat8BitYUV, flags))) {
             CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Could not enable video input.")
                                                       << boost::errinfo_api_function("EnableVideoInput"));
@@ -471,6 +585,11 @@ class decklink_producer : public IDeckLinkInputCallback
 
             video_filter_ = Filter(vfilter_, AVMEDIA_TYPE_VIDEO, format_desc_, mode_);
             audio_filter_ = Filter(afilter_, AVMEDIA_TYPE_AUDIO, format_desc_, mode_);
+            direct_       = is_direct();
+            fields_.clear();
+            if (allocator_) {
+                allocator_->set_upload(direct_);
+            }
 
             // reinitializing video input with the new display mode
             if (FAILED(input_->EnableVideoInput(newMode, bmdFormat8BitYUV, bmdVideoInputEnableFormatDetection))) {
@@ -494,11 +613,135 @@ class decklink_producer : public IDeckLinkInputCallback
         }
     }
 
+    // Without filters of our own and at the channel's field rate, bwdif/yadif would be the only work avfilter does.
+    bool is_direct() const
+    {
+        const auto dominance = mode_->GetFieldDominance();
+        if (!gpu_deinterlace_ || !vfilter_.empty() || dominance == bmdUnknownFieldDominance) {
+            return false;
+        }
+
+        BMDTimeScale time_scale;
+        BMDTimeValue duration;
+        mode_->GetFrameRate(&duration, &time_scale);
+
+        const bool interlaced = dominance == bmdUpperFieldFirst || dominance == bmdLowerFieldFirst;
+        const auto field_rate =
+            boost::rational<int>(static_cast<int>(time_scale / 1000 * (interlaced ? 2 : 1)), duration / 1000);
+        return field_rate == format_desc_.framerate * format_desc_.field_count;
+    }
+
+    // Frames the card captured into an upload buffer are drawn from it, others are copied into one first.
+    core::mutable_frame create_capture_frame(IDeckLinkVideoInputFrame*      video,
+                                             const std::uint8_t*            bytes,
+                                             const core::pixel_format_desc& desc)
+    {
+        const auto linesize  = desc.planes[0].linesize;
+        const auto row_bytes = static_cast<int>(video->GetRowBytes());
+
+        if (auto upload = allocator_ && row_bytes == linesize ? allocator_->find_upload(bytes) : nullptr) {
+            // The card doesn't capture into the buffer again until the frame is released.
+            video->AddRef();
+            auto shared = std::shared_ptr<array<std::uint8_t>>(
+                upload.get(), [upload, video](array<std::uint8_t>*) { video->Release(); });
+
+            core::image_data_t planes;
+            planes.emplace_back(shared->data(), shared->size(), shared);
+            return frame_factory_->create_frame(this, desc, std::move(planes));
+        }
+
+        auto frame = frame_factory_->create_frame(this, desc);
+        auto dest  = frame.image_data(0).data();
+        if (row_bytes == linesize) {
+            std::memcpy(dest, bytes, desc.planes[0].size);
+        } else {
+            tbb::parallel_for(0, desc.planes[0].height, [&](int y) {
+                std::memcpy(dest + y * linesize, bytes + y * row_bytes, linesize);
+            });
+        }
+        return frame;
+    }
+
+    // Uploads the captured UYVY as it is and queues each of its fields.
+    void push_fields(IDeckLinkVideoInputFrame*             video,
+                     const std::uint8_t*                   bytes,
+                     std::chrono::steady_clock::time_point arrival)
+    {
+        core::pixel_format_desc desc(core::pixel_format::uyvy);
+        desc.planes.push_back(core::pixel_format_desc::plane(video->GetWidth() / 2, video->GetHeight(), 4));
+
+        auto frame           = create_capture_frame(video, bytes, desc);
+        frame.capture_time() = arrival;
+
+        core::const_frame image(std::move(frame));
+        switch (mode_->GetFieldDominance()) {
+            case bmdUpperFieldFirst:
+                fields_.emplace_back(image, core::video_field::a);
+                fields_.emplace_back(image, core::video_field::b);
+                break;
+            case bmdLowerFieldFirst:
+                fields_.emplace_back(image, core::video_field::b);
+                fields_.emplace_back(image, core::video_field::a);
+                break;
+            default:
+                fields_.emplace_back(image, core::video_field::progressive);
+                break;
+        }
+
+        while (fields_.size() > static_cast<size_t>(buffer_capacity_) * 2) {
+            fields_.pop_front();
+        }
+    }
+
+    // The arrival of the latest frame written to video_filter_ at or before pts, as deinterlacers add frames between.
+    std::chrono::steady_clock::time_point capture_time(std::int64_t pts)
+    {
+        while (arrivals_.size() > 1 && arrivals_[1].first <= pts) {
+            arrivals_.pop_front();
+        }
+        return arrivals_.empty() ? std::chrono::steady_clock::time_point() : arrivals_.front().second;
+    }
+
+    void push_frame(const core::draw_frame& frame)
+    {
+        auto field = core::video_field::progressive;
+        if (format_desc_.field_count == 2) {
+            field = frame_count_ % 2 == 0 ? core::video_field::a : core::video_field::b;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(buffer_mutex_);
+
+            buffer_.emplace_back(std::make_pair(frame, field));
+            frame_count_++;
+
+            if (buffer_.size() > buffer_capacity_) {
+                buffer_.pop_front();
+                // If interlaced, pop a second frame, to drop a whole source frame.
+                if (format_desc_.field_count == 2)
+                    buffer_.pop_front();
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+            }
+        }
+
+        boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
+    }
+
     HRESULT STDMETHODCALLTYPE VideoInputFrameArrived(IDeckLinkVideoInputFrame*  video,
                                                      IDeckLinkAudioInputPacket* audio) override
     {
         caspar::timer frame_timer;
 
+        // The driver's callback thread, counted in INFO THREADS.
+        thread_local auto registered = false;
+        if (!registered) {
+            registered = true;
+            register_thread(L"decklink_producer[" + std::to_wstring(device_index_) + L"]-VideoInputFrameArrived");
+        }
+
+        // The card's stream time is on its own clock, the latency through the server is measured from here.
+        const auto arrival = std::chrono::steady_clock::now();
+
         CASPAR_SCOPE_EXIT
         {
             size_t buffer_size = 0;
@@ -573,8 +816,15 @@ class decklink_producer : public IDeckLinkInputCallback
                         src->pts = in_video_pts;
                     }
 
-                    if (video_filter_.video_source) {
+                    if (direct_) {
+                        push_fields(video, reinterpret_cast<const std::uint8_t*>(video_bytes), arrival);
+                    } else if (video_filter_.video_source) {
                         FF(av_buffersrc_write_frame(video_filter_.video_source, src.get()));
+
+                        arrivals_.emplace_back(src->pts, arrival);
+                        while (arrivals_.size() > static_cast<size_t>(buffer_capacity_) * 4) {
+                            arrivals_.pop_front();
+                        }
                     }
                     if (audio_filter_.video_source) {
                         FF(av_buffersrc_write_frame(audio_filter_.video_source, src.get()));
@@ -610,7 +860,24 @@ class decklink_producer : public IDeckLinkInputCallback
                 }
             }
 
-            while (true) {
+            while (direct_ && !fields_.empty()) {
+                auto av_audio = alloc_frame();
+
+                audio_filter_.sink->inputs[0]->min_samples = audio_cadence_[0];
+                if (av_buffersink_get_frame_flags(audio_filter_.sink, av_audio.get(), AV_BUFFERSINK_FLAG_PEEK) < 0) {
+                    return S_OK;
+                }
+                av_audio = alloc_frame();
+                av_buffersink_get_samples(audio_filter_.sink, av_audio.get(), audio_cadence_[0]);
+
+                auto audio = core::const_frame(make_frame(this, *frame_factory_, nullptr, av_audio));
+                auto field = fields_.front().first.with_field(
+                    fields_.front().second, audio.audio_data(), audio.audio_channels());
+                push_frame(core::draw_frame(std::move(field)));
+                fields_.pop_front();
+            }
+
+            while (!direct_) {
                 {
                     auto av_video = alloc_frame();
                     auto av_audio = alloc_frame();
@@ -659,28 +926,9 @@ class decklink_producer : public IDeckLinkInputCallback
                 graph_->set_value("in-sync", in_sync * 2.0 + 0.5);
                 graph_->set_value("out-sync", out_sync * 2.0 + 0.5);
 
-                auto frame = core::draw_frame(make_frame(this, *frame_factory_, av_video, av_audio));
-                auto field = core::video_field::progressive;
-                if (format_desc_.field_count == 2) {
-                    field = frame_count_ % 2 == 0 ? core::video_field::a : core::video_field::b;
-                }
-
-                {
-                    std::lock_guard<std::mutex> lock(buffer_mutex_);
-
-                    buffer_.emplace_back(std::make_pair(frame, field));
-                    frame_count_++;
-
-                    if (buffer_.size() > buffer_capacity_) {
-                        buffer_.pop_front();
-                        // If interlaced, pop a second frame, to drop a whole source frame.
-                        if (format_desc_.field_count == 2)
-                            buffer_.pop_front();
-                        graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
-                    }
-                }
-
-                boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
+                auto frame           = make_frame(this, *frame_factory_, av_video, av_audio);
+                frame.capture_time() = capture_time(av_rescale_q(av_video->pts, video_tb, AV_TIME_BASE_Q));
+                push_frame(core::draw_frame(std::move(frame)));
             }
         } catch (...) {
             exception_ = std::current_exception();
@@ -768,6 +1016,7 @@ class decklink_producer_proxy : public core::frame_producer
         auto ctx = core::diagnostics::call_context::for_thread();
         executor_.invoke([=] {
             core::diagnostics::call_context::for_thread() = ctx;
+            set_thread_affinity(thread_role::producer);
             com_initialize();
             producer_.reset(new decklink_producer(
                 format_desc, device_index, frame_factory, format_repository, vfilter, afilter, format, freeze_on_lost));
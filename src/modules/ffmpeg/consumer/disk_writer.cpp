@@ -0,0 +1,569 @@
+#include "disk_writer.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/regex.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avio.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+static const int64_t BLOCK_SIZE     = 1024 * 1024;
+static const int64_t ALIGNMENT      = 4096;
+static const int64_t PREALLOCATE    = 64 * BLOCK_SIZE;
+static const int     IO_BUFFER_SIZE = 64 * 1024;
+
+static std::uint8_t* alloc_block()
+{
+#ifdef _WIN32
+    return static_cast<std::uint8_t*>(_aligned_malloc(BLOCK_SIZE, ALIGNMENT));
+#else
+    void* ptr = nullptr;
+    return posix_memalign(&ptr, ALIGNMENT, BLOCK_SIZE) == 0 ? static_cast<std::uint8_t*>(ptr) : nullptr;
+#endif
+}
+
+static void free_block(std::uint8_t* ptr)
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+static bool write_at(int fd, const std::uint8_t* data, int64_t size, int64_t offset)
+{
+#ifdef _WIN32
+    if (_lseeki64(fd, offset, SEEK_SET) != offset) {
+        return false;
+    }
+#endif
+    while (size > 0) {
+        const auto count = static_cast<unsigned>(std::min<int64_t>(size, 1 << 30));
+#ifdef _WIN32
+        const auto ret = _write(fd, data, count);
+#else
+        const auto ret = pwrite(fd, data, count, offset);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+#endif
+        if (ret <= 0) {
+            return false;
+        }
+        data += ret;
+        size -= ret;
+        offset += ret;
+    }
+    return true;
+}
+
+static int read_at(int fd, std::uint8_t* data, int size, int64_t offset)
+{
+#ifdef _WIN32
+    if (_lseeki64(fd, offset, SEEK_SET) != offset) {
+        return -1;
+    }
+    return _read(fd, data, static_cast<unsigned>(size));
+#else
+    while (true) {
+        const auto ret = pread(fd, data, size, offset);
+        if (ret >= 0 || errno != EINTR) {
+            return static_cast<int>(ret);
+        }
+    }
+#endif
+}
+
+struct DiskWriter::Impl
+{
+    // A block of the ring, or a write over data that has already left the ring, e.g. a size patched by the muxer.
+    struct Item
+    {
+        int                       block  = -1;
+        int64_t                   offset = 0;
+        int64_t                   size   = 0;
+        bool                      keep   = false;
+        bool                      end    = false;
+        std::vector<std::uint8_t> patch;
+    };
+
+    const std::string filename_;
+
+    std::vector<std::uint8_t*> blocks_;
+
+    mutable std::mutex      mutex_;
+    std::condition_variable cond_;
+    std::deque<int>         free_;
+    std::deque<Item>        queue_;
+    int                     error_ = 0;
+
+    // Only touched by the muxer.
+    int     current_      = -1;
+    int64_t block_offset_ = 0;
+    int64_t fill_         = 0;
+    int64_t pos_          = 0;
+    bool    closed_       = false;
+    bool    full_logged_  = false;
+
+    int          fd_        = -1;
+    int          direct_fd_ = -1;
+    int64_t      allocated_ = 0;
+    std::thread  thread_;
+    AVIOContext* avio_ = nullptr;
+
+    Impl(const std::string& filename, int64_t ring_size)
+        : filename_(filename)
+    {
+#ifdef _WIN32
+        fd_ = _wopen(u16(filename).c_str(), _O_RDWR | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        fd_ = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+        if (fd_ < 0) {
+            CASPAR_THROW_EXCEPTION(file_write_error() << msg_info(u16(filename)));
+        }
+
+#ifdef O_DIRECT
+        // Not every file system takes O_DIRECT, the blocks then go through the page cache.
+        direct_fd_ = ::open(filename.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+#endif
+
+        const auto count = std::max<int64_t>(2, ring_size / BLOCK_SIZE);
+        for (auto n = 0; n < count; ++n) {
+            auto block = alloc_block();
+            if (!block) {
+                release();
+                CASPAR_THROW_EXCEPTION(bad_alloc());
+            }
+            blocks_.push_back(block);
+            free_.push_back(n);
+        }
+
+        auto buffer = static_cast<unsigned char*>(av_malloc(IO_BUFFER_SIZE));
+        avio_       = avio_alloc_context(buffer, IO_BUFFER_SIZE, 1, this, read_packet, write_packet, seek);
+        if (!avio_) {
+            av_free(buffer);
+            release();
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"avio_alloc_context failed"));
+        }
+
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~Impl()
+    {
+        close();
+
+        av_freep(&avio_->buffer);
+        avio_context_free(&avio_);
+    }
+
+    void release()
+    {
+        for (auto block : blocks_) {
+            free_block(block);
+        }
+        blocks_.clear();
+
+#ifdef O_DIRECT
+        if (direct_fd_ >= 0) {
+            ::close(direct_fd_);
+            direct_fd_ = -1;
+        }
+#endif
+        if (fd_ >= 0) {
+#ifdef _WIN32
+            _close(fd_);
+#else
+            ::close(fd_);
+#endif
+            fd_ = -1;
+        }
+    }
+
+    bool write_item(const Item& item)
+    {
+        if (!item.patch.empty()) {
+            return write_at(fd_, item.patch.data(), static_cast<int64_t>(item.patch.size()), item.offset);
+        }
+
+#ifdef __linux__
+        // Reserves the space in large extents ahead of the writes, without changing the file size.
+        if (item.offset + item.size > allocated_) {
+            if (fallocate(fd_, FALLOC_FL_KEEP_SIZE, allocated_, PREALLOCATE) == 0) {
+                allocated_ += PREALLOCATE;
+            } else {
+                allocated_ = INT64_MAX;
+            }
+        }
+#endif
+
+        const auto data = blocks_[item.block];
+        if (direct_fd_ >= 0) {
+            // The tail is padded to the alignment and the file truncated to its size on close.
+            const auto size = (item.size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+            std::fill(data + item.size, data + size, 0);
+            return write_at(direct_fd_, data, size, item.offset);
+        }
+        return write_at(fd_, data, item.size, item.offset);
+    }
+
+    void run()
+    {
+        set_thread_name(L"[ffmpeg::consumer::DiskWriter]");
+        set_thread_affinity(thread_role::consumer);
+
+        while (true) {
+            Item item;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [&] { return !queue_.empty(); });
+                if (queue_.front().end) {
+                    queue_.pop_front();
+                    break;
+                }
+                item = std::move(queue_.front());
+            }
+
+            const auto ok  = error() == 0 ? write_item(item) : true;
+            const auto err = ok ? 0 : errno;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!ok && error_ == 0) {
+                    error_ = AVERROR(err ? err : EIO);
+                    CASPAR_LOG(error) << L"[ffmpeg] Write to " << u16(filename_) << L" failed.";
+                }
+                if (item.block >= 0 && !item.keep) {
+                    free_.push_back(item.block);
+                }
+                queue_.pop_front();
+            }
+            cond_.notify_all();
+        }
+    }
+
+    void push(Item item)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(std::move(item));
+        }
+        cond_.notify_all();
+    }
+
+    void wait_drained()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [&] { return queue_.empty(); });
+    }
+
+    int64_t end() const { return block_offset_ + fill_; }
+
+    bool acquire()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (free_.empty() && !full_logged_) {
+            CASPAR_LOG(warning) << L"[ffmpeg] Write buffer of " << u16(filename_) << L" is full.";
+            full_logged_ = true;
+        }
+        cond_.wait(lock, [&] { return !free_.empty() || error_ != 0; });
+        if (error_ != 0) {
+            return false;
+        }
+        current_ = free_.front();
+        free_.pop_front();
+        return true;
+    }
+
+    // Appends data, or zeros for nullptr, at the end of the file.
+    bool append(const std::uint8_t* data, int64_t count)
+    {
+        while (count > 0) {
+            if (current_ < 0 && !acquire()) {
+                return false;
+            }
+
+            const auto n     = std::min(count, BLOCK_SIZE - fill_);
+            const auto block = blocks_[current_] + fill_;
+            if (data) {
+                std::copy_n(data, n, block);
+                data += n;
+            } else {
+                std::fill_n(block, n, 0);
+            }
+            fill_ += n;
+            pos_ += n;
+            count -= n;
+
+            if (fill_ == BLOCK_SIZE) {
+                Item item;
+                item.block  = current_;
+                item.offset = block_offset_;
+                item.size   = fill_;
+                push(std::move(item));
+
+                current_ = -1;
+                block_offset_ += BLOCK_SIZE;
+                fill_ = 0;
+            }
+        }
+        return true;
+    }
+
+    int error() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return error_;
+    }
+
+    int write(const std::uint8_t* data, int size)
+    {
+        if (auto ret = error()) {
+            return ret;
+        }
+
+        if (pos_ > end()) {
+            // A seek past the end leaves zeros, as it would in a sparse file.
+            const auto gap = pos_ - end();
+            pos_           = end();
+            if (!append(nullptr, gap)) {
+                return error();
+            }
+        }
+
+        int64_t count = size;
+        while (count > 0) {
+            if (pos_ == end()) {
+                if (!append(data, count)) {
+                    return error();
+                }
+                break;
+            }
+
+            if (pos_ >= block_offset_) {
+                const auto n = std::min(count, end() - pos_);
+                std::copy_n(data, n, blocks_[current_] + (pos_ - block_offset_));
+                data += n;
+                pos_ += n;
+                count -= n;
+            } else {
+                const auto n = std::min(count, block_offset_ - pos_);
+                Item       item;
+                item.offset = pos_;
+                item.patch.assign(data, data + n);
+                push(std::move(item));
+                data += n;
+                pos_ += n;
+                count -= n;
+            }
+        }
+
+        return size;
+    }
+
+    int read(std::uint8_t* data, int size)
+    {
+        if (pos_ >= end()) {
+            return AVERROR_EOF;
+        }
+
+        int count = 0;
+        if (pos_ >= block_offset_) {
+            count = static_cast<int>(std::min<int64_t>(size, end() - pos_));
+            std::copy_n(blocks_[current_] + (pos_ - block_offset_), count, data);
+        } else {
+            wait_drained();
+            if (auto ret = error()) {
+                return ret;
+            }
+            count = read_at(fd_, data, static_cast<int>(std::min<int64_t>(size, block_offset_ - pos_)), pos_);
+            if (count < 0) {
+                return AVERROR(errno);
+            }
+            if (count == 0) {
+                return AVERROR_EOF;
+            }
+        }
+
+        pos_ += count;
+        return count;
+    }
+
+    int64_t seek(int64_t offset, int whence)
+    {
+        if (whence == AVSEEK_SIZE) {
+            return end();
+        }
+
+        switch (whence & ~AVSEEK_FORCE) {
+            case SEEK_SET:
+                break;
+            case SEEK_CUR:
+                offset += pos_;
+                break;
+            case SEEK_END:
+                offset += end();
+                break;
+            default:
+                return AVERROR(EINVAL);
+        }
+
+        if (offset < 0) {
+            return AVERROR(EINVAL);
+        }
+
+        pos_ = offset;
+        return pos_;
+    }
+
+    void sync()
+    {
+        avio_flush(avio_);
+
+        if (current_ >= 0 && fill_ > 0) {
+            // Written in place, the block stays with the muxer.
+            Item item;
+            item.block  = current_;
+            item.offset = block_offset_;
+            item.size   = fill_;
+            item.keep   = true;
+            push(std::move(item));
+        }
+        wait_drained();
+    }
+
+    int close()
+    {
+        if (closed_) {
+            return error();
+        }
+        closed_ = true;
+
+        avio_flush(avio_);
+
+        if (current_ >= 0 && fill_ > 0) {
+            Item item;
+            item.block  = current_;
+            item.offset = block_offset_;
+            item.size   = fill_;
+            push(std::move(item));
+            current_ = -1;
+        }
+
+        Item item;
+        item.end = true;
+        push(std::move(item));
+        thread_.join();
+
+#ifdef _WIN32
+        const auto truncated = _chsize_s(fd_, end()) == 0;
+#else
+        const auto truncated = ftruncate(fd_, end()) == 0;
+#endif
+        if (!truncated && error_ == 0) {
+            error_ = AVERROR(errno);
+        }
+
+        release();
+
+        return error_;
+    }
+
+    double fill() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return 1.0 - static_cast<double>(free_.size()) / static_cast<double>(std::max<size_t>(1, blocks_.size()));
+    }
+
+    static int read_packet(void* opaque, std::uint8_t* buf, int size)
+    {
+        return static_cast<Impl*>(opaque)->read(buf, size);
+    }
+
+    static int write_packet(void* opaque, std::uint8_t* buf, int size)
+    {
+        return static_cast<Impl*>(opaque)->write(buf, size);
+    }
+
+    static int64_t seek(void* opaque, int64_t offset, int whence)
+    {
+        return static_cast<Impl*>(opaque)->seek(offset, whence);
+    }
+};
+
+std::shared_ptr<DiskWriter> DiskWriter::open(const std::string& filename)
+{
+    const auto ring_size = env::properties().get(L"configuration.ffmpeg.consumer.write-buffer", 0) * BLOCK_SIZE;
+    if (ring_size <= 0) {
+        return nullptr;
+    }
+
+    // Protocols have a scheme of two letters or more, C: is a drive.
+    static const boost::regex prot_exp("^[a-zA-Z][a-zA-Z0-9+.-]+:.*");
+
+    auto path = filename;
+    if (boost::regex_match(path, prot_exp)) {
+        if (path.compare(0, 5, "file:") != 0) {
+            return nullptr;
+        }
+        path = path.substr(5);
+    }
+
+    return std::make_shared<DiskWriter>(path, ring_size);
+}
+
+DiskWriter::DiskWriter(const std::string& filename, int64_t ring_size)
+    : impl_(new Impl(filename, ring_size))
+{
+}
+
+DiskWriter::~DiskWriter() {}
+
+AVIOContext* DiskWriter::context() const { return impl_->avio_; }
+
+void DiskWriter::sync() { impl_->sync(); }
+
+int DiskWriter::close() { return impl_->close(); }
+
+double DiskWriter::fill() const { return impl_->fill(); }
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct AVIOContext;
+
+namespace caspar { namespace ffmpeg {
+
+// AVIOContext writing a local file from a thread of its own through a ring of pre-allocated blocks, so that a
+// writeback stall of the disk doesn't hold up muxing until the ring is full. Blocks are written with O_DIRECT where
+// the file system supports it, into space reserved with fallocate ahead of the writes.
+class DiskWriter
+{
+  public:
+    // Returns nullptr if the writer is disabled or filename isn't a local path.
+    static std::shared_ptr<DiskWriter> open(const std::string& filename);
+
+    DiskWriter(const std::string& filename, int64_t ring_size);
+    ~DiskWriter();
+
+    DiskWriter(const DiskWriter&)            = delete;
+    DiskWriter& operator=(const DiskWriter&) = delete;
+
+    AVIOContext* context() const;
+
+    // Waits until everything written so far is on disk, for muxers that read their output back.
+    void sync();
+
+    // Writes out the rest and closes the file. Returns 0 or the AVERROR of the first write that failed.
+    int close();
+
+    // Share of the ring holding data that isn't written yet, 0 to 1.
+    double fill() const;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}} // namespace caspar::ffmpeg
@@ -21,18 +21,22 @@
 
 #include "ffmpeg_consumer.h"
 
+#include "disk_writer.h"
+#include "paced_writer.h"
+#include "tee_output.h"
+
 #include "../util/av_assert.h"
 #include "../util/av_util.h"
 
 #include <common/diagnostics/graph.h>
 #include <common/env.h>
 #include <common/executor.h>
-#include <common/future.h>
 #include <common/memory.h>
 #include <common/scope_exit.h>
 #include <common/timer.h>
 
 #include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
 #include <core/video_format.h>
 
 #include <boost/algorithm/string.hpp>
@@ -58,10 +62,11 @@ extern "C" {
 #include <libavfilter/buffersrc.h>
 #include <libavformat/avformat.h>
 #include <libavutil/channel_layout.h>
+#include <libavutil/eval.h>
+#include <libavutil/imgutils.h>
 #include <libavutil/opt.h>
 #include <libavutil/pixfmt.h>
 #include <libavutil/samplefmt.h>
-#include <libswscale/swscale.h>
 }
 #ifdef _MSC_VER
 #pragma warning(pop)
@@ -69,51 +74,154 @@ extern "C" {
 
 #include <tbb/concurrent_queue.h>
 #include <tbb/parallel_for.h>
-#include <tbb/parallel_invoke.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <thread>
+#include <vector>
 
 namespace caspar { namespace ffmpeg {
 
 // TODO multiple output streams
 // TODO multiple output files
-// TODO run video filter, video encoder, audio filter, audio encoder in separate threads.
 // TODO realtime with smaller buffer?
 
+// Full range rgb to limited range BT.709, in 16 bit fixed point.
+constexpr int bt709_coef(double value, double range)
+{
+    return static_cast<int>(value * range / 255.0 * 65536.0 + (value < 0.0 ? -0.5 : 0.5));
+}
+
+constexpr int Y_R  = bt709_coef(0.2126, 219.0);
+constexpr int Y_G  = bt709_coef(0.7152, 219.0);
+constexpr int Y_B  = bt709_coef(0.0722, 219.0);
+constexpr int CB_R = bt709_coef(-0.1146, 224.0);
+constexpr int CB_G = bt709_coef(-0.3854, 224.0);
+constexpr int CB_B = bt709_coef(0.5, 224.0);
+constexpr int CR_R = bt709_coef(0.5, 224.0);
+constexpr int CR_G = bt709_coef(-0.4542, 224.0);
+constexpr int CR_B = bt709_coef(-0.0458, 224.0);
+
+// Converts a row of bgra pixels to yuva422p, averaging horizontal pairs for chroma. Plain integer loops without
+// dependencies between pixels, which the compiler vectorizes.
+static void bgra_to_yuva422_row(const std::uint8_t* src,
+                                std::uint8_t*       y,
+                                std::uint8_t*       cb,
+                                std::uint8_t*       cr,
+                                std::uint8_t*       a,
+                                int                 width)
+{
+    for (int x = 0; x < width; ++x) {
+        const int b = src[x * 4 + 0];
+        const int g = src[x * 4 + 1];
+        const int r = src[x * 4 + 2];
+        y[x]        = static_cast<std::uint8_t>(((Y_R * r + Y_G * g + Y_B * b + (1 << 15)) >> 16) + 16);
+        a[x]        = src[x * 4 + 3];
+    }
+
+    for (int x = 0; x < width / 2; ++x) {
+        const int b = src[x * 8 + 0] + src[x * 8 + 4];
+        const int g = src[x * 8 + 1] + src[x * 8 + 5];
+        const int r = src[x * 8 + 2] + src[x * 8 + 6];
+        cb[x]       = static_cast<std::uint8_t>(((CB_R * r + CB_G * g + CB_B * b + (1 << 16)) >> 17) + 128);
+        cr[x]       = static_cast<std::uint8_t>(((CR_R * r + CR_G * g + CR_B * b + (1 << 16)) >> 17) + 128);
+    }
+
+    if (width % 2) {
+        const auto last = src + (width - 1) * 4;
+        const int  b    = last[0];
+        const int  g    = last[1];
+        const int  r    = last[2];
+        cb[width / 2]   = static_cast<std::uint8_t>(((CB_R * r + CB_G * g + CB_B * b + (1 << 15)) >> 16) + 128);
+        cr[width / 2]   = static_cast<std::uint8_t>(((CR_R * r + CR_G * g + CR_B * b + (1 << 15)) >> 16) + 128);
+    }
+}
+
+// Removes the options ending in suffix, e.g. "b:v", from options and returns them without it.
+static std::map<std::string, std::string> take_stream_options(const std::string&                  suffix,
+                                                              std::map<std::string, std::string>& options)
+{
+    std::map<std::string, std::string> stream_options;
+
+    auto tmp = std::move(options);
+    for (auto& p : tmp) {
+        if (boost::algorithm::ends_with(p.first, suffix)) {
+            const auto key = p.first.substr(0, p.first.size() - suffix.size());
+            stream_options.emplace(key, std::move(p.second));
+        } else {
+            options.insert(std::move(p));
+        }
+    }
+
+    return stream_options;
+}
+
+static const AVCodec* find_encoder(AVCodecID codec_id, std::map<std::string, std::string>& stream_options)
+{
+    const AVCodec* codec = avcodec_find_encoder(codec_id);
+    {
+        const auto it = stream_options.find("codec");
+        if (it != stream_options.end()) {
+            codec = avcodec_find_encoder_by_name(it->second.c_str());
+            stream_options.erase(it);
+        }
+    }
+
+    if (!codec) {
+        FF_RET(AVERROR(EINVAL), "avcodec_find_encoder");
+    }
+
+    return codec;
+}
+
+// Passes on every frame a sink has ready, and nullptr once the graph has ended.
+static void drain_sink(AVFilterContext* sink, const std::function<void(std::shared_ptr<AVFrame>)>& cb)
+{
+    while (true) {
+        auto filtered = alloc_frame();
+        auto ret      = av_buffersink_get_frame(sink, filtered.get());
+        if (ret == AVERROR(EAGAIN)) {
+            return;
+        }
+        if (ret == AVERROR_EOF) {
+            cb(nullptr);
+            return;
+        }
+        FF_RET(ret, "av_buffersink_get_frame");
+        cb(std::move(filtered));
+    }
+}
+
 struct Stream
 {
     std::shared_ptr<AVFilterGraph> graph  = nullptr;
     AVFilterContext*               sink   = nullptr;
     AVFilterContext*               source = nullptr;
 
+    // One per rendition when the graph ends in a ladder, else just sink.
+    std::vector<AVFilterContext*> sinks;
+
     std::shared_ptr<AVCodecContext> enc = nullptr;
     AVStream*                       st  = nullptr;
 
-    tbb::concurrent_bounded_queue<std::shared_ptr<SwsContext>> sws_;
-
     int64_t pts = 0;
 
-    Stream(AVFormatContext*                    oc,
-           std::string                         suffix,
-           AVCodecID                           codec_id,
-           const core::video_format_desc&      format_desc,
-           bool                                realtime,
-           std::map<std::string, std::string>& options)
+    // sizes turns the video graph into a ladder that ends in one sink per size, each scaled from the one before it.
+    Stream(AVFormatContext*                        oc,
+           std::string                             suffix,
+           AVCodecID                               codec_id,
+           const core::video_format_desc&          format_desc,
+           bool                                    realtime,
+           std::map<std::string, std::string>&     options,
+           const std::vector<std::pair<int, int>>& sizes = {})
     {
-        std::map<std::string, std::string> stream_options;
-
-        {
-            auto tmp = std::move(options);
-            for (auto& p : tmp) {
-                if (boost::algorithm::ends_with(p.first, suffix)) {
-                    const auto key = p.first.substr(0, p.first.size() - suffix.size());
-                    stream_options.emplace(key, std::move(p.second));
-                } else {
-                    options.insert(std::move(p));
-                }
-            }
-        }
+        auto stream_options = take_stream_options(suffix, options);
 
         std::string filter_spec = "";
         {
@@ -124,18 +232,22 @@ struct Stream
             }
         }
 
-        auto codec = avcodec_find_encoder(codec_id);
+        // Hardware encoders get their frames uploaded by the filter graph, e.g. -codec:v h264_vaapi -hwaccel:v vaapi.
+        std::shared_ptr<AVBufferRef> hw_device;
         {
-            const auto it = stream_options.find("codec");
+            const auto it = stream_options.find("hwaccel");
             if (it != stream_options.end()) {
-                codec = avcodec_find_encoder_by_name(it->second.c_str());
+                const auto type = av_hwdevice_find_type_by_name(it->second.c_str());
+                hw_device       = type != AV_HWDEVICE_TYPE_NONE ? get_hw_device(type) : nullptr;
+                if (!hw_device) {
+                    CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EINVAL)
+                                                            << msg_info_t("invalid hwaccel " + it->second));
+                }
                 stream_options.erase(it);
             }
         }
 
-        if (!codec) {
-            FF_RET(AVERROR(EINVAL), "avcodec_find_encoder");
-        }
+        const auto codec = find_encoder(codec_id, stream_options);
 
         AVFilterInOut* outputs = nullptr;
         AVFilterInOut* inputs  = nullptr;
@@ -157,6 +269,22 @@ struct Stream
             if (filter_spec.empty()) {
                 filter_spec = "null";
             }
+            // Hardware encoders take 8 bit 4:2:0 surfaces, there is no alpha to keep.
+            const std::string upload = hw_device ? "format=nv12,hwupload" : "null";
+            if (!sizes.empty()) {
+                filter_spec += "[l0]";
+                for (auto n = 0U; n < sizes.size(); ++n) {
+                    filter_spec += (boost::format(";[l%d]scale=%d:%d") % n % sizes[n].first % sizes[n].second).str();
+                    if (n + 1 < sizes.size()) {
+                        filter_spec += (boost::format(",split[t%d][l%d];[t%d]") % n % (n + 1) % n).str();
+                    } else {
+                        filter_spec += ",";
+                    }
+                    filter_spec += (boost::format("%s[o%d]") % upload % n).str();
+                }
+            } else if (hw_device) {
+                filter_spec += "," + upload;
+            }
         } else {
             if (filter_spec.empty()) {
                 filter_spec = "anull";
@@ -204,58 +332,103 @@ struct Stream
             }
         }
 
-        if (codec->type == AVMEDIA_TYPE_VIDEO) {
-            FF(avfilter_graph_create_filter(
-                &sink, avfilter_get_by_name("buffersink"), "out", nullptr, nullptr, graph.get()));
+        sinks.resize(std::max<size_t>(1, sizes.size()), nullptr);
+
+        for (auto cur = outputs; cur; cur = cur->next) {
+            const auto index = !sizes.empty() && cur->name ? std::atoi(cur->name + 1) : 0;
+            if (index < 0 || index >= static_cast<int>(sinks.size()) || sinks[index]) {
+                CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EINVAL)
+                                                        << msg_info_t("invalid filter graph output count"));
+            }
+
+            if (avfilter_pad_get_type(cur->filter_ctx->output_pads, cur->pad_idx) != codec->type) {
+                CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EINVAL)
+                                                        << msg_info_t("invalid filter output media type"));
+            }
+
+            const auto name = (boost::format("out_%d") % index).str();
+            auto&      out  = sinks[index];
+
+            if (codec->type == AVMEDIA_TYPE_VIDEO) {
+                FF(avfilter_graph_create_filter(
+                    &out, avfilter_get_by_name("buffersink"), name.c_str(), nullptr, nullptr, graph.get()));
 
 #ifdef _MSC_VER
 #pragma warning(push)
 #pragma warning(disable : 4245)
 #endif
-            // TODO codec->profiles
-            // TODO FF(av_opt_set_int_list(sink, "framerates", codec->supported_framerates, { 0, 0 },
-            // AV_OPT_SEARCH_CHILDREN));
-            FF(av_opt_set_int_list(sink, "pix_fmts", codec->pix_fmts, -1, AV_OPT_SEARCH_CHILDREN));
+                // TODO codec->profiles
+                // TODO FF(av_opt_set_int_list(sink, "framerates", codec->supported_framerates, { 0, 0 },
+                // AV_OPT_SEARCH_CHILDREN));
+                FF(av_opt_set_int_list(out, "pix_fmts", codec->pix_fmts, -1, AV_OPT_SEARCH_CHILDREN));
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
-        } else if (codec->type == AVMEDIA_TYPE_AUDIO) {
-            FF(avfilter_graph_create_filter(
-                &sink, avfilter_get_by_name("abuffersink"), "out", nullptr, nullptr, graph.get()));
+            } else if (codec->type == AVMEDIA_TYPE_AUDIO) {
+                FF(avfilter_graph_create_filter(
+                    &out, avfilter_get_by_name("abuffersink"), name.c_str(), nullptr, nullptr, graph.get()));
 #ifdef _MSC_VER
 #pragma warning(push)
 #pragma warning(disable : 4245)
 #endif
-            // TODO codec->profiles
-            FF(av_opt_set_int_list(sink, "sample_fmts", codec->sample_fmts, -1, AV_OPT_SEARCH_CHILDREN));
-            FF(av_opt_set_int_list(sink, "channel_layouts", codec->channel_layouts, 0, AV_OPT_SEARCH_CHILDREN));
-            FF(av_opt_set_int_list(sink, "sample_rates", codec->supported_samplerates, 0, AV_OPT_SEARCH_CHILDREN));
+                // TODO codec->profiles
+                FF(av_opt_set_int_list(out, "sample_fmts", codec->sample_fmts, -1, AV_OPT_SEARCH_CHILDREN));
+                FF(av_opt_set_int_list(out, "channel_layouts", codec->channel_layouts, 0, AV_OPT_SEARCH_CHILDREN));
+                FF(av_opt_set_int_list(out, "sample_rates", codec->supported_samplerates, 0, AV_OPT_SEARCH_CHILDREN));
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
-        } else {
-            CASPAR_THROW_EXCEPTION(ffmpeg_error_t()
-                                   << boost::errinfo_errno(EINVAL) << msg_info_t("invalid output media type"));
+            } else {
+                CASPAR_THROW_EXCEPTION(ffmpeg_error_t()
+                                       << boost::errinfo_errno(EINVAL) << msg_info_t("invalid output media type"));
+            }
+
+            FF(avfilter_link(cur->filter_ctx, cur->pad_idx, out, 0));
         }
 
-        {
-            const auto cur = outputs;
+        if (std::find(sinks.begin(), sinks.end(), nullptr) != sinks.end()) {
+            CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EINVAL)
+                                                    << msg_info_t("invalid filter graph output count"));
+        }
 
-            if (!cur || cur->next) {
-                CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EINVAL)
-                                                        << msg_info_t("invalid filter graph output count"));
-            }
+        sink = sinks[0];
 
-            if (avfilter_pad_get_type(cur->filter_ctx->output_pads, cur->pad_idx) != codec->type) {
-                CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EINVAL)
-                                                        << msg_info_t("invalid filter output media type"));
+        if (hw_device) {
+            for (auto n = 0U; n < graph->nb_filters; ++n) {
+                if (std::string(graph->filters[n]->filter->name) == "hwupload") {
+                    graph->filters[n]->hw_device_ctx = av_buffer_ref(hw_device.get());
+                }
             }
-
-            FF(avfilter_link(cur->filter_ctx, cur->pad_idx, sink, 0));
         }
 
         FF(avfilter_graph_config(graph.get(), nullptr));
 
+        open(oc, codec, suffix, realtime, std::move(stream_options), options);
+    }
+
+    // Encodes the frames of a sink in a graph that is shared with other streams.
+    Stream(AVFormatContext*                    oc,
+           const std::string&                  suffix,
+           const AVCodec*                      codec,
+           std::shared_ptr<AVFilterGraph>      graph,
+           AVFilterContext*                    sink,
+           bool                                realtime,
+           std::map<std::string, std::string>  stream_options,
+           std::map<std::string, std::string>& options)
+        : graph(std::move(graph))
+        , sink(sink)
+        , sinks({sink})
+    {
+        open(oc, codec, suffix, realtime, std::move(stream_options), options);
+    }
+
+    void open(AVFormatContext*                    oc,
+              const AVCodec*                      codec,
+              const std::string&                  suffix,
+              bool                                realtime,
+              std::map<std::string, std::string>  stream_options,
+              std::map<std::string, std::string>& options)
+    {
         st = avformat_new_stream(oc, nullptr);
         if (!st) {
             FF_RET(AVERROR(ENOMEM), "avformat_new_stream");
@@ -277,6 +450,10 @@ struct Stream
             enc->sample_aspect_ratio = av_buffersink_get_sample_aspect_ratio(sink);
             enc->time_base           = st->time_base;
             enc->pix_fmt             = static_cast<AVPixelFormat>(av_buffersink_get_format(sink));
+
+            if (auto frames = av_buffersink_get_hw_frames_ctx(sink)) {
+                enc->hw_frames_ctx = av_buffer_ref(frames);
+            }
         } else if (codec->type == AVMEDIA_TYPE_AUDIO) {
             st->time_base = {1, av_buffersink_get_sample_rate(sink)};
 
@@ -317,130 +494,217 @@ struct Stream
         }
     }
 
-    std::shared_ptr<SwsContext> get_sws(int width, int height)
+    // Copies the yuva422 image the mixer converted on the gpu into a frame, sparing the conversion from bgra.
+    std::shared_ptr<AVFrame> make_yuva422_frame(const core::const_frame&       in_frame,
+                                                const core::video_format_desc& format_desc)
     {
-        std::shared_ptr<SwsContext> sws;
+        const auto sar = boost::rational<int>(format_desc.square_width, format_desc.square_height) /
+                         boost::rational<int>(format_desc.width, format_desc.height);
+
+        auto frame                 = alloc_frame();
+        frame->sample_aspect_ratio = {sar.numerator(), sar.denominator()};
+        frame->width               = format_desc.width;
+        frame->height              = format_desc.height;
+        frame->format              = AV_PIX_FMT_YUVA422P;
+        frame->colorspace          = AVCOL_SPC_BT709;
+        frame->color_primaries     = AVCOL_PRI_BT709;
+        frame->color_range         = AVCOL_RANGE_MPEG;
+        frame->color_trc           = AVCOL_TRC_BT709;
+        FF(av_frame_get_buffer(frame.get(), 64));
+
+        // Y lines, then Cb and Cr sharing each line, then A lines, all with a linesize of the width.
+        auto data   = in_frame.image_data(core::output_format::yuva422).data();
+        auto width  = format_desc.width;
+        auto height = format_desc.height;
+        auto plane  = static_cast<std::ptrdiff_t>(width) * height;
+
+        av_image_copy_plane(frame->data[0], frame->linesize[0], data, width, width, height);
+        av_image_copy_plane(frame->data[1], frame->linesize[1], data + plane, width, width / 2, height);
+        av_image_copy_plane(frame->data[2], frame->linesize[2], data + plane + width / 2, width, width / 2, height);
+        av_image_copy_plane(frame->data[3], frame->linesize[3], data + plane * 2, width, width, height);
+
+        return frame;
+    }
 
-        if (sws_.try_pop(sws)) {
-            return sws;
+    // Converts a mixer frame into the filter input. Returns nullptr for the empty frame that ends the stream.
+    std::shared_ptr<AVFrame> convert(const core::const_frame& in_frame, const core::video_format_desc& format_desc)
+    {
+        if (!in_frame) {
+            return nullptr;
         }
 
-        sws.reset(sws_getContext(
-                      width, height, AV_PIX_FMT_BGRA, width, height, AV_PIX_FMT_YUVA422P, 0, nullptr, nullptr, nullptr),
-                  [](SwsContext* ptr) { sws_freeContext(ptr); });
+        std::shared_ptr<AVFrame> frame;
 
-        if (!sws) {
-            CASPAR_THROW_EXCEPTION(caspar_exception());
-        }
+        if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
+            if (in_frame.image_data(core::output_format::yuva422)) {
+                frame = make_yuva422_frame(in_frame, format_desc);
+            } else {
+                frame = make_av_video_frame(in_frame, format_desc);
 
-        int        brigthness;
-        int        contrast;
-        int        saturation;
-        int        in_full;
-        int        out_full;
-        const int* inv_table;
-        const int* table;
+                auto frame2                 = alloc_frame();
+                frame2->sample_aspect_ratio = frame->sample_aspect_ratio;
+                frame2->width               = frame->width;
+                frame2->height              = frame->height;
+                frame2->format              = AV_PIX_FMT_YUVA422P;
+                frame2->colorspace          = AVCOL_SPC_BT709;
+                frame2->color_primaries     = AVCOL_PRI_BT709;
+                frame2->color_range         = AVCOL_RANGE_MPEG;
+                frame2->color_trc           = AVCOL_TRC_BT709;
+                FF(av_frame_get_buffer(frame2.get(), 64));
+
+                tbb::parallel_for(0, frame->height, [&](int y) {
+                    bgra_to_yuva422_row(frame->data[0] + static_cast<std::ptrdiff_t>(frame->linesize[0]) * y,
+                                        frame2->data[0] + static_cast<std::ptrdiff_t>(frame2->linesize[0]) * y,
+                                        frame2->data[1] + static_cast<std::ptrdiff_t>(frame2->linesize[1]) * y,
+                                        frame2->data[2] + static_cast<std::ptrdiff_t>(frame2->linesize[2]) * y,
+                                        frame2->data[3] + static_cast<std::ptrdiff_t>(frame2->linesize[3]) * y,
+                                        frame->width);
+                });
 
-        sws_getColorspaceDetails(
-            sws.get(), (int**)&inv_table, &in_full, (int**)&table, &out_full, &brigthness, &contrast, &saturation);
+                frame = std::move(frame2);
+            }
 
-        inv_table = sws_getCoefficients(AVCOL_SPC_RGB);
-        table     = sws_getCoefficients(AVCOL_SPC_BT709);
+            frame->pts = pts;
+            pts += 1;
+        } else if (enc->codec_type == AVMEDIA_TYPE_AUDIO) {
+            frame      = make_av_audio_frame(in_frame, format_desc);
+            frame->pts = pts;
+            pts += frame->nb_samples;
+        } else {
+            // TODO
+        }
 
-        in_full  = AVCOL_RANGE_JPEG;
-        out_full = AVCOL_RANGE_MPEG;
+        return frame;
+    }
 
-        sws_setColorspaceDetails(sws.get(), inv_table, in_full, table, out_full, brigthness, contrast, saturation);
+    // Feeds a converted frame to the filter graph, or closes it for nullptr, and passes on every frame the graph has
+    // ready. cb gets nullptr once the graph has ended.
+    void filter(const std::shared_ptr<AVFrame>& frame, const std::function<void(std::shared_ptr<AVFrame>)>& cb)
+    {
+        if (frame) {
+            FF(av_buffersrc_write_frame(source, frame.get()));
+        } else {
+            // pts was last written by convert, before the stream end was queued for filtering.
+            FF(av_buffersrc_close(source, pts, 0));
+        }
 
-        return std::shared_ptr<SwsContext>(sws.get(), [this, sws](SwsContext*) { sws_.push(sws); });
+        drain_sink(sink, cb);
     }
 
-    void send(core::const_frame&                             in_frame,
-              const core::video_format_desc&                 format_desc,
-              std::function<void(std::shared_ptr<AVPacket>)> cb)
+    // Encodes a filtered frame, or flushes the encoder for nullptr, and passes on the packets it has ready.
+    void encode(const std::shared_ptr<AVFrame>& frame, const std::function<void(std::shared_ptr<AVPacket>)>& cb)
     {
-        std::shared_ptr<AVFrame>  frame;
-        std::shared_ptr<AVPacket> pkt;
+        auto ret = avcodec_send_frame(enc.get(), frame.get());
+        while (ret == AVERROR(EAGAIN)) {
+            receive(cb);
+            ret = avcodec_send_frame(enc.get(), frame.get());
+        }
+        FF_RET(ret, "avcodec_send_frame");
+        receive(cb);
+    }
 
-        if (in_frame) {
-            if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
-                frame = make_av_video_frame(in_frame, format_desc);
+    void receive(const std::function<void(std::shared_ptr<AVPacket>)>& cb)
+    {
+        while (true) {
+            auto pkt = alloc_packet();
+            auto ret = avcodec_receive_packet(enc.get(), pkt.get());
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                return;
+            }
+            FF_RET(ret, "avcodec_receive_packet");
+            pkt->stream_index = st->index;
+            av_packet_rescale_ts(pkt.get(), enc->time_base, st->time_base);
+            cb(std::move(pkt));
+        }
+    }
+};
 
-                {
-                    auto frame2                 = alloc_frame();
-                    frame2->sample_aspect_ratio = frame->sample_aspect_ratio;
-                    frame2->width               = frame->width;
-                    frame2->height              = frame->height;
-                    frame2->format              = AV_PIX_FMT_YUVA422P;
-                    frame2->colorspace          = AVCOL_SPC_BT709;
-                    frame2->color_primaries     = AVCOL_PRI_BT709;
-                    frame2->color_range         = AVCOL_RANGE_MPEG;
-                    frame2->color_trc           = AVCOL_TRC_BT709;
-                    av_frame_get_buffer(frame2.get(), 64);
-
-                    int h = frame->height / 8;
-                    tbb::parallel_for(0, 8, [&](int i) {
-                        auto sws = get_sws(frame->width, h);
-
-                        uint8_t* src[4] = {};
-                        src[0]          = frame->data[0] + frame->linesize[0] * (i * h);
-
-                        uint8_t* dst[4] = {};
-                        dst[0]          = frame2->data[0] + frame2->linesize[0] * (i * h);
-                        dst[1]          = frame2->data[1] + frame2->linesize[1] * (i * h);
-                        dst[2]          = frame2->data[2] + frame2->linesize[2] * (i * h);
-                        dst[3]          = frame2->data[3] + frame2->linesize[3] * (i * h);
-
-                        sws_scale(sws.get(), src, frame->linesize, 0, h, dst, frame2->linesize);
-                    });
-
-                    int i = frame->height - h;
-                    if (i > 0) {
-                        // TODO
-                    }
+// Opens what the muxer writes. Local files, one per segment for the segment muxer, go through a DiskWriter when a
+// write buffer is configured, and network streams through a PacedWriter when a pacing bitrate is set. Anything else
+// is opened by avio as before.
+struct OutputIO
+{
+    int64_t pace_bitrate = 0;
+    int     packet_size  = 1316;
 
-                    frame = std::move(frame2);
-                }
+    std::mutex                                          mutex;
+    std::map<std::string, std::shared_ptr<DiskWriter>>  writers;
+    std::map<std::string, std::shared_ptr<PacedWriter>> paced;
 
-                frame->pts = pts;
-                pts += 1;
-            } else if (enc->codec_type == AVMEDIA_TYPE_AUDIO) {
-                frame      = make_av_audio_frame(in_frame, format_desc);
-                frame->pts = pts;
-                pts += frame->nb_samples;
+    static int io_open(AVFormatContext* s, AVIOContext** pb, const char* url, int flags, AVDictionary** options)
+    {
+        auto self = static_cast<OutputIO*>(s->opaque);
+        try {
+            std::lock_guard<std::mutex> lock(self->mutex);
+            if (flags & AVIO_FLAG_WRITE) {
+                static const boost::regex net_exp("^(srt|udp)://.*");
+                if (self->pace_bitrate > 0 && boost::regex_match(std::string(url), net_exp)) {
+                    auto writer = std::make_shared<PacedWriter>(
+                        url, self->pace_bitrate, self->packet_size, &s->interrupt_callback, options);
+                    *pb               = writer->context();
+                    self->paced[url] = std::move(writer);
+                    return 0;
+                }
+                if (auto writer = DiskWriter::open(url)) {
+                    *pb                = writer->context();
+                    self->writers[url] = std::move(writer);
+                    return 0;
+                }
             } else {
-                // TODO
+                // e.g. movflags +faststart reads the file back before moving the index to the front.
+                const auto it = self->writers.find(url);
+                if (it != self->writers.end()) {
+                    it->second->sync();
+                }
             }
-            FF(av_buffersrc_write_frame(source, frame.get()));
-        } else {
-            FF(av_buffersrc_close(source, pts, 0));
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            return AVERROR(EIO);
         }
+        return avio_open2(pb, url, flags, &s->interrupt_callback, options);
+    }
 
-        while (true) {
-            pkt     = alloc_packet();
-            int ret = avcodec_receive_packet(enc.get(), pkt.get());
-
-            if (ret == AVERROR(EAGAIN)) {
-                frame = alloc_frame();
-                ret   = av_buffersink_get_frame(sink, frame.get());
-                if (ret == AVERROR(EAGAIN)) {
-                    return;
-                }
-                if (ret == AVERROR_EOF) {
-                    FF(avcodec_send_frame(enc.get(), nullptr));
-                } else {
-                    FF_RET(ret, "av_buffersink_get_frame");
-                    FF(avcodec_send_frame(enc.get(), frame.get()));
-                }
-            } else if (ret == AVERROR_EOF) {
-                return;
-            } else {
-                FF_RET(ret, "avcodec_receive_packet");
-                pkt->stream_index = st->index;
-                av_packet_rescale_ts(pkt.get(), enc->time_base, st->time_base);
-                cb(std::move(pkt));
+    static int io_close2(AVFormatContext* s, AVIOContext* pb)
+    {
+        auto self = static_cast<OutputIO*>(s->opaque);
+
+        std::lock_guard<std::mutex> lock(self->mutex);
+        for (auto it = self->writers.begin(); it != self->writers.end(); ++it) {
+            if (it->second->context() == pb) {
+                const auto ret = it->second->close();
+                self->writers.erase(it);
+                return ret;
+            }
+        }
+        for (auto it = self->paced.begin(); it != self->paced.end(); ++it) {
+            if (it->second->context() == pb) {
+                const auto ret = it->second->close();
+                self->paced.erase(it);
+                return ret;
             }
         }
+        return avio_close(pb);
+    }
+
+    double fill()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto result = 0.0;
+        for (auto& p : writers) {
+            result = std::max(result, p.second->fill());
+        }
+        return result;
+    }
+
+    std::optional<PacedWriter::Stats> stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (paced.empty()) {
+            return {};
+        }
+        return paced.begin()->second->stats();
     }
 };
 
@@ -451,6 +715,7 @@ struct ffmpeg_consumer : public core::frame_consumer
     int                     channel_index_ = -1;
     core::video_format_desc format_desc_;
     bool                    realtime_ = false;
+    std::atomic<bool>       paced_{true};
 
     spl::shared_ptr<diagnostics::graph> graph_;
 
@@ -482,6 +747,12 @@ struct ffmpeg_consumer : public core::frame_consumer
         graph_->set_color("frame-time", diagnostics::color(0.1f, 1.0f, 0.1f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
         graph_->set_color("input", diagnostics::color(0.7f, 0.4f, 0.4f));
+        graph_->set_color("video-convert", diagnostics::color(0.9f, 0.9f, 0.3f));
+        graph_->set_color("video-filter", diagnostics::color(0.3f, 0.9f, 0.9f));
+        graph_->set_color("video-encode", diagnostics::color(0.9f, 0.3f, 0.9f));
+        graph_->set_color("audio", diagnostics::color(0.3f, 0.3f, 0.9f));
+        graph_->set_color("write-buffer", diagnostics::color(0.6f, 0.6f, 0.6f));
+        graph_->set_color("stream-queue", diagnostics::color(0.9f, 0.6f, 0.2f));
     }
 
     ~ffmpeg_consumer()
@@ -506,7 +777,10 @@ struct ffmpeg_consumer : public core::frame_consumer
         graph_->set_text(print());
 
         frame_thread_ = std::thread([=] {
+            set_thread_affinity(thread_role::consumer);
             try {
+                OutputIO output;
+
                 std::map<std::string, std::string> options;
                 {
                     static boost::regex opt_exp("-(?<NAME>[^\\s]+)(\\s+(?<VALUE>[^\\s]+))?");
@@ -518,6 +792,49 @@ struct ffmpeg_consumer : public core::frame_consumer
                     }
                 }
 
+                // STREAM to srt:// or udp:// sends mpegts with low latency defaults, -muxrate makes it constant
+                // bitrate and paces the packets to it.
+                static const boost::regex net_exp("^(srt|udp)://.*");
+                if (realtime_ && boost::regex_match(path_, net_exp)) {
+                    options.emplace("format", "mpegts");
+                    options.emplace("flush_packets", "1");
+                    options.emplace("muxdelay", "0.1");
+                    if (boost::algorithm::starts_with(path_, "udp://")) {
+                        options.emplace("pkt_size", "1316");
+                    }
+
+                    const auto muxrate = options.find("muxrate");
+                    if (muxrate != options.end()) {
+                        output.pace_bitrate = static_cast<int64_t>(av_strtod(muxrate->second.c_str(), nullptr));
+                    }
+                    const auto pkt_size = options.find("pkt_size");
+                    if (pkt_size != options.end()) {
+                        output.packet_size = std::max(188, std::atoi(pkt_size->second.c_str()));
+                    }
+                }
+
+                // -tee out.mp4|[f=flv]rtmp://host/app sends the packets of the encoders to further outputs, as the
+                // ffmpeg tee muxer does. They are isolated from the consumer's own output, which should be the one
+                // that matters most, usually the recording.
+                std::vector<std::string> tee_specs;
+                {
+                    const auto it = options.find("tee");
+                    if (it != options.end()) {
+                        boost::split(tee_specs, it->second, boost::is_any_of("|"));
+                        tee_specs.erase(std::remove(tee_specs.begin(), tee_specs.end(), ""), tee_specs.end());
+                        options.erase(it);
+                    }
+                }
+
+                // Seconds, as with the ffmpeg cli.
+                {
+                    const auto it = options.find("muxdelay");
+                    if (it != options.end()) {
+                        options["max_delay"] = std::to_string(static_cast<int64_t>(std::stod(it->second) * 1000000));
+                        options.erase(it);
+                    }
+                }
+
                 boost::filesystem::path full_path = path_;
 
                 static boost::regex prot_exp("^.+:.*");
@@ -552,16 +869,85 @@ struct ffmpeg_consumer : public core::frame_consumer
 
                 CASPAR_SCOPE_EXIT { avformat_free_context(oc); };
 
-                std::optional<Stream> video_stream;
+                oc->opaque    = &output;
+                oc->io_open   = OutputIO::io_open;
+                oc->io_close2 = OutputIO::io_close2;
+
+                // The encoders are shared, so a muxer that wants the headers out of band gets them everywhere.
+                if (std::any_of(tee_specs.begin(), tee_specs.end(), TeeOutput::global_header)) {
+                    if (oc->oformat->video_codec != AV_CODEC_ID_NONE) {
+                        options["flags:v"] += "+global_header";
+                    }
+                    if (oc->oformat->audio_codec != AV_CODEC_ID_NONE) {
+                        options["flags:a"] += "+global_header";
+                    }
+                }
+
+                // The first stream converts and filters the frames for all of them, the others are renditions
+                // encoding further sinks of its graph.
+                std::vector<std::unique_ptr<Stream>> video_streams;
                 if (oc->oformat->video_codec != AV_CODEC_ID_NONE) {
-                    if (oc->oformat->video_codec == AV_CODEC_ID_H264 && options.find("preset:v") == options.end()) {
+                    // Hardware encoders have presets of their own.
+                    if (oc->oformat->video_codec == AV_CODEC_ID_H264 && options.find("preset:v") == options.end() &&
+                        options.find("codec:v") == options.end()) {
                         options["preset:v"] = "veryfast";
                     }
-                    video_stream.emplace(oc, ":v", oc->oformat->video_codec, format_desc, realtime_, options);
+
+                    // -renditions 1920x1080:6M,1280x720:3M,640x360:800k, largest first.
+                    std::vector<std::pair<int, int>> sizes;
+                    std::vector<std::string>         bitrates;
+                    {
+                        const auto it = options.find("renditions");
+                        if (it != options.end()) {
+                            static const boost::regex rendition_exp("(\\d+)x(\\d+)(:(\\S+))?");
+
+                            std::vector<std::string> items;
+                            boost::split(items, it->second, boost::is_any_of(","));
+                            for (auto& item : items) {
+                                boost::smatch what;
+                                if (!boost::regex_match(item, what, rendition_exp)) {
+                                    CASPAR_THROW_EXCEPTION(user_error()
+                                                           << msg_info("Invalid rendition " + item + "."));
+                                }
+                                sizes.emplace_back(std::stoi(what[1].str()), std::stoi(what[2].str()));
+                                bitrates.push_back(what[4].str());
+                            }
+                            options.erase(it);
+                        }
+                    }
+
+                    // Renditions take the same video options, with a bitrate of their own.
+                    auto other_options     = options;
+                    auto rendition_options = take_stream_options(":v", other_options);
+                    rendition_options.erase("filter");
+                    rendition_options.erase("hwaccel");
+
+                    if (!sizes.empty() && !bitrates[0].empty()) {
+                        options["b:v"] = bitrates[0];
+                    }
+
+                    video_streams.push_back(std::make_unique<Stream>(
+                        oc, ":v", oc->oformat->video_codec, format_desc, realtime_, options, sizes));
+
+                    for (auto n = 1U; n < sizes.size(); ++n) {
+                        auto stream_options = rendition_options;
+                        if (!bitrates[n].empty()) {
+                            stream_options["b"] = bitrates[n];
+                        }
+                        const auto codec = find_encoder(oc->oformat->video_codec, stream_options);
+                        video_streams.push_back(std::make_unique<Stream>(oc,
+                                                                         ":v",
+                                                                         codec,
+                                                                         video_streams[0]->graph,
+                                                                         video_streams[0]->sinks[n],
+                                                                         realtime_,
+                                                                         std::move(stream_options),
+                                                                         options));
+                    }
 
                     {
                         std::lock_guard<std::mutex> lock(state_mutex_);
-                        state_["file/fps"] = av_q2d(av_buffersink_get_frame_rate(video_stream->sink));
+                        state_["file/fps"] = av_q2d(av_buffersink_get_frame_rate(video_streams[0]->sink));
                     }
                 }
 
@@ -570,11 +956,26 @@ struct ffmpeg_consumer : public core::frame_consumer
                     audio_stream.emplace(oc, ":a", oc->oformat->audio_codec, format_desc, realtime_, options);
                 }
 
+                // Renditions share the audio stream, hls needs %v in the path to write a playlist per variant.
+                if (video_streams.size() > 1) {
+                    const std::string muxer = oc->oformat->name;
+                    if (muxer == "hls" && options.find("var_stream_map") == options.end()) {
+                        std::string map = audio_stream ? "a:0,agroup:audio" : "";
+                        for (auto n = 0U; n < video_streams.size(); ++n) {
+                            map += (map.empty() ? "" : " ") + (boost::format("v:%d") % n).str();
+                            map += audio_stream ? ",agroup:audio" : "";
+                        }
+                        options["var_stream_map"] = map;
+                    } else if (muxer == "dash" && options.find("adaptation_sets") == options.end()) {
+                        options["adaptation_sets"] = audio_stream ? "id=0,streams=v id=1,streams=a" : "id=0,streams=v";
+                    }
+                }
+
                 if (!(oc->oformat->flags & AVFMT_NOFILE)) {
                     // TODO (fix) interrupt_cb
                     auto dict = to_dict(std::move(options));
                     CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
-                    FF(avio_open2(&oc->pb, full_path.string().c_str(), AVIO_FLAG_WRITE, nullptr, &dict));
+                    FF(oc->io_open(oc, &oc->pb, full_path.string().c_str(), AVIO_FLAG_WRITE, &dict));
                     options = to_map(&dict);
                 }
 
@@ -591,14 +992,26 @@ struct ffmpeg_consumer : public core::frame_consumer
                     }
                 }
 
+                // Opened once the streams are final, each connects on a thread of its own.
+                std::vector<std::unique_ptr<TeeOutput>> tee_outputs;
+                {
+                    const auto streams = std::vector<AVStream*>(oc->streams, oc->streams + oc->nb_streams);
+                    for (auto& spec : tee_specs) {
+                        tee_outputs.push_back(std::make_unique<TeeOutput>(spec, streams));
+                    }
+                }
+
                 tbb::concurrent_bounded_queue<std::shared_ptr<AVPacket>> packet_buffer;
                 packet_buffer.set_capacity(realtime_ ? 1 : 128);
                 auto packet_thread = std::thread([&] {
+                    set_thread_affinity(thread_role::consumer);
                     try {
                         CASPAR_SCOPE_EXIT
                         {
                             if (!(oc->oformat->flags & AVFMT_NOFILE)) {
-                                FF(avio_closep(&oc->pb));
+                                auto pb = oc->pb;
+                                oc->pb  = nullptr;
+                                FF(oc->io_close2(oc, pb));
                             }
                         };
 
@@ -612,12 +1025,38 @@ struct ffmpeg_consumer : public core::frame_consumer
                             }
                             count[pkt->stream_index] += 1;
                             FF(av_interleaved_write_frame(oc, pkt.get()));
+
+                            const auto fill  = output.fill();
+                            const auto stats = output.stats();
+                            graph_->set_value("write-buffer", fill);
+                            if (stats) {
+                                graph_->set_value("stream-queue", stats->queue);
+                            }
+                            {
+                                std::lock_guard<std::mutex> lock(state_mutex_);
+                                state_["file/write-buffer"] = fill;
+                                if (stats) {
+                                    state_["stream/bytes"]     = stats->bytes;
+                                    state_["stream/queue"]     = stats->queue;
+                                    state_["stream/underruns"] = stats->underruns;
+                                }
+                                for (auto n = 0U; n < tee_outputs.size(); ++n) {
+                                    const auto tee = tee_outputs[n]->stats();
+                                    const auto key = "tee/" + std::to_string(n);
+                                    state_[key + "/url"]     = tee_outputs[n]->url();
+                                    state_[key + "/packets"] = tee.packets;
+                                    state_[key + "/dropped"] = tee.dropped;
+                                    state_[key + "/failed"]  = tee.failed;
+                                }
+                            }
                         }
 
-                        auto video_st = video_stream ? video_stream->st : nullptr;
                         auto audio_st = audio_stream ? audio_stream->st : nullptr;
+                        auto video_ok = std::all_of(video_streams.begin(), video_streams.end(), [&](auto& stream) {
+                            return count[stream->st->index] > 0;
+                        });
 
-                        if ((!video_st || count[video_st->index]) && (!audio_st || count[audio_st->index])) {
+                        if (video_ok && (!audio_st || count[audio_st->index])) {
                             FF(av_write_trailer(oc));
                         }
 
@@ -637,7 +1076,57 @@ struct ffmpeg_consumer : public core::frame_consumer
                     }
                 };
 
-                auto packet_cb = [&](std::shared_ptr<AVPacket>&& pkt) { packet_buffer.push(std::move(pkt)); };
+                auto packet_cb = [&](std::shared_ptr<AVPacket>&& pkt) {
+                    for (auto& tee : tee_outputs) {
+                        tee->push(pkt);
+                    }
+                    packet_buffer.push(std::move(pkt));
+                };
+
+                // Each stage runs on a thread of its own and hands its output to the next one through a bounded
+                // queue, so a slow encode only stalls the frame thread once every queue before it is full. After a
+                // stage fails the queued work is skipped and the error is rethrown on the frame thread.
+                std::atomic<bool>  stage_failed{false};
+                std::mutex         stage_mutex;
+                std::exception_ptr stage_error;
+
+                auto stage = [&](const char* name, auto&& func) {
+                    if (stage_failed) {
+                        return;
+                    }
+                    try {
+                        caspar::timer stage_timer;
+                        func();
+                        graph_->set_value(name, stage_timer.elapsed() * format_desc.fps * 0.5);
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(stage_mutex);
+                        if (!stage_error) {
+                            stage_error = std::current_exception();
+                        }
+                        stage_failed = true;
+                    }
+                };
+
+                // Declared so that each stage is joined before the one it feeds. Every rendition has an encoder
+                // thread of its own.
+                std::vector<std::unique_ptr<executor>> video_encode;
+                for (auto n = 0U; n < video_streams.size(); ++n) {
+                    video_encode.push_back(std::make_unique<executor>(L"ffmpeg_consumer video encode"));
+                }
+                executor video_filter(L"ffmpeg_consumer video filter");
+                executor video_convert(L"ffmpeg_consumer video convert");
+                executor audio_encode(L"ffmpeg_consumer audio");
+
+                auto executors = std::vector<executor*>{&video_convert, &video_filter};
+                for (auto& exec : video_encode) {
+                    executors.push_back(exec.get());
+                }
+                executors.push_back(&audio_encode);
+
+                for (auto exec : executors) {
+                    exec->set_capacity(realtime_ ? 1 : 8);
+                    exec->begin_invoke([] { set_thread_affinity(thread_role::consumer); });
+                }
 
                 std::int32_t frame_number = 0;
                 while (true) {
@@ -652,26 +1141,67 @@ struct ffmpeg_consumer : public core::frame_consumer
                                       static_cast<double>(frame_buffer_.size() + 0.001) / frame_buffer_.capacity());
 
                     caspar::timer frame_timer;
-                    tbb::parallel_invoke(
-                        [&] {
-                            if (video_stream) {
-                                video_stream->send(frame, format_desc, packet_cb);
-                            }
-                        },
-                        [&] {
-                            if (audio_stream) {
-                                audio_stream->send(frame, format_desc, packet_cb);
-                            }
+                    if (!video_streams.empty()) {
+                        video_convert.begin_invoke([&, frame] {
+                            stage("video-convert", [&] {
+                                auto converted = video_streams[0]->convert(frame, format_desc);
+                                video_filter.begin_invoke([&, converted] {
+                                    stage("video-filter", [&] {
+                                        for (auto n = 0U; n < video_streams.size(); ++n) {
+                                            auto encode = [&, n](std::shared_ptr<AVFrame> filtered) {
+                                                video_encode[n]->begin_invoke([&, n, filtered] {
+                                                    stage("video-encode",
+                                                          [&] { video_streams[n]->encode(filtered, packet_cb); });
+                                                });
+                                            };
+                                            if (n == 0) {
+                                                video_streams[0]->filter(converted, encode);
+                                            } else {
+                                                drain_sink(video_streams[n]->sink, encode);
+                                            }
+                                        }
+                                    });
+                                });
+                            });
+                        });
+                    }
+                    if (audio_stream) {
+                        audio_encode.begin_invoke([&, frame] {
+                            stage("audio", [&] {
+                                audio_stream->filter(audio_stream->convert(frame, format_desc),
+                                                     [&](std::shared_ptr<AVFrame> filtered) {
+                                                         audio_stream->encode(filtered, packet_cb);
+                                                     });
+                            });
                         });
+                    }
                     graph_->set_value("frame-time", frame_timer.elapsed() * format_desc.fps * 0.5);
 
+                    if (stage_failed) {
+                        std::lock_guard<std::mutex> lock(stage_mutex);
+                        std::rethrow_exception(stage_error);
+                    }
+
                     if (!frame) {
-                        packet_buffer.push(nullptr);
                         break;
                     }
                 }
 
+                for (auto exec : executors) {
+                    exec->stop_and_wait();
+                }
+
+                if (stage_failed) {
+                    std::lock_guard<std::mutex> lock(stage_mutex);
+                    std::rethrow_exception(stage_error);
+                }
+
+                packet_buffer.push(nullptr);
                 packet_thread.join();
+
+                for (auto& tee : tee_outputs) {
+                    tee->close();
+                }
             } catch (...) {
                 std::lock_guard<std::mutex> lock(exception_mutex_);
                 exception_ = std::current_exception();
@@ -679,7 +1209,7 @@ struct ffmpeg_consumer : public core::frame_consumer
         });
     }
 
-    std::future<bool> send(core::video_field field, core::const_frame frame) override
+    core::send_result send(core::video_field field, core::const_frame frame) override
     {
         // TODO - field alignment
 
@@ -690,12 +1220,23 @@ struct ffmpeg_consumer : public core::frame_consumer
             }
         }
 
-        if (!frame_buffer_.try_push(frame)) {
-            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        // An unpaced channel renders faster than real time, it waits for room instead of dropping frames. Polled, so
+        // an encoder that failed is noticed rather than waited for.
+        while (!frame_buffer_.try_push(frame)) {
+            if (paced_) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+            std::lock_guard<std::mutex> lock(exception_mutex_);
+            if (exception_ != nullptr) {
+                std::rethrow_exception(exception_);
+            }
         }
         graph_->set_value("input", static_cast<double>(frame_buffer_.size() + 0.001) / frame_buffer_.capacity());
 
-        return make_ready_future(true);
+        return true;
     }
 
     std::wstring print() const override { return L"ffmpeg[" + u16(path_) + L"]"; }
@@ -704,6 +1245,19 @@ struct ffmpeg_consumer : public core::frame_consumer
 
     bool has_synchronization_clock() const override { return false; }
 
+    void paced(bool value) override { paced_ = value; }
+
+    // The frames waiting to be encoded.
+    core::memory_usage memory() const override
+    {
+        core::memory_usage usage;
+        usage.host = std::max<std::int64_t>(frame_buffer_.size(), 0) * static_cast<std::int64_t>(format_desc_.size);
+        return usage;
+    }
+
+    // The encoder input is always yuva422p, see Stream.
+    core::output_format preferred_output_format() const override { return core::output_format::yuva422; }
+
     int index() const override { return 100000 + channel_index_; }
 
     core::monitor::state state() const override
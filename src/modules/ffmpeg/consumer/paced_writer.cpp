@@ -0,0 +1,197 @@
+#include "paced_writer.h"
+
+#include "../util/av_assert.h"
+
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avio.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+// How far the sender may fall behind before it stops catching up, and how much the muxer may queue.
+static const std::chrono::milliseconds MAX_BURST(10);
+static const std::chrono::milliseconds MAX_QUEUE(1000);
+
+struct PacedWriter::Impl
+{
+    using clock = std::chrono::steady_clock;
+
+    const std::string url_;
+    const int64_t     bitrate_;
+    const int64_t     max_queue_;
+
+    mutable std::mutex                    mutex_;
+    std::condition_variable               cond_;
+    std::deque<std::vector<std::uint8_t>> packets_;
+    int64_t                               queued_ = 0;
+    bool                                  end_    = false;
+    int                                   error_  = 0;
+    Stats                                 stats_;
+
+    AVIOContext* inner_  = nullptr;
+    AVIOContext* avio_   = nullptr;
+    bool         closed_ = false;
+    std::thread  thread_;
+
+    Impl(const std::string& url, int64_t bitrate, int packet_size, AVIOInterruptCB* interrupt, AVDictionary** options)
+        : url_(url)
+        , bitrate_(std::max<int64_t>(1, bitrate))
+        , max_queue_(bitrate_ / 8 * MAX_QUEUE.count() / 1000)
+    {
+        FF(avio_open2(&inner_, url.c_str(), AVIO_FLAG_WRITE, interrupt, options));
+
+        auto buffer = static_cast<unsigned char*>(av_malloc(packet_size));
+        avio_       = avio_alloc_context(buffer, packet_size, 1, this, nullptr, write_packet, nullptr);
+        if (!avio_) {
+            av_free(buffer);
+            avio_closep(&inner_);
+            FF_RET(AVERROR(ENOMEM), "avio_alloc_context");
+        }
+        // Every write is one packet on the wire.
+        avio_->max_packet_size = packet_size;
+
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~Impl()
+    {
+        close();
+
+        av_freep(&avio_->buffer);
+        avio_context_free(&avio_);
+    }
+
+    void run()
+    {
+        set_thread_name(L"[ffmpeg::consumer::PacedWriter]");
+        set_thread_affinity(thread_role::consumer);
+
+        auto next    = clock::now();
+        auto started = false;
+
+        while (true) {
+            std::vector<std::uint8_t> packet;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (packets_.empty() && started && !end_) {
+                    stats_.underruns += 1;
+                }
+                cond_.wait(lock, [&] { return !packets_.empty() || end_; });
+                if (packets_.empty()) {
+                    break;
+                }
+                packet = std::move(packets_.front());
+                packets_.pop_front();
+                queued_ -= static_cast<int64_t>(packet.size());
+            }
+            cond_.notify_all();
+
+            // After an underrun the schedule restarts instead of sending what was missed in a burst.
+            const auto now = clock::now();
+            if (now > next + MAX_BURST) {
+                next = now;
+            }
+            std::this_thread::sleep_until(next);
+            next += std::chrono::duration_cast<clock::duration>(
+                std::chrono::duration<double>(static_cast<double>(packet.size()) * 8.0 / bitrate_));
+            started = true;
+
+            avio_write(inner_, packet.data(), static_cast<int>(packet.size()));
+            avio_flush(inner_);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (inner_->error < 0 && error_ == 0) {
+                error_ = inner_->error;
+                CASPAR_LOG(error) << L"[ffmpeg] Send to " << u16(url_) << L" failed.";
+            }
+            stats_.bytes += static_cast<int64_t>(packet.size());
+        }
+    }
+
+    int write(const std::uint8_t* data, int size)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [&] { return queued_ < max_queue_ || error_ != 0; });
+        if (error_ != 0) {
+            return error_;
+        }
+        packets_.emplace_back(data, data + size);
+        queued_ += size;
+        lock.unlock();
+        cond_.notify_all();
+        return size;
+    }
+
+    int close()
+    {
+        if (closed_) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return error_;
+        }
+        closed_ = true;
+
+        avio_flush(avio_);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            end_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+
+        const auto ret = avio_closep(&inner_);
+        return error_ != 0 ? error_ : ret;
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto stats  = stats_;
+        stats.queue = static_cast<double>(queued_) * 8.0 / bitrate_;
+        return stats;
+    }
+
+    static int write_packet(void* opaque, std::uint8_t* buf, int size)
+    {
+        return static_cast<Impl*>(opaque)->write(buf, size);
+    }
+};
+
+PacedWriter::PacedWriter(const std::string& url,
+                         int64_t            bitrate,
+                         int                packet_size,
+                         AVIOInterruptCB*   interrupt,
+                         AVDictionary**     options)
+    : impl_(new Impl(url, bitrate, packet_size, interrupt, options))
+{
+}
+
+PacedWriter::~PacedWriter() {}
+
+AVIOContext* PacedWriter::context() const { return impl_->avio_; }
+
+int PacedWriter::close() { return impl_->close(); }
+
+PacedWriter::Stats PacedWriter::stats() const { return impl_->stats(); }
+
+}} // namespace caspar::ffmpeg
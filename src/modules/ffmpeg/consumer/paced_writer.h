@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct AVIOContext;
+struct AVIOInterruptCB;
+struct AVDictionary;
+
+namespace caspar { namespace ffmpeg {
+
+// AVIOContext sending what the muxer writes to a network url at a constant bitrate from a thread of its own, one
+// write of up to packet_size bytes at a time, so the transport stream packets of a frame don't leave in one burst.
+class PacedWriter
+{
+  public:
+    struct Stats
+    {
+        int64_t bytes     = 0;
+        double  queue     = 0.0; // Seconds of data waiting to be sent.
+        int64_t underruns = 0;   // Times the sender ran out of data.
+    };
+
+    PacedWriter(const std::string& url,
+                int64_t            bitrate,
+                int                packet_size,
+                AVIOInterruptCB*   interrupt,
+                AVDictionary**     options);
+    ~PacedWriter();
+
+    PacedWriter(const PacedWriter&)            = delete;
+    PacedWriter& operator=(const PacedWriter&) = delete;
+
+    AVIOContext* context() const;
+
+    // Sends the rest and closes the url. Returns 0 or the AVERROR of the first write that failed.
+    int close();
+
+    Stats stats() const;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,327 @@
+#include "tee_output.h"
+
+#include "../util/av_assert.h"
+#include "../util/av_util.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/scope_exit.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/regex.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+// Packets an output may fall behind by, a few seconds of video and audio, and the time it has to finish once closed.
+static const size_t                    MAX_QUEUE = 1024;
+static const std::chrono::milliseconds CLOSE_TIMEOUT(5000);
+
+namespace {
+
+struct output_spec
+{
+    std::string                        url;
+    std::string                        format;
+    std::map<std::string, std::string> options;
+    bool                               local = false;
+};
+
+// [f=flv:flvflags=no_duration_filesize]rtmp://host/app, where srt:// and udp:// default to mpegts like STREAM does.
+output_spec parse_spec(const std::string& spec)
+{
+    output_spec result;
+    result.url = spec;
+
+    if (!spec.empty() && spec[0] == '[') {
+        const auto end = spec.find(']');
+        if (end == std::string::npos) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid tee output " + spec + "."));
+        }
+        result.url = spec.substr(end + 1);
+
+        const auto               list = spec.substr(1, end - 1);
+        std::vector<std::string> items;
+        boost::split(items, list, boost::is_any_of(":"));
+        for (auto& item : items) {
+            if (item.empty()) {
+                continue;
+            }
+            const auto eq    = item.find('=');
+            const auto key   = item.substr(0, eq);
+            const auto value = eq != std::string::npos ? item.substr(eq + 1) : "";
+            if (key == "f") {
+                result.format = value;
+            } else {
+                result.options[key] = value;
+            }
+        }
+    }
+
+    static const boost::regex net_exp("^(srt|udp)://.*");
+    if (result.format.empty() && boost::regex_match(result.url, net_exp)) {
+        result.format = "mpegts";
+    }
+
+    // Files go to the media folder like the consumer's own.
+    static const boost::regex prot_exp("^.+:.*");
+    if (!boost::regex_match(result.url, prot_exp)) {
+        boost::filesystem::path path = result.url;
+        if (!path.is_complete()) {
+            path = u8(env::media_folder()) + result.url;
+        }
+        result.url   = path.string();
+        result.local = true;
+    }
+
+    return result;
+}
+
+struct source_stream
+{
+    std::shared_ptr<AVCodecParameters> codecpar;
+    AVRational                         time_base = {0, 1};
+};
+
+} // namespace
+
+struct TeeOutput::Impl
+{
+    using clock = std::chrono::steady_clock;
+
+    output_spec                spec_;
+    std::vector<source_stream> streams_;
+
+    mutable std::mutex                    mutex_;
+    std::condition_variable               cond_;
+    std::deque<std::shared_ptr<AVPacket>> packets_;
+    std::vector<bool>                     waiting_; // For a keyframe after dropping, by stream.
+    bool                                  end_ = false;
+    Stats                                 stats_;
+
+    // Of close, in ticks of clock, after which blocking io is interrupted.
+    std::atomic<clock::rep> deadline_{0};
+
+    std::thread thread_;
+
+    Impl(const std::string& spec, const std::vector<AVStream*>& streams)
+        : spec_(parse_spec(spec))
+        , waiting_(streams.size(), false)
+    {
+        for (auto st : streams) {
+            source_stream stream;
+            stream.codecpar = std::shared_ptr<AVCodecParameters>(
+                avcodec_parameters_alloc(), [](AVCodecParameters* ptr) { avcodec_parameters_free(&ptr); });
+            if (!stream.codecpar) {
+                FF_RET(AVERROR(ENOMEM), "avcodec_parameters_alloc");
+            }
+            FF(avcodec_parameters_copy(stream.codecpar.get(), st->codecpar));
+            stream.time_base = st->time_base;
+            streams_.push_back(std::move(stream));
+        }
+
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~Impl() { close(); }
+
+    void run()
+    {
+        set_thread_name(L"[ffmpeg::consumer::TeeOutput]");
+        set_thread_affinity(thread_role::consumer);
+
+        try {
+            AVFormatContext* oc = nullptr;
+            FF(avformat_alloc_output_context2(
+                &oc, nullptr, !spec_.format.empty() ? spec_.format.c_str() : nullptr, spec_.url.c_str()));
+            CASPAR_SCOPE_EXIT { avformat_free_context(oc); };
+
+            oc->interrupt_callback.callback = interrupt;
+            oc->interrupt_callback.opaque   = this;
+
+            for (auto& stream : streams_) {
+                auto st = avformat_new_stream(oc, nullptr);
+                if (!st) {
+                    FF_RET(AVERROR(ENOMEM), "avformat_new_stream");
+                }
+                FF(avcodec_parameters_copy(st->codecpar, stream.codecpar.get()));
+                // The tags are those of the consumer's muxer, this one picks its own.
+                st->codecpar->codec_tag = 0;
+                st->time_base           = stream.time_base;
+            }
+
+            auto dict = to_dict(std::move(spec_.options));
+            CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
+
+            if (!(oc->oformat->flags & AVFMT_NOFILE)) {
+                if (spec_.local) {
+                    boost::system::error_code ec;
+                    boost::filesystem::create_directories(boost::filesystem::path(spec_.url).parent_path(), ec);
+                }
+                FF(avio_open2(&oc->pb, spec_.url.c_str(), AVIO_FLAG_WRITE, &oc->interrupt_callback, &dict));
+            }
+            CASPAR_SCOPE_EXIT
+            {
+                if (!(oc->oformat->flags & AVFMT_NOFILE)) {
+                    avio_closep(&oc->pb);
+                }
+            };
+
+            FF(avformat_write_header(oc, &dict));
+            for (auto& p : to_map(&dict)) {
+                CASPAR_LOG(warning) << L"[ffmpeg] Unused option " << u16(p.first) << L"=" << u16(p.second)
+                                    << L" for tee output " << u16(spec_.url);
+            }
+            CASPAR_LOG(info) << L"[ffmpeg] Tee output to " << u16(spec_.url) << L" opened.";
+
+            auto written = false;
+            while (true) {
+                std::shared_ptr<AVPacket> pkt;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    cond_.wait(lock, [&] { return !packets_.empty() || end_; });
+                    if (packets_.empty()) {
+                        break;
+                    }
+                    pkt = std::move(packets_.front());
+                    packets_.pop_front();
+                }
+
+                const auto index = pkt->stream_index;
+                av_packet_rescale_ts(pkt.get(), streams_[index].time_base, oc->streams[index]->time_base);
+                FF(av_interleaved_write_frame(oc, pkt.get()));
+                written = true;
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                stats_.packets += 1;
+            }
+
+            if (written) {
+                FF(av_write_trailer(oc));
+            }
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            CASPAR_LOG(error) << L"[ffmpeg] Tee output to " << u16(spec_.url) << L" failed, the others go on.";
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.failed = true;
+            packets_.clear();
+        }
+    }
+
+    void push(const std::shared_ptr<AVPacket>& pkt)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (end_ || stats_.failed || pkt->stream_index < 0 ||
+                pkt->stream_index >= static_cast<int>(streams_.size())) {
+                return;
+            }
+
+            // Video picks up again at a keyframe, audio where it is.
+            if (packets_.size() >= MAX_QUEUE) {
+                if (std::find(waiting_.begin(), waiting_.end(), true) == waiting_.end()) {
+                    CASPAR_LOG(warning) << L"[ffmpeg] Tee output to " << u16(spec_.url)
+                                        << L" is falling behind, dropping packets.";
+                }
+                for (auto n = 0U; n < streams_.size(); ++n) {
+                    waiting_[n] = waiting_[n] || streams_[n].codecpar->codec_type == AVMEDIA_TYPE_VIDEO;
+                }
+                stats_.dropped += 1;
+                return;
+            }
+            if (waiting_[pkt->stream_index]) {
+                if (!(pkt->flags & AV_PKT_FLAG_KEY)) {
+                    stats_.dropped += 1;
+                    return;
+                }
+                waiting_[pkt->stream_index] = false;
+            }
+
+            // A new reference to the same data, the muxers take theirs apart.
+            auto ref = std::shared_ptr<AVPacket>(av_packet_clone(pkt.get()),
+                                                 [](AVPacket* ptr) { av_packet_free(&ptr); });
+            if (!ref) {
+                stats_.dropped += 1;
+                return;
+            }
+            packets_.push_back(std::move(ref));
+        }
+        cond_.notify_all();
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            end_ = true;
+        }
+        deadline_ = (clock::now() + CLOSE_TIMEOUT).time_since_epoch().count();
+        cond_.notify_all();
+
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    static int interrupt(void* opaque)
+    {
+        const auto deadline = static_cast<Impl*>(opaque)->deadline_.load();
+        return deadline != 0 && clock::now().time_since_epoch().count() > deadline ? 1 : 0;
+    }
+};
+
+TeeOutput::TeeOutput(const std::string& spec, const std::vector<AVStream*>& streams)
+    : impl_(new Impl(spec, streams))
+{
+}
+
+TeeOutput::~TeeOutput() {}
+
+bool TeeOutput::global_header(const std::string& spec)
+{
+    const auto parsed = parse_spec(spec);
+    const auto format =
+        av_guess_format(!parsed.format.empty() ? parsed.format.c_str() : nullptr, parsed.url.c_str(), nullptr);
+    return format && (format->flags & AVFMT_GLOBALHEADER);
+}
+
+void TeeOutput::push(const std::shared_ptr<AVPacket>& pkt) { impl_->push(pkt); }
+
+void TeeOutput::close() { impl_->close(); }
+
+const std::string& TeeOutput::url() const { return impl_->spec_.url; }
+
+TeeOutput::Stats TeeOutput::stats() const { return impl_->stats(); }
+
+}} // namespace caspar::ffmpeg
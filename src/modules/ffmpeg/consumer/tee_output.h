@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct AVPacket;
+struct AVStream;
+
+namespace caspar { namespace ffmpeg {
+
+// Muxes the packets the encoders of a consumer already produced to a further url, so that recording and streaming the
+// same encode takes one encode. Each output has a queue and a thread of its own: one that falls behind drops packets
+// up to the next keyframe and one that fails is closed, neither holding back the consumer's own output.
+class TeeOutput
+{
+  public:
+    struct Stats
+    {
+        int64_t packets = 0; // Written to the muxer.
+        int64_t dropped = 0;
+        bool    failed  = false;
+    };
+
+    // spec is a url, optionally preceded by muxer options as with the ffmpeg tee muxer, e.g. [f=flv]rtmp://host/app.
+    // streams are those of the consumer's output after its header was written, whose packets push takes.
+    TeeOutput(const std::string& spec, const std::vector<AVStream*>& streams);
+    ~TeeOutput();
+
+    TeeOutput(const TeeOutput&)            = delete;
+    TeeOutput& operator=(const TeeOutput&) = delete;
+
+    // Whether the muxer of spec takes the codec headers out of band, which the encoders must then be opened for.
+    static bool global_header(const std::string& spec);
+
+    // Queues a reference to the packet without ever blocking.
+    void push(const std::shared_ptr<AVPacket>& pkt);
+
+    // Writes what is queued and the trailer, giving up on an output that doesn't take them within a few seconds.
+    void close();
+
+    const std::string& url() const;
+
+    Stats stats() const;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}} // namespace caspar::ffmpeg
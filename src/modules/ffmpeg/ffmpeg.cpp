@@ -24,14 +24,30 @@
 #include "ffmpeg.h"
 
 #include "consumer/ffmpeg_consumer.h"
+#include "producer/av_cache.h"
+#include "producer/av_thumbnail.h"
 #include "producer/ffmpeg_producer.h"
 
+#include <common/env.h>
+#include <common/except.h>
+#include <common/filesystem.h>
 #include <common/log.h>
+#include <common/utf.h>
 
 #include <core/consumer/frame_consumer.h>
+#include <core/module_dependencies.h>
 #include <core/producer/frame_producer.h>
 
+#include <protocol/amcp/amcp_command_context.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+
+#include <cstring>
+#include <memory>
 #include <mutex>
+#include <sstream>
+#include <string>
 
 #if defined(_MSC_VER)
 #pragma warning(disable : 4244)
@@ -88,26 +104,116 @@ void log_callback(void* ptr, int level, const char* fmt, va_list vl)
     }
 
     try {
-        if (level == AV_LOG_VERBOSE)
+        // Damaged streams can make decoders warn for every packet.
+        if (level == AV_LOG_VERBOSE) {
             CASPAR_LOG(trace) << L"[ffmpeg] " << line;
-        else if (level == AV_LOG_DEBUG)
+        } else if (level == AV_LOG_DEBUG) {
             CASPAR_LOG(trace) << L"[ffmpeg] " << line;
-        else if (level == AV_LOG_INFO)
+        } else if (level == AV_LOG_INFO) {
             CASPAR_LOG(info) << L"[ffmpeg] " << line;
-        else if (level == AV_LOG_WARNING)
-            CASPAR_LOG(warning) << L"[ffmpeg] " << line;
-        else if (level == AV_LOG_ERROR)
-            CASPAR_LOG(error) << L"[ffmpeg] " << line;
-        else if (level == AV_LOG_FATAL)
+        } else if (level == AV_LOG_WARNING) {
+            CASPAR_LOG_RATE_LIMITED(warning, 1) << L"[ffmpeg] " << line;
+        } else if (level == AV_LOG_ERROR) {
+            CASPAR_LOG_RATE_LIMITED(error, 1) << L"[ffmpeg] " << line;
+        } else if (level == AV_LOG_FATAL) {
             CASPAR_LOG(fatal) << L"[ffmpeg] " << line;
-        else
+        } else {
             CASPAR_LOG(trace) << L"[ffmpeg] " << line;
+        }
     } catch (...) {
     }
 }
 
 void log_for_thread(void* ptr, int level, const char* fmt, va_list vl) { log_callback(ptr, level, fmt, vl); }
 
+// Probes the container the way the media scanner did, for the built-in media index.
+static bool extract_media_info(const std::wstring& file, core::media_info& info)
+{
+    AVFormatContext* ctx = nullptr;
+    if (avformat_open_input(&ctx, u8(file).c_str(), nullptr, nullptr) < 0)
+        return false;
+
+    std::shared_ptr<AVFormatContext> input(ctx, [](AVFormatContext* ptr) { avformat_close_input(&ptr); });
+
+    // Text files would otherwise show up as the tty demuxer's video.
+    if (std::strcmp(input->iformat->name, "tty") == 0)
+        return false;
+
+    if (avformat_find_stream_info(input.get(), nullptr) < 0)
+        return false;
+
+    const auto video = av_find_best_stream(input.get(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (video >= 0 && (input->streams[video]->disposition & AV_DISPOSITION_ATTACHED_PIC) == 0) {
+        const auto format = std::string(input->iformat->name);
+        if (format == "image2" || boost::ends_with(format, "_pipe")) {
+            info.clip_type = L"STILL";
+            return true;
+        }
+
+        const auto rate = av_guess_frame_rate(input.get(), input->streams[video], nullptr);
+        if (rate.num <= 0 || rate.den <= 0)
+            return false;
+
+        info.clip_type             = L"MOVIE";
+        info.time_base_numerator   = rate.den;
+        info.time_base_denominator = rate.num;
+        if (input->duration != AV_NOPTS_VALUE)
+            info.duration = av_rescale(input->duration, rate.num, static_cast<int64_t>(rate.den) * AV_TIME_BASE);
+        return true;
+    }
+
+    if (av_find_best_stream(input.get(), AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0) >= 0) {
+        info.clip_type             = L"AUDIO";
+        info.time_base_numerator   = 1;
+        info.time_base_denominator = AV_TIME_BASE;
+        info.duration              = input->duration != AV_NOPTS_VALUE ? input->duration : 0;
+        return true;
+    }
+
+    return false;
+}
+
+// The file of a media name such as AMB, or of an absolute path, for the clip cache.
+static std::string clip_cache_file(const std::wstring& name)
+{
+    auto file = find_file_within_dir_or_absolute(env::media_folder(), name, [](const boost::filesystem::path& path) {
+        return boost::filesystem::is_regular_file(path);
+    });
+    if (!file) {
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(name + L" not found"));
+    }
+    return u8(file->wstring());
+}
+
+// CACHE ADD AMB
+static std::wstring cache_add_command(protocol::amcp::command_context& ctx)
+{
+    pin_clip(clip_cache_file(ctx.parameters.at(0)));
+    return L"202 CACHE ADD OK\r\n";
+}
+
+// CACHE REMOVE AMB
+static std::wstring cache_remove_command(protocol::amcp::command_context& ctx)
+{
+    if (!remove_clip(clip_cache_file(ctx.parameters.at(0)))) {
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(ctx.parameters.at(0) + L" not cached"));
+    }
+    return L"202 CACHE REMOVE OK\r\n";
+}
+
+// CACHE LIST, a "file" size pinned hits line for each cached file, the most recently played first.
+static std::wstring cache_list_command(protocol::amcp::command_context& ctx)
+{
+    std::wstringstream replyString;
+    replyString << L"200 CACHE LIST OK\r\n";
+    for (auto& clip : cached_clips()) {
+        replyString << L"\"" << u16(clip.filename) << L"\" " << clip.size << L" " << (clip.pinned ? 1 : 0) << L" "
+                    << clip.hits << L"\r\n";
+    }
+    replyString << L"\r\n";
+    return replyString.str();
+}
+
 void init(const core::module_dependencies& dependencies)
 {
     av_log_set_callback(log_for_thread);
@@ -126,7 +232,16 @@ void init(const core::module_dependencies& dependencies)
     dependencies.consumer_registry->register_consumer_factory(L"FFmpeg Consumer", create_consumer);
     dependencies.consumer_registry->register_preconfigured_consumer_factory(L"ffmpeg", create_preconfigured_consumer);
 
+    dependencies.producer_registry->register_producer_factory(
+        L"FFmpeg Playlist Producer", create_playlist_producer, {{L"[PLAYLIST]"}});
     dependencies.producer_registry->register_producer_factory(L"FFmpeg Producer", create_producer);
+    dependencies.producer_registry->register_media_info_extractor(extract_media_info);
+    dependencies.producer_registry->register_thumbnail_extractor(extract_thumbnail);
+    dependencies.producer_registry->register_thumbnail_writer(write_thumbnail);
+
+    dependencies.command_repository->register_command(L"Basic Commands", L"CACHE ADD", cache_add_command, 1);
+    dependencies.command_repository->register_command(L"Basic Commands", L"CACHE REMOVE", cache_remove_command, 1);
+    dependencies.command_repository->register_command(L"Query Commands", L"CACHE LIST", cache_list_command, 0);
 }
 
 void uninit()
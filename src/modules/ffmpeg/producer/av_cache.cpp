@@ -0,0 +1,332 @@
+#include "av_cache.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <algorithm>
+#include <ctime>
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avio.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+const int     IO_BUFFER_SIZE = 64 * 1024;
+const int64_t MB             = 1024 * 1024;
+
+using bytes = std::shared_ptr<const std::vector<std::uint8_t>>;
+
+int64_t budget() { return env::properties().get(L"configuration.ffmpeg.producer.clip-cache", 0) * MB; }
+
+int64_t max_file() { return env::properties().get(L"configuration.ffmpeg.producer.clip-cache-max-file", 16) * MB; }
+
+struct file_stamp
+{
+    int64_t     size  = -1;
+    std::time_t mtime = 0;
+
+    bool operator==(const file_stamp& other) const { return size == other.size && mtime == other.mtime; }
+};
+
+// -1 for the size of anything that isn't a regular file.
+file_stamp stamp(const std::string& filename)
+{
+    boost::system::error_code ec;
+    const auto                path = boost::filesystem::path(u16(filename));
+    file_stamp                result;
+    if (boost::filesystem::is_regular_file(path, ec)) {
+        const auto size  = boost::filesystem::file_size(path, ec);
+        const auto mtime = boost::filesystem::last_write_time(path, ec);
+        if (!ec) {
+            result.size  = static_cast<int64_t>(size);
+            result.mtime = mtime;
+        }
+    }
+    return result;
+}
+
+bytes load(const std::string& filename, int64_t size)
+{
+    boost::filesystem::ifstream file(u16(filename), std::ios::binary);
+    if (!file) {
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(u16(filename)));
+    }
+
+    auto data = std::make_shared<std::vector<std::uint8_t>>(static_cast<size_t>(size));
+    if (!file.read(reinterpret_cast<char*>(data->data()), static_cast<std::streamsize>(size))) {
+        CASPAR_THROW_EXCEPTION(io_error() << msg_info(L"Could not read " + u16(filename)));
+    }
+    return data;
+}
+
+struct entry
+{
+    bytes      data;
+    file_stamp stamp;
+    bool       pinned = false;
+    int64_t    hits   = 0;
+};
+
+// By filename, with the order they were last opened in, the most recent first.
+struct clip_cache
+{
+    std::mutex                   mutex;
+    std::map<std::string, entry> entries;
+    std::list<std::string>       order;
+    int64_t                      used = 0;
+
+    // Requires mutex.
+    void touch(const std::string& filename)
+    {
+        order.remove(filename);
+        order.push_front(filename);
+    }
+
+    // Requires mutex.
+    void erase(const std::string& filename)
+    {
+        auto it = entries.find(filename);
+        if (it != entries.end()) {
+            used -= static_cast<int64_t>(it->second.data->size());
+            entries.erase(it);
+            order.remove(filename);
+        }
+    }
+
+    // Requires mutex. Least recently opened first, pinned files stay.
+    void evict(int64_t limit)
+    {
+        const std::vector<std::string> oldest(order.rbegin(), order.rend());
+        for (auto& filename : oldest) {
+            if (used <= limit) {
+                break;
+            }
+            if (!entries[filename].pinned) {
+                CASPAR_LOG(debug) << L"[ffmpeg] Clip cache evicted " << u16(filename);
+                erase(filename);
+            }
+        }
+    }
+
+    // Requires mutex.
+    void insert(const std::string& filename, entry value)
+    {
+        erase(filename);
+        used += static_cast<int64_t>(value.data->size());
+        entries[filename] = std::move(value);
+        touch(filename);
+    }
+};
+
+clip_cache& cache()
+{
+    static clip_cache instance;
+    return instance;
+}
+
+} // namespace
+
+std::shared_ptr<CachedFile> CachedFile::open(const std::string& filename)
+{
+    auto& c = cache();
+
+    {
+        std::lock_guard<std::mutex> lock(c.mutex);
+        auto                        it = c.entries.find(filename);
+        if (it != c.entries.end() && it->second.pinned) {
+            it->second.hits += 1;
+            c.touch(filename);
+            return std::make_shared<CachedFile>(it->second.data);
+        }
+    }
+
+    const auto limit = budget();
+    if (limit <= 0) {
+        return nullptr;
+    }
+
+    const auto current = stamp(filename);
+    {
+        std::lock_guard<std::mutex> lock(c.mutex);
+        auto                        it = c.entries.find(filename);
+        if (it != c.entries.end()) {
+            if (it->second.stamp == current) {
+                it->second.hits += 1;
+                c.touch(filename);
+                return std::make_shared<CachedFile>(it->second.data);
+            }
+            c.erase(filename);
+        }
+    }
+
+    if (current.size < 0 || current.size > std::min(max_file(), limit)) {
+        return nullptr;
+    }
+
+    // Read outside the lock, a file opened twice at once is read twice.
+    entry value;
+    value.data  = load(filename, current.size);
+    value.stamp = current;
+    auto data   = value.data;
+
+    std::lock_guard<std::mutex> lock(c.mutex);
+    c.insert(filename, std::move(value));
+    c.evict(limit);
+    return std::make_shared<CachedFile>(std::move(data));
+}
+
+struct CachedFile::Impl
+{
+    const bytes  data_;
+    int64_t      pos_  = 0;
+    AVIOContext* avio_ = nullptr;
+
+    explicit Impl(bytes data)
+        : data_(std::move(data))
+    {
+        auto buffer = static_cast<unsigned char*>(av_malloc(IO_BUFFER_SIZE));
+        avio_       = avio_alloc_context(buffer, IO_BUFFER_SIZE, 0, this, read_packet, nullptr, seek);
+        if (!avio_) {
+            av_free(buffer);
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"avio_alloc_context failed"));
+        }
+    }
+
+    ~Impl()
+    {
+        av_freep(&avio_->buffer);
+        avio_context_free(&avio_);
+    }
+
+    int64_t size() const { return static_cast<int64_t>(data_->size()); }
+
+    int read(std::uint8_t* buf, int size)
+    {
+        if (pos_ >= this->size()) {
+            return AVERROR_EOF;
+        }
+
+        const auto count = static_cast<int>(std::min<int64_t>(size, this->size() - pos_));
+        std::copy_n(data_->data() + pos_, count, buf);
+        pos_ += count;
+        return count;
+    }
+
+    int64_t seek(int64_t offset, int whence)
+    {
+        if (whence == AVSEEK_SIZE) {
+            return size();
+        }
+
+        switch (whence & ~AVSEEK_FORCE) {
+            case SEEK_SET:
+                break;
+            case SEEK_CUR:
+                offset += pos_;
+                break;
+            case SEEK_END:
+                offset += size();
+                break;
+            default:
+                return AVERROR(EINVAL);
+        }
+
+        if (offset < 0) {
+            return AVERROR(EINVAL);
+        }
+
+        pos_ = offset;
+        return pos_;
+    }
+
+    static int read_packet(void* opaque, std::uint8_t* buf, int size)
+    {
+        return static_cast<Impl*>(opaque)->read(buf, size);
+    }
+
+    static int64_t seek(void* opaque, int64_t offset, int whence)
+    {
+        return static_cast<Impl*>(opaque)->seek(offset, whence);
+    }
+};
+
+CachedFile::CachedFile(std::shared_ptr<const std::vector<std::uint8_t>> data)
+    : impl_(new Impl(std::move(data)))
+{
+}
+
+CachedFile::~CachedFile() {}
+
+AVIOContext* CachedFile::context() const { return impl_->avio_; }
+
+void pin_clip(const std::string& filename)
+{
+    const auto current = stamp(filename);
+    if (current.size < 0) {
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(u16(filename)));
+    }
+
+    entry value;
+    value.data   = load(filename, current.size);
+    value.stamp  = current;
+    value.pinned = true;
+
+    auto&                       c = cache();
+    std::lock_guard<std::mutex> lock(c.mutex);
+    c.insert(filename, std::move(value));
+    c.evict(budget());
+
+    CASPAR_LOG(info) << L"[ffmpeg] Clip cache pinned " << u16(filename) << L", " << c.used / MB << L" MB used.";
+}
+
+bool remove_clip(const std::string& filename)
+{
+    auto&                       c = cache();
+    std::lock_guard<std::mutex> lock(c.mutex);
+    if (c.entries.find(filename) == c.entries.end()) {
+        return false;
+    }
+    c.erase(filename);
+    return true;
+}
+
+std::vector<CachedClip> cached_clips()
+{
+    auto&                       c = cache();
+    std::lock_guard<std::mutex> lock(c.mutex);
+
+    std::vector<CachedClip> result;
+    for (auto& filename : c.order) {
+        const auto& value = c.entries[filename];
+        CachedClip  clip;
+        clip.filename = filename;
+        clip.size     = static_cast<int64_t>(value.data->size());
+        clip.pinned   = value.pinned;
+        clip.hits     = value.hits;
+        result.push_back(std::move(clip));
+    }
+    return result;
+}
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct AVIOContext;
+
+namespace caspar { namespace ffmpeg {
+
+// Whole files kept in memory, so that stings, bumpers and other short clips played over and over don't read from
+// storage again. Files of up to configuration.ffmpeg.producer.clip-cache-max-file MB are cached when a clip opens
+// them, the least recently opened going first once configuration.ffmpeg.producer.clip-cache MB are used. Pinned files
+// stay cached whatever their size and the budget, and are played without looking at the file again.
+
+struct CachedClip
+{
+    std::string filename;
+    int64_t     size   = 0;
+    bool        pinned = false;
+    int64_t     hits   = 0; // Opens served from memory.
+};
+
+// AVIOContext reading a file from the cache.
+class CachedFile
+{
+  public:
+    // Loads filename into the cache unless it's there already. Returns nullptr if it isn't pinned and the cache is
+    // disabled, or it isn't a regular file small enough to be cached.
+    static std::shared_ptr<CachedFile> open(const std::string& filename);
+
+    explicit CachedFile(std::shared_ptr<const std::vector<std::uint8_t>> data);
+    ~CachedFile();
+
+    CachedFile(const CachedFile&)            = delete;
+    CachedFile& operator=(const CachedFile&) = delete;
+
+    AVIOContext* context() const;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+// Loads filename again and keeps it until removed. Throws if it can't be read.
+void pin_clip(const std::string& filename);
+
+// Drops filename from the cache, pinned or not, clips playing it keep their copy. Returns false if it wasn't cached.
+bool remove_clip(const std::string& filename);
+
+// The cached files, the most recently opened first.
+std::vector<CachedClip> cached_clips();
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,269 @@
+#include "av_geometry.h"
+
+#include <boost/algorithm/string.hpp>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavutil/mathematics.h>
+#include <libavutil/parseutils.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+// The options of one filter by name, positional ones by the name their position stands for.
+struct filter_args
+{
+    std::string                        name;
+    std::map<std::string, std::string> options;
+};
+
+// Aliases to the first name, in the order of the positional options.
+using option_names = std::vector<std::vector<std::string>>;
+
+std::optional<filter_args> parse_filter(const std::string& spec, const option_names& names)
+{
+    filter_args result;
+
+    const auto eq = spec.find('=');
+    result.name   = boost::trim_copy(spec.substr(0, eq));
+    if (eq == std::string::npos) {
+        return result;
+    }
+
+    std::vector<std::string> items;
+    boost::split(items, spec.substr(eq + 1), boost::is_any_of(":"));
+
+    size_t position = 0;
+    for (auto item : items) {
+        boost::trim(item);
+        const auto  item_eq = item.find('=');
+        std::string key;
+        if (item_eq == std::string::npos) {
+            if (position >= names.size()) {
+                return {};
+            }
+            key = names[position++][0];
+        } else {
+            key = item.substr(0, item_eq);
+        }
+
+        auto found = false;
+        for (auto& aliases : names) {
+            if (std::find(aliases.begin(), aliases.end(), key) != aliases.end()) {
+                key   = aliases[0];
+                found = true;
+            }
+        }
+        if (!found || result.options.count(key) > 0) {
+            return {};
+        }
+        result.options[key] = item_eq == std::string::npos ? item : item.substr(item_eq + 1);
+    }
+    return result;
+}
+
+// Constants only, expressions of the input size are left to the filters.
+std::optional<int> get_int(const filter_args& args, const std::string& key, int default_value)
+{
+    auto it = args.options.find(key);
+    if (it == args.options.end()) {
+        return default_value;
+    }
+    try {
+        size_t     end   = 0;
+        const auto value = std::stoi(it->second, &end);
+        if (end != it->second.size()) {
+            return {};
+        }
+        return value;
+    } catch (...) {
+        return {};
+    }
+}
+
+// As the scale filter evaluates it, where -n keeps the aspect ratio at a multiple of n and 0 is the input size.
+int scaled_size(int value, int other, int in, int other_in)
+{
+    if (value == 0) {
+        return in;
+    }
+    if (value > 0) {
+        return value;
+    }
+    return static_cast<int>(av_rescale(other, in, static_cast<int64_t>(other_in) * -value)) * -value;
+}
+
+// The part of the source the image shows and where it is in the frame of the last pad, both in the unit square, and
+// the size of the image in pixels.
+struct placement
+{
+    core::rectangle source;
+    core::rectangle dest;
+    int             width;
+    int             height;
+    bool            padded = false;
+};
+
+bool scale(placement& image, const filter_args& args)
+{
+    const auto w = get_int(args, "w", 0);
+    const auto h = get_int(args, "h", 0);
+    if (!w || !h || *w < -16 || *h < -16) {
+        return false;
+    }
+
+    if (*w < 0 && *h < 0) {
+        return true;
+    }
+    const auto height = *h < 0 ? 0 : scaled_size(*h, 0, image.height, 1);
+    const auto width  = *w < 0 ? 0 : scaled_size(*w, 0, image.width, 1);
+    image.width       = *w < 0 ? scaled_size(*w, height, image.width, image.height) : width;
+    image.height      = *h < 0 ? scaled_size(*h, width, image.height, image.width) : height;
+    return image.width > 0 && image.height > 0;
+}
+
+bool crop(placement& image, const filter_args& args)
+{
+    if (image.padded) {
+        return false;
+    }
+
+    const auto w = get_int(args, "w", image.width);
+    const auto h = get_int(args, "h", image.height);
+    if (!w || !h || *w <= 0 || *h <= 0 || *w > image.width || *h > image.height) {
+        return false;
+    }
+
+    const auto x = get_int(args, "x", (image.width - *w) / 2);
+    const auto y = get_int(args, "y", (image.height - *h) / 2);
+    if (!x || !y || *x < 0 || *y < 0 || *x + *w > image.width || *y + *h > image.height) {
+        return false;
+    }
+
+    auto&      source = image.source;
+    const auto sw     = source.lr[0] - source.ul[0];
+    const auto sh     = source.lr[1] - source.ul[1];
+    source.ul         = {source.ul[0] + sw * *x / image.width, source.ul[1] + sh * *y / image.height};
+    source.lr         = {source.ul[0] + sw * *w / image.width, source.ul[1] + sh * *h / image.height};
+    image.width       = *w;
+    image.height      = *h;
+    return true;
+}
+
+bool pad(placement& image, const filter_args& args, Geometry& geometry)
+{
+    if (image.padded) {
+        return false;
+    }
+
+    const auto w = get_int(args, "w", 0);
+    const auto h = get_int(args, "h", 0);
+    if (!w || !h || *w < 0 || *h < 0) {
+        return false;
+    }
+    const auto width  = *w == 0 ? image.width : *w;
+    const auto height = *h == 0 ? image.height : *h;
+    if (width < image.width || height < image.height) {
+        return false;
+    }
+
+    // Negative offsets center the image.
+    auto x = get_int(args, "x", 0);
+    auto y = get_int(args, "y", 0);
+    if (!x || !y) {
+        return false;
+    }
+    x = *x < 0 ? (width - image.width) / 2 : *x;
+    y = *y < 0 ? (height - image.height) / 2 : *y;
+    if (*x + image.width > width || *y + image.height > height) {
+        return false;
+    }
+
+    const auto color = args.options.count("color") > 0 ? args.options.at("color") : "black";
+    uint8_t    rgba[4];
+    if (av_parse_color(rgba, color.c_str(), -1, nullptr) < 0) {
+        return false;
+    }
+    if (rgba[3] > 0) {
+        const auto premultiply = [&](int n) { return static_cast<uint32_t>(rgba[n] * rgba[3] / 255); };
+        const auto alpha       = static_cast<uint32_t>(rgba[3]);
+        geometry.background    = alpha << 24 | premultiply(0) << 16 | premultiply(1) << 8 | premultiply(2);
+    }
+
+    image.dest.ul = {static_cast<double>(*x) / width, static_cast<double>(*y) / height};
+    image.dest.lr = {static_cast<double>(*x + image.width) / width, static_cast<double>(*y + image.height) / height};
+    image.width   = width;
+    image.height  = height;
+    image.padded  = true;
+    return true;
+}
+
+} // namespace
+
+std::optional<Geometry> map_geometry(const std::string& vfilter, int width, int height)
+{
+    // Labels, several chains and escapes are beyond a plain chain of filters.
+    if (vfilter.empty() || width <= 0 || height <= 0 || vfilter.find_first_of("[];'\\") != std::string::npos) {
+        return {};
+    }
+
+    static const option_names scale_names = {{"w", "width"}, {"h", "height"}, {"flags"}};
+    static const option_names crop_names  = {{"w", "out_w"}, {"h", "out_h"}, {"x"}, {"y"}};
+    static const option_names pad_names   = {{"w", "width"}, {"h", "height"}, {"x"}, {"y"}, {"color"}};
+
+    Geometry  geometry;
+    placement image;
+    image.width  = width;
+    image.height = height;
+
+    std::vector<std::string> filters;
+    boost::split(filters, vfilter, boost::is_any_of(","));
+    for (auto& spec : filters) {
+        const auto name = boost::trim_copy(spec.substr(0, spec.find('=')));
+
+        std::optional<filter_args> args;
+        if (name == "scale") {
+            args = parse_filter(spec, scale_names);
+            if (!args || !scale(image, *args)) {
+                return {};
+            }
+        } else if (name == "crop") {
+            args = parse_filter(spec, crop_names);
+            if (!args || !crop(image, *args)) {
+                return {};
+            }
+        } else if (name == "pad") {
+            args = parse_filter(spec, pad_names);
+            if (!args || !pad(image, *args, geometry)) {
+                return {};
+            }
+        } else {
+            return {};
+        }
+    }
+
+    // Each corner of the source part lands on the same corner of where it is in the frame.
+    const auto& source = image.source;
+    const auto& dest   = image.dest;
+    auto&       t      = geometry.transform;
+    for (auto n = 0; n < 2; ++n) {
+        t.fill_scale[n]       = (dest.lr[n] - dest.ul[n]) / (source.lr[n] - source.ul[n]);
+        t.fill_translation[n] = dest.ul[n] - source.ul[n] * t.fill_scale[n];
+    }
+    t.crop = source;
+    return geometry;
+}
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <core/frame/frame_transform.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace caspar { namespace ffmpeg {
+
+// Where a chain of scale, crop and pad filters puts the image in the frame, which the mixer draws on the gpu instead
+// of the filters doing it on the cpu. The mixer stretches every frame to the channel, so scaling only changes the
+// pixels that later crops and pads count in.
+struct Geometry
+{
+    core::image_transform   transform; // Only crop, fill_translation and fill_scale are set.
+    std::optional<uint32_t> background; // Premultiplied 0xAARRGGBB of the padding, none if it's transparent.
+};
+
+// The geometry of vfilter for a source of width x height, or none if vfilter isn't made of scale, crop and pad with
+// constant sizes and offsets alone, or does anything the mixer doesn't draw the same, in which case the filters run
+// as usual. A pad can only be followed by scales.
+std::optional<Geometry> map_geometry(const std::string& vfilter, int width, int height);
+
+}} // namespace caspar::ffmpeg
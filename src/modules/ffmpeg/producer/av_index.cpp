@@ -0,0 +1,238 @@
+#include "av_index.h"
+
+#include "../util/av_assert.h"
+#include "../util/av_util.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avformat.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+static const int INDEX_VERSION = 1;
+
+struct KeyframeIndex::Impl
+{
+    const std::string             filename_;
+    const boost::filesystem::path cache_path_;
+    std::string                   header_;
+
+    mutable std::mutex    mutex_;
+    std::vector<Keyframe> keyframes_;
+    bool                  ready_ = false;
+
+    std::atomic<bool> abort_{false};
+    std::thread       thread_;
+
+    explicit Impl(const std::string& filename)
+        : filename_(filename)
+        , cache_path_(boost::filesystem::path(env::data_folder()) / L"ffmpeg-index" /
+                      (std::to_wstring(std::hash<std::string>()(filename)) + L".idx"))
+    {
+        const auto path = boost::filesystem::path(u16(filename_));
+
+        std::stringstream header;
+        header << INDEX_VERSION << " " << boost::filesystem::file_size(path) << " "
+               << boost::filesystem::last_write_time(path) << " " << filename_;
+        header_ = header.str();
+
+        if (load()) {
+            return;
+        }
+
+        thread_ = std::thread([this] {
+            try {
+                set_thread_name(L"[ffmpeg::av_producer::KeyframeIndex]");
+                set_thread_affinity(thread_role::producer);
+                build();
+            } catch (...) {
+                if (!abort_) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+            }
+        });
+    }
+
+    ~Impl()
+    {
+        abort_ = true;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    static int interrupt_cb(void* ctx) { return static_cast<Impl*>(ctx)->abort_ ? 1 : 0; }
+
+    bool load()
+    {
+        boost::filesystem::ifstream file(cache_path_);
+        if (!file) {
+            return false;
+        }
+
+        std::string header;
+        if (!std::getline(file, header) || header != header_) {
+            return false;
+        }
+
+        std::vector<Keyframe> keyframes;
+        Keyframe              keyframe;
+        while (file >> keyframe.pts >> keyframe.pos) {
+            keyframes.push_back(keyframe);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        keyframes_ = std::move(keyframes);
+        ready_     = true;
+        return true;
+    }
+
+    void save(const std::vector<Keyframe>& keyframes)
+    {
+        boost::system::error_code ec;
+        boost::filesystem::create_directories(cache_path_.parent_path(), ec);
+
+        boost::filesystem::ofstream file(cache_path_);
+        if (!file) {
+            CASPAR_LOG(warning) << L"[ffmpeg] Could not write keyframe index " << cache_path_.wstring();
+            return;
+        }
+
+        file << header_ << "\n";
+        for (auto& keyframe : keyframes) {
+            file << keyframe.pts << " " << keyframe.pos << "\n";
+        }
+    }
+
+    void build()
+    {
+        AVFormatContext* ic             = avformat_alloc_context();
+        ic->interrupt_callback.callback = interrupt_cb;
+        ic->interrupt_callback.opaque   = this;
+
+        FF(avformat_open_input(&ic, filename_.c_str(), nullptr, nullptr));
+        auto ic2 = std::shared_ptr<AVFormatContext>(ic, [](AVFormatContext* ctx) { avformat_close_input(&ctx); });
+
+        FF(avformat_find_stream_info(ic, nullptr));
+
+        const auto index = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (index < 0) {
+            return;
+        }
+
+        for (auto n = 0U; n < ic->nb_streams; ++n) {
+            if (static_cast<int>(n) != index) {
+                ic->streams[n]->discard = AVDISCARD_ALL;
+            }
+        }
+
+        const auto st = ic->streams[index];
+
+        std::vector<Keyframe> keyframes;
+
+        auto packet = alloc_packet();
+        while (true) {
+            const auto ret = av_read_frame(ic, packet.get());
+            if (ret == AVERROR_EOF) {
+                break;
+            }
+            FF_RET(ret, "av_read_frame");
+
+            const auto ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+            if (packet->stream_index == index && (packet->flags & AV_PKT_FLAG_KEY) && ts != AV_NOPTS_VALUE) {
+                keyframes.push_back({av_rescale_q(ts, st->time_base, AV_TIME_BASE_Q), packet->pos});
+            }
+            av_packet_unref(packet.get());
+        }
+
+        std::sort(keyframes.begin(), keyframes.end(), [](auto& lhs, auto& rhs) { return lhs.pts < rhs.pts; });
+
+        save(keyframes);
+
+        CASPAR_LOG(debug) << L"[ffmpeg] Indexed " << keyframes.size() << L" keyframes of " << u16(filename_);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        keyframes_ = std::move(keyframes);
+        ready_     = true;
+    }
+
+    std::optional<Keyframe> find(int64_t ts) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (!ready_) {
+            return {};
+        }
+
+        auto it = std::upper_bound(
+            keyframes_.begin(), keyframes_.end(), ts, [](int64_t ts, auto& keyframe) { return ts < keyframe.pts; });
+        if (it == keyframes_.begin()) {
+            return {};
+        }
+        return *(it - 1);
+    }
+};
+
+std::shared_ptr<KeyframeIndex> KeyframeIndex::open(const std::string& filename)
+{
+    static std::mutex                                          mutex;
+    static std::map<std::string, std::weak_ptr<KeyframeIndex>> indexes;
+
+    boost::system::error_code ec;
+    const auto                path = boost::filesystem::path(u16(filename));
+    if (!boost::filesystem::is_regular_file(path, ec)) {
+        return nullptr;
+    }
+
+    std::stringstream key;
+    key << filename << ":" << boost::filesystem::last_write_time(path, ec);
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto it = indexes.begin(); it != indexes.end();) {
+        it = it->second.expired() ? indexes.erase(it) : std::next(it);
+    }
+
+    auto index = indexes[key.str()].lock();
+    if (!index) {
+        index              = std::make_shared<KeyframeIndex>(filename);
+        indexes[key.str()] = index;
+    }
+    return index;
+}
+
+KeyframeIndex::KeyframeIndex(const std::string& filename)
+    : impl_(new Impl(filename))
+{
+}
+
+KeyframeIndex::~KeyframeIndex() {}
+
+std::optional<KeyframeIndex::Keyframe> KeyframeIndex::find(int64_t ts) const { return impl_->find(ts); }
+
+}} // namespace caspar::ffmpeg
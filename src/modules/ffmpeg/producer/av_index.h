@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace caspar { namespace ffmpeg {
+
+// Positions of the video keyframes of a file, in AV_TIME_BASE units and bytes. The index is read from a cache in
+// the data folder, keyed by path, size and modification time, or else built by a background scan of the file.
+class KeyframeIndex
+{
+  public:
+    struct Keyframe
+    {
+        int64_t pts = 0;
+        int64_t pos = -1;
+    };
+
+    // Returns nullptr for anything that isn't a regular file.
+    static std::shared_ptr<KeyframeIndex> open(const std::string& filename);
+
+    explicit KeyframeIndex(const std::string& filename);
+    ~KeyframeIndex();
+
+    KeyframeIndex(const KeyframeIndex&)            = delete;
+    KeyframeIndex& operator=(const KeyframeIndex&) = delete;
+
+    // Last keyframe at or before ts. Empty until the index is complete.
+    std::optional<Keyframe> find(int64_t ts) const;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}} // namespace caspar::ffmpeg
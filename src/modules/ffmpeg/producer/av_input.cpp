@@ -1,8 +1,13 @@
 #include "av_input.h"
+#include "av_cache.h"
+#include "av_index.h"
+#include "av_io.h"
+#include "av_probe.h"
 
 #include "../util/av_assert.h"
 #include "../util/av_util.h"
 
+#include <common/env.h>
 #include <common/except.h>
 #include <common/os/thread.h>
 #include <common/param.h>
@@ -26,18 +31,34 @@ extern "C" {
 
 namespace caspar { namespace ffmpeg {
 
-Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> graph, std::optional<bool> seekable)
+Input::Input(const std::string&                  filename,
+             std::shared_ptr<diagnostics::graph> graph,
+             std::optional<bool>                 seekable,
+             std::function<void()>               notify,
+             bool                                live)
     : filename_(filename)
     , graph_(graph)
+    , notify_(std::move(notify))
     , seekable_(seekable)
+    , live_(live)
 {
     graph_->set_color("seek", diagnostics::color(1.0f, 0.5f, 0.0f));
     graph_->set_color("input", diagnostics::color(0.7f, 0.4f, 0.4f));
 
-    buffer_.set_capacity(256);
+    if (env::properties().get(L"configuration.ffmpeg.producer.keyframe-index", false)) {
+        try {
+            index_ = KeyframeIndex::open(filename_);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+
+    // Packets read ahead of a live stream are only latency.
+    buffer_.set_capacity(live_ ? 32 : 256);
     thread_ = boost::thread([=] {
         try {
             set_thread_name(L"[ffmpeg::av_producer::Input]");
+            set_thread_affinity(thread_role::producer);
 
             while (true) {
                 auto packet = alloc_packet();
@@ -65,8 +86,13 @@ Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> gr
                     }
                 }
 
+                buffer_bytes_ += packet ? packet->size : 0;
                 buffer_.push(std::move(packet));
                 graph_->set_value("input", (static_cast<double>(buffer_.size()) / buffer_.capacity()));
+
+                if (notify_) {
+                    notify_();
+                }
             }
         } catch (...) {
             CASPAR_LOG_CURRENT_EXCEPTION();
@@ -81,7 +107,7 @@ Input::~Input()
     ic_cond_.notify_all();
 
     std::shared_ptr<AVPacket> packet;
-    while (buffer_.try_pop(packet))
+    while (pop(packet))
         ;
 
     thread_.join();
@@ -95,11 +121,24 @@ int Input::interrupt_cb(void* ctx)
 
 bool Input::try_pop(std::shared_ptr<AVPacket>& packet)
 {
-    auto result = buffer_.try_pop(packet);
+    auto result = pop(packet);
     graph_->set_value("input", (static_cast<double>(buffer_.size()) / buffer_.capacity()));
     return result;
 }
 
+bool Input::pop(std::shared_ptr<AVPacket>& packet)
+{
+    if (!buffer_.try_pop(packet)) {
+        return false;
+    }
+    buffer_bytes_ -= packet ? packet->size : 0;
+    return true;
+}
+
+int64_t Input::memory_usage() const { return buffer_bytes_; }
+
+bool Input::live() const { return live_; }
+
 AVFormatContext* Input::operator->() { return ic_.get(); }
 AVFormatContext* const Input::operator->() const { return ic_.get(); }
 
@@ -109,7 +148,7 @@ void Input::abort()
     ic_cond_.notify_all();
 
     std::shared_ptr<AVPacket> packet;
-    while (buffer_.try_pop(packet))
+    while (pop(packet))
         ;
 }
 
@@ -145,12 +184,28 @@ void Input::internal_reset()
         filename_    = u8(url_parts.second);
     }
 
+    if (live_) {
+        FF(av_dict_set(&options, "fflags", "nobuffer", 0));
+        FF(av_dict_set(&options, "probesize", "500000", 0));
+        FF(av_dict_set(&options, "analyzeduration", "500000", 0)); // 0.5 seconds
+    }
+
     if (seekable_) {
         CASPAR_LOG(debug) << "av_input[" + filename_ + "] Disabled seeking";
         FF(av_dict_set(&options, "seekable", *seekable_ ? "1" : "0", 0));
     }
 
+    // Files in the clip cache are read from memory, others may be read ahead.
+    std::shared_ptr<CachedFile> cached;
+    std::shared_ptr<ReadAhead>  io;
     if (input_format == nullptr) {
+        cached = CachedFile::open(filename_);
+    }
+    if (input_format == nullptr && !cached) {
+        io = ReadAhead::open(filename_, [this] { return abort_request_.load(); });
+    }
+
+    if (input_format == nullptr && !io && !cached) {
         // TODO (fix) timeout?
         FF(av_dict_set(&options, "rw_timeout", "60000000", 0)); // 60 second IO timeout
     }
@@ -158,35 +213,62 @@ void Input::internal_reset()
     AVFormatContext* ic             = avformat_alloc_context();
     ic->interrupt_callback.callback = Input::interrupt_cb;
     ic->interrupt_callback.opaque   = this;
+    if (cached || io) {
+        ic->pb = cached ? cached->context() : io->context();
+        ic->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
 
     FF(avformat_open_input(&ic, filename_.c_str(), input_format, &options));
-    auto ic2 = std::shared_ptr<AVFormatContext>(ic, [](AVFormatContext* ctx) { avformat_close_input(&ctx); });
+    // The deleter keeps the io context alive until the demuxer is closed.
+    auto ic2 = std::shared_ptr<AVFormatContext>(ic, [cached, io](AVFormatContext* ctx) { avformat_close_input(&ctx); });
 
     for (auto& p : to_map(&options)) {
         CASPAR_LOG(warning) << "av_input[" + filename_ + "]"
                             << " Unused option " << p.first << "=" << p.second;
     }
 
-    FF(avformat_find_stream_info(ic2.get(), nullptr));
+    // Files loaded before skip the probe, which reads and decodes the start of each stream.
+    if (!restore_stream_info(filename_, ic2.get())) {
+        FF(avformat_find_stream_info(ic2.get(), nullptr));
+        store_stream_info(filename_, ic2.get());
+    }
     ic_ = std::move(ic2);
     ic_cond_.notify_all();
 }
 
 bool Input::eof() const { return eof_; }
 
+std::optional<int64_t> Input::keyframe(int64_t ts) const
+{
+    auto keyframe = index_ ? index_->find(ts) : std::optional<KeyframeIndex::Keyframe>();
+    return keyframe ? keyframe->pts : std::optional<int64_t>();
+}
+
 void Input::seek(int64_t ts, bool flush)
 {
     std::unique_lock<std::mutex> lock(ic_mutex_);
 
     if (ic_ && ts != ic_->start_time && ts != AV_NOPTS_VALUE) {
-        FF(avformat_seek_file(ic_.get(), -1, INT64_MIN, ts, ts, 0));
+        // Straight to the keyframe the decoders have to start from. Demuxers with discontinuous timestamps seek
+        // by bisecting the file otherwise, so they get a byte seek.
+        auto keyframe = index_ ? index_->find(ts) : std::optional<KeyframeIndex::Keyframe>();
+        auto ret      = -1;
+        if (keyframe && keyframe->pos >= 0 && (ic_->iformat->flags & AVFMT_TS_DISCONT) &&
+            !(ic_->iformat->flags & AVFMT_NO_BYTE_SEEK)) {
+            ret = avformat_seek_file(ic_.get(), -1, keyframe->pos, keyframe->pos, keyframe->pos, AVSEEK_FLAG_BYTE);
+        } else if (keyframe) {
+            ret = avformat_seek_file(ic_.get(), -1, keyframe->pts, keyframe->pts, keyframe->pts, 0);
+        }
+        if (ret < 0) {
+            FF(avformat_seek_file(ic_.get(), -1, INT64_MIN, ts, ts, 0));
+        }
     } else {
         internal_reset();
     }
 
     if (flush) {
         std::shared_ptr<AVPacket> packet;
-        while (buffer_.try_pop(packet))
+        while (pop(packet))
             ;
     }
     eof_ = false;
@@ -21,16 +21,29 @@ struct AVFormatContext;
 
 namespace caspar { namespace ffmpeg {
 
+class KeyframeIndex;
+
 class Input
 {
   public:
-    Input(const std::string& filename, std::shared_ptr<diagnostics::graph> graph, std::optional<bool> seekable);
+    // notify is called from the input thread whenever a packet becomes available. A live input probes briefly and
+    // reads without buffering in the demuxer, so that a stream starts quickly and is played close to its source.
+    Input(const std::string&                  filename,
+          std::shared_ptr<diagnostics::graph> graph,
+          std::optional<bool>                 seekable,
+          std::function<void()>               notify = nullptr,
+          bool                                live   = false);
     ~Input();
 
     static int interrupt_cb(void* ctx);
 
     bool try_pop(std::shared_ptr<AVPacket>& packet);
 
+    // Bytes of the packets read ahead.
+    int64_t memory_usage() const;
+
+    bool live() const;
+
     AVFormatContext* operator->();
 
     AVFormatContext* const operator->() const;
@@ -40,19 +53,27 @@ class Input
     bool eof() const;
     void seek(int64_t ts, bool flush = true);
 
+    // Last indexed keyframe at or before ts, where the decoders start after seeking to ts. Empty without an index.
+    std::optional<int64_t> keyframe(int64_t ts) const;
+
   private:
     void internal_reset();
+    bool pop(std::shared_ptr<AVPacket>& packet);
 
     std::optional<bool> seekable_;
+    const bool          live_;
 
     std::string                         filename_;
     std::shared_ptr<diagnostics::graph> graph_;
+    std::function<void()>               notify_;
+    std::shared_ptr<KeyframeIndex>      index_;
 
     mutable std::mutex               ic_mutex_;
     std::shared_ptr<AVFormatContext> ic_;
     std::condition_variable          ic_cond_;
 
     tbb::concurrent_bounded_queue<std::shared_ptr<AVPacket>> buffer_;
+    std::atomic<int64_t>                                     buffer_bytes_{0};
 
     std::atomic<bool> eof_{false};
 
@@ -0,0 +1,323 @@
+#include "av_io.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#endif
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avio.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+static const int64_t BLOCK_SIZE     = 1024 * 1024;
+static const int     IO_BUFFER_SIZE = 64 * 1024;
+
+static std::FILE* open_file(const std::string& filename)
+{
+#ifdef _WIN32
+    return _wfopen(u16(filename).c_str(), L"rb");
+#else
+    return std::fopen(filename.c_str(), "rb");
+#endif
+}
+
+static bool read_file(std::FILE* file, int64_t offset, std::vector<std::uint8_t>& data)
+{
+#ifdef _WIN32
+    if (_fseeki64(file, offset, SEEK_SET) != 0) {
+        return false;
+    }
+#else
+    if (fseeko(file, offset, SEEK_SET) != 0) {
+        return false;
+    }
+#endif
+    return std::fread(data.data(), 1, data.size(), file) == data.size();
+}
+
+// Page cache hints, the fetch threads read each block once and the reader never goes back far.
+static void advise(std::FILE* file, int64_t offset, int64_t size, int advice)
+{
+#ifndef _WIN32
+    posix_fadvise(fileno(file), offset, size, advice);
+#endif
+}
+
+struct ReadAhead::Impl
+{
+    struct Block
+    {
+        std::vector<std::uint8_t> data;
+        bool                      ready  = false;
+        bool                      failed = false;
+    };
+
+    const std::string           filename_;
+    const int64_t               size_;
+    const int64_t               window_;
+    const std::function<bool()> interrupted_;
+
+    std::mutex                                mutex_;
+    std::condition_variable                   fetch_cond_;
+    std::condition_variable                   ready_cond_;
+    std::map<int64_t, std::shared_ptr<Block>> blocks_;
+    int64_t                                   pos_   = 0;
+    bool                                      abort_ = false;
+
+    std::FILE*               advice_file_ = nullptr;
+    std::vector<std::thread> threads_;
+    AVIOContext*             avio_ = nullptr;
+
+    Impl(const std::string& filename, int64_t window, int threads, std::function<bool()> interrupted)
+        : filename_(filename)
+        , size_(static_cast<int64_t>(boost::filesystem::file_size(u16(filename))))
+        , window_(std::max<int64_t>(1, window / BLOCK_SIZE))
+        , interrupted_(std::move(interrupted))
+        , advice_file_(open_file(filename))
+    {
+        if (!advice_file_) {
+            CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(u16(filename)));
+        }
+#ifndef _WIN32
+        advise(advice_file_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+        auto buffer = static_cast<unsigned char*>(av_malloc(IO_BUFFER_SIZE));
+        avio_       = avio_alloc_context(buffer, IO_BUFFER_SIZE, 0, this, read_packet, nullptr, seek);
+        if (!avio_) {
+            av_free(buffer);
+            std::fclose(advice_file_);
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"avio_alloc_context failed"));
+        }
+
+        for (int n = 0; n < threads; ++n) {
+            threads_.emplace_back([this] { fetch(); });
+        }
+    }
+
+    ~Impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_ = true;
+        }
+        fetch_cond_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+
+        av_freep(&avio_->buffer);
+        avio_context_free(&avio_);
+        std::fclose(advice_file_);
+    }
+
+    int64_t block_count() const { return (size_ + BLOCK_SIZE - 1) / BLOCK_SIZE; }
+
+    // First block of the window that isn't fetched or being fetched, -1 if there is none.
+    int64_t next_missing() const
+    {
+        const auto first = pos_ / BLOCK_SIZE;
+        const auto last  = std::min(first + window_, block_count());
+        for (auto index = first; index < last; ++index) {
+            if (blocks_.find(index) == blocks_.end()) {
+                return index;
+            }
+        }
+        return -1;
+    }
+
+    void fetch()
+    {
+        set_thread_name(L"[ffmpeg::av_producer::ReadAhead]");
+        set_thread_affinity(thread_role::producer);
+
+        auto file = open_file(filename_);
+        if (!file) {
+            CASPAR_LOG(warning) << L"[ffmpeg] Could not open " << u16(filename_) << L" for read ahead.";
+            return;
+        }
+
+        while (true) {
+            std::shared_ptr<Block> block;
+            int64_t                index = -1;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                fetch_cond_.wait(lock, [&] { return abort_ || next_missing() >= 0; });
+                if (abort_) {
+                    break;
+                }
+
+                index          = next_missing();
+                block          = std::make_shared<Block>();
+                blocks_[index] = block;
+            }
+
+            const auto offset = index * BLOCK_SIZE;
+            block->data.resize(static_cast<size_t>(std::min(BLOCK_SIZE, size_ - offset)));
+            const auto ok = read_file(file, offset, block->data);
+#ifndef _WIN32
+            advise(file, offset + window_ * BLOCK_SIZE, BLOCK_SIZE, POSIX_FADV_WILLNEED);
+#endif
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                block->ready  = ok;
+                block->failed = !ok;
+            }
+            ready_cond_.notify_all();
+        }
+
+        std::fclose(file);
+    }
+
+    // Drops blocks outside the window, keeping the one before the read position for short seeks back.
+    void evict()
+    {
+        const auto first = pos_ / BLOCK_SIZE;
+        for (auto it = blocks_.begin(); it != blocks_.end();) {
+            if (it->first < first - 1 || it->first >= first + window_) {
+#ifndef _WIN32
+                advise(advice_file_, it->first * BLOCK_SIZE, BLOCK_SIZE, POSIX_FADV_DONTNEED);
+#endif
+                it = blocks_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    int read(std::uint8_t* buf, int size)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if (pos_ >= size_) {
+            return AVERROR_EOF;
+        }
+
+        const auto index = pos_ / BLOCK_SIZE;
+        fetch_cond_.notify_all();
+
+        std::shared_ptr<Block> block;
+        while (!ready_cond_.wait_for(lock, std::chrono::milliseconds(100), [&] {
+            auto it = blocks_.find(index);
+            block   = it != blocks_.end() && (it->second->ready || it->second->failed) ? it->second : nullptr;
+            return block != nullptr;
+        })) {
+            if (interrupted_ && interrupted_()) {
+                return AVERROR_EXIT;
+            }
+        }
+
+        if (block->failed) {
+            // Fetched again on the next read.
+            blocks_.erase(index);
+            return AVERROR(EIO);
+        }
+
+        const auto offset = pos_ - index * BLOCK_SIZE;
+        const auto count  = static_cast<int>(std::min<int64_t>(size, block->data.size() - offset));
+        std::copy_n(block->data.data() + offset, count, buf);
+        pos_ += count;
+
+        evict();
+        fetch_cond_.notify_all();
+
+        return count;
+    }
+
+    int64_t seek(int64_t offset, int whence)
+    {
+        if (whence == AVSEEK_SIZE) {
+            return size_;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        switch (whence & ~AVSEEK_FORCE) {
+            case SEEK_SET:
+                break;
+            case SEEK_CUR:
+                offset += pos_;
+                break;
+            case SEEK_END:
+                offset += size_;
+                break;
+            default:
+                return AVERROR(EINVAL);
+        }
+
+        if (offset < 0) {
+            return AVERROR(EINVAL);
+        }
+
+        pos_ = offset;
+        evict();
+        fetch_cond_.notify_all();
+
+        return pos_;
+    }
+
+    static int read_packet(void* opaque, std::uint8_t* buf, int size)
+    {
+        return static_cast<Impl*>(opaque)->read(buf, size);
+    }
+
+    static int64_t seek(void* opaque, int64_t offset, int whence)
+    {
+        return static_cast<Impl*>(opaque)->seek(offset, whence);
+    }
+};
+
+std::shared_ptr<ReadAhead> ReadAhead::open(const std::string& filename, std::function<bool()> interrupted)
+{
+    const auto window  = env::properties().get(L"configuration.ffmpeg.producer.read-ahead", 0) * BLOCK_SIZE;
+    const auto threads = env::properties().get(L"configuration.ffmpeg.producer.read-ahead-threads", 2);
+    if (window <= 0 || threads <= 0) {
+        return nullptr;
+    }
+
+    boost::system::error_code ec;
+    if (!boost::filesystem::is_regular_file(u16(filename), ec)) {
+        return nullptr;
+    }
+
+    return std::make_shared<ReadAhead>(filename, window, threads, std::move(interrupted));
+}
+
+ReadAhead::ReadAhead(const std::string& filename, int64_t window, int threads, std::function<bool()> interrupted)
+    : impl_(new Impl(filename, window, threads, std::move(interrupted)))
+{
+}
+
+ReadAhead::~ReadAhead() {}
+
+AVIOContext* ReadAhead::context() const { return impl_->avio_; }
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+struct AVIOContext;
+
+namespace caspar { namespace ffmpeg {
+
+// AVIOContext reading a file through a window of blocks that a few threads fetch ahead of the read position in
+// parallel, so that a single slow read from network storage doesn't stall demuxing.
+class ReadAhead
+{
+  public:
+    // Returns nullptr if read ahead is disabled or filename isn't a regular file. interrupted aborts blocked reads.
+    static std::shared_ptr<ReadAhead> open(const std::string& filename, std::function<bool()> interrupted);
+
+    ReadAhead(const std::string& filename, int64_t window, int threads, std::function<bool()> interrupted);
+    ~ReadAhead();
+
+    ReadAhead(const ReadAhead&)            = delete;
+    ReadAhead& operator=(const ReadAhead&) = delete;
+
+    AVIOContext* context() const;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,364 @@
+#include "av_probe.h"
+
+#include <common/env.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/mem.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+const int    PROBE_VERSION  = 1;
+const size_t MEMORY_ENTRIES = 512;
+
+struct stream_info
+{
+    std::shared_ptr<AVCodecParameters> codecpar;
+    AVRational                         time_base           = {0, 1};
+    AVRational                         r_frame_rate        = {0, 1};
+    AVRational                         avg_frame_rate      = {0, 1};
+    AVRational                         sample_aspect_ratio = {0, 1};
+    int64_t                            start_time          = AV_NOPTS_VALUE;
+    int64_t                            duration            = AV_NOPTS_VALUE;
+    int64_t                            nb_frames           = 0;
+    int                                disposition         = 0;
+};
+
+struct format_info
+{
+    std::string              format;
+    int64_t                  start_time = AV_NOPTS_VALUE;
+    int64_t                  duration   = AV_NOPTS_VALUE;
+    int64_t                  bit_rate   = 0;
+    std::vector<stream_info> streams;
+};
+
+std::shared_ptr<AVCodecParameters> alloc_codecpar()
+{
+    return std::shared_ptr<AVCodecParameters>(avcodec_parameters_alloc(),
+                                              [](AVCodecParameters* ptr) { avcodec_parameters_free(&ptr); });
+}
+
+// none, memory or disk.
+std::wstring cache_mode() { return env::properties().get(L"configuration.ffmpeg.producer.probe-cache", L"memory"); }
+
+bool cache_enabled() { return cache_mode() != L"none"; }
+
+bool disk_cache() { return cache_mode() == L"disk"; }
+
+// Version, size, modification time and path, which is also the first line of the file on disk.
+std::string cache_key(const std::string& filename)
+{
+    boost::system::error_code ec;
+    const auto                path = boost::filesystem::path(u16(filename));
+    if (!boost::filesystem::is_regular_file(path, ec)) {
+        return {};
+    }
+
+    const auto size  = boost::filesystem::file_size(path, ec);
+    const auto mtime = boost::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return {};
+    }
+
+    std::stringstream key;
+    key << PROBE_VERSION << " " << size << " " << mtime << " " << filename;
+    return key.str();
+}
+
+boost::filesystem::path cache_path(const std::string& filename)
+{
+    return boost::filesystem::path(env::data_folder()) / L"ffmpeg-probe" /
+           (std::to_wstring(std::hash<std::string>()(filename)) + L".txt");
+}
+
+std::ostream& operator<<(std::ostream& out, const AVRational& value) { return out << value.num << " " << value.den; }
+
+std::istream& operator>>(std::istream& in, AVRational& value) { return in >> value.num >> value.den; }
+
+// Enums are read through an int.
+template <typename T>
+void read_enum(std::istream& in, T& value)
+{
+    int n = 0;
+    in >> n;
+    value = static_cast<T>(n);
+}
+
+void write_stream(std::ostream& out, const stream_info& info)
+{
+    const auto& par = *info.codecpar;
+    out << par.codec_type << " " << par.codec_id << " " << par.codec_tag << " " << par.format << " " << par.bit_rate
+        << " " << par.bits_per_coded_sample << " " << par.bits_per_raw_sample << " " << par.profile << " " << par.level
+        << " " << par.width << " " << par.height << " " << par.sample_aspect_ratio << " " << par.field_order << " "
+        << par.color_range << " " << par.color_primaries << " " << par.color_trc << " " << par.color_space << " "
+        << par.chroma_location << " " << par.video_delay << " " << par.channel_layout << " " << par.channels << " "
+        << par.sample_rate << " " << par.block_align << " " << par.frame_size << " " << par.initial_padding << " "
+        << par.trailing_padding << " " << par.seek_preroll << " " << info.time_base << " " << info.r_frame_rate << " "
+        << info.avg_frame_rate << " " << info.sample_aspect_ratio << " " << info.start_time << " " << info.duration
+        << " " << info.nb_frames << " " << info.disposition << " " << par.extradata_size << " ";
+
+    char hex[3];
+    for (int n = 0; n < par.extradata_size; ++n) {
+        std::snprintf(hex, sizeof(hex), "%02x", par.extradata[n]);
+        out << hex;
+    }
+    out << "\n";
+}
+
+bool read_stream(std::istream& in, stream_info& info)
+{
+    info.codecpar = alloc_codecpar();
+
+    auto& par = *info.codecpar;
+    read_enum(in, par.codec_type);
+    read_enum(in, par.codec_id);
+    in >> par.codec_tag >> par.format >> par.bit_rate >> par.bits_per_coded_sample >> par.bits_per_raw_sample >>
+        par.profile >> par.level >> par.width >> par.height >> par.sample_aspect_ratio;
+    read_enum(in, par.field_order);
+    read_enum(in, par.color_range);
+    read_enum(in, par.color_primaries);
+    read_enum(in, par.color_trc);
+    read_enum(in, par.color_space);
+    read_enum(in, par.chroma_location);
+    in >> par.video_delay >> par.channel_layout >> par.channels >> par.sample_rate >> par.block_align >>
+        par.frame_size >> par.initial_padding >> par.trailing_padding >> par.seek_preroll >> info.time_base >>
+        info.r_frame_rate >> info.avg_frame_rate >> info.sample_aspect_ratio >> info.start_time >> info.duration >>
+        info.nb_frames >> info.disposition;
+
+    int size = 0;
+    if (!(in >> size) || size < 0 || size > 64 * 1024 * 1024) {
+        return false;
+    }
+
+    std::string hex;
+    if (size > 0 && (!(in >> hex) || hex.size() != static_cast<size_t>(size) * 2)) {
+        return false;
+    }
+
+    if (size > 0) {
+        par.extradata = static_cast<uint8_t*>(av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE));
+        if (!par.extradata) {
+            return false;
+        }
+        par.extradata_size = size;
+        for (int n = 0; n < size; ++n) {
+            par.extradata[n] = static_cast<uint8_t>(std::stoi(hex.substr(n * 2, 2), nullptr, 16));
+        }
+    }
+
+    return static_cast<bool>(in);
+}
+
+std::shared_ptr<const format_info> load(const std::string& filename, const std::string& key)
+{
+    try {
+        boost::filesystem::ifstream file(cache_path(filename));
+        if (!file) {
+            return nullptr;
+        }
+
+        std::string header;
+        if (!std::getline(file, header) || header != key) {
+            return nullptr;
+        }
+
+        auto   info  = std::make_shared<format_info>();
+        size_t count = 0;
+        if (!(file >> info->format >> info->start_time >> info->duration >> info->bit_rate >> count)) {
+            return nullptr;
+        }
+
+        info->streams.resize(count);
+        for (auto& stream : info->streams) {
+            if (!read_stream(file, stream)) {
+                return nullptr;
+            }
+        }
+        return info;
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void save(const std::string& filename, const std::string& key, const format_info& info)
+{
+    const auto path = cache_path(filename);
+
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(path.parent_path(), ec);
+
+    boost::filesystem::ofstream file(path);
+    if (!file) {
+        CASPAR_LOG(warning) << L"[ffmpeg] Could not write probe cache " << path.wstring();
+        return;
+    }
+
+    file << key << "\n";
+    file << info.format << " " << info.start_time << " " << info.duration << " " << info.bit_rate << " "
+         << info.streams.size() << "\n";
+    for (auto& stream : info.streams) {
+        write_stream(file, stream);
+    }
+}
+
+// The most recently stored entries, the oldest going first.
+struct memory_cache
+{
+    std::mutex                                                 mutex;
+    std::map<std::string, std::shared_ptr<const format_info>> entries;
+    std::deque<std::string>                                    order;
+
+    std::shared_ptr<const format_info> find(const std::string& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto                        it = entries.find(key);
+        return it != entries.end() ? it->second : nullptr;
+    }
+
+    void insert(const std::string& key, std::shared_ptr<const format_info> info)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (entries.find(key) == entries.end()) {
+            order.push_back(key);
+        }
+        entries[key] = std::move(info);
+
+        while (order.size() > MEMORY_ENTRIES) {
+            entries.erase(order.front());
+            order.pop_front();
+        }
+    }
+};
+
+memory_cache& cache()
+{
+    static memory_cache instance;
+    return instance;
+}
+
+} // namespace
+
+bool restore_stream_info(const std::string& filename, AVFormatContext* ic)
+{
+    if (!ic || !cache_enabled()) {
+        return false;
+    }
+
+    const auto key = cache_key(filename);
+    if (key.empty()) {
+        return false;
+    }
+
+    auto info = cache().find(key);
+    if (!info && disk_cache()) {
+        info = load(filename, key);
+        if (info) {
+            cache().insert(key, info);
+        }
+    }
+    if (!info) {
+        return false;
+    }
+
+    // Formats that only find their streams while probing, or find them differently, are probed as usual.
+    if (info->format != ic->iformat->name || info->streams.size() != ic->nb_streams) {
+        return false;
+    }
+    for (auto n = 0U; n < ic->nb_streams; ++n) {
+        const auto par = ic->streams[n]->codecpar;
+        if (par->codec_type != info->streams[n].codecpar->codec_type ||
+            par->codec_id != info->streams[n].codecpar->codec_id) {
+            return false;
+        }
+    }
+
+    for (auto n = 0U; n < ic->nb_streams; ++n) {
+        const auto  st     = ic->streams[n];
+        const auto& stream = info->streams[n];
+        if (avcodec_parameters_copy(st->codecpar, stream.codecpar.get()) < 0) {
+            return false;
+        }
+        st->time_base           = stream.time_base;
+        st->r_frame_rate        = stream.r_frame_rate;
+        st->avg_frame_rate      = stream.avg_frame_rate;
+        st->sample_aspect_ratio = stream.sample_aspect_ratio;
+        st->start_time          = stream.start_time;
+        st->duration            = stream.duration;
+        st->nb_frames           = stream.nb_frames;
+        st->disposition         = stream.disposition;
+    }
+    ic->start_time = info->start_time;
+    ic->duration   = info->duration;
+    ic->bit_rate   = info->bit_rate;
+
+    return true;
+}
+
+void store_stream_info(const std::string& filename, const AVFormatContext* ic)
+{
+    if (!ic || !cache_enabled()) {
+        return;
+    }
+
+    const auto key = cache_key(filename);
+    if (key.empty()) {
+        return;
+    }
+
+    auto info        = std::make_shared<format_info>();
+    info->format     = ic->iformat->name;
+    info->start_time = ic->start_time;
+    info->duration   = ic->duration;
+    info->bit_rate   = ic->bit_rate;
+
+    for (auto n = 0U; n < ic->nb_streams; ++n) {
+        const auto  st = ic->streams[n];
+        stream_info stream;
+        stream.codecpar = alloc_codecpar();
+        if (avcodec_parameters_copy(stream.codecpar.get(), st->codecpar) < 0) {
+            return;
+        }
+        stream.time_base           = st->time_base;
+        stream.r_frame_rate        = st->r_frame_rate;
+        stream.avg_frame_rate      = st->avg_frame_rate;
+        stream.sample_aspect_ratio = st->sample_aspect_ratio;
+        stream.start_time          = st->start_time;
+        stream.duration            = st->duration;
+        stream.nb_frames           = st->nb_frames;
+        stream.disposition         = st->disposition;
+        info->streams.push_back(std::move(stream));
+    }
+
+    if (disk_cache()) {
+        save(filename, key, *info);
+    }
+    cache().insert(key, std::move(info));
+}
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+struct AVFormatContext;
+
+namespace caspar { namespace ffmpeg {
+
+// What avformat_find_stream_info found for a file, kept in memory and, with configuration.ffmpeg.producer.probe-cache
+// set to disk, in the data folder. Entries are keyed by path, size and modification time, so that loading a file
+// again doesn't probe it again.
+
+// Fills in the streams of a freshly opened ic from the cache. Returns false, leaving ic as it was, for anything that
+// isn't a regular file, when nothing is cached, or when the demuxer opened other streams than were cached.
+bool restore_stream_info(const std::string& filename, AVFormatContext* ic);
+
+// Caches the streams of ic after avformat_find_stream_info.
+void store_stream_info(const std::string& filename, const AVFormatContext* ic);
+
+}} // namespace caspar::ffmpeg
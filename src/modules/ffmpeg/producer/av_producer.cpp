@@ -1,9 +1,11 @@
 #include "av_producer.h"
 
+#include "av_geometry.h"
 #include "av_input.h"
 
 #include "../util/av_assert.h"
 #include "../util/av_util.h"
+#include "../util/hap.h"
 
 #include <boost/exception/exception.hpp>
 #include <boost/format.hpp>
@@ -14,17 +16,24 @@
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 
+#include <tbb/parallel_invoke.h>
+#include <tbb/task_arena.h>
+
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/metrics.h>
 #include <common/env.h>
 #include <common/except.h>
-#include <common/executor.h>
 #include <common/os/thread.h>
 #include <common/scope_exit.h>
 #include <common/timer.h>
+#include <common/utf.h>
 
+#include <core/diagnostics/call_context.h>
 #include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
 #include <core/frame/frame_factory.h>
 #include <core/monitor/monitor.h>
+#include <core/producer/color/color_producer.h>
 
 #ifdef _MSC_VER
 #pragma warning(push)
@@ -39,6 +48,8 @@ extern "C" {
 #include <libavutil/avutil.h>
 #include <libavutil/channel_layout.h>
 #include <libavutil/error.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/imgutils.h>
 #include <libavutil/opt.h>
 #include <libavutil/pixfmt.h>
 #include <libavutil/samplefmt.h>
@@ -48,14 +59,20 @@ extern "C" {
 #endif
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <atomic>
 #include <deque>
+#include <functional>
 #include <iomanip>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <vector>
 
 namespace caspar { namespace ffmpeg {
 
@@ -70,11 +87,203 @@ struct Frame
     int64_t                  pts         = AV_NOPTS_VALUE;
     int64_t                  duration    = 0;
     int64_t                  frame_count = 0;
+    int64_t                  size        = 0;
+    std::shared_ptr<void>    budget;
+};
+
+// Decoded frames held by all producers, bounded by configuration.ffmpeg.producer.buffer-budget. Buffers only grow
+// past their minimum while there is budget left.
+class FrameBudget
+{
+    static std::atomic<int64_t>& used_bytes()
+    {
+        static std::atomic<int64_t> used{0};
+        return used;
+    }
+
+  public:
+    static int64_t used() { return used_bytes(); }
+
+    static int64_t limit()
+    {
+        static const int64_t limit =
+            env::properties().get(L"configuration.ffmpeg.producer.buffer-budget", 2048) * 1024LL * 1024LL;
+        return limit;
+    }
+
+    // Counts size against the budget until the returned token and all its copies are gone.
+    static std::shared_ptr<void> acquire(int64_t size)
+    {
+        used_bytes() += size;
+        return std::shared_ptr<void>(nullptr, [size](void*) { used_bytes() -= size; });
+    }
+
+    static int64_t size(const std::shared_ptr<AVFrame>& video, const std::shared_ptr<AVFrame>& audio)
+    {
+        int64_t size = 0;
+        if (video && video->data[0]) {
+            size += std::max(
+                0, av_image_get_buffer_size(static_cast<AVPixelFormat>(video->format), video->width, video->height, 1));
+        }
+        if (audio && audio->data[0]) {
+            size += std::max(0,
+                             av_samples_get_buffer_size(nullptr,
+                                                        audio->channels,
+                                                        audio->nb_samples,
+                                                        static_cast<AVSampleFormat>(audio->format),
+                                                        1));
+        }
+        return size;
+    }
 };
 
+// Wakes the producer thread when one of the stages it feeds from made progress, so that it can sleep instead of
+// polling them.
+class Wakeup
+{
+    boost::mutex              mutex_;
+    boost::condition_variable cond_;
+    bool                      pending_ = false;
+
+  public:
+    void notify()
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            pending_ = true;
+        }
+        cond_.notify_all();
+    }
+
+    // Returns false if nothing happened within timeout.
+    bool wait_for(boost::chrono::milliseconds timeout)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        const auto                       result = cond_.wait_for(lock, timeout, [&] { return pending_; });
+        pending_                                = false;
+        return result;
+    }
+};
+
+// Decoding and filtering of all producers runs as tasks in this arena rather than on threads of their own.
+static tbb::task_arena& producer_arena()
+{
+    static tbb::task_arena arena([] {
+        const auto threads = env::properties().get(L"configuration.ffmpeg.producer.pool-threads", 0);
+        return threads > 0 ? threads : static_cast<int>(tbb::task_arena::automatic);
+    }());
+    return arena;
+}
+
+// Video decoders currently open, which share the cores with each other and with the channels.
+static std::atomic<int>& video_decoder_count()
+{
+    static std::atomic<int> count{0};
+    return count;
+}
+
+struct Threading
+{
+    int type  = 0;
+    int count = 1;
+};
+
+// Intra codecs decode frames independently, so frame threading scales with the thread count at the cost of a frame
+// of latency per thread. Long GOP codecs get few slice threads, more only pay off at higher resolutions. Either way
+// the cores are split between the open decoders. configuration.ffmpeg.producer.threads fixes the count for all
+// codecs, configuration.ffmpeg.producer.codecs.<codec>.threads and .thread-type override both for one codec.
+static Threading choose_threading(const AVCodec* codec, const AVCodecContext* ctx)
+{
+    Threading threading;
+
+    const auto desc         = avcodec_descriptor_get(codec->id);
+    const auto intra_only   = desc && (desc->props & AV_CODEC_PROP_INTRA_ONLY);
+    const auto frame_thread = (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) != 0;
+    const auto slice_thread = (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) != 0;
+
+    if (ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        const auto cores  = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        const auto share  = std::max(1, cores / std::max(1, video_decoder_count().load() + 1));
+        const auto pixels = static_cast<int64_t>(ctx->width) * ctx->height;
+
+        if (intra_only && (frame_thread || slice_thread)) {
+            threading.type  = frame_thread ? FF_THREAD_FRAME : FF_THREAD_SLICE;
+            threading.count = std::min(share, 16);
+        } else if (slice_thread || frame_thread) {
+            threading.type  = slice_thread ? FF_THREAD_SLICE : FF_THREAD_FRAME;
+            threading.count = std::min(share, pixels <= 720 * 576 ? 2 : pixels <= 1920 * 1080 ? 4 : 8);
+        }
+    }
+
+    const auto threads = env::properties().get(L"configuration.ffmpeg.producer.threads", 0);
+    if (threads > 0) {
+        threading.count = threads;
+    }
+
+    const auto codec_path = L"configuration.ffmpeg.producer.codecs." + u16(codec->name);
+
+    threading.count = std::max(1, env::properties().get(codec_path + L".threads", threading.count));
+
+    const auto type = env::properties().get<std::wstring>(codec_path + L".thread-type", L"");
+    if (type == L"frame" && frame_thread) {
+        threading.type = FF_THREAD_FRAME;
+    } else if (type == L"slice" && slice_thread) {
+        threading.type = FF_THREAD_SLICE;
+    }
+
+    if (threading.count > 1 && threading.type == 0) {
+        threading.type = slice_thread ? FF_THREAD_SLICE : frame_thread ? FF_THREAD_FRAME : 0;
+    }
+
+    return threading;
+}
+
 // TODO (fix) Handle ts discontinuities.
 // TODO (feat) Forward options.
 
+// The context a decoder of the stream starts from before its codec is opened, which is all the sources of a filter
+// graph are built from. With textures it describes the frames of a Hap stream's block compressed textures instead.
+std::shared_ptr<AVCodecContext> describe_stream(const AVCodec* codec, AVStream* stream, bool textures)
+{
+    auto ctx = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
+                                               [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
+
+    if (!ctx) {
+        FF_RET(AVERROR(ENOMEM), "avcodec_alloc_context3");
+    }
+
+    FF(avcodec_parameters_to_context(ctx.get(), stream->codecpar));
+
+    ctx->pkt_timebase = stream->time_base;
+
+    if (ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        ctx->framerate           = av_guess_frame_rate(nullptr, stream, nullptr);
+        ctx->sample_aspect_ratio = av_guess_sample_aspect_ratio(nullptr, stream, nullptr);
+    } else if (ctx->codec_type == AVMEDIA_TYPE_AUDIO) {
+        if (!ctx->channel_layout && ctx->channels) {
+            ctx->channel_layout = av_get_default_channel_layout(ctx->channels);
+        }
+        if (!ctx->channels && ctx->channel_layout) {
+            ctx->channels = av_get_channel_layout_nb_channels(ctx->channel_layout);
+        }
+    }
+
+    if (textures) {
+        const auto texture_desc = hap_texture_desc(*stream->codecpar);
+        if (texture_desc.format == core::pixel_format::invalid) {
+            CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EINVAL)
+                                                    << msg_info_t("stream has no hap textures"));
+        }
+
+        const auto& plane = texture_desc.planes.at(0);
+        ctx->pix_fmt      = AV_PIX_FMT_GRAY8;
+        ctx->width        = plane.linesize;
+        ctx->height       = plane.size / plane.linesize;
+    }
+
+    return ctx;
+}
+
 class Decoder
 {
     Decoder(const Decoder&)            = delete;
@@ -86,139 +295,358 @@ class Decoder
 
     std::queue<std::shared_ptr<AVPacket>> input;
     mutable boost::mutex                  input_mutex;
-    boost::condition_variable             input_cond;
     int                                   input_capacity = 2;
 
     std::queue<std::shared_ptr<AVFrame>> output;
     mutable boost::mutex                 output_mutex;
-    boost::condition_variable            output_cond;
     int                                  output_capacity = 8;
 
-    boost::thread thread;
+    // A decoder has at most one task queued or running in producer_arena, which decodes a single frame and then
+    // queues the next one behind the tasks of other producers.
+    std::atomic<bool>         scheduled{false};
+    std::atomic<bool>         abort{false};
+    bool                      need_packet = false;
+    boost::mutex              task_mutex;
+    boost::condition_variable task_cond;
+
+    AVPixelFormat hw_pix_fmt = AV_PIX_FMT_NONE;
+    bool          counted    = false;
+
+    // Hap textures are unpacked here instead of being decoded by ffmpeg.
+    core::pixel_format_desc texture_desc = core::pixel_format_desc(core::pixel_format::invalid);
+
+    std::shared_ptr<core::frame_factory> frame_factory;
+    std::function<void()>                notify;
+
+    static int get_buffer(AVCodecContext* ctx, AVFrame* frame, int flags)
+    {
+        auto self = static_cast<Decoder*>(ctx->opaque);
+        return get_frame_buffer(*self->frame_factory, ctx, frame, flags);
+    }
+
+    // Intra only codecs never read back decoded frames, which is what makes it fine to decode into upload
+    // memory that is likely write combined.
+    void setup_direct_rendering(const AVCodec* codec)
+    {
+        const auto desc = avcodec_descriptor_get(codec->id);
+        if (!frame_factory || hw_pix_fmt != AV_PIX_FMT_NONE || !(codec->capabilities & AV_CODEC_CAP_DR1) || !desc ||
+            !(desc->props & AV_CODEC_PROP_INTRA_ONLY)) {
+            return;
+        }
+
+        ctx->opaque      = this;
+        ctx->get_buffer2 = get_buffer;
+    }
+
+    static AVPixelFormat get_hw_format(AVCodecContext* ctx, const AVPixelFormat* formats)
+    {
+        auto self = static_cast<Decoder*>(ctx->opaque);
+        for (auto format = formats; *format != AV_PIX_FMT_NONE; ++format) {
+            if (*format == self->hw_pix_fmt) {
+                return *format;
+            }
+        }
+        // The hardware can't decode this stream, e.g. an unsupported profile.
+        return avcodec_default_get_format(ctx, formats);
+    }
+
+    void setup_hwaccel(const AVCodec* codec)
+    {
+        auto hw = find_hw_decoding(codec);
+        if (!hw.device) {
+            return;
+        }
+
+        ctx->hw_device_ctx = av_buffer_ref(hw.device.get());
+        ctx->opaque        = this;
+        ctx->get_format    = get_hw_format;
+        hw_pix_fmt         = hw.pix_fmt;
+
+        CASPAR_LOG(debug) << L"[ffmpeg] Decoding " << codec->name << L" with " << av_hwdevice_get_type_name(hw.type)
+                          << L".";
+    }
 
   public:
     std::shared_ptr<AVCodecContext> ctx;
 
     Decoder() = default;
 
-    explicit Decoder(AVStream* stream)
+    // notify is called from the decoding task whenever a frame or room for a packet becomes available. With textures
+    // the frames of a Hap stream are its block compressed textures, as GRAY8 images with a row for every row of
+    // blocks.
+    Decoder(AVStream*                            stream,
+            std::shared_ptr<core::frame_factory> frame_factory,
+            std::function<void()>                notify,
+            bool                                 textures  = false,
+            bool                                 low_delay = false)
         : st(stream)
+        , frame_factory(std::move(frame_factory))
+        , notify(std::move(notify))
     {
         const auto codec = avcodec_find_decoder(stream->codecpar->codec_id);
         if (!codec) {
             FF_RET(AVERROR_DECODER_NOT_FOUND, "avcodec_find_decoder");
         }
 
-        ctx = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
-                                              [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
+        ctx = describe_stream(codec, stream, textures);
 
-        if (!ctx) {
-            FF_RET(AVERROR(ENOMEM), "avcodec_alloc_context3");
+        const auto threading = choose_threading(codec, ctx.get());
+        FF(av_opt_set_int(ctx.get(), "threads", threading.count, 0));
+        ctx->thread_type = threading.type;
+
+        if (low_delay && ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+            // Frame threads hold back one frame per thread, slices do not.
+            ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+            ctx->thread_type = FF_THREAD_SLICE;
         }
 
-        FF(avcodec_parameters_to_context(ctx.get(), stream->codecpar));
+        if (textures) {
+            // The context describes the frames handed to the filter graph, the codec is never opened.
+            texture_desc = hap_texture_desc(*stream->codecpar);
 
-        int thread_count = env::properties().get(L"configuration.ffmpeg.producer.threads", 0);
-        FF(av_opt_set_int(ctx.get(), "threads", thread_count, 0));
+            counted = true;
+            video_decoder_count()++;
 
-        ctx->pkt_timebase = stream->time_base;
+            CASPAR_LOG(debug) << L"[ffmpeg] Uploading " << codec->name << L" as block compressed textures.";
+            return;
+        }
+
+        if (ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+            setup_hwaccel(codec);
+            setup_direct_rendering(codec);
+        }
+
+        FF(avcodec_open2(ctx.get(), codec, nullptr));
 
         if (ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
-            ctx->framerate           = av_guess_frame_rate(nullptr, stream, nullptr);
-            ctx->sample_aspect_ratio = av_guess_sample_aspect_ratio(nullptr, stream, nullptr);
-        } else if (ctx->codec_type == AVMEDIA_TYPE_AUDIO) {
-            if (!ctx->channel_layout && ctx->channels) {
-                ctx->channel_layout = av_get_default_channel_layout(ctx->channels);
+            counted = true;
+            video_decoder_count()++;
+        }
+
+        CASPAR_LOG(debug) << L"[ffmpeg] Decoding " << codec->name << L" with " << ctx->thread_count << L" "
+                          << (ctx->active_thread_type == FF_THREAD_FRAME   ? L"frame"
+                              : ctx->active_thread_type == FF_THREAD_SLICE ? L"slice"
+                                                                           : L"no")
+                          << L" threads.";
+    }
+
+  private:
+    void schedule()
+    {
+        if (!abort && !scheduled.exchange(true)) {
+            producer_arena().enqueue([this] { run(); });
+        }
+    }
+
+    void run()
+    {
+        auto more = false;
+        try {
+            more = !abort && decode();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            // Ends the stream instead of stalling the producer.
+            eof = true;
+        }
+
+        boost::lock_guard<boost::mutex> lock(task_mutex);
+        if (more) {
+            producer_arena().enqueue([this] { run(); });
+            return;
+        }
+
+        // Cleared before looking for work so that a concurrent schedule either sees it cleared or its work is
+        // found here.
+        scheduled = false;
+        if (can_decode() && !scheduled.exchange(true)) {
+            producer_arena().enqueue([this] { run(); });
+            return;
+        }
+        task_cond.notify_all();
+    }
+
+    bool can_decode() const
+    {
+        if (abort || eof) {
+            return false;
+        }
+        if (need_packet) {
+            boost::lock_guard<boost::mutex> lock(input_mutex);
+            if (input.empty()) {
+                return false;
             }
-            if (!ctx->channels && ctx->channel_layout) {
-                ctx->channels = av_get_channel_layout_nb_channels(ctx->channel_layout);
+        }
+        boost::lock_guard<boost::mutex> lock(output_mutex);
+        return static_cast<int>(output.size()) < output_capacity;
+    }
+
+    // Every packet of Hap is a frame.
+    bool decode_texture()
+    {
+        std::shared_ptr<AVPacket> packet;
+        {
+            boost::lock_guard<boost::mutex> lock(input_mutex);
+            need_packet = input.empty();
+            if (need_packet) {
+                return false;
             }
+            packet = std::move(input.front());
+            input.pop();
         }
+        notify();
 
-        if (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) {
-            ctx->thread_type = FF_THREAD_SLICE;
+        auto av_frame = alloc_frame();
+
+        if (!packet) {
+            av_frame->pts = next_pts;
+            next_pts      = AV_NOPTS_VALUE;
+            eof           = true;
+
+            {
+                boost::lock_guard<boost::mutex> lock(output_mutex);
+                output.push(std::move(av_frame));
+            }
+            notify();
+            return false;
         }
 
-        FF(avcodec_open2(ctx.get(), codec, nullptr));
+        av_frame->format              = ctx->pix_fmt;
+        av_frame->width               = ctx->width;
+        av_frame->height              = ctx->height;
+        av_frame->sample_aspect_ratio = ctx->sample_aspect_ratio;
+        FF(av_frame_get_buffer(av_frame.get(), 0));
 
-        thread = boost::thread([=]() {
-            try {
-                while (!thread.interruption_requested()) {
-                    auto av_frame = alloc_frame();
-                    auto ret      = avcodec_receive_frame(ctx.get(), av_frame.get());
+        const auto& plane = texture_desc.planes.at(0);
+        if (av_frame->linesize[0] == plane.linesize) {
+            decode_hap(packet->data, packet->size, texture_desc, av_frame->data[0]);
+        } else {
+            std::vector<std::uint8_t> blocks(plane.size);
+            decode_hap(packet->data, packet->size, texture_desc, blocks.data());
+            for (int y = 0; y < ctx->height; ++y) {
+                std::memcpy(av_frame->data[0] + y * av_frame->linesize[0],
+                            blocks.data() + y * plane.linesize,
+                            plane.linesize);
+            }
+        }
 
-                    if (ret == AVERROR(EAGAIN)) {
-                        std::shared_ptr<AVPacket> packet;
-                        {
-                            boost::unique_lock<boost::mutex> lock(input_mutex);
-                            input_cond.wait(lock, [&]() { return !input.empty(); });
-                            packet = std::move(input.front());
-                            input.pop();
-                        }
-                        FF(avcodec_send_packet(ctx.get(), packet.get()));
-                    } else if (ret == AVERROR_EOF) {
-                        avcodec_flush_buffers(ctx.get());
-                        av_frame->pts = next_pts;
-                        next_pts      = AV_NOPTS_VALUE;
-                        eof           = true;
+        av_frame->pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
 
-                        {
-                            boost::unique_lock<boost::mutex> lock(output_mutex);
-                            output_cond.wait(lock, [&]() { return output.size() < output_capacity; });
-                            output.push(std::move(av_frame));
-                        }
-                    } else {
-                        FF_RET(ret, "avcodec_receive_frame");
+        auto duration_pts = packet->duration;
+        if (duration_pts <= 0 && ctx->framerate.num > 0) {
+            duration_pts = av_rescale_q(1, av_inv_q(ctx->framerate), st->time_base);
+        }
+        next_pts = av_frame->pts != AV_NOPTS_VALUE && duration_pts > 0 ? av_frame->pts + duration_pts : AV_NOPTS_VALUE;
 
-                        // NOTE This is a workaround for DVCPRO HD.
-                        if (av_frame->width > 1024 && av_frame->interlaced_frame) {
-                            av_frame->top_field_first = 1;
-                        }
+        {
+            boost::lock_guard<boost::mutex> lock(output_mutex);
+            output.push(std::move(av_frame));
+        }
+        notify();
+        return true;
+    }
 
-                        // TODO (fix) is this always best?
-                        av_frame->pts = av_frame->best_effort_timestamp;
-
-                        auto duration_pts = av_frame->pkt_duration;
-                        if (duration_pts <= 0) {
-                            if (ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
-                                const auto ticks = av_stream_get_parser(st) ? av_stream_get_parser(st)->repeat_pict + 1
-                                                                            : ctx->ticks_per_frame;
-                                duration_pts     = static_cast<int64_t>(AV_TIME_BASE) * ctx->framerate.den * ticks /
-                                               ctx->framerate.num / ctx->ticks_per_frame;
-                                duration_pts = av_rescale_q(duration_pts, {1, AV_TIME_BASE}, st->time_base);
-                            } else if (ctx->codec_type == AVMEDIA_TYPE_AUDIO) {
-                                duration_pts = av_rescale_q(av_frame->nb_samples, {1, ctx->sample_rate}, st->time_base);
-                            }
-                        }
+    // Decodes at most one frame without blocking. Returns whether there may be more to do right away.
+    bool decode()
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(output_mutex);
+            if (static_cast<int>(output.size()) >= output_capacity) {
+                return false;
+            }
+        }
 
-                        if (duration_pts > 0) {
-                            next_pts = av_frame->pts + duration_pts;
-                        } else {
-                            next_pts = AV_NOPTS_VALUE;
-                        }
+        if (texture_desc.format != core::pixel_format::invalid) {
+            return decode_texture();
+        }
 
-                        {
-                            boost::unique_lock<boost::mutex> lock(output_mutex);
-                            output_cond.wait(lock, [&]() { return output.size() < output_capacity; });
-                            output.push(std::move(av_frame));
-                        }
-                    }
+        auto av_frame = alloc_frame();
+        auto ret      = avcodec_receive_frame(ctx.get(), av_frame.get());
+
+        if (ret == AVERROR(EAGAIN)) {
+            std::shared_ptr<AVPacket> packet;
+            {
+                boost::lock_guard<boost::mutex> lock(input_mutex);
+                need_packet = input.empty();
+                if (need_packet) {
+                    return false;
                 }
-            } catch (boost::thread_interrupted&) {
-                // Do nothing...
+                packet = std::move(input.front());
+                input.pop();
             }
-        });
+            notify();
+            FF(avcodec_send_packet(ctx.get(), packet.get()));
+            return true;
+        }
+
+        if (ret == AVERROR_EOF) {
+            avcodec_flush_buffers(ctx.get());
+            av_frame->pts = next_pts;
+            next_pts      = AV_NOPTS_VALUE;
+            eof           = true;
+
+            {
+                boost::lock_guard<boost::mutex> lock(output_mutex);
+                output.push(std::move(av_frame));
+            }
+            notify();
+            return false;
+        }
+
+        FF_RET(ret, "avcodec_receive_frame");
+
+        // Hardware frames are downloaded here, in the decoding task.
+        if (hw_pix_fmt != AV_PIX_FMT_NONE && av_frame->format == hw_pix_fmt) {
+            auto sw_frame = alloc_frame();
+            FF(av_hwframe_transfer_data(sw_frame.get(), av_frame.get(), 0));
+            FF(av_frame_copy_props(sw_frame.get(), av_frame.get()));
+            av_frame = std::move(sw_frame);
+        }
+
+        // NOTE This is a workaround for DVCPRO HD.
+        if (av_frame->width > 1024 && av_frame->interlaced_frame) {
+            av_frame->top_field_first = 1;
+        }
+
+        // TODO (fix) is this always best?
+        av_frame->pts = av_frame->best_effort_timestamp;
+
+        auto duration_pts = av_frame->pkt_duration;
+        if (duration_pts <= 0) {
+            if (ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+                const auto ticks = av_stream_get_parser(st) ? av_stream_get_parser(st)->repeat_pict + 1
+                                                            : ctx->ticks_per_frame;
+                duration_pts     = static_cast<int64_t>(AV_TIME_BASE) * ctx->framerate.den * ticks /
+                               ctx->framerate.num / ctx->ticks_per_frame;
+                duration_pts = av_rescale_q(duration_pts, {1, AV_TIME_BASE}, st->time_base);
+            } else if (ctx->codec_type == AVMEDIA_TYPE_AUDIO) {
+                duration_pts = av_rescale_q(av_frame->nb_samples, {1, ctx->sample_rate}, st->time_base);
+            }
+        }
+
+        if (duration_pts > 0) {
+            next_pts = av_frame->pts + duration_pts;
+        } else {
+            next_pts = AV_NOPTS_VALUE;
+        }
+
+        {
+            boost::lock_guard<boost::mutex> lock(output_mutex);
+            output.push(std::move(av_frame));
+        }
+        notify();
+        return true;
     }
 
+  public:
     ~Decoder()
     {
-        try {
-            if (thread.joinable()) {
-                thread.interrupt();
-                thread.join();
-            }
-        } catch (boost::thread_interrupted&) {
-            // Do nothing...
+        abort = true;
+
+        boost::unique_lock<boost::mutex> lock(task_mutex);
+        task_cond.wait(lock, [&] { return !scheduled; });
+
+        if (counted) {
+            video_decoder_count()--;
         }
     }
 
@@ -245,7 +673,7 @@ class Decoder
             input.push(std::move(packet));
         }
 
-        input_cond.notify_all();
+        schedule();
     }
 
     std::shared_ptr<AVFrame> pop()
@@ -262,7 +690,7 @@ class Decoder
         }
 
         if (frame) {
-            output_cond.notify_all();
+            schedule();
         } else if (eof) {
             frame = alloc_frame();
         }
@@ -271,6 +699,35 @@ class Decoder
     }
 };
 
+// The Hap textures of the video stream a video filter without a filter spec would play, invalid when there is none.
+static core::pixel_format_desc find_textures(const Input& input)
+{
+    if (!env::properties().get(L"configuration.ffmpeg.producer.hap-textures", true)) {
+        return core::pixel_format_desc(core::pixel_format::invalid);
+    }
+
+    std::vector<AVStream*> video_streams;
+    for (auto n = 0U; n < input->nb_streams; ++n) {
+        const auto st          = input->streams[n];
+        const auto disposition = st->disposition;
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && (!disposition || disposition == AV_DISPOSITION_DEFAULT)) {
+            video_streams.push_back(st);
+        }
+    }
+
+    std::stable_sort(video_streams.begin(), video_streams.end(), [](auto lhs, auto rhs) {
+        return lhs->codecpar->height > rhs->codecpar->height;
+    });
+
+    // Two streams of the same height are alphamerged.
+    if (video_streams.empty() ||
+        (video_streams.size() >= 2 && video_streams[0]->codecpar->height == video_streams[1]->codecpar->height)) {
+        return core::pixel_format_desc(core::pixel_format::invalid);
+    }
+
+    return hap_texture_desc(*video_streams[0]->codecpar);
+}
+
 struct Filter
 {
     std::shared_ptr<AVFilterGraph>  graph;
@@ -279,16 +736,63 @@ struct Filter
     std::shared_ptr<AVFrame>        frame;
     bool                            eof = false;
 
+    // The frames are Hap textures of texture_desc, which are only retimed.
+    bool                    textures     = false;
+    core::pixel_format_desc texture_desc = core::pixel_format_desc(core::pixel_format::invalid);
+
+    // With configuration.ffmpeg.producer.frame-rate-conversion set to blend, video leaves the graph at the rate of
+    // the source and is retimed here instead of by the fps filter. frame is then source at the time of the next
+    // field or frame of the channel, which the mixer draws blended with the source frame after it, blend, at
+    // blend_weight.
+    bool                     retime = false;
+    std::shared_ptr<AVFrame> source;
+    std::shared_ptr<AVFrame> blend;
+    double                   blend_weight = 0.0;
+    std::shared_ptr<AVFrame> upcoming;
+    AVRational               retime_tb  = {0, 1};
+    int64_t                  retime_pts = 0; // Of the next frame, in retime_tb.
+    bool                     sink_eof   = false;
+
+    // Where the scale, crop and pad filters of the spec, which the graph then leaves out, put the image.
+    std::optional<Geometry> geometry;
+
     Filter() = default;
 
-    Filter(std::string                    filter_spec,
-           const Input&                   input,
-           std::map<int, Decoder>&        streams,
-           int64_t                        start_time,
-           AVMediaType                    media_type,
-           const core::video_format_desc& format_desc)
+    Filter(std::string                          filter_spec,
+           const Input&                         input,
+           std::map<int, Decoder>&              streams,
+           int64_t                              start_time,
+           AVMediaType                          media_type,
+           const core::video_format_desc&       format_desc,
+           std::shared_ptr<core::frame_factory> frame_factory,
+           const std::function<void()>&         notify,
+           int                                  proxy = 1,
+           bool                                 open_decoders = true)
     {
         if (media_type == AVMEDIA_TYPE_VIDEO) {
+            if (!filter_spec.empty() && env::properties().get(L"configuration.ffmpeg.producer.gpu-geometry", true)) {
+                // Of the tallest stream, the one the others are alphamerged with.
+                const AVCodecParameters* par = nullptr;
+                for (auto n = 0U; n < input->nb_streams; ++n) {
+                    const auto st = input->streams[n];
+                    if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO &&
+                        (!par || st->codecpar->height > par->height)) {
+                        par = st->codecpar;
+                    }
+                }
+                geometry = par ? map_geometry(filter_spec, par->width, par->height) : std::nullopt;
+                if (geometry) {
+                    CASPAR_LOG(debug) << L"[ffmpeg] " << u16(filter_spec) << L" is drawn by the mixer.";
+                    filter_spec.clear();
+                }
+            }
+
+            // Textures can't be deinterlaced, scaled or filtered. Hap is always progressive.
+            if (filter_spec.empty() && proxy <= 1) {
+                texture_desc = find_textures(input);
+                textures     = texture_desc.format != core::pixel_format::invalid;
+            }
+
             if (filter_spec.empty()) {
                 filter_spec = "null";
             }
@@ -296,14 +800,29 @@ struct Filter
             auto deint = u8(
                 env::properties().get<std::wstring>(L"configuration.ffmpeg.producer.auto-deinterlace", L"interlaced"));
 
-            if (deint != "none") {
+            if (deint != "none" && !textures) {
                 filter_spec += (boost::format(",bwdif=mode=send_field:parity=auto:deint=%s") % deint).str();
             }
 
-            filter_spec += (boost::format(",fps=fps=%d/%d:start_time=%f") %
-                            (format_desc.framerate.numerator() * format_desc.field_count) %
-                            format_desc.framerate.denominator() % (static_cast<double>(start_time) / AV_TIME_BASE))
-                               .str();
+            // Scaled after deinterlacing, which needs the fields at full height. Chroma subsampling needs even sizes.
+            if (proxy > 1) {
+                filter_spec += (boost::format(",scale=w=trunc(iw/%1%/2)*2:h=trunc(ih/%1%/2)*2:flags=fast_bilinear") %
+                                proxy)
+                                   .str();
+            }
+
+            retime = env::properties().get<std::wstring>(L"configuration.ffmpeg.producer.frame-rate-conversion",
+                                                         L"drop") == L"blend";
+            if (retime) {
+                retime_tb  = {format_desc.framerate.denominator(),
+                              format_desc.framerate.numerator() * format_desc.field_count};
+                retime_pts = av_rescale_q(start_time, TIME_BASE_Q, retime_tb);
+            } else {
+                filter_spec += (boost::format(",fps=fps=%d/%d:start_time=%f") %
+                                (format_desc.framerate.numerator() * format_desc.field_count) %
+                                format_desc.framerate.denominator() % (static_cast<double>(start_time) / AV_TIME_BASE))
+                                   .str();
+            }
         } else if (media_type == AVMEDIA_TYPE_AUDIO) {
             if (filter_spec.empty()) {
                 filter_spec = "anull";
@@ -440,11 +959,23 @@ struct Filter
                 index = av_streams.at(index)->index;
 
                 auto it = streams.find(index);
-                if (it == streams.end()) {
-                    it = streams.emplace(index, input->streams[index]).first;
+                if (it == streams.end() && open_decoders) {
+                    it = streams
+                             .emplace(std::piecewise_construct,
+                                      std::forward_as_tuple(index),
+                                      std::forward_as_tuple(
+                                          input->streams[index], frame_factory, notify, textures, input.live()))
+                             .first;
                 }
 
-                auto st = it->second.ctx;
+                std::shared_ptr<AVCodecContext> st;
+                if (it != streams.end()) {
+                    st = it->second.ctx;
+                } else {
+                    // Without a decoder of its own the stream is described as one would start, its codec left closed.
+                    const auto stream = input->streams[index];
+                    st = describe_stream(avcodec_find_decoder(stream->codecpar->codec_id), stream, textures);
+                }
 
                 if (st->codec_type == AVMEDIA_TYPE_VIDEO) {
                     auto args = (boost::format("video_size=%dx%d:pix_fmt=%d:time_base=%d/%d") % st->width % st->height %
@@ -508,8 +1039,28 @@ struct Filter
                                               AV_PIX_FMT_YUVA422P,
                                               AV_PIX_FMT_YUVA420P,
                                               AV_PIX_FMT_UYVY422,
+                                              AV_PIX_FMT_NV12,
+                                              AV_PIX_FMT_P010LE,
+                                              AV_PIX_FMT_P016LE,
+                                              AV_PIX_FMT_YUV444P10LE,
+                                              AV_PIX_FMT_YUV422P10LE,
+                                              AV_PIX_FMT_YUV420P10LE,
+                                              AV_PIX_FMT_YUV444P12LE,
+                                              AV_PIX_FMT_YUV422P12LE,
+                                              AV_PIX_FMT_YUV420P12LE,
+                                              AV_PIX_FMT_YUV444P16LE,
+                                              AV_PIX_FMT_YUV422P16LE,
+                                              AV_PIX_FMT_YUV420P16LE,
+                                              AV_PIX_FMT_YUVA444P10LE,
+                                              AV_PIX_FMT_YUVA422P10LE,
+                                              AV_PIX_FMT_YUVA420P10LE,
+                                              AV_PIX_FMT_YUVA444P16LE,
+                                              AV_PIX_FMT_YUVA422P16LE,
+                                              AV_PIX_FMT_YUVA420P16LE,
                                               AV_PIX_FMT_NONE};
-            FF(av_opt_set_int_list(sink, "pix_fmts", pix_fmts, -1, AV_OPT_SEARCH_CHILDREN));
+            const AVPixelFormat texture_pix_fmts[] = {AV_PIX_FMT_GRAY8, AV_PIX_FMT_NONE};
+            FF(av_opt_set_int_list(
+                sink, "pix_fmts", textures ? texture_pix_fmts : pix_fmts, -1, AV_OPT_SEARCH_CHILDREN));
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
@@ -520,7 +1071,8 @@ struct Filter
 #pragma warning(push)
 #pragma warning(disable : 4245)
 #endif
-            const AVSampleFormat sample_fmts[] = {AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_NONE};
+            // Float sources (most compressed audio) stay float all the way into the mixer.
+            const AVSampleFormat sample_fmts[] = {AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_NONE};
             FF(av_opt_set_int_list(sink, "sample_fmts", sample_fmts, -1, AV_OPT_SEARCH_CHILDREN));
 
             const int channel_counts[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, -1};
@@ -570,6 +1122,10 @@ struct Filter
             return true;
         }
 
+        if (retime) {
+            return retime_frame();
+        }
+
         auto av_frame = alloc_frame();
         auto ret      = nb_samples >= 0 ? av_buffersink_get_samples(sink, av_frame.get(), nb_samples)
                                         : av_buffersink_get_frame(sink, av_frame.get());
@@ -586,8 +1142,98 @@ struct Filter
         frame = std::move(av_frame);
         return true;
     }
+
+    // Of frame, which is the channel's when retimed.
+    AVRational time_base() const { return retime ? retime_tb : av_buffersink_get_time_base(sink); }
+    AVRational frame_rate() const { return retime ? av_inv_q(retime_tb) : av_buffersink_get_frame_rate(sink); }
+
+  private:
+    // Shows each source frame from its timestamp on, like the fps filter, and blends in the one after it by how far
+    // the channel frame is between the two.
+    bool retime_frame()
+    {
+        const auto tb       = av_buffersink_get_time_base(sink);
+        const auto fr       = av_buffersink_get_frame_rate(sink);
+        auto       progress = false;
+
+        while (true) {
+            if (source && (upcoming || sink_eof)) {
+                const auto time = av_rescale_q(retime_pts, retime_tb, tb);
+
+                if (upcoming && upcoming->pts <= time) {
+                    source = std::move(upcoming);
+                    continue;
+                }
+
+                if (!upcoming) {
+                    // The last frame lasts a frame of the source, or of the channel when the rate isn't known.
+                    const auto duration = fr.num > 0 && fr.den > 0 ? av_rescale_q(1, av_inv_q(fr), tb)
+                                                                   : av_rescale_q(1, retime_tb, tb);
+                    if (time >= source->pts + std::max<int64_t>(duration, 1)) {
+                        eof   = true;
+                        frame = nullptr;
+                        return true;
+                    }
+                }
+
+                auto copy = std::shared_ptr<AVFrame>(av_frame_clone(source.get()),
+                                                     [](AVFrame* ptr) { av_frame_free(&ptr); });
+                if (!copy) {
+                    FF_RET(AVERROR(ENOMEM), "av_frame_clone");
+                }
+                copy->pts = retime_pts++;
+
+                blend_weight = 0.0;
+                if (upcoming && upcoming->pts > source->pts) {
+                    blend_weight = std::clamp(static_cast<double>(time - source->pts) /
+                                                  static_cast<double>(upcoming->pts - source->pts),
+                                              0.0,
+                                              1.0);
+                }
+                // Less than a step of 8 bit video is not worth drawing.
+                blend = blend_weight >= 1.0 / 256.0 ? upcoming : nullptr;
+                frame = std::move(copy);
+                return true;
+            }
+
+            if (sink_eof) {
+                eof   = true;
+                frame = nullptr;
+                return true;
+            }
+
+            auto       av_frame = alloc_frame();
+            const auto ret      = av_buffersink_get_frame(sink, av_frame.get());
+            if (ret == AVERROR(EAGAIN)) {
+                return progress;
+            }
+            progress = true;
+            if (ret == AVERROR_EOF) {
+                sink_eof = true;
+                continue;
+            }
+            FF_RET(ret, "av_buffersink_get_frame");
+
+            if (av_frame->pts == AV_NOPTS_VALUE) {
+                av_frame->pts = av_frame->best_effort_timestamp;
+            }
+            if (av_frame->pts == AV_NOPTS_VALUE) {
+                av_frame->pts = source ? source->pts + 1 : 0;
+            }
+            (source ? upcoming : source) = std::move(av_frame);
+        }
+    }
 };
 
+// Producers are created while the command that loads them has the channel and layer in the call context.
+static diagnostics::metrics::labels_t producer_labels()
+{
+    const auto& context = core::diagnostics::call_context::for_thread();
+    return {{"channel", std::to_string(context.video_channel)},
+            {"layer", std::to_string(context.layer)},
+            {"producer", "ffmpeg"}};
+}
+
 struct AVProducer::Impl
 {
     caspar::core::monitor::state state_;
@@ -595,12 +1241,19 @@ struct AVProducer::Impl
 
     spl::shared_ptr<diagnostics::graph> graph_;
 
+    const diagnostics::metrics::labels_t                 metric_labels_ = producer_labels();
+    const std::shared_ptr<diagnostics::metrics::gauge>   buffered_frames_ = diagnostics::metrics::make_gauge(
+        "caspar_producer_buffered_frames", "Decoded frames ready for the producer", metric_labels_);
+    const std::shared_ptr<diagnostics::metrics::counter> underflows_ = diagnostics::metrics::make_counter(
+        "caspar_producer_underflows_total", "Frames the producer had nothing decoded for", metric_labels_);
+
     const std::shared_ptr<core::frame_factory> frame_factory_;
     const core::video_format_desc              format_desc_;
     const AVRational                           format_tb_;
     const std::string                          name_;
     const std::string                          path_;
 
+    Wakeup                 wakeup_;
     Input                  input_;
     std::map<int, Decoder> decoders_;
     Filter                 video_filter_;
@@ -608,6 +1261,13 @@ struct AVProducer::Impl
 
     std::map<int, std::vector<AVFilterContext*>> sources_;
 
+    // Filter graphs for the next loop, built while the buffer is full. A graph can't be flushed, the fps and
+    // resampling filters keep the timestamps they have seen, so reset() swaps these in instead of rebuilding when
+    // they were built for the same start time.
+    Filter  spare_video_filter_;
+    Filter  spare_audio_filter_;
+    int64_t spare_start_ = AV_NOPTS_VALUE;
+
     std::atomic<int64_t> start_{AV_NOPTS_VALUE};
     std::atomic<int64_t> duration_{AV_NOPTS_VALUE};
     std::atomic<int64_t> input_duration_{AV_NOPTS_VALUE};
@@ -617,6 +1277,23 @@ struct AVProducer::Impl
     std::string afilter_;
     std::string vfilter_;
 
+    // Never opens a video decoder or graph, frames carry only audio and have nothing for the mixer to upload.
+    const bool audio_only_;
+
+    // Divides the width and height of the video, so that preview channels upload and mix less.
+    const int proxy_;
+
+    // Milliseconds a live stream is played behind its source, 0 when not live. The buffer is kept around that
+    // depth instead of filling up, frames are dropped while it stays deeper and the last frame is repeated when it
+    // runs dry, so that a source running faster or slower than the channel clock neither drifts nor stalls.
+    const int live_latency_;
+
+    // The images of the last source frames the video filter retimed, by the frame they were made from.
+    std::deque<std::pair<std::shared_ptr<AVFrame>, core::draw_frame>> retimed_images_;
+
+    // The padding of the geometry of the video filter.
+    core::draw_frame background_;
+
     int              seekable_       = 2;
     int64_t          frame_count_    = 0;
     bool             frame_flush_    = true;
@@ -628,13 +1305,52 @@ struct AVProducer::Impl
     mutable boost::mutex      buffer_mutex_;
     boost::condition_variable buffer_cond_;
     std::atomic<bool>         buffer_eof_{false};
-    int                       buffer_capacity_ = static_cast<int>(format_desc_.fps) / 4;
 
-    std::optional<caspar::executor> video_executor_;
-    std::optional<caspar::executor> audio_executor_;
+    // Frames decoded, and uploaded by the mixer, before the producer is ready to start or continue after a seek.
+    const int preroll_ =
+        live_latency_ > 0
+            ? std::max(format_desc_.field_count,
+                       static_cast<int>(std::ceil(live_latency_ * format_desc_.fps / 1000.0)))
+            : std::clamp(env::properties().get(L"configuration.ffmpeg.producer.preroll", 4),
+                         1,
+                         std::max(4, static_cast<int>(format_desc_.fps) * 4));
+
+    // The buffer covers twice the worst recent time it took to produce a frame, which includes IO stalls.
+    const int buffer_min_ =
+        live_latency_ > 0 ? preroll_ : std::max(preroll_, static_cast<int>(format_desc_.fps) / 8);
+    const int buffer_max_ =
+        live_latency_ > 0 ? buffer_min_ * 4 : std::max(buffer_min_, static_cast<int>(format_desc_.fps) * 4);
+    int               buffer_capacity_ = buffer_min_;
+    double            buffer_jitter_   = 0.0;
+    std::atomic<bool> buffer_stalled_{false};
+
+    // The depth of a live buffer averaged over about a second, and the frames dropped and repeated to hold it.
+    double  live_depth_    = 0.0;
+    int64_t live_dropped_  = 0;
+    int64_t live_repeated_ = 0;
+
+    // The first frames decoded after seeking to loop_frames_start_. When looping they are played while the
+    // decoders seek to the frame after them, so that the seek never drains the buffer.
+    std::vector<Frame> loop_frames_;
+    int64_t            loop_frames_start_    = AV_NOPTS_VALUE;
+    const size_t       loop_frames_capacity_ = std::max<size_t>(4, static_cast<size_t>(format_desc_.fps) / 4);
 
     int latency_ = 0;
 
+    // Playback at any other speed than 1, reverse included, is served from cache_ instead of buffer_. Frames are
+    // kept by pts within configuration.ffmpeg.producer.cache-budget, those farthest from cache_position_ going
+    // first. A frame missing from the cache is requested through cache_request_, and decoded from the keyframe
+    // before it up to the first frame already cached, so that every GOP is decoded once. Audio is muted.
+    std::atomic<double>      speed_{1.0};
+    std::map<int64_t, Frame> cache_;
+    int64_t                  cache_bytes_    = 0;
+    double                   cache_position_ = 0.0;
+    std::atomic<int64_t>     cache_request_{AV_NOPTS_VALUE};
+    std::atomic<bool>        cache_idle_{false};
+    int64_t                  cache_target_ = AV_NOPTS_VALUE;
+    const int64_t            cache_budget_ =
+        env::properties().get(L"configuration.ffmpeg.producer.cache-budget", 1024) * 1024LL * 1024LL;
+
     boost::thread thread_;
 
     Impl(std::shared_ptr<core::frame_factory> frame_factory,
@@ -647,27 +1363,36 @@ struct AVProducer::Impl
          std::optional<int64_t>               seek,
          std::optional<int64_t>               duration,
          bool                                 loop,
-         int                                  seekable)
+         int                                  seekable,
+         bool                                 audio_only,
+         int                                  proxy,
+         int                                  live_latency)
         : frame_factory_(frame_factory)
         , format_desc_(format_desc)
         , format_tb_({format_desc.duration, format_desc.time_scale * format_desc.field_count})
         , name_(name)
         , path_(path)
-        , input_(path, graph_, seekable >= 0 && seekable < 2 ? std::optional<bool>(false) : std::optional<bool>())
+        , input_(path,
+                 graph_,
+                 seekable >= 0 && seekable < 2 ? std::optional<bool>(false) : std::optional<bool>(),
+                 [this] { wakeup_.notify(); },
+                 live_latency > 0)
         , start_(start ? av_rescale_q(*start, format_tb_, TIME_BASE_Q) : AV_NOPTS_VALUE)
         , duration_(duration ? av_rescale_q(*duration, format_tb_, TIME_BASE_Q) : AV_NOPTS_VALUE)
         , loop_(loop)
         , afilter_(afilter)
         , vfilter_(vfilter)
+        , audio_only_(audio_only)
+        , proxy_(std::max(1, proxy))
+        , live_latency_(std::max(0, live_latency))
         , seekable_(seekable)
-        , video_executor_(L"video-executor")
-        , audio_executor_(L"audio-executor")
     {
         diagnostics::register_graph(graph_);
         graph_->set_color("underflow", diagnostics::color(0.6f, 0.3f, 0.9f));
         graph_->set_color("frame-time", diagnostics::color(0.0f, 1.0f, 0.0f));
         graph_->set_color("decode-time", diagnostics::color(0.0f, 1.0f, 1.0f));
         graph_->set_color("buffer", diagnostics::color(1.0f, 1.0f, 0.0f));
+        graph_->set_color("live-drop", diagnostics::color(0.9f, 0.3f, 0.3f));
 
         state_["file/name"] = u8(name_);
         state_["file/path"] = u8(path_);
@@ -707,9 +1432,6 @@ struct AVProducer::Impl
             // Do nothing...
         }
 
-        video_executor_.reset();
-        audio_executor_.reset();
-
         CASPAR_LOG(debug) << print() << " Joined";
     }
 
@@ -748,10 +1470,12 @@ struct AVProducer::Impl
                 seek_internal(start);
             } else {
                 reset(input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0);
+                loop_frames_start_ = 0;
             }
         }
 
         set_thread_name(L"[ffmpeg::av_producer]");
+        set_thread_affinity(thread_role::producer);
 
         boost::range::rotate(audio_cadence, std::end(audio_cadence) - 1);
 
@@ -772,9 +1496,31 @@ struct AVProducer::Impl
                 }
             }
 
-            {
-                // TODO (perf) seek as soon as input is past duration or eof.
+            if (speed_ != 1.0) {
+                const auto next_pts = frame.pts != AV_NOPTS_VALUE ? frame.pts + frame.duration : AV_NOPTS_VALUE;
+                const auto request  = cache_request_.exchange(AV_NOPTS_VALUE);
 
+                // Requests the decoders will get to by going on are left to them.
+                if (request != AV_NOPTS_VALUE && (cache_idle_ || next_pts == AV_NOPTS_VALUE || request < next_pts)) {
+                    seek_cache(request);
+                    frame = Frame{};
+                    continue;
+                }
+
+                bool wanted = true;
+                if (next_pts != AV_NOPTS_VALUE) {
+                    boost::lock_guard<boost::mutex> buffer_lock(buffer_mutex_);
+                    wanted = cache_wanted(next_pts);
+                }
+                cache_idle_ = !wanted;
+                if (!wanted) {
+                    // Woken by requests, and by seek, start and duration changes.
+                    wakeup_.wait_for(boost::chrono::milliseconds(100));
+                    continue;
+                }
+            }
+
+            {
                 auto start    = start_.load();
                 auto duration = duration_.load();
 
@@ -788,13 +1534,33 @@ struct AVProducer::Impl
                 buffer_eof_ = (video_filter_.eof && audio_filter_.eof) || time > end;
 
                 if (buffer_eof_) {
-                    if (loop_ && frame_count_ > 2) {
+                    if (speed_ != 1.0) {
+                        cache_idle_ = true;
+                        wakeup_.wait_for(boost::chrono::milliseconds(100));
+                    } else if (loop_ && frame_count_ > 2 && loop_frames_start_ == start &&
+                        loop_frames_.size() == loop_frames_capacity_) {
+                        auto frames = std::move(loop_frames_);
+                        frame       = frames.back();
+
+                        seek_internal(frame.pts + frame.duration);
+                        frame_count_       = static_cast<int64_t>(frames.size());
+                        loop_frames_start_ = start;
+
+                        {
+                            boost::lock_guard<boost::mutex> buffer_lock(buffer_mutex_);
+                            if (seek_ == AV_NOPTS_VALUE) {
+                                buffer_.insert(buffer_.end(), frames.begin(), frames.end());
+                            }
+                        }
+
+                        loop_frames_ = std::move(frames);
+                    } else if (loop_ && frame_count_ > 2) {
                         frame = Frame{};
                         seek_internal(start);
                     } else {
-                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                        // Woken by seek, loop, start and duration changes.
+                        wakeup_.wait_for(boost::chrono::milliseconds(100));
                     }
-                    // TODO (fix) Limit live polling due to bugs.
                     continue;
                 }
             }
@@ -803,24 +1569,19 @@ struct AVProducer::Impl
             {
                 progress |= schedule();
 
-                std::vector<std::future<bool>> futures;
-
-                if (!video_filter_.frame) {
-                    futures.push_back(video_executor_->begin_invoke([&]() { return video_filter_(); }));
-                }
-
-                if (!audio_filter_.frame) {
-                    futures.push_back(audio_executor_->begin_invoke([&]() { return audio_filter_(audio_cadence[0]); }));
-                }
-
-                for (auto& future : futures) {
-                    progress |= future.get();
-                }
+                auto video_progress = false;
+                auto audio_progress = false;
+                producer_arena().execute([&] {
+                    tbb::parallel_invoke(
+                        [&] { video_progress = !video_filter_.frame && video_filter_(); },
+                        [&] { audio_progress = !audio_filter_.frame && audio_filter_(audio_cadence[0]); });
+                });
+                progress |= video_progress || audio_progress;
             }
 
             if ((!video_filter_.frame && !video_filter_.eof) || (!audio_filter_.frame && !audio_filter_.eof)) {
                 if (!progress) {
-                    if (warning_debounce++ % 500 == 100) {
+                    if (warning_debounce++ % 50 == 10) {
                         if (!video_filter_.frame && !video_filter_.eof) {
                             CASPAR_LOG(warning) << print() << " Waiting for video frame...";
                         } else if (!audio_filter_.frame && !audio_filter_.eof) {
@@ -830,8 +1591,9 @@ struct AVProducer::Impl
                         }
                     }
 
-                    // TODO (perf): Avoid live loop.
-                    std::this_thread::sleep_for(std::chrono::milliseconds(warning_debounce > 25 ? 20 : 5));
+                    // Everything left to do waits on the input or the decoders, which wake us once they have
+                    // something. The timeout only paces the warnings above.
+                    wakeup_.wait_for(boost::chrono::milliseconds(100));
                 }
                 continue;
             }
@@ -848,8 +1610,8 @@ struct AVProducer::Impl
 
             if (video_filter_.frame) {
                 frame.video      = std::move(video_filter_.frame);
-                const auto tb    = av_buffersink_get_time_base(video_filter_.sink);
-                const auto fr    = av_buffersink_get_frame_rate(video_filter_.sink);
+                const auto tb    = video_filter_.time_base();
+                const auto fr    = video_filter_.frame_rate();
                 frame.start_time = start_time;
                 frame.pts        = av_rescale_q(frame.video->pts, tb, TIME_BASE_Q) - start_time;
                 frame.duration   = av_rescale_q(1, av_inv_q(fr), TIME_BASE_Q);
@@ -864,16 +1626,64 @@ struct AVProducer::Impl
                 frame.duration   = av_rescale_q(frame.audio->nb_samples, {1, sr}, TIME_BASE_Q);
             }
 
-            frame.frame       = core::draw_frame(make_frame(this, *frame_factory_, frame.video, frame.audio));
+            if (video_filter_.retime && frame.video && speed_ == 1.0) {
+                frame.frame = retimed_frame(frame.audio);
+            } else {
+                const core::const_frame image(
+                    video_filter_.textures
+                        ? make_frame(this, *frame_factory_, frame.video, frame.audio, video_filter_.texture_desc)
+                        : make_frame(this, *frame_factory_, frame.video, frame.audio));
+                frame.frame = core::draw_frame(speed_ != 1.0 ? image.with_field(image.pixel_format_desc().field, {})
+                                                             : image);
+            }
+            if (frame.video) {
+                frame.frame = placed(std::move(frame.frame));
+            }
             frame.frame_count = frame_count_++;
+            frame.size        = FrameBudget::size(frame.video, frame.audio);
+            frame.budget      = FrameBudget::acquire(frame.size);
+
+            if (loop_ && loop_frames_.size() < loop_frames_capacity_ &&
+                frame.frame_count == static_cast<int64_t>(loop_frames_.size())) {
+                loop_frames_.push_back(frame);
+                // Only the mixer frame is played again.
+                loop_frames_.back().video = nullptr;
+                loop_frames_.back().audio = nullptr;
+            }
+
+            const auto decode_time = decode_timer.elapsed();
+            graph_->set_value("decode-time", decode_time * format_desc_.fps * 0.5);
 
-            graph_->set_value("decode-time", decode_timer.elapsed() * format_desc_.fps * 0.5);
+            // Decays with a half life of about 700 frames, an underflow counts as a stall twice as long.
+            buffer_jitter_ = std::max(decode_time, buffer_jitter_ * 0.999);
+            if (buffer_stalled_.exchange(false)) {
+                buffer_jitter_ = std::max(buffer_jitter_ * 2.0, 4.0 / format_desc_.fps);
+            }
+
+            if (loop_ && seek_ == AV_NOPTS_VALUE && speed_ == 1.0) {
+                prepare_loop();
+            }
 
             {
                 boost::unique_lock<boost::mutex> buffer_lock(buffer_mutex_);
-                buffer_cond_.wait(buffer_lock, [&] { return buffer_.size() < buffer_capacity_; });
-                if (seek_ == AV_NOPTS_VALUE) {
+
+                const auto jitter_frames = static_cast<int>(std::ceil(buffer_jitter_ * format_desc_.fps * 2.0));
+                buffer_capacity_         = std::clamp(buffer_min_ + jitter_frames, buffer_min_, buffer_max_);
+
+                // A live stream is never held back, what the buffer doesn't take waits upstream and adds latency.
+                const auto capacity = live_latency_ > 0 ? buffer_max_ : buffer_capacity_;
+
+                buffer_cond_.wait(buffer_lock, [&] {
+                    const auto size = static_cast<int>(buffer_.size());
+                    return size < buffer_min_ || (size < capacity && FrameBudget::used() <= FrameBudget::limit());
+                });
+                if (seek_ == AV_NOPTS_VALUE && speed_ != 1.0) {
+                    cache_insert(frame);
+                } else if (seek_ == AV_NOPTS_VALUE) {
+                    // The mixer frame holds its own copy of the image.
                     buffer_.push_back(frame);
+                    buffer_.back().video = nullptr;
+                    buffer_.back().audio = nullptr;
                 }
             }
 
@@ -886,18 +1696,117 @@ struct AVProducer::Impl
             decode_timer.restart();
 
             graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
+            buffered_frames_->set(static_cast<double>(buffer_.size()));
 
             boost::range::rotate(audio_cadence, std::end(audio_cadence) - 1);
         }
     }
 
+    // The image of a source frame of the video filter, made once for all the channel frames that show it.
+    core::draw_frame retimed_image(const std::shared_ptr<AVFrame>& source)
+    {
+        for (auto& image : retimed_images_) {
+            if (image.first == source) {
+                return image.second;
+            }
+        }
+
+        core::draw_frame image(
+            video_filter_.textures ? make_frame(this, *frame_factory_, source, nullptr, video_filter_.texture_desc)
+                                   : make_frame(this, *frame_factory_, source, nullptr));
+        retimed_images_.emplace_back(source, image);
+        if (retimed_images_.size() > 2) {
+            retimed_images_.pop_front();
+        }
+        return image;
+    }
+
+    // The image where the geometry the video filter left to the mixer puts it, over the padding.
+    core::draw_frame placed(core::draw_frame image)
+    {
+        const auto& geometry = video_filter_.geometry;
+        if (!geometry) {
+            return image;
+        }
+
+        auto& transform            = image.transform().image_transform;
+        transform.fill_translation = geometry->transform.fill_translation;
+        transform.fill_scale       = geometry->transform.fill_scale;
+        transform.crop             = geometry->transform.crop;
+        if (!geometry->background) {
+            return image;
+        }
+
+        if (!background_) {
+            background_ = core::create_color_frame(this, spl::make_shared_ptr(frame_factory_), *geometry->background);
+        }
+        return core::draw_frame::over(background_, std::move(image));
+    }
+
+    // The source frame the video filter retimed, blended with the one after it on the gpu, and the audio.
+    core::draw_frame retimed_frame(std::shared_ptr<AVFrame> audio)
+    {
+        auto image = retimed_image(video_filter_.source);
+        if (video_filter_.blend) {
+            auto next                                = retimed_image(video_filter_.blend);
+            next.transform().image_transform.opacity = video_filter_.blend_weight;
+            image                                    = core::draw_frame::over(std::move(image), std::move(next));
+        }
+        if (!audio) {
+            return image;
+        }
+        return core::draw_frame::over(std::move(image),
+                                      core::draw_frame(make_frame(this, *frame_factory_, nullptr, std::move(audio))));
+    }
+
+    // While the average depth is above the capacity the jitter calls for, the source runs ahead of the channel and
+    // the oldest frame, both fields when interlaced, is dropped. Falling behind shows as underflows, which repeat
+    // the last frame. Audio is dropped and repeated with the frames it belongs to.
+    void drift_live_buffer()
+    {
+        live_depth_ += (static_cast<double>(buffer_.size()) - live_depth_) / format_desc_.fps;
+
+        const auto drop = format_desc_.field_count;
+        if (live_depth_ <= buffer_capacity_ + drop || static_cast<int>(buffer_.size()) <= buffer_min_ + drop) {
+            return;
+        }
+
+        buffer_.erase(buffer_.begin(), buffer_.begin() + drop);
+        buffer_cond_.notify_all();
+
+        live_depth_ -= drop;
+        live_dropped_ += drop;
+        graph_->set_tag(diagnostics::tag_severity::INFO, "live-drop");
+    }
+
     void update_state()
     {
         graph_->set_text(u16(print()));
+
+        core::monitor::vector_t buffer;
+        core::monitor::vector_t live;
+        {
+            boost::lock_guard<boost::mutex> buffer_lock(buffer_mutex_);
+            buffer = {static_cast<int>(buffer_.size()), buffer_capacity_};
+            if (live_latency_ > 0) {
+                live = {
+                    live_depth_ * 1000.0 / format_desc_.fps, buffer_jitter_ * 1000.0, live_dropped_, live_repeated_};
+            }
+        }
+
         boost::lock_guard<boost::mutex> lock(state_mutex_);
-        state_["file/clip"] = {start().value_or(0) / format_desc_.fps, duration().value_or(0) / format_desc_.fps};
-        state_["file/time"] = {time() / format_desc_.fps, file_duration().value_or(0) / format_desc_.fps};
-        state_["loop"]      = loop_;
+        state_["file/clip"]     = {start().value_or(0) / format_desc_.fps, duration().value_or(0) / format_desc_.fps};
+        state_["file/time"]     = {time() / format_desc_.fps, file_duration().value_or(0) / format_desc_.fps};
+        state_["loop"]          = loop_;
+        state_["speed"]         = speed_.load();
+        state_["buffer/frames"] = std::move(buffer);
+        state_["buffer/budget"] = {FrameBudget::used(), FrameBudget::limit()};
+        if (live_latency_ > 0) {
+            state_["live/latency"]  = live[0];
+            state_["live/jitter"]   = live[1];
+            state_["live/dropped"]  = live[2];
+            state_["live/repeated"] = live[3];
+        }
     }
 
     core::draw_frame prev_frame(const core::video_field field)
@@ -921,10 +1830,39 @@ struct AVProducer::Impl
         return core::draw_frame::still(frame_);
     }
 
+    // Requires buffer_mutex_.
+    bool prerolled() const
+    {
+        return static_cast<int>(buffer_.size()) >= preroll_ || (buffer_eof_ && !buffer_.empty());
+    }
+
     bool is_ready()
     {
         boost::lock_guard<boost::mutex> lock(buffer_mutex_);
-        return !buffer_.empty() || frame_;
+        return prerolled() || (buffer_eof_ && frame_) || (speed_ != 1.0 && !cache_.empty());
+    }
+
+    // Every frame up to the end was handed out, next_frame only repeats the last one.
+    bool eof() const
+    {
+        boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+        return buffer_eof_ && buffer_.empty() && frame_ && speed_ == 1.0;
+    }
+
+    // The buffered frames with their uploaded textures and the packets read ahead. Cached frames are counted by their
+    // decoded size, on the host and on the gpu alike.
+    core::memory_usage memory() const
+    {
+        core::memory_usage usage;
+        usage.host = input_.memory_usage();
+
+        boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+        for (auto& frame : buffer_) {
+            usage += core::frame_memory(frame.frame);
+        }
+        usage.host += cache_bytes_;
+        usage.device += cache_bytes_;
+        return usage;
     }
 
     core::draw_frame next_frame(const core::video_field field)
@@ -933,7 +1871,11 @@ struct AVProducer::Impl
 
         boost::lock_guard<boost::mutex> lock(buffer_mutex_);
 
-        if (buffer_.empty() || (frame_flush_ && buffer_.size() < 4)) {
+        if (speed_ != 1.0) {
+            return next_cached_frame();
+        }
+
+        if (buffer_.empty() || (frame_flush_ && !prerolled())) {
             auto start    = start_.load();
             auto duration = duration_.load();
 
@@ -949,15 +1891,25 @@ struct AVProducer::Impl
                 return core::draw_frame::still(frame_);
             }
             graph_->set_tag(diagnostics::tag_severity::WARNING, "underflow");
+            underflows_->increment();
+            if (frame_ && !frame_flush_) {
+                buffer_stalled_ = true;
+                live_repeated_ += live_latency_ > 0 ? 1 : 0;
+            }
             latency_ += 1;
             return core::draw_frame{};
         }
 
+        if (live_latency_ > 0) {
+            drift_live_buffer();
+        }
+
         if (format_desc_.field_count == 2) {
             // Check if the next frame is the correct 'field'
             auto is_field_1 = (buffer_[0].frame_count % 2) == 0;
             if ((field == core::video_field::a && !is_field_1) || (field == core::video_field::b && is_field_1)) {
                 graph_->set_tag(diagnostics::tag_severity::WARNING, "underflow");
+                underflows_->increment();
                 latency_ += 1;
                 return core::draw_frame{};
             }
@@ -977,6 +1929,7 @@ struct AVProducer::Impl
         buffer_cond_.notify_all();
 
         graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
+        buffered_frames_->set(static_cast<double>(buffer_.size()));
 
         return frame_;
     }
@@ -985,14 +1938,37 @@ struct AVProducer::Impl
     {
         CASPAR_SCOPE_EXIT { update_state(); };
 
-        seek_ = av_rescale_q(time, format_tb_, TIME_BASE_Q);
+        const auto ts = av_rescale_q(time, format_tb_, TIME_BASE_Q);
 
         {
             boost::lock_guard<boost::mutex> lock(buffer_mutex_);
-            buffer_.clear();
+
+            if (speed_ != 1.0) {
+                // Played from the cache, which decodes whatever is missing there.
+                cache_position_ = static_cast<double>(ts);
+                frame_time_     = ts;
+                return;
+            }
+
+            // A target that is already decoded only needs the frames before it dropped, as long as enough is left
+            // for next_frame not to underflow.
+            auto it = std::find_if(buffer_.begin(), buffer_.end(), [&](const Frame& frame) {
+                return frame.pts <= ts && ts < frame.pts + frame.duration;
+            });
+            if (seek_ == AV_NOPTS_VALUE && it != buffer_.end() && std::distance(it, buffer_.end()) >= preroll_) {
+                buffer_.erase(buffer_.begin(), it);
+                frame_flush_ = true;
+            } else {
+                seek_ = ts;
+                buffer_.clear();
+            }
+
             buffer_cond_.notify_all();
             graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
+            buffered_frames_->set(static_cast<double>(buffer_.size()));
         }
+
+        wakeup_.notify();
     }
 
     int64_t time() const
@@ -1010,14 +1986,49 @@ struct AVProducer::Impl
         CASPAR_SCOPE_EXIT { update_state(); };
 
         loop_ = loop;
+        wakeup_.notify();
     }
 
     bool loop() const { return loop_; }
 
+    void speed(double speed)
+    {
+        CASPAR_SCOPE_EXIT { update_state(); };
+
+        const auto previous = speed_.exchange(speed);
+        if (previous == speed) {
+            return;
+        }
+
+        if (speed == 1.0) {
+            // Back to the buffer, from the frame the cache got to.
+            {
+                boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+                cache_.clear();
+                cache_bytes_ = 0;
+            }
+            seek(time());
+        } else if (previous == 1.0) {
+            // The buffered frames have their audio, the decoders start over from the frame on air.
+            boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+            cache_.clear();
+            cache_bytes_    = 0;
+            cache_position_ = static_cast<double>(frame_time_ != AV_NOPTS_VALUE ? frame_time_ : 0);
+            cache_request_  = static_cast<int64_t>(cache_position_);
+            buffer_.clear();
+            buffer_cond_.notify_all();
+        }
+
+        wakeup_.notify();
+    }
+
+    double speed() const { return speed_; }
+
     void start(int64_t start)
     {
         CASPAR_SCOPE_EXIT { update_state(); };
         start_ = av_rescale_q(start, format_tb_, TIME_BASE_Q);
+        wakeup_.notify();
     }
 
     std::optional<int64_t> start() const
@@ -1031,6 +2042,7 @@ struct AVProducer::Impl
         CASPAR_SCOPE_EXIT { update_state(); };
 
         duration_ = av_rescale_q(duration, format_tb_, TIME_BASE_Q);
+        wakeup_.notify();
     }
 
     std::optional<int64_t> duration() const
@@ -1052,6 +2064,132 @@ struct AVProducer::Impl
     }
 
   private:
+    // Requires buffer_mutex_.
+    std::map<int64_t, Frame>::const_iterator find_cached(int64_t pts) const
+    {
+        auto it = cache_.upper_bound(pts);
+        if (it == cache_.begin()) {
+            return cache_.end();
+        }
+        --it;
+        return pts < it->first + std::max<int64_t>(it->second.duration, 1) ? it : cache_.end();
+    }
+
+    // Requires buffer_mutex_.
+    core::draw_frame next_cached_frame()
+    {
+        auto start    = start_.load();
+        auto duration = duration_.load();
+
+        start    = start != AV_NOPTS_VALUE ? start : 0;
+        auto end = duration != AV_NOPTS_VALUE ? start + duration : input_duration_.load();
+        end      = end != AV_NOPTS_VALUE ? end : INT64_MAX;
+
+        const auto speed = speed_.load();
+        const auto step  = av_rescale_q(1, format_tb_, TIME_BASE_Q);
+
+        cache_position_ += speed * static_cast<double>(step);
+        if (cache_position_ >= static_cast<double>(end)) {
+            cache_position_ = loop_ && end != INT64_MAX ? cache_position_ - static_cast<double>(end - start)
+                                                        : static_cast<double>(end - step);
+        }
+        if (cache_position_ < static_cast<double>(start)) {
+            cache_position_ = loop_ && end != INT64_MAX ? cache_position_ + static_cast<double>(end - start)
+                                                        : static_cast<double>(start);
+        }
+
+        const auto pts = static_cast<int64_t>(cache_position_);
+
+        // Once the decoders are done, the frames about a second of playback ahead are asked for in time.
+        const auto ahead = static_cast<int64_t>(cache_position_ + speed * static_cast<double>(step) * format_desc_.fps);
+        if (cache_idle_ && ahead >= start && ahead < end && find_cached(ahead) == cache_.end()) {
+            cache_request_ = ahead;
+            wakeup_.notify();
+        }
+
+        auto it = find_cached(pts);
+        if (it == cache_.end()) {
+            cache_request_ = pts;
+            wakeup_.notify();
+
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "underflow");
+            underflows_->increment();
+            return core::draw_frame::still(frame_);
+        }
+
+        frame_          = it->second.frame;
+        frame_time_     = it->second.pts;
+        frame_duration_ = it->second.duration;
+        frame_flush_    = false;
+
+        return frame_;
+    }
+
+    // Requires buffer_mutex_. Whether the decoders should go on to the frame at pts.
+    bool cache_wanted(int64_t pts) const
+    {
+        // Up to the requested frame, over frames that may be cached already.
+        if (cache_target_ != AV_NOPTS_VALUE && pts <= cache_target_) {
+            return true;
+        }
+        // Past the request, but on the side of the position that was played already.
+        if ((speed_ < 0.0 && static_cast<double>(pts) > cache_position_) ||
+            (speed_ > 0.0 && static_cast<double>(pts) < cache_position_)) {
+            return false;
+        }
+        if (find_cached(pts) != cache_.end()) {
+            return false;
+        }
+        if (cache_bytes_ < cache_budget_ || cache_.empty()) {
+            return true;
+        }
+        const auto distance = [&](int64_t time) { return std::abs(static_cast<double>(time) - cache_position_); };
+        return distance(pts) < std::max(distance(cache_.begin()->first), distance(cache_.rbegin()->first));
+    }
+
+    // Requires buffer_mutex_.
+    void cache_insert(const Frame& frame)
+    {
+        auto& cached = cache_[frame.pts];
+        cache_bytes_ += frame.size - cached.size;
+        cached       = frame;
+        // The mixer frame holds its own copy of the image, and the cache has a budget of its own.
+        cached.video  = nullptr;
+        cached.audio  = nullptr;
+        cached.budget = nullptr;
+
+        const auto distance = [&](int64_t time) { return std::abs(static_cast<double>(time) - cache_position_); };
+        while (cache_bytes_ > cache_budget_ && cache_.size() > 1) {
+            auto farthest = distance(cache_.begin()->first) > distance(cache_.rbegin()->first)
+                                ? cache_.begin()
+                                : std::prev(cache_.end());
+            cache_bytes_ -= farthest->second.size;
+            cache_.erase(farthest);
+        }
+    }
+
+    // Decodes from the keyframe before ts, or without an index, from ts when playing forward and from a second
+    // before it when playing in reverse.
+    void seek_cache(int64_t ts)
+    {
+        const auto start_time = input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0;
+
+        auto time = ts;
+        if (auto keyframe = input_.keyframe(ts + start_time)) {
+            time = *keyframe - start_time;
+        } else if (speed_ < 0.0) {
+            time = ts - AV_TIME_BASE;
+        }
+
+        {
+            boost::lock_guard<boost::mutex> buffer_lock(buffer_mutex_);
+            cache_target_ = ts;
+        }
+        cache_idle_ = false;
+
+        seek_internal(std::max<int64_t>(time, 0));
+    }
+
     bool want_packet()
     {
         return std::any_of(decoders_.begin(), decoders_.end(), [](auto& p) { return p.second.want_packet(); });
@@ -1126,6 +2264,12 @@ struct AVProducer::Impl
     void seek_internal(int64_t time)
     {
         time = time != AV_NOPTS_VALUE ? time : 0;
+
+        if (time != loop_frames_start_ || loop_frames_.size() < loop_frames_capacity_) {
+            loop_frames_.clear();
+            loop_frames_start_ = time;
+        }
+
         time = time + (input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0);
 
         // TODO (fix) Dont seek if time is close future.
@@ -1141,10 +2285,108 @@ struct AVProducer::Impl
         reset(time);
     }
 
+    // Start time, including the input start time, of the seek the next loop will do.
+    int64_t loop_start_time() const
+    {
+        auto time = start_.load();
+        time      = time != AV_NOPTS_VALUE ? time : 0;
+        if (loop_frames_start_ == time && loop_frames_.size() == loop_frames_capacity_) {
+            time = loop_frames_.back().pts + loop_frames_.back().duration;
+        }
+        return time + (input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0);
+    }
+
+    void prepare_loop()
+    {
+        const auto start_time = loop_start_time();
+        if (start_time == spare_start_) {
+            return;
+        }
+
+        {
+            boost::lock_guard<boost::mutex> buffer_lock(buffer_mutex_);
+            if (static_cast<int>(buffer_.size()) < buffer_capacity_) {
+                return;
+            }
+        }
+
+        const auto notify = [this] { wakeup_.notify(); };
+
+        spare_video_filter_ = Filter{};
+        spare_audio_filter_ = Filter{};
+
+        // No decoders are opened here, the graph sources take the parameters of the open ones or of the streams, and
+        // reset() opens decoders for the streams that have none once the spare graphs are taken.
+        // Not retried for the same start time, reset() builds the graphs again and reports the error.
+        spare_start_ = start_time;
+        try {
+            if (!audio_only_) {
+                spare_video_filter_ = Filter(vfilter_,
+                                             input_,
+                                             decoders_,
+                                             start_time,
+                                             AVMEDIA_TYPE_VIDEO,
+                                             format_desc_,
+                                             frame_factory_,
+                                             notify,
+                                             proxy_,
+                                             false);
+            }
+            spare_audio_filter_ = Filter(afilter_,
+                                         input_,
+                                         decoders_,
+                                         start_time,
+                                         AVMEDIA_TYPE_AUDIO,
+                                         format_desc_,
+                                         frame_factory_,
+                                         notify,
+                                         1,
+                                         false);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            spare_video_filter_ = Filter{};
+            spare_audio_filter_ = Filter{};
+        }
+    }
+
     void reset(int64_t start_time)
     {
-        video_filter_ = Filter(vfilter_, input_, decoders_, start_time, AVMEDIA_TYPE_VIDEO, format_desc_);
-        audio_filter_ = Filter(afilter_, input_, decoders_, start_time, AVMEDIA_TYPE_AUDIO, format_desc_);
+        const auto notify = [this] { wakeup_.notify(); };
+
+        if (start_time == spare_start_ && (spare_video_filter_.graph || spare_audio_filter_.graph)) {
+            video_filter_ = std::move(spare_video_filter_);
+            audio_filter_ = std::move(spare_audio_filter_);
+
+            for (auto filter : {&video_filter_, &audio_filter_}) {
+                for (auto& p : filter->sources) {
+                    if (decoders_.find(p.first) == decoders_.end()) {
+                        decoders_.emplace(std::piecewise_construct,
+                                          std::forward_as_tuple(p.first),
+                                          std::forward_as_tuple(input_->streams[p.first],
+                                                                frame_factory_,
+                                                                notify,
+                                                                filter->textures,
+                                                                input_.live()));
+                    }
+                }
+            }
+        } else {
+            video_filter_ = audio_only_ ? Filter{}
+                                        : Filter(vfilter_,
+                                                 input_,
+                                                 decoders_,
+                                                 start_time,
+                                                 AVMEDIA_TYPE_VIDEO,
+                                                 format_desc_,
+                                                 frame_factory_,
+                                                 notify,
+                                                 proxy_);
+            audio_filter_ = Filter(
+                afilter_, input_, decoders_, start_time, AVMEDIA_TYPE_AUDIO, format_desc_, frame_factory_, notify);
+        }
+        spare_video_filter_ = Filter{};
+        spare_audio_filter_ = Filter{};
+        spare_start_        = AV_NOPTS_VALUE;
 
         sources_.clear();
         for (auto& p : video_filter_.sources) {
@@ -1188,7 +2430,10 @@ AVProducer::AVProducer(std::shared_ptr<core::frame_factory> frame_factory,
                        std::optional<int64_t>               seek,
                        std::optional<int64_t>               duration,
                        std::optional<bool>                  loop,
-                       int                                  seekable)
+                       int                                  seekable,
+                       bool                                 audio_only,
+                       int                                  proxy,
+                       int                                  live_latency)
     : impl_(new Impl(std::move(frame_factory),
                      std::move(format_desc),
                      std::move(name),
@@ -1199,7 +2444,10 @@ AVProducer::AVProducer(std::shared_ptr<core::frame_factory> frame_factory,
                      std::move(seek),
                      std::move(duration),
                      std::move(loop.value_or(false)),
-                     seekable))
+                     seekable,
+                     audio_only,
+                     proxy,
+                     live_latency))
 {
 }
 
@@ -1209,6 +2457,10 @@ core::draw_frame AVProducer::prev_frame(const core::video_field field) { return
 
 bool AVProducer::is_ready() { return impl_->is_ready(); }
 
+bool AVProducer::eof() const { return impl_->eof(); }
+
+core::memory_usage AVProducer::memory() const { return impl_->memory(); }
+
 AVProducer& AVProducer::seek(int64_t time)
 {
     impl_->seek(time);
@@ -1223,6 +2475,14 @@ AVProducer& AVProducer::loop(bool loop)
 
 bool AVProducer::loop() const { return impl_->loop(); }
 
+AVProducer& AVProducer::speed(double speed)
+{
+    impl_->speed(speed);
+    return *this;
+}
+
+double AVProducer::speed() const { return impl_->speed(); }
+
 AVProducer& AVProducer::start(int64_t start)
 {
     impl_->start(start);
@@ -1,6 +1,7 @@
 #include <memory>
 
 #include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
 #include <core/frame/frame_factory.h>
 #include <core/monitor/monitor.h>
 #include <core/video_format.h>
@@ -24,18 +25,30 @@ class AVProducer
                std::optional<int64_t>               seek,
                std::optional<int64_t>               duration,
                std::optional<bool>                  loop,
-               int                                  seekable);
+               int                                  seekable,
+               bool                                 audio_only   = false,
+               int                                  proxy        = 1,
+               int                                  live_latency = 0);
 
     core::draw_frame prev_frame(const core::video_field field);
     core::draw_frame next_frame(const core::video_field field);
     bool             is_ready();
 
+    // Whether the last frame before the end was returned by next_frame. Never while looping.
+    bool eof() const;
+
+    core::memory_usage memory() const;
+
     AVProducer& seek(int64_t time);
     int64_t     time() const;
 
     AVProducer& loop(bool loop);
     bool        loop() const;
 
+    // Frames of playback per frame of the channel, negative in reverse. Playback at any other speed than 1 is muted.
+    AVProducer& speed(double speed);
+    double      speed() const;
+
     AVProducer& start(int64_t start);
     int64_t     start() const;
 
@@ -0,0 +1,215 @@
+#include "av_thumbnail.h"
+
+#include "av_input.h"
+
+#include "../util/av_assert.h"
+#include "../util/av_util.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+// Waiting longer than this for a packet means the file is stuck somewhere, such as on an unreachable share.
+const auto packet_timeout = std::chrono::seconds(10);
+
+std::shared_ptr<AVCodecContext> alloc_codec_context(const AVCodec* codec)
+{
+    auto ctx = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
+                                               [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
+    if (!ctx) {
+        FF_RET(AVERROR(ENOMEM), "avcodec_alloc_context3");
+    }
+    return ctx;
+}
+
+std::shared_ptr<AVFrame> convert(const std::uint8_t* const* data,
+                                 const int*                 linesize,
+                                 AVPixelFormat              src_format,
+                                 int                        width,
+                                 int                        height,
+                                 AVPixelFormat              format)
+{
+    auto dst    = alloc_frame();
+    dst->format = format;
+    dst->width  = width;
+    dst->height = height;
+    FF(av_frame_get_buffer(dst.get(), 0));
+
+    auto sws = std::shared_ptr<SwsContext>(
+        sws_getContext(width, height, src_format, width, height, format, SWS_POINT, nullptr, nullptr, nullptr),
+        sws_freeContext);
+    if (!sws) {
+        FF_RET(AVERROR(EINVAL), "sws_getContext");
+    }
+    sws_scale(sws.get(), data, linesize, 0, height, dst->data, dst->linesize);
+    return dst;
+}
+
+} // namespace
+
+core::const_frame extract_thumbnail(const std::wstring& file, core::frame_factory& frame_factory)
+{
+    std::mutex              mutex;
+    std::condition_variable cond;
+
+    // Declared after what it notifies, its thread is joined first.
+    Input input(u8(file), std::make_shared<diagnostics::graph>(), {}, [&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        cond.notify_all();
+    });
+    input.reset();
+
+    // Text files would otherwise show up as the tty demuxer's video.
+    if (std::strcmp(input->iformat->name, "tty") == 0) {
+        return {};
+    }
+
+    const auto index = av_find_best_stream(input.operator->(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (index < 0) {
+        return {};
+    }
+    const auto stream = input->streams[index];
+
+    const auto codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!codec) {
+        return {};
+    }
+
+    auto ctx = alloc_codec_context(codec);
+    FF(avcodec_parameters_to_context(ctx.get(), stream->codecpar));
+    ctx->pkt_timebase = stream->time_base;
+    ctx->skip_frame   = AVDISCARD_NONKEY;
+
+    // The default get_format picks the hardware format whenever there is a device.
+    auto hw = find_hw_decoding(codec);
+    if (hw.device) {
+        ctx->hw_device_ctx = av_buffer_ref(hw.device.get());
+    }
+    FF(avcodec_open2(ctx.get(), codec, nullptr));
+
+    // Past the slates and black of the first seconds, stills and streams without a duration start at the beginning.
+    if (input->duration > 0) {
+        input.seek((input->start_time != AV_NOPTS_VALUE ? input->start_time : 0) + input->duration / 10);
+    }
+
+    auto frame = alloc_frame();
+    while (true) {
+        auto ret = avcodec_receive_frame(ctx.get(), frame.get());
+        if (ret == 0) {
+            break;
+        }
+        if (ret == AVERROR_EOF) {
+            return {};
+        }
+        if (ret != AVERROR(EAGAIN)) {
+            FF_RET(ret, "avcodec_receive_frame");
+        }
+
+        std::shared_ptr<AVPacket> packet;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!cond.wait_for(lock, packet_timeout, [&] { return input.try_pop(packet); })) {
+                CASPAR_LOG(warning) << L"[ffmpeg] Timed out reading " << file << L" for its thumbnail.";
+                return {};
+            }
+        }
+
+        // Only keyframes are decoded, the packets in between never reach the decoder. A null packet is the end of the
+        // file, which flushes the decoder.
+        if (packet && (packet->stream_index != index || !(packet->flags & AV_PKT_FLAG_KEY))) {
+            continue;
+        }
+        FF(avcodec_send_packet(ctx.get(), packet.get()));
+    }
+
+    if (hw.device && frame->format == hw.pix_fmt) {
+        auto sw_frame = alloc_frame();
+        FF(av_hwframe_transfer_data(sw_frame.get(), frame.get(), 0));
+        frame = std::move(sw_frame);
+    }
+
+    // Formats the mixer can't upload, such as nv12 from hardware decoders or 10 bit video, go through swscale.
+    std::vector<int> data_map;
+    if (pixel_format_desc(static_cast<AVPixelFormat>(frame->format), frame->width, frame->height, data_map).format ==
+        core::pixel_format::invalid) {
+        frame = convert(frame->data,
+                        frame->linesize,
+                        static_cast<AVPixelFormat>(frame->format),
+                        frame->width,
+                        frame->height,
+                        AV_PIX_FMT_BGRA);
+    }
+
+    return make_frame(&frame_factory, frame_factory, frame, nullptr);
+}
+
+bool write_thumbnail(const array<const std::uint8_t>& bgra, int width, int height, const std::wstring& file)
+{
+    const auto codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
+    if (!codec || static_cast<int>(bgra.size()) < width * height * 4) {
+        return false;
+    }
+
+    auto ctx       = alloc_codec_context(codec);
+    ctx->width     = width;
+    ctx->height    = height;
+    ctx->pix_fmt   = AV_PIX_FMT_RGBA;
+    ctx->time_base = {1, 25};
+    FF(avcodec_open2(ctx.get(), codec, nullptr));
+
+    // The png encoder has no bgra input.
+    const std::uint8_t* const data[]     = {bgra.data()};
+    const int                 linesize[] = {width * 4};
+    auto                      frame      = convert(data, linesize, AV_PIX_FMT_BGRA, width, height, AV_PIX_FMT_RGBA);
+    frame->pts = 0;
+
+    auto packet = alloc_packet();
+    FF(avcodec_send_frame(ctx.get(), frame.get()));
+    FF(avcodec_receive_packet(ctx.get(), packet.get()));
+
+    // Written next to the thumbnail and renamed over it, so it is never listed or retrieved half written.
+    const auto temporary = file + L".tmp";
+    {
+        boost::filesystem::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(packet->data), packet->size);
+        if (!out) {
+            CASPAR_LOG(warning) << L"[ffmpeg] Failed to write " << temporary << L".";
+            return false;
+        }
+    }
+    boost::filesystem::rename(temporary, file);
+    return true;
+}
+
+}} // namespace caspar::ffmpeg
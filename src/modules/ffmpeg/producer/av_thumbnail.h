@@ -0,0 +1,20 @@
+#pragma once
+
+#include <common/array.h>
+
+#include <core/frame/frame.h>
+#include <core/fwd.h>
+
+#include <cstdint>
+#include <string>
+
+namespace caspar { namespace ffmpeg {
+
+// Decodes the first keyframe a tenth of the way into file, only looking at keyframes and with the hardware decoder
+// configured for the producer, see core::thumbnail_extractor_t. Threads it starts inherit the caller's priority.
+core::const_frame extract_thumbnail(const std::wstring& file, core::frame_factory& frame_factory);
+
+// Encodes the thumbnail with ffmpeg's png encoder, see core::thumbnail_writer_t.
+bool write_thumbnail(const array<const std::uint8_t>& bgra, int width, int height, const std::wstring& file);
+
+}} // namespace caspar::ffmpeg
@@ -26,6 +26,7 @@
 #include "av_producer.h"
 
 #include <common/env.h>
+#include <common/future.h>
 #include <common/os/filesystem.h>
 #include <common/param.h>
 
@@ -34,12 +35,22 @@
 #include <core/producer/frame_producer.h>
 #include <core/video_format.h>
 
+#include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/split.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/logic/tribool.hpp>
 #include <common/filesystem.h>
 
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <optional>
+
 #pragma warning(push, 1)
 
 extern "C" {
@@ -54,13 +65,167 @@ namespace caspar { namespace ffmpeg {
 
 using namespace std::chrono_literals;
 
+template <typename T>
+void destroy_async(std::shared_ptr<T> ptr)
+{
+    std::thread([ptr = std::move(ptr)]() mutable {
+        try {
+            ptr.reset();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }).detach();
+}
+
+// One AVProducer read by every ffmpeg_producer that plays the same clip with the same parameters. Each reader
+// keeps its own position in a short history of frames, so readers on channels that tick a little apart still get
+// the same frames.
+class shared_producer
+{
+    static const int64_t HISTORY_CAPACITY = 8;
+
+    std::mutex                   mutex_;
+    std::deque<core::draw_frame> history_;
+    int64_t                      end_ = 0;
+
+  public:
+    const std::shared_ptr<AVProducer> producer;
+
+    explicit shared_producer(std::shared_ptr<AVProducer> producer)
+        : producer(std::move(producer))
+    {
+    }
+
+    // Readers joining later start at the first frame, which is only possible until it leaves the history.
+    bool joinable()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return end_ < HISTORY_CAPACITY;
+    }
+
+    // Frame number seq of the clip, decoded when no reader got that far yet. Empty if the reader fell so far
+    // behind that the frame is no longer kept.
+    std::optional<core::draw_frame> next_frame(int64_t& seq, const core::video_field field)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (seq >= end_) {
+            auto frame = producer->next_frame(field);
+            if (frame) {
+                history_.push_back(frame);
+                end_ += 1;
+                seq = end_;
+                if (static_cast<int64_t>(history_.size()) > HISTORY_CAPACITY) {
+                    history_.pop_front();
+                }
+            }
+            return frame;
+        }
+
+        const auto begin = end_ - static_cast<int64_t>(history_.size());
+        if (seq < begin) {
+            return {};
+        }
+        return history_[seq++ - begin];
+    }
+
+    // Whether a reader at seq got every frame of the clip.
+    bool eof(int64_t seq)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return seq >= end_ && producer->eof();
+    }
+
+    static std::shared_ptr<shared_producer> find(const std::wstring&                          key,
+                                                 const std::function<std::shared_ptr<AVProducer>()>& create)
+    {
+        static std::mutex                                             mutex;
+        static std::map<std::wstring, std::weak_ptr<shared_producer>> producers;
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto it = producers.begin(); it != producers.end();) {
+            it = it->second.expired() ? producers.erase(it) : std::next(it);
+        }
+
+        auto producer = producers[key].lock();
+        if (!producer || !producer->joinable()) {
+            producer       = std::make_shared<shared_producer>(create());
+            producers[key] = producer;
+        }
+        return producer;
+    }
+};
+
 struct ffmpeg_producer : public core::frame_producer
 {
     const std::wstring                   filename_;
     spl::shared_ptr<core::frame_factory> frame_factory_;
     core::video_format_desc              format_desc_;
 
-    std::shared_ptr<AVProducer> producer_;
+    const std::wstring           path_;
+    const std::wstring           vfilter_;
+    const std::wstring           afilter_;
+    const std::optional<int64_t> start_;
+    const std::optional<int64_t> seek_;
+    const std::optional<int64_t> duration_;
+    const std::optional<bool>    loop_;
+    const int                    seekable_;
+    const bool                   audio_only_;
+    const int                    proxy_;
+    const int                    live_latency_;
+
+    std::shared_ptr<AVProducer>      producer_;
+    std::shared_ptr<shared_producer> shared_;
+    int64_t                          shared_seq_ = 0;
+
+    std::shared_ptr<AVProducer> create(std::optional<int64_t> seek) const
+    {
+        return std::make_shared<AVProducer>(frame_factory_,
+                                            format_desc_,
+                                            u8(path_),
+                                            u8(filename_),
+                                            u8(vfilter_),
+                                            u8(afilter_),
+                                            start_,
+                                            seek,
+                                            duration_,
+                                            loop_,
+                                            seekable_,
+                                            audio_only_,
+                                            proxy_,
+                                            live_latency_);
+    }
+
+    // Where this reader is in the clip. The shared decoder runs at the pace of the fastest reader, so its own time is
+    // only ours once we have a decoder of our own.
+    int64_t time() const
+    {
+        if (!shared_) {
+            return producer_->time();
+        }
+
+        const auto start    = producer_->start();
+        const auto duration = producer_->duration();
+        auto       offset   = seek_.value_or(start) - start + shared_seq_;
+        if (duration > 0 && duration != std::numeric_limits<int64_t>::max()) {
+            offset = producer_->loop() ? offset % duration : std::min(offset, duration - 1);
+        }
+        return start + std::max<int64_t>(offset, 0);
+    }
+
+    // Continues on a decoder of our own from time, leaving the others reading the shared one undisturbed.
+    void detach(int64_t time)
+    {
+        if (!shared_) {
+            return;
+        }
+
+        if (shared_.use_count() > 1) {
+            producer_ = create(time);
+        }
+        destroy_async(std::move(shared_));
+    }
 
   public:
     explicit ffmpeg_producer(spl::shared_ptr<core::frame_factory> frame_factory,
@@ -73,33 +238,43 @@ struct ffmpeg_producer : public core::frame_producer
                              std::optional<int64_t>               seek,
                              std::optional<int64_t>               duration,
                              std::optional<bool>                  loop,
-                             int                                  seekable)
+                             int                                  seekable,
+                             bool                                 audio_only,
+                             int                                  proxy,
+                             int                                  live_latency)
         : filename_(filename)
         , frame_factory_(frame_factory)
         , format_desc_(format_desc)
-        , producer_(new AVProducer(frame_factory_,
-                                   format_desc_,
-                                   u8(path),
-                                   u8(filename),
-                                   u8(vfilter),
-                                   u8(afilter),
-                                   start,
-                                   seek,
-                                   duration,
-                                   loop,
-                                   seekable))
+        , path_(std::move(path))
+        , vfilter_(std::move(vfilter))
+        , afilter_(std::move(afilter))
+        , start_(start)
+        , seek_(seek)
+        , duration_(duration)
+        , loop_(loop)
+        , seekable_(seekable)
+        , audio_only_(audio_only)
+        , proxy_(proxy)
+        , live_latency_(live_latency)
     {
+        if (env::properties().get(L"configuration.ffmpeg.producer.shared-decoding", false)) {
+            const auto key = filename_ + L"|" + vfilter_ + L"|" + afilter_ + L"|" +
+                             std::to_wstring(start_.value_or(-1)) + L"|" + std::to_wstring(seek_.value_or(-1)) + L"|" +
+                             std::to_wstring(duration_.value_or(-1)) + L"|" + std::to_wstring(loop_.value_or(false)) +
+                             L"|" + std::to_wstring(seekable_) + L"|" + std::to_wstring(audio_only_) + L"|" +
+                             std::to_wstring(proxy_) + L"|" + std::to_wstring(live_latency_) + L"|" +
+                             format_desc_.name;
+            shared_   = shared_producer::find(key, [&] { return create(seek_); });
+            producer_ = shared_->producer;
+        } else {
+            producer_ = create(seek_);
+        }
     }
 
     ~ffmpeg_producer()
     {
-        std::thread([producer = std::move(producer_)]() mutable {
-            try {
-                producer.reset();
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
-            }
-        }).detach();
+        destroy_async(std::move(shared_));
+        destroy_async(std::move(producer_));
     }
 
     // frame_producer
@@ -108,6 +283,12 @@ struct ffmpeg_producer : public core::frame_producer
 
     core::draw_frame receive_impl(const core::video_field field, int nb_samples) override
     {
+        if (shared_) {
+            if (auto frame = shared_->next_frame(shared_seq_, field)) {
+                return *frame;
+            }
+            detach(time());
+        }
         return producer_->next_frame(field);
     }
 
@@ -124,6 +305,17 @@ struct ffmpeg_producer : public core::frame_producer
 
     bool is_ready() override { return producer_->is_ready(); }
 
+    // The last frame of the clip was received, what follows are repeats of it.
+    bool eof() const { return shared_ ? shared_->eof(shared_seq_) : producer_->eof(); }
+
+    // A decoder shared with other layers is counted by each of them.
+    core::memory_usage memory() const override
+    {
+        auto usage = frame_producer::memory();
+        usage += producer_->memory();
+        return usage;
+    }
+
     std::future<std::wstring> call(const std::vector<std::wstring>& params) override
     {
         std::wstring result;
@@ -134,12 +326,23 @@ struct ffmpeg_producer : public core::frame_producer
             value = params.at(1);
         }
 
+        // Commands that change playback only apply to this producer.
+        if (!value.empty()) {
+            detach(time());
+        }
+
         if (boost::iequals(cmd, L"loop")) {
             if (!value.empty()) {
                 producer_->loop(boost::lexical_cast<bool>(value));
             }
 
             result = std::to_wstring(producer_->loop());
+        } else if (boost::iequals(cmd, L"speed")) {
+            if (!value.empty()) {
+                producer_->speed(boost::lexical_cast<double>(value));
+            }
+
+            result = std::to_wstring(producer_->speed());
         } else if (boost::iequals(cmd, L"in") || boost::iequals(cmd, L"start")) {
             if (!value.empty()) {
                 producer_->start(boost::lexical_cast<int64_t>(value));
@@ -282,8 +485,9 @@ bool is_valid_file(const boost::filesystem::path& filename)
     return av_probe_input_format2(&pb, true, &score) != nullptr;
 }
 
-spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
-                                                      const std::vector<std::wstring>&         params)
+// The producer for the clip and options of params, nullptr when ffmpeg doesn't open what params name.
+std::shared_ptr<ffmpeg_producer> create_clip(const core::frame_producer_dependencies& dependencies,
+                                             const std::vector<std::wstring>&         params)
 {
     auto name = params.at(0);
     auto path = name;
@@ -293,20 +497,38 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
         if (fullMediaPath) {
             path = fullMediaPath->wstring();
         } else {
-            return core::frame_producer::empty();
+            return nullptr;
         }
     } else if (!has_valid_extension(path) || has_invalid_protocol(path)) {
-        return core::frame_producer::empty();
+        return nullptr;
     }
 
     if (path.empty()) {
-        return core::frame_producer::empty();
+        return nullptr;
     }
 
     auto seekable = get_param(L"SEEKABLE", params, static_cast<int>(2));
 
     auto loop = contains_param(L"LOOP", params);
 
+    // Music beds and the like that only feed the audio mixer.
+    auto audio_only = contains_param(L"AUDIO_ONLY", params);
+
+    // Decodes at a half or a quarter of the width and height, for layers shown small on preview channels.
+    auto proxy = std::clamp(get_param(L"PROXY", params, 1), 1, 4);
+
+    // Plays a live stream a fixed number of milliseconds behind its source, LIVE_LATENCY or
+    // configuration.ffmpeg.producer.live-latency, instead of buffering it like a file.
+    auto live_latency = 0;
+    if (contains_param(L"LIVE", params) || contains_param(L"LIVE_LATENCY", params)) {
+        live_latency = std::clamp(
+            get_param(L"LIVE_LATENCY",
+                      params,
+                      env::properties().get(L"configuration.ffmpeg.producer.live-latency", 200)),
+            1,
+            10000);
+    }
+
     auto seek = get_param(L"SEEK", params, static_cast<uint32_t>(0));
     auto in   = get_param(L"IN", params, seek);
 
@@ -346,23 +568,203 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
     auto vfilter = get_param(L"VF", params, filter_str);
     auto afilter = get_param(L"AF", params, get_param(L"FILTER", params, L""));
 
+    return std::make_shared<ffmpeg_producer>(dependencies.frame_factory,
+                                             dependencies.format_desc,
+                                             name,
+                                             path,
+                                             vfilter,
+                                             afilter,
+                                             start,
+                                             seek2,
+                                             duration,
+                                             loop,
+                                             seekable,
+                                             audio_only,
+                                             proxy,
+                                             live_latency);
+}
+
+spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
+                                                      const std::vector<std::wstring>&         params)
+{
     try {
-        auto producer = spl::make_shared<ffmpeg_producer>(dependencies.frame_factory,
-                                                          dependencies.format_desc,
-                                                          name,
-                                                          path,
-                                                          vfilter,
-                                                          afilter,
-                                                          start,
-                                                          seek2,
-                                                          duration,
-                                                          loop,
-                                                          seekable);
-        return core::create_destroy_proxy(std::move(producer));
+        if (auto producer = create_clip(dependencies, params)) {
+            return core::create_destroy_proxy(spl::make_shared_ptr(std::move(producer)));
+        }
     } catch (...) {
         CASPAR_LOG_CURRENT_EXCEPTION();
     }
     return core::frame_producer::empty();
 }
 
+// Plays clips back to back. The next clip is opened and starts decoding while the one before it plays, and takes
+// over on the first frame after the last one of the clip before it, rather than at a time worked out from its
+// length like LOADBG AUTO does.
+class playlist_producer : public core::frame_producer
+{
+    const core::frame_producer_dependencies      dependencies_;
+    const std::vector<std::vector<std::wstring>> clips_;
+    const bool                                   loop_;
+
+    size_t                                        index_ = 0;
+    std::shared_ptr<ffmpeg_producer>              clip_;
+    size_t                                        next_index_ = 0;
+    std::future<std::shared_ptr<ffmpeg_producer>> next_;
+    int64_t                                       late_frames_ = 0;
+
+    // Opens the clip after index in the background, or none at the end of a list that doesn't loop.
+    void open_next(size_t index)
+    {
+        if (index + 1 >= clips_.size() && !loop_) {
+            return;
+        }
+        next_index_ = (index + 1) % clips_.size();
+        next_       = std::async(std::launch::async, [dependencies = dependencies_, params = clips_[next_index_]] {
+            return create_clip(dependencies, params);
+        });
+    }
+
+    // Switches to the next clip once it's open and decoded. Clips that fail to open are skipped.
+    bool cut()
+    {
+        while (next_.valid()) {
+            if (!is_ready(next_)) {
+                return false;
+            }
+
+            std::shared_ptr<ffmpeg_producer> next;
+            try {
+                next = next_.get();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+            if (!next) {
+                CASPAR_LOG(warning) << print() << L" Skipping " << clips_[next_index_].at(0) << L".";
+                open_next(next_index_);
+                continue;
+            }
+            if (!next->is_ready()) {
+                next_ = make_ready_future(std::move(next));
+                return false;
+            }
+
+            destroy_async(std::move(clip_));
+            clip_  = std::move(next);
+            index_ = next_index_;
+            open_next(index_);
+            return true;
+        }
+        return false;
+    }
+
+  public:
+    playlist_producer(const core::frame_producer_dependencies& dependencies,
+                      std::vector<std::vector<std::wstring>>   clips,
+                      bool                                     loop)
+        : dependencies_(dependencies)
+        , clips_(std::move(clips))
+        , loop_(loop)
+    {
+        clip_ = create_clip(dependencies_, clips_.at(0));
+        if (!clip_) {
+            CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(L"Could not open " + clips_.at(0).at(0) + L"."));
+        }
+        open_next(index_);
+    }
+
+    ~playlist_producer()
+    {
+        destroy_async(std::move(clip_));
+        if (next_.valid()) {
+            try {
+                destroy_async(next_.get());
+            } catch (...) {
+            }
+        }
+    }
+
+    // frame_producer
+
+    core::draw_frame last_frame(const core::video_field field) override { return clip_->last_frame(field); }
+
+    core::draw_frame receive_impl(const core::video_field field, int nb_samples) override
+    {
+        // Both fields of a frame come from the same clip.
+        if (field != core::video_field::b && clip_->eof() && next_.valid() && !cut()) {
+            if (late_frames_++ == 0 || late_frames_ % 100 == 0) {
+                CASPAR_LOG(warning) << print() << L" Next clip not ready at the cut, repeating the last frame.";
+            }
+        }
+        return clip_->receive(field, nb_samples);
+    }
+
+    std::uint32_t nb_frames() const override
+    {
+        // Only the last clip of a list that doesn't loop tells when the list ends.
+        if (loop_ || index_ + 1 < clips_.size() || clip_->nb_frames() == std::numeric_limits<std::uint32_t>::max()) {
+            return std::numeric_limits<std::uint32_t>::max();
+        }
+        const auto left = clip_->nb_frames() - std::min(clip_->frame_number(), clip_->nb_frames());
+        return frame_number() + left;
+    }
+
+    bool is_ready() override { return clip_->is_ready(); }
+
+    core::memory_usage memory() const override
+    {
+        auto usage = frame_producer::memory();
+        usage += clip_->memory();
+        return usage;
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override { return clip_->call(params); }
+
+    std::wstring print() const override
+    {
+        return L"playlist[" + std::to_wstring(index_ + 1) + L"/" + std::to_wstring(clips_.size()) + L"|" +
+               clip_->print() + L"]";
+    }
+
+    std::wstring name() const override { return L"playlist"; }
+
+    core::monitor::state state() const override
+    {
+        auto state                    = clip_->state();
+        state["playlist/index"]       = static_cast<int64_t>(index_);
+        state["playlist/count"]       = static_cast<int64_t>(clips_.size());
+        state["playlist/loop"]        = loop_;
+        state["playlist/late-frames"] = late_frames_;
+        return state;
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_playlist_producer(const core::frame_producer_dependencies& dependencies,
+                                                               const std::vector<std::wstring>&         params)
+{
+    if (params.empty() || !boost::iequals(params.at(0), L"[PLAYLIST]")) {
+        return core::frame_producer::empty();
+    }
+
+    // [PLAYLIST] "AMB SEEK 10" "GO1080P25 LENGTH 100" LOOP, each clip with the options of a PLAY of it.
+    std::vector<std::vector<std::wstring>> clips;
+    auto                                   loop = false;
+    for (auto it = params.begin() + 1; it != params.end(); ++it) {
+        if (boost::iequals(*it, L"LOOP")) {
+            loop = true;
+            continue;
+        }
+        std::vector<std::wstring> clip;
+        boost::split(clip, *it, boost::is_space(), boost::token_compress_on);
+        clip.erase(std::remove(clip.begin(), clip.end(), L""), clip.end());
+        if (!clip.empty()) {
+            clips.push_back(std::move(clip));
+        }
+    }
+    if (clips.empty()) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info("A playlist takes at least one clip."));
+    }
+
+    return core::create_destroy_proxy(spl::make_shared<playlist_producer>(dependencies, std::move(clips), loop));
+}
+
 }} // namespace caspar::ffmpeg
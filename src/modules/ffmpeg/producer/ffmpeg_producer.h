@@ -33,4 +33,9 @@ namespace caspar { namespace ffmpeg {
 spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
                                                       const std::vector<std::wstring>&         params);
 
+// [PLAYLIST] followed by clips, each a quoted name with the options of a PLAY of it, and LOOP to start over after the
+// last one.
+spl::shared_ptr<core::frame_producer> create_playlist_producer(const core::frame_producer_dependencies& dependencies,
+                                                               const std::vector<std::wstring>&         params);
+
 }} // namespace caspar::ffmpeg
@@ -2,6 +2,9 @@
 
 #include "av_assert.h"
 
+#include <common/env.h>
+#include <common/utf.h>
+
 #if defined(_MSC_VER)
 #pragma warning(push)
 #pragma warning(disable : 4244)
@@ -11,7 +14,9 @@ extern "C" {
 #include <libavfilter/avfilter.h>
 #include <libavutil/channel_layout.h>
 #include <libavutil/frame.h>
+#include <libavutil/hwcontext.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/pixfmt.h>
 }
 #if defined(_MSC_VER)
@@ -19,6 +24,9 @@ extern "C" {
 #endif
 
 #include <array>
+#include <map>
+#include <mutex>
+#include <set>
 #include <tbb/parallel_for.h>
 #include <tbb/parallel_invoke.h>
 
@@ -40,26 +48,194 @@ std::shared_ptr<AVPacket> alloc_packet()
     return packet;
 }
 
-core::mutable_frame make_frame(void*                    tag,
-                               core::frame_factory&     frame_factory,
-                               std::shared_ptr<AVFrame> video,
-                               std::shared_ptr<AVFrame> audio)
+std::shared_ptr<AVBufferRef> get_hw_device(AVHWDeviceType type)
 {
-    std::vector<int> data_map; // TODO(perf) when using data_map, avoid uploading duplicate planes
+    static std::mutex                                            mutex;
+    static std::map<AVHWDeviceType, std::shared_ptr<AVBufferRef>> devices;
 
-    const auto pix_desc =
-        video ? pixel_format_desc(static_cast<AVPixelFormat>(video->format), video->width, video->height, data_map)
-              : core::pixel_format_desc(core::pixel_format::invalid);
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = devices.find(type);
+    if (it != devices.end()) {
+        return it->second;
+    }
+
+    AVBufferRef* ref = nullptr;
+    if (av_hwdevice_ctx_create(&ref, type, nullptr, nullptr, 0) < 0) {
+        CASPAR_LOG(warning) << L"[ffmpeg] Failed to create " << av_hwdevice_get_type_name(type) << L" device.";
+        return devices[type] = nullptr;
+    }
+
+    return devices[type] = std::shared_ptr<AVBufferRef>(ref, [](AVBufferRef* ptr) { av_buffer_unref(&ptr); });
+}
+
+hw_decoding find_hw_decoding(const AVCodec* codec)
+{
+    const auto name = u8(env::properties().get(L"configuration.ffmpeg.producer.hwaccel", L"none"));
+    if (name == "none") {
+        return {};
+    }
+
+    for (int n = 0;; ++n) {
+        auto config = avcodec_get_hw_config(codec, n);
+        if (!config) {
+            break;
+        }
+        if (!(config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX)) {
+            continue;
+        }
+        if (name != "auto" && config->device_type != av_hwdevice_find_type_by_name(name.c_str())) {
+            continue;
+        }
+
+        auto device = get_hw_device(config->device_type);
+        if (device) {
+            return {std::move(device), config->device_type, config->pix_fmt};
+        }
+    }
+    return {};
+}
+
+// Planes handed out by get_frame_buffer that are still referenced by an AVBuffer. Used to recognize them in
+// make_frame, the opaque pointer of a foreign buffer can't be trusted to be one of ours.
+using frame_buffer = std::shared_ptr<array<uint8_t>>;
+
+static std::mutex                    g_frame_buffers_mutex;
+static std::set<const frame_buffer*> g_frame_buffers;
+
+static void free_frame_buffer(void* opaque, uint8_t* data)
+{
+    auto plane = static_cast<frame_buffer*>(opaque);
+    {
+        std::lock_guard<std::mutex> lock(g_frame_buffers_mutex);
+        g_frame_buffers.erase(plane);
+    }
+    delete plane;
+}
+
+static frame_buffer find_frame_buffer(const AVBufferRef* buf, const uint8_t* data)
+{
+    if (!buf) {
+        return nullptr;
+    }
+
+    auto plane = static_cast<const frame_buffer*>(av_buffer_get_opaque(buf));
+
+    std::lock_guard<std::mutex> lock(g_frame_buffers_mutex);
+    if (g_frame_buffers.find(plane) == g_frame_buffers.end() || (*plane)->data() != data) {
+        return nullptr;
+    }
+    return *plane;
+}
+
+int get_frame_buffer(core::frame_factory& frame_factory, AVCodecContext* ctx, AVFrame* frame, int flags)
+{
+    auto format = static_cast<AVPixelFormat>(frame->format);
+
+    std::vector<int> data_map;
+    const auto       pix_desc = pixel_format_desc(format, frame->width, frame->height, data_map);
+    const auto       av_desc  = av_pix_fmt_desc_get(format);
+    if (pix_desc.format == core::pixel_format::invalid || !data_map.empty() || !av_desc ||
+        (av_desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+        return avcodec_default_get_buffer2(ctx, frame, flags);
+    }
+
+    // The decoder may write up to the aligned dimensions, the planes keep the line sizes of the frame description
+    // so they can be uploaded as they are.
+    int width  = frame->width;
+    int height = frame->height;
+    int align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(ctx, &width, &height, align);
+
+    int linesizes[4];
+    if (av_image_fill_linesizes(linesizes, format, width) < 0) {
+        return avcodec_default_get_buffer2(ctx, frame, flags);
+    }
+
+    for (size_t n = 0; n < pix_desc.planes.size(); ++n) {
+        auto linesize = pix_desc.planes[n].linesize;
+        if (linesize < linesizes[n] || linesize % align[n] != 0) {
+            return avcodec_default_get_buffer2(ctx, frame, flags);
+        }
+    }
+
+    for (size_t n = 0; n < pix_desc.planes.size(); ++n) {
+        auto plane_height = n == 1 || n == 2 ? AV_CEIL_RSHIFT(height, av_desc->log2_chroma_h) : height;
+        // Same padding as the default allocator, some decoders read a little past the end.
+        auto size = pix_desc.planes[n].linesize * plane_height + 16 + 64 - 1;
+
+        auto plane = new frame_buffer(std::make_shared<array<uint8_t>>(frame_factory.create_array(size)));
+        {
+            std::lock_guard<std::mutex> lock(g_frame_buffers_mutex);
+            g_frame_buffers.insert(plane);
+        }
+
+        frame->buf[n] = av_buffer_create((*plane)->data(), size, free_frame_buffer, plane, 0);
+        if (!frame->buf[n]) {
+            free_frame_buffer(plane, nullptr);
+            for (size_t i = 0; i < n; ++i) {
+                av_buffer_unref(&frame->buf[i]);
+            }
+            return AVERROR(ENOMEM);
+        }
+
+        frame->data[n]     = (*plane)->data();
+        frame->linesize[n] = pix_desc.planes[n].linesize;
+    }
+    frame->extended_data = frame->data;
+
+    return 0;
+}
 
-    auto frame = frame_factory.create_frame(tag, pix_desc);
+// The audio keeps the channels of the stream, the mixer maps them to the ones of the channel.
+template <typename T>
+static void copy_audio(array<T>& dst, const T* src, const AVFrame& audio)
+{
+    dst = std::vector<T>(src, src + static_cast<size_t>(audio.nb_samples) * audio.channels);
+}
+
+static core::mutable_frame make_frame(void*                           tag,
+                                      core::frame_factory&            frame_factory,
+                                      const std::shared_ptr<AVFrame>& video,
+                                      const std::shared_ptr<AVFrame>& audio,
+                                      const core::pixel_format_desc&  pix_desc,
+                                      const std::vector<int>&         data_map)
+{
+    // Frames decoded by get_frame_buffer that reach us untouched already sit in upload memory.
+    core::image_data_t planes;
+    if (video && data_map.empty()) {
+        for (int n = 0; n < static_cast<int>(pix_desc.planes.size()); ++n) {
+            auto plane = find_frame_buffer(video->buf[n], video->data[n]);
+            if (!plane || video->linesize[n] != pix_desc.planes[n].linesize ||
+                plane->size() < static_cast<size_t>(pix_desc.planes[n].size)) {
+                planes.clear();
+                break;
+            }
+            // Shares the mixer buffer with the AVFrame, which is never written to again after decoding.
+            planes.emplace_back(plane->data(), plane->size(), plane);
+        }
+    }
+
+    auto zero_copy = !planes.empty();
+    auto frame     = zero_copy ? frame_factory.create_frame(tag, pix_desc, std::move(planes))
+                               : frame_factory.create_frame(tag, pix_desc);
 
     tbb::parallel_invoke(
         [&]() {
-            if (video) {
+            if (video && !zero_copy) {
                 for (int n = 0; n < static_cast<int>(pix_desc.planes.size()); ++n) {
                     auto frame_plan_index = data_map.empty() ? n : data_map.at(n);
+                    // Planes of blocks have a row for every 4 lines.
+                    auto rows = pix_desc.planes[n].size / pix_desc.planes[n].linesize;
+
+                    if (video->linesize[frame_plan_index] == pix_desc.planes[n].linesize) {
+                        std::memcpy(frame.image_data(n).begin(),
+                                    video->data[frame_plan_index],
+                                    static_cast<size_t>(pix_desc.planes[n].linesize) * rows);
+                        continue;
+                    }
 
-                    tbb::parallel_for(0, pix_desc.planes[n].height, [&](int y) {
+                    tbb::parallel_for(0, rows, [&](int y) {
                         std::memcpy(frame.image_data(n).begin() + y * pix_desc.planes[n].linesize,
                                     video->data[frame_plan_index] + y * video->linesize[frame_plan_index],
                                     pix_desc.planes[n].linesize);
@@ -69,23 +245,11 @@ core::mutable_frame make_frame(void*                    tag,
         },
         [&]() {
             if (audio) {
-                const int channel_count = 16;
-                frame.audio_data()      = std::vector<int32_t>(audio->nb_samples * channel_count, 0);
-
-                if (audio->channels == channel_count) {
-                    std::memcpy(frame.audio_data().data(),
-                                reinterpret_cast<int32_t*>(audio->data[0]),
-                                sizeof(int32_t) * channel_count * audio->nb_samples);
+                frame.audio_channels() = audio->channels;
+                if (audio->format == AV_SAMPLE_FMT_FLT) {
+                    copy_audio(frame.audio_data_float(), reinterpret_cast<const float*>(audio->data[0]), *audio);
                 } else {
-                    // This isn't pretty, but some callers may not provide 16 channels
-
-                    auto dst = frame.audio_data().data();
-                    auto src = reinterpret_cast<int32_t*>(audio->data[0]);
-                    for (auto i = 0; i < audio->nb_samples; i++) {
-                        for (auto j = 0; j < std::min(channel_count, audio->channels); ++j) {
-                            dst[i * channel_count + j] = src[i * audio->channels + j];
-                        }
-                    }
+                    copy_audio(frame.audio_data(), reinterpret_cast<const int32_t*>(audio->data[0]), *audio);
                 }
             }
         });
@@ -93,6 +257,34 @@ core::mutable_frame make_frame(void*                    tag,
     return frame;
 }
 
+core::mutable_frame make_frame(void*                    tag,
+                               core::frame_factory&     frame_factory,
+                               std::shared_ptr<AVFrame> video,
+                               std::shared_ptr<AVFrame> audio)
+{
+    std::vector<int> data_map;
+
+    const auto pix_desc =
+        video ? pixel_format_desc(static_cast<AVPixelFormat>(video->format), video->width, video->height, data_map)
+              : core::pixel_format_desc(core::pixel_format::invalid);
+
+    return make_frame(tag, frame_factory, video, audio, pix_desc, data_map);
+}
+
+core::mutable_frame make_frame(void*                          tag,
+                               core::frame_factory&           frame_factory,
+                               std::shared_ptr<AVFrame>       video,
+                               std::shared_ptr<AVFrame>       audio,
+                               const core::pixel_format_desc& texture_desc)
+{
+    return make_frame(tag,
+                      frame_factory,
+                      video,
+                      audio,
+                      video ? texture_desc : core::pixel_format_desc(core::pixel_format::invalid),
+                      std::vector<int>{});
+}
+
 core::pixel_format get_pixel_format(AVPixelFormat pix_fmt)
 {
     switch (pix_fmt) {
@@ -128,6 +320,28 @@ core::pixel_format get_pixel_format(AVPixelFormat pix_fmt)
             return core::pixel_format::ycbcra;
         case AV_PIX_FMT_UYVY422:
             return core::pixel_format::uyvy;
+        case AV_PIX_FMT_NV12:
+            return core::pixel_format::nv12;
+        case AV_PIX_FMT_P010LE:
+        case AV_PIX_FMT_P016LE:
+            return core::pixel_format::p010;
+        case AV_PIX_FMT_YUV420P10LE:
+        case AV_PIX_FMT_YUV422P10LE:
+        case AV_PIX_FMT_YUV444P10LE:
+        case AV_PIX_FMT_YUV420P12LE:
+        case AV_PIX_FMT_YUV422P12LE:
+        case AV_PIX_FMT_YUV444P12LE:
+        case AV_PIX_FMT_YUV420P16LE:
+        case AV_PIX_FMT_YUV422P16LE:
+        case AV_PIX_FMT_YUV444P16LE:
+            return core::pixel_format::ycbcr16;
+        case AV_PIX_FMT_YUVA420P10LE:
+        case AV_PIX_FMT_YUVA422P10LE:
+        case AV_PIX_FMT_YUVA444P10LE:
+        case AV_PIX_FMT_YUVA420P16LE:
+        case AV_PIX_FMT_YUVA422P16LE:
+        case AV_PIX_FMT_YUVA444P16LE:
+            return core::pixel_format::ycbcra16;
         default:
             return core::pixel_format::invalid;
     }
@@ -160,7 +374,9 @@ core::pixel_format_desc pixel_format_desc(AVPixelFormat pix_fmt, int width, int
             return desc;
         }
         case core::pixel_format::ycbcr:
-        case core::pixel_format::ycbcra: {
+        case core::pixel_format::ycbcra:
+        case core::pixel_format::ycbcr16:
+        case core::pixel_format::ycbcra16: {
             // Find chroma height
             // av_image_fill_plane_sizes is not available until ffmpeg 4.4, but we still need to support ffmpeg 4.2, so
             // we fall back to calling av_image_fill_pointers with a NULL image buffer. We can't unconditionally use
@@ -179,23 +395,32 @@ core::pixel_format_desc pixel_format_desc(AVPixelFormat pix_fmt, int width, int
 #endif
             auto h2 = size2 / linesizes[1];
 
-            desc.planes.push_back(core::pixel_format_desc::plane(linesizes[0], height, 1));
-            desc.planes.push_back(core::pixel_format_desc::plane(linesizes[1], h2, 1));
-            desc.planes.push_back(core::pixel_format_desc::plane(linesizes[2], h2, 1));
+            // Planes of 16 bit samples are twice as wide in bytes as in samples.
+            const auto bytes = core::is_16_bit(desc.format) ? 2 : 1;
+            desc.depth       = av_pix_fmt_desc_get(pix_fmt)->comp[0].depth;
+
+            desc.planes.push_back(core::pixel_format_desc::plane(linesizes[0] / bytes, height, bytes));
+            desc.planes.push_back(core::pixel_format_desc::plane(linesizes[1] / bytes, h2, bytes));
+            desc.planes.push_back(core::pixel_format_desc::plane(linesizes[2] / bytes, h2, bytes));
 
-            if (desc.format == core::pixel_format::ycbcra)
-                desc.planes.push_back(core::pixel_format_desc::plane(linesizes[3], height, 1));
+            if (desc.format == core::pixel_format::ycbcra || desc.format == core::pixel_format::ycbcra16)
+                desc.planes.push_back(core::pixel_format_desc::plane(linesizes[3] / bytes, height, bytes));
 
             return desc;
         }
+        case core::pixel_format::nv12:
+        case core::pixel_format::p010: {
+            // A plane of Cb Cr pairs, sampled as two channel texels.
+            const auto bytes = desc.format == core::pixel_format::p010 ? 2 : 1;
+            const auto h2    = AV_CEIL_RSHIFT(height, av_pix_fmt_desc_get(pix_fmt)->log2_chroma_h);
+
+            desc.planes.push_back(core::pixel_format_desc::plane(linesizes[0] / bytes, height, bytes));
+            desc.planes.push_back(core::pixel_format_desc::plane(linesizes[1] / (bytes * 2), h2, bytes * 2));
+            return desc;
+        }
         case core::pixel_format::uyvy: {
-            desc.planes.push_back(core::pixel_format_desc::plane(linesizes[0] / 2, height, 2));
+            // One texel per pair of pixels, the shader picks Y from it by the column.
             desc.planes.push_back(core::pixel_format_desc::plane(linesizes[0] / 4, height, 4));
-
-            data_map.clear();
-            data_map.push_back(0);
-            data_map.push_back(0);
-
             return desc;
         }
         default:
@@ -265,6 +490,19 @@ std::shared_ptr<AVFrame> make_av_video_frame(const core::const_frame& frame, con
         case core::pixel_format::ycbcra:
             av_frame->format = AVPixelFormat::AV_PIX_FMT_YUVA420P;
             break;
+        case core::pixel_format::nv12:
+            av_frame->format = AVPixelFormat::AV_PIX_FMT_NV12;
+            break;
+        case core::pixel_format::p010:
+            av_frame->format = AVPixelFormat::AV_PIX_FMT_P010LE;
+            break;
+        case core::pixel_format::uyva:
+        case core::pixel_format::ycbcr16:
+        case core::pixel_format::ycbcra16:
+        case core::pixel_format::bc1:
+        case core::pixel_format::bc3:
+        case core::pixel_format::bc3_ycocg:
+        case core::pixel_format::bc7:
         case core::pixel_format::count:
         case core::pixel_format::invalid:
             break;
@@ -1,4 +1,7 @@
 #include <libavutil/pixfmt.h>
+extern "C" {
+#include <libavutil/hwcontext.h>
+}
 
 #include <core/frame/frame.h>
 #include <core/frame/frame_factory.h>
@@ -14,18 +17,44 @@ struct AVPacket;
 struct AVFilterContext;
 struct AVCodecContext;
 struct AVDictionary;
+struct AVBufferRef;
+struct AVCodec;
 
 namespace caspar { namespace ffmpeg {
 
 std::shared_ptr<AVFrame>  alloc_frame();
 std::shared_ptr<AVPacket> alloc_packet();
 
+// Hardware devices are shared by every decoder and encoder of the same type, nullptr if the device couldn't be
+// created.
+std::shared_ptr<AVBufferRef> get_hw_device(AVHWDeviceType type);
+
+// The hardware decoding configuration.ffmpeg.producer.hwaccel picks for codec, with the pixel format of the frames it
+// decodes. No device when it's off or nothing that supports the codec could be opened.
+struct hw_decoding
+{
+    std::shared_ptr<AVBufferRef> device;
+    AVHWDeviceType               type    = AV_HWDEVICE_TYPE_NONE;
+    AVPixelFormat                pix_fmt = AV_PIX_FMT_NONE;
+};
+hw_decoding find_hw_decoding(const AVCodec* codec);
+
 core::pixel_format      get_pixel_format(AVPixelFormat pix_fmt);
 core::pixel_format_desc pixel_format_desc(AVPixelFormat pix_fmt, int width, int height, std::vector<int>& data_map);
 core::mutable_frame     make_frame(void*                    tag,
                                    core::frame_factory&     frame_factory,
                                    std::shared_ptr<AVFrame> video,
                                    std::shared_ptr<AVFrame> audio);
+// For the frames of Hap textures, which hold the blocks of texture_desc in rows of a GRAY8 image.
+core::mutable_frame make_frame(void*                          tag,
+                               core::frame_factory&           frame_factory,
+                               std::shared_ptr<AVFrame>       video,
+                               std::shared_ptr<AVFrame>       audio,
+                               const core::pixel_format_desc& texture_desc);
+
+// get_buffer2 implementation allocating the planes from frame_factory. make_frame then builds the frame on them
+// without copying, as long as nothing in between replaced the buffers.
+int get_frame_buffer(core::frame_factory& frame_factory, AVCodecContext* ctx, AVFrame* frame, int flags);
 
 std::shared_ptr<AVFrame> make_av_video_frame(const core::const_frame& frame, const core::video_format_desc& format_des);
 std::shared_ptr<AVFrame> make_av_audio_frame(const core::const_frame& frame, const core::video_format_desc& format_des);
@@ -0,0 +1,345 @@
+#include "hap.h"
+
+#include "av_assert.h"
+
+#include <common/except.h>
+
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/common.h>
+}
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#endif
+
+#include <tbb/parallel_for.h>
+
+#include <cstring>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+// Second-stage compressors, the high nibble of a section type.
+enum compressor
+{
+    compressor_none    = 0xA,
+    compressor_snappy  = 0xB,
+    compressor_complex = 0xC,
+};
+
+// Section types inside the decode instructions of a complex frame.
+enum instruction
+{
+    instruction_container   = 0x01,
+    instruction_compressors = 0x02,
+    instruction_sizes       = 0x03,
+    instruction_offsets     = 0x04,
+};
+
+struct section
+{
+    int                 type = 0;
+    const std::uint8_t* data = nullptr;
+    std::uint32_t       size = 0;
+};
+
+std::uint32_t read_le(const std::uint8_t* data, int count)
+{
+    std::uint32_t value = 0;
+    for (int n = count; n-- > 0;) {
+        value = value << 8 | data[n];
+    }
+    return value;
+}
+
+[[noreturn]] void invalid_data(const char* what)
+{
+    CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_api_function(what) << msg_info_t("invalid hap frame")
+                                            << ffmpeg_errn_info(AVERROR_INVALIDDATA));
+}
+
+// A section header is a 24 bit size and a type, followed by a 32 bit size when the first one is 0.
+section read_section(const std::uint8_t*& data, const std::uint8_t* end)
+{
+    if (end - data < 4) {
+        invalid_data("hap section header");
+    }
+
+    section result;
+    result.size = read_le(data, 3);
+    result.type = data[3];
+    data += 4;
+
+    if (result.size == 0) {
+        if (end - data < 4) {
+            invalid_data("hap section header");
+        }
+        result.size = read_le(data, 4);
+        data += 4;
+    }
+
+    if (static_cast<std::uint32_t>(end - data) < result.size) {
+        invalid_data("hap section size");
+    }
+
+    result.data = data;
+    data += result.size;
+    return result;
+}
+
+// Snappy as written by Hap, a varint length followed by literals and copies of what was already written.
+bool snappy_length(const std::uint8_t* data, std::uint32_t size, std::uint32_t& length, std::uint32_t& header)
+{
+    length = 0;
+    for (header = 0; header < size && header < 5; ++header) {
+        length |= static_cast<std::uint32_t>(data[header] & 0x7F) << (7 * header);
+        if (!(data[header] & 0x80)) {
+            header += 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+void snappy_decode(const std::uint8_t* data, std::uint32_t size, std::uint8_t* dest, std::uint32_t dest_size)
+{
+    std::uint32_t length = 0;
+    std::uint32_t header = 0;
+    if (!snappy_length(data, size, length, header) || length != dest_size) {
+        invalid_data("hap snappy length");
+    }
+
+    const auto    end = data + size;
+    auto          src = data + header;
+    std::uint32_t pos = 0;
+
+    while (src < end) {
+        const auto tag = *src++;
+
+        if ((tag & 3) == 0) {
+            std::uint32_t literal = tag >> 2;
+            if (literal >= 60) {
+                // The length minus one follows in 1 to 4 bytes.
+                const auto count = static_cast<int>(literal) - 59;
+                if (end - src < count) {
+                    invalid_data("hap snappy literal");
+                }
+                literal = read_le(src, count);
+                src += count;
+            }
+            literal += 1;
+
+            if (static_cast<std::uint32_t>(end - src) < literal || dest_size - pos < literal) {
+                invalid_data("hap snappy literal");
+            }
+            std::memcpy(dest + pos, src, literal);
+            src += literal;
+            pos += literal;
+            continue;
+        }
+
+        std::uint32_t copy   = 0;
+        std::uint32_t offset = 0;
+        const auto    count  = (tag & 3) == 1 ? 1 : (tag & 3) == 2 ? 2 : 4;
+        if (end - src < count) {
+            invalid_data("hap snappy copy");
+        }
+        if (count == 1) {
+            copy   = 4 + ((tag >> 2) & 7);
+            offset = (tag >> 5) << 8 | *src;
+        } else {
+            copy   = (tag >> 2) + 1;
+            offset = read_le(src, count);
+        }
+        src += count;
+
+        if (offset == 0 || offset > pos || dest_size - pos < copy) {
+            invalid_data("hap snappy copy");
+        }
+        // Copies may overlap what they write, repeating the last offset bytes.
+        for (auto out = dest + pos, in = out - offset; copy > 0; --copy, ++pos) {
+            *out++ = *in++;
+        }
+    }
+
+    if (pos != dest_size) {
+        invalid_data("hap snappy length");
+    }
+}
+
+void decode_chunk(int                 compressor,
+                  const std::uint8_t* data,
+                  std::uint32_t       size,
+                  std::uint8_t*       dest,
+                  std::uint32_t       dest_size)
+{
+    if (compressor == compressor_none) {
+        if (size != dest_size) {
+            invalid_data("hap chunk size");
+        }
+        std::memcpy(dest, data, size);
+    } else if (compressor == compressor_snappy) {
+        snappy_decode(data, size, dest, dest_size);
+    } else {
+        invalid_data("hap chunk compressor");
+    }
+}
+
+// The chunks of a complex frame are compressed independently, and are decoded in parallel.
+void decode_complex(const section& frame, std::uint8_t* dest, std::uint32_t dest_size)
+{
+    auto       data         = frame.data;
+    const auto end          = frame.data + frame.size;
+    const auto instructions = read_section(data, end);
+    if (instructions.type != instruction_container) {
+        invalid_data("hap decode instructions");
+    }
+
+    section compressors;
+    section sizes;
+    section offsets;
+    for (auto pos = instructions.data; pos < instructions.data + instructions.size;) {
+        const auto instruction = read_section(pos, instructions.data + instructions.size);
+        if (instruction.type == instruction_compressors) {
+            compressors = instruction;
+        } else if (instruction.type == instruction_sizes) {
+            sizes = instruction;
+        } else if (instruction.type == instruction_offsets) {
+            offsets = instruction;
+        }
+    }
+
+    const auto count = compressors.size;
+    if (count == 0 || sizes.size != count * 4 || (offsets.data && offsets.size != count * 4)) {
+        invalid_data("hap decode instructions");
+    }
+
+    struct chunk
+    {
+        const std::uint8_t* data;
+        std::uint32_t       size;
+        std::uint8_t*       dest;
+        std::uint32_t       dest_size;
+    };
+
+    std::vector<chunk> chunks(count);
+    std::uint32_t      input  = 0;
+    std::uint32_t      output = 0;
+    for (std::uint32_t n = 0; n < count; ++n) {
+        auto& chunk = chunks[n];
+        chunk.size  = read_le(sizes.data + n * 4, 4);
+
+        // Offsets are from the end of the decode instructions, chunks without them follow each other.
+        auto offset    = offsets.data ? read_le(offsets.data + n * 4, 4) : input;
+        auto available = static_cast<std::uint32_t>(end - data);
+        if (offset > available || available - offset < chunk.size) {
+            invalid_data("hap chunk size");
+        }
+        chunk.data = data + offset;
+        input      = offset + chunk.size;
+
+        std::uint32_t header = 0;
+        if (compressors.data[n] == compressor_none) {
+            chunk.dest_size = chunk.size;
+        } else if (!snappy_length(chunk.data, chunk.size, chunk.dest_size, header)) {
+            invalid_data("hap snappy length");
+        }
+        if (dest_size - output < chunk.dest_size) {
+            invalid_data("hap chunk size");
+        }
+        chunk.dest = dest + output;
+        output += chunk.dest_size;
+    }
+
+    if (output != dest_size) {
+        invalid_data("hap texture size");
+    }
+
+    tbb::parallel_for(std::uint32_t{0}, count, [&](std::uint32_t n) {
+        const auto& chunk = chunks[n];
+        decode_chunk(compressors.data[n], chunk.data, chunk.size, chunk.dest, chunk.dest_size);
+    });
+}
+
+// The texture format of a section type, the low nibble.
+int texture_code(core::pixel_format format)
+{
+    switch (format) {
+        case core::pixel_format::bc1:
+            return 0xB;
+        case core::pixel_format::bc3:
+            return 0xE;
+        case core::pixel_format::bc3_ycocg:
+            return 0xF;
+        case core::pixel_format::bc7:
+            return 0xC;
+        default:
+            return -1;
+    }
+}
+
+} // namespace
+
+core::pixel_format_desc hap_texture_desc(const AVCodecParameters& codecpar)
+{
+    core::pixel_format_desc desc(core::pixel_format::invalid);
+    if (codecpar.codec_id != AV_CODEC_ID_HAP || codecpar.width <= 0 || codecpar.height <= 0) {
+        return desc;
+    }
+
+    int block_size = 16;
+    switch (codecpar.codec_tag) {
+        case MKTAG('H', 'a', 'p', '1'):
+            desc.format = core::pixel_format::bc1;
+            block_size  = 8;
+            break;
+        case MKTAG('H', 'a', 'p', '5'):
+            desc.format = core::pixel_format::bc3;
+            break;
+        case MKTAG('H', 'a', 'p', 'Y'):
+            desc.format = core::pixel_format::bc3_ycocg;
+            break;
+        case MKTAG('H', 'a', 'p', '7'):
+            desc.format = core::pixel_format::bc7;
+            break;
+        default:
+            return desc;
+    }
+
+    desc.planes.push_back(core::pixel_format_desc::plane::blocks(codecpar.width, codecpar.height, block_size));
+    return desc;
+}
+
+void decode_hap(const std::uint8_t* data, int size, const core::pixel_format_desc& desc, std::uint8_t* dest)
+{
+    if (!data || size < 0 || desc.planes.size() != 1) {
+        invalid_data("hap frame");
+    }
+
+    auto       pos   = data;
+    const auto frame = read_section(pos, data + size);
+    if ((frame.type & 0xF) != texture_code(desc.format)) {
+        invalid_data("hap texture format");
+    }
+
+    const auto dest_size = static_cast<std::uint32_t>(desc.planes[0].size);
+    switch (frame.type >> 4) {
+        case compressor_none:
+        case compressor_snappy:
+            decode_chunk(frame.type >> 4, frame.data, frame.size, dest, dest_size);
+            break;
+        case compressor_complex:
+            decode_complex(frame, dest, dest_size);
+            break;
+        default:
+            invalid_data("hap compressor");
+    }
+}
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <core/frame/pixel_format.h>
+
+#include <cstdint>
+
+struct AVCodecParameters;
+
+namespace caspar { namespace ffmpeg {
+
+// The block compressed texture a Hap stream is made of, with its single plane of blocks. Invalid for anything else,
+// and for the variants that don't fit one texture (Hap Alpha Only and Hap Q Alpha), which are decoded by ffmpeg.
+core::pixel_format_desc hap_texture_desc(const AVCodecParameters& codecpar);
+
+// Unpacks the texture of a Hap frame into dest, the plane of desc, without decompressing the blocks.
+void decode_hap(const std::uint8_t* data, int size, const core::pixel_format_desc& desc, std::uint8_t* dest);
+
+}} // namespace caspar::ffmpeg
@@ -36,6 +36,7 @@
 #include <boost/range/algorithm/remove_if.hpp>
 
 #include <memory>
+#include <mutex>
 #include <utility>
 
 #pragma warning(push)
@@ -164,6 +165,31 @@ class renderer_application
 
     void OnBrowserDestroyed(CefRefPtr<CefBrowser> browser) override { contexts_.clear(); }
 
+    bool OnProcessMessageReceived(CefRefPtr<CefBrowser>        browser,
+                                  CefRefPtr<CefFrame>          frame,
+                                  CefProcessId                 source_process,
+                                  CefRefPtr<CefProcessMessage> message) override
+    {
+        if (message->GetName().ToString() != MEMORY_REQUEST_MESSAGE_NAME || !frame->IsMain()) {
+            return false;
+        }
+
+        auto context = frame->GetV8Context();
+        if (!context) {
+            return true;
+        }
+
+        const auto                javascript = "performance.memory ? performance.memory.usedJSHeapSize : 0";
+        CefRefPtr<CefV8Value>     ret;
+        CefRefPtr<CefV8Exception> exception;
+        if (context->Eval(javascript, CefString(), 1, ret, exception) && ret && ret->IsDouble()) {
+            auto msg = CefProcessMessage::Create(MEMORY_MESSAGE_NAME);
+            msg->GetArgumentList()->SetDouble(0, ret->GetDoubleValue());
+            frame->SendProcessMessage(PID_BROWSER, msg);
+        }
+        return true;
+    }
+
     void OnBeforeCommandLineProcessing(const CefString& process_type, CefRefPtr<CefCommandLine> command_line) override
     {
         if (enable_gpu_) {
@@ -183,6 +209,25 @@ class renderer_application
         command_line->AppendSwitchWithValue("autoplay-policy", "no-user-gesture-required");
         command_line->AppendSwitchWithValue("remote-allow-origins", "*");
 
+        if (process_type.empty()) {
+            // Templates of the same site share a render process rather than starting one each, and a limit caps the
+            // processes started for the others.
+            if (env::properties().get(L"configuration.html.process-per-site", false)) {
+                command_line->AppendSwitch("process-per-site");
+            }
+            auto process_limit = env::properties().get(L"configuration.html.renderer-process-limit", 0);
+            if (process_limit > 0) {
+                command_line->AppendSwitchWithValue("renderer-process-limit", std::to_string(process_limit));
+            }
+
+            // Passed on to the render processes.
+            auto heap_limit = env::properties().get(L"configuration.html.js-heap-limit", 0);
+            if (heap_limit > 0) {
+                command_line->AppendSwitchWithValue("js-flags", "--max-old-space-size=" + std::to_string(heap_limit));
+            }
+            command_line->AppendSwitch("enable-precise-memory-info");
+        }
+
         if (process_type.empty() && !enable_gpu_) {
             // This gives more performance, but disabled gpu effects. Without it a single 1080p producer cannot be run
             // smoothly
@@ -207,32 +252,72 @@ bool intercept_command_line(int argc, char** argv)
     return CefExecuteProcess(main_args, CefRefPtr<CefApp>(new renderer_application(false)), nullptr) >= 0;
 }
 
-void init(const core::module_dependencies& dependencies)
-{
-    dependencies.producer_registry->register_producer_factory(L"HTML Producer", html::create_producer);
+namespace {
 
-    CefMainArgs main_args;
-    g_cef_executor = std::make_unique<executor>(L"cef");
-    g_cef_executor->invoke([&] {
+std::once_flag           g_cef_once;
+std::shared_future<void> g_cef_started;
+
+void initialize_cef()
+{
 #ifdef WIN32
-        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
 #endif
-        const bool enable_gpu = env::properties().get(L"configuration.html.enable-gpu", false);
+    const bool enable_gpu = env::properties().get(L"configuration.html.enable-gpu", false);
 
-        CefSettings settings;
-        settings.command_line_args_disabled   = false;
-        settings.no_sandbox                   = true;
-        settings.remote_debugging_port        = env::properties().get(L"configuration.html.remote-debugging-port", 0);
-        settings.windowless_rendering_enabled = true;
+    CefMainArgs main_args;
+    CefSettings settings;
+    settings.command_line_args_disabled   = false;
+    settings.no_sandbox                   = true;
+    settings.remote_debugging_port        = env::properties().get(L"configuration.html.remote-debugging-port", 0);
+    settings.windowless_rendering_enabled = true;
+
+    auto cache_path = env::properties().get(L"configuration.html.cache-path", L"");
+    if (!cache_path.empty()) {
+        CefString(&settings.cache_path).FromWString(cache_path);
+    }
 
-        auto cache_path = env::properties().get(L"configuration.html.cache-path", L"");
-        if (!cache_path.empty()) {
-            CefString(&settings.cache_path).FromWString(cache_path);
-        }
+    CefInitialize(main_args, settings, CefRefPtr<CefApp>(new renderer_application(enable_gpu)), nullptr);
+}
 
-        CefInitialize(main_args, settings, CefRefPtr<CefApp>(new renderer_application(enable_gpu)), nullptr);
+// Starts CEF on an executor of its own, whose thread then runs the message loop, once for the process.
+void start_cef()
+{
+    std::call_once(g_cef_once, [] {
+        CASPAR_LOG(info) << L"[html] Starting CEF.";
+
+        g_cef_executor = std::make_unique<executor>(L"cef");
+        g_cef_started  = g_cef_executor->begin_invoke([] { initialize_cef(); }).share();
+        g_cef_executor->begin_invoke([] { CefRunMessageLoop(); });
     });
-    g_cef_executor->begin_invoke([&] { CefRunMessageLoop(); });
+}
+
+} // namespace
+
+void require_cef()
+{
+    start_cef();
+    g_cef_started.get();
+}
+
+void init(const core::module_dependencies& dependencies)
+{
+    dependencies.producer_registry->register_producer_factory(
+        L"HTML Producer", html::create_producer, {{L"[HTML]"}, {L"http", L"https"}, {L".html"}});
+
+    // CEF takes seconds and hundreds of MB to start, which servers that never load a template don't spend.
+    switch (core::get_module_init()) {
+        case core::module_init::eager:
+            require_cef();
+            break;
+        case core::module_init::background:
+            if (env::properties().get_child_optional(L"configuration.html")) {
+                start_cef();
+            }
+            break;
+        case core::module_init::lazy:
+            break;
+    }
+
     dependencies.cg_registry->register_cg_producer(
         L"html",
         {L".html"},
@@ -252,6 +337,17 @@ void init(const core::module_dependencies& dependencies)
 
 void uninit()
 {
+    // Never started, or not yet when the server stops.
+    if (!g_cef_executor) {
+        return;
+    }
+    try {
+        g_cef_started.get();
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+    }
+
+    clear_browser_pool();
     invoke([] { CefQuitMessageLoop(); });
     g_cef_executor->begin_invoke([&] { CefShutdown(); });
     g_cef_executor.reset();
@@ -292,6 +388,8 @@ void invoke(const std::function<void()>& func) { begin_invoke(func).get(); }
 
 std::future<void> begin_invoke(const std::function<void()>& func)
 {
+    require_cef();
+
     CefRefPtr<cef_task> task = new cef_task(func);
 
     if (CefCurrentlyOn(TID_UI)) {
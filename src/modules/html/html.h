@@ -32,9 +32,17 @@ namespace caspar { namespace html {
 const std::string REMOVE_MESSAGE_NAME = "CasparCGRemove";
 const std::string LOG_MESSAGE_NAME    = "CasparCGLog";
 
+// Asks the render process for the javascript heap of a browser, which it answers with MEMORY_MESSAGE_NAME.
+const std::string MEMORY_REQUEST_MESSAGE_NAME = "CasparCGMemoryRequest";
+const std::string MEMORY_MESSAGE_NAME         = "CasparCGMemory";
+
 bool              intercept_command_line(int argc, char** argv);
 void              init(const core::module_dependencies& dependencies);
 void              uninit();
+
+// Starts CEF unless it's running, and waits for it. Everything posted to CEF starts it first.
+void require_cef();
+
 void              invoke(const std::function<void()>& func);
 std::future<void> begin_invoke(const std::function<void()>& func);
 
@@ -44,7 +44,6 @@
 #include <boost/log/trivial.hpp>
 #include <boost/regex.hpp>
 
-#include <tbb/concurrent_queue.h>
 #include <tbb/parallel_for.h>
 
 #include <mutex>
@@ -56,14 +55,31 @@
 #include <include/cef_render_handler.h>
 #pragma warning(pop)
 
+#include <algorithm>
+#include <deque>
+#include <map>
 #include <optional>
 #include <queue>
+#include <tuple>
 #include <utility>
 
 #include "../html.h"
 
 namespace caspar { namespace html {
 
+// Idle browsers kept ready for each format, 0 opens a browser for every producer.
+size_t pool_size()
+{
+    static const auto size = env::properties().get(L"configuration.html.browser-pool", 0);
+    return static_cast<size_t>(std::max(size, 0));
+}
+
+bool preload_templates()
+{
+    static const auto preload = env::properties().get(L"configuration.html.preload-templates", false);
+    return preload;
+}
+
 class html_client
     : public CefClient
     , public CefRenderHandler
@@ -80,51 +96,132 @@ class html_client
     caspar::timer                       paint_timer_;
     caspar::timer                       test_timer_;
 
-    spl::shared_ptr<core::frame_factory>                        frame_factory_;
+    std::shared_ptr<core::frame_factory>                        frame_factory_;
     core::video_format_desc                                     format_desc_;
-    bool                                                        gpu_enabled_;
-    tbb::concurrent_queue<std::wstring>                         javascript_before_load_;
     std::atomic<bool>                                           loaded_;
     std::queue<std::pair<std::int_least64_t, core::draw_frame>> frames_;
     mutable std::mutex                                          frames_mutex_;
     const size_t                                                frames_max_size_ = 4;
     std::atomic<bool>                                           closing_;
+    std::atomic<bool>                                           closed_;
 
     core::draw_frame   last_frame_;
     std::int_least64_t last_frame_time_;
 
+    // Upload buffers the view is painted into, reused once the mixer has released their frames. Each one knows the
+    // areas that changed since it was last painted, so a paint only copies those and not the whole view.
+    struct canvas
+    {
+        std::shared_ptr<array<std::uint8_t>> data;
+        std::vector<CefRect>                 stale;
+    };
+
+    std::vector<canvas>       canvases_;
+    std::atomic<std::int64_t> canvas_bytes_{0};
+    int                       canvas_width_    = 0;
+    int                       canvas_height_   = 0;
+    const size_t              max_stale_rects_ = 16;
+
+    // Scripts waiting for the page to load, or for the next frame while the producer is received, and then executed
+    // together. An update following another one replaces it, as only the newest data of a template is shown.
+    std::mutex                javascript_mutex_;
+    std::vector<std::wstring> javascript_;
+    bool                      javascript_ends_with_update_ = false;
+
+    // The browser stops painting while its layer is drawn invisibly or its frames aren't received, which is the case
+    // for producers in the background and browsers in the pool.
+    std::atomic<bool>               visible_{true};
+    std::atomic<std::int_least64_t> last_receive_time_{0};
+    std::atomic<bool>               hidden_{false};
+
+    // The render process is asked for the javascript heap of the page about once a second while it is received.
+    std::int_least64_t last_memory_request_ = 0;
+
     CefRefPtr<CefBrowser> browser_;
 
   public:
-    html_client(spl::shared_ptr<core::frame_factory>       frame_factory,
-                const spl::shared_ptr<diagnostics::graph>& graph,
-                core::video_format_desc                    format_desc,
-                bool                                       gpu_enabled,
-                std::wstring                               url)
+    // Paints are dropped until a producer attaches.
+    html_client(core::video_format_desc format_desc, std::wstring url)
         : url_(std::move(url))
-        , graph_(graph)
-        , frame_factory_(std::move(frame_factory))
         , format_desc_(std::move(format_desc))
-        , gpu_enabled_(gpu_enabled)
     {
-        graph_->set_color("browser-tick-time", diagnostics::color(0.1f, 1.0f, 0.1f));
-        graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
-        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
-        graph_->set_color("late-frame", diagnostics::color(0.6f, 0.1f, 0.1f));
-        graph_->set_color("overload", diagnostics::color(0.6f, 0.6f, 0.3f));
-        graph_->set_color("buffered-frames", diagnostics::color(0.2f, 0.9f, 0.9f));
-        graph_->set_text(print());
-        diagnostics::register_graph(graph_);
+        loaded_  = false;
+        closing_ = false;
+        closed_  = false;
+    }
+
+    // Hands the browser to a producer, or back to the pool with no frame factory. With navigate it loads url anew,
+    // else it keeps the page it has and paints it again.
+    void attach(std::shared_ptr<core::frame_factory>       frame_factory,
+                const spl::shared_ptr<diagnostics::graph>& graph,
+                const core::video_format_desc&             format_desc,
+                const std::wstring&                        url,
+                bool                                       navigate)
+    {
+        CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
+
+        frame_factory_ = std::move(frame_factory);
+        graph_         = graph;
+        format_desc_   = format_desc;
+        url_           = url;
+        closing_       = false;
+        last_frame_    = core::draw_frame{};
+        canvases_.clear();
+        canvas_bytes_ = 0;
+
+        visible_           = true;
+        last_receive_time_ = now();
 
         {
-            std::lock_guard<std::mutex> lock(state_mutex_);
-            state_["file/path"] = u8(url_);
+            std::lock_guard<std::mutex> lock(frames_mutex_);
+            frames_ = {};
         }
 
-        loaded_  = false;
-        closing_ = false;
+        {
+            std::lock_guard<std::mutex> lock(javascript_mutex_);
+            javascript_.clear();
+            javascript_ends_with_update_ = false;
+        }
+
+        if (navigate) {
+            loaded_ = false;
+            if (browser_ != nullptr) {
+                browser_->GetMainFrame()->LoadURL(url_);
+            }
+        } else if (browser_ != nullptr) {
+            browser_->GetHost()->Invalidate(PET_VIEW);
+        }
+        update_hidden();
+
+        if (frame_factory_) {
+            graph_->set_color("browser-tick-time", diagnostics::color(0.1f, 1.0f, 0.1f));
+            graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
+            graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+            graph_->set_color("late-frame", diagnostics::color(0.6f, 0.1f, 0.1f));
+            graph_->set_color("overload", diagnostics::color(0.6f, 0.6f, 0.3f));
+            graph_->set_color("buffered-frames", diagnostics::color(0.2f, 0.9f, 0.9f));
+            graph_->set_text(print());
+            diagnostics::register_graph(graph_);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_ = {};
+            if (frame_factory_) {
+                state_["file/path"] = u8(url_);
+            }
+        }
     }
 
+    // The browser has finished loading its page and can be handed to a producer.
+    bool is_loaded() const { return browser_ != nullptr && loaded_ && !closed_; }
+
+    bool is_closed() const { return closed_; }
+
+    const core::video_format_desc& format_desc() const { return format_desc_; }
+
+    const std::wstring& url() const { return url_; }
+
     void reload()
     {
         html::begin_invoke([=] {
@@ -136,6 +233,7 @@ class html_client
     void close()
     {
         closing_ = true;
+        closed_  = true;
 
         html::invoke([=] {
             if (browser_ != nullptr) {
@@ -188,15 +286,49 @@ class html_client
 
     core::draw_frame receive(const core::video_field field)
     {
-        if (!try_pop(field)) {
+        last_receive_time_ = now();
+        if (loaded_) {
+            execute_queued_javascript();
+        }
+        if (last_receive_time_ - last_memory_request_ > 1000) {
+            last_memory_request_ = last_receive_time_;
+            html::begin_invoke([=] { request_memory(); });
+        }
+        if (hidden_ && visible_) {
+            html::begin_invoke([=] { update_hidden(); });
+        }
+
+        if (!try_pop(field) && !hidden_) {
             graph_->set_tag(diagnostics::tag_severity::SILENT, "late-frame");
         }
 
         return last_frame_;
     }
 
+    void set_visible(bool visible)
+    {
+        if (visible_.exchange(visible) != visible) {
+            html::begin_invoke([=] { update_hidden(); });
+        }
+    }
+
     core::draw_frame last_frame() const { return last_frame_; }
 
+    // The canvases hold the images of the frames painted, the frames queued and shown add their textures.
+    core::memory_usage memory() const
+    {
+        core::memory_usage usage;
+        {
+            std::lock_guard<std::mutex> lock(frames_mutex_);
+            for (auto frames = frames_; !frames.empty(); frames.pop()) {
+                usage.device += core::frame_memory(frames.front().second).device;
+            }
+        }
+        usage.device += core::frame_memory(last_frame_).device;
+        usage.host = canvas_bytes_;
+        return usage;
+    }
+
     bool is_ready() const
     {
         std::lock_guard<std::mutex> lock(frames_mutex_);
@@ -205,11 +337,22 @@ class html_client
 
     void execute_javascript(const std::wstring& javascript)
     {
-        if (!loaded_) {
-            javascript_before_load_.push(javascript);
-        } else {
+        {
+            std::lock_guard<std::mutex> lock(javascript_mutex_);
+
+            const auto update = boost::algorithm::starts_with(javascript, L"update(");
+            if (update && javascript_ends_with_update_) {
+                javascript_.back() = javascript;
+            } else {
+                javascript_.push_back(javascript);
+            }
+            javascript_ends_with_update_ = update;
+        }
+
+        // Without a producer receiving frames there is no next frame to wait for.
+        const auto received = (now() - last_receive_time_) <= 2 * 1000 / format_desc_.fps;
+        if (loaded_ && !received) {
             execute_queued_javascript();
-            do_execute_javascript(javascript);
         }
     }
 
@@ -266,7 +409,9 @@ class html_client
                  int                   width,
                  int                   height) override
     {
-        if (closing_)
+        update_hidden();
+
+        if (closing_ || !frame_factory_)
             return;
 
         graph_->set_value("browser-tick-time", paint_timer_.elapsed() * format_desc_.fps * 0.5);
@@ -276,26 +421,50 @@ class html_client
         if (type != PET_VIEW)
             return;
 
-        core::pixel_format_desc pixel_desc(core::pixel_format::bgra);
-        pixel_desc.planes.emplace_back(width, height, 4);
+        if (width != canvas_width_ || height != canvas_height_) {
+            canvases_.clear();
+            canvas_bytes_  = 0;
+            canvas_width_  = width;
+            canvas_height_ = height;
+        }
+
+        const auto view = CefRect(0, 0, width, height);
+
+        std::vector<CefRect> dirty;
+        for (auto rect : dirtyRects) {
+            rect.Intersect(view);
+            if (!rect.IsEmpty()) {
+                dirty.push_back(rect);
+            }
+        }
 
-        core::mutable_frame frame = frame_factory_->create_frame(this, pixel_desc);
-        char*               src   = (char*)buffer;
-        char*               dst   = reinterpret_cast<char*>(frame.image_data(0).begin());
         test_timer_.restart();
 
-#ifdef WIN32
-        if (gpu_enabled_) {
-            int chunksize = height * width;
-            tbb::parallel_for(0, 4, [&](int y) { std::memcpy(dst + y * chunksize, src + y * chunksize, chunksize); });
-        } else {
-            std::memcpy(dst, src, width * height * 4);
+        auto& target = next_canvas();
+        for (auto& canvas : canvases_) {
+            if (&canvas != &target) {
+                add_stale(canvas, dirty);
+            }
+        }
+        add_stale(target, dirty);
+
+        auto       src      = static_cast<const std::uint8_t*>(buffer);
+        auto       dst      = target.data->data();
+        const auto linesize = width * 4;
+        for (const auto& rect : target.stale) {
+            tbb::parallel_for(rect.y, rect.y + rect.height, [&](int y) {
+                const auto offset = y * linesize + rect.x * 4;
+                std::memcpy(dst + offset, src + offset, rect.width * 4);
+            });
         }
-#else
-        // On my one test linux machine, doing a single memcpy doesn't have the same cost as windows,
-        // making using tbb excessive
-        std::memcpy(dst, src, width * height * 4);
-#endif
+        target.stale.clear();
+
+        core::pixel_format_desc pixel_desc(core::pixel_format::bgra);
+        pixel_desc.planes.emplace_back(width, height, 4);
+
+        core::image_data_t planes;
+        planes.emplace_back(target.data->data(), target.data->size(), target.data);
+        auto frame = frame_factory_->create_frame(this, pixel_desc, std::move(planes));
 
         graph_->set_value("memcpy", test_timer_.elapsed() * format_desc_.fps * 0.5 * 5);
 
@@ -311,6 +480,66 @@ class html_client
         }
     }
 
+    // Browsers that are loaded but not shown stop painting. They paint again from the next receive while visible, and
+    // only the newest frame painted before is kept so that nothing stale is shown.
+    void update_hidden()
+    {
+        CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
+
+        if (browser_ == nullptr) {
+            return;
+        }
+
+        const auto idle   = (now() - last_receive_time_) > 4 * 1000 / format_desc_.fps;
+        const auto hidden = loaded_ && (!frame_factory_ || !visible_ || idle);
+        if (hidden == hidden_) {
+            return;
+        }
+
+        hidden_ = hidden;
+        browser_->GetHost()->WasHidden(hidden);
+
+        if (!hidden) {
+            std::lock_guard<std::mutex> lock(frames_mutex_);
+            while (frames_.size() > 1) {
+                frames_.pop();
+            }
+            browser_->GetHost()->Invalidate(PET_VIEW);
+        }
+    }
+
+    // A canvas that no frame holds any more, the mixer is done with it by then.
+    canvas& next_canvas()
+    {
+        for (auto& canvas : canvases_) {
+            if (canvas.data.use_count() == 1) {
+                return canvas;
+            }
+        }
+
+        canvas fresh;
+        fresh.data =
+            std::make_shared<array<std::uint8_t>>(frame_factory_->create_array(canvas_width_ * canvas_height_ * 4));
+        fresh.stale.emplace_back(0, 0, canvas_width_, canvas_height_);
+        canvas_bytes_ += fresh.data->size();
+        canvases_.push_back(std::move(fresh));
+        return canvases_.back();
+    }
+
+    void add_stale(canvas& canvas, const std::vector<CefRect>& dirty)
+    {
+        canvas.stale.insert(canvas.stale.end(), dirty.begin(), dirty.end());
+
+        // Past a handful of rects, or once they add up to the view, one copy of the whole view is cheaper.
+        auto area = 0;
+        for (const auto& rect : canvas.stale) {
+            area += rect.width * rect.height;
+        }
+        if (canvas.stale.size() > max_stale_rects_ || area >= canvas_width_ * canvas_height_) {
+            canvas.stale.assign(1, CefRect(0, 0, canvas_width_, canvas_height_));
+        }
+    }
+
     void OnAfterCreated(CefRefPtr<CefBrowser> browser) override
     {
         CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
@@ -374,7 +603,12 @@ class html_client
 
         if (name == REMOVE_MESSAGE_NAME) {
             // TODO fully remove producer
-            this->close();
+            if (pool_size() > 0) {
+                // Kept open to go back to the pool once the producer is gone.
+                closing_ = true;
+            } else {
+                this->close();
+            }
 
             {
                 std::lock_guard<std::mutex> lock(frames_mutex_);
@@ -395,10 +629,23 @@ class html_client
 
             BOOST_LOG_SEV(log::logger::get(), severity) << print() << L" [renderer_process] " << msg;
         }
+        if (name == MEMORY_MESSAGE_NAME) {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_["memory/js-heap"] = static_cast<std::int64_t>(message->GetArgumentList()->GetDouble(0));
+            return true;
+        }
 
         return false;
     }
 
+    void request_memory()
+    {
+        if (browser_ != nullptr && loaded_) {
+            browser_->GetMainFrame()->SendProcessMessage(PID_RENDERER,
+                                                         CefProcessMessage::Create(MEMORY_REQUEST_MESSAGE_NAME));
+        }
+    }
+
     void do_execute_javascript(const std::wstring& javascript)
     {
         html::begin_invoke([=] {
@@ -408,12 +655,24 @@ class html_client
         });
     }
 
+    // One script for everything queued, so that it costs a single message to the render process. Each call is
+    // caught on its own, as it was when they were executed one by one.
     void execute_queued_javascript()
     {
         std::wstring javascript;
+        {
+            std::lock_guard<std::mutex> lock(javascript_mutex_);
+            if (javascript_.empty()) {
+                return;
+            }
+            for (auto& call : javascript_) {
+                javascript += L"try {\n" + call + L"\n} catch (e) { console.error(e); }\n";
+            }
+            javascript_.clear();
+            javascript_ends_with_update_ = false;
+        }
 
-        while (javascript_before_load_.try_pop(javascript))
-            do_execute_javascript(javascript);
+        do_execute_javascript(javascript);
     }
 
     std::wstring print() const
@@ -425,6 +684,136 @@ class html_client
     IMPLEMENT_REFCOUNTING(html_client);
 };
 
+void create_browser(const CefRefPtr<html_client>&  client,
+                    const core::video_format_desc& format_desc,
+                    const std::wstring&            url)
+{
+    const bool enable_gpu = env::properties().get(L"configuration.html.enable-gpu", false);
+
+    CefWindowInfo window_info;
+    window_info.bounds.width                 = format_desc.square_width;
+    window_info.bounds.height                = format_desc.square_height;
+    window_info.windowless_rendering_enabled = true;
+
+    CefBrowserSettings browser_settings;
+    browser_settings.webgl = enable_gpu ? cef_state_t::STATE_ENABLED : cef_state_t::STATE_DISABLED;
+    double fps             = format_desc.fps;
+    browser_settings.windowless_frame_rate = int(ceil(fps));
+    CefBrowserHost::CreateBrowser(window_info, client.get(), url, browser_settings, nullptr, nullptr);
+}
+
+// Browsers kept open for producers to take over, so an add doesn't wait for a render process to start. Browsers
+// given back by producers load their template again when templates are preloaded, and are used first for the next
+// add of that template. Only used on the cef thread.
+class browser_pool
+{
+    struct entry
+    {
+        CefRefPtr<html_client> client;
+        std::wstring           url;
+    };
+
+    using key_t = std::tuple<int, int, double>;
+
+    std::map<key_t, std::deque<entry>> entries_;
+
+    static key_t key(const core::video_format_desc& format_desc)
+    {
+        return key_t(format_desc.square_width, format_desc.square_height, format_desc.fps);
+    }
+
+  public:
+    CefRefPtr<html_client> acquire(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                   const spl::shared_ptr<diagnostics::graph>&  graph,
+                                   const core::video_format_desc&              format_desc,
+                                   const std::wstring&                         url)
+    {
+        CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
+
+        auto& entries = entries_[key(format_desc)];
+
+        auto find = [&](auto&& pred) {
+            return std::find_if(
+                entries.begin(), entries.end(), [&](const entry& e) { return e.client->is_loaded() && pred(e); });
+        };
+
+        auto navigate = false;
+        auto it       = find([&](const entry& e) { return !e.url.empty() && e.url == url; });
+        if (it == entries.end()) {
+            navigate = true;
+            it       = find([](const entry& e) { return e.url.empty(); });
+        }
+        if (it == entries.end()) {
+            it = find([](const entry&) { return true; });
+        }
+
+        CefRefPtr<html_client> client;
+        if (it != entries.end()) {
+            client = it->client;
+            entries.erase(it);
+        } else {
+            client   = new html_client(format_desc, url);
+            navigate = false;
+            create_browser(client, format_desc, url);
+        }
+        client->attach(frame_factory, graph, format_desc, url, navigate);
+
+        while (entries.size() < pool_size()) {
+            CefRefPtr<html_client> spare = new html_client(format_desc, L"about:blank");
+            create_browser(spare, format_desc, L"about:blank");
+            entries.push_back(entry{spare, L""});
+        }
+
+        return client;
+    }
+
+    void release(const CefRefPtr<html_client>& client)
+    {
+        CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
+
+        if (client->is_closed()) {
+            return;
+        }
+
+        auto& entries = entries_[key(client->format_desc())];
+        if (!preload_templates() && entries.size() >= pool_size()) {
+            client->close();
+            return;
+        }
+
+        auto url = preload_templates() ? client->url() : std::wstring();
+        client->attach(nullptr,
+                       spl::make_shared<diagnostics::graph>(),
+                       client->format_desc(),
+                       url.empty() ? L"about:blank" : url,
+                       true);
+        entries.push_back(entry{client, url});
+
+        while (entries.size() > pool_size()) {
+            entries.front().client->close();
+            entries.pop_front();
+        }
+    }
+
+    void clear()
+    {
+        CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
+
+        for (auto& format : entries_) {
+            for (auto& e : format.second) {
+                e.client->close();
+            }
+        }
+        entries_.clear();
+    }
+};
+
+browser_pool& get_browser_pool()
+{
+    static browser_pool pool;
+    return pool;
+}
+
 class html_producer : public core::frame_producer
 {
     core::video_format_desc             format_desc_;
@@ -440,28 +829,13 @@ class html_producer : public core::frame_producer
         : format_desc_(format_desc)
         , url_(url)
     {
-        html::invoke([&] {
-            const bool enable_gpu = env::properties().get(L"configuration.html.enable-gpu", false);
-
-            client_ = new html_client(frame_factory, graph_, format_desc, enable_gpu, url_);
-
-            CefWindowInfo window_info;
-            window_info.bounds.width                 = format_desc.square_width;
-            window_info.bounds.height                = format_desc.square_height;
-            window_info.windowless_rendering_enabled = true;
-
-            CefBrowserSettings browser_settings;
-            browser_settings.webgl = enable_gpu ? cef_state_t::STATE_ENABLED : cef_state_t::STATE_DISABLED;
-            double fps             = format_desc.fps;
-            browser_settings.windowless_frame_rate = int(ceil(fps));
-            CefBrowserHost::CreateBrowser(window_info, client_.get(), url, browser_settings, nullptr, nullptr);
-        });
+        html::invoke([&] { client_ = get_browser_pool().acquire(frame_factory, graph_, format_desc, url_); });
     }
 
     ~html_producer() override
     {
         if (client_ != nullptr)
-            client_->close();
+            html::invoke([&] { get_browser_pool().release(client_); });
     }
 
     // frame_producer
@@ -512,8 +886,20 @@ class html_producer : public core::frame_producer
         return make_ready_future(std::wstring());
     }
 
+    void render_transform(const core::frame_transform& transform) override
+    {
+        if (client_ != nullptr) {
+            client_->set_visible(core::is_visible(transform.image_transform));
+        }
+    }
+
     std::wstring print() const override { return L"html[" + url_ + L"]"; }
 
+    core::memory_usage memory() const override
+    {
+        return client_ != nullptr ? client_->memory() : frame_producer::memory();
+    }
+
     core::monitor::state state() const override
     {
         if (client_ != nullptr) {
@@ -566,6 +952,11 @@ spl::shared_ptr<core::frame_producer> create_cg_producer(const core::frame_produ
     return core::create_destroy_proxy(spl::make_shared<html_producer>(dependencies.frame_factory, format_desc, url));
 }
 
+void clear_browser_pool()
+{
+    html::invoke([] { get_browser_pool().clear(); });
+}
+
 spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
                                                       const std::vector<std::wstring>&         params)
 {
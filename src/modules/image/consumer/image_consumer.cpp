@@ -30,8 +30,9 @@
 
 #include <common/array.h>
 #include <common/env.h>
-#include <common/future.h>
 #include <common/log.h>
+#include <common/os/thread.h>
+#include <common/param.h>
 #include <common/utf.h>
 
 #include <core/consumer/frame_consumer.h>
@@ -41,6 +42,12 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <tbb/concurrent_queue.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -49,57 +56,156 @@
 
 namespace caspar { namespace image {
 
-struct image_consumer : public core::frame_consumer
+struct snapshot_options
+{
+    bool         jpeg    = false;
+    bool         fast    = false;
+    int          quality = 90;
+    int          width   = 0;
+    int          height  = 0;
+    std::wstring extension() const { return jpeg ? L".jpg" : L".png"; }
+};
+
+// Encodes snapshots on a few threads shared by all image consumers. Requests beyond the queue are dropped, so
+// clients polling PRINT can't pile up threads or frames.
+class snapshot_writer
 {
-    const std::wstring filename_;
+    tbb::concurrent_bounded_queue<std::function<void()>> queue_;
+    std::vector<std::thread>                             threads_;
 
   public:
-    // frame_consumer
+    snapshot_writer()
+    {
+        const auto threads = std::max(env::properties().get(L"configuration.image.snapshot.threads", 2), 1);
+        queue_.set_capacity(std::max(env::properties().get(L"configuration.image.snapshot.queue-depth", 4), 1));
+
+        for (int n = 0; n < threads; ++n) {
+            threads_.emplace_back([this] {
+                set_thread_name(L"image snapshot");
+                while (true) {
+                    std::function<void()> task;
+                    queue_.pop(task);
+                    if (!task) {
+                        break;
+                    }
+                    task();
+                }
+            });
+        }
+    }
 
-    explicit image_consumer(std::wstring filename)
-        : filename_(std::move(filename))
+    ~snapshot_writer()
     {
+        queue_.clear();
+        for (size_t n = 0; n < threads_.size(); ++n) {
+            queue_.push(nullptr);
+        }
+        for (auto& thread : threads_) {
+            thread.join();
+        }
     }
 
-    void initialize(const core::video_format_desc& /*format_desc*/, int /*channel_index*/) override {}
+    bool try_push(std::function<void()> task) { return queue_.try_push(std::move(task)); }
+};
 
-    std::future<bool> send(core::video_field field, core::const_frame frame) override
-    {
-        auto filename = filename_;
+snapshot_writer& get_snapshot_writer()
+{
+    static snapshot_writer writer;
+    return writer;
+}
 
-        std::thread async([frame, filename] {
-            try {
-                auto filename2 = filename;
+std::pair<int, int> snapshot_size(const snapshot_options& options, int width, int height)
+{
+    if (options.width > 0 && options.height > 0) {
+        return {std::min(options.width, width), std::min(options.height, height)};
+    }
+    if (options.width > 0 && options.width < width) {
+        return {options.width, std::max(1, height * options.width / width)};
+    }
+    if (options.height > 0 && options.height < height) {
+        return {std::max(1, width * options.height / height), options.height};
+    }
+    return {width, height};
+}
+
+void write_snapshot(const core::const_frame& frame, const std::wstring& filename, const snapshot_options& options)
+{
+    const auto width  = static_cast<int>(frame.width());
+    const auto height = static_cast<int>(frame.height());
+
+    auto bitmap = std::shared_ptr<FIBITMAP>(FreeImage_Allocate(width, height, 32), FreeImage_Unload);
+    std::memcpy(FreeImage_GetBits(bitmap.get()), frame.image_data(0).begin(), frame.image_data(0).size());
 
-                if (filename2.empty())
-                    filename2 = env::media_folder() +
-                                boost::posix_time::to_iso_wstring(boost::posix_time::second_clock::local_time()) +
-                                L".png";
-                else
-                    filename2 = env::media_folder() + filename2 + L".png";
+    // Filtering premultiplied pixels keeps dark fringes off the edges of keyed graphics.
+    const auto size = snapshot_size(options, width, height);
+    if (size != std::make_pair(width, height)) {
+        bitmap = std::shared_ptr<FIBITMAP>(
+            FreeImage_Rescale(bitmap.get(), size.first, size.second, FILTER_BILINEAR), FreeImage_Unload);
+    }
+
+    image_view<bgra_pixel> view(FreeImage_GetBits(bitmap.get()),
+                                static_cast<int>(FreeImage_GetWidth(bitmap.get())),
+                                static_cast<int>(FreeImage_GetHeight(bitmap.get())));
+    unmultiply(view);
 
-                auto bitmap = std::shared_ptr<FIBITMAP>(
-                    FreeImage_Allocate(static_cast<int>(frame.width()), static_cast<int>(frame.height()), 32),
-                    FreeImage_Unload);
-                std::memcpy(FreeImage_GetBits(bitmap.get()), frame.image_data(0).begin(), frame.image_data(0).size());
+    FreeImage_FlipVertical(bitmap.get());
 
-                image_view<bgra_pixel> original_view(
-                    FreeImage_GetBits(bitmap.get()), static_cast<int>(frame.width()), static_cast<int>(frame.height()));
-                unmultiply(original_view);
+    auto format = FIF_PNG;
+    auto flags  = options.fast ? PNG_Z_BEST_SPEED : 0;
+    if (options.jpeg) {
+        bitmap = std::shared_ptr<FIBITMAP>(FreeImage_ConvertTo24Bits(bitmap.get()), FreeImage_Unload);
+        format = FIF_JPEG;
+        flags  = std::clamp(options.quality, 1, 100);
+    }
 
-                FreeImage_FlipVertical(bitmap.get());
 #ifdef WIN32
-                FreeImage_SaveU(FIF_PNG, bitmap.get(), filename2.c_str(), 0);
+    FreeImage_SaveU(format, bitmap.get(), filename.c_str(), flags);
 #else
-                FreeImage_Save(FIF_PNG, bitmap.get(), u8(filename2).c_str(), 0);
+    FreeImage_Save(format, bitmap.get(), u8(filename).c_str(), flags);
 #endif
+}
+
+struct image_consumer : public core::frame_consumer
+{
+    const std::wstring     filename_;
+    const snapshot_options options_;
+
+  public:
+    // frame_consumer
+
+    image_consumer(std::wstring filename, snapshot_options options)
+        : filename_(std::move(filename))
+        , options_(std::move(options))
+    {
+    }
+
+    void initialize(const core::video_format_desc& /*format_desc*/, int /*channel_index*/) override {}
+
+    core::send_result send(core::video_field field, core::const_frame frame) override
+    {
+        auto filename = filename_;
+
+        if (filename.empty())
+            filename = env::media_folder() +
+                       boost::posix_time::to_iso_wstring(boost::posix_time::second_clock::local_time()) +
+                       options_.extension();
+        else
+            filename = env::media_folder() + filename + options_.extension();
+
+        auto options = options_;
+        auto pushed  = get_snapshot_writer().try_push([frame, filename, options] {
+            try {
+                write_snapshot(frame, filename, options);
             } catch (...) {
                 CASPAR_LOG_CURRENT_EXCEPTION()
             }
         });
-        async.detach();
 
-        return make_ready_future(false);
+        if (!pushed) {
+            CASPAR_LOG_RATE_LIMITED(warning, 5) << print() << L" Snapshot queue is full, dropped " << filename;
+        }
+
+        return false;
     }
 
     std::wstring print() const override { return L"image[]"; }
@@ -125,10 +231,21 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
 
     std::wstring filename;
 
-    if (params.size() > 1)
+    static const std::vector<std::wstring> keywords = {L"FORMAT", L"QUALITY", L"WIDTH", L"HEIGHT", L"FAST"};
+    if (params.size() > 1 && std::none_of(keywords.begin(), keywords.end(), [&](const std::wstring& keyword) {
+            return boost::iequals(params.at(1), keyword);
+        }))
         filename = params.at(1);
 
-    return spl::make_shared<image_consumer>(filename);
+    snapshot_options options;
+    const auto format = get_param(L"FORMAT", params, L"PNG");
+    options.jpeg      = boost::iequals(format, L"JPG") || boost::iequals(format, L"JPEG");
+    options.fast      = contains_param(L"FAST", params);
+    options.quality   = get_param(L"QUALITY", params, 90);
+    options.width     = get_param(L"WIDTH", params, 0);
+    options.height    = get_param(L"HEIGHT", params, 0);
+
+    return spl::make_shared<image_consumer>(filename, options);
 }
 
 }} // namespace caspar::image
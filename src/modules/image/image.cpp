@@ -27,6 +27,8 @@
 #include "consumer/image_consumer.h"
 #include "producer/image_producer.h"
 #include "producer/image_scroll_producer.h"
+#include "producer/image_sequence_producer.h"
+#include "util/image_loader.h"
 
 #include <common/utf.h>
 
@@ -37,9 +39,21 @@ std::wstring version() { return u16(FreeImage_GetVersion()); }
 void init(const core::module_dependencies& dependencies)
 {
     FreeImage_Initialise();
-    dependencies.producer_registry->register_producer_factory(L"Image Scroll Producer", create_scroll_producer);
-    dependencies.producer_registry->register_producer_factory(L"Image Producer", create_producer);
+    // Sequences are folders that can share their name with a media file, so that factory is always asked.
+    const core::producer_factory_keys image_keys = {{}, {}, image_extensions()};
+    dependencies.producer_registry->register_producer_factory(
+        L"Image Scroll Producer", create_scroll_producer, image_keys);
+    dependencies.producer_registry->register_producer_factory(L"Image Sequence Producer", create_sequence_producer);
+    dependencies.producer_registry->register_producer_factory(L"Image Producer", create_producer, image_keys);
     dependencies.consumer_registry->register_consumer_factory(L"Image Consumer", create_consumer);
+    dependencies.producer_registry->register_media_info_extractor(
+        [](const std::wstring& file, core::media_info& info) -> bool {
+            if (!is_valid_file(file))
+                return false;
+
+            info.clip_type = L"STILL";
+            return true;
+        });
 }
 
 void uninit() { FreeImage_DeInitialise(); }
@@ -28,6 +28,7 @@
 #endif
 #include <FreeImage.h>
 
+#include "../util/image_cache.h"
 #include "../util/image_loader.h"
 
 #include <core/video_format.h>
@@ -35,6 +36,7 @@
 #include <core/frame/draw_frame.h>
 #include <core/frame/frame.h>
 #include <core/frame/frame_factory.h>
+#include <core/frame/geometry.h>
 #include <core/frame/pixel_format.h>
 #include <core/monitor/monitor.h>
 #include <core/producer/frame_producer.h>
@@ -50,6 +52,7 @@
 #include <boost/filesystem.hpp>
 
 #include <algorithm>
+#include <limits>
 #include <set>
 #include <utility>
 
@@ -62,14 +65,18 @@ struct image_producer : public core::frame_producer
     const spl::shared_ptr<core::frame_factory> frame_factory_;
     const uint32_t                             length_ = 0;
     core::draw_frame                           frame_;
+    std::shared_ptr<const core::draw_frame>    shared_frame_;
 
     image_producer(const spl::shared_ptr<core::frame_factory>& frame_factory, std::wstring description, uint32_t length)
         : description_(std::move(description))
         , frame_factory_(frame_factory)
         , length_(length)
     {
-        load(load_image(description_));
+        shared_frame_ = load_cached_image(frame_factory_, description_);
+        frame_        = *shared_frame_;
 
+        // An image shown for a length is counted down, and received every frame to get to its end.
+        set_static(length_ == std::numeric_limits<uint32_t>::max());
         CASPAR_LOG(info) << print() << L" Initialized";
     }
 
@@ -83,17 +90,20 @@ struct image_producer : public core::frame_producer
     {
         load(load_png_from_memory(png_data, size));
 
+        // An image shown for a length is counted down, and received every frame to get to its end.
+        set_static(length_ == std::numeric_limits<uint32_t>::max());
         CASPAR_LOG(info) << print() << L" Initialized";
     }
 
     void load(const std::shared_ptr<FIBITMAP>& bitmap)
     {
-        FreeImage_FlipVertical(bitmap.get());
         core::pixel_format_desc desc(core::pixel_format::bgra);
         desc.planes.emplace_back(FreeImage_GetWidth(bitmap.get()), FreeImage_GetHeight(bitmap.get()), 4);
         auto frame = frame_factory_->create_frame(this, desc);
 
+        // FreeImage decodes bottom up, the mixer flips it.
         std::copy_n(FreeImage_GetBits(bitmap.get()), frame.image_data(0).size(), frame.image_data(0).begin());
+        frame.geometry() = core::frame_geometry::get_default_vflip();
         frame_ = core::draw_frame(std::move(frame));
     }
 
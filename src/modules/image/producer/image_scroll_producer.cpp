@@ -56,13 +56,15 @@
 #include <boost/date_time.hpp>
 #include <boost/date_time/posix_time/ptime.hpp>
 #include <boost/lexical_cast.hpp>
-#include <boost/scoped_array.hpp>
+
+#include <tbb/parallel_for.h>
 
 #include <algorithm>
 #include <array>
 #include <cstdint>
 #include <optional>
 #include <utility>
+#include <vector>
 
 namespace caspar { namespace image {
 
@@ -177,7 +179,8 @@ struct image_scroll_producer : public core::frame_producer
         if (premultiply_with_alpha)
             premultiply(original_view);
 
-        boost::scoped_array<uint8_t> blurred_copy;
+        // Full tiles of a vertical scroll are drawn straight from the image, which they keep alive.
+        std::shared_ptr<void> storage = bitmap;
 
         if (motion_blur_px > 0) {
             double angle = 3.14159265 / 2; // Up
@@ -189,11 +192,12 @@ struct image_scroll_producer : public core::frame_producer
             else if (horizontal && speed > 0)
                 angle = 0.0; // Right
 
-            blurred_copy.reset(new uint8_t[count]);
-            image_view<bgra_pixel> blurred_view(blurred_copy.get(), width_, height_);
+            auto                   blurred_copy = std::make_shared<std::vector<uint8_t>>(count);
+            image_view<bgra_pixel> blurred_view(blurred_copy->data(), width_, height_);
             caspar::tweener        blur_tweener(L"easeInQuad");
             blur(original_view, blurred_view, angle, motion_blur_px, blur_tweener);
-            bytes = blurred_copy.get();
+            bytes   = blurred_copy->data();
+            storage = blurred_copy;
             bitmap.reset();
         }
 
@@ -203,20 +207,22 @@ struct image_scroll_producer : public core::frame_producer
             while (count > 0) {
                 core::pixel_format_desc desc = core::pixel_format_desc(core::pixel_format::bgra);
                 desc.planes.emplace_back(width_, format_desc_.height, 4);
-                auto frame = frame_factory->create_frame(this, desc);
-
-                if (count >= frame.image_data(0).size()) {
-                    std::copy_n(bytes + count - frame.image_data(0).size(),
-                                frame.image_data(0).size(),
-                                frame.image_data(0).begin());
-                    count -= static_cast<int>(frame.image_data(0).size());
+                const auto size = desc.planes[0].size;
+
+                std::optional<core::mutable_frame> frame;
+                if (count >= size) {
+                    core::image_data_t planes;
+                    planes.emplace_back(bytes + count - size, size, storage);
+                    frame = frame_factory->create_frame(this, desc, std::move(planes));
+                    count -= size;
                 } else {
-                    memset(frame.image_data(0).begin(), 0, frame.image_data(0).size());
-                    std::copy_n(bytes, count, frame.image_data(0).begin() + format_desc_.size - count);
+                    frame = frame_factory->create_frame(this, desc);
+                    memset(frame->image_data(0).begin(), 0, frame->image_data(0).size());
+                    std::copy_n(bytes, count, frame->image_data(0).begin() + format_desc_.size - count);
                     count = 0;
                 }
 
-                core::draw_frame draw_frame(std::move(frame));
+                core::draw_frame draw_frame(std::move(*frame));
 
                 // Set the relative position to the other image fragments
                 draw_frame.transform().image_transform.fill_translation[1] = -n++;
@@ -230,20 +236,22 @@ struct image_scroll_producer : public core::frame_producer
                 desc.planes.emplace_back(format_desc_.width, height_, 4);
                 auto frame = frame_factory->create_frame(this, desc);
                 if (count >= frame.image_data(0).size()) {
-                    for (int y = 0; y < height_; ++y)
+                    tbb::parallel_for(0, height_, [&](int y) {
                         std::copy_n(bytes + i * format_desc_.width * 4 + y * width_ * 4,
                                     format_desc_.width * 4,
                                     frame.image_data(0).begin() + y * format_desc_.width * 4);
+                    });
 
                     ++i;
                     count -= static_cast<int>(frame.image_data(0).size());
                 } else {
                     memset(frame.image_data(0).begin(), 0, frame.image_data(0).size());
                     auto width2 = width_ % format_desc_.width;
-                    for (int y = 0; y < height_; ++y)
+                    tbb::parallel_for(0, height_, [&](int y) {
                         std::copy_n(bytes + i * format_desc_.width * 4 + y * width_ * 4,
                                     width2 * 4,
                                     frame.image_data(0).begin() + y * format_desc_.width * 4);
+                    });
 
                     count = 0;
                 }
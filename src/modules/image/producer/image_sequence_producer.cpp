@@ -0,0 +1,317 @@
+#pragma once
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+
+#include "image_sequence_producer.h"
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#if defined(_MSC_VER)
+#include <windows.h>
+#endif
+#include <FreeImage.h>
+
+#include "../util/image_loader.h"
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/geometry.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/frame_producer.h>
+
+#include <common/diagnostics/graph.h>
+#include <common/env.h>
+#include <common/filesystem.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/param.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace caspar { namespace image {
+
+// Mapped rather than read, so FreeImage decodes straight from the page cache.
+std::shared_ptr<FIBITMAP> load_mapped_image(const std::wstring& filename)
+{
+    boost::interprocess::file_mapping  file(u8(filename).c_str(), boost::interprocess::read_only);
+    boost::interprocess::mapped_region region(file, boost::interprocess::read_only);
+    region.advise(boost::interprocess::mapped_region::advice_sequential);
+
+    return load_image_from_memory(region.get_address(), region.get_size());
+}
+
+struct image_sequence_producer : public core::frame_producer
+{
+    core::monitor::state                       state_;
+    const std::wstring                         description_;
+    const std::vector<std::wstring>            files_;
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const bool                                 loop_;
+    spl::shared_ptr<diagnostics::graph>        graph_;
+
+    size_t read_ahead_;
+    bool   resident_;
+
+    // Frames decoded ahead of the position, by index into the sequence. All of them while the sequence is resident.
+    std::mutex                         mutex_;
+    std::condition_variable            cond_;
+    std::map<size_t, core::draw_frame> decoded_;
+    size_t                             position_ = 0;
+    bool                               abort_    = false;
+
+    core::draw_frame first_frame_;
+    core::draw_frame frame_;
+    std::thread      thread_;
+
+    image_sequence_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                            std::wstring                                description,
+                            std::vector<std::wstring>                   files,
+                            bool                                        loop)
+        : description_(std::move(description))
+        , files_(std::move(files))
+        , frame_factory_(frame_factory)
+        , loop_(loop)
+    {
+        graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_color("buffered-frames", diagnostics::color(0.2f, 0.9f, 0.9f));
+        graph_->set_text(print());
+        diagnostics::register_graph(graph_);
+
+        auto bitmap = load_mapped_image(files_.front());
+        first_frame_ = create_frame(bitmap);
+        frame_       = first_frame_;
+        decoded_[0]  = first_frame_;
+
+        const auto budget     = env::properties().get(L"configuration.image.sequence.resident-budget", 1024);
+        const auto read_ahead = env::properties().get(L"configuration.image.sequence.read-ahead", 8);
+        const auto frame_size = static_cast<size_t>(FreeImage_GetPitch(bitmap.get())) *
+                                FreeImage_GetHeight(bitmap.get());
+
+        resident_   = frame_size * files_.size() <= static_cast<size_t>(std::max(budget, 0)) * 1024 * 1024;
+        read_ahead_ = resident_ ? files_.size() : std::min(files_.size(), static_cast<size_t>(std::max(read_ahead, 1)));
+
+        thread_ = std::thread([this] { run(); });
+
+        CASPAR_LOG(info) << print() << L" Initialized" << (resident_ ? L" resident." : L".");
+    }
+
+    ~image_sequence_producer() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    core::draw_frame create_frame(const std::shared_ptr<FIBITMAP>& bitmap)
+    {
+        core::pixel_format_desc desc(core::pixel_format::bgra);
+        desc.planes.emplace_back(FreeImage_GetWidth(bitmap.get()), FreeImage_GetHeight(bitmap.get()), 4);
+        auto frame = frame_factory_->create_frame(this, desc);
+
+        // FreeImage decodes bottom up, the mixer flips it.
+        std::memcpy(frame.image_data(0).data(), FreeImage_GetBits(bitmap.get()), frame.image_data(0).size());
+        frame.geometry() = core::frame_geometry::get_default_vflip();
+
+        return core::draw_frame(std::move(frame));
+    }
+
+    // The indices from the position on that should be decoded and aren't.
+    std::vector<size_t> missing() const
+    {
+        std::vector<size_t> result;
+        for (size_t n = 0; n < read_ahead_; ++n) {
+            auto index = position_ + n;
+            if (index >= files_.size()) {
+                if (!loop_) {
+                    break;
+                }
+                index %= files_.size();
+            }
+            if (decoded_.find(index) == decoded_.end()) {
+                result.push_back(index);
+            }
+        }
+        return result;
+    }
+
+    bool in_window(size_t index) const
+    {
+        const auto ahead = index >= position_ ? index - position_ : index + files_.size() - position_;
+        return ahead < read_ahead_ && (loop_ || index >= position_);
+    }
+
+    void run()
+    {
+        set_thread_name(L"[image_sequence_producer]");
+        set_thread_affinity(thread_role::producer);
+
+        while (true) {
+            std::vector<size_t> indices;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [&] {
+                    indices = missing();
+                    return abort_ || !indices.empty();
+                });
+                if (abort_) {
+                    return;
+                }
+            }
+
+            std::vector<core::draw_frame> frames(indices.size());
+            tbb::parallel_for(size_t(0), indices.size(), [&](size_t n) {
+                try {
+                    frames[n] = create_frame(load_mapped_image(files_[indices[n]]));
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                    CASPAR_LOG(error) << print() << L" Failed to decode " << files_[indices[n]];
+                }
+            });
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (size_t n = 0; n < indices.size(); ++n) {
+                decoded_[indices[n]] = std::move(frames[n]);
+            }
+            if (!resident_) {
+                for (auto it = decoded_.begin(); it != decoded_.end();) {
+                    it = in_window(it->first) ? std::next(it) : decoded_.erase(it);
+                }
+            }
+            graph_->set_value("buffered-frames", static_cast<double>(decoded_.size()) / read_ahead_);
+        }
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(const core::video_field field, int nb_samples) override
+    {
+        // Interlaced channels show each image for both fields.
+        if (field == core::video_field::b) {
+            return frame_;
+        }
+
+        size_t position;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            auto it = decoded_.find(position_);
+            if (it == decoded_.end()) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+                return frame_;
+            }
+            frame_   = it->second;
+            position = position_;
+
+            if (position_ + 1 < files_.size()) {
+                ++position_;
+            } else if (loop_) {
+                position_ = 0;
+            }
+        }
+        cond_.notify_all();
+
+        state_["file/path"]  = description_;
+        state_["file/frame"] = {static_cast<int64_t>(position), static_cast<int64_t>(files_.size())};
+
+        return frame_;
+    }
+
+    core::draw_frame first_frame(const core::video_field field) override { return first_frame_; }
+
+    core::draw_frame last_frame(const core::video_field field) override { return frame_; }
+
+    bool is_ready() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return decoded_.find(position_) != decoded_.end();
+    }
+
+    uint32_t nb_frames() const override
+    {
+        return loop_ ? std::numeric_limits<uint32_t>::max() : static_cast<uint32_t>(files_.size());
+    }
+
+    std::wstring print() const override { return L"image_sequence_producer[" + description_ + L"]"; }
+
+    std::wstring name() const override { return L"image-sequence"; }
+
+    core::monitor::state state() const override { return state_; }
+};
+
+spl::shared_ptr<core::frame_producer> create_sequence_producer(const core::frame_producer_dependencies& dependencies,
+                                                               const std::vector<std::wstring>&         params)
+{
+    const auto sequence_prefix = boost::iequals(params.at(0), L"[IMG_SEQUENCE]");
+    if (sequence_prefix && params.size() < 2) {
+        return core::frame_producer::empty();
+    }
+
+    const auto name = sequence_prefix ? params.at(1) : params.at(0);
+    if (boost::contains(name, L"://")) {
+        return core::frame_producer::empty();
+    }
+
+    auto dir = find_file_within_dir_or_absolute(env::media_folder(), name, [](const boost::filesystem::path& path) {
+        return boost::filesystem::is_directory(path);
+    });
+    if (!dir) {
+        return core::frame_producer::empty();
+    }
+
+    // The images in the folder play in the order of their names.
+    std::vector<std::wstring> files;
+    for (auto it = boost::filesystem::directory_iterator(*dir); it != boost::filesystem::directory_iterator(); ++it) {
+        if (boost::filesystem::is_regular_file(it->path()) && is_valid_file(it->path())) {
+            files.push_back(it->path().wstring());
+        }
+    }
+    if (files.empty()) {
+        return core::frame_producer::empty();
+    }
+    std::sort(files.begin(), files.end());
+
+    return spl::make_shared<image_sequence_producer>(
+        dependencies.frame_factory, dir->wstring(), std::move(files), contains_param(L"LOOP", params));
+}
+
+}} // namespace caspar::image
@@ -23,6 +23,9 @@
 
 #include <common/tweener.h>
 
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
 #include <algorithm>
 #include <cstdint>
 
@@ -110,25 +113,28 @@ void blur(const SrcView&                          src,
     tweened_weights_y.pop_back();
     tweened_weights_y.erase(tweened_weights_y.begin());
 
-    auto src_end  = src.end();
-    auto dst_iter = dst.begin();
+    // Rows are blurred in parallel, each reading from the whole source.
+    tbb::parallel_for(tbb::blocked_range<int>(0, src.height(), 8), [&](const tbb::blocked_range<int>& rows) {
+        auto src_end  = src.begin() + rows.end() * src.width();
+        auto dst_iter = dst.begin() + rows.begin() * dst.width();
 
-    for (auto src_iter = src.begin(); src_iter != src_end; ++src_iter, ++dst_iter) {
-        rgba_weighting w;
+        for (auto src_iter = src.begin() + rows.begin() * src.width(); src_iter != src_end; ++src_iter, ++dst_iter) {
+            rgba_weighting w;
 
-        for (int i = 0; i < blur_px; ++i) {
-            auto& coordinate  = motion_trail_coordinates[i];
-            auto  other_pixel = src.relative(src_iter, coordinate.first, coordinate.second);
+            for (int i = 0; i < blur_px; ++i) {
+                auto& coordinate  = motion_trail_coordinates[i];
+                auto  other_pixel = src.relative(src_iter, coordinate.first, coordinate.second);
 
-            if (other_pixel == nullptr)
-                break;
+                if (other_pixel == nullptr)
+                    break;
 
-            w.add_pixel(*other_pixel, tweened_weights_y[i]);
-        }
+                w.add_pixel(*other_pixel, tweened_weights_y[i]);
+            }
 
-        w.add_pixel(*src_iter, 255);
-        w.store_result(*dst_iter);
-    }
+            w.add_pixel(*src_iter, 255);
+            w.store_result(*dst_iter);
+        }
+    });
 }
 
 /**
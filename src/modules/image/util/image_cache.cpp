@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+
+#include "image_cache.h"
+
+#include "image_loader.h"
+#include "texture_compression.h"
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#if defined(_MSC_VER)
+#include <windows.h>
+#endif
+#include <FreeImage.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/geometry.h>
+#include <core/frame/pixel_format.h>
+
+#include <common/array.h>
+#include <common/diagnostics/metrics.h>
+#include <common/env.h>
+#include <common/executor.h>
+#include <common/log.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace caspar { namespace image {
+
+namespace {
+
+struct decoded_image
+{
+    std::shared_ptr<FIBITMAP> bitmap;
+    size_t                    size   = 0;
+    int                       width  = 0;
+    int                       height = 0;
+
+    // BC7 of the bitmap once the compressor got to it, which then replaces the bitmap. Set with the cache locked.
+    std::shared_ptr<std::vector<std::uint8_t>> compressed;
+    bool                                       compressing = false;
+
+    std::vector<std::pair<std::weak_ptr<core::frame_factory>, std::weak_ptr<const core::draw_frame>>> frames;
+};
+
+using image_key = std::pair<std::wstring, std::time_t>;
+
+// Stills larger than image.tile-size along either side are drawn as tiles of at most that size, each a frame of its
+// own placed where it is in the still. No texture is larger than the GPU takes, and the mixer, which leaves out the
+// items drawn outside the clip before uploading anything, only uploads the tiles of a panned still that are shown.
+// Tiles are copied out of the bitmap, rows bottom up as FreeImage decodes them. A crop applies to each tile.
+core::draw_frame make_tiled_frame(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                  const void*                                 tag,
+                                  FIBITMAP*                                   bitmap,
+                                  int                                         tile_size)
+{
+    const auto width  = static_cast<int>(FreeImage_GetWidth(bitmap));
+    const auto height = static_cast<int>(FreeImage_GetHeight(bitmap));
+    const auto pitch  = static_cast<size_t>(FreeImage_GetPitch(bitmap));
+    const auto bits   = FreeImage_GetBits(bitmap);
+
+    const auto columns = (width + tile_size - 1) / tile_size;
+    const auto rows    = (height + tile_size - 1) / tile_size;
+
+    std::vector<core::draw_frame> tiles(static_cast<size_t>(columns * rows));
+    tbb::parallel_for(0, columns * rows, [&](int n) {
+        const auto x = n % columns * tile_size;
+        const auto y = n / columns * tile_size;
+        const auto w = std::min(tile_size, width - x);
+        const auto h = std::min(tile_size, height - y);
+
+        core::pixel_format_desc desc(core::pixel_format::bgra);
+        desc.planes.emplace_back(w, h, 4);
+        auto frame = frame_factory->create_frame(tag, desc);
+
+        // The bottom row of the tile is row height - y - h of the bitmap.
+        auto dest = frame.image_data(0).begin();
+        for (int row = 0; row < h; ++row) {
+            std::copy_n(bits + (height - y - h + row) * pitch + x * 4, w * 4, dest + row * w * 4);
+        }
+        frame.geometry() = core::frame_geometry::get_default_vflip();
+
+        tiles[n]                   = core::draw_frame(std::move(frame));
+        auto& transform            = tiles[n].transform().image_transform;
+        transform.fill_translation = {static_cast<double>(x) / width, static_cast<double>(y) / height};
+        transform.fill_scale       = {static_cast<double>(w) / width, static_cast<double>(h) / height};
+    });
+
+    return core::draw_frame(std::move(tiles));
+}
+
+class image_cache
+{
+    using entry = std::pair<image_key, std::shared_ptr<decoded_image>>;
+
+    std::mutex                                       mutex_;
+    std::list<entry>                                 entries_;
+    std::map<image_key, std::list<entry>::iterator> index_;
+    size_t                                           size_ = 0;
+    size_t                                           capacity_;
+    const int                                        tile_size_ =
+        std::max(0, env::properties().get(L"configuration.image.tile-size", 4096));
+
+    const bool compress_ = env::properties().get(L"configuration.image.texture-compression", L"none") == L"bc7";
+
+    // Decoded images kept for stills loaded again, the frames drawn from them are counted by their producers.
+    const std::shared_ptr<diagnostics::metrics::gauge> size_gauge_ =
+        diagnostics::metrics::make_gauge("caspar_image_cache_bytes", "Bytes of decoded images kept in the cache");
+
+    // Last, so that it stops before what its tasks use goes away.
+    executor compressor_{L"image_cache compressor"};
+
+  public:
+    image_cache()
+    {
+        auto capacity = env::properties().get(L"configuration.image.cache-size", 256);
+        capacity_     = static_cast<size_t>(std::max(capacity, 0)) * 1024 * 1024;
+    }
+
+    ~image_cache() { compressor_.clear(); }
+
+    std::shared_ptr<const core::draw_frame> load(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                                 const std::wstring&                         filename)
+    {
+        const auto key = image_key(filename, boost::filesystem::last_write_time(filename));
+
+        auto image = find(key);
+        if (!image) {
+            // Decoded without the lock, two producers loading the same new still may both decode it.
+            auto decoded    = std::make_shared<decoded_image>();
+            decoded->bitmap = load_image(filename);
+            decoded->size   = FreeImage_GetPitch(decoded->bitmap.get()) * FreeImage_GetHeight(decoded->bitmap.get());
+            decoded->width  = static_cast<int>(FreeImage_GetWidth(decoded->bitmap.get()));
+            decoded->height = static_cast<int>(FreeImage_GetHeight(decoded->bitmap.get()));
+
+            image = insert(key, std::move(decoded));
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto& frames = image->frames;
+        frames.erase(std::remove_if(frames.begin(),
+                                    frames.end(),
+                                    [](const auto& f) { return f.first.expired() || f.second.expired(); }),
+                     frames.end());
+
+        std::shared_ptr<core::frame_factory> factory = frame_factory;
+        for (const auto& f : frames) {
+            if (f.first.lock() == factory) {
+                if (auto frame = f.second.lock()) {
+                    return frame;
+                }
+            }
+        }
+
+        if (image->compressed) {
+            core::pixel_format_desc desc(core::pixel_format::bc7);
+            desc.planes.push_back(core::pixel_format_desc::plane::blocks(image->width, image->height, 16));
+
+            core::image_data_t planes;
+            planes.emplace_back(image->compressed->data(), image->compressed->size(), image->compressed);
+
+            auto mutable_frame       = frame_factory->create_frame(image.get(), desc, std::move(planes));
+            mutable_frame.geometry() = core::frame_geometry::get_default_vflip();
+
+            auto frame = std::make_shared<const core::draw_frame>(std::move(mutable_frame));
+            frames.emplace_back(factory, frame);
+            return frame;
+        }
+
+        if (tile_size_ > 0 && (image->width > tile_size_ || image->height > tile_size_)) {
+            auto frame = std::make_shared<const core::draw_frame>(
+                make_tiled_frame(frame_factory, image.get(), image->bitmap.get(), tile_size_));
+            frames.emplace_back(factory, frame);
+            return frame;
+        }
+
+        if (compress_ && !image->compressing && index_.find(key) != index_.end()) {
+            image->compressing = true;
+            compressor_.begin_invoke([this, key, image] { compress(key, image); });
+        }
+
+        core::pixel_format_desc desc(core::pixel_format::bgra);
+        desc.planes.emplace_back(image->width, image->height, 4);
+
+        // The frame is built on the decoded bitmap and keeps it alive, the upload copies it from there. Its rows are
+        // bottom up as FreeImage decodes them, and flipped when drawn.
+        core::image_data_t planes;
+        planes.emplace_back(FreeImage_GetBits(image->bitmap.get()), image->size, image->bitmap);
+
+        auto mutable_frame = frame_factory->create_frame(image.get(), desc, std::move(planes));
+        mutable_frame.geometry() = core::frame_geometry::get_default_vflip();
+
+        auto frame = std::make_shared<const core::draw_frame>(std::move(mutable_frame));
+        frames.emplace_back(factory, frame);
+        return frame;
+    }
+
+  private:
+    // Producers loading the still from then on draw the BC7 texture, those holding a frame of the bitmap keep it.
+    void compress(const image_key& key, const std::shared_ptr<decoded_image>& image)
+    {
+        const auto bits  = FreeImage_GetBits(image->bitmap.get());
+        const auto pitch = static_cast<size_t>(FreeImage_GetPitch(image->bitmap.get()));
+
+        std::shared_ptr<std::vector<std::uint8_t>> compressed;
+        try {
+            compressed = std::make_shared<std::vector<std::uint8_t>>(
+                encode_bc7(bits, image->width, image->height, pitch));
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const auto size = compressed->size();
+        if (index_.find(key) != index_.end() && index_[key]->second == image) {
+            size_ = size_ - image->size + size;
+            size_gauge_->set(static_cast<double>(size_));
+        }
+        image->compressed = std::move(compressed);
+        image->bitmap     = nullptr;
+        image->size       = size;
+        image->frames.clear();
+    }
+
+    std::shared_ptr<decoded_image> find(const image_key& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            return nullptr;
+        }
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return it->second->second;
+    }
+
+    std::shared_ptr<decoded_image> insert(const image_key& key, std::shared_ptr<decoded_image> image)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            return it->second->second;
+        }
+
+        if (image->size > capacity_) {
+            return image;
+        }
+
+        entries_.emplace_front(key, image);
+        index_[key] = entries_.begin();
+        size_ += image->size;
+
+        while (size_ > capacity_) {
+            size_ -= entries_.back().second->size;
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+        size_gauge_->set(static_cast<double>(size_));
+
+        return image;
+    }
+};
+
+} // namespace
+
+std::shared_ptr<const core::draw_frame> load_cached_image(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                                          const std::wstring&                         filename)
+{
+    static image_cache cache;
+    return cache.load(frame_factory, filename);
+}
+
+}} // namespace caspar::image
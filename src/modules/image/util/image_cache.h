@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/fwd.h>
+
+#include <memory>
+#include <string>
+
+namespace caspar { namespace image {
+
+// The still in filename, decoded once for all producers while the file is unchanged. Producers of the same frame
+// factory share one frame, and so one texture, while any of them holds it. Least recently used decoded stills are
+// dropped past image.cache-size. With image.texture-compression set to bc7 cached stills are compressed in the
+// background, and loads from then on share a BC7 frame instead.
+std::shared_ptr<const core::draw_frame> load_cached_image(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                                          const std::wstring&                         filename);
+
+}} // namespace caspar::image
@@ -39,11 +39,70 @@
 #include <boost/exception/errinfo_file_name.hpp>
 #include <boost/filesystem.hpp>
 
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
 #include "image_algorithms.h"
 #include "image_view.h"
 
 namespace caspar { namespace image {
 
+namespace {
+
+// 24 bit images, which most jpegs and many pngs are, are expanded on all cores instead of by FreeImage.
+std::shared_ptr<FIBITMAP> convert_to_32_bits(std::shared_ptr<FIBITMAP> bitmap)
+{
+    if (!bitmap || FreeImage_GetBPP(bitmap.get()) == 32) {
+        return bitmap;
+    }
+
+    const auto width  = static_cast<int>(FreeImage_GetWidth(bitmap.get()));
+    const auto height = static_cast<int>(FreeImage_GetHeight(bitmap.get()));
+
+    if (FreeImage_GetImageType(bitmap.get()) != FIT_BITMAP || FreeImage_GetBPP(bitmap.get()) != 24) {
+        bitmap = std::shared_ptr<FIBITMAP>(FreeImage_ConvertTo32Bits(bitmap.get()), FreeImage_Unload);
+        if (!bitmap)
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported image format."));
+        return bitmap;
+    }
+
+    auto result = std::shared_ptr<FIBITMAP>(
+        FreeImage_Allocate(width, height, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK),
+        FreeImage_Unload);
+    if (!result)
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported image format."));
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, height, 16), [&](const tbb::blocked_range<int>& r) {
+        for (auto y = r.begin(); y != r.end(); ++y) {
+            auto src = FreeImage_GetScanLine(bitmap.get(), y);
+            auto dst = FreeImage_GetScanLine(result.get(), y);
+            for (auto x = 0; x < width; ++x, src += 3, dst += 4) {
+                dst[FI_RGBA_BLUE]  = src[FI_RGBA_BLUE];
+                dst[FI_RGBA_GREEN] = src[FI_RGBA_GREEN];
+                dst[FI_RGBA_RED]   = src[FI_RGBA_RED];
+                dst[FI_RGBA_ALPHA] = 255;
+            }
+        }
+    });
+
+    return result;
+}
+
+void premultiply_bitmap(FIBITMAP* bitmap)
+{
+    const auto width  = static_cast<int>(FreeImage_GetWidth(bitmap));
+    const auto height = static_cast<int>(FreeImage_GetHeight(bitmap));
+    const auto pitch  = static_cast<int>(FreeImage_GetPitch(bitmap));
+    const auto bits   = FreeImage_GetBits(bitmap);
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, height, 16), [&](const tbb::blocked_range<int>& r) {
+        image_view<bgra_pixel> view(bits + r.begin() * pitch, width, static_cast<int>(r.size()));
+        premultiply(view);
+    });
+}
+
+} // namespace
+
 std::shared_ptr<FIBITMAP> load_image(const std::wstring& filename)
 {
     if (!boost::filesystem::exists(filename))
@@ -71,17 +130,14 @@ std::shared_ptr<FIBITMAP> load_image(const std::wstring& filename)
     auto bitmap = std::shared_ptr<FIBITMAP>(FreeImage_Load(fif, u8(filename).c_str(), 0), FreeImage_Unload);
 #endif
 
-    if (FreeImage_GetBPP(bitmap.get()) != 32) {
-        bitmap = std::shared_ptr<FIBITMAP>(FreeImage_ConvertTo32Bits(bitmap.get()), FreeImage_Unload);
-        if (!bitmap)
-            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported image format."));
-    }
+    if (!bitmap)
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported image format."));
+
+    bitmap = convert_to_32_bits(std::move(bitmap));
 
     // PNG-images need to be premultiplied with their alpha
     if (fif == FIF_PNG) {
-        image_view<bgra_pixel> original_view(
-            FreeImage_GetBits(bitmap.get()), FreeImage_GetWidth(bitmap.get()), FreeImage_GetHeight(bitmap.get()));
-        premultiply(original_view);
+        premultiply_bitmap(bitmap.get());
     }
 
     return bitmap;
@@ -96,24 +152,50 @@ std::shared_ptr<FIBITMAP> load_png_from_memory(const void* memory_location, size
         FreeImage_CloseMemory);
     auto bitmap = std::shared_ptr<FIBITMAP>(FreeImage_LoadFromMemory(fif, memory.get(), 0), FreeImage_Unload);
 
-    if (FreeImage_GetBPP(bitmap.get()) != 32) {
-        bitmap = std::shared_ptr<FIBITMAP>(FreeImage_ConvertTo32Bits(bitmap.get()), FreeImage_Unload);
+    if (!bitmap)
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported image format."));
 
-        if (!bitmap)
-            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported image format."));
-    }
+    bitmap = convert_to_32_bits(std::move(bitmap));
 
     // PNG-images need to be premultiplied with their alpha
-    image_view<bgra_pixel> original_view(
-        FreeImage_GetBits(bitmap.get()), FreeImage_GetWidth(bitmap.get()), FreeImage_GetHeight(bitmap.get()));
-    premultiply(original_view);
+    premultiply_bitmap(bitmap.get());
     return bitmap;
 }
 
-bool is_valid_file(const boost::filesystem::path& filename)
+std::shared_ptr<FIBITMAP> load_image_from_memory(const void* memory_location, size_t size)
 {
-    static const std::set<std::wstring> extensions = {
+    auto memory = std::unique_ptr<FIMEMORY, decltype(&FreeImage_CloseMemory)>(
+        FreeImage_OpenMemory(static_cast<BYTE*>(const_cast<void*>(memory_location)), static_cast<DWORD>(size)),
+        FreeImage_CloseMemory);
+
+    FREE_IMAGE_FORMAT fif = FreeImage_GetFileTypeFromMemory(memory.get(), 0);
+    if (fif == FIF_UNKNOWN || (FreeImage_FIFSupportsReading(fif) == 0))
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported image format."));
+
+    auto bitmap = std::shared_ptr<FIBITMAP>(FreeImage_LoadFromMemory(fif, memory.get(), 0), FreeImage_Unload);
+    if (!bitmap)
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported image format."));
+
+    bitmap = convert_to_32_bits(std::move(bitmap));
+
+    // PNG-images need to be premultiplied with their alpha
+    if (fif == FIF_PNG) {
+        premultiply_bitmap(bitmap.get());
+    }
+
+    return bitmap;
+}
+
+const std::vector<std::wstring>& image_extensions()
+{
+    static const std::vector<std::wstring> extensions = {
         L".png", L".tga", L".bmp", L".jpg", L".jpeg", L".gif", L".tiff", L".tif", L".jp2", L".jpx", L".j2k", L".j2c"};
+    return extensions;
+}
+
+bool is_valid_file(const boost::filesystem::path& filename)
+{
+    static const std::set<std::wstring> extensions(image_extensions().begin(), image_extensions().end());
 
     auto ext = boost::to_lower_copy(boost::filesystem::path(filename).extension().wstring());
     if (extensions.find(ext) == extensions.end()) {
@@ -24,6 +24,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 #include <boost/filesystem.hpp>
 
@@ -33,7 +34,9 @@ namespace caspar { namespace image {
 
 std::shared_ptr<FIBITMAP> load_image(const std::wstring& filename);
 std::shared_ptr<FIBITMAP> load_png_from_memory(const void* memory_location, size_t size);
+std::shared_ptr<FIBITMAP> load_image_from_memory(const void* memory_location, size_t size);
 
-bool is_valid_file(const boost::filesystem::path& filename);
+bool                             is_valid_file(const boost::filesystem::path& filename);
+const std::vector<std::wstring>& image_extensions(); // lower case, with the dot
 
 }} // namespace caspar::image
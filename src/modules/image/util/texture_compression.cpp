@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "texture_compression.h"
+
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+namespace caspar { namespace image {
+
+namespace {
+
+const int BLOCK_BYTES = 16;
+
+// Of the second endpoint in each of the 16 steps of mode 6, out of 64.
+const int WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+using color = std::array<double, 4>; // rgba
+
+struct encoding
+{
+    std::array<std::array<int, 4>, 2> endpoints; // 7 bits
+    std::array<int, 2>                pbits;
+    std::array<int, 16>               indices;
+    int64_t                           error = std::numeric_limits<int64_t>::max();
+};
+
+// The step nearest to each pixel along the line between the endpoints, and the error of the block drawn so.
+void fit(const std::array<std::array<int, 4>, 16>& pixels, encoding& result)
+{
+    std::array<std::array<int, 4>, 2> ends;
+    for (int n = 0; n < 2; ++n) {
+        for (int c = 0; c < 4; ++c) {
+            ends[n][c] = result.endpoints[n][c] << 1 | result.pbits[n];
+        }
+    }
+
+    std::array<std::array<int, 4>, 16> palette;
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            palette[i][c] = ((64 - WEIGHTS[i]) * ends[0][c] + WEIGHTS[i] * ends[1][c] + 32) >> 6;
+        }
+    }
+
+    int length = 0;
+    for (int c = 0; c < 4; ++c) {
+        length += (ends[1][c] - ends[0][c]) * (ends[1][c] - ends[0][c]);
+    }
+
+    result.error = 0;
+    for (int n = 0; n < 16; ++n) {
+        int index = 0;
+        if (length > 0) {
+            int dot = 0;
+            for (int c = 0; c < 4; ++c) {
+                dot += (pixels[n][c] - ends[0][c]) * (ends[1][c] - ends[0][c]);
+            }
+            const auto weight = std::clamp(dot * 64.0 / length, 0.0, 64.0);
+            while (index < 15 && weight > (WEIGHTS[index] + WEIGHTS[index + 1]) * 0.5) {
+                ++index;
+            }
+        }
+        result.indices[n] = index;
+        for (int c = 0; c < 4; ++c) {
+            const auto diff = pixels[n][c] - palette[index][c];
+            result.error += diff * diff;
+        }
+    }
+}
+
+// The endpoints nearest to ends at each combination of p-bits, fitted, into best if it's better.
+void try_endpoints(const std::array<std::array<int, 4>, 16>& pixels, const std::array<color, 2>& ends, encoding& best)
+{
+    for (int p = 0; p < 4; ++p) {
+        encoding candidate;
+        candidate.pbits = {p & 1, p >> 1};
+        for (int n = 0; n < 2; ++n) {
+            for (int c = 0; c < 4; ++c) {
+                const auto value          = std::lround((ends[n][c] - candidate.pbits[n]) * 0.5);
+                candidate.endpoints[n][c] = static_cast<int>(std::clamp<long>(value, 0, 127));
+            }
+        }
+        fit(pixels, candidate);
+        if (candidate.error < best.error) {
+            best = candidate;
+        }
+    }
+}
+
+encoding encode_block(const std::array<std::array<int, 4>, 16>& pixels)
+{
+    color mean = {0.0, 0.0, 0.0, 0.0};
+    color low  = {255.0, 255.0, 255.0, 255.0};
+    color high = {0.0, 0.0, 0.0, 0.0};
+    for (auto& pixel : pixels) {
+        for (int c = 0; c < 4; ++c) {
+            mean[c] += pixel[c] / 16.0;
+            low[c]  = std::min<double>(low[c], pixel[c]);
+            high[c] = std::max<double>(high[c], pixel[c]);
+        }
+    }
+
+    // The principal axis of the pixels by power iteration, starting from the diagonal of their bounds.
+    std::array<color, 4> covariance = {};
+    for (auto& pixel : pixels) {
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                covariance[i][j] += (pixel[i] - mean[i]) * (pixel[j] - mean[j]);
+            }
+        }
+    }
+    color axis;
+    for (int c = 0; c < 4; ++c) {
+        axis[c] = high[c] - low[c];
+    }
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        color next = {0.0, 0.0, 0.0, 0.0};
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                next[i] += covariance[i][j] * axis[j];
+            }
+        }
+        const auto length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+        if (length < 1e-9) {
+            break;
+        }
+        for (int c = 0; c < 4; ++c) {
+            axis[c] = next[c] / length;
+        }
+    }
+
+    std::array<color, 2> ends = {mean, mean};
+    const auto length         = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] + axis[3] * axis[3];
+    if (length > 1e-9) {
+        auto t_low  = std::numeric_limits<double>::max();
+        auto t_high = std::numeric_limits<double>::lowest();
+        for (auto& pixel : pixels) {
+            double t = 0.0;
+            for (int c = 0; c < 4; ++c) {
+                t += (pixel[c] - mean[c]) * axis[c];
+            }
+            t_low  = std::min(t_low, t / length);
+            t_high = std::max(t_high, t / length);
+        }
+        for (int c = 0; c < 4; ++c) {
+            ends[0][c] = std::clamp(mean[c] + axis[c] * t_low, 0.0, 255.0);
+            ends[1][c] = std::clamp(mean[c] + axis[c] * t_high, 0.0, 255.0);
+        }
+    }
+
+    encoding best;
+    try_endpoints(pixels, ends, best);
+
+    // Once more with the endpoints that fit the steps found best, by least squares.
+    double a = 0.0;
+    double b = 0.0;
+    double d = 0.0;
+    color  x0 = {0.0, 0.0, 0.0, 0.0};
+    color  x1 = {0.0, 0.0, 0.0, 0.0};
+    for (int n = 0; n < 16; ++n) {
+        const auto w = WEIGHTS[best.indices[n]] / 64.0;
+        a += (1.0 - w) * (1.0 - w);
+        b += (1.0 - w) * w;
+        d += w * w;
+        for (int c = 0; c < 4; ++c) {
+            x0[c] += (1.0 - w) * pixels[n][c];
+            x1[c] += w * pixels[n][c];
+        }
+    }
+    const auto det = a * d - b * b;
+    if (best.error > 0 && std::abs(det) > 1e-9) {
+        for (int c = 0; c < 4; ++c) {
+            ends[0][c] = std::clamp((d * x0[c] - b * x1[c]) / det, 0.0, 255.0);
+            ends[1][c] = std::clamp((a * x1[c] - b * x0[c]) / det, 0.0, 255.0);
+        }
+        try_endpoints(pixels, ends, best);
+    }
+
+    return best;
+}
+
+// Bits from the lowest of the first byte up.
+struct block_writer
+{
+    std::uint8_t* dest;
+    int           pos = 0;
+
+    void put(int value, int count)
+    {
+        for (int n = 0; n < count; ++n, ++pos) {
+            if (value >> n & 1) {
+                dest[pos / 8] |= static_cast<std::uint8_t>(1 << pos % 8);
+            }
+        }
+    }
+};
+
+void write_block(encoding block, std::uint8_t* dest)
+{
+    // The first pixel's step leaves out its top bit, which must then be 0.
+    if (block.indices[0] >= 8) {
+        std::swap(block.endpoints[0], block.endpoints[1]);
+        std::swap(block.pbits[0], block.pbits[1]);
+        for (auto& index : block.indices) {
+            index = 15 - index;
+        }
+    }
+
+    std::fill_n(dest, BLOCK_BYTES, 0);
+    block_writer writer{dest};
+    writer.put(1 << 6, 7);
+    for (int c = 0; c < 4; ++c) {
+        writer.put(block.endpoints[0][c], 7);
+        writer.put(block.endpoints[1][c], 7);
+    }
+    writer.put(block.pbits[0], 1);
+    writer.put(block.pbits[1], 1);
+    writer.put(block.indices[0], 3);
+    for (int n = 1; n < 16; ++n) {
+        writer.put(block.indices[n], 4);
+    }
+}
+
+} // namespace
+
+std::size_t bc7_size(int width, int height)
+{
+    return static_cast<std::size_t>((width + 3) / 4) * ((height + 3) / 4) * BLOCK_BYTES;
+}
+
+std::vector<std::uint8_t> encode_bc7(const std::uint8_t* bgra, int width, int height, std::size_t pitch)
+{
+    const auto columns = (width + 3) / 4;
+    const auto rows    = (height + 3) / 4;
+
+    std::vector<std::uint8_t> result(bc7_size(width, height));
+    tbb::parallel_for(0, rows, [&](int row) {
+        for (int column = 0; column < columns; ++column) {
+            // Blocks past the edge repeat its last pixels.
+            std::array<std::array<int, 4>, 16> pixels;
+            for (int n = 0; n < 16; ++n) {
+                const auto x   = std::min(column * 4 + n % 4, width - 1);
+                const auto y   = std::min(row * 4 + n / 4, height - 1);
+                const auto src = bgra + y * pitch + x * 4;
+                pixels[n]      = {src[2], src[1], src[0], src[3]};
+            }
+            const auto offset = (static_cast<std::size_t>(row) * columns + column) * BLOCK_BYTES;
+            write_block(encode_block(pixels), result.data() + offset);
+        }
+    });
+    return result;
+}
+
+}} // namespace caspar::image
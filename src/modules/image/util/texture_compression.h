@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace caspar { namespace image {
+
+// Bytes of the 4x4 pixel blocks of a BC7 texture of width x height, the last column and row of blocks padded.
+std::size_t bc7_size(int width, int height);
+
+// Compresses width x height bgra pixels, rows pitch bytes apart, to a BC7 texture of the same rows in the same order,
+// a quarter of the size. Every block is encoded in mode 6, a single line through rgba with 7 bit endpoints and 16
+// steps, which keeps gradients and alpha edges of graphics close and takes the same time for every block. Blocks are
+// encoded in parallel.
+std::vector<std::uint8_t> encode_bc7(const std::uint8_t* bgra, int width, int height, std::size_t pitch);
+
+}} // namespace caspar::image
@@ -0,0 +1,492 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "net_route_producer.h"
+
+#include "../util/transport.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/diagnostics/metrics.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/param.h>
+#include <common/utf.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+#include <boost/regex.hpp>
+
+#include <tbb/concurrent_queue.h>
+
+#include <atomic>
+#include <cstring>
+#include <optional>
+#include <sstream>
+#include <thread>
+
+namespace caspar { namespace netroute {
+
+using boost::asio::ip::tcp;
+using boost::asio::ip::udp;
+
+namespace {
+
+// How long the sender has to accept a route.
+constexpr auto connect_timeout = std::chrono::seconds(5);
+
+diagnostics::metrics::labels_t route_labels(const std::wstring& host, int channel, int layer)
+{
+    return {{"host", u8(host)}, {"source_channel", std::to_string(channel)}, {"source_layer", std::to_string(layer)}};
+}
+
+// The planes an image of the format is uploaded as, empty for frames without an image.
+core::pixel_format_desc pixel_desc(const packet_header& header)
+{
+    const auto format = static_cast<core::output_format>(header.format);
+    if (header.image_size == 0) {
+        return core::pixel_format_desc(core::pixel_format::bgra);
+    }
+    if (header.image_size != image_size(format, header.width, header.height)) {
+        return core::pixel_format_desc(core::pixel_format::invalid);
+    }
+
+    core::pixel_format_desc desc(core::pixel_format::invalid);
+    switch (format) {
+        case core::output_format::bgra:
+            desc.format = core::pixel_format::bgra;
+            desc.planes.emplace_back(header.width, header.height, 4);
+            break;
+        case core::output_format::uyvy:
+            desc.format = core::pixel_format::uyvy;
+            desc.planes.emplace_back(header.width / 2, header.height, 4);
+            break;
+        case core::output_format::uyva:
+            desc.format = core::pixel_format::uyva;
+            desc.planes.emplace_back(header.width / 2, header.height, 4);
+            desc.planes.emplace_back(header.width, header.height, 1);
+            break;
+        default:
+            break;
+    }
+    return desc;
+}
+
+} // namespace
+
+class net_route_producer : public core::frame_producer
+{
+    const std::wstring                         host_;
+    const unsigned short                       port_;
+    const int                                  channel_;
+    const int                                  layer_;
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const core::video_format_desc              format_desc_;
+
+    spl::shared_ptr<diagnostics::graph>                  graph_;
+    const std::shared_ptr<diagnostics::metrics::counter> late_frames_;
+    const std::shared_ptr<diagnostics::metrics::counter> dropped_frames_;
+    const std::shared_ptr<diagnostics::metrics::counter> incomplete_frames_;
+
+    boost::asio::io_context context_;
+    tcp::socket             control_{context_};
+    char                    control_byte_ = 0;
+    frame_receiver          receiver_;
+
+    tbb::concurrent_bounded_queue<std::pair<core::draw_frame, core::draw_frame>> buffer_;
+    std::optional<std::pair<core::draw_frame, core::draw_frame>>                 frame_;
+
+    // The frame being received, only touched by the receive thread.
+    struct assembly
+    {
+        packet_header                      header;
+        std::optional<core::mutable_frame> frame;
+        std::vector<std::int32_t>          audio;
+        bool                               valid = false;
+
+        // Which datagrams arrived, by their index. All but the last carry as much as the sender fits in one, which
+        // is only known once one that isn't the last arrived.
+        std::size_t                  chunk = 0;
+        std::vector<bool>            arrived;
+        std::size_t                  missing = 0;
+        std::optional<std::uint32_t> last; // offset of the last datagram, when it arrived before the others
+
+        // Whether the datagram is new to the frame, false for repeats and for those that don't fit the others.
+        bool arrive(std::uint32_t offset, std::size_t size)
+        {
+            const auto final = offset + size == header.size;
+            if (chunk == 0) {
+                if (final && offset > 0) {
+                    if (last) {
+                        return false;
+                    }
+                    last = offset;
+                    return true;
+                }
+
+                chunk = size;
+                if (chunk == 0) {
+                    return false;
+                }
+                arrived.assign((header.size + chunk - 1) / chunk, false);
+                missing = arrived.size();
+
+                if (last) {
+                    if (*last % chunk != 0 || *last / chunk != arrived.size() - 1) {
+                        valid = false;
+                        return false;
+                    }
+                    arrived.back() = true;
+                    missing -= 1;
+                }
+            }
+
+            if (offset % chunk != 0) {
+                return false;
+            }
+            const auto index = offset / chunk;
+            if (index >= arrived.size() || final != (index == arrived.size() - 1) || (!final && size != chunk) ||
+                arrived[index]) {
+                return false;
+            }
+            arrived[index] = true;
+            missing -= 1;
+            return true;
+        }
+    };
+    std::optional<assembly>         assembly_;
+    std::optional<core::draw_frame> field_a_;
+
+    std::atomic<bool> connected_{false};
+    std::atomic<bool> abort_request_{false};
+    std::thread       thread_;
+
+  public:
+    net_route_producer(std::wstring                                host,
+                       unsigned short                              port,
+                       int                                         channel,
+                       int                                         layer,
+                       const std::wstring&                         mode,
+                       const std::wstring&                         format,
+                       int                                         buffer,
+                       const spl::shared_ptr<core::frame_factory>& frame_factory,
+                       const core::video_format_desc&              format_desc)
+        : host_(std::move(host))
+        , port_(port)
+        , channel_(channel)
+        , layer_(layer)
+        , frame_factory_(frame_factory)
+        , format_desc_(format_desc)
+        , late_frames_(diagnostics::metrics::make_counter("caspar_net_route_late_frames_total",
+                                                          "Ticks the network route had no frame from its source",
+                                                          route_labels(host_, channel, layer)))
+        , dropped_frames_(diagnostics::metrics::make_counter("caspar_net_route_dropped_frames_total",
+                                                             "Frames received while the route buffer was full",
+                                                             route_labels(host_, channel, layer)))
+        , incomplete_frames_(diagnostics::metrics::make_counter("caspar_net_route_incomplete_frames_total",
+                                                                "Frames missing datagrams, which were dropped",
+                                                                route_labels(host_, channel, layer)))
+    {
+        buffer_.set_capacity(buffer > 0 ? buffer : 2);
+
+        connect(mode, format);
+
+        graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        graph_->set_color("incomplete-frame", diagnostics::color(0.6f, 0.6f, 0.3f));
+        graph_->set_text(print());
+        diagnostics::register_graph(graph_);
+
+        thread_ = std::thread([this] {
+            set_thread_name(L"net-route");
+            while (!abort_request_) {
+                receiver_.receive(std::chrono::milliseconds(100),
+                                  [this](const packet_header& header, const std::uint8_t* payload, std::size_t size) {
+                                      on_packet(header, payload, size);
+                                  });
+                context_.poll();
+            }
+        });
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    ~net_route_producer() override
+    {
+        abort_request_ = true;
+        thread_.join();
+    }
+
+    core::draw_frame last_frame(const core::video_field field) override
+    {
+        if (!frame_) {
+            std::pair<core::draw_frame, core::draw_frame> frame;
+            if (buffer_.try_pop(frame)) {
+                frame_ = frame;
+            }
+        }
+
+        if (!frame_) {
+            return core::draw_frame{};
+        }
+
+        return core::draw_frame::still(field == core::video_field::b ? frame_->second : frame_->first);
+    }
+
+    core::draw_frame receive_impl(const core::video_field field, int nb_samples) override
+    {
+        if (field == core::video_field::a || field == core::video_field::progressive) {
+            std::pair<core::draw_frame, core::draw_frame> frame;
+            if (!buffer_.try_pop(frame)) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+                late_frames_->increment();
+            } else {
+                frame_ = frame;
+            }
+        }
+
+        if (!frame_) {
+            return core::draw_frame{};
+        }
+
+        return field == core::video_field::b ? frame_->second : frame_->first;
+    }
+
+    bool is_ready() override { return true; }
+
+    std::wstring print() const override
+    {
+        return L"net-route[" + host_ + L":" + std::to_wstring(port_) + L"/" + std::to_wstring(channel_) +
+               (layer_ >= 0 ? L"-" + std::to_wstring(layer_) : L"") + L"]";
+    }
+
+    std::wstring name() const override { return L"net-route"; }
+
+    core::monitor::state state() const override
+    {
+        core::monitor::state state;
+        state["route/host"]      = host_;
+        state["route/channel"]   = channel_;
+        state["route/connected"] = connected_.load();
+        if (layer_ > -1) {
+            state["route/layer"] = layer_;
+        }
+        return state;
+    }
+
+  private:
+    // Asks the sender for the route, which then streams to our port until the connection closes.
+    void connect(const std::wstring& mode, const std::wstring& format)
+    {
+        boost::system::error_code ec = boost::asio::error::timed_out;
+        tcp::resolver             resolver(context_);
+        boost::asio::async_connect(control_,
+                                   resolver.resolve(u8(host_), std::to_string(port_)),
+                                   [&](const boost::system::error_code& error, const tcp::endpoint&) { ec = error; });
+        context_.run_for(connect_timeout);
+        if (ec) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(print() + L" Could not connect: " + u16(ec.message())));
+        }
+
+        const auto request = "ROUTE " + std::to_string(channel_) + " " + std::to_string(layer_) + " " + u8(mode) +
+                             " " + u8(format) + " " + std::to_string(receiver_.port()) + "\r\n";
+        boost::asio::write(control_, boost::asio::buffer(request), ec);
+
+        boost::asio::streambuf reply;
+        ec = boost::asio::error::timed_out;
+        context_.restart();
+        boost::asio::async_read_until(
+            control_, reply, "\r\n", [&](const boost::system::error_code& error, std::size_t) { ec = error; });
+        context_.run_for(connect_timeout);
+        if (ec) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(print() + L" No answer: " + u16(ec.message())));
+        }
+
+        std::istream stream(&reply);
+        std::string  line;
+        std::getline(stream, line);
+        boost::trim(line);
+
+        std::istringstream answer(line);
+        std::string        status;
+        unsigned short     sender_port = 0;
+        answer >> status >> sender_port;
+        if (status != "OK" || !answer) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(print() + L" Refused: " + u16(line)));
+        }
+        receiver_.connect(udp::endpoint(control_.remote_endpoint().address(), sender_port));
+
+        connected_ = true;
+        context_.restart();
+        watch_control();
+    }
+
+    // The sender never writes again, the read ends once it closes the connection.
+    void watch_control()
+    {
+        control_.async_read_some(boost::asio::buffer(&control_byte_, 1),
+                                 [this](const boost::system::error_code& ec, std::size_t) {
+                                     if (!ec) {
+                                         watch_control();
+                                         return;
+                                     }
+                                     connected_ = false;
+                                     CASPAR_LOG(warning) << print() << L" Sender closed the route.";
+                                 });
+    }
+
+    void on_packet(const packet_header& header, const std::uint8_t* payload, std::size_t size)
+    {
+        if (!assembly_ || header.frame != assembly_->header.frame) {
+            // Datagrams of a frame that was given up on.
+            if (assembly_ && static_cast<std::int32_t>(header.frame - assembly_->header.frame) < 0) {
+                return;
+            }
+            if (assembly_ && assembly_->valid) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "incomplete-frame");
+                incomplete_frames_->increment();
+            }
+            begin(header);
+        }
+
+        if (!assembly_->valid) {
+            return;
+        }
+
+        // Every datagram of a frame describes it alike and lies within it, whatever claims to be part of it.
+        const auto& frame = assembly_->header;
+        if (header.size != frame.size || header.image_size != frame.image_size || header.width != frame.width ||
+            header.height != frame.height || header.format != frame.format || header.field != frame.field ||
+            static_cast<std::uint64_t>(header.offset) + size > frame.size) {
+            return;
+        }
+
+        if (!assembly_->arrive(header.offset, size)) {
+            return;
+        }
+
+        copy(header.offset, payload, size);
+        if (assembly_->chunk > 0 && assembly_->missing == 0) {
+            finish();
+        }
+    }
+
+    void begin(const packet_header& header)
+    {
+        assembly_.emplace();
+        assembly_->header = header;
+
+        const auto desc = pixel_desc(header);
+        if (desc.format == core::pixel_format::invalid || header.size < header.image_size ||
+            (header.size - header.image_size) % sizeof(std::int32_t)) {
+            CASPAR_LOG_RATE_LIMITED(warning, 5) << print() << L" Invalid frame.";
+            return;
+        }
+
+        assembly_->frame.emplace(frame_factory_->create_frame(this, desc));
+        assembly_->audio.resize((header.size - header.image_size) / sizeof(std::int32_t));
+        assembly_->valid = true;
+    }
+
+    // The image is received straight into the planes, which lie one after the other in the datagrams.
+    void copy(std::size_t offset, const std::uint8_t* data, std::size_t size)
+    {
+        auto&      frame      = *assembly_->frame;
+        const auto image_size = static_cast<std::size_t>(assembly_->header.image_size);
+
+        std::size_t plane_start = 0;
+        for (std::size_t n = 0; size > 0 && n < frame.pixel_format_desc().planes.size(); ++n) {
+            const auto plane_size = static_cast<std::size_t>(frame.pixel_format_desc().planes[n].size);
+            if (offset < plane_start + plane_size) {
+                const auto count = std::min(size, plane_start + plane_size - offset);
+                std::memcpy(frame.image_data(n).data() + (offset - plane_start), data, count);
+                offset += count;
+                data += count;
+                size -= count;
+            }
+            plane_start += plane_size;
+        }
+
+        if (size > 0 && offset >= image_size) {
+            std::memcpy(reinterpret_cast<std::uint8_t*>(assembly_->audio.data()) + (offset - image_size), data, size);
+        }
+    }
+
+    void finish()
+    {
+        assembly_->frame->audio_data() = array<std::int32_t>(std::move(assembly_->audio));
+        assembly_->valid               = false;
+
+        const auto       field = static_cast<core::video_field>(assembly_->header.field);
+        core::draw_frame frame(std::move(*assembly_->frame));
+
+        if (field == core::video_field::a) {
+            field_a_ = std::move(frame);
+            return;
+        }
+
+        auto first = field == core::video_field::b && field_a_ ? std::move(*field_a_) : frame;
+        field_a_.reset();
+        if (!buffer_.try_push(std::make_pair(std::move(first), std::move(frame)))) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+            dropped_frames_->increment();
+        }
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
+                                                      const std::vector<std::wstring>&         params)
+{
+    static boost::wregex expr(L"route://(?<HOST>[^/:]+)(:(?<PORT>\\d+))?/(?<CHANNEL>\\d+)(-(?<LAYER>\\d+))?",
+                              boost::regex::icase);
+    boost::wsmatch what;
+
+    if (params.empty() || !boost::regex_match(params.at(0), what, expr)) {
+        return core::frame_producer::empty();
+    }
+
+    auto host    = what["HOST"].str();
+    auto port    = what["PORT"].matched ? static_cast<unsigned short>(std::stoi(what["PORT"].str())) : default_port;
+    auto channel = std::stoi(what["CHANNEL"].str());
+    auto layer   = what["LAYER"].matched ? std::stoi(what["LAYER"].str()) : -1;
+
+    std::wstring mode = L"FOREGROUND";
+    if (layer >= 0 && contains_param(L"BACKGROUND", params)) {
+        mode = L"BACKGROUND";
+    } else if (layer >= 0 && contains_param(L"NEXT", params)) {
+        mode = L"NEXT";
+    }
+
+    auto format = boost::to_upper_copy(get_param(L"FORMAT", params, L"BGRA"));
+    if (format != L"BGRA" && format != L"UYVY" && format != L"UYVA") {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid route format: " + format));
+    }
+
+    auto buffer = get_param(L"BUFFER", params, 2);
+
+    return spl::make_shared<net_route_producer>(
+        host, port, channel, layer, mode, format, buffer, dependencies.frame_factory, dependencies.format_desc);
+}
+
+}} // namespace caspar::netroute
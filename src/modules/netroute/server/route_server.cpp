@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "route_server.h"
+
+#include "../util/transport.h"
+
+#include <common/except.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <core/consumer/frame_consumer.h>
+#include <core/consumer/output.h>
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/video_channel.h>
+#include <core/video_format.h>
+
+#include <boost/asio.hpp>
+#include <boost/signals2.hpp>
+
+#include <tbb/concurrent_queue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <istream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace caspar { namespace netroute {
+
+using boost::asio::ip::tcp;
+using boost::asio::ip::udp;
+
+namespace {
+
+struct pending_frame
+{
+    packet_header                                 header;
+    std::shared_future<array<const std::uint8_t>> image;
+    array<const std::int32_t>                     audio;
+    double                                        frames_per_second = 0.0;
+};
+
+// Sends the frames of one route from a thread of its own. Frames are dropped rather than queued while the network
+// is behind, so the route never lags its source by more than the queue.
+class frame_stream final
+{
+    const std::wstring                           name_;
+    frame_sender                                 sender_;
+    tbb::concurrent_bounded_queue<pending_frame> queue_;
+    std::atomic<std::int64_t>                    dropped_{0};
+    std::thread                                  thread_;
+
+  public:
+    frame_stream(std::wstring name, const udp::endpoint& endpoint, int mtu)
+        : name_(std::move(name))
+        , sender_(endpoint, mtu)
+    {
+        queue_.set_capacity(2);
+        thread_ = std::thread([this] {
+            set_thread_name(L"net-route-send");
+            try {
+                while (true) {
+                    pending_frame frame;
+                    queue_.pop(frame);
+                    sender_.send(frame.header, frame.image.get(), frame.audio, frame.frames_per_second);
+                }
+            } catch (tbb::user_abort&) {
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
+    }
+
+    unsigned short port() const { return sender_.port(); }
+
+    ~frame_stream()
+    {
+        queue_.abort();
+        thread_.join();
+    }
+
+    void push(pending_frame frame)
+    {
+        if (!queue_.try_push(std::move(frame))) {
+            CASPAR_LOG_RATE_LIMITED(warning, 5) << name_ << L" Network behind, dropped frames: " << ++dropped_;
+        }
+    }
+
+    std::int64_t dropped() const { return dropped_; }
+};
+
+packet_header make_header(int width, int height, core::output_format format, core::video_field field, int channels)
+{
+    packet_header header;
+    header.width          = static_cast<std::uint16_t>(width);
+    header.height         = static_cast<std::uint16_t>(height);
+    header.format         = static_cast<std::uint8_t>(format);
+    header.field          = static_cast<std::uint8_t>(field);
+    header.audio_channels = static_cast<std::uint16_t>(channels);
+    return header;
+}
+
+// Takes the frames of a whole channel as the mixer converted them for its consumers.
+class route_consumer final : public core::frame_consumer
+{
+    const std::shared_ptr<frame_stream> stream_;
+    const core::output_format           format_;
+    const int                           index_;
+    const std::wstring                  name_;
+    core::video_format_desc             format_desc_;
+
+  public:
+    route_consumer(std::shared_ptr<frame_stream> stream, core::output_format format, int id, std::wstring name)
+        : stream_(std::move(stream))
+        , format_(format)
+        , index_(1100 + id)
+        , name_(std::move(name))
+    {
+    }
+
+    core::send_result send(core::video_field field, core::const_frame frame) override
+    {
+        // Right after the consumers change, frames only have the bgra image.
+        auto format = format_;
+        auto image  = frame.image_data(format);
+        if (!image) {
+            format = core::output_format::bgra;
+            image  = frame.image_data(format);
+        }
+
+        // Without the padding of the mixer's layout.
+        const auto width  = static_cast<int>(frame.width());
+        const auto height = static_cast<int>(frame.height());
+        const auto size   = static_cast<std::size_t>(image_size(format, width, height));
+        if (image.size() > size) {
+            image = array<const std::uint8_t>(image.data(), size, image);
+        }
+
+        pending_frame pending;
+        pending.header            = make_header(width, height, format, field, format_desc_.audio_channels);
+        pending.image             = make_ready_future(std::move(image)).share();
+        pending.audio             = frame.audio_data();
+        pending.frames_per_second = format_desc_.fps;
+        stream_->push(std::move(pending));
+
+        return true;
+    }
+
+    void initialize(const core::video_format_desc& format_desc, int channel_index) override
+    {
+        format_desc_ = format_desc;
+    }
+
+    core::monitor::state state() const override
+    {
+        core::monitor::state state;
+        state["dropped"] = stream_->dropped();
+        return state;
+    }
+
+    std::wstring        print() const override { return name_; }
+    std::wstring        name() const override { return L"net-route"; }
+    int                 index() const override { return index_; }
+    core::output_format preferred_output_format() const override { return format_; }
+};
+
+class route_connection : public std::enable_shared_from_this<route_connection>
+{
+    tcp::socket                                             socket_;
+    const std::vector<spl::shared_ptr<core::video_channel>> channels_;
+    const int                                               mtu_;
+    const int                                               id_;
+    boost::asio::streambuf                                  request_{1024};
+    std::string                                             response_;
+    char                                                    byte_ = 0;
+
+    std::shared_ptr<core::video_channel> channel_;
+    std::shared_ptr<frame_stream>        stream_;
+    int                                  consumer_index_ = -1;
+    std::shared_ptr<core::route>         route_;
+    boost::signals2::scoped_connection   connection_;
+
+  public:
+    route_connection(tcp::socket socket, std::vector<spl::shared_ptr<core::video_channel>> channels, int mtu, int id)
+        : socket_(std::move(socket))
+        , channels_(std::move(channels))
+        , mtu_(mtu)
+        , id_(id)
+    {
+    }
+
+    ~route_connection()
+    {
+        connection_.disconnect();
+        if (channel_ && consumer_index_ >= 0) {
+            channel_->output().remove(consumer_index_);
+        }
+        if (stream_) {
+            CASPAR_LOG(info) << print() << L" Closed.";
+        }
+    }
+
+    void start()
+    {
+        auto self = shared_from_this();
+        boost::asio::async_read_until(
+            socket_, request_, "\r\n", [self](const boost::system::error_code& ec, std::size_t) {
+                if (!ec)
+                    self->respond();
+            });
+    }
+
+    void close()
+    {
+        boost::system::error_code ec;
+        socket_.close(ec);
+    }
+
+  private:
+    std::wstring print() const
+    {
+        boost::system::error_code ec;
+        return L"net-route[" + u16(socket_.remote_endpoint(ec).address().to_string()) + L"]";
+    }
+
+    void respond()
+    {
+        std::istream   stream(&request_);
+        std::string    command;
+        int            channel = 0;
+        int            layer   = -1;
+        std::string    mode;
+        std::string    format;
+        unsigned short port = 0;
+        stream >> command >> channel >> layer >> mode >> format >> port;
+
+        try {
+            if (!stream || command != "ROUTE") {
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid route request"));
+            }
+            open(channel, layer, mode, format, port);
+            response_ = "OK " + std::to_string(stream_->port()) + "\r\n";
+        } catch (const caspar_exception& e) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            const auto message = boost::get_error_info<msg_info_t>(e);
+            response_          = "ERROR " + (message ? *message : std::string("route failed")) + "\r\n";
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            response_ = "ERROR route failed\r\n";
+        }
+
+        auto self = shared_from_this();
+        boost::asio::async_write(
+            socket_, boost::asio::buffer(response_), [self](const boost::system::error_code& ec, std::size_t) {
+                if (!ec && self->stream_)
+                    self->watch();
+            });
+    }
+
+    // The receiver never writes after its request, the read ends when it goes away.
+    void watch()
+    {
+        auto self = shared_from_this();
+        socket_.async_read_some(boost::asio::buffer(&byte_, 1),
+                                [self](const boost::system::error_code& ec, std::size_t) {
+                                    if (!ec)
+                                        self->watch();
+                                });
+    }
+
+    void open(int channel, int layer, const std::string& mode, const std::string& format, unsigned short port)
+    {
+        auto it = std::find_if(channels_.begin(), channels_.end(), [&](auto& c) { return c->index() == channel; });
+        if (it == channels_.end()) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"No channel with id " + std::to_wstring(channel)));
+        }
+        channel_ = *it;
+
+        core::output_format output_format;
+        if (format == "BGRA") {
+            output_format = core::output_format::bgra;
+        } else if (format == "UYVY") {
+            output_format = core::output_format::uyvy;
+        } else if (format == "UYVA") {
+            output_format = core::output_format::uyva;
+        } else {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid route format: " + u16(format)));
+        }
+
+        auto route_mode = core::route_mode::foreground;
+        if (mode == "BACKGROUND") {
+            route_mode = core::route_mode::background;
+        } else if (mode == "NEXT") {
+            route_mode = core::route_mode::next;
+        }
+
+        const udp::endpoint endpoint(socket_.remote_endpoint().address(), port);
+        const auto          name = print() + L"[" + std::to_wstring(channel) +
+                          (layer >= 0 ? L"-" + std::to_wstring(layer) : L"") + L"|" + u16(format) + L"]";
+        stream_ = std::make_shared<frame_stream>(name, endpoint, mtu_);
+
+        if (layer < 0) {
+            auto consumer   = spl::make_shared<route_consumer>(stream_, output_format, id_, name);
+            consumer_index_ = consumer->index();
+            channel_->output().add(consumer);
+        } else {
+            route_ = channel_->route(layer, route_mode);
+
+            // Drawn when the channel produces the layer, read back by the time the stream gets to send it.
+            const auto fd     = route_->format_desc;
+            const auto source = channel_.get();
+            const auto stream = stream_;
+            const auto push   = [=](const core::draw_frame& frame, core::video_field field) {
+                pending_frame pending;
+                pending.header            = make_header(fd.width, fd.height, output_format, field, 0);
+                pending.image             = source->read(frame, output_format).share();
+                pending.frames_per_second = fd.fps;
+                stream->push(std::move(pending));
+            };
+            connection_ = route_->signal.connect([=](const core::draw_frame& frame1, const core::draw_frame& frame2) {
+                if (fd.field_count == 2) {
+                    push(frame1, core::video_field::a);
+                    push(frame2, core::video_field::b);
+                } else {
+                    push(frame1, core::video_field::progressive);
+                }
+            });
+        }
+
+        CASPAR_LOG(info) << name << L" Streaming to " << u16(endpoint.address().to_string()) << L":" << port << L".";
+    }
+};
+
+} // namespace
+
+struct route_server::impl : public std::enable_shared_from_this<impl>
+{
+    std::shared_ptr<boost::asio::io_service>                service_;
+    tcp::acceptor                                           acceptor_;
+    const int                                               mtu_;
+    const std::vector<spl::shared_ptr<core::video_channel>> channels_;
+    std::mutex                                              mutex_;
+    std::vector<std::weak_ptr<route_connection>>            connections_;
+    int                                                     next_id_ = 0;
+
+    impl(std::shared_ptr<boost::asio::io_service>          service,
+         unsigned short                                    port,
+         int                                               mtu,
+         std::vector<spl::shared_ptr<core::video_channel>> channels)
+        : service_(std::move(service))
+        , acceptor_(*service_, tcp::endpoint(tcp::v4(), port))
+        , mtu_(mtu)
+        , channels_(std::move(channels))
+    {
+    }
+
+    void start_accept()
+    {
+        std::weak_ptr<impl> weak_self = shared_from_this();
+        acceptor_.async_accept([weak_self](const boost::system::error_code& ec, tcp::socket socket) {
+            auto self = weak_self.lock();
+            if (!self || ec == boost::asio::error::operation_aborted)
+                return;
+            if (!ec) {
+                socket.set_option(tcp::no_delay(true));
+                auto connection = std::make_shared<route_connection>(
+                    std::move(socket), self->channels_, self->mtu_, self->next_id_++);
+                connection->start();
+
+                std::lock_guard<std::mutex> lock(self->mutex_);
+                auto&                       connections = self->connections_;
+                connections.erase(std::remove_if(connections.begin(),
+                                                 connections.end(),
+                                                 [](auto& c) { return c.expired(); }),
+                                  connections.end());
+                connections.push_back(connection);
+            }
+            self->start_accept();
+        });
+    }
+
+    // Closing the sockets fails their reads, and the routes end once the last handler lets go.
+    void stop()
+    {
+        boost::system::error_code ec;
+        acceptor_.close(ec);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& c : connections_) {
+            if (auto connection = c.lock()) {
+                connection->close();
+            }
+        }
+    }
+};
+
+route_server::route_server(std::shared_ptr<boost::asio::io_service>          service,
+                           unsigned short                                    port,
+                           int                                               mtu,
+                           std::vector<spl::shared_ptr<core::video_channel>> channels)
+    : impl_(spl::make_shared<impl>(std::move(service), port, mtu, std::move(channels)))
+{
+    impl_->start_accept();
+    CASPAR_LOG(info) << L"Serving routes on port " << port;
+}
+
+route_server::~route_server()
+{
+    auto impl = impl_;
+    boost::asio::post(*impl->service_, [impl] { impl->stop(); });
+}
+
+}} // namespace caspar::netroute
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/fwd.h>
+
+#include <boost/asio/io_service.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace caspar { namespace netroute {
+
+// Streams channels and layers to the route:// producers of other servers, see util/transport.h. Whole channels are
+// sent as the mixer converted them for the output, layers are drawn and read back by the gpu of their channel for
+// every route and carry no audio, which is only mixed for the channel.
+class route_server final
+{
+  public:
+    route_server(std::shared_ptr<boost::asio::io_service>          service,
+                 unsigned short                                    port,
+                 int                                               mtu,
+                 std::vector<spl::shared_ptr<core::video_channel>> channels);
+    ~route_server();
+
+    route_server(const route_server&)            = delete;
+    route_server& operator=(const route_server&) = delete;
+
+  private:
+    struct impl;
+    spl::shared_ptr<impl> impl_;
+};
+
+}} // namespace caspar::netroute
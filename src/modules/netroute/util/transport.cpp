@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "transport.h"
+
+#include <common/log.h>
+
+#include <boost/asio/io_context.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef SO_MAX_PACING_RATE
+#define SO_MAX_PACING_RATE 47
+#endif
+#endif
+
+namespace caspar { namespace netroute {
+
+using boost::asio::ip::udp;
+
+namespace {
+
+// IP and UDP headers, without options.
+constexpr int ip_udp_header_size = 28;
+
+// The largest datagram the kernel segments from one message.
+constexpr int max_message_size     = 65000;
+constexpr int max_message_segments = 64;
+
+constexpr int max_datagram_size = 65536;
+constexpr int receive_batch     = 32;
+
+// A range of the frame's bytes, which may lie partly in the image and partly in the audio.
+template <typename Add>
+void gather(const array<const std::uint8_t>& image,
+            const array<const std::int32_t>& audio,
+            std::size_t                      offset,
+            std::size_t                      size,
+            Add&&                            add)
+{
+    const auto audio_bytes = reinterpret_cast<const std::uint8_t*>(audio.data());
+    if (offset < image.size()) {
+        const auto count = std::min(size, image.size() - offset);
+        add(image.data() + offset, count);
+        offset += count;
+        size -= count;
+    }
+    if (size > 0) {
+        add(audio_bytes + (offset - image.size()), size);
+    }
+}
+
+} // namespace
+
+std::int64_t image_size(core::output_format format, int width, int height)
+{
+    const auto pixels = static_cast<std::int64_t>(width) * height;
+    switch (format) {
+        case core::output_format::uyvy:
+            return pixels * 2;
+        case core::output_format::uyva:
+            return pixels * 3;
+        default:
+            return pixels * 4;
+    }
+}
+
+struct frame_sender::impl
+{
+    boost::asio::io_context context_;
+    udp::socket             socket_{context_};
+    const std::size_t       payload_size_;
+    std::uint32_t           frame_ = 0;
+
+#ifdef __linux__
+    bool          segmentation_ = true;
+    std::uint32_t pacing_rate_  = 0;
+
+    struct alignas(cmsghdr) control
+    {
+        char data[CMSG_SPACE(sizeof(std::uint16_t))];
+    };
+
+    std::vector<packet_header> headers_;
+    std::vector<iovec>         iovecs_;
+    std::vector<std::size_t>   starts_;
+    std::vector<mmsghdr>       messages_;
+    std::vector<control>       controls_;
+#endif
+
+    impl(const udp::endpoint& endpoint, int mtu)
+        : payload_size_(static_cast<std::size_t>(std::max(mtu - ip_udp_header_size, 576) - sizeof(packet_header)))
+    {
+        socket_.open(udp::v4());
+        socket_.set_option(boost::asio::socket_base::send_buffer_size(16 * 1024 * 1024));
+        socket_.connect(endpoint);
+    }
+
+    void send(packet_header                    header,
+              const array<const std::uint8_t>& image,
+              const array<const std::int32_t>& audio,
+              double                           frames_per_second)
+    {
+        header.magic      = packet_magic;
+        header.frame      = frame_++;
+        header.image_size = static_cast<std::uint32_t>(image.size());
+        header.size       = static_cast<std::uint32_t>(image.size() + audio.size() * sizeof(std::int32_t));
+
+        // Frames without anything to draw or hear still send a header, the receiver plays them as empty frames.
+        const auto packets = std::max<std::size_t>(1, (header.size + payload_size_ - 1) / payload_size_);
+
+#ifdef __linux__
+        pace(packets * (sizeof(packet_header) + payload_size_), frames_per_second);
+
+        headers_.assign(packets, header);
+        iovecs_.clear();
+        iovecs_.reserve(packets * 3);
+        starts_.clear();
+        for (std::size_t n = 0; n < packets; ++n) {
+            auto& packet  = headers_[n];
+            packet.offset = static_cast<std::uint32_t>(n * payload_size_);
+
+            starts_.push_back(iovecs_.size());
+            iovecs_.push_back({&packet, sizeof(packet_header)});
+            const auto size = std::min<std::size_t>(payload_size_, header.size - std::min(packet.offset, header.size));
+            gather(image, audio, packet.offset, size, [&](const std::uint8_t* data, std::size_t count) {
+                iovecs_.push_back({const_cast<std::uint8_t*>(data), count});
+            });
+        }
+        starts_.push_back(iovecs_.size());
+
+        if (!send_messages(packets)) {
+            // Kernels or interfaces without segmentation offload refuse the first frame, which is sent again.
+            segmentation_ = false;
+            CASPAR_LOG(info) << L"[net-route] UDP segmentation offload unavailable, sending datagrams one by one.";
+            send_messages(packets);
+        }
+#else
+        std::vector<boost::asio::const_buffer> buffers;
+        for (std::size_t n = 0; n < packets; ++n) {
+            header.offset = static_cast<std::uint32_t>(n * payload_size_);
+            const auto size =
+                std::min<std::size_t>(payload_size_, header.size - std::min(header.offset, header.size));
+
+            buffers.clear();
+            buffers.emplace_back(&header, sizeof(packet_header));
+            gather(image, audio, header.offset, size, [&](const std::uint8_t* data, std::size_t count) {
+                buffers.emplace_back(data, count);
+            });
+
+            boost::system::error_code ec;
+            socket_.send(buffers, 0, ec);
+            if (ec) {
+                CASPAR_LOG_RATE_LIMITED(warning, 5) << L"[net-route] Send failed: " << ec.message().c_str();
+                return;
+            }
+        }
+#endif
+    }
+
+#ifdef __linux__
+    // Returns false only when segmentation isn't supported.
+    bool send_messages(std::size_t packets)
+    {
+        const auto datagram = sizeof(packet_header) + payload_size_;
+        const auto segments =
+            segmentation_ ? std::clamp<std::size_t>(max_message_size / datagram, 1, max_message_segments) : 1;
+
+        messages_.assign((packets + segments - 1) / segments, mmsghdr{});
+        controls_.resize(messages_.size());
+        for (std::size_t n = 0; n < messages_.size(); ++n) {
+            const auto first = n * segments;
+            const auto last  = std::min(first + segments, packets);
+
+            auto& message      = messages_[n].msg_hdr;
+            message.msg_iov    = &iovecs_[starts_[first]];
+            message.msg_iovlen = starts_[last] - starts_[first];
+            if (last - first > 1) {
+                // Every datagram is whole but the very last of the frame, which ends the last message.
+                message.msg_control    = controls_[n].data;
+                message.msg_controllen = sizeof(controls_[n].data);
+                auto cmsg              = CMSG_FIRSTHDR(&message);
+                cmsg->cmsg_level       = SOL_UDP;
+                cmsg->cmsg_type        = UDP_SEGMENT;
+                cmsg->cmsg_len         = CMSG_LEN(sizeof(std::uint16_t));
+                const auto size        = static_cast<std::uint16_t>(datagram);
+                std::memcpy(CMSG_DATA(cmsg), &size, sizeof(size));
+            }
+        }
+
+        for (std::size_t sent = 0; sent < messages_.size();) {
+            const auto result = ::sendmmsg(socket_.native_handle(),
+                                           &messages_[sent],
+                                           static_cast<unsigned int>(messages_.size() - sent),
+                                           0);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (segmentation_ && sent == 0 && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT)) {
+                    return false;
+                }
+                CASPAR_LOG_RATE_LIMITED(warning, 5) << L"[net-route] Send failed: " << std::strerror(errno);
+                return true;
+            }
+            sent += static_cast<std::size_t>(result);
+        }
+        return true;
+    }
+
+    void pace(std::size_t frame_bytes, double frames_per_second)
+    {
+        const auto rate = static_cast<std::uint32_t>(
+            std::min(frame_bytes * frames_per_second * 2.0, static_cast<double>(UINT32_MAX)));
+        if (rate == pacing_rate_) {
+            return;
+        }
+        pacing_rate_ = rate;
+        // Without the fq qdisc on the interface this has no effect, and bursts go out at line rate.
+        ::setsockopt(socket_.native_handle(), SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate));
+    }
+#endif
+};
+
+frame_sender::frame_sender(const udp::endpoint& endpoint, int mtu)
+    : impl_(new impl(endpoint, mtu))
+{
+}
+frame_sender::~frame_sender() {}
+unsigned short frame_sender::port() const { return impl_->socket_.local_endpoint().port(); }
+void frame_sender::send(packet_header                    header,
+                        const array<const std::uint8_t>& image,
+                        const array<const std::int32_t>& audio,
+                        double                           frames_per_second)
+{
+    impl_->send(header, image, audio, frames_per_second);
+}
+
+struct frame_receiver::impl
+{
+    boost::asio::io_context context_;
+    udp::socket             socket_{context_};
+
+    std::vector<std::uint8_t> buffers_ = std::vector<std::uint8_t>(receive_batch * max_datagram_size);
+
+#ifdef __linux__
+    std::vector<iovec>   iovecs_   = std::vector<iovec>(receive_batch);
+    std::vector<mmsghdr> messages_ = std::vector<mmsghdr>(receive_batch);
+#endif
+
+    impl()
+    {
+        socket_.open(udp::v4());
+        // Frames arrive in bursts of several MB, the kernel caps this at net.core.rmem_max.
+        socket_.set_option(boost::asio::socket_base::receive_buffer_size(64 * 1024 * 1024));
+        socket_.bind(udp::endpoint(udp::v4(), 0));
+        socket_.non_blocking(true);
+
+#ifdef __linux__
+        for (int n = 0; n < receive_batch; ++n) {
+            iovecs_[n]                     = {buffers_.data() + n * max_datagram_size, max_datagram_size};
+            messages_[n].msg_hdr.msg_iov   = &iovecs_[n];
+            messages_[n].msg_hdr.msg_iovlen = 1;
+        }
+#endif
+    }
+
+    void receive(std::chrono::milliseconds timeout, const handler_t& handler)
+    {
+#ifdef __linux__
+        pollfd fd{socket_.native_handle(), POLLIN, 0};
+        if (::poll(&fd, 1, static_cast<int>(timeout.count())) <= 0) {
+            return;
+        }
+
+        for (;;) {
+            const auto count =
+                ::recvmmsg(socket_.native_handle(), messages_.data(), receive_batch, MSG_DONTWAIT, nullptr);
+            if (count <= 0) {
+                return;
+            }
+            for (int n = 0; n < count; ++n) {
+                dispatch(buffers_.data() + n * max_datagram_size, messages_[n].msg_len, handler);
+            }
+            if (count < receive_batch) {
+                return;
+            }
+        }
+#else
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        for (;;) {
+            boost::system::error_code ec;
+            const auto size = socket_.receive(boost::asio::buffer(buffers_.data(), max_datagram_size), 0, ec);
+            if (!ec) {
+                dispatch(buffers_.data(), size, handler);
+                continue;
+            }
+            if (ec != boost::asio::error::would_block || std::chrono::steady_clock::now() >= deadline) {
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+#endif
+    }
+
+    static void dispatch(const std::uint8_t* data, std::size_t size, const handler_t& handler)
+    {
+        if (size < sizeof(packet_header)) {
+            return;
+        }
+        packet_header header;
+        std::memcpy(&header, data, sizeof(header));
+        const auto payload = size - sizeof(packet_header);
+        if (header.magic != packet_magic || header.image_size > header.size || header.offset > header.size ||
+            payload > header.size - header.offset) {
+            return;
+        }
+        handler(header, data + sizeof(packet_header), payload);
+    }
+};
+
+frame_receiver::frame_receiver()
+    : impl_(new impl())
+{
+}
+frame_receiver::~frame_receiver() {}
+unsigned short frame_receiver::port() const { return impl_->socket_.local_endpoint().port(); }
+void           frame_receiver::connect(const udp::endpoint& sender) { impl_->socket_.connect(sender); }
+void           frame_receiver::receive(std::chrono::milliseconds timeout, const handler_t& handler)
+{
+    impl_->receive(timeout, handler);
+}
+
+}} // namespace caspar::netroute
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/array.h>
+
+#include <core/frame/pixel_format.h>
+
+#include <boost/asio/ip/udp.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace caspar { namespace netroute {
+
+// A route between servers is asked for over TCP with a single line, "ROUTE <channel> <layer> <mode> <format> <port>",
+// where layer is -1 for the whole channel, mode is FOREGROUND, BACKGROUND or NEXT and format BGRA, UYVY or UYVA. The
+// sender answers "OK <port>" with the UDP port the frames leave from, or "ERROR <message>", and streams the frames to
+// the UDP port of the asking address until the connection closes.
+//
+// Each datagram is a packet_header and a slice of its frame, the image followed by interleaved 32 bit audio. Every
+// header describes the whole frame so a receiver can start on any datagram. Fields of interlaced channels are sent as
+// frames of their own. Values are in the byte order of the sender, both ends being little endian.
+struct packet_header
+{
+    std::uint32_t magic          = 0;
+    std::uint32_t frame          = 0; // counts up with every frame sent
+    std::uint32_t offset         = 0; // of the payload in the frame
+    std::uint32_t size           = 0; // of the frame, image and audio
+    std::uint32_t image_size     = 0;
+    std::uint16_t width          = 0;
+    std::uint16_t height         = 0;
+    std::uint8_t  format         = 0; // core::output_format of the image, bgra, uyvy or uyva
+    std::uint8_t  field          = 0; // core::video_field
+    std::uint16_t audio_channels = 0;
+};
+static_assert(sizeof(packet_header) == 28, "packet_header is sent as it is");
+
+constexpr std::uint32_t packet_magic = 0x54524743; // CGRT
+
+// The TCP port routes are asked for on when none is given.
+constexpr unsigned short default_port = 5255;
+
+// The bytes of an image of the format as the receiver uploads it, the mixer's layout without its padding.
+std::int64_t image_size(core::output_format format, int width, int height);
+
+// Sends frames to one receiver. On Linux a frame leaves in a few sendmmsg calls that have the kernel cut batches of
+// datagrams apart (UDP_SEGMENT), with the payloads gathered straight from the frame's memory, paced by the fq qdisc
+// at twice the stream's rate to spare the switch and the receiver. Elsewhere each datagram is sent by itself.
+class frame_sender final
+{
+  public:
+    // The datagrams, IP and UDP headers included, are at most mtu bytes.
+    frame_sender(const boost::asio::ip::udp::endpoint& endpoint, int mtu);
+    ~frame_sender();
+
+    frame_sender(const frame_sender&)            = delete;
+    frame_sender& operator=(const frame_sender&) = delete;
+
+    // The local port the datagrams leave from.
+    unsigned short port() const;
+
+    // header describes the frame, the rest of it is filled in. frames_per_second is the rate frames are sent at.
+    void send(packet_header                    header,
+              const array<const std::uint8_t>& image,
+              const array<const std::int32_t>& audio,
+              double                           frames_per_second);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+// Receives datagrams on a port of its own. On Linux they are read in batches with recvmmsg.
+class frame_receiver final
+{
+  public:
+    using handler_t = std::function<void(const packet_header&, const std::uint8_t* payload, std::size_t size)>;
+
+    frame_receiver();
+    ~frame_receiver();
+
+    frame_receiver(const frame_receiver&)            = delete;
+    frame_receiver& operator=(const frame_receiver&) = delete;
+
+    unsigned short port() const;
+
+    // Only takes datagrams from the sender from then on, the port being open to anyone on the network.
+    void connect(const boost::asio::ip::udp::endpoint& sender);
+
+    // Waits up to timeout for datagrams and hands each one with a valid header to handler.
+    void receive(std::chrono::milliseconds timeout, const handler_t& handler);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::netroute
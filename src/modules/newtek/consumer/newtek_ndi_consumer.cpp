@@ -28,12 +28,15 @@
 #include <chrono>
 #include <condition_variable>
 #include <core/consumer/frame_consumer.h>
+#include <core/consumer/latency.h>
 #include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
 #include <core/mixer/audio/audio_util.h>
 #include <core/video_format.h>
 
 #include <common/assert.h>
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/metrics.h>
 #include <common/executor.h>
 #include <common/future.h>
 #include <common/param.h>
@@ -42,6 +45,7 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/thread.hpp>
+#include <array>
 #include <ratio>
 #include <thread>
 
@@ -55,34 +59,40 @@ struct newtek_ndi_consumer : public core::frame_consumer
     const int               instance_no_;
     const std::wstring      name_;
     const bool              allow_fields_;
-
-    core::video_format_desc              format_desc_;
-    int                                  channel_index_;
-    NDIlib_v5*                           ndi_lib_;
-    NDIlib_video_frame_v2_t              ndi_video_frame_;
-    NDIlib_audio_frame_interleaved_32s_t ndi_audio_frame_;
-    std::shared_ptr<uint8_t>             field_data_;
-    spl::shared_ptr<diagnostics::graph>  graph_;
-    caspar::timer                        tick_timer_;
-    caspar::timer                        frame_timer_;
-    caspar::timer                        ndi_timer_;
-    int                                  frame_no_;
-    std::mutex                           buffer_mutex_;
-    std::condition_variable              buffer_cond_;
-    std::condition_variable              worker_cond_;
-    bool                                 ready_for_frame_;
-    std::queue<core::const_frame>        buffer_;
-    boost::thread                        send_thread;
-    executor                             executor_;
+    const int               width_;
+    const int               height_;
+
+    core::video_format_desc                  format_desc_;
+    int                                      channel_index_;
+    NDIlib_v5*                               ndi_lib_;
+    NDIlib_video_frame_v2_t                  ndi_video_frame_;
+    NDIlib_audio_frame_interleaved_32s_t     ndi_audio_frame_;
+    std::array<std::vector<uint8_t>, 2>      field_data_;
+    core::const_frame                        sent_frame_;
+    std::shared_ptr<core::latency_histogram> latency_;
+    spl::shared_ptr<diagnostics::graph>      graph_;
+    caspar::timer                            tick_timer_;
+    caspar::timer                            frame_timer_;
+    caspar::timer                            ndi_timer_;
+    int                                      frame_no_;
+    std::mutex                               buffer_mutex_;
+    std::condition_variable                  buffer_cond_;
+    std::condition_variable                  worker_cond_;
+    bool                                     ready_for_frame_;
+    std::queue<core::const_frame>            buffer_;
+    boost::thread                            send_thread;
+    executor                                 executor_;
 
     std::unique_ptr<NDIlib_send_instance_t, std::function<void(NDIlib_send_instance_t*)>> ndi_send_instance_;
 
   public:
-    newtek_ndi_consumer(std::wstring name, bool allow_fields)
+    newtek_ndi_consumer(std::wstring name, bool allow_fields, int width, int height)
         : name_(!name.empty() ? name : default_ndi_name())
         , instance_no_(instances_++)
         , frame_no_(0)
         , allow_fields_(allow_fields)
+        , width_(width)
+        , height_(height)
         , channel_index_(0)
         , executor_(L"ndi_consumer[" + std::to_wstring(instance_no_) + L"]")
     {
@@ -133,9 +143,10 @@ struct newtek_ndi_consumer : public core::frame_consumer
             ndi_video_frame_.yres /= 2;
             ndi_video_frame_.frame_rate_N /= 2;
             ndi_video_frame_.picture_aspect_ratio = format_desc.width * 1.0f / format_desc.height;
-            field_data_.reset(new uint8_t[ndi_video_frame_.line_stride_in_bytes * ndi_video_frame_.yres],
-                              std::default_delete<uint8_t[]>());
-            ndi_video_frame_.p_data = field_data_.get();
+            // Fields are sent from alternate buffers, NDI reads the previous one until the next send returns.
+            for (auto& field_data : field_data_) {
+                field_data.resize(static_cast<size_t>(ndi_video_frame_.line_stride_in_bytes) * ndi_video_frame_.yres);
+            }
         }
 
         ndi_audio_frame_.sample_rate = format_desc_.audio_sample_rate;
@@ -145,9 +156,14 @@ struct newtek_ndi_consumer : public core::frame_consumer
         graph_->set_text(print());
         // CASPAR_VERIFY(ndi_send_instance_);
 
+        auto latency = std::make_shared<core::latency_histogram>(diagnostics::metrics::labels_t{
+            {"channel", std::to_string(channel_index_)}, {"consumer", "ndi"}, {"name", u8(name_)}});
+        std::atomic_store(&latency_, latency);
+
         send_thread = boost::thread([=]() {
             set_thread_realtime_priority();
             set_thread_name(L"NDI-SEND: " + name_);
+            set_thread_affinity(thread_role::consumer);
             CASPAR_LOG(info) << L"Starting ndi-send thread for ndi output: " << name_;
             try {
                 auto buffer_size = buffer_.size();
@@ -186,18 +202,51 @@ struct newtek_ndi_consumer : public core::frame_consumer
                     ndi_audio_frame_.no_samples = audio_data_size / format_desc_.audio_channels;
                     ndi_audio_frame_.p_data     = const_cast<int*>(audio_data.data());
                     ndi_lib_->util_send_send_audio_interleaved_32s(*ndi_send_instance_, &ndi_audio_frame_);
-                    if (format_desc_.field_count == 2 && allow_fields_) {
+
+                    // UYVA is what NDI compresses from, bgra is left for frames mixed before the consumer was added.
+                    // Scaled by the mixer, the frame is sent whole as the fields don't survive the scaling.
+                    const auto& scaled =
+                        frame.image_data(core::scaled_output_format{core::output_format::uyva, width_, height_});
+                    const auto& uyva     = scaled ? scaled : frame.image_data(core::output_format::uyva);
+                    const auto& image    = uyva ? uyva : frame.image_data(core::output_format::bgra);
+                    const auto  width    = scaled ? width_ : format_desc_.width;
+                    const auto  height   = scaled ? height_ : format_desc_.height;
+                    const auto  linesize = width * (uyva ? 2 : 4);
+                    const auto  fields   = format_desc_.field_count == 2 && allow_fields_ && !scaled;
+
+                    ndi_video_frame_.xres                 = width;
+                    ndi_video_frame_.yres                 = fields ? height / 2 : height;
+                    ndi_video_frame_.FourCC               = uyva ? NDIlib_FourCC_type_UYVA : NDIlib_FourCC_type_BGRA;
+                    ndi_video_frame_.line_stride_in_bytes = linesize;
+                    ndi_video_frame_.frame_rate_N =
+                        format_desc_.framerate.numerator() * format_desc_.field_count / (fields ? 2 : 1);
+                    ndi_video_frame_.picture_aspect_ratio = fields ? width * 1.0f / height : 0.0f;
+
+                    if (fields) {
+                        const auto field = frame_no_ % 2;
+                        auto       dest  = field_data_[field].data();
                         ndi_video_frame_.frame_format_type =
-                            (frame_no_ % 2 ? NDIlib_frame_format_type_field_1 : NDIlib_frame_format_type_field_0);
+                            (field ? NDIlib_frame_format_type_field_1 : NDIlib_frame_format_type_field_0);
                         for (auto y = 0; y < ndi_video_frame_.yres; ++y) {
-                            std::memcpy(reinterpret_cast<char*>(ndi_video_frame_.p_data) + y * format_desc_.width * 4,
-                                        frame.image_data(0).data() + (y * 2 + frame_no_ % 2) * format_desc_.width * 4,
-                                        format_desc_.width * 4);
+                            std::memcpy(dest + y * linesize, image.data() + (y * 2 + field) * linesize, linesize);
+                        }
+                        if (uyva) {
+                            auto alpha_dest = dest + ndi_video_frame_.yres * linesize;
+                            auto alpha      = image.data() + height * linesize;
+                            for (auto y = 0; y < ndi_video_frame_.yres; ++y) {
+                                std::memcpy(alpha_dest + y * width, alpha + (y * 2 + field) * width, width);
+                            }
                         }
+                        ndi_video_frame_.p_data = dest;
                     } else {
-                        ndi_video_frame_.p_data = const_cast<uint8_t*>(frame.image_data(0).begin());
+                        ndi_video_frame_.frame_format_type = NDIlib_frame_format_type_progressive;
+                        ndi_video_frame_.p_data            = const_cast<uint8_t*>(image.data());
                     }
-                    ndi_lib_->send_send_video_v2(*ndi_send_instance_, &ndi_video_frame_);
+
+                    // Returns once NDI has taken the previous frame, which until then had to stay alive.
+                    ndi_lib_->send_send_video_async_v2(*ndi_send_instance_, &ndi_video_frame_);
+                    latency->observe(frame.capture_time());
+                    sent_frame_ = std::move(frame);
                     frame_no_++;
                     graph_->set_value("frame-time", frame_timer_.elapsed() * format_desc_.fps * 0.5);
                     std::this_thread::sleep_until(time_point);
@@ -206,10 +255,14 @@ struct newtek_ndi_consumer : public core::frame_consumer
             } catch (boost::thread_interrupted) {
                 // NOTHING
             }
+
+            // Wait for NDI to let go of the last frame.
+            ndi_lib_->send_send_video_async_v2(*ndi_send_instance_, nullptr);
+            sent_frame_ = {};
         });
     }
 
-    std::future<bool> send(core::video_field field, core::const_frame frame) override
+    core::send_result send(core::video_field field, core::const_frame frame) override
     {
         return executor_.begin_invoke([=] {
             graph_->set_value("tick-time", tick_timer_.elapsed() * format_desc_.fps * 0.5);
@@ -243,11 +296,22 @@ struct newtek_ndi_consumer : public core::frame_consumer
 
     bool has_synchronization_clock() const override { return false; }
 
+    core::output_format preferred_output_format() const override { return core::output_format::uyva; }
+
+    std::pair<int, int> preferred_output_size() const override { return {width_, height_}; }
+
     core::monitor::state state() const override
     {
         core::monitor::state state;
         state["ndi/name"]         = name_;
         state["ndi/allow_fields"] = allow_fields_;
+        if (width_ > 0 && height_ > 0) {
+            state["ndi/width"]  = width_;
+            state["ndi/height"] = height_;
+        }
+        if (auto latency = std::atomic_load(&latency_)) {
+            state["latency"] = latency->state();
+        }
         return state;
     }
 };
@@ -263,7 +327,9 @@ create_ndi_consumer(const std::vector<std::wstring>&                         par
         return core::frame_consumer::empty();
     std::wstring name         = get_param(L"NAME", params, L"");
     bool         allow_fields = contains_param(L"ALLOW_FIELDS", params);
-    return spl::make_shared<newtek_ndi_consumer>(name, allow_fields);
+    auto         width        = get_param(L"WIDTH", params, 0);
+    auto         height       = get_param(L"HEIGHT", params, 0);
+    return spl::make_shared<newtek_ndi_consumer>(name, allow_fields, width, height);
 }
 
 spl::shared_ptr<core::frame_consumer>
@@ -273,7 +339,9 @@ create_preconfigured_ndi_consumer(const boost::property_tree::wptree&
 {
     auto name         = ptree.get(L"name", L"");
     bool allow_fields = ptree.get(L"allow-fields", false);
-    return spl::make_shared<newtek_ndi_consumer>(name, allow_fields);
+    auto width        = ptree.get(L"width", 0);
+    auto height       = ptree.get(L"height", 0);
+    return spl::make_shared<newtek_ndi_consumer>(name, allow_fields, width, height);
 }
 
 }} // namespace caspar::newtek
@@ -40,12 +40,14 @@ void init(const core::module_dependencies& dependencies)
         dependencies.consumer_registry->register_preconfigured_consumer_factory(L"ndi",
                                                                                 create_preconfigured_ndi_consumer);
 
-        dependencies.producer_registry->register_producer_factory(L"NDI Producer", create_ndi_producer);
+        dependencies.producer_registry->register_producer_factory(
+            L"NDI Producer", create_ndi_producer, {{L"[NDI]"}, {L"ndi"}});
 
         dependencies.command_repository->register_command(L"Query Commands", L"NDI LIST", ndi::list_command, 0);
 
+        // Otherwise loaded by the first NDI producer, consumer or NDI LIST.
         bool autoload = caspar::env::properties().get(L"configuration.ndi.auto-load", false);
-        if (autoload)
+        if (autoload || core::get_module_init() == core::module_init::eager)
             ndi::load_library();
 
     } catch (...) {
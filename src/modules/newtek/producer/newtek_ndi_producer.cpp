@@ -27,6 +27,7 @@
 #include <core/frame/draw_frame.h>
 #include <core/frame/frame.h>
 #include <core/frame/frame_factory.h>
+#include <core/frame/frame_transform.h>
 #include <core/frame/geometry.h>
 #include <core/frame/pixel_format.h>
 #include <core/monitor/monitor.h>
@@ -50,6 +51,10 @@
 
 #include <tbb/parallel_for.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
 #include <ffmpeg/util/av_util.h>
 
 #ifdef _MSC_VER
@@ -67,18 +72,57 @@ extern "C" {
 
 namespace caspar { namespace newtek {
 
+// Owns the receiver, and is shared with the frames still holding video captured from it.
+struct ndi_receiver
+{
+    NDIlib_v5*                  lib;
+    NDIlib_recv_instance_t      recv;
+    NDIlib_framesync_instance_t framesync;
+
+    ndi_receiver(NDIlib_v5* lib, NDIlib_recv_instance_t recv)
+        : lib(lib)
+        , recv(recv)
+        , framesync(lib->framesync_create(recv))
+    {
+    }
+
+    ~ndi_receiver()
+    {
+        lib->framesync_destroy(framesync);
+        lib->recv_destroy(recv);
+    }
+};
+
+// Describes UYVY and UYVA video as the planes the mixer draws on the uyvy path, uploaded straight from the NDI
+// buffer. Returns an invalid description for anything it has to be converted from.
+core::pixel_format_desc get_pixel_format_desc(const NDIlib_video_frame_v2_t& video)
+{
+    const bool alpha = video.FourCC == NDIlib_FourCC_type_UYVA;
+    if ((video.FourCC != NDIlib_FourCC_type_UYVY && !alpha) || video.xres % 2 != 0 ||
+        video.line_stride_in_bytes != video.xres * 2) {
+        return core::pixel_format_desc(core::pixel_format::invalid);
+    }
+
+    core::pixel_format_desc desc(alpha ? core::pixel_format::uyva : core::pixel_format::uyvy);
+    desc.planes.emplace_back(video.xres / 2, video.yres, 4);
+    if (alpha) {
+        desc.planes.emplace_back(video.xres, video.yres, 1);
+    }
+    return desc;
+}
+
 struct newtek_ndi_producer : public core::frame_producer
 {
     static std::atomic<int> instances_;
     const int               instance_no_;
     const std::wstring      name_;
     const bool              low_bandwidth_;
+    const bool              auto_bandwidth_;
 
     spl::shared_ptr<core::frame_factory> frame_factory_;
     core::video_format_desc              format_desc_;
     NDIlib_v5*                           ndi_lib_;
-    NDIlib_framesync_instance_t          ndi_framesync_;
-    NDIlib_recv_instance_t               ndi_recv_instance_;
+    std::shared_ptr<ndi_receiver>        receiver_;
     spl::shared_ptr<diagnostics::graph>  graph_;
     timer                                tick_timer_;
     timer                                frame_timer_;
@@ -91,15 +135,23 @@ struct newtek_ndi_producer : public core::frame_producer
     int cadence_counter_;
     int cadence_length_;
 
+    // With auto bandwidth, the proxy stream is received while the layer is shown small.
+    std::atomic<bool> want_low_bandwidth_{false};
+    std::atomic<bool> receiving_low_bandwidth_;
+    int               small_frames_ = 0;
+
   public:
     explicit newtek_ndi_producer(spl::shared_ptr<core::frame_factory> frame_factory,
                                  core::video_format_desc              format_desc,
                                  std::wstring                         name,
-                                 bool                                 low_bandwidth)
+                                 bool                                 low_bandwidth,
+                                 bool                                 auto_bandwidth)
         : format_desc_(format_desc)
         , frame_factory_(frame_factory)
         , name_(name)
         , low_bandwidth_(low_bandwidth)
+        , auto_bandwidth_(auto_bandwidth && !low_bandwidth)
+        , receiving_low_bandwidth_(low_bandwidth)
         , instance_no_(instances_++)
         , executor_(print())
         , cadence_counter_(0)
@@ -111,6 +163,7 @@ struct newtek_ndi_producer : public core::frame_producer
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
         diagnostics::register_graph(graph_);
         executor_.set_capacity(2);
+        executor_.begin_invoke([] { set_thread_affinity(thread_role::producer); });
         cadence_length_ = static_cast<int>(format_desc_.audio_cadence.size());
         initialize();
     }
@@ -118,8 +171,6 @@ struct newtek_ndi_producer : public core::frame_producer
     ~newtek_ndi_producer()
     {
         executor_.stop();
-        ndi_lib_->framesync_destroy(ndi_framesync_);
-        ndi_lib_->recv_destroy(ndi_recv_instance_);
     }
 
     std::wstring print() const override
@@ -153,67 +204,78 @@ struct newtek_ndi_producer : public core::frame_producer
         return !frames_.empty() || last_frame_;
     }
 
+    void render_transform(const core::frame_transform& transform) override
+    {
+        if (!auto_bandwidth_) {
+            return;
+        }
+
+        // The proxy stream is around a third of the full resolution.
+        const auto& scale = transform.image_transform.fill_scale;
+        if (std::max(std::abs(scale[0]), std::abs(scale[1])) > 1.0 / 3.0) {
+            small_frames_       = 0;
+            want_low_bandwidth_ = false;
+        } else if (++small_frames_ >= format_desc_.fps * 2) {
+            // Only after two seconds, so a fill animating through small sizes doesn't reconnect.
+            want_low_bandwidth_ = true;
+        }
+    }
+
     bool prepare_next_frame()
     {
         try {
+            if (want_low_bandwidth_ != receiving_low_bandwidth_) {
+                receiving_low_bandwidth_ = want_low_bandwidth_.load();
+                CASPAR_LOG(info) << print() << L" Reconnecting at "
+                                 << (receiving_low_bandwidth_ ? L"lowest" : L"highest") << L" bandwidth.";
+                // Frames already received keep the previous receiver alive until they are released.
+                initialize();
+            }
+
             frame_timer_.restart();
             NDIlib_video_frame_v2_t video_frame;
             NDIlib_audio_frame_v2_t audio_frame;
-            ndi_lib_->framesync_capture_video(ndi_framesync_, &video_frame, NDIlib_frame_format_type_progressive);
-            ndi_lib_->framesync_capture_audio(ndi_framesync_,
+            auto framesync = receiver_->framesync;
+            ndi_lib_->framesync_capture_video(framesync, &video_frame, NDIlib_frame_format_type_progressive);
+            ndi_lib_->framesync_capture_audio(framesync,
                                               &audio_frame,
                                               format_desc_.audio_sample_rate,
                                               format_desc_.audio_channels,
                                               format_desc_.audio_cadence[++cadence_counter_ %= cadence_length_]);
 
+            // Video handed to the mixer is freed by the last frame holding it.
+            std::shared_ptr<NDIlib_video_frame_v2_t> video;
+            if (video_frame.p_data != nullptr) {
+                video = std::shared_ptr<NDIlib_video_frame_v2_t>(
+                    new NDIlib_video_frame_v2_t(video_frame), [receiver = receiver_](NDIlib_video_frame_v2_t* frame) {
+                        receiver->lib->framesync_free_video(receiver->framesync, frame);
+                        delete frame;
+                    });
+            }
+
             CASPAR_SCOPE_EXIT
             {
-                if (video_frame.p_data != nullptr)
-                    ndi_lib_->framesync_free_video(ndi_framesync_, &video_frame);
                 if (audio_frame.p_data != nullptr)
-                    ndi_lib_->framesync_free_audio(ndi_framesync_, &audio_frame);
+                    ndi_lib_->framesync_free_audio(framesync, &audio_frame);
             };
 
-            if (video_frame.p_data != nullptr) {
-                std::shared_ptr<AVFrame> av_frame(av_frame_alloc(), [](AVFrame* frame) { av_frame_free(&frame); });
-                std::shared_ptr<AVFrame> a_frame(av_frame_alloc(), [](AVFrame* frame) { av_frame_free(&frame); });
-                av_frame->data[0]     = video_frame.p_data;
-                av_frame->linesize[0] = video_frame.line_stride_in_bytes;
-                switch (video_frame.FourCC) {
-                    case NDIlib_FourCC_type_BGRA:
-                        av_frame->format = AV_PIX_FMT_BGRA;
-                        break;
-                    case NDIlib_FourCC_type_BGRX:
-                        av_frame->format = AV_PIX_FMT_BGRA;
-                        break;
-                    case NDIlib_FourCC_type_RGBA:
-                        av_frame->format = AV_PIX_FMT_RGBA;
-                        break;
-                    case NDIlib_FourCC_type_RGBX:
-                        av_frame->format = AV_PIX_FMT_RGBA;
-                        break;
-                    case NDIlib_FourCC_type_UYVY:
-                        av_frame->format = AV_PIX_FMT_UYVY422;
-                        break;
-                    default: // should never happen because library handles the conversion for us
-                        av_frame->format = AV_PIX_FMT_BGRA;
-                        break;
-                }
-                av_frame->width  = video_frame.xres;
-                av_frame->height = video_frame.yres;
-                NDIlib_audio_frame_interleaved_32s_t audio_frame_32s;
-                audio_frame_32s.p_data = new int32_t[audio_frame.no_samples * audio_frame.no_channels];
+            if (video) {
+                auto mframe = create_frame(video);
+
+                // The NDI timestamps are on the sender's clock, the latency through the server is measured from here.
+                mframe.capture_time() = std::chrono::steady_clock::now();
+
+                // Interleaved straight into the frame, NDI was asked for the channel's layout.
                 if (audio_frame.p_data != nullptr) {
+                    auto& audio_data = mframe.audio_data();
+                    audio_data       = std::vector<int32_t>(audio_frame.no_samples * audio_frame.no_channels);
+
+                    NDIlib_audio_frame_interleaved_32s_t audio_frame_32s;
                     audio_frame_32s.reference_level = 0;
+                    audio_frame_32s.p_data          = audio_data.data();
                     ndi_lib_->util_audio_to_interleaved_32s_v2(&audio_frame, &audio_frame_32s);
-                    a_frame->channels    = audio_frame_32s.no_channels;
-                    a_frame->sample_rate = audio_frame_32s.sample_rate;
-                    a_frame->nb_samples  = audio_frame_32s.no_samples;
-                    a_frame->data[0]     = reinterpret_cast<uint8_t*>(audio_frame_32s.p_data);
                 }
-                auto mframe =
-                    ffmpeg::make_frame(this, *(frame_factory_.get()), std::move(av_frame), std::move(a_frame));
-                delete[] audio_frame_32s.p_data;
+
                 auto dframe = core::draw_frame(std::move(mframe));
                 {
                     std::lock_guard<std::mutex> lock(frames_mutex_);
@@ -233,6 +295,46 @@ struct newtek_ndi_producer : public core::frame_producer
         return true;
     }
 
+    core::mutable_frame create_frame(const std::shared_ptr<NDIlib_video_frame_v2_t>& video)
+    {
+        const auto desc = get_pixel_format_desc(*video);
+        if (desc.format != core::pixel_format::invalid) {
+            // The upload reads the planes from the NDI buffer, which the frame keeps alive.
+            core::image_data_t planes;
+            auto               data = video->p_data;
+            for (auto& plane : desc.planes) {
+                planes.emplace_back(data, plane.size, video);
+                data += plane.size;
+            }
+            return frame_factory_->create_frame(this, desc, std::move(planes));
+        }
+
+        // Padded lines, or formats NDI falls back to, are copied by ffmpeg.
+        std::shared_ptr<AVFrame> av_frame(av_frame_alloc(), [](AVFrame* frame) { av_frame_free(&frame); });
+        av_frame->data[0]     = video->p_data;
+        av_frame->linesize[0] = video->line_stride_in_bytes;
+        switch (video->FourCC) {
+            case NDIlib_FourCC_type_BGRA:
+            case NDIlib_FourCC_type_BGRX:
+                av_frame->format = AV_PIX_FMT_BGRA;
+                break;
+            case NDIlib_FourCC_type_RGBA:
+            case NDIlib_FourCC_type_RGBX:
+                av_frame->format = AV_PIX_FMT_RGBA;
+                break;
+            case NDIlib_FourCC_type_UYVY:
+            case NDIlib_FourCC_type_UYVA: // The alpha plane is dropped.
+                av_frame->format = AV_PIX_FMT_UYVY422;
+                break;
+            default:
+                av_frame->format = AV_PIX_FMT_BGRA;
+                break;
+        }
+        av_frame->width  = video->xres;
+        av_frame->height = video->yres;
+        return ffmpeg::make_frame(this, *frame_factory_, std::move(av_frame), nullptr);
+    }
+
     // frame_producer
 
     void initialize()
@@ -241,22 +343,26 @@ struct newtek_ndi_producer : public core::frame_producer
 
         NDIlib_recv_create_v3_t NDI_recv_create_desc;
         NDI_recv_create_desc.allow_video_fields = false;
-        NDI_recv_create_desc.bandwidth = low_bandwidth_ ? NDIlib_recv_bandwidth_lowest : NDIlib_recv_bandwidth_highest;
-        NDI_recv_create_desc.color_format = NDIlib_recv_color_format_UYVY_BGRA;
+        NDI_recv_create_desc.bandwidth =
+            receiving_low_bandwidth_ ? NDIlib_recv_bandwidth_lowest : NDIlib_recv_bandwidth_highest;
+        NDI_recv_create_desc.color_format = NDIlib_recv_color_format_fastest;
         std::string src_name              = u8(name_);
 
+        // The receiver connects by name to a source that shows up later.
         auto found_source = sources.find(src_name);
         if (found_source != sources.end()) {
-            NDI_recv_create_desc.source_to_connect_to = found_source->second;
+            NDI_recv_create_desc.source_to_connect_to.p_ndi_name    = found_source->second.name.c_str();
+            NDI_recv_create_desc.source_to_connect_to.p_url_address =
+                !found_source->second.url.empty() ? found_source->second.url.c_str() : nullptr;
         } else {
             CASPAR_LOG(info) << print() << " Source currently not available.";
             NDI_recv_create_desc.source_to_connect_to.p_ndi_name = src_name.c_str();
         }
         std::string receiver_name = "CasparCG " + u8(env::version()) + " NDI Producer " + std::to_string(instance_no_);
         NDI_recv_create_desc.p_ndi_recv_name = receiver_name.c_str();
-        ndi_recv_instance_                   = ndi_lib_->recv_create_v3(&NDI_recv_create_desc);
-        ndi_framesync_                       = ndi_lib_->framesync_create(ndi_recv_instance_);
-        CASPAR_VERIFY(ndi_recv_instance_);
+        auto recv_instance                   = ndi_lib_->recv_create_v3(&NDI_recv_create_desc);
+        CASPAR_VERIFY(recv_instance);
+        receiver_ = std::make_shared<ndi_receiver>(ndi_lib_, recv_instance);
     }
 
     core::draw_frame last_frame(const core::video_field field) override
@@ -270,8 +376,9 @@ struct newtek_ndi_producer : public core::frame_producer
     core::monitor::state state() const override
     {
         core::monitor::state state;
-        state["ndi/name"]          = u8(name_);
-        state["ndi/low_bandwidth"] = low_bandwidth_;
+        state["ndi/name"]           = u8(name_);
+        state["ndi/low_bandwidth"]  = receiving_low_bandwidth_.load();
+        state["ndi/auto_bandwidth"] = auto_bandwidth_;
         return state;
     }
 
@@ -301,10 +408,11 @@ spl::shared_ptr<core::frame_producer> create_ndi_producer(const core::frame_prod
             return core::frame_producer::empty();
         }
     }
-    const bool low_bandwidth = contains_param(L"LOW_BANDWIDTH", params);
+    const bool low_bandwidth  = contains_param(L"LOW_BANDWIDTH", params);
+    const bool auto_bandwidth = contains_param(L"AUTO_BANDWIDTH", params);
 
     auto producer = spl::make_shared<newtek_ndi_producer>(
-        dependencies.frame_factory, dependencies.format_desc, name_or_url, low_bandwidth);
+        dependencies.frame_factory, dependencies.format_desc, name_or_url, low_bandwidth, auto_bandwidth);
     return core::create_destroy_proxy(std::move(producer));
 }
 }} // namespace caspar::newtek
@@ -23,8 +23,10 @@
 
 #include "ndi.h"
 
+#include <atomic>
 #include <memory>
 #include <mutex>
+#include <thread>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -35,6 +37,7 @@
 
 #include <common/env.h>
 #include <common/except.h>
+#include <common/os/thread.h>
 
 #include <boost/filesystem.hpp>
 
@@ -47,8 +50,87 @@ const std::wstring& dll_name()
     return name;
 }
 
-static std::mutex                              find_instance_mutex;
-static std::shared_ptr<NDIlib_find_instance_t> find_instance;
+// Keeps the sources on the network up to date from a thread of its own, so that looking one up never waits for
+// discovery.
+class finder
+{
+    NDIlib_v5*             ndi_lib_;
+    NDIlib_find_instance_t instance_;
+
+    mutable std::mutex            mutex_;
+    std::map<std::string, source> sources_;
+
+    std::atomic<bool> running_{true};
+    std::thread       thread_;
+
+  public:
+    explicit finder(NDIlib_v5* ndi_lib)
+        : ndi_lib_(ndi_lib)
+        , instance_(ndi_lib->find_create_v2(nullptr))
+    {
+        if (!instance_) {
+            CASPAR_THROW_EXCEPTION(not_supported() << msg_info("Unable to create NDI finder."));
+        }
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~finder()
+    {
+        running_ = false;
+        thread_.join();
+        ndi_lib_->find_destroy(instance_);
+    }
+
+    std::map<std::string, source> sources() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return sources_;
+    }
+
+  private:
+    void run()
+    {
+        set_thread_name(L"[newtek::ndi::finder]");
+
+        while (running_) {
+            // Returns within the timeout so that shutting down doesn't wait for the network.
+            if (!ndi_lib_->find_wait_for_sources(instance_, 1000)) {
+                continue;
+            }
+
+            uint32_t                      no_sources = 0;
+            const NDIlib_source_t*        found = ndi_lib_->find_get_current_sources(instance_, &no_sources);
+            std::map<std::string, source> sources;
+            for (uint32_t i = 0; i < no_sources; i++) {
+                if (!found[i].p_ndi_name) {
+                    continue;
+                }
+                sources.emplace(std::string(found[i].p_ndi_name),
+                                source{found[i].p_ndi_name, found[i].p_url_address ? found[i].p_url_address : ""});
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& s : sources) {
+                if (sources_.find(s.first) == sources_.end()) {
+                    CASPAR_LOG(debug) << L"[ndi] Found source " << u16(s.first) << L" at " << u16(s.second.url);
+                }
+            }
+            for (auto& s : sources_) {
+                if (sources.find(s.first) == sources.end()) {
+                    CASPAR_LOG(debug) << L"[ndi] Lost source " << u16(s.first);
+                }
+            }
+            sources_ = std::move(sources);
+        }
+    }
+};
+
+static std::unique_ptr<finder>& find_instance()
+{
+    // Declared after the library is loaded, it goes before the library does.
+    static std::unique_ptr<finder> instance;
+    return instance;
+}
 
 NDIlib_v5* load_library()
 {
@@ -108,22 +190,15 @@ NDIlib_v5* load_library()
         not_initialized();
     }
 
-    find_instance.reset(new NDIlib_find_instance_t(ndi_lib->NDIlib_find_create_v2(nullptr)),
-                        [](NDIlib_find_instance_t* p) { ndi_lib->NDIlib_find_destroy(*p); });
+    find_instance() = std::make_unique<finder>(ndi_lib);
     return ndi_lib;
 }
 
-std::map<std::string, NDIlib_source_t> get_current_sources()
+std::map<std::string, source> get_current_sources()
 {
-    auto                        sources_map = std::map<std::string, NDIlib_source_t>();
-    uint32_t                    no_sources;
-    std::lock_guard<std::mutex> guard(find_instance_mutex);
-    const NDIlib_source_t*      sources =
-        load_library()->NDIlib_find_get_current_sources(*(find_instance.get()), &no_sources);
-    for (uint32_t i = 0; i < no_sources; i++) {
-        sources_map.emplace(std::string(sources[i].p_ndi_name), sources[i]);
-    }
-    return sources_map;
+    load_library();
+    auto& instance = find_instance();
+    return instance ? instance->sources() : std::map<std::string, source>();
 }
 
 void not_installed()
@@ -146,10 +221,9 @@ std::wstring list_command(protocol::amcp::command_context& ctx)
     }
     std::wstringstream replyString;
     replyString << L"200 NDI LIST OK\r\n";
-    uint32_t               no_sources;
-    const NDIlib_source_t* sources = ndi_lib->NDIlib_find_get_current_sources(*(find_instance.get()), &no_sources);
-    for (uint32_t i = 0; i < no_sources; i++) {
-        replyString << i + 1 << L" \"" << sources[i].p_ndi_name << L"\" " << sources[i].p_url_address << L"\r\n";
+    auto n = 0;
+    for (auto& s : get_current_sources()) {
+        replyString << ++n << L" \"" << u16(s.second.name) << L"\" " << u16(s.second.url) << L"\r\n";
     }
     replyString << L"\r\n";
     return replyString.str();
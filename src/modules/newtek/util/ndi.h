@@ -22,15 +22,25 @@
 
 #include "../interop/Processing.NDI.Lib.h"
 #include "protocol/amcp/amcp_command_context.h"
+#include <map>
 #include <string>
 
 namespace caspar { namespace newtek { namespace ndi {
 
-const std::wstring&                    dll_name();
-NDIlib_v5*                             load_library();
-std::map<std::string, NDIlib_source_t> get_current_sources();
-void                                   not_initialized();
-void                                   not_installed();
+struct source
+{
+    std::string name;
+    std::string url;
+};
+
+const std::wstring& dll_name();
+NDIlib_v5*          load_library();
+void                not_initialized();
+void                not_installed();
+
+// The sources the finder, started along with the library, last saw by name. Returns at once, being empty until the
+// first ones are found.
+std::map<std::string, source> get_current_sources();
 
 std::wstring list_command(protocol::amcp::command_context& ctx);
 
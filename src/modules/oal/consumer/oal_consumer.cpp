@@ -24,9 +24,8 @@
 #include <common/diagnostics/graph.h>
 #include <common/env.h>
 #include <common/except.h>
-#include <common/executor.h>
-#include <common/future.h>
 #include <common/log.h>
+#include <common/os/thread.h>
 #include <common/param.h>
 #include <common/timer.h>
 #include <common/utf.h>
@@ -39,24 +38,11 @@
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/property_tree/ptree.hpp>
 
-#include <tbb/concurrent_queue.h>
-
-#if defined(_MSC_VER)
-#pragma warning(push)
-#pragma warning(disable : 4244)
-#endif
-extern "C" {
-#define __STDC_CONSTANT_MACROS
-#define __STDC_LIMIT_MACROS
-#include <libavutil/channel_layout.h>
-#include <libavutil/samplefmt.h>
-#include <libswresample/swresample.h>
-}
-#if defined(_MSC_VER)
-#pragma warning(pop)
-#endif
-
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <thread>
 #include <vector>
 
 #include <AL/al.h>
@@ -182,208 +168,283 @@ void init_device()
     });
 }
 
+// Stereo samples handed from the channel to the device thread. One thread writes and one reads, neither takes a
+// lock or waits for the other.
+class sample_ring
+{
+    std::vector<std::int16_t> samples_;
+    const std::size_t         capacity_;
+    std::atomic<std::size_t>  write_{0};
+    std::atomic<std::size_t>  read_{0};
+
+  public:
+    explicit sample_ring(std::size_t capacity)
+        : samples_(capacity * 2)
+        , capacity_(capacity)
+    {
+    }
+
+    std::size_t size() const { return write_.load(std::memory_order_acquire) - read_.load(std::memory_order_acquire); }
+
+    // Writes the first two channels of interleaved samples, or the one of a mono channel twice. Returns the number
+    // of samples that didn't fit.
+    std::size_t write(const std::int32_t* source, std::size_t count, int channels)
+    {
+        const auto write = write_.load(std::memory_order_relaxed);
+        const auto space = capacity_ - (write - read_.load(std::memory_order_acquire));
+        const auto n     = std::min(count, space);
+
+        for (std::size_t i = 0; i < n; ++i) {
+            const auto* sample  = source + i * channels;
+            const auto  index   = (write + i) % capacity_ * 2;
+            samples_[index]     = static_cast<std::int16_t>(sample[0] >> 16);
+            samples_[index + 1] = static_cast<std::int16_t>(sample[channels > 1 ? 1 : 0] >> 16);
+        }
+
+        write_.store(write + n, std::memory_order_release);
+        return count - n;
+    }
+
+    // Sample n after the read position, channel c. Only valid for n < size().
+    float at(std::size_t n, int c) const
+    {
+        return samples_[(read_.load(std::memory_order_relaxed) + n) % capacity_ * 2 + c];
+    }
+
+    void consume(std::size_t count)
+    {
+        read_.store(read_.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+};
+
+// Reads the ring at a rate nudged by how far its fill is from the target, so the device drains it exactly as fast
+// as the channel fills it however far their clocks drift apart. Linear interpolation is plenty for monitoring.
+class drift_resampler
+{
+    sample_ring&      ring_;
+    const std::size_t target_;
+    double            position_ = 0.0;
+    double            fill_     = 0.0;
+    bool              primed_   = false;
+
+  public:
+    drift_resampler(sample_ring& ring, std::size_t target)
+        : ring_(ring)
+        , target_(target)
+        , fill_(static_cast<double>(target))
+    {
+    }
+
+    double fill() const { return fill_ / static_cast<double>(target_); }
+
+    // Returns false if the ring ran dry, the rest of dest is silence then.
+    bool operator()(std::int16_t* dest, std::size_t count)
+    {
+        auto available = ring_.size();
+
+        if (!primed_) {
+            if (available < target_) {
+                std::fill_n(dest, count * 2, std::int16_t{0});
+                return true;
+            }
+            primed_ = true;
+        }
+
+        // Way behind after a stall of the device, skip to the target instead of slowly catching up.
+        if (available > target_ * 3) {
+            ring_.consume(available - target_);
+            available = target_;
+            fill_     = static_cast<double>(target_);
+        }
+
+        fill_ += 0.01 * (static_cast<double>(available) - fill_);
+        const auto ratio = 1.0 + std::clamp((fill_ - target_) / target_ * 0.01, -0.005, 0.005);
+
+        for (std::size_t n = 0; n < count; ++n) {
+            const auto index = static_cast<std::size_t>(position_);
+            if (index + 1 >= available) {
+                std::fill_n(dest + n * 2, (count - n) * 2, std::int16_t{0});
+                ring_.consume(std::min(index, available));
+                position_ = 0.0;
+                primed_   = false;
+                return false;
+            }
+
+            const auto frac = static_cast<float>(position_ - static_cast<double>(index));
+            for (int c = 0; c < 2; ++c) {
+                const auto a    = ring_.at(index, c);
+                const auto b    = ring_.at(index + 1, c);
+                dest[n * 2 + c] = static_cast<std::int16_t>(a + (b - a) * frac);
+            }
+            position_ += ratio;
+        }
+
+        const auto consumed = static_cast<std::size_t>(position_);
+        ring_.consume(consumed);
+        position_ -= static_cast<double>(consumed);
+        return true;
+    }
+};
+
 struct oal_consumer : public core::frame_consumer
 {
     spl::shared_ptr<diagnostics::graph> graph_;
     caspar::timer                       perf_timer_;
     int                                 channel_index_ = -1;
+    const int                           latency_;
 
     core::video_format_desc format_desc_;
 
-    ALuint              source_ = 0;
-    std::vector<ALuint> buffers_;
-    bool                started_  = false;
-    int                 duration_ = 1920;
-
-    std::shared_ptr<SwrContext> swr_;
+    std::unique_ptr<sample_ring> ring_;
 
-    executor executor_{L"oal_consumer"};
+    std::atomic<bool> is_running_{false};
+    std::thread       thread_;
 
   public:
-    explicit oal_consumer()
+    explicit oal_consumer(int latency)
+        : latency_(latency)
     {
         init_device();
 
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
         graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_color("buffer", diagnostics::color(1.0f, 1.0f, 0.0f));
         diagnostics::register_graph(graph_);
     }
 
-    ~oal_consumer() override
-    {
-        executor_.invoke([=] {
-            if (source_ != 0u) {
-                alSourceStop(source_);
-                alDeleteSources(1, &source_);
-            }
-
-            for (auto& buffer : buffers_) {
-                if (buffer != 0u)
-                    alDeleteBuffers(1, &buffer);
-            }
-        });
-    }
+    ~oal_consumer() override { stop(); }
 
     // frame consumer
 
     void initialize(const core::video_format_desc& format_desc, int channel_index) override
     {
+        stop();
+
         format_desc_   = format_desc;
         channel_index_ = channel_index;
         graph_->set_text(print());
 
-        executor_.begin_invoke([=] {
-            duration_ = format_desc_.audio_cadence[0];
-            buffers_.resize(8);
-            alGenBuffers(static_cast<ALsizei>(buffers_.size()), buffers_.data());
-            alGenSources(1, &source_);
-
-            alSourcei(source_, AL_LOOPING, AL_FALSE);
+        // At least one and a half frames of audio, so a late tick of the channel doesn't run the ring dry.
+        const auto rate   = format_desc_.audio_sample_rate;
+        const auto frame  = static_cast<std::size_t>(format_desc_.audio_cadence[0]);
+        const auto target = std::max(static_cast<std::size_t>(rate) * latency_ / 1000, frame * 3 / 2);
+
+        ring_       = std::make_unique<sample_ring>(target * 4 + frame);
+        is_running_ = true;
+        thread_     = std::thread([this, target] {
+            set_thread_name(L"oal_consumer");
+            set_thread_affinity(thread_role::consumer);
+            try {
+                run(target);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
         });
     }
 
-    std::future<bool> send(core::video_field field, core::const_frame frame) override
+    core::send_result send(core::video_field field, core::const_frame frame) override
     {
-        executor_.begin_invoke([=] {
-            auto dst            = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* ptr) { av_frame_free(&ptr); });
-            dst->format         = AV_SAMPLE_FMT_S16;
-            dst->sample_rate    = format_desc_.audio_sample_rate;
-            dst->channels       = 2;
-            dst->channel_layout = av_get_default_channel_layout(dst->channels);
-            dst->nb_samples     = duration_;
-            if (av_frame_get_buffer(dst.get(), 32) < 0) {
-                // TODO FF error
-                CASPAR_THROW_EXCEPTION(invalid_argument());
-            }
-            std::memset(dst->extended_data[0], 0, dst->linesize[0]);
-
-            if (!started_) {
-                for (ALuint& buffer : buffers_) {
-                    alBufferData(buffer,
-                                 AL_FORMAT_STEREO16,
-                                 dst->extended_data[0],
-                                 static_cast<ALsizei>(dst->linesize[0]),
-                                 dst->sample_rate);
-                    alSourceQueueBuffers(source_, 1, &buffer);
-                }
+        const auto& audio    = frame.audio_data();
+        const auto  channels = std::max(format_desc_.audio_channels, 1);
 
-                alSourcePlay(source_);
-                started_ = true;
+        if (ring_ && ring_->write(audio.data(), audio.size() / channels, channels) > 0) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
 
-                return;
-            }
+        graph_->set_value("tick-time", perf_timer_.elapsed() * format_desc_.fps * 0.5);
+        perf_timer_.restart();
 
-            auto src            = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* ptr) { av_frame_free(&ptr); });
-            src->format         = AV_SAMPLE_FMT_S32;
-            src->sample_rate    = format_desc_.audio_sample_rate;
-            src->channels       = format_desc_.audio_channels;
-            src->channel_layout = av_get_default_channel_layout(src->channels);
-            src->nb_samples     = static_cast<int>(frame.audio_data().size() / src->channels);
-            src->extended_data[0] = const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(frame.audio_data().data()));
-            src->linesize[0]      = static_cast<int>(frame.audio_data().size() * sizeof(int32_t));
-
-            if (!swr_) {
-                swr_.reset(swr_alloc(), [](SwrContext* ptr) { swr_free(&ptr); });
-                if (!swr_) {
-                    CASPAR_THROW_EXCEPTION(bad_alloc());
-                }
-                if (swr_config_frame(swr_.get(), dst.get(), src.get()) < 0) {
-                    // TODO FF error
-                    CASPAR_THROW_EXCEPTION(invalid_argument());
-                }
-                if (swr_init(swr_.get()) < 0) {
-                    // TODO FF error
-                    CASPAR_THROW_EXCEPTION(invalid_argument());
-                }
-            }
+        return true;
+    }
 
-            if (swr_convert_frame(swr_.get(), nullptr, src.get()) < 0) {
-                // TODO FF error
-                CASPAR_THROW_EXCEPTION(invalid_argument());
-            }
+    std::wstring print() const override
+    {
+        return L"oal[" + std::to_wstring(channel_index_) + L"|" + format_desc_.name + L"]";
+    }
 
-            ALint processed = 0;
-            alGetSourceiv(source_, AL_BUFFERS_PROCESSED, &processed);
+    std::wstring name() const override { return L"system-audio"; }
 
-            auto in_duration  = swr_get_delay(swr_.get(), 48000);
-            auto out_duration = static_cast<int64_t>(processed) * duration_;
-            auto delta        = static_cast<int>(out_duration - in_duration);
+    bool has_synchronization_clock() const override { return false; }
 
-            ALenum state;
-            alGetSourcei(source_, AL_SOURCE_STATE, &state);
-            if (state != AL_PLAYING) {
-                while (delta > duration_) {
-                    ALuint buffer = 0;
-                    alSourceUnqueueBuffers(source_, 1, &buffer);
-                    if (buffer == 0u) {
-                        break;
-                    }
-                    alBufferData(buffer,
-                                 AL_FORMAT_STEREO16,
-                                 dst->extended_data[0],
-                                 static_cast<ALsizei>(dst->linesize[0]),
-                                 dst->sample_rate);
-                    alSourceQueueBuffers(source_, 1, &buffer);
-                    delta -= duration_;
-                }
+    int index() const override { return 500; }
 
-                alSourcePlay(source_);
-            }
+    core::monitor::state state() const override
+    {
+        static const core::monitor::state empty;
+        return empty;
+    }
 
-            // TODO (fix)
-            // if (std::abs(delta) > duration_ && swr_set_compensation(swr_.get(), delta, 2000) < 0) {
-            //    // TODO FF error
-            //    CASPAR_THROW_EXCEPTION(invalid_argument());
-            //}
+  private:
+    void stop()
+    {
+        is_running_ = false;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
 
-            for (auto n = 0; n < processed; ++n) {
-                if (swr_get_delay(swr_.get(), 48000) < dst->nb_samples) {
-                    break;
-                }
+    // Keeps a few short buffers queued on the device, refilled from the ring as soon as it has played one.
+    void run(std::size_t target)
+    {
+        const auto rate   = format_desc_.audio_sample_rate;
+        const auto period = static_cast<std::size_t>(rate / 200);
+
+        drift_resampler           resample(*ring_, target);
+        std::vector<std::int16_t> samples(period * 2, 0);
+        std::vector<ALuint>       buffers(4);
+        ALuint                    source = 0;
+
+        alGenBuffers(static_cast<ALsizei>(buffers.size()), buffers.data());
+        alGenSources(1, &source);
+        alSourcei(source, AL_LOOPING, AL_FALSE);
+
+        for (auto& buffer : buffers) {
+            alBufferData(buffer,
+                         AL_FORMAT_STEREO16,
+                         samples.data(),
+                         static_cast<ALsizei>(samples.size() * sizeof(std::int16_t)),
+                         rate);
+            alSourceQueueBuffers(source, 1, &buffer);
+        }
+        alSourcePlay(source);
 
+        while (is_running_) {
+            ALint processed = 0;
+            alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+
+            for (auto n = 0; n < processed; ++n) {
                 ALuint buffer = 0;
-                alSourceUnqueueBuffers(source_, 1, &buffer);
+                alSourceUnqueueBuffers(source, 1, &buffer);
                 if (buffer == 0u) {
-                    // TODO error
                     break;
                 }
 
-                if (swr_convert_frame(swr_.get(), dst.get(), nullptr) != 0) {
-                    // TODO FF error
-                    CASPAR_THROW_EXCEPTION(invalid_argument());
+                if (!resample(samples.data(), period)) {
+                    graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
                 }
 
                 alBufferData(buffer,
                              AL_FORMAT_STEREO16,
-                             dst->extended_data[0],
-                             static_cast<ALsizei>(dst->linesize[0]),
-                             dst->sample_rate);
-                alSourceQueueBuffers(source_, 1, &buffer);
+                             samples.data(),
+                             static_cast<ALsizei>(samples.size() * sizeof(std::int16_t)),
+                             rate);
+                alSourceQueueBuffers(source, 1, &buffer);
             }
+            graph_->set_value("buffer", resample.fill() * 0.5);
 
-            graph_->set_value("tick-time", perf_timer_.elapsed() * format_desc_.fps * 0.5);
-            perf_timer_.restart();
-        });
-
-        return make_ready_future(true);
-    }
-
-    std::wstring print() const override
-    {
-        return L"oal[" + std::to_wstring(channel_index_) + L"|" + format_desc_.name + L"]";
-    }
-
-    std::wstring name() const override { return L"system-audio"; }
-
-    bool has_synchronization_clock() const override { return false; }
+            ALint state = 0;
+            alGetSourcei(source, AL_SOURCE_STATE, &state);
+            if (state != AL_PLAYING) {
+                alSourcePlay(source);
+            }
 
-    int index() const override { return 500; }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
 
-    core::monitor::state state() const override
-    {
-        static const core::monitor::state empty;
-        return empty;
+        alSourceStop(source);
+        alDeleteSources(1, &source);
+        alDeleteBuffers(static_cast<ALsizei>(buffers.size()), buffers.data());
     }
 };
 
@@ -394,7 +455,7 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
     if (params.empty() || !boost::iequals(params.at(0), L"AUDIO"))
         return core::frame_consumer::empty();
 
-    return spl::make_shared<oal_consumer>();
+    return spl::make_shared<oal_consumer>(get_param(L"LATENCY", params, 40));
 }
 
 spl::shared_ptr<core::frame_consumer>
@@ -402,7 +463,7 @@ create_preconfigured_consumer(const boost::property_tree::wptree&
                               const core::video_format_repository&                     format_repository,
                               const std::vector<spl::shared_ptr<core::video_channel>>& channels)
 {
-    return spl::make_shared<oal_consumer>();
+    return spl::make_shared<oal_consumer>(ptree.get(L"latency", 40));
 }
 
 }} // namespace caspar::oal
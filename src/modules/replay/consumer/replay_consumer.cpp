@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay_consumer.h"
+
+#include "../util/replay_buffer.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/executor.h>
+#include <common/param.h>
+#include <common/timer.h>
+
+#include <core/consumer/frame_consumer.h>
+#include <core/frame/frame.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+
+namespace caspar { namespace replay {
+
+// Records every frame of the channel, every field when it is interlaced, into the replay buffer named after it. The
+// ring holds as many frames as fit in its size.
+struct replay_consumer : public core::frame_consumer
+{
+    const std::wstring name_;
+    const int64_t      size_;
+
+    core::video_format_desc        format_desc_;
+    int                            channel_index_ = -1;
+    std::shared_ptr<replay_buffer> buffer_;
+
+    spl::shared_ptr<diagnostics::graph> graph_;
+    caspar::timer                       tick_timer_;
+    executor                            executor_;
+
+  public:
+    replay_consumer(std::wstring name, int64_t size)
+        : name_(std::move(name))
+        , size_(size)
+        , executor_(L"replay_consumer")
+    {
+        graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
+        graph_->set_color("copy-time", diagnostics::color(0.5f, 1.0f, 0.2f));
+        diagnostics::register_graph(graph_);
+    }
+
+    // frame_consumer
+
+    void initialize(const core::video_format_desc& format_desc, int channel_index) override
+    {
+        format_desc_   = format_desc;
+        channel_index_ = channel_index;
+
+        executor_.invoke([&] {
+            buffer_ = replay_buffer::open(!name_.empty() ? name_ : std::to_wstring(channel_index));
+            buffer_->reset(format_desc, size_ / std::max<int64_t>(format_desc.size, 1));
+        });
+
+        graph_->set_text(print());
+        CASPAR_LOG(info) << print() << L" Recording the last "
+                         << static_cast<double>(size_ / std::max<int64_t>(format_desc.size, 1)) / format_desc.fps
+                         << L" seconds.";
+    }
+
+    core::send_result send(core::video_field field, core::const_frame frame) override
+    {
+        graph_->set_value("tick-time", tick_timer_.elapsed() * format_desc_.fps * 0.5);
+        tick_timer_.restart();
+
+        return executor_.begin_invoke([=] {
+            caspar::timer copy_timer;
+            buffer_->push(frame);
+            graph_->set_value("copy-time", copy_timer.elapsed() * format_desc_.fps * 0.5);
+            return true;
+        });
+    }
+
+    std::wstring print() const override
+    {
+        return L"replay_consumer[" + std::to_wstring(channel_index_) + L"|" + (buffer_ ? buffer_->name() : name_) +
+               L"]";
+    }
+
+    std::wstring name() const override { return L"replay"; }
+
+    int index() const override { return 1000; }
+
+    // The recorded images, shared with the replay producers playing them.
+    core::memory_usage memory() const override
+    {
+        core::memory_usage usage;
+        if (buffer_) {
+            usage.host = (buffer_->end() - buffer_->begin()) * static_cast<int64_t>(buffer_->format_desc().size);
+        }
+        return usage;
+    }
+
+    core::monitor::state state() const override
+    {
+        core::monitor::state state;
+        if (buffer_) {
+            state["replay/name"]   = buffer_->name();
+            state["replay/frames"] = {buffer_->begin(), buffer_->end()};
+        }
+        return state;
+    }
+};
+
+spl::shared_ptr<core::frame_consumer>
+create_consumer(const std::vector<std::wstring>&                         params,
+                const core::video_format_repository&                     format_repository,
+                const std::vector<spl::shared_ptr<core::video_channel>>& channels)
+{
+    if (params.empty() || !boost::iequals(params.at(0), L"REPLAY")) {
+        return core::frame_consumer::empty();
+    }
+
+    auto name = get_param(L"NAME", params, L"");
+    auto size = get_param(L"SIZE", params, 1024);
+    return spl::make_shared<replay_consumer>(name, size * 1024LL * 1024LL);
+}
+
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_consumer(const boost::property_tree::wptree&                      ptree,
+                              const core::video_format_repository&                     format_repository,
+                              const std::vector<spl::shared_ptr<core::video_channel>>& channels)
+{
+    auto name = ptree.get(L"name", L"");
+    auto size = ptree.get(L"size", 1024);
+    return spl::make_shared<replay_consumer>(name, size * 1024LL * 1024LL);
+}
+
+}} // namespace caspar::replay
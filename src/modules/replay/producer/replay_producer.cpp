@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay_producer.h"
+
+#include "../util/replay_buffer.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/except.h>
+#include <common/param.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/regex.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+namespace caspar { namespace replay {
+
+// Plays a range of a replay buffer at any speed, reverse included, while it is still being recorded. Positions are
+// the frame numbers of the recording, so that commands are frame accurate. Without an out point playback follows the
+// recording and holds at its latest frame. Audio only plays at speed 1 on a channel of the recorded format.
+class replay_producer : public core::frame_producer
+{
+    spl::shared_ptr<diagnostics::graph> graph_;
+
+    const std::shared_ptr<replay_buffer> buffer_;
+    const bool                           audio_;
+
+    mutable std::mutex mutex_;
+    int64_t            in_;
+    int64_t            out_;
+    double             position_;
+    double             speed_;
+    bool               loop_;
+    core::draw_frame   frame_;
+
+  public:
+    replay_producer(std::shared_ptr<replay_buffer>  buffer,
+                    const core::video_format_desc& format_desc,
+                    int64_t                        in,
+                    int64_t                        out,
+                    int64_t                        seek,
+                    double                         speed,
+                    bool                           loop)
+        : buffer_(std::move(buffer))
+        , audio_(buffer_->format_desc().fps == format_desc.fps &&
+                 buffer_->format_desc().audio_channels == format_desc.audio_channels)
+        , in_(in)
+        , out_(out)
+        , position_(static_cast<double>(seek))
+        , speed_(speed)
+        , loop_(loop)
+    {
+        graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_text(print());
+        diagnostics::register_graph(graph_);
+    }
+
+    // frame_producer
+
+    core::draw_frame last_frame(const core::video_field field) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return core::draw_frame::still(frame_);
+    }
+
+    core::draw_frame receive_impl(const core::video_field field, int nb_samples) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const auto begin = std::max(in_, buffer_->begin());
+        const auto end   = std::min(out_, buffer_->end());
+        if (begin >= end) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+            return core::draw_frame::still(frame_);
+        }
+
+        // Loops need an out point, playback without one stays at the latest frame recorded.
+        if (position_ < static_cast<double>(begin) || position_ >= static_cast<double>(end)) {
+            if (loop_ && out_ != INT64_MAX) {
+                auto offset = std::fmod(position_ - static_cast<double>(begin), static_cast<double>(end - begin));
+                position_   = static_cast<double>(begin) + (offset < 0.0 ? offset + (end - begin) : offset);
+            } else {
+                position_ = std::clamp(position_, static_cast<double>(begin), static_cast<double>(end - 1));
+            }
+        }
+
+        auto frame = buffer_->get(static_cast<int64_t>(position_));
+        position_ += speed_;
+        if (!frame) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+            return core::draw_frame::still(frame_);
+        }
+
+        // The image and the textures uploaded for it are shared with every other time the frame is played.
+        if (!audio_ || speed_ != 1.0) {
+            frame = frame.with_field(frame.pixel_format_desc().field, {});
+        }
+        frame_ = core::draw_frame(std::move(frame));
+        return frame_;
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::wstring result;
+
+        const auto   cmd   = params.at(0);
+        std::wstring value = params.size() > 1 ? params.at(1) : L"";
+
+        if (boost::iequals(cmd, L"speed")) {
+            if (!value.empty()) {
+                speed_ = boost::lexical_cast<double>(value);
+            }
+            result = std::to_wstring(speed_);
+        } else if (boost::iequals(cmd, L"loop")) {
+            if (!value.empty()) {
+                loop_ = boost::lexical_cast<bool>(value);
+            }
+            result = std::to_wstring(loop_);
+        } else if (boost::iequals(cmd, L"in") || boost::iequals(cmd, L"start")) {
+            if (!value.empty()) {
+                in_ = boost::lexical_cast<int64_t>(value);
+            }
+            result = std::to_wstring(in_);
+        } else if (boost::iequals(cmd, L"out")) {
+            if (!value.empty()) {
+                out_ = boost::iequals(value, L"live") ? INT64_MAX : boost::lexical_cast<int64_t>(value);
+            }
+            result = out_ != INT64_MAX ? std::to_wstring(out_) : L"live";
+        } else if (boost::iequals(cmd, L"length")) {
+            if (!value.empty()) {
+                out_ = in_ + boost::lexical_cast<int64_t>(value);
+            }
+            result = out_ != INT64_MAX ? std::to_wstring(out_ - in_) : L"live";
+        } else if (boost::iequals(cmd, L"seek") && !value.empty()) {
+            int64_t seek;
+            if (boost::iequals(value, L"rel")) {
+                seek = static_cast<int64_t>(position_);
+            } else if (boost::iequals(value, L"in")) {
+                seek = in_;
+            } else if (boost::iequals(value, L"out")) {
+                seek = std::min(out_, buffer_->end()) - 1;
+            } else if (boost::iequals(value, L"live")) {
+                seek = buffer_->end() - 1;
+            } else {
+                seek = boost::lexical_cast<int64_t>(value);
+            }
+
+            if (params.size() > 2) {
+                seek += boost::lexical_cast<int64_t>(params.at(2));
+            }
+
+            position_ = static_cast<double>(seek);
+            result    = std::to_wstring(seek);
+        } else {
+            CASPAR_THROW_EXCEPTION(invalid_argument());
+        }
+
+        std::promise<std::wstring> promise;
+        promise.set_value(result);
+        return promise.get_future();
+    }
+
+    uint32_t frame_number() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return static_cast<uint32_t>(std::max<int64_t>(static_cast<int64_t>(position_) - in_, 0));
+    }
+
+    uint32_t nb_frames() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return out_ != INT64_MAX && !loop_ ? static_cast<uint32_t>(std::max<int64_t>(out_ - in_, 0))
+                                           : std::numeric_limits<uint32_t>::max();
+    }
+
+    bool is_ready() override { return buffer_->end() > buffer_->begin(); }
+
+    std::wstring print() const override { return L"replay[" + buffer_->name() + L"]"; }
+
+    std::wstring name() const override { return L"replay"; }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        core::monitor::state state;
+        state["replay/name"]   = buffer_->name();
+        state["replay/frame"]  = static_cast<int64_t>(position_);
+        state["replay/frames"] = {buffer_->begin(), buffer_->end()};
+        state["replay/in"]     = in_;
+        if (out_ != INT64_MAX) {
+            state["replay/out"] = out_;
+        }
+        state["replay/speed"] = speed_;
+        state["loop"]         = loop_;
+        return state;
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
+                                                      const std::vector<std::wstring>&         params)
+{
+    static boost::wregex expr(L"replay://(?<NAME>.+)", boost::regex::icase);
+    boost::wsmatch       what;
+
+    if (params.empty() || !boost::regex_match(params.at(0), what, expr)) {
+        return core::frame_producer::empty();
+    }
+
+    auto name   = what["NAME"].str();
+    auto buffer = replay_buffer::find(name);
+    if (!buffer) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Nothing is recorded as " + name));
+    }
+
+    auto in     = get_param(L"IN", params, buffer->begin());
+    auto length = get_param(L"LENGTH", params, static_cast<int64_t>(-1));
+    auto out    = length >= 0 ? in + length : INT64_MAX;
+    auto seek   = get_param(L"SEEK", params, in);
+    auto speed  = get_param(L"SPEED", params, 1.0);
+    auto loop   = contains_param(L"LOOP", params);
+
+    return spl::make_shared<replay_producer>(buffer, dependencies.format_desc, in, out, seek, speed, loop);
+}
+
+}} // namespace caspar::replay
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay_buffer.h"
+
+#include <common/array.h>
+
+#include <core/frame/pixel_format.h>
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace caspar { namespace replay {
+
+struct replay_buffer::impl
+{
+    const std::wstring name_;
+
+    mutable std::mutex            mutex_;
+    core::video_format_desc       format_desc_;
+    int64_t                       capacity_ = 0;
+    std::deque<core::const_frame> frames_;
+    int64_t                       end_ = 0;
+
+    explicit impl(std::wstring name)
+        : name_(std::move(name))
+    {
+    }
+
+    void reset(const core::video_format_desc& format_desc, int64_t capacity)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        format_desc_ = format_desc;
+        capacity_    = std::max<int64_t>(capacity, 1);
+        frames_.clear();
+        end_ = 0;
+    }
+
+    void push(const core::const_frame& frame)
+    {
+        core::const_image_data_t image_data;
+        for (std::size_t n = 0; n < frame.pixel_format_desc().planes.size(); ++n) {
+            const auto& plane = frame.image_data(n);
+
+            array<std::uint8_t> image(plane.size());
+            std::memcpy(image.data(), plane.data(), plane.size());
+            image_data.emplace_back(std::move(image));
+        }
+        core::const_frame recorded(std::move(image_data), frame.audio_data(), frame.pixel_format_desc());
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        frames_.push_back(std::move(recorded));
+        end_ += 1;
+        while (static_cast<int64_t>(frames_.size()) > capacity_) {
+            frames_.pop_front();
+        }
+    }
+
+    core::const_frame get(int64_t n) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto begin = end_ - static_cast<int64_t>(frames_.size());
+        if (n < begin || n >= end_) {
+            return core::const_frame{};
+        }
+        return frames_[n - begin];
+    }
+
+    int64_t begin() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return end_ - static_cast<int64_t>(frames_.size());
+    }
+
+    int64_t end() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return end_;
+    }
+
+    core::video_format_desc format_desc() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return format_desc_;
+    }
+};
+
+namespace {
+
+std::mutex& registry_mutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::map<std::wstring, std::weak_ptr<replay_buffer>>& registry()
+{
+    static std::map<std::wstring, std::weak_ptr<replay_buffer>> buffers;
+    return buffers;
+}
+
+} // namespace
+
+std::shared_ptr<replay_buffer> replay_buffer::open(const std::wstring& name)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex());
+
+    auto& buffers = registry();
+    for (auto it = buffers.begin(); it != buffers.end();) {
+        it = it->second.expired() ? buffers.erase(it) : std::next(it);
+    }
+
+    auto buffer = buffers[name].lock();
+    if (!buffer) {
+        buffer        = std::make_shared<replay_buffer>(name);
+        buffers[name] = buffer;
+    }
+    return buffer;
+}
+
+std::shared_ptr<replay_buffer> replay_buffer::find(const std::wstring& name)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex());
+
+    auto it = registry().find(name);
+    return it != registry().end() ? it->second.lock() : nullptr;
+}
+
+replay_buffer::replay_buffer(std::wstring name)
+    : impl_(new impl(std::move(name)))
+{
+}
+
+replay_buffer::~replay_buffer() {}
+
+void replay_buffer::reset(const core::video_format_desc& format_desc, int64_t capacity)
+{
+    impl_->reset(format_desc, capacity);
+}
+
+void replay_buffer::push(const core::const_frame& frame) { impl_->push(frame); }
+
+core::const_frame replay_buffer::get(int64_t n) const { return impl_->get(n); }
+
+int64_t replay_buffer::begin() const { return impl_->begin(); }
+
+int64_t replay_buffer::end() const { return impl_->end(); }
+
+core::video_format_desc replay_buffer::format_desc() const { return impl_->format_desc(); }
+
+const std::wstring& replay_buffer::name() const { return impl_->name_; }
+
+}} // namespace caspar::replay
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/frame/frame.h>
+#include <core/video_format.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace caspar { namespace replay {
+
+// Frames a replay consumer recorded, held in RAM for replay producers to play back. Frames are numbered from the first
+// one recorded since the last reset, and the oldest are dropped once the ring holds its capacity.
+class replay_buffer
+{
+  public:
+    // The buffer recorded as name, created empty if there is none.
+    static std::shared_ptr<replay_buffer> open(const std::wstring& name);
+
+    // Empty if nothing records or recorded as name.
+    static std::shared_ptr<replay_buffer> find(const std::wstring& name);
+
+    explicit replay_buffer(std::wstring name);
+    ~replay_buffer();
+
+    replay_buffer(const replay_buffer&)            = delete;
+    replay_buffer& operator=(const replay_buffer&) = delete;
+
+    // Starts over with an empty ring of capacity frames of format_desc.
+    void reset(const core::video_format_desc& format_desc, int64_t capacity);
+
+    // Copies the image, the mixer's readback buffers aren't held on to for the length of the ring.
+    void push(const core::const_frame& frame);
+
+    // Recorded frame n, empty before begin() and from end() on. The same frame is returned every time, so that the
+    // mixer only uploads it once however often it is played.
+    core::const_frame get(int64_t n) const;
+
+    int64_t begin() const;
+    int64_t end() const;
+
+    core::video_format_desc format_desc() const;
+    const std::wstring&     name() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::replay
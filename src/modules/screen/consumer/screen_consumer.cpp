@@ -26,10 +26,10 @@
 
 #include <common/array.h>
 #include <common/diagnostics/graph.h>
-#include <common/future.h>
 #include <common/gl/gl_check.h>
 #include <common/log.h>
 #include <common/memory.h>
+#include <common/os/thread.h>
 #include <common/param.h>
 #include <common/timer.h>
 #include <common/utf.h>
@@ -37,14 +37,19 @@
 #include <core/consumer/frame_consumer.h>
 #include <core/frame/frame.h>
 #include <core/frame/geometry.h>
+#include <core/frame/pixel_format.h>
 #include <core/video_format.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/property_tree/ptree.hpp>
 
-#include <tbb/concurrent_queue.h>
-
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -61,6 +66,7 @@
 #include "consumer_screen_fragment.h"
 #include "consumer_screen_vertex.h"
 #include <accelerator/ogl/util/shader.h>
+#include <accelerator/ogl/util/texture.h>
 
 namespace caspar { namespace screen {
 
@@ -77,6 +83,26 @@ enum class stretch
     uniform_to_fill
 };
 
+// The part of the channel a head shows, in channel pixels. A width or height of 0 reaches to the edge.
+struct region
+{
+    int x      = 0;
+    int y      = 0;
+    int width  = 0;
+    int height = 0;
+};
+
+// One window of the consumer. The first head takes its placement from the consumer's own settings.
+struct head_configuration
+{
+    int    screen_index  = 0;
+    int    screen_x      = 0;
+    int    screen_y      = 0;
+    int    screen_width  = 0;
+    int    screen_height = 0;
+    region source;
+};
+
 struct configuration
 {
     enum class aspect_ratio
@@ -93,30 +119,81 @@ struct configuration
         datavideo_limited = 2
     };
 
-    std::wstring    name          = L"Screen consumer";
-    int             screen_index  = 0;
-    int             screen_x      = 0;
-    int             screen_y      = 0;
-    int             screen_width  = 0;
-    int             screen_height = 0;
-    screen::stretch stretch       = screen::stretch::fill;
-    bool            windowed      = true;
-    bool            key_only      = false;
-    bool            sbs_key       = false;
-    aspect_ratio    aspect        = aspect_ratio::aspect_invalid;
-    bool            vsync         = false;
-    bool            interactive   = true;
-    bool            borderless    = false;
-    bool            always_on_top = false;
-    colour_spaces   colour_space  = colour_spaces::RGB;
+    std::wstring                    name           = L"Screen consumer";
+    int                             screen_index   = 0;
+    int                             screen_x       = 0;
+    int                             screen_y       = 0;
+    int                             screen_width   = 0;
+    int                             screen_height  = 0;
+    region                          source;
+    screen::stretch                 stretch        = screen::stretch::fill;
+    bool                            windowed       = true;
+    bool                            key_only       = false;
+    bool                            sbs_key        = false;
+    aspect_ratio                    aspect         = aspect_ratio::aspect_invalid;
+    bool                            vsync          = false;
+    int                             swap_delay     = 0; // ms before the vertical blank to draw at
+    bool                            interactive    = true;
+    bool                            borderless     = false;
+    bool                            always_on_top  = false;
+    colour_spaces                   colour_space   = colour_spaces::RGB;
+    bool                            shared_texture = true;
+    std::vector<head_configuration> heads;
+
+    std::vector<head_configuration> all_heads() const
+    {
+        head_configuration primary;
+        primary.screen_index  = screen_index;
+        primary.screen_x      = screen_x;
+        primary.screen_y      = screen_y;
+        primary.screen_width  = screen_width;
+        primary.screen_height = screen_height;
+        primary.source        = source;
+
+        auto result = heads;
+        result.insert(result.begin(), primary);
+        return result;
+    }
 };
 
 struct frame
 {
-    GLuint pbo   = 0;
-    GLuint tex   = 0;
-    char*  ptr   = nullptr;
-    GLsync fence = nullptr;
+    GLuint pbo = 0;
+    GLuint tex = 0;
+    char*  ptr = nullptr;
+
+    // Signals once the image is on the gpu, every head waits for it before drawing.
+    GLsync ready = nullptr;
+
+    // One per head, the slot is reused once all of their draws from it are done.
+    std::vector<GLsync> fences;
+
+    // The texture to draw, tex or the one of the mixer held by shared.
+    GLuint            source = 0;
+    core::const_frame shared;
+
+    // When the image was sent to the consumer.
+    std::chrono::steady_clock::time_point arrival;
+};
+
+// A window and the part of the channel it shows. Vertex arrays aren't shared between contexts, so each head has
+// its own, while the textures and the shader are shared by all of them.
+struct head
+{
+    head_configuration config;
+    sf::Window         window;
+
+    int screen_width  = 0;
+    int screen_height = 0;
+    int square_width  = 0;
+    int square_height = 0;
+    int screen_x      = 0;
+    int screen_y      = 0;
+
+    std::vector<core::frame_geometry::coord> draw_coords;
+
+    GLuint vao = 0;
+    GLuint vbo = 0;
 };
 
 struct screen_consumer
@@ -125,27 +202,22 @@ struct screen_consumer
     core::video_format_desc format_desc_;
     int                     channel_index_;
 
-    std::vector<frame> frames_;
-
-    int screen_width_  = format_desc_.width;
-    int screen_height_ = format_desc_.height;
-    int square_width_  = format_desc_.square_width;
-    int square_height_ = format_desc_.square_height;
-    int screen_x_      = 0;
-    int screen_y_      = 0;
-
-    std::vector<core::frame_geometry::coord> draw_coords_;
-
-    sf::Window window_;
+    std::vector<frame>                 frames_;
+    std::vector<std::unique_ptr<head>> heads_;
 
     spl::shared_ptr<diagnostics::graph> graph_;
     caspar::timer                       tick_timer_;
 
-    tbb::concurrent_bounded_queue<core::const_frame> frame_buffer_;
+    // The next frame to show, newer ones are dropped until it is taken.
+    std::mutex                       buffer_mutex_;
+    std::condition_variable          buffer_cond_;
+    std::optional<core::const_frame> buffer_;
+
+    std::chrono::steady_clock::time_point last_present_;
+    std::atomic<int64_t>                  missed_vsyncs_{0};
 
     std::unique_ptr<accelerator::ogl::shader> shader_;
-    GLuint                                    vao_;
-    GLuint                                    vbo_;
+    GLuint                                    sampler_;
 
     std::atomic<bool> is_running_{true};
     std::thread       thread_;
@@ -159,116 +231,46 @@ struct screen_consumer
         , format_desc_(format_desc)
         , channel_index_(channel_index)
     {
-        if (format_desc_.format == core::video_format::ntsc &&
-            config_.aspect == configuration::aspect_ratio::aspect_4_3) {
-            // Use default values which are 4:3.
-        } else {
-            if (config_.aspect == configuration::aspect_ratio::aspect_16_9) {
-                square_width_ = format_desc.height * 16 / 9;
-            } else if (config_.aspect == configuration::aspect_ratio::aspect_4_3) {
-                square_width_ = format_desc.height * 4 / 3;
-            }
-        }
-
-        frame_buffer_.set_capacity(1);
-
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
+        graph_->set_color("present-latency", diagnostics::color(0.9f, 0.6f, 0.2f));
+        graph_->set_color("missed-vsync", diagnostics::color(0.9f, 0.3f, 0.3f));
         graph_->set_color("frame-time", diagnostics::color(0.1f, 1.0f, 0.1f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
         graph_->set_text(print());
         diagnostics::register_graph(graph_);
 
-#if defined(_MSC_VER)
-        DISPLAY_DEVICE              d_device = {sizeof(d_device), 0};
-        std::vector<DISPLAY_DEVICE> displayDevices;
-        for (int n = 0; EnumDisplayDevices(nullptr, n, &d_device, NULL); ++n) {
-            displayDevices.push_back(d_device);
-        }
-
-        if (config_.screen_index >= displayDevices.size()) {
-            CASPAR_LOG(warning) << print() << L" Invalid screen-index: " << config_.screen_index;
-        }
-
-        DEVMODE devmode = {};
-        if (!EnumDisplaySettings(displayDevices[config_.screen_index].DeviceName, ENUM_CURRENT_SETTINGS, &devmode)) {
-            CASPAR_LOG(warning) << print() << L" Could not find display settings for screen-index: "
-                                << config_.screen_index;
-        }
-
-        screen_x_      = devmode.dmPosition.x;
-        screen_y_      = devmode.dmPosition.y;
-        screen_width_  = devmode.dmPelsWidth;
-        screen_height_ = devmode.dmPelsHeight;
-#else
-        if (config_.screen_index > 1) {
-            CASPAR_LOG(warning) << print() << L" Screen-index is not supported on linux";
-        }
-#endif
-
-        if (config.windowed) {
-            screen_x_ += config.screen_x;
-            screen_y_ += config.screen_y;
-
-            if (config.screen_width > 0 && config.screen_height > 0) {
-                screen_width_  = config.screen_width;
-                screen_height_ = config.screen_height;
-            } else if (config.screen_width > 0) {
-                screen_width_  = config.screen_width;
-                screen_height_ = square_height_ * config.screen_width / square_width_;
-            } else if (config.screen_height > 0) {
-                screen_height_ = config.screen_height;
-                screen_width_  = square_width_ * config.screen_height / square_height_;
-            } else {
-                screen_width_  = square_width_;
-                screen_height_ = square_height_;
-            }
+        for (auto& head_config : config_.all_heads()) {
+            auto head    = std::make_unique<screen::head>();
+            head->config = head_config;
+            place(*head);
+            heads_.push_back(std::move(head));
         }
 
         thread_ = std::thread([this] {
+            set_thread_affinity(thread_role::consumer);
             try {
-                const auto    window_style = config_.borderless ? sf::Style::None
-                                             : config_.windowed ? sf::Style::Resize | sf::Style::Close
-                                                                : sf::Style::Fullscreen;
-                sf::VideoMode desktop      = sf::VideoMode::getDesktopMode();
-                sf::VideoMode mode(
-                    config_.sbs_key ? screen_width_ * 2 : screen_width_, screen_height_, desktop.bitsPerPixel);
-                window_.create(mode,
-                               u8(print()),
-                               window_style,
-                               sf::ContextSettings(0, 0, 0, 4, 5, sf::ContextSettings::Attribute::Core));
-                window_.setPosition(sf::Vector2i(screen_x_, screen_y_));
-                window_.setMouseCursorVisible(config_.interactive);
-                window_.setActive(true);
-
-                if (config_.always_on_top) {
-#ifdef _MSC_VER
-                    HWND hwnd = window_.getSystemHandle();
-                    SetWindowPos(hwnd, HWND_TOPMOST, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE);
-#else
-                    window_always_on_top(window_);
-#endif
+                for (size_t n = 0; n < heads_.size(); ++n) {
+                    create_window(*heads_[n], n);
                 }
 
-                if (glewInit() != GLEW_OK) {
-                    CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to initialize GLEW."));
-                }
-
-                if (!GLEW_VERSION_4_5 && (glewIsSupported("GL_ARB_sync GL_ARB_shader_objects GL_ARB_multitexture "
-                                                          "GL_ARB_direct_state_access GL_ARB_texture_barrier") == 0u)) {
-                    CASPAR_THROW_EXCEPTION(not_supported() << msg_info(
-                                               "Your graphics card does not meet the minimum hardware requirements "
-                                               "since it does not support OpenGL 4.5 or higher."));
-                }
-
-                GL(glGenVertexArrays(1, &vao_));
-                GL(glGenBuffers(1, &vbo_));
-                GL(glBindVertexArray(vao_));
-                GL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
+                // Uploads happen in the context of the first head, the others draw from the shared textures.
+                heads_.front()->window.setActive(true);
 
                 shader_ = get_shader();
                 shader_->use();
                 shader_->set("background", 0);
-                shader_->set("window_width", screen_width_);
+                shader_->set("colour_space", config_.colour_space);
+
+                // The mixer's textures don't carry the filtering of ours, a sampler applies it to both.
+                const auto filter = config_.colour_space == configuration::colour_spaces::datavideo_full ||
+                                            config_.colour_space == configuration::colour_spaces::datavideo_limited
+                                        ? GL_NEAREST
+                                        : GL_LINEAR;
+                GL(glCreateSamplers(1, &sampler_));
+                GL(glSamplerParameteri(sampler_, GL_TEXTURE_MIN_FILTER, filter));
+                GL(glSamplerParameteri(sampler_, GL_TEXTURE_MAG_FILTER, filter));
+                GL(glSamplerParameteri(sampler_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+                GL(glSamplerParameteri(sampler_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
 
                 for (int n = 0; n < 2; ++n) {
                     screen::frame frame;
@@ -279,39 +281,23 @@ struct screen_consumer
                         reinterpret_cast<char*>(GL2(glMapNamedBufferRange(frame.pbo, 0, format_desc_.size, flags)));
 
                     GL(glCreateTextures(GL_TEXTURE_2D, 1, &frame.tex));
-                    GL(glTextureParameteri(frame.tex,
-                                           GL_TEXTURE_MIN_FILTER,
-                                           (config_.colour_space == configuration::colour_spaces::datavideo_full ||
-                                            config_.colour_space == configuration::colour_spaces::datavideo_limited)
-                                               ? GL_NEAREST
-                                               : GL_LINEAR));
-                    GL(glTextureParameteri(frame.tex,
-                                           GL_TEXTURE_MAG_FILTER,
-                                           (config_.colour_space == configuration::colour_spaces::datavideo_full ||
-                                            config_.colour_space == configuration::colour_spaces::datavideo_limited)
-                                               ? GL_NEAREST
-                                               : GL_LINEAR));
-                    GL(glTextureParameteri(frame.tex, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-                    GL(glTextureParameteri(frame.tex, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
                     GL(glTextureStorage2D(frame.tex, 1, GL_RGBA8, format_desc_.width, format_desc_.height));
                     GL(glClearTexImage(frame.tex, 0, GL_BGRA, GL_UNSIGNED_BYTE, nullptr));
+                    frame.source = frame.tex;
+                    frame.ready  = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 
                     frames_.push_back(frame);
                 }
+                GL(glFlush());
 
-                GL(glDisable(GL_DEPTH_TEST));
-                GL(glClearColor(0.0, 0.0, 0.0, 0.0));
-                GL(glViewport(
-                    0, 0, config_.sbs_key ? format_desc_.width * 2 : format_desc_.width, format_desc_.height));
-
-                calculate_aspect();
-
-                window_.setVerticalSyncEnabled(config_.vsync);
                 if (config_.vsync) {
                     CASPAR_LOG(info) << print() << " Enabled vsync.";
+                    if (config_.swap_delay > 0 &&
+                        !delay_before_swap(*heads_.front(), config_.swap_delay / 1000.0f)) {
+                        CASPAR_LOG(warning) << print() << " GL_NV_delay_before_swap is not available.";
+                    }
                 }
 
-                shader_->set("colour_space", config_.colour_space);
                 if (config_.colour_space == configuration::colour_spaces::datavideo_full ||
                     config_.colour_space == configuration::colour_spaces::datavideo_limited) {
                     CASPAR_LOG(info) << print() << " Enabled colours conversion for DataVideo TC-100/TC-200 "
@@ -322,151 +308,415 @@ struct screen_consumer
                 while (is_running_) {
                     tick();
                 }
-            } catch (tbb::user_abort&) {
-                // Do nothing
             } catch (...) {
                 CASPAR_LOG_CURRENT_EXCEPTION();
                 is_running_ = false;
             }
-            for (auto frame : frames_) {
+
+            if (!heads_.empty()) {
+                heads_.front()->window.setActive(true);
+            }
+            for (auto& frame : frames_) {
+                wait_for(frame);
+                if (frame.ready != nullptr) {
+                    glDeleteSync(frame.ready);
+                }
+                frame.shared = core::const_frame{};
                 GL(glUnmapNamedBuffer(frame.pbo));
                 glDeleteBuffers(1, &frame.pbo);
                 glDeleteTextures(1, &frame.tex);
             }
 
+            glDeleteSamplers(1, &sampler_);
             shader_.reset();
-            GL(glDeleteVertexArrays(1, &vao_));
-            GL(glDeleteBuffers(1, &vbo_));
 
-            window_.close();
+            for (auto& head : heads_) {
+                if (head->window.setActive(true)) {
+                    glDeleteVertexArrays(1, &head->vao);
+                    glDeleteBuffers(1, &head->vbo);
+                }
+                head->window.close();
+            }
         });
     }
 
     ~screen_consumer()
     {
         is_running_ = false;
-        frame_buffer_.abort();
+        buffer_cond_.notify_all();
         thread_.join();
     }
 
+    void place(head& head) const
+    {
+        const auto& config = head.config;
+
+        auto& source = head.config.source;
+        source.x     = std::clamp(source.x, 0, format_desc_.width - 1);
+        source.y     = std::clamp(source.y, 0, format_desc_.height - 1);
+        if (source.width <= 0 || source.x + source.width > format_desc_.width) {
+            source.width = format_desc_.width - source.x;
+        }
+        if (source.height <= 0 || source.y + source.height > format_desc_.height) {
+            source.height = format_desc_.height - source.y;
+        }
+
+        auto square_width = format_desc_.square_width;
+        if (format_desc_.format == core::video_format::ntsc &&
+            config_.aspect == configuration::aspect_ratio::aspect_4_3) {
+            // Use default values which are 4:3.
+        } else {
+            if (config_.aspect == configuration::aspect_ratio::aspect_16_9) {
+                square_width = format_desc_.height * 16 / 9;
+            } else if (config_.aspect == configuration::aspect_ratio::aspect_4_3) {
+                square_width = format_desc_.height * 4 / 3;
+            }
+        }
+        head.square_width  = square_width * source.width / format_desc_.width;
+        head.square_height = format_desc_.square_height * source.height / format_desc_.height;
+        head.screen_width  = head.square_width;
+        head.screen_height = head.square_height;
+
+#if defined(_MSC_VER)
+        DISPLAY_DEVICE              d_device = {sizeof(d_device), 0};
+        std::vector<DISPLAY_DEVICE> displayDevices;
+        for (int n = 0; EnumDisplayDevices(nullptr, n, &d_device, NULL); ++n) {
+            displayDevices.push_back(d_device);
+        }
+
+        if (config.screen_index >= displayDevices.size()) {
+            CASPAR_LOG(warning) << print() << L" Invalid screen-index: " << config.screen_index;
+        }
+
+        DEVMODE devmode = {};
+        if (!EnumDisplaySettings(displayDevices[config.screen_index].DeviceName, ENUM_CURRENT_SETTINGS, &devmode)) {
+            CASPAR_LOG(warning) << print() << L" Could not find display settings for screen-index: "
+                                << config.screen_index;
+        }
+
+        head.screen_x      = devmode.dmPosition.x;
+        head.screen_y      = devmode.dmPosition.y;
+        head.screen_width  = devmode.dmPelsWidth;
+        head.screen_height = devmode.dmPelsHeight;
+#else
+        if (config.screen_index > 1) {
+            CASPAR_LOG(warning) << print() << L" Screen-index is not supported on linux";
+        }
+#endif
+
+        if (config_.windowed) {
+            head.screen_x += config.screen_x;
+            head.screen_y += config.screen_y;
+
+            if (config.screen_width > 0 && config.screen_height > 0) {
+                head.screen_width  = config.screen_width;
+                head.screen_height = config.screen_height;
+            } else if (config.screen_width > 0) {
+                head.screen_width  = config.screen_width;
+                head.screen_height = head.square_height * config.screen_width / head.square_width;
+            } else if (config.screen_height > 0) {
+                head.screen_height = config.screen_height;
+                head.screen_width  = head.square_width * config.screen_height / head.square_height;
+            } else {
+                head.screen_width  = head.square_width;
+                head.screen_height = head.square_height;
+            }
+        }
+    }
+
+    void create_window(head& head, size_t index)
+    {
+        // SFML allows a single fullscreen window, further heads cover their screen with a borderless one.
+        const auto    fullscreen   = !config_.windowed && !config_.borderless;
+        const auto    window_style = config_.borderless || (fullscreen && index > 0) ? sf::Style::None
+                                     : config_.windowed ? sf::Style::Resize | sf::Style::Close
+                                                        : sf::Style::Fullscreen;
+        sf::VideoMode desktop      = sf::VideoMode::getDesktopMode();
+        sf::VideoMode mode(
+            config_.sbs_key ? head.screen_width * 2 : head.screen_width, head.screen_height, desktop.bitsPerPixel);
+        head.window.create(mode,
+                           u8(print()),
+                           window_style,
+                           sf::ContextSettings(0, 0, 0, 4, 5, sf::ContextSettings::Attribute::Core));
+        head.window.setPosition(sf::Vector2i(head.screen_x, head.screen_y));
+        head.window.setMouseCursorVisible(config_.interactive);
+        head.window.setActive(true);
+
+        if (config_.always_on_top) {
+#ifdef _MSC_VER
+            HWND hwnd = head.window.getSystemHandle();
+            SetWindowPos(hwnd, HWND_TOPMOST, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE);
+#else
+            window_always_on_top(head.window);
+#endif
+        }
+
+        if (index == 0) {
+            if (glewInit() != GLEW_OK) {
+                CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to initialize GLEW."));
+            }
+
+            if (!GLEW_VERSION_4_5 && (glewIsSupported("GL_ARB_sync GL_ARB_shader_objects GL_ARB_multitexture "
+                                                      "GL_ARB_direct_state_access GL_ARB_texture_barrier") == 0u)) {
+                CASPAR_THROW_EXCEPTION(not_supported() << msg_info(
+                                           "Your graphics card does not meet the minimum hardware requirements "
+                                           "since it does not support OpenGL 4.5 or higher."));
+            }
+        }
+
+        GL(glGenVertexArrays(1, &head.vao));
+        GL(glGenBuffers(1, &head.vbo));
+        GL(glBindVertexArray(head.vao));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, head.vbo));
+
+        GL(glDisable(GL_DEPTH_TEST));
+        GL(glClearColor(0.0, 0.0, 0.0, 0.0));
+
+        calculate_aspect(head);
+
+        // Heads present together, only the first one waits for the vertical blank.
+        head.window.setVerticalSyncEnabled(config_.vsync && index == 0);
+    }
+
     bool poll()
     {
-        int       count = 0;
-        sf::Event e;
-        while (window_.pollEvent(e)) {
-            count++;
-            if (e.type == sf::Event::Resized) {
-                calculate_aspect();
-            } else if (e.type == sf::Event::Closed) {
-                is_running_ = false;
+        int count = 0;
+        for (auto& head : heads_) {
+            sf::Event e;
+            while (head->window.pollEvent(e)) {
+                count++;
+                if (e.type == sf::Event::Resized) {
+                    calculate_aspect(*head);
+                } else if (e.type == sf::Event::Closed) {
+                    is_running_ = false;
+                }
             }
         }
         return count > 0;
     }
 
-    void tick()
+    // Blocks on the fences of the last draws from the slot, a millisecond at a time with the window events handled in
+    // between.
+    void wait_for(frame& frame)
     {
-        core::const_frame in_frame;
+        while (!frame.fences.empty()) {
+            auto wait = glClientWaitSync(frame.fences.back(), GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            if (wait == GL_ALREADY_SIGNALED || wait == GL_CONDITION_SATISFIED || wait == GL_WAIT_FAILED) {
+                glDeleteSync(frame.fences.back());
+                frame.fences.pop_back();
+            } else {
+                poll();
+            }
+        }
+    }
 
-        while (!frame_buffer_.try_pop(in_frame) && is_running_) {
-            // TODO (fix)
-            if (!poll()) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    // Blocks until a frame is sent, handling the window events at least once a frame meanwhile.
+    bool pop(core::const_frame& frame)
+    {
+        const auto timeout = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / format_desc_.hz));
+
+        while (is_running_) {
+            {
+                std::unique_lock<std::mutex> lock(buffer_mutex_);
+                buffer_cond_.wait_for(lock, timeout, [&] { return buffer_ || !is_running_; });
+                if (buffer_) {
+                    frame = std::move(*buffer_);
+                    buffer_.reset();
+                    return true;
+                }
             }
+            poll();
+        }
+        return false;
+    }
+
+    // Blocks until seconds before the next vertical blank of the head, for drawing as late as possible. False for
+    // drivers without GL_NV_delay_before_swap.
+    static bool delay_before_swap(head& head, float seconds)
+    {
+#ifdef _MSC_VER
+        using delay_fn    = BOOL(WINAPI*)(HDC, GLfloat);
+        static auto delay = reinterpret_cast<delay_fn>(wglGetProcAddress("wglDelayBeforeSwapNV"));
+        if (!delay) {
+            return false;
         }
+        auto hwnd   = head.window.getSystemHandle();
+        auto hdc    = GetDC(hwnd);
+        auto result = delay(hdc, seconds) == TRUE;
+        ReleaseDC(hwnd, hdc);
+        return result;
+#else
+        return window_delay_before_swap(head.window, seconds);
+#endif
+    }
 
-        if (!in_frame) {
+    void tick()
+    {
+        poll();
+
+        core::const_frame in_frame;
+        if (!pop(in_frame)) {
             return;
         }
+        const auto arrival = std::chrono::steady_clock::now();
 
-        // Upload
+        // Upload, once for all heads.
         {
             auto& frame = frames_.front();
 
-            while (frame.fence != nullptr) {
-                auto wait = glClientWaitSync(frame.fence, 0, 0);
-                if (wait == GL_ALREADY_SIGNALED || wait == GL_CONDITION_SATISFIED) {
-                    glDeleteSync(frame.fence);
-                    frame.fence = nullptr;
-                }
-                if (!poll()) {
-                    // TODO (fix)
-                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
-                }
+            heads_.front()->window.setActive(true);
+            wait_for(frame);
+
+            // The last draws from this slot are done, so the mixer may have its texture back.
+            frame.shared = core::const_frame{};
+
+            const auto& texture = in_frame.image_data(core::output_format::texture);
+            const auto  shared  = texture.storage<accelerator::ogl::shared_texture>();
+            // The key of the mixer draws like the fill through the key only shader, the alpha being in every byte.
+            const auto& key     = in_frame.image_data(core::output_format::key);
+            const auto& image   = key ? key : in_frame.image_data(core::output_format::bgra);
+
+            if (shared != nullptr && shared->image) {
+                // Waits on the gpu for the mixer to be done drawing, neither thread blocks.
+                GL(glWaitSync(static_cast<GLsync>(shared->fence.get()), 0, GL_TIMEOUT_IGNORED));
+                frame.source = shared->image->id();
+                frame.shared = in_frame;
+            } else if (image) {
+                // Streamed through the pbo, when the mixer renders in a context we don't share or before it has
+                // seen our preferred format.
+                std::memcpy(frame.ptr, image.begin(), format_desc_.size);
+
+                GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, frame.pbo));
+                GL(glTextureSubImage2D(
+                    frame.tex, 0, 0, 0, format_desc_.width, format_desc_.height, GL_BGRA, GL_UNSIGNED_BYTE, nullptr));
+                GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+                frame.source = frame.tex;
+            } else {
+                GL(glClearTexImage(frame.tex, 0, GL_BGRA, GL_UNSIGNED_BYTE, nullptr));
+                frame.source = frame.tex;
             }
 
-            std::memcpy(frame.ptr, in_frame.image_data(0).begin(), format_desc_.size);
-
-            GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, frame.pbo));
-            GL(glTextureSubImage2D(
-                frame.tex, 0, 0, 0, format_desc_.width, format_desc_.height, GL_BGRA, GL_UNSIGNED_BYTE, nullptr));
-            GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
-
-            frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glDeleteSync(frame.ready);
+            frame.ready   = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            frame.arrival = arrival;
+            GL(glFlush());
         }
 
-        // Display
+        // Display, the first head last so the others are already queued when it waits for vsync.
         {
             auto& frame = frames_.back();
 
-            GL(glClear(GL_COLOR_BUFFER_BIT));
+            if (config_.vsync && config_.swap_delay > 0) {
+                heads_.front()->window.setActive(true);
+                delay_before_swap(*heads_.front(), config_.swap_delay / 1000.0f);
+            }
+
+            for (size_t n = heads_.size(); n-- > 0;) {
+                draw(*heads_[n], frame);
+            }
+
+            // The first head returns from display once its swap is done, at the vertical blank with vsync.
+            const auto present = std::chrono::steady_clock::now();
+            if (frame.arrival != std::chrono::steady_clock::time_point{}) {
+                const auto latency = std::chrono::duration<double>(present - frame.arrival).count();
+                graph_->set_value("present-latency", latency * format_desc_.hz * 0.5);
+            }
+
+            // A frame that arrived within a frame of the last present but is shown more than one and a half later
+            // missed the vertical blank it was due for.
+            if (config_.vsync && last_present_ != std::chrono::steady_clock::time_point{}) {
+                const auto period   = 1.0 / format_desc_.hz;
+                const auto interval = std::chrono::duration<double>(present - last_present_).count();
+                const auto waited   = std::chrono::duration<double>(arrival - last_present_).count();
+                if (interval > period * 1.5 && waited < period) {
+                    missed_vsyncs_ += 1;
+                    graph_->set_tag(diagnostics::tag_severity::WARNING, "missed-vsync");
+                }
+            }
+            last_present_ = present;
+        }
+
+        std::rotate(frames_.begin(), frames_.begin() + 1, frames_.end());
+
+        graph_->set_value("tick-time", tick_timer_.elapsed() * format_desc_.fps * 0.5);
+        tick_timer_.restart();
+    }
 
-            GL(glActiveTexture(GL_TEXTURE0));
-            GL(glBindTexture(GL_TEXTURE_2D, frame.tex));
+    void draw(head& head, frame& frame)
+    {
+        head.window.setActive(true);
 
-            GL(glBufferData(GL_ARRAY_BUFFER,
-                            static_cast<GLsizeiptr>(sizeof(core::frame_geometry::coord)) * draw_coords_.size(),
-                            draw_coords_.data(),
-                            GL_STATIC_DRAW));
+        GL(glWaitSync(frame.ready, 0, GL_TIMEOUT_IGNORED));
 
-            auto stride = static_cast<GLsizei>(sizeof(core::frame_geometry::coord));
+        GL(glViewport(0, 0, head.screen_width, head.screen_height));
+        GL(glClear(GL_COLOR_BUFFER_BIT));
 
-            auto vtx_loc = shader_->get_attrib_location("Position");
-            auto tex_loc = shader_->get_attrib_location("TexCoordIn");
+        shader_->use();
 
-            GL(glEnableVertexAttribArray(vtx_loc));
-            GL(glEnableVertexAttribArray(tex_loc));
+        GL(glActiveTexture(GL_TEXTURE0));
+        GL(glBindTexture(GL_TEXTURE_2D, frame.source));
+        GL(glBindSampler(0, sampler_));
 
-            GL(glVertexAttribPointer(vtx_loc, 2, GL_DOUBLE, GL_FALSE, stride, nullptr));
-            GL(glVertexAttribPointer(tex_loc, 4, GL_DOUBLE, GL_FALSE, stride, (GLvoid*)(2 * sizeof(GLdouble))));
+        GL(glBindVertexArray(head.vao));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, head.vbo));
+        GL(glBufferData(GL_ARRAY_BUFFER,
+                        static_cast<GLsizeiptr>(sizeof(core::frame_geometry::coord)) * head.draw_coords.size(),
+                        head.draw_coords.data(),
+                        GL_STATIC_DRAW));
 
-            shader_->set("window_width", screen_width_);
+        auto stride = static_cast<GLsizei>(sizeof(core::frame_geometry::coord));
 
-            if (config_.sbs_key) {
-                auto coords_size = static_cast<GLsizei>(draw_coords_.size());
+        auto vtx_loc = shader_->get_attrib_location("Position");
+        auto tex_loc = shader_->get_attrib_location("TexCoordIn");
 
-                // First half fill
-                shader_->set("key_only", false);
-                GL(glDrawArrays(GL_TRIANGLES, 0, coords_size / 2));
+        GL(glEnableVertexAttribArray(vtx_loc));
+        GL(glEnableVertexAttribArray(tex_loc));
 
-                // Second half key
-                shader_->set("key_only", true);
-                GL(glDrawArrays(GL_TRIANGLES, coords_size / 2, coords_size / 2));
-            } else {
-                shader_->set("key_only", config_.key_only);
-                GL(glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(draw_coords_.size())));
-            }
+        GL(glVertexAttribPointer(vtx_loc, 2, GL_DOUBLE, GL_FALSE, stride, nullptr));
+        GL(glVertexAttribPointer(tex_loc, 4, GL_DOUBLE, GL_FALSE, stride, (GLvoid*)(2 * sizeof(GLdouble))));
+
+        shader_->set("window_width", head.screen_width);
 
-            GL(glDisableVertexAttribArray(vtx_loc));
-            GL(glDisableVertexAttribArray(tex_loc));
+        if (config_.sbs_key) {
+            auto coords_size = static_cast<GLsizei>(head.draw_coords.size());
+
+            // First half fill
+            shader_->set("key_only", false);
+            GL(glDrawArrays(GL_TRIANGLES, 0, coords_size / 2));
 
-            GL(glBindTexture(GL_TEXTURE_2D, 0));
+            // Second half key
+            shader_->set("key_only", true);
+            GL(glDrawArrays(GL_TRIANGLES, coords_size / 2, coords_size / 2));
+        } else {
+            shader_->set("key_only", config_.key_only);
+            GL(glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(head.draw_coords.size())));
         }
 
-        window_.display();
+        GL(glDisableVertexAttribArray(vtx_loc));
+        GL(glDisableVertexAttribArray(tex_loc));
 
-        std::rotate(frames_.begin(), frames_.begin() + 1, frames_.end());
+        GL(glBindSampler(0, 0));
+        GL(glBindTexture(GL_TEXTURE_2D, 0));
 
-        graph_->set_value("tick-time", tick_timer_.elapsed() * format_desc_.fps * 0.5);
-        tick_timer_.restart();
+        // Fences the draw of this head, the slot is only reused and the mixer's texture released once all are done.
+        frame.fences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+
+        head.window.display();
     }
 
-    std::future<bool> send(core::video_field field, const core::const_frame& frame)
+    core::send_result send(core::video_field field, const core::const_frame& frame)
     {
-        if (!frame_buffer_.try_push(frame)) {
-            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        {
+            std::lock_guard<std::mutex> lock(buffer_mutex_);
+            if (buffer_) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+            } else {
+                buffer_ = frame;
+            }
         }
-        return make_ready_future(is_running_.load());
+        buffer_cond_.notify_one();
+        return is_running_.load();
     }
 
     std::wstring channel_and_format() const
@@ -476,84 +726,89 @@ struct screen_consumer
 
     std::wstring print() const { return config_.name + L" " + channel_and_format(); }
 
-    void calculate_aspect()
+    void calculate_aspect(head& head)
     {
         if (config_.windowed) {
-            screen_height_ = window_.getSize().y;
-            screen_width_  = window_.getSize().x;
+            head.screen_height = head.window.getSize().y;
+            head.screen_width  = head.window.getSize().x;
         }
 
-        GL(glViewport(0, 0, screen_width_, screen_height_));
-
-        std::pair<float, float> target_ratio = none();
+        std::pair<float, float> target_ratio = none(head);
         if (config_.stretch == screen::stretch::fill) {
             target_ratio = Fill();
         } else if (config_.stretch == screen::stretch::uniform) {
-            target_ratio = uniform();
+            target_ratio = uniform(head);
         } else if (config_.stretch == screen::stretch::uniform_to_fill) {
-            target_ratio = uniform_to_fill();
+            target_ratio = uniform_to_fill(head);
         }
 
+        const auto& source = head.config.source;
+        const auto  left   = static_cast<double>(source.x) / format_desc_.width;
+        const auto  right  = static_cast<double>(source.x + source.width) / format_desc_.width;
+        const auto  top    = static_cast<double>(source.y) / format_desc_.height;
+        const auto  bottom = static_cast<double>(source.y + source.height) / format_desc_.height;
+
         if (config_.sbs_key) {
-            draw_coords_ = {
+            head.draw_coords = {
                 // First half fill
-                {-target_ratio.first, target_ratio.second, 0.0, 0.0}, // upper left
-                {0, target_ratio.second, 1.0, 0.0},                   // upper right
-                {0, -target_ratio.second, 1.0, 1.0},                  // lower right
+                {-target_ratio.first, target_ratio.second, left, top}, // upper left
+                {0, target_ratio.second, right, top},                  // upper right
+                {0, -target_ratio.second, right, bottom},              // lower right
 
-                {-target_ratio.first, target_ratio.second, 0.0, 0.0},  // upper left
-                {0, -target_ratio.second, 1.0, 1.0},                   // lower right
-                {-target_ratio.first, -target_ratio.second, 0.0, 1.0}, // lower left
+                {-target_ratio.first, target_ratio.second, left, top},     // upper left
+                {0, -target_ratio.second, right, bottom},                  // lower right
+                {-target_ratio.first, -target_ratio.second, left, bottom}, // lower left
 
                 // Second half key
-                {0, target_ratio.second, 0.0, 0.0},                   // upper left
-                {target_ratio.first, target_ratio.second, 1.0, 0.0},  // upper right
-                {target_ratio.first, -target_ratio.second, 1.0, 1.0}, // lower right
+                {0, target_ratio.second, left, top},                       // upper left
+                {target_ratio.first, target_ratio.second, right, top},     // upper right
+                {target_ratio.first, -target_ratio.second, right, bottom}, // lower right
 
-                {0, target_ratio.second, 0.0, 0.0},                   // upper left
-                {target_ratio.first, -target_ratio.second, 1.0, 1.0}, // lower right
-                {0, -target_ratio.second, 0.0, 1.0}                   // lower left
+                {0, target_ratio.second, left, top},                       // upper left
+                {target_ratio.first, -target_ratio.second, right, bottom}, // lower right
+                {0, -target_ratio.second, left, bottom}                    // lower left
             };
         } else {
-            draw_coords_ = {
+            head.draw_coords = {
                 //    vertex    texture
-                {-target_ratio.first, target_ratio.second, 0.0, 0.0}, // upper left
-                {target_ratio.first, target_ratio.second, 1.0, 0.0},  // upper right
-                {target_ratio.first, -target_ratio.second, 1.0, 1.0}, // lower right
+                {-target_ratio.first, target_ratio.second, left, top},     // upper left
+                {target_ratio.first, target_ratio.second, right, top},     // upper right
+                {target_ratio.first, -target_ratio.second, right, bottom}, // lower right
 
-                {-target_ratio.first, target_ratio.second, 0.0, 0.0}, // upper left
-                {target_ratio.first, -target_ratio.second, 1.0, 1.0}, // lower right
-                {-target_ratio.first, -target_ratio.second, 0.0, 1.0} // lower left
+                {-target_ratio.first, target_ratio.second, left, top},     // upper left
+                {target_ratio.first, -target_ratio.second, right, bottom}, // lower right
+                {-target_ratio.first, -target_ratio.second, left, bottom}  // lower left
             };
         }
     }
 
-    std::pair<float, float> none() const
+    std::pair<float, float> none(const head& head) const
     {
-        float width =
-            static_cast<float>(config_.sbs_key ? square_width_ * 2 : square_width_) / static_cast<float>(screen_width_);
-        float height = static_cast<float>(square_height_) / static_cast<float>(screen_height_);
+        float width  = static_cast<float>(config_.sbs_key ? head.square_width * 2 : head.square_width) /
+                      static_cast<float>(head.screen_width);
+        float height = static_cast<float>(head.square_height) / static_cast<float>(head.screen_height);
 
         return std::make_pair(width, height);
     }
 
-    std::pair<float, float> uniform() const
+    std::pair<float, float> uniform(const head& head) const
     {
-        float aspect = static_cast<float>(config_.sbs_key ? square_width_ * 2 : square_width_) /
-                       static_cast<float>(square_height_);
-        float width  = std::min(1.0f, static_cast<float>(screen_height_) * aspect / static_cast<float>(screen_width_));
-        float height = static_cast<float>(screen_width_ * width) / static_cast<float>(screen_height_ * aspect);
+        float aspect = static_cast<float>(config_.sbs_key ? head.square_width * 2 : head.square_width) /
+                       static_cast<float>(head.square_height);
+        float width  = std::min(
+            1.0f, static_cast<float>(head.screen_height) * aspect / static_cast<float>(head.screen_width));
+        float height = static_cast<float>(head.screen_width * width) / static_cast<float>(head.screen_height * aspect);
 
         return std::make_pair(width, height);
     }
 
     static std::pair<float, float> Fill() { return std::make_pair(1.0f, 1.0f); }
 
-    std::pair<float, float> uniform_to_fill() const
+    std::pair<float, float> uniform_to_fill(const head& head) const
     {
-        float wr =
-            static_cast<float>(config_.sbs_key ? square_width_ * 2 : square_width_) / static_cast<float>(screen_width_);
-        float hr    = static_cast<float>(square_height_) / static_cast<float>(screen_height_);
+        float wr    = static_cast<float>(config_.sbs_key ? head.square_width * 2 : head.square_width) /
+                   static_cast<float>(head.screen_width);
+        float hr    = static_cast<float>(head.square_height) / static_cast<float>(head.screen_height);
         float r_inv = 1.0f / std::min(wr, hr);
 
         float width  = wr * r_inv;
@@ -582,7 +837,7 @@ struct screen_consumer_proxy : public core::frame_consumer
         consumer_ = std::make_unique<screen_consumer>(config_, format_desc, channel_index);
     }
 
-    std::future<bool> send(core::video_field field, core::const_frame frame) override
+    core::send_result send(core::video_field field, core::const_frame frame) override
     {
         return consumer_->send(field, frame);
     }
@@ -593,6 +848,14 @@ struct screen_consumer_proxy : public core::frame_consumer
 
     bool has_synchronization_clock() const override { return false; }
 
+    core::output_format preferred_output_format() const override
+    {
+        if (config_.shared_texture) {
+            return core::output_format::texture;
+        }
+        return config_.key_only ? core::output_format::key : core::output_format::bgra;
+    }
+
     int index() const override { return 600 + (config_.key_only ? 10 : 0) + config_.screen_index; }
 
     core::monitor::state state() const override
@@ -602,6 +865,10 @@ struct screen_consumer_proxy : public core::frame_consumer
         state["screen/index"]         = config_.screen_index;
         state["screen/key_only"]      = config_.key_only;
         state["screen/always_on_top"] = config_.always_on_top;
+        state["screen/heads"]         = static_cast<int>(config_.heads.size() + 1);
+        if (consumer_ && config_.vsync) {
+            state["screen/missed_vsyncs"] = consumer_->missed_vsyncs_.load();
+        }
         return state;
     }
 };
@@ -623,11 +890,13 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
         }
     }
 
-    config.windowed    = !contains_param(L"FULLSCREEN", params);
-    config.key_only    = contains_param(L"KEY_ONLY", params);
-    config.sbs_key     = contains_param(L"SBS_KEY", params);
-    config.interactive = !contains_param(L"NON_INTERACTIVE", params);
-    config.borderless  = contains_param(L"BORDERLESS", params);
+    config.windowed       = !contains_param(L"FULLSCREEN", params);
+    config.key_only       = contains_param(L"KEY_ONLY", params);
+    config.sbs_key        = contains_param(L"SBS_KEY", params);
+    config.interactive    = !contains_param(L"NON_INTERACTIVE", params);
+    config.borderless     = contains_param(L"BORDERLESS", params);
+    config.shared_texture = !contains_param(L"NO_SHARED_TEXTURE", params);
+
 
     if (contains_param(L"NAME", params)) {
         config.name = get_param(L"NAME", params);
@@ -641,25 +910,61 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
     return spl::make_shared<screen_consumer_proxy>(config);
 }
 
+region get_region(const boost::property_tree::wptree& ptree)
+{
+    region result;
+    result.x      = ptree.get(L"src-x", result.x);
+    result.y      = ptree.get(L"src-y", result.y);
+    result.width  = ptree.get(L"width", result.width);
+    result.height = ptree.get(L"height", result.height);
+    return result;
+}
+
 spl::shared_ptr<core::frame_consumer>
 create_preconfigured_consumer(const boost::property_tree::wptree&                      ptree,
                               const core::video_format_repository&                     format_repository,
                               const std::vector<spl::shared_ptr<core::video_channel>>& channels)
 {
     configuration config;
-    config.name          = ptree.get(L"name", config.name);
-    config.screen_index  = ptree.get(L"device", config.screen_index + 1) - 1;
-    config.screen_x      = ptree.get(L"x", config.screen_x);
-    config.screen_y      = ptree.get(L"y", config.screen_y);
-    config.screen_width  = ptree.get(L"width", config.screen_width);
-    config.screen_height = ptree.get(L"height", config.screen_height);
-    config.windowed      = ptree.get(L"windowed", config.windowed);
-    config.key_only      = ptree.get(L"key-only", config.key_only);
-    config.sbs_key       = ptree.get(L"sbs-key", config.sbs_key);
-    config.vsync         = ptree.get(L"vsync", config.vsync);
-    config.interactive   = ptree.get(L"interactive", config.interactive);
-    config.borderless    = ptree.get(L"borderless", config.borderless);
-    config.always_on_top = ptree.get(L"always-on-top", config.always_on_top);
+    config.name           = ptree.get(L"name", config.name);
+    config.screen_index   = ptree.get(L"device", config.screen_index + 1) - 1;
+    config.screen_x       = ptree.get(L"x", config.screen_x);
+    config.screen_y       = ptree.get(L"y", config.screen_y);
+    config.screen_width   = ptree.get(L"width", config.screen_width);
+    config.screen_height  = ptree.get(L"height", config.screen_height);
+    config.windowed       = ptree.get(L"windowed", config.windowed);
+    config.key_only       = ptree.get(L"key-only", config.key_only);
+    config.sbs_key        = ptree.get(L"sbs-key", config.sbs_key);
+    config.vsync          = ptree.get(L"vsync", config.vsync);
+    config.swap_delay     = ptree.get(L"delay-before-swap", config.swap_delay);
+    config.interactive    = ptree.get(L"interactive", config.interactive);
+    config.borderless     = ptree.get(L"borderless", config.borderless);
+    config.always_on_top  = ptree.get(L"always-on-top", config.always_on_top);
+    config.shared_texture = ptree.get(L"shared-texture", config.shared_texture);
+
+    if (auto region = ptree.get_child_optional(L"region")) {
+        config.source = get_region(*region);
+    }
+
+    if (auto heads = ptree.get_child_optional(L"heads")) {
+        for (auto& xml_head : *heads) {
+            if (xml_head.first != L"head") {
+                continue;
+            }
+
+            head_configuration head;
+            head.screen_index  = xml_head.second.get(L"device", head.screen_index + 1) - 1;
+            head.screen_x      = xml_head.second.get(L"x", head.screen_x);
+            head.screen_y      = xml_head.second.get(L"y", head.screen_y);
+            head.screen_width  = xml_head.second.get(L"width", head.screen_width);
+            head.screen_height = xml_head.second.get(L"height", head.screen_height);
+            if (auto region = xml_head.second.get_child_optional(L"region")) {
+                head.source = get_region(*region);
+            }
+            config.heads.push_back(head);
+        }
+    }
+
 
     auto colour_space_value = ptree.get(L"colour-space", L"RGB");
     config.colour_space     = configuration::colour_spaces::RGB;
@@ -21,9 +21,12 @@
 
 #include "x11_util.h"
 
+#include <GL/glx.h>
 #include <X11/X.h>
 #include <X11/Xlib.h>
 
+#include <cstring>
+
 bool window_always_on_top(const sf::Window& window)
 {
     Display* disp = XOpenDisplay(nullptr);
@@ -57,3 +60,25 @@ bool window_always_on_top(const sf::Window& window)
     XCloseDisplay(disp);
     return true;
 }
+
+bool window_delay_before_swap(const sf::Window& window, float seconds)
+{
+    using delay_fn = Bool (*)(Display*, GLXDrawable, GLfloat);
+
+    Display* disp = glXGetCurrentDisplay();
+    if (!disp)
+        return false;
+
+    // glXGetProcAddress returns an address for any name, the extension string tells whether it is there.
+    static const auto delay = [disp]() -> delay_fn {
+        const char* extensions = glXQueryExtensionsString(disp, DefaultScreen(disp));
+        if (!extensions || !std::strstr(extensions, "GLX_NV_delay_before_swap"))
+            return nullptr;
+        return reinterpret_cast<delay_fn>(
+            glXGetProcAddress(reinterpret_cast<const GLubyte*>("glXDelayBeforeSwapNV")));
+    }();
+    if (!delay)
+        return false;
+
+    return delay(disp, window.getSystemHandle(), seconds) == True;
+}
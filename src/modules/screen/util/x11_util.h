@@ -24,3 +24,7 @@
 #include <SFML/Window.hpp>
 
 bool window_always_on_top(const sf::Window& window);
+
+// Blocks until seconds before the next vertical blank of the window, whose context is current. False for drivers
+// without GLX_NV_delay_before_swap.
+bool window_delay_before_swap(const sf::Window& window, float seconds);
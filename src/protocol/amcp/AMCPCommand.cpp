@@ -24,6 +24,8 @@
 #include "AMCPCommand.h"
 #include <core/producer/stage.h>
 
+#include <boost/algorithm/string/predicate.hpp>
+
 namespace caspar { namespace protocol { namespace amcp {
 
 std::future<std::wstring> AMCPCommand::Execute(const spl::shared_ptr<std::vector<channel_context>>& channels)
@@ -31,6 +33,22 @@ std::future<std::wstring> AMCPCommand::Execute(const spl::shared_ptr<std::vector
     return command_(ctx_, channels);
 }
 
+int AMCPCommand::layer_scope() const
+{
+    if (ctx_.channel_index < 0 || ctx_.layer_id < 0)
+        return -1;
+
+    // SWAP takes a second layer, perhaps of another channel, and these mixer commands act on the whole channel or on
+    // the transforms deferred for it.
+    if (name_ == L"SWAP" || name_ == L"MIXER COMMIT" || name_ == L"MIXER GRID" || name_ == L"MIXER MASTERVOLUME")
+        return -1;
+    if (boost::starts_with(name_, L"MIXER ") && !ctx_.parameters.empty() &&
+        boost::iequals(ctx_.parameters.back(), L"DEFER"))
+        return -1;
+
+    return ctx_.layer_id;
+}
+
 void send_reply(IO::ClientInfoPtrStd client, const std::wstring& str, const std::wstring& request_id)
 {
     if (str.empty())
@@ -57,6 +57,9 @@ class AMCPCommand
 
     int channel_index() const { return ctx_.channel_index; }
 
+    // The layer of the channel that the command touches alone, or -1 when it may touch others or the whole channel.
+    int layer_scope() const;
+
     IO::ClientInfoPtr client() const { return ctx_.client; }
 
     const std::wstring& name() const { return name_; }
@@ -98,6 +101,9 @@ class AMCPGroupCommand
 
     bool HasClient() const { return !!client_; }
 
+    // The layer the command touches alone, batches belong to the whole channel.
+    int layer_scope() const { return is_batch_ || commands_.size() != 1 ? -1 : commands_.at(0)->layer_scope(); }
+
     void SendReply(const std::wstring& str) const;
 
     std::wstring name() const;
@@ -28,36 +28,32 @@
 #include <common/future.h>
 #include <common/timer.h>
 
+#include <chrono>
+#include <limits>
+
 namespace caspar { namespace protocol { namespace amcp {
 
 AMCPCommandQueue::AMCPCommandQueue(const std::wstring&                                  name,
-                                   const spl::shared_ptr<std::vector<channel_context>>& channels)
-    : executor_(L"AMCPCommandQueue " + name)
+                                   const spl::shared_ptr<std::vector<channel_context>>& channels,
+                                   int                                                  layer_threads)
+    : name_(name)
     , channels_(channels)
+    , replies_(L"AMCPCommandQueue " + name + L" replies")
+    , layer_executors_(layer_threads > 1 ? layer_threads : 0)
+    , layer_used_(layer_executors_.size(), false)
+    , executor_(L"AMCPCommandQueue " + name)
 {
+    replies_.set_capacity(std::numeric_limits<unsigned int>::max());
 }
 
 AMCPCommandQueue::~AMCPCommandQueue() {}
 
-std::future<bool> exec_cmd(std::shared_ptr<AMCPCommand>                         cmd,
-                           const spl::shared_ptr<std::vector<channel_context>>& channels,
-                           bool                                                 reply_without_req_id)
+// Replies to a command that failed with the exception being handled.
+void send_error_reply(const std::shared_ptr<AMCPCommand>& cmd, bool reply_without_req_id)
 {
     try {
         try {
-            caspar::timer timer;
-
-            auto name = cmd->name();
-            CASPAR_LOG(debug) << "Executing command: " << name;
-
-            auto res = cmd->Execute(channels).share();
-            return std::async(std::launch::async, [cmd, res, reply_without_req_id, timer, name]() -> bool {
-                cmd->SendReply(res.get(), reply_without_req_id);
-
-                CASPAR_LOG(debug) << "Executed command (" << timer.elapsed() << "s): " << name;
-                return true;
-            });
-
+            throw;
         } catch (file_not_found&) {
             CASPAR_LOG(error) << " File not found.";
             cmd->SendReply(L"404 " + cmd->name() + L" FAILED\r\n", reply_without_req_id);
@@ -77,10 +73,45 @@ std::future<bool> exec_cmd(std::shared_ptr<AMCPCommand>
             CASPAR_LOG(error) << "Failed to execute command: " << cmd->name();
             cmd->SendReply(L"501 " + cmd->name() + L" FAILED\r\n", reply_without_req_id);
         }
-
     } catch (...) {
         CASPAR_LOG_CURRENT_EXCEPTION();
     }
+}
+
+std::future<bool> exec_cmd(std::shared_ptr<AMCPCommand>                         cmd,
+                           const spl::shared_ptr<std::vector<channel_context>>& channels,
+                           bool                                                 reply_without_req_id,
+                           executor&                                            replies)
+{
+    try {
+        caspar::timer timer;
+
+        auto name = cmd->name();
+        CASPAR_LOG(debug) << "Executing command: " << name;
+
+        auto res   = cmd->Execute(channels).share();
+        auto reply = [cmd, res, reply_without_req_id, timer, name]() -> bool {
+            // Commands that complete later, such as loads, fail here instead of in Execute.
+            try {
+                cmd->SendReply(res.get(), reply_without_req_id);
+            } catch (...) {
+                send_error_reply(cmd, reply_without_req_id);
+                return false;
+            }
+
+            CASPAR_LOG(debug) << "Executed command (" << timer.elapsed() << "s): " << name;
+            return true;
+        };
+
+        if (res.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            return make_ready_future(reply());
+        }
+
+        // The reply of a load still running is sent once it has finished, so the queue doesn't wait for it.
+        return replies.begin_invoke(std::move(reply));
+    } catch (...) {
+        send_error_reply(cmd, reply_without_req_id);
+    }
 
     return make_ready_future(false);
 }
@@ -90,7 +121,7 @@ void AMCPCommandQueue::AddCommand(std::shared_ptr<AMCPGroupCommand> pCurrentComm
     if (!pCurrentCommand)
         return;
 
-    if (executor_.size() > 128) {
+    if (queued_ > 128) {
         try {
             CASPAR_LOG(error) << "AMCP Command Queue Overflow.";
             CASPAR_LOG(error) << "Failed to execute command:" << pCurrentCommand->name();
@@ -101,14 +132,40 @@ void AMCPCommandQueue::AddCommand(std::shared_ptr<AMCPGroupCommand> pCurrentComm
         return;
     }
 
+    ++queued_;
     executor_.begin_invoke([=] {
-        try {
-            Execute(pCurrentCommand);
+        auto run = [=] {
+            try {
+                Execute(pCurrentCommand);
 
-            CASPAR_LOG(trace) << "Ready for a new command";
-        } catch (...) {
-            CASPAR_LOG_CURRENT_EXCEPTION();
+                CASPAR_LOG(trace) << "Ready for a new command";
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+            --queued_;
+        };
+
+        const auto layer = pCurrentCommand->layer_scope();
+        if (layer >= 0 && !layer_executors_.empty()) {
+            // The commands of a layer always go to the same executor, which keeps them in order.
+            const auto index = layer % layer_executors_.size();
+            auto&      lane  = layer_executors_[index];
+            if (!lane)
+                lane = std::make_unique<executor>(L"AMCPCommandQueue " + name_ + L" layers " + std::to_wstring(index));
+            layer_used_[index] = true;
+            lane->begin_invoke(std::move(run));
+            return;
+        }
+
+        // Everything queued before a command of the whole channel has finished before it runs, and nothing after it
+        // is handed out until it has finished.
+        for (std::size_t n = 0; n < layer_executors_.size(); ++n) {
+            if (layer_used_[n]) {
+                layer_executors_[n]->wait();
+                layer_used_[n] = false;
+            }
         }
+        run();
     });
 }
 
@@ -119,7 +176,7 @@ void AMCPCommandQueue::Execute(std::shared_ptr<AMCPGroupCommand> cmd) const
 
     // Shortcut for commands which are either not a batch, or don't need to be
     if (cmd->Commands().size() == 1) {
-        exec_cmd(cmd->Commands().at(0), channels_, true);
+        exec_cmd(cmd->Commands().at(0), channels_, true, replies_);
         return;
     }
 
@@ -140,12 +197,12 @@ void AMCPCommandQueue::Execute(std::shared_ptr<AMCPGroupCommand> cmd) const
 
         // 'execute' aka queue all comamnds
         for (auto& cmd2 : cmd->Commands()) {
-            results.push_back(exec_cmd(cmd2, delayed_channels, cmd->HasClient()));
+            results.push_back(exec_cmd(cmd2, delayed_channels, cmd->HasClient(), replies_));
         }
 
         // lock all the channels needed
         for (auto& st : delayed_stages) {
-            if (st->count_queued() == 0) {
+            if (st->count_queued() == 0 && !st->has_transforms()) {
                 continue;
             }
 
@@ -169,6 +226,29 @@ void AMCPCommandQueue::Execute(std::shared_ptr<AMCPGroupCommand> cmd) const
     for (auto& st : delayed_stages) {
         st->wait();
     }
+
+    // Hand the transforms of all channels over together, so that they land at the start of the same tick instead of
+    // one command at a time.
+    std::vector<core::stage::stage_transforms_t>      transforms;
+    std::vector<std::shared_ptr<core::stage_delayed>> transformed_stages;
+    for (auto& st : delayed_stages) {
+        if (st->has_transforms()) {
+            transforms.push_back(st->take_transforms());
+            transformed_stages.push_back(st);
+        }
+    }
+
+    std::exception_ptr error;
+    try {
+        if (!transforms.empty())
+            core::stage::apply_transforms(transforms).get();
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        error = std::current_exception();
+    }
+    for (auto& st : transformed_stages) {
+        st->transforms_applied(error);
+    }
     channel_locks.clear();
 
     int failed = 0;
@@ -26,22 +26,45 @@
 #include <common/executor.h>
 #include <common/memory.h>
 
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
 namespace caspar { namespace protocol { namespace amcp {
 
+// Runs the commands sent to a channel in the order they arrive. Commands that touch only their own layer run on one of
+// a few layer threads, so that a slow command on one layer doesn't hold up the others, while the commands of a layer
+// still run one after the other. Commands of the whole channel and batches wait for everything before them and run
+// by themselves.
 class AMCPCommandQueue
 {
   public:
     using ptr_type = spl::shared_ptr<AMCPCommandQueue>;
 
-    AMCPCommandQueue(const std::wstring& name, const spl::shared_ptr<std::vector<channel_context>>& channels);
+    AMCPCommandQueue(const std::wstring&                                  name,
+                     const spl::shared_ptr<std::vector<channel_context>>& channels,
+                     int                                                  layer_threads = 1);
     ~AMCPCommandQueue();
 
     void AddCommand(std::shared_ptr<AMCPGroupCommand> command);
     void Execute(std::shared_ptr<AMCPGroupCommand> cmd) const;
 
   private:
-    executor                                            executor_;
+    std::wstring                                        name_;
     const spl::shared_ptr<std::vector<channel_context>> channels_;
+    std::atomic<int>                                    queued_{0};
+
+    // Sends the replies of loads still running once they have finished, in the order the loads were issued. Before the
+    // layer executors, so it is only joined once nothing can hand it replies anymore.
+    mutable executor replies_;
+
+    // Created as they are first needed, only touched from executor_.
+    std::vector<std::unique_ptr<executor>> layer_executors_;
+    std::vector<bool>                      layer_used_; // since everything was last waited for
+
+    // Last, so that it stops handing out commands before the layer executors go away.
+    executor executor_;
 };
 
 }}} // namespace caspar::protocol::amcp
@@ -31,14 +31,20 @@
 #include "AMCPCommandQueue.h"
 #include "amcp_args.h"
 #include "amcp_command_repository.h"
+#include "data_store.h"
+#include "layer_loader.h"
+#include "media_index.h"
+#include "thumbnail_generator.h"
 
 #include <common/env.h>
 
 #include <common/base64.h>
+#include <common/diagnostics/trace.h>
 #include <common/filesystem.h>
 #include <common/future.h>
 #include <common/log.h>
 #include <common/os/filesystem.h>
+#include <common/os/thread.h>
 #include <common/param.h>
 
 #include <core/consumer/output.h>
@@ -107,72 +113,6 @@ namespace caspar { namespace protocol { namespace amcp {
 using namespace core;
 namespace pt = boost::property_tree;
 
-std::wstring read_utf8_file(const boost::filesystem::path& file)
-{
-    std::wstringstream           result;
-    boost::filesystem::wifstream filestream(file);
-
-    if (filestream) {
-        // Consume BOM first
-        filestream.get();
-        // read all data
-        result << filestream.rdbuf();
-    }
-
-    return result.str();
-}
-
-std::wstring read_latin1_file(const boost::filesystem::path& file)
-{
-    boost::locale::generator gen;
-    gen.locale_cache_enabled(true);
-#if BOOST_VERSION >= 108100
-    gen.categories(boost::locale::category_t::codepage);
-#else
-    gen.categories(boost::locale::codepage_facet);
-#endif
-
-    std::stringstream           result_stream;
-    boost::filesystem::ifstream filestream(file);
-    filestream.imbue(gen("en_US.ISO8859-1"));
-
-    if (filestream) {
-        // read all data
-        result_stream << filestream.rdbuf();
-    }
-
-    std::string  result = result_stream.str();
-    std::wstring widened_result;
-
-    // The first 255 codepoints in unicode is the same as in latin1
-    boost::copy(result | boost::adaptors::transformed([](char c) { return static_cast<unsigned char>(c); }),
-                std::back_inserter(widened_result));
-
-    return widened_result;
-}
-
-std::wstring read_file(const boost::filesystem::path& file)
-{
-    static const uint8_t BOM[] = {0xef, 0xbb, 0xbf};
-
-    if (!boost::filesystem::exists(file)) {
-        return L"";
-    }
-
-    if (boost::filesystem::file_size(file) >= 3) {
-        boost::filesystem::ifstream bom_stream(file);
-
-        char header[3];
-        bom_stream.read(header, 3);
-        bom_stream.close();
-
-        if (std::memcmp(BOM, header, 3) == 0)
-            return read_utf8_file(file);
-    }
-
-    return read_latin1_file(file);
-}
-
 std::wstring get_sub_directory(const std::wstring& base_folder, const std::wstring& sub_directory)
 {
     if (sub_directory.empty())
@@ -206,6 +146,29 @@ core::frame_producer_dependencies get_producer_dependencies(const std::shared_pt
                                              ctx.static_context->cg_registry);
 }
 
+// Refuses a producer that takes the memory held by all channels past configuration.memory.host-budget or
+// device-budget, in MB and 0 for none. Producers hold more once they have buffered, so this only stops loads once the
+// channels are already close to the budget.
+void check_memory_budget(const command_context& ctx, const frame_producer& producer)
+{
+    static const auto host_budget   = env::properties().get(L"configuration.memory.host-budget", 0) * 1024LL * 1024LL;
+    static const auto device_budget = env::properties().get(L"configuration.memory.device-budget", 0) * 1024LL * 1024LL;
+    if (host_budget <= 0 && device_budget <= 0)
+        return;
+
+    auto usage = producer.memory();
+    for (auto& cc : *ctx.channels) {
+        usage += cc.raw_channel->memory();
+    }
+
+    if (host_budget > 0 && usage.host > host_budget)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Memory host-budget exceeded, " +
+                                                        std::to_wstring(usage.host / (1024 * 1024)) + L" MB held"));
+    if (device_budget > 0 && usage.device > device_budget)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Memory device-budget exceeded, " +
+                                                        std::to_wstring(usage.device / (1024 * 1024)) + L" MB held"));
+}
+
 bool try_match_sting(const std::vector<std::wstring>& params, sting_info& stingInfo)
 {
     auto match = std::find_if(params.begin(), params.end(), param_comparer(L"STING"));
@@ -271,7 +234,41 @@ bool try_match_sting(const std::vector<std::wstring>& params, sting_info& stingI
 
 // Basic Commands
 
-std::wstring loadbg_command(command_context& ctx)
+// Runs load through the layer loader, so creating the producer doesn't hold up the commands queued behind it. Batches
+// still load on the queue, their stage operations only run once the whole batch has been released anyway.
+std::future<std::wstring>
+load_async(command_context& ctx, const std::wstring& reply, const std::function<void(command_context&)>& load)
+{
+    auto loader = ctx.static_context->loader;
+    if (!loader || std::dynamic_pointer_cast<core::stage_delayed>(ctx.channel.stage)) {
+        load(ctx);
+        return make_ready_future(reply);
+    }
+
+    auto reply_when_queued = loader->reply_when_queued();
+    auto task              = [context = ctx, reply, load, reply_when_queued] {
+        auto ctx = context;
+        try {
+            load(ctx);
+        } catch (...) {
+            if (!reply_when_queued)
+                throw;
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+        return reply;
+    };
+    auto result = loader->enqueue(ctx.channel_index, ctx.layer_index(), std::move(task));
+
+    return reply_when_queued ? make_ready_future(reply) : std::move(result);
+}
+
+void wait_for_loads(const command_context& ctx)
+{
+    if (auto loader = ctx.static_context->loader)
+        loader->wait(ctx.channel_index, ctx.layer_id);
+}
+
+void do_loadbg(command_context& ctx)
 {
     // Perform loading of the clip
     core::diagnostics::scoped_call_context save;
@@ -288,6 +285,8 @@ std::wstring loadbg_command(command_context& ctx)
         if (new_producer == frame_producer::empty())
             CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(!ctx.parameters.empty() ? ctx.parameters[0] : L""));
 
+        check_memory_budget(ctx, *new_producer);
+
         spl::shared_ptr<frame_producer> transition_producer = frame_producer::empty();
         transition_info                 transitionInfo;
         sting_info                      stingInfo;
@@ -316,23 +315,31 @@ std::wstring loadbg_command(command_context& ctx)
         }
         throw;
     }
-
-    return L"202 LOADBG OK\r\n";
 }
 
-std::wstring load_command(command_context& ctx)
+std::future<std::wstring> loadbg_command(command_context& ctx)
 {
-    core::diagnostics::scoped_call_context save;
-    core::diagnostics::call_context::for_thread().video_channel = ctx.channel_index + 1;
-    core::diagnostics::call_context::for_thread().layer         = ctx.layer_index();
+    return load_async(ctx, L"202 LOADBG OK\r\n", do_loadbg);
+}
 
+std::future<std::wstring> load_command(command_context& ctx)
+{
     if (ctx.parameters.empty()) {
         // Must be a promoting load
+        wait_for_loads(ctx);
         ctx.channel.stage->preview(ctx.layer_index());
-    } else {
+        return make_ready_future<std::wstring>(L"202 LOAD OK\r\n");
+    }
+
+    return load_async(ctx, L"202 LOAD OK\r\n", [](command_context& ctx) {
+        core::diagnostics::scoped_call_context save;
+        core::diagnostics::call_context::for_thread().video_channel = ctx.channel_index + 1;
+        core::diagnostics::call_context::for_thread().layer         = ctx.layer_index();
+
         try {
             auto new_producer = ctx.static_context->producer_registry->create_producer(
                 get_producer_dependencies(ctx.channel.raw_channel, ctx), ctx.parameters);
+            check_memory_budget(ctx, *new_producer);
             auto transition_producer = create_transition_producer(new_producer, transition_info{});
 
             ctx.channel.stage->load(ctx.layer_index(), transition_producer, true);
@@ -343,26 +350,29 @@ std::wstring load_command(command_context& ctx)
             }
             throw;
         }
-    }
-
-    return L"202 LOAD OK\r\n";
+    });
 }
 
-std::wstring play_command(command_context& ctx)
+std::future<std::wstring> play_command(command_context& ctx)
 {
-    try {
-        if (!ctx.parameters.empty())
-            loadbg_command(ctx);
-    } catch (file_not_found&) {
-        if (contains_param(L"CLEAR_ON_404", ctx.parameters)) {
-            ctx.channel.stage->play(ctx.layer_index());
-        }
-        throw;
+    if (ctx.parameters.empty()) {
+        wait_for_loads(ctx);
+        ctx.channel.stage->play(ctx.layer_index());
+        return make_ready_future<std::wstring>(L"202 PLAY OK\r\n");
     }
 
-    ctx.channel.stage->play(ctx.layer_index());
+    return load_async(ctx, L"202 PLAY OK\r\n", [](command_context& ctx) {
+        try {
+            do_loadbg(ctx);
+        } catch (file_not_found&) {
+            if (contains_param(L"CLEAR_ON_404", ctx.parameters)) {
+                ctx.channel.stage->play(ctx.layer_index());
+            }
+            throw;
+        }
 
-    return L"202 PLAY OK\r\n";
+        ctx.channel.stage->play(ctx.layer_index());
+    });
 }
 
 std::wstring pause_command(command_context& ctx)
@@ -540,7 +550,7 @@ std::wstring set_command(command_context& ctx)
     if (name == L"MODE") {
         auto format_desc = ctx.static_context->format_repository.find(value);
         if (format_desc.format != core::video_format::invalid) {
-            ctx.channel.raw_channel->stage()->video_format_desc(format_desc);
+            ctx.channel.raw_channel->switch_format(format_desc);
             return L"202 SET MODE OK\r\n";
         }
 
@@ -552,55 +562,21 @@ std::wstring set_command(command_context& ctx)
 
 std::wstring data_store_command(command_context& ctx)
 {
-    std::wstring filename = env::data_folder();
-    filename.append(ctx.parameters[0]);
-    filename.append(L".ftd");
-
-    auto data_path       = boost::filesystem::path(filename).parent_path().wstring();
-    auto found_data_path = find_case_insensitive(data_path);
-
-    if (found_data_path)
-        data_path = *found_data_path;
-
-    if (!boost::filesystem::exists(data_path))
-        boost::filesystem::create_directories(data_path);
-
-    auto found_filename = find_case_insensitive(filename);
-
-    if (found_filename)
-        filename = *found_filename; // Overwrite case insensitive.
-
-    boost::filesystem::wofstream datafile(filename);
-    if (!datafile)
-        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"Could not open file " + filename));
-
-    datafile << static_cast<wchar_t>(65279); // UTF-8 BOM character
-    datafile << ctx.parameters[1] << std::flush;
-    datafile.close();
+    ctx.static_context->data->store(ctx.parameters[0], ctx.parameters[1]);
 
     return L"202 DATA STORE OK\r\n";
 }
 
 std::wstring data_retrieve_command(command_context& ctx)
 {
-    std::wstring filename = env::data_folder();
-    filename.append(ctx.parameters[0]);
-    filename.append(L".ftd");
-
-    std::wstring file_contents;
-
-    auto found_file = find_case_insensitive(filename);
-
-    if (found_file)
-        file_contents = read_file(boost::filesystem::path(*found_file));
-
-    if (file_contents.empty())
-        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(filename + L" not found"));
+    auto file_contents = ctx.static_context->data->retrieve(ctx.parameters[0]);
+    if (!file_contents)
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(ctx.parameters[0] + L" not found"));
 
     std::wstringstream reply;
     reply << L"201 DATA RETRIEVE OK\r\n";
 
-    std::wstringstream file_contents_stream(file_contents);
+    std::wstringstream file_contents_stream(*file_contents);
     std::wstring       line;
 
     bool firstLine = true;
@@ -624,6 +600,9 @@ std::wstring data_list_command(command_context& ctx)
     if (!ctx.parameters.empty())
         sub_directory = ctx.parameters.at(0);
 
+    // The folder is listed, so it has to hold the latest stores and removes.
+    ctx.static_context->data->flush();
+
     std::wstringstream replyString;
     replyString << L"200 DATA LIST OK\r\n";
 
@@ -651,15 +630,8 @@ std::wstring data_list_command(command_context& ctx)
 
 std::wstring data_remove_command(command_context& ctx)
 {
-    std::wstring filename = env::data_folder();
-    filename.append(ctx.parameters[0]);
-    filename.append(L".ftd");
-
-    if (!boost::filesystem::exists(filename))
-        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(filename + L" not found"));
-
-    if (!boost::filesystem::remove(filename))
-        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(filename + L" could not be removed"));
+    if (!ctx.static_context->data->remove(ctx.parameters[0]))
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(ctx.parameters[0] + L" not found"));
 
     return L"202 DATA REMOVE OK\r\n";
 }
@@ -693,15 +665,9 @@ std::wstring cg_add_command(command_context& ctx)
         if (dataString.at(0) == L'<' || dataString.at(0) == L'{') // the data is XML or Json
             pDataString = dataString.c_str();
         else {
-            // The data is not an XML-string, it must be a filename
-            std::wstring filename = env::data_folder();
-            filename.append(dataString);
-            filename.append(L".ftd");
-
-            auto found_file = find_case_insensitive(filename);
-
-            if (found_file) {
-                dataFromFile = read_file(boost::filesystem::path(*found_file));
+            // The data is not an XML-string, it must be the name of a DATA entry
+            if (auto data = ctx.static_context->data->retrieve(dataString)) {
+                dataFromFile = std::move(*data);
                 pDataString  = dataFromFile.c_str();
             }
         }
@@ -780,12 +746,8 @@ std::wstring cg_update_command(command_context& ctx)
 
     std::wstring dataString = ctx.parameters.at(1);
     if (dataString.at(0) != L'<' && dataString.at(0) != L'{') {
-        // The data is not XML or Json, it must be a filename
-        std::wstring filename = env::data_folder();
-        filename.append(dataString);
-        filename.append(L".ftd");
-
-        dataString = read_file(boost::filesystem::path(filename));
+        // The data is not XML or Json, it must be the name of a DATA entry
+        dataString = ctx.static_context->data->retrieve(dataString).value_or(L"");
     }
 
     get_expected_cg_proxy(ctx)->update(layer, dataString);
@@ -1348,6 +1310,16 @@ std::wstring mixer_mastervolume_command(command_context& ctx)
     return L"202 MIXER OK\r\n";
 }
 
+std::wstring mixer_loudness_command(command_context& ctx)
+{
+    if (!boost::iequals(ctx.parameters.at(0), L"RESET")) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Expected RESET"));
+    }
+
+    ctx.channel.raw_channel->mixer().reset_loudness();
+    return L"202 MIXER OK\r\n";
+}
+
 std::wstring mixer_grid_command(command_context& ctx)
 {
     transforms_applier transforms(ctx);
@@ -1445,50 +1417,98 @@ std::wstring channel_grid_command(command_context& ctx)
 
 // Thumbnail Commands
 
-std::wstring make_request(command_context& ctx, const std::string& path, const std::wstring& default_response)
-{
-    auto res = http::request(ctx.static_context->proxy_host, ctx.static_context->proxy_port, path);
-    if (res.status_code >= 500 || res.body.size() == 0) {
-        CASPAR_LOG(error) << "Failed to connect to media-scanner. Is it running? \nReason: " << res.status_message;
-        return default_response;
-    }
-    return u16(res.body);
-}
-
-std::wstring thumbnail_list_command(command_context& ctx)
-{
+std::future<std::wstring>
+make_request(command_context& ctx, const std::string& path, const std::wstring& default_response)
+{
+    // The reply is completed from the http client thread, leaving the command queue free while the scanner answers.
+    auto promise = std::make_shared<std::promise<std::wstring>>();
+    http::request_async(ctx.static_context->proxy_host,
+                        ctx.static_context->proxy_port,
+                        path,
+                        [promise, default_response](std::exception_ptr error, http::HTTPResponse res) {
+                            if (error) {
+                                try {
+                                    std::rethrow_exception(error);
+                                } catch (...) {
+                                    CASPAR_LOG_CURRENT_EXCEPTION();
+                                }
+                                promise->set_value(default_response);
+                                return;
+                            }
+                            if (res.status_code >= 500 || res.body.size() == 0) {
+                                CASPAR_LOG(error) << "Failed to connect to media-scanner. Is it running? \nReason: "
+                                                  << res.status_message;
+                                promise->set_value(default_response);
+                                return;
+                            }
+                            promise->set_value(u16(res.body));
+                        });
+    return promise->get_future();
+}
+
+std::future<std::wstring> thumbnail_list_command(command_context& ctx)
+{
+    auto thumbnails = ctx.static_context->thumbnails;
+    if (thumbnails && thumbnails->available())
+        return make_ready_future(thumbnails->list());
     return make_request(ctx, "/thumbnail", L"501 THUMBNAIL LIST FAILED\r\n");
 }
 
-std::wstring thumbnail_retrieve_command(command_context& ctx)
+std::future<std::wstring> thumbnail_retrieve_command(command_context& ctx)
 {
+    auto thumbnails = ctx.static_context->thumbnails;
+    if (thumbnails && thumbnails->available())
+        return make_ready_future(thumbnails->retrieve(ctx.parameters.at(0)));
     return make_request(
         ctx, "/thumbnail/" + http::url_encode(u8(ctx.parameters.at(0))), L"501 THUMBNAIL RETRIEVE FAILED\r\n");
 }
 
-std::wstring thumbnail_generate_command(command_context& ctx)
+std::future<std::wstring> thumbnail_generate_command(command_context& ctx)
 {
+    auto thumbnails = ctx.static_context->thumbnails;
+    if (thumbnails && thumbnails->available())
+        return thumbnails->generate(ctx.parameters.at(0));
     return make_request(
         ctx, "/thumbnail/generate/" + http::url_encode(u8(ctx.parameters.at(0))), L"501 THUMBNAIL GENERATE FAILED\r\n");
 }
 
-std::wstring thumbnail_generateall_command(command_context& ctx)
+std::future<std::wstring> thumbnail_generateall_command(command_context& ctx)
 {
+    auto thumbnails = ctx.static_context->thumbnails;
+    if (thumbnails && thumbnails->available())
+        return thumbnails->generate_all();
     return make_request(ctx, "/thumbnail/generate", L"501 THUMBNAIL GENERATE_ALL FAILED\r\n");
 }
 
 // Query Commands
 
-std::wstring cinf_command(command_context& ctx)
+std::future<std::wstring> cinf_command(command_context& ctx)
 {
+    if (ctx.static_context->media_index)
+        return make_ready_future(ctx.static_context->media_index->cinf(ctx.parameters.at(0)));
     return make_request(ctx, "/cinf/" + http::url_encode(u8(ctx.parameters.at(0))), L"501 CINF FAILED\r\n");
 }
 
-std::wstring cls_command(command_context& ctx) { return make_request(ctx, "/cls", L"501 CLS FAILED\r\n"); }
+std::future<std::wstring> cls_command(command_context& ctx)
+{
+    if (ctx.static_context->media_index)
+        return make_ready_future(ctx.static_context->media_index->cls());
+    return make_request(ctx, "/cls", L"501 CLS FAILED\r\n");
+}
 
-std::wstring fls_command(command_context& ctx) { return make_request(ctx, "/fls", L"501 FLS FAILED\r\n"); }
+std::future<std::wstring> fls_command(command_context& ctx)
+{
+    if (ctx.static_context->media_index)
+        return make_ready_future(ctx.static_context->media_index->fls());
+    return make_request(ctx, "/fls", L"501 FLS FAILED\r\n");
+}
 
-std::wstring tls_command(command_context& ctx) { return make_request(ctx, "/tls", L"501 TLS FAILED\r\n"); }
+std::future<std::wstring> tls_command(command_context& ctx)
+{
+    if (ctx.static_context->media_index)
+        return make_ready_future(ctx.static_context->media_index->tls());
+    return make_request(ctx, "/tls", L"501 TLS FAILED\r\n");
+}
 
 std::wstring version_command(command_context& ctx) { return L"201 VERSION OK\r\n" + env::version() + L"\r\n"; }
 
@@ -1530,7 +1550,7 @@ std::wstring info_channel_command(command_context& ctx)
 
     auto state = ctx.channel.raw_channel->state();
     for (const auto& p : state) {
-        const auto replaced = boost::algorithm::replace_all_copy(p.first, "/", ".");
+        const auto replaced = boost::algorithm::replace_all_copy(p.first.str(), "/", ".");
         // avoid digit-only nodes in XML
         const auto path = boost::algorithm::replace_all_regex_copy(
             replaced, boost::regex("\\.(.*?)\\.([0-9]*?)\\."), std::string(".$1.$1_$2."));
@@ -1601,6 +1621,65 @@ std::wstring info_paths_command(command_context& ctx)
     return replyString.str();
 }
 
+std::wstring info_startup_command(command_context& ctx)
+{
+    boost::property_tree::wptree info;
+
+    auto& startup = info.add_child(L"startup", boost::property_tree::wptree());
+    for (auto& component : ctx.static_context->startup->components()) {
+        auto& node = startup.add_child(L"component", boost::property_tree::wptree());
+        node.add(L"name", component.first);
+        node.add(L"seconds", component.second);
+    }
+
+    std::wstringstream replyString;
+    replyString << L"201 INFO STARTUP OK\r\n";
+
+    pt::xml_writer_settings<std::wstring> w(' ', 3);
+    pt::xml_parser::write_xml(replyString, info, w);
+
+    replyString << L"\r\n";
+    return replyString.str();
+}
+
+void add_thread_usage(boost::property_tree::wptree& node, const thread_usage& usage)
+{
+    node.add(L"name", usage.name);
+    node.add(L"user-seconds", usage.user_seconds);
+    node.add(L"system-seconds", usage.system_seconds);
+    node.add(L"voluntary-switches", usage.voluntary_switches);
+    node.add(L"involuntary-switches", usage.involuntary_switches);
+    node.add(L"run-delay-seconds", usage.run_delay_seconds);
+}
+
+std::wstring info_threads_command(command_context& ctx)
+{
+    boost::property_tree::wptree info;
+
+    const auto threads = thread_usages();
+
+    // The totals include threads that have exited, the threads are those running now.
+    auto& root = info.add_child(L"threads", boost::property_tree::wptree());
+    for (auto& total : subsystem_usages(threads)) {
+        auto& subsystem = root.add_child(L"subsystem", boost::property_tree::wptree());
+        add_thread_usage(subsystem, total);
+        for (auto& usage : threads) {
+            if (usage.subsystem == total.subsystem) {
+                add_thread_usage(subsystem.add_child(L"thread", boost::property_tree::wptree()), usage);
+            }
+        }
+    }
+
+    std::wstringstream replyString;
+    replyString << L"201 INFO THREADS OK\r\n";
+
+    pt::xml_writer_settings<std::wstring> w(' ', 3);
+    pt::xml_parser::write_xml(replyString, info, w);
+
+    replyString << L"\r\n";
+    return replyString.str();
+}
+
 std::wstring diag_command(command_context& ctx)
 {
     core::diagnostics::osd::show_graphs(true);
@@ -1608,6 +1687,32 @@ std::wstring diag_command(command_context& ctx)
     return L"202 DIAG OK\r\n";
 }
 
+std::wstring diag_trace_command(command_context& ctx)
+{
+    auto action = boost::to_upper_copy(ctx.parameters.at(0));
+
+    if (action == L"START") {
+        auto capacity = ctx.parameters.size() > 1 ? boost::lexical_cast<std::size_t>(ctx.parameters.at(1)) : 65536;
+        caspar::diagnostics::trace::set_capacity(capacity);
+        return L"202 DIAG TRACE OK\r\n";
+    }
+
+    if (action == L"STOP") {
+        caspar::diagnostics::trace::set_capacity(0);
+        return L"202 DIAG TRACE OK\r\n";
+    }
+
+    if (action == L"DUMP") {
+        auto seconds  = ctx.parameters.size() > 1 ? boost::lexical_cast<double>(ctx.parameters.at(1)) : 0.0;
+        auto filename = env::log_folder() + L"trace_" +
+                        boost::posix_time::to_iso_wstring(boost::posix_time::second_clock::local_time()) + L".json";
+        caspar::diagnostics::trace::write(filename, seconds);
+        return L"201 DIAG TRACE OK\r\n" + filename + L"\r\n";
+    }
+
+    return L"403 DIAG TRACE ERROR\r\n";
+}
+
 std::wstring bye_command(command_context& ctx)
 {
     ctx.client->disconnect();
@@ -1616,13 +1721,16 @@ std::wstring bye_command(command_context& ctx)
 
 std::wstring kill_command(command_context& ctx)
 {
-    ctx.static_context->shutdown_server_now(false); // false for not attempting to restart
+    ctx.static_context->shutdown_server_now(shutdown_mode::exit);
     return L"202 KILL OK\r\n";
 }
 
 std::wstring restart_command(command_context& ctx)
 {
-    ctx.static_context->shutdown_server_now(true); // true for attempting to restart
+    // RESTART WARM reloads the configuration without letting go of the gpu devices, their pools and compiled
+    // shaders, and the modules with what they have cached.
+    auto warm = !ctx.parameters.empty() && boost::iequals(ctx.parameters.at(0), L"WARM");
+    ctx.static_context->shutdown_server_now(warm ? shutdown_mode::warm_restart : shutdown_mode::restart);
     return L"202 RESTART OK\r\n";
 }
 
@@ -1711,8 +1819,13 @@ std::wstring osc_subscribe_command(command_context& ctx)
         return L"403 OSC SUBSCRIBE BAD PORT\r\n";
     }
 
+    // Any further parameters are the address prefixes this subscription is limited to.
+    std::vector<std::string> prefixes;
+    for (size_t n = 1; n < ctx.parameters.size(); ++n)
+        prefixes.push_back(u8(ctx.parameters[n]));
+
     auto subscription = ctx.static_context->osc_client->get_subscription_token(
-        udp::endpoint(address_v4::from_string(u8(ctx.client->address())), port));
+        udp::endpoint(address_v4::from_string(u8(ctx.client->address())), port), std::move(prefixes));
 
     ctx.client->add_lifecycle_bound_object(get_osc_subscription_token(port), subscription);
 
@@ -1735,10 +1848,10 @@ std::wstring osc_unsubscribe_command(command_context& ctx)
 
 void register_commands(std::shared_ptr<amcp_command_repository_wrapper>& repo)
 {
-    repo->register_channel_command(L"Basic Commands", L"LOADBG", loadbg_command, 1);
+    repo->register_load_command(L"Basic Commands", L"LOADBG", loadbg_command, 1);
     repo->register_channel_command(L"Basic Commands", L"CALLBG", callbg_command, 1);
-    repo->register_channel_command(L"Basic Commands", L"LOAD", load_command, 0);
-    repo->register_channel_command(L"Basic Commands", L"PLAY", play_command, 0);
+    repo->register_load_command(L"Basic Commands", L"LOAD", load_command, 0);
+    repo->register_load_command(L"Basic Commands", L"PLAY", play_command, 0);
     repo->register_channel_command(L"Basic Commands", L"PAUSE", pause_command, 0);
     repo->register_channel_command(L"Basic Commands", L"RESUME", resume_command, 0);
     repo->register_channel_command(L"Basic Commands", L"STOP", stop_command, 0);
@@ -1785,6 +1898,7 @@ void register_commands(std::shared_ptr<amcp_command_repository_wrapper>& repo)
     repo->register_channel_command(L"Mixer Commands", L"MIXER PERSPECTIVE", mixer_perspective_command, 0);
     repo->register_channel_command(L"Mixer Commands", L"MIXER VOLUME", mixer_volume_command, 0);
     repo->register_channel_command(L"Mixer Commands", L"MIXER MASTERVOLUME", mixer_mastervolume_command, 0);
+    repo->register_channel_command(L"Mixer Commands", L"MIXER LOUDNESS", mixer_loudness_command, 1);
     repo->register_channel_command(L"Mixer Commands", L"MIXER GRID", mixer_grid_command, 1);
     repo->register_channel_command(L"Mixer Commands", L"MIXER COMMIT", mixer_commit_command, 0);
     repo->register_channel_command(L"Mixer Commands", L"MIXER CLEAR", mixer_clear_command, 0);
@@ -1801,6 +1915,7 @@ void register_commands(std::shared_ptr<amcp_command_repository_wrapper>& repo)
     repo->register_command(L"Query Commands", L"TLS", tls_command, 0);
     repo->register_command(L"Query Commands", L"VERSION", version_command, 0);
     repo->register_command(L"Query Commands", L"DIAG", diag_command, 0);
+    repo->register_command(L"Query Commands", L"DIAG TRACE", diag_trace_command, 1);
     repo->register_command(L"Query Commands", L"BYE", bye_command, 0);
     repo->register_command(L"Query Commands", L"KILL", kill_command, 0);
     repo->register_command(L"Query Commands", L"RESTART", restart_command, 0);
@@ -1808,6 +1923,8 @@ void register_commands(std::shared_ptr<amcp_command_repository_wrapper>& repo)
     repo->register_command(L"Query Commands", L"INFO", info_command, 0);
     repo->register_command(L"Query Commands", L"INFO CONFIG", info_config_command, 0);
     repo->register_command(L"Query Commands", L"INFO PATHS", info_paths_command, 0);
+    repo->register_command(L"Query Commands", L"INFO STARTUP", info_startup_command, 0);
+    repo->register_command(L"Query Commands", L"INFO THREADS", info_threads_command, 0);
     repo->register_command(L"Query Commands", L"GL INFO", gl_info_command, 0);
     repo->register_command(L"Query Commands", L"GL GC", gl_gc_command, 0);
 
@@ -27,17 +27,22 @@
 #include "amcp_command_context.h"
 #include "amcp_command_repository.h"
 #include "amcp_shared.h"
+#include "command_recorder.h"
 #include "protocol/util/strategy_adapters.h"
 #include "protocol/util/tokenize.h"
 
 #include "../util/tokenize.h"
 
 #include <algorithm>
+#include <iterator>
+#include <string_view>
+#include <vector>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/log/keywords/delimiter.hpp>
 
 #include <common/diagnostics/graph.h>
+#include <common/env.h>
 
 #if defined(_MSC_VER)
 #pragma warning(push, 1) // TODO: Legacy code, just disable warnings
@@ -99,9 +104,10 @@ class AMCPProtocolStrategy
     {
         commandQueues_.push_back(spl::make_shared<AMCPCommandQueue>(L"General Queue for " + name, repo_->channels()));
 
+        const auto layer_threads = env::properties().get(L"configuration.amcp.layer-threads", 4);
         for (auto& ch : *repo_->channels()) {
-            auto queue = spl::make_shared<AMCPCommandQueue>(
-                L"Channel " + std::to_wstring(ch.raw_channel->index()) + L" for " + name, repo_->channels());
+            auto queue_name = L"Channel " + std::to_wstring(ch.raw_channel->index()) + L" for " + name;
+            auto queue      = spl::make_shared<AMCPCommandQueue>(queue_name, repo_->channels(), layer_threads);
             std::weak_ptr<AMCPCommandQueue> queue_weak = queue;
             commandQueues_.push_back(queue);
         }
@@ -124,16 +130,18 @@ class AMCPProtocolStrategy
     void
     parse(const std::wstring& message, const ClientInfoPtr& client, const std::shared_ptr<AMCPClientBatchInfo>& batch)
     {
-        std::list<std::wstring> tokens;
-        IO::tokenize(message, tokens);
+        // Reused for every line parsed on this thread, the tokens are views into the storage.
+        thread_local std::vector<std::wstring_view> tokens;
+        thread_local std::wstring                   storage;
+        tokens.clear();
+        IO::tokenize(message, tokens, storage);
 
         if (!tokens.empty() && boost::iequals(tokens.front(), L"PING")) {
-            tokens.pop_front();
             std::wstringstream answer;
             answer << L"PONG";
 
-            for (auto t : tokens)
-                answer << L" " << t;
+            for (auto it = std::next(tokens.begin()); it != tokens.end(); ++it)
+                answer << L" " << *it;
 
             answer << "\r\n";
             client->send(answer.str(), true);
@@ -142,9 +150,9 @@ class AMCPProtocolStrategy
 
         CASPAR_LOG(info) << L"Received message from " << client->address() << ": " << message << L"\\r\\n";
 
-        std::wstring request_id;
-        std::wstring command_name;
-        error_state  err = parse_command_string(client, batch, tokens, request_id, command_name);
+        std::wstring      request_id;
+        std::wstring_view command_name;
+        error_state       err = parse_command_string(client, batch, tokens, request_id, command_name);
         if (err != error_state::no_error) {
             std::wstringstream answer;
 
@@ -156,13 +164,13 @@ class AMCPProtocolStrategy
                     answer << L"400 ERROR\r\n" << message << "\r\n";
                     break;
                 case error_state::channel_error:
-                    answer << L"401 " << command_name << " ERROR\r\n";
+                    answer << L"401 " << boost::to_upper_copy(std::wstring(command_name)) << " ERROR\r\n";
                     break;
                 case error_state::parameters_error:
-                    answer << L"402 " << command_name << " ERROR\r\n";
+                    answer << L"402 " << boost::to_upper_copy(std::wstring(command_name)) << " ERROR\r\n";
                     break;
                 case error_state::access_error:
-                    answer << L"503 " << command_name << " FAILED\r\n";
+                    answer << L"503 " << boost::to_upper_copy(std::wstring(command_name)) << " FAILED\r\n";
                     break;
                 case error_state::unknown_error:
                     answer << L"500 FAILED\r\n";
@@ -178,14 +186,14 @@ class AMCPProtocolStrategy
   private:
     error_state parse_command_string(const ClientInfoPtr&                        client,
                                      const std::shared_ptr<AMCPClientBatchInfo>& batch,
-                                     std::list<std::wstring>                     tokens,
+                                     std::vector<std::wstring_view>&             tokens,
                                      std::wstring&                               request_id,
-                                     std::wstring&                               command_name)
+                                     std::wstring_view&                          command_name)
     {
         try {
             // Discard GetSwitch
             if (!tokens.empty() && tokens.front().at(0) == L'/')
-                tokens.pop_front();
+                tokens.erase(tokens.begin());
 
             error_state error = parse_request_token(tokens, request_id);
             if (error != error_state::no_error) {
@@ -201,7 +209,7 @@ class AMCPProtocolStrategy
                 return error;
             }
 
-            command_name                               = boost::to_upper_copy(tokens.front());
+            command_name                               = tokens.front();
             const std::shared_ptr<AMCPCommand> command = repo_->parse_command(client, tokens, request_id);
             if (!command) {
                 return error_state::command_error;
@@ -230,26 +238,39 @@ class AMCPProtocolStrategy
         }
     }
 
-    static error_state parse_request_token(std::list<std::wstring>& tokens, std::wstring& request_id)
+    static error_state parse_request_token(std::vector<std::wstring_view>& tokens, std::wstring& request_id)
     {
         if (tokens.empty() || !boost::iequals(tokens.front(), L"REQ")) {
             return error_state::no_error;
         }
 
-        tokens.pop_front();
-
-        if (tokens.empty()) {
+        if (tokens.size() < 2) {
+            tokens.clear();
             return error_state::parameters_error;
         }
 
-        request_id = std::move(tokens.front());
-        tokens.pop_front();
+        request_id = tokens[1];
+        tokens.erase(tokens.begin(), tokens.begin() + 2);
 
         return error_state::no_error;
     }
 
+    static int batch_channel(const AMCPGroupCommand& group)
+    {
+        const auto commands = group.Commands();
+        if (commands.empty())
+            return -1;
+
+        const auto channel_index = commands.front()->channel_index();
+        for (auto& command : commands) {
+            if (command->channel_index() != channel_index)
+                return -1;
+        }
+        return channel_index;
+    }
+
     bool parse_batch_commands(const std::shared_ptr<AMCPClientBatchInfo>& batch,
-                              std::list<std::wstring>&                    tokens,
+                              const std::vector<std::wstring_view>&       tokens,
                               std::wstring&                               request_id,
                               error_state&                                error)
     {
@@ -259,7 +280,10 @@ class AMCPProtocolStrategy
                 return true;
             }
 
-            commandQueues_.at(0)->AddCommand(std::move(batch->finish()));
+            // A batch of a single channel waits on its queue for the commands sent to the channel before it, and holds
+            // up the ones after it. Batches for several channels run on the general queue.
+            auto group = batch->finish();
+            commandQueues_.at(batch_channel(*group) + 1)->AddCommand(std::move(group));
             error = error_state::no_error;
             return true;
         }
@@ -293,41 +317,57 @@ class AMCPClientStrategy : public IO::protocol_strategy<wchar_t>
     const std::shared_ptr<AMCPProtocolStrategy> strategy_;
     const std::shared_ptr<AMCPClientBatchInfo>  batch_;
     ClientInfoPtr                               client_info_;
+    const std::shared_ptr<command_recorder>     recorder_;
+    const int                                   connection_;
 
   public:
     AMCPClientStrategy(const std::shared_ptr<AMCPProtocolStrategy>& strategy,
-                       const IO::client_connection<wchar_t>::ptr&   client_connection)
+                       const IO::client_connection<wchar_t>::ptr&   client_connection,
+                       const std::shared_ptr<command_recorder>&     recorder)
         : strategy_(strategy)
         , batch_(std::make_shared<AMCPClientBatchInfo>(client_connection))
         , client_info_(client_connection)
+        , recorder_(recorder)
+        , connection_(recorder ? recorder->add_connection(client_connection->address()) : 0)
     {
     }
 
-    void parse(const std::basic_string<wchar_t>& data) override { strategy_->parse(data, client_info_, batch_); }
+    void parse(const std::basic_string<wchar_t>& data) override
+    {
+        if (recorder_)
+            recorder_->record(connection_, data);
+
+        strategy_->parse(data, client_info_, batch_);
+    }
 };
 
 class amcp_client_strategy_factory : public IO::protocol_strategy_factory<wchar_t>
 {
   public:
-    explicit amcp_client_strategy_factory(const std::shared_ptr<AMCPProtocolStrategy>& strategy)
+    amcp_client_strategy_factory(const std::shared_ptr<AMCPProtocolStrategy>& strategy,
+                                 std::shared_ptr<command_recorder>            recorder)
         : strategy_(strategy)
+        , recorder_(std::move(recorder))
     {
     }
 
     IO::protocol_strategy<wchar_t>::ptr create(const IO::client_connection<wchar_t>::ptr& client_connection) override
     {
-        return spl::make_shared<AMCPClientStrategy>(strategy_, client_connection);
+        return spl::make_shared<AMCPClientStrategy>(strategy_, client_connection, recorder_);
     }
 
   private:
     const std::shared_ptr<AMCPProtocolStrategy> strategy_;
+    const std::shared_ptr<command_recorder>     recorder_;
 };
 
 IO::protocol_strategy_factory<char>::ptr
-create_char_amcp_strategy_factory(const std::wstring& name, const spl::shared_ptr<amcp_command_repository>& repo)
+create_char_amcp_strategy_factory(const std::wstring&                             name,
+                                  const spl::shared_ptr<amcp_command_repository>& repo,
+                                  std::shared_ptr<command_recorder>               recorder)
 {
     auto amcp_strategy = spl::make_shared<AMCPProtocolStrategy>(name, repo);
-    auto amcp_client   = spl::make_shared<amcp_client_strategy_factory>(amcp_strategy);
+    auto amcp_client   = spl::make_shared<amcp_client_strategy_factory>(amcp_strategy, std::move(recorder));
     auto to_unicode    = spl::make_shared<IO::to_unicode_adapter_factory>("UTF-8", amcp_client);
     return spl::make_shared<IO::delimiter_based_chunking_strategy_factory<char>>("\r\n", to_unicode);
 }
@@ -336,7 +376,7 @@ IO::protocol_strategy_factory<wchar_t>::ptr
 create_wchar_amcp_strategy_factory(const std::wstring& name, const spl::shared_ptr<amcp_command_repository>& repo)
 {
     auto amcp_strategy = spl::make_shared<AMCPProtocolStrategy>(name, repo);
-    auto amcp_client   = spl::make_shared<amcp_client_strategy_factory>(amcp_strategy);
+    auto amcp_client   = spl::make_shared<amcp_client_strategy_factory>(amcp_strategy, nullptr);
     return spl::make_shared<IO::delimiter_based_chunking_strategy_factory<wchar_t>>(L"\r\n", amcp_client);
 }
 
@@ -27,12 +27,18 @@
 
 #include "amcp_command_repository.h"
 
+#include <memory>
 #include <string>
 
 namespace caspar { namespace protocol { namespace amcp {
 
+class command_recorder;
+
+// Commands received through the factory are recorded when given a recorder.
 IO::protocol_strategy_factory<char>::ptr
-create_char_amcp_strategy_factory(const std::wstring& name, const spl::shared_ptr<amcp_command_repository>& repo);
+create_char_amcp_strategy_factory(const std::wstring&                             name,
+                                  const spl::shared_ptr<amcp_command_repository>& repo,
+                                  std::shared_ptr<command_recorder>               recorder = nullptr);
 
 IO::protocol_strategy_factory<wchar_t>::ptr
 create_wchar_amcp_strategy_factory(const std::wstring& name, const spl::shared_ptr<amcp_command_repository>& repo);
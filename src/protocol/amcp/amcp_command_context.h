@@ -28,12 +28,47 @@
 #include <common/forward.h>
 #include <core/consumer/frame_consumer.h>
 #include <future>
+#include <mutex>
+#include <string>
 #include <utility>
+#include <vector>
 
 FORWARD3(caspar, protocol, osc, class client);
+FORWARD3(caspar, protocol, amcp, class data_store);
+FORWARD3(caspar, protocol, amcp, class layer_loader);
+FORWARD3(caspar, protocol, amcp, class media_index);
+FORWARD3(caspar, protocol, amcp, class thumbnail_generator);
 
 namespace caspar { namespace protocol { namespace amcp {
 
+enum class shutdown_mode
+{
+    exit,
+    restart,      // the process exits with code 5 for a script to start it again
+    warm_restart, // the server is replaced in process, keeping the gpu devices and modules
+};
+
+// How long the server took to bring up each channel and consumer, filled in as they start and reported by INFO
+// STARTUP.
+class startup_report
+{
+    mutable std::mutex                           mutex_;
+    std::vector<std::pair<std::wstring, double>> components_;
+
+  public:
+    void add(std::wstring component, double seconds)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        components_.emplace_back(std::move(component), seconds);
+    }
+
+    std::vector<std::pair<std::wstring, double>> components() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return components_;
+    }
+};
+
 struct amcp_command_static_context
 {
     const core::video_format_repository                        format_repository;
@@ -41,22 +76,32 @@ struct amcp_command_static_context
     const spl::shared_ptr<const core::frame_producer_registry> producer_registry;
     const spl::shared_ptr<const core::frame_consumer_registry> consumer_registry;
     const std::shared_ptr<amcp_command_repository>             parser;
-    std::function<void(bool)>                                  shutdown_server_now;
+    std::function<void(shutdown_mode)>                         shutdown_server_now;
     const std::string                                          proxy_host;
     const std::string                                          proxy_port;
     std::weak_ptr<accelerator::accelerator_device>             ogl_device;
     const spl::shared_ptr<osc::client>                         osc_client;
+    const std::shared_ptr<amcp::media_index>                   media_index;
+    const std::shared_ptr<amcp::thumbnail_generator>           thumbnails;
+    const std::shared_ptr<amcp::layer_loader>                  loader;
+    const spl::shared_ptr<const startup_report>                startup;
+    const spl::shared_ptr<amcp::data_store>                    data;
 
     amcp_command_static_context(core::video_format_repository                               format_repository,
                                 const spl::shared_ptr<core::cg_producer_registry>&          cg_registry,
                                 const spl::shared_ptr<const core::frame_producer_registry>& producer_registry,
                                 const spl::shared_ptr<const core::frame_consumer_registry>& consumer_registry,
                                 std::shared_ptr<amcp_command_repository>                    parser,
-                                std::function<void(bool)>                                   shutdown_server_now,
+                                std::function<void(shutdown_mode)>                          shutdown_server_now,
                                 std::string                                                 proxy_host,
                                 std::string                                                 proxy_port,
                                 std::weak_ptr<accelerator::accelerator_device>              ogl_device,
-                                const spl::shared_ptr<osc::client>&                         osc_client)
+                                const spl::shared_ptr<osc::client>&                         osc_client,
+                                std::shared_ptr<amcp::media_index>                          media_index,
+                                std::shared_ptr<amcp::thumbnail_generator>                  thumbnails,
+                                std::shared_ptr<amcp::layer_loader>                         loader,
+                                spl::shared_ptr<const startup_report>                       startup,
+                                spl::shared_ptr<amcp::data_store>                           data)
         : format_repository(std::move(format_repository))
         , cg_registry(cg_registry)
         , producer_registry(producer_registry)
@@ -67,6 +112,11 @@ struct amcp_command_static_context
         , proxy_port(std::move(proxy_port))
         , ogl_device(std::move(ogl_device))
         , osc_client(osc_client)
+        , media_index(std::move(media_index))
+        , thumbnails(std::move(thumbnails))
+        , loader(std::move(loader))
+        , startup(std::move(startup))
+        , data(std::move(data))
     {
     }
 };
@@ -26,172 +26,231 @@
 #include <common/env.h>
 
 #include <boost/algorithm/string.hpp>
-#include <boost/lexical_cast.hpp>
 
-#include <map>
+#include <algorithm>
+#include <cstdint>
+#include <cwctype>
+#include <string_view>
+#include <vector>
 
 namespace caspar { namespace protocol { namespace amcp {
 
-AMCPCommand::ptr_type make_cmd(amcp_command_func        func,
-                               const std::wstring&      name,
-                               const std::wstring&      id,
-                               IO::ClientInfoPtr        client,
-                               unsigned int             channel_index,
-                               int                      layer_index,
-                               std::list<std::wstring>& tokens)
+// Commands keyed by their full name, like "MIXER FILL". Lookups take the name and subcommand tokens of a line as they
+// are and hash and compare them case insensitively, so finding a command neither copies nor upper cases anything.
+// The table is probed linearly and rebuilt on registration, which only happens at startup.
+class command_table
 {
-    const std::vector<std::wstring> parameters(tokens.begin(), tokens.end());
-    const command_context_simple    ctx(std::move(client), channel_index, layer_index, std::move(parameters));
+  public:
+    struct entry
+    {
+        std::wstring      name;
+        amcp_command_func func;
+        int               min_num_params;
+    };
 
-    return std::make_shared<AMCPCommand>(ctx, func, name, id);
-}
+    void insert(std::wstring name, amcp_command_func func, int min_num_params)
+    {
+        boost::to_upper(name);
+
+        if (find(name, {}))
+            return;
+
+        entries_.push_back(entry{std::move(name), std::move(func), min_num_params});
+
+        slots_.assign(std::max<std::size_t>(16, entries_.size() * 4), -1);
+        for (int n = 0; n < static_cast<int>(entries_.size()); ++n) {
+            auto slot = hash(entries_[n].name, {}) % slots_.size();
+            while (slots_[slot] != -1)
+                slot = (slot + 1) % slots_.size();
+            slots_[slot] = n;
+        }
+    }
+
+    const entry* find(std::wstring_view name, std::wstring_view subcommand) const
+    {
+        if (slots_.empty())
+            return nullptr;
+
+        for (auto slot = hash(name, subcommand) % slots_.size(); slots_[slot] != -1;
+             slot      = (slot + 1) % slots_.size()) {
+            const auto& entry = entries_[slots_[slot]];
+            if (equals(entry.name, name, subcommand))
+                return &entry;
+        }
+
+        return nullptr;
+    }
+
+  private:
+    static wchar_t fold(wchar_t c) { return c >= L'a' && c <= L'z' ? static_cast<wchar_t>(c - L'a' + L'A') : c; }
+
+    static std::uint64_t hash(std::uint64_t h, std::wstring_view str)
+    {
+        for (auto c : str)
+            h = (h ^ static_cast<std::uint64_t>(fold(c))) * 1099511628211ULL;
+        return h;
+    }
+
+    static std::size_t hash(std::wstring_view name, std::wstring_view subcommand)
+    {
+        auto h = hash(14695981039346656037ULL, name);
+        if (!subcommand.empty())
+            h = hash(hash(h, L" "), subcommand);
+        return static_cast<std::size_t>(h);
+    }
+
+    static bool equals_folded(std::wstring_view key, std::wstring_view str)
+    {
+        return key.size() == str.size() &&
+               std::equal(key.begin(), key.end(), str.begin(), [](wchar_t a, wchar_t b) { return a == fold(b); });
+    }
+
+    static bool equals(const std::wstring& key, std::wstring_view name, std::wstring_view subcommand)
+    {
+        if (subcommand.empty())
+            return equals_folded(key, name);
+
+        return key.size() == name.size() + 1 + subcommand.size() && key[name.size()] == L' ' &&
+               equals_folded(std::wstring_view(key).substr(0, name.size()), name) &&
+               equals_folded(std::wstring_view(key).substr(name.size() + 1), subcommand);
+    }
 
-AMCPCommand::ptr_type find_command(const std::map<std::wstring, std::pair<amcp_command_func, int>>& commands,
-                                   const std::wstring&                                              name,
-                                   const std::wstring&                                              request_id,
-                                   IO::ClientInfoPtr                                                client,
-                                   int                                                              channel_index,
-                                   int                                                              layer_index,
-                                   std::list<std::wstring>&                                         tokens)
+    std::vector<entry> entries_;
+    std::vector<int>   slots_;
+};
+
+using token_list = std::vector<std::wstring_view>;
+
+AMCPCommand::ptr_type make_cmd(const command_table::entry& command,
+                               const std::wstring&         id,
+                               IO::ClientInfoPtr           client,
+                               unsigned int                channel_index,
+                               int                         layer_index,
+                               const token_list&           tokens,
+                               std::size_t                 first)
 {
-    std::wstring subcommand;
+    // The command runs asynchronously, so this is where the parameters get their own storage.
+    std::vector<std::wstring> parameters(tokens.begin() + first, tokens.end());
+    command_context_simple    ctx(std::move(client), channel_index, layer_index, std::move(parameters));
 
-    if (!tokens.empty())
-        subcommand = boost::to_upper_copy(tokens.front());
+    return std::make_shared<AMCPCommand>(ctx, command.func, command.name, id);
+}
 
+AMCPCommand::ptr_type find_command(const command_table& commands,
+                                   std::wstring_view    name,
+                                   const std::wstring&  request_id,
+                                   IO::ClientInfoPtr    client,
+                                   int                  channel_index,
+                                   int                  layer_index,
+                                   const token_list&    tokens,
+                                   std::size_t          first)
+{
     // Start with subcommand syntax like MIXER CLEAR etc
-    if (!subcommand.empty()) {
-        const auto fullname = name + L" " + subcommand;
-        const auto subcmd   = commands.find(fullname);
-
-        if (subcmd != commands.end()) {
-            tokens.pop_front();
+    if (first < tokens.size() && !tokens[first].empty()) {
+        if (const auto subcmd = commands.find(name, tokens[first])) {
+            ++first;
 
-            if (tokens.size() >= subcmd->second.second) {
-                return make_cmd(
-                    subcmd->second.first, fullname, request_id, std::move(client), channel_index, layer_index, tokens);
+            if (tokens.size() - first >= static_cast<std::size_t>(subcmd->min_num_params)) {
+                return make_cmd(*subcmd, request_id, std::move(client), channel_index, layer_index, tokens, first);
             }
         }
     }
 
     // Resort to ordinary command
-    const auto command = commands.find(name);
+    const auto command = commands.find(name, {});
 
-    if (command != commands.end() && tokens.size() >= command->second.second) {
-        return make_cmd(command->second.first, name, request_id, std::move(client), channel_index, layer_index, tokens);
+    if (command && tokens.size() - first >= static_cast<std::size_t>(command->min_num_params)) {
+        return make_cmd(*command, request_id, std::move(client), channel_index, layer_index, tokens, first);
     }
 
     return nullptr;
 }
 
-template <typename Out, typename In>
-bool try_lexical_cast(const In& input, Out& result)
+static bool parse_int(std::wstring_view str, int& result)
 {
-    Out        saved   = result;
-    const bool success = boost::conversion::detail::try_lexical_convert(input, result);
+    bool negative = false;
+    if (!str.empty() && (str.front() == L'-' || str.front() == L'+')) {
+        negative = str.front() == L'-';
+        str.remove_prefix(1);
+    }
 
-    if (!success)
-        result = saved; // Needed because of how try_lexical_convert is implemented.
+    if (str.empty() || str.size() > 9)
+        return false;
 
-    return success;
+    int value = 0;
+    for (auto c : str) {
+        if (c < L'0' || c > L'9')
+            return false;
+        value = value * 10 + (c - L'0');
+    }
+
+    result = negative ? -value : value;
+    return true;
 }
 
-static void
-parse_channel_id(std::list<std::wstring>& tokens, std::wstring& channel_spec, int& channel_index, int& layer_index)
+static bool parse_channel_id(std::wstring_view channel_spec, int& channel_index, int& layer_index)
 {
-    if (!tokens.empty()) {
-        channel_spec                            = tokens.front();
-        std::wstring              channelid_str = boost::trim_copy(channel_spec);
-        std::vector<std::wstring> split;
-        boost::split(split, channelid_str, boost::is_any_of("-"));
+    while (!channel_spec.empty() && std::iswspace(channel_spec.front()))
+        channel_spec.remove_prefix(1);
+    while (!channel_spec.empty() && std::iswspace(channel_spec.back()))
+        channel_spec.remove_suffix(1);
 
-        // Use non_throwing lexical cast to not hit exception break point all the time.
-        if (try_lexical_cast(split[0], channel_index)) {
-            --channel_index;
+    const auto dash = channel_spec.find(L'-');
 
-            if (split.size() > 1)
-                try_lexical_cast(split[1], layer_index);
+    if (!parse_int(channel_spec.substr(0, dash), channel_index))
+        return false;
 
-            // Consume channel-spec
-            tokens.pop_front();
-        }
+    --channel_index;
+
+    if (dash != std::wstring_view::npos) {
+        const auto layer = channel_spec.substr(dash + 1);
+        parse_int(layer.substr(0, layer.find(L'-')), layer_index);
     }
+
+    return true;
 }
 
 struct amcp_command_repository::impl
 {
     const spl::shared_ptr<std::vector<channel_context>> channels_;
 
-    std::map<std::wstring, std::pair<amcp_command_func, int>> commands{};
-    std::map<std::wstring, std::pair<amcp_command_func, int>> channel_commands{};
+    command_table commands;
+    command_table channel_commands;
 
     impl(const spl::shared_ptr<std::vector<channel_context>>& channels)
         : channels_(channels)
     {
     }
 
-    AMCPCommand::ptr_type create_command(const std::wstring&      name,
-                                         const std::wstring&      id,
-                                         IO::ClientInfoPtr        client,
-                                         std::list<std::wstring>& tokens) const
+    std::shared_ptr<AMCPCommand> parse_command(IO::ClientInfoPtr   client,
+                                               const token_list&   tokens,
+                                               const std::wstring& request_id) const
     {
-        auto command = find_command(commands, name, id, std::move(client), -1, -1, tokens);
-
-        if (command)
-            return command;
-
-        return nullptr;
-    }
-
-    AMCPCommand::ptr_type create_channel_command(const std::wstring&      name,
-                                                 const std::wstring&      id,
-                                                 IO::ClientInfoPtr        client,
-                                                 unsigned int             channel_index,
-                                                 int                      layer_index,
-                                                 std::list<std::wstring>& tokens) const
-    {
-        if (channels_->size() <= channel_index)
+        if (tokens.empty())
             return nullptr;
 
-        auto command = find_command(channel_commands, name, id, std::move(client), channel_index, layer_index, tokens);
-
-        if (command)
-            return command;
-
-        return nullptr;
-    }
-
-    std::shared_ptr<AMCPCommand>
-    parse_command(IO::ClientInfoPtr client, std::list<std::wstring> tokens, const std::wstring& request_id) const
-    {
         // Consume command name
-        const std::basic_string<wchar_t> command_name = boost::to_upper_copy(tokens.front());
-        tokens.pop_front();
+        const auto  command_name = tokens.front();
+        std::size_t first        = 1;
 
         // Determine whether the next parameter is a channel spec or not
-        int          channel_index = -1;
-        int          layer_index   = -1;
-        std::wstring channel_spec;
-        parse_channel_id(tokens, channel_spec, channel_index, layer_index);
+        int channel_index = -1;
+        int layer_index   = -1;
 
         // Create command instance
         std::shared_ptr<AMCPCommand> command;
-        if (channel_index >= 0) {
-            command = create_channel_command(command_name, request_id, client, channel_index, layer_index, tokens);
-
-            if (!command) // Might be a non channel command, although the first argument is numeric
-            {
-                // Restore backed up channel spec string.
-                tokens.push_front(channel_spec);
-            }
+        if (first < tokens.size() && parse_channel_id(tokens[first], channel_index, layer_index) &&
+            channel_index >= 0 && static_cast<std::size_t>(channel_index) < channels_->size()) {
+            command = find_command(
+                channel_commands, command_name, request_id, client, channel_index, layer_index, tokens, first + 1);
         }
 
-        // Create global instance
+        // Create global instance, which might be a non channel command although the first argument is numeric
         if (!command) {
-            command = create_command(command_name, request_id, client, tokens);
+            command = find_command(commands, command_name, request_id, client, -1, -1, tokens, first);
         }
 
-        return std::move(command);
+        return command;
     }
 
     bool check_channel_lock(IO::ClientInfoPtr client, int channel_index) const
@@ -214,13 +273,20 @@ const spl::shared_ptr<std::vector<channel_context>>& amcp_command_repository::ch
     return impl_->channels_;
 }
 
-std::shared_ptr<AMCPCommand> amcp_command_repository::parse_command(IO::ClientInfoPtr       client,
-                                                                    std::list<std::wstring> tokens,
-                                                                    const std::wstring&     request_id) const
+std::shared_ptr<AMCPCommand> amcp_command_repository::parse_command(IO::ClientInfoPtr                     client,
+                                                                    const std::vector<std::wstring_view>& tokens,
+                                                                    const std::wstring& request_id) const
 {
     return impl_->parse_command(client, tokens, request_id);
 }
 
+std::shared_ptr<AMCPCommand> amcp_command_repository::parse_command(IO::ClientInfoPtr              client,
+                                                                    const std::list<std::wstring>& tokens,
+                                                                    const std::wstring&            request_id) const
+{
+    return impl_->parse_command(client, token_list(tokens.begin(), tokens.end()), request_id);
+}
+
 bool amcp_command_repository::check_channel_lock(IO::ClientInfoPtr client, int channel_index) const
 {
     return impl_->check_channel_lock(client, channel_index);
@@ -231,7 +297,7 @@ void amcp_command_repository::register_command(std::wstring      category,
                                                amcp_command_func command,
                                                int               min_num_params)
 {
-    impl_->commands.insert(std::make_pair(std::move(name), std::make_pair(std::move(command), min_num_params)));
+    impl_->commands.insert(std::move(name), std::move(command), min_num_params);
 }
 
 void amcp_command_repository::register_channel_command(std::wstring      category,
@@ -239,7 +305,7 @@ void amcp_command_repository::register_channel_command(std::wstring      categor
                                                        amcp_command_func command,
                                                        int               min_num_params)
 {
-    impl_->channel_commands.insert(std::make_pair(std::move(name), std::make_pair(std::move(command), min_num_params)));
+    impl_->channel_commands.insert(std::move(name), std::move(command), min_num_params);
 }
 
 }}} // namespace caspar::protocol::amcp
@@ -27,6 +27,10 @@
 #include <common/memory.h>
 
 #include <functional>
+#include <list>
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace caspar { namespace protocol { namespace amcp {
 
@@ -35,8 +39,13 @@ class amcp_command_repository
   public:
     amcp_command_repository(const spl::shared_ptr<std::vector<channel_context>>& channels);
 
-    std::shared_ptr<AMCPCommand>
-         parse_command(IO::ClientInfoPtr client, std::list<std::wstring> tokens, const std::wstring& request_id) const;
+    // tokens only need to outlive the call, the command copies the parameters it keeps.
+    std::shared_ptr<AMCPCommand> parse_command(IO::ClientInfoPtr                     client,
+                                               const std::vector<std::wstring_view>& tokens,
+                                               const std::wstring&                   request_id) const;
+    std::shared_ptr<AMCPCommand> parse_command(IO::ClientInfoPtr              client,
+                                               const std::list<std::wstring>& tokens,
+                                               const std::wstring&            request_id) const;
     bool check_channel_lock(IO::ClientInfoPtr client, int channel_index) const;
 
     const spl::shared_ptr<std::vector<channel_context>>& channels() const;
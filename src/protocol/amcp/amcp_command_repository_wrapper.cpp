@@ -21,10 +21,23 @@
 
 #include "amcp_command_repository_wrapper.h"
 
+#include "layer_loader.h"
+
 #include <common/future.h>
 
 namespace caspar { namespace protocol { namespace amcp {
 
+namespace {
+
+// Commands for a layer see the producers of the loads issued before them.
+void wait_for_loads(const command_context& ctx)
+{
+    if (ctx.static_context->loader)
+        ctx.static_context->loader->wait(ctx.channel_index, ctx.layer_id);
+}
+
+} // namespace
+
 void amcp_command_repository_wrapper::register_command(std::wstring                  category,
                                                        std::wstring                  name,
                                                        amcp_command_impl_func_future command,
@@ -42,6 +55,9 @@ void amcp_command_repository_wrapper::register_command(std::wstring
     };
 
     repo_->register_command(category, name, func, min_num_params);
+    registrations_.push_back([=](amcp_command_repository_wrapper& other) {
+        other.register_command(category, name, command, min_num_params);
+    });
 }
 
 void amcp_command_repository_wrapper::register_command(std::wstring           category,
@@ -61,6 +77,9 @@ void amcp_command_repository_wrapper::register_command(std::wstring           ca
     };
 
     repo_->register_command(category, name, func, min_num_params);
+    registrations_.push_back([=](amcp_command_repository_wrapper& other) {
+        other.register_command(category, name, command, min_num_params);
+    });
 }
 
 void amcp_command_repository_wrapper::register_channel_command(std::wstring                  category,
@@ -76,10 +95,14 @@ void amcp_command_repository_wrapper::register_channel_command(std::wstring
             return make_ready_future<std::wstring>(L"");
 
         auto context = context_factory->create(ctx, channels);
+        wait_for_loads(context);
         return command(context);
     };
 
     repo_->register_channel_command(category, name, func, min_num_params);
+    registrations_.push_back([=](amcp_command_repository_wrapper& other) {
+        other.register_channel_command(category, name, command, min_num_params);
+    });
 }
 
 void amcp_command_repository_wrapper::register_channel_command(std::wstring           category,
@@ -95,10 +118,36 @@ void amcp_command_repository_wrapper::register_channel_command(std::wstring
             return make_ready_future<std::wstring>(L"");
 
         auto context = context_factory->create(ctx, channels);
+        wait_for_loads(context);
         return make_ready_future(command(context));
     };
 
     repo_->register_channel_command(category, name, func, min_num_params);
+    registrations_.push_back([=](amcp_command_repository_wrapper& other) {
+        other.register_channel_command(category, name, command, min_num_params);
+    });
+}
+
+void amcp_command_repository_wrapper::register_load_command(std::wstring                  category,
+                                                            std::wstring                  name,
+                                                            amcp_command_impl_func_future command,
+                                                            int                           min_num_params)
+{
+    std::weak_ptr<command_context_factory> weak_context_factory = context_factory_;
+    auto func = [weak_context_factory, command](const command_context_simple&                        ctx,
+                                                const spl::shared_ptr<std::vector<channel_context>>& channels) {
+        auto context_factory = weak_context_factory.lock();
+        if (!context_factory)
+            return make_ready_future<std::wstring>(L"");
+
+        auto context = context_factory->create(ctx, channels);
+        return command(context);
+    };
+
+    repo_->register_channel_command(category, name, func, min_num_params);
+    registrations_.push_back([=](amcp_command_repository_wrapper& other) {
+        other.register_load_command(category, name, command, min_num_params);
+    });
 }
 
 }}} // namespace caspar::protocol::amcp
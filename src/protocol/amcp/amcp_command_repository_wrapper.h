@@ -78,9 +78,23 @@ class amcp_command_repository_wrapper
                                   amcp_command_impl_func command,
                                   int                    min_num_params);
 
+    // A channel command that goes through the layer loader itself, so it doesn't wait for the loads of its layer
+    // like the other channel commands do.
+    void register_load_command(std::wstring                  category,
+                               std::wstring                  name,
+                               amcp_command_impl_func_future command,
+                               int                           min_num_params);
+
+    using registration = std::function<void(amcp_command_repository_wrapper&)>;
+
+    // Every registration made through this wrapper so far, to make the same ones with another, such as the commands
+    // of the modules with the server that replaces this one on a warm restart.
+    const std::vector<registration>& registrations() const { return registrations_; }
+
   private:
     std::shared_ptr<amcp_command_repository> repo_;
     std::weak_ptr<command_context_factory>   context_factory_;
+    std::vector<registration>                registrations_;
 };
 
 }}} // namespace caspar::protocol::amcp
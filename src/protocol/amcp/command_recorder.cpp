@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../StdAfx.h"
+
+#include "command_recorder.h"
+
+#include <common/except.h>
+#include <common/executor.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <boost/filesystem/fstream.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <string>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+struct command_recorder::impl
+{
+    const std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+    std::atomic<int>                            next_connection_{1};
+    boost::filesystem::ofstream                 file_;
+    executor                                    executor_{L"amcp recorder"};
+
+    explicit impl(const std::wstring& path)
+        : file_(boost::filesystem::path(path), std::ios::out | std::ios::app | std::ios::binary)
+    {
+        if (!file_)
+            CASPAR_THROW_EXCEPTION(file_write_error() << msg_info(L"Failed to open " + path + L" for recording."));
+
+        auto now = std::time(nullptr);
+        char date[32];
+        std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+        write(std::string("# casparcg amcp trace 1 ") + date + "\n");
+
+        CASPAR_LOG(info) << L"Recording AMCP commands to " << path;
+    }
+
+    ~impl() { executor_.stop_and_wait(); }
+
+    void write(std::string line)
+    {
+        executor_.begin_invoke([this, line = std::move(line)] {
+            file_ << line;
+            // Flush once the queue has been written, so a crash loses at most the commands of a moment.
+            if (executor_.size() <= 1)
+                file_.flush();
+        });
+    }
+};
+
+command_recorder::command_recorder(const std::wstring& path)
+    : impl_(new impl(path))
+{
+}
+
+command_recorder::~command_recorder() {}
+
+int command_recorder::add_connection(const std::wstring& address)
+{
+    auto connection = impl_->next_connection_++;
+    impl_->write("C " + std::to_string(connection) + " " + u8(address) + "\n");
+    return connection;
+}
+
+void command_recorder::record(int connection, const std::wstring& command)
+{
+    auto elapsed = std::chrono::steady_clock::now() - impl_->start_;
+    auto micros  = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    impl_->write(std::to_string(micros) + " " + std::to_string(connection) + " " + u8(command) + "\n");
+}
+
+}}} // namespace caspar::protocol::amcp
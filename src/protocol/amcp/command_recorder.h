@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <string>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+/**
+ * Appends every command the AMCP controllers receive to a trace file, with the
+ * time since recording started and the connection it came in on, for
+ * casparcg-replay to play back. The file is written on a thread of its own, so
+ * recording never holds up a connection.
+ *
+ * The file is text, one line each:
+ *   # casparcg amcp trace 1 <start time>
+ *   C <connection> <address>
+ *   <microseconds> <connection> <command>
+ */
+class command_recorder
+{
+  public:
+    explicit command_recorder(const std::wstring& path);
+    ~command_recorder();
+
+    command_recorder(const command_recorder&)            = delete;
+    command_recorder& operator=(const command_recorder&) = delete;
+
+    // The id the commands of a new connection are recorded with.
+    int add_connection(const std::wstring& address);
+
+    void record(int connection, const std::wstring& command);
+
+  private:
+    struct impl;
+    spl::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::amcp
@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "data_store.h"
+
+#include <common/except.h>
+#include <common/executor.h>
+#include <common/log.h>
+#include <common/os/filesystem.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/locale.hpp>
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/algorithm/copy.hpp>
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+namespace {
+
+std::wstring read_utf8_file(const boost::filesystem::path& file)
+{
+    std::wstringstream           result;
+    boost::filesystem::wifstream filestream(file);
+
+    if (filestream) {
+        // Consume BOM first
+        filestream.get();
+        // read all data
+        result << filestream.rdbuf();
+    }
+
+    return result.str();
+}
+
+std::wstring read_latin1_file(const boost::filesystem::path& file)
+{
+    boost::locale::generator gen;
+    gen.locale_cache_enabled(true);
+#if BOOST_VERSION >= 108100
+    gen.categories(boost::locale::category_t::codepage);
+#else
+    gen.categories(boost::locale::codepage_facet);
+#endif
+
+    std::stringstream           result_stream;
+    boost::filesystem::ifstream filestream(file);
+    filestream.imbue(gen("en_US.ISO8859-1"));
+
+    if (filestream) {
+        // read all data
+        result_stream << filestream.rdbuf();
+    }
+
+    std::string  result = result_stream.str();
+    std::wstring widened_result;
+
+    // The first 255 codepoints in unicode is the same as in latin1
+    boost::copy(result | boost::adaptors::transformed([](char c) { return static_cast<unsigned char>(c); }),
+                std::back_inserter(widened_result));
+
+    return widened_result;
+}
+
+std::wstring read_file(const boost::filesystem::path& file)
+{
+    static const uint8_t BOM[] = {0xef, 0xbb, 0xbf};
+
+    if (!boost::filesystem::exists(file)) {
+        return L"";
+    }
+
+    if (boost::filesystem::file_size(file) >= 3) {
+        boost::filesystem::ifstream bom_stream(file);
+
+        char header[3];
+        bom_stream.read(header, 3);
+        bom_stream.close();
+
+        if (std::memcmp(BOM, header, 3) == 0)
+            return read_utf8_file(file);
+    }
+
+    return read_latin1_file(file);
+}
+
+} // namespace
+
+struct data_store::impl
+{
+    struct pending_write
+    {
+        std::wstring                name; // as last given, names the file when there's none yet
+        std::optional<std::wstring> data; // none removes the file
+    };
+
+    const std::wstring    folder_;
+    const change_callback on_change_;
+
+    std::mutex                            mutex_;
+    std::map<std::wstring, std::wstring>  entries_; // by key
+    std::map<std::wstring, pending_write> pending_; // by key, changes not yet being written
+    std::map<std::wstring, pending_write> writing_; // by key, changes being written
+    bool                                  scheduled_ = false;
+    std::uint64_t                         revision_  = 0;
+
+    // Last, so that it writes what is pending before the rest goes away.
+    executor writer_{L"data store"};
+
+    impl(std::wstring folder, change_callback on_change)
+        : folder_(std::move(folder))
+        , on_change_(std::move(on_change))
+    {
+    }
+
+    static std::wstring key_of(const std::wstring& name)
+    {
+        auto key = boost::to_upper_copy(name);
+        boost::replace_all(key, L"\\", L"/");
+        return key;
+    }
+
+    std::wstring filename_of(const std::wstring& name) const { return folder_ + name + L".ftd"; }
+
+    // Whether the entry has been removed, but its file may still be there.
+    bool is_removed(const std::wstring& key) const
+    {
+        for (auto changes : {&pending_, &writing_}) {
+            auto it = changes->find(key);
+            if (it != changes->end())
+                return !it->second.data;
+        }
+        return false;
+    }
+
+    std::optional<std::wstring> retrieve(const std::wstring& name)
+    {
+        const auto    key = key_of(name);
+        std::uint64_t revision;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            auto it = entries_.find(key);
+            if (it != entries_.end())
+                return it->second.empty() ? std::nullopt : std::make_optional(it->second);
+            if (is_removed(key))
+                return {};
+            revision = revision_;
+        }
+
+        std::wstring data;
+        if (auto found = find_case_insensitive(filename_of(name)))
+            data = read_file(boost::filesystem::path(*found));
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // Not kept when anything changed while reading, the file might be older than the change. Missing files are
+        // looked for again, they might be copied in later.
+        if (revision_ == revision && !data.empty())
+            entries_.emplace(key, data);
+
+        return data.empty() ? std::nullopt : std::make_optional(std::move(data));
+    }
+
+    void store(const std::wstring& name, std::wstring data)
+    {
+        const auto    key = key_of(name);
+        std::uint64_t revision;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries_[key] = data;
+            pending_[key] = pending_write{name, std::move(data)};
+            revision      = ++revision_;
+            schedule();
+        }
+
+        if (on_change_)
+            on_change_(boost::to_lower_copy(key), revision);
+    }
+
+    bool remove(const std::wstring& name)
+    {
+        const auto key     = key_of(name);
+        const auto on_disk = static_cast<bool>(find_case_insensitive(filename_of(name)));
+
+        std::uint64_t revision;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const auto                  removed = is_removed(key);
+            if (entries_.erase(key) == 0 && (removed || !on_disk))
+                return false;
+
+            pending_[key] = pending_write{name, std::nullopt};
+            revision      = ++revision_;
+            schedule();
+        }
+
+        if (on_change_)
+            on_change_(boost::to_lower_copy(key), revision);
+
+        return true;
+    }
+
+    void schedule()
+    {
+        if (scheduled_)
+            return;
+
+        scheduled_ = true;
+        writer_.begin_invoke([this] { write_pending(); });
+    }
+
+    void write_pending()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            writing_.swap(pending_);
+            scheduled_ = false;
+        }
+
+        for (auto& change : writing_) {
+            try {
+                if (change.second.data)
+                    write(change.second.name, *change.second.data);
+                else
+                    erase(change.second.name);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        writing_.clear();
+    }
+
+    void write(const std::wstring& name, const std::wstring& data) const
+    {
+        auto filename = filename_of(name);
+
+        auto data_path       = boost::filesystem::path(filename).parent_path().wstring();
+        auto found_data_path = find_case_insensitive(data_path);
+
+        if (found_data_path)
+            data_path = *found_data_path;
+
+        if (!boost::filesystem::exists(data_path))
+            boost::filesystem::create_directories(data_path);
+
+        auto found_filename = find_case_insensitive(filename);
+
+        if (found_filename)
+            filename = *found_filename; // Overwrite case insensitive.
+
+        boost::filesystem::wofstream datafile(filename);
+        if (!datafile)
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"Could not open file " + filename));
+
+        datafile << static_cast<wchar_t>(65279); // UTF-8 BOM character
+        datafile << data << std::flush;
+        datafile.close();
+    }
+
+    void erase(const std::wstring& name) const
+    {
+        auto found_filename = find_case_insensitive(filename_of(name));
+        if (found_filename && !boost::filesystem::remove(*found_filename))
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(*found_filename + L" could not be removed"));
+    }
+};
+
+data_store::data_store(std::wstring folder, change_callback on_change)
+    : impl_(new impl(std::move(folder), std::move(on_change)))
+{
+}
+
+data_store::~data_store() {}
+
+std::optional<std::wstring> data_store::retrieve(const std::wstring& name) { return impl_->retrieve(name); }
+
+void data_store::store(const std::wstring& name, std::wstring data) { impl_->store(name, std::move(data)); }
+
+bool data_store::remove(const std::wstring& name) { return impl_->remove(name); }
+
+void data_store::flush()
+{
+    impl_->writer_.invoke([this] { impl_->write_pending(); });
+}
+
+}}} // namespace caspar::protocol::amcp
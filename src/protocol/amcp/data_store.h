@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+/**
+ * Holds the DATA entries in memory, so that DATA RETRIEVE and templates given the name of an entry are answered
+ * without touching the disk. Names are case insensitive like the files. An entry is read from its .ftd file in the
+ * data folder the first time it is asked for, after which edits of the file behind the server's back are not seen.
+ *
+ * Stores and removes take effect at once and are written to the files on a background thread, a later change of an
+ * entry replacing a write still pending for it.
+ */
+class data_store
+{
+  public:
+    // Called with the name of an entry, lower case with / between folders, and a revision increasing over all entries
+    // when it is stored or removed.
+    using change_callback = std::function<void(const std::wstring& name, std::uint64_t revision)>;
+
+    data_store(std::wstring folder, change_callback on_change = nullptr);
+    ~data_store(); // Writes what is still pending.
+
+    data_store(const data_store&)            = delete;
+    data_store& operator=(const data_store&) = delete;
+
+    // None when there is no entry of that name, or it is empty.
+    std::optional<std::wstring> retrieve(const std::wstring& name);
+
+    void store(const std::wstring& name, std::wstring data);
+
+    // False when there is no entry of that name.
+    bool remove(const std::wstring& name);
+
+    // Blocks until every store and remove so far is on disk, for listing the folder.
+    void flush();
+
+  private:
+    struct impl;
+    spl::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::amcp
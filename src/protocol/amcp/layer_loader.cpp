@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../StdAfx.h"
+
+#include "layer_loader.h"
+
+#include <common/executor.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+struct layer_loader::impl
+{
+    const bool                             reply_when_queued_;
+    std::vector<std::unique_ptr<executor>> workers_;
+
+    mutable std::mutex                                              mutex_;
+    std::map<std::pair<int, int>, std::shared_future<std::wstring>> last_;
+
+    impl(int threads, bool reply_when_queued)
+        : reply_when_queued_(reply_when_queued)
+    {
+        for (int n = 0; n < std::max(1, threads); ++n) {
+            workers_.push_back(std::make_unique<executor>(L"layer loader " + std::to_wstring(n)));
+            // Decoder threads started by ffmpeg while opening a producer inherit the placement.
+            workers_.back()->begin_invoke([] { set_thread_affinity(thread_role::producer); });
+        }
+    }
+
+    std::future<std::wstring> enqueue(int channel_index, int layer_index, std::function<std::wstring()> load)
+    {
+        const auto key    = std::make_pair(channel_index, layer_index);
+        auto&      worker = workers_[static_cast<std::size_t>(channel_index * 1009 + layer_index) % workers_.size()];
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // Forget the loads that have finished while here.
+        for (auto it = last_.begin(); it != last_.end();) {
+            if (it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+                it = last_.erase(it);
+            else
+                ++it;
+        }
+
+        auto result = worker->begin_invoke(std::move(load)).share();
+        last_[key]  = result;
+        return std::async(std::launch::deferred, [result] { return result.get(); });
+    }
+
+    void wait(int channel_index, int layer_index) const
+    {
+        std::vector<std::shared_future<std::wstring>> pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& p : last_) {
+                if (p.first.first == channel_index && (layer_index == -1 || p.first.second == layer_index))
+                    pending.push_back(p.second);
+            }
+        }
+
+        // The loads report their own errors.
+        for (auto& f : pending)
+            f.wait();
+    }
+};
+
+layer_loader::layer_loader(int threads, bool reply_when_queued)
+    : impl_(new impl(threads, reply_when_queued))
+{
+}
+
+layer_loader::~layer_loader() {}
+
+std::future<std::wstring>
+layer_loader::enqueue(int channel_index, int layer_index, std::function<std::wstring()> load)
+{
+    return impl_->enqueue(channel_index, layer_index, std::move(load));
+}
+
+bool layer_loader::reply_when_queued() const { return impl_->reply_when_queued_; }
+
+void layer_loader::wait(int channel_index, int layer_index) const { impl_->wait(channel_index, layer_index); }
+
+}}} // namespace caspar::protocol::amcp
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <common/memory.h>
+
+#include <functional>
+#include <future>
+#include <string>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+/**
+ * Creates the producers of LOAD, LOADBG and PLAY on background threads, so opening slow media doesn't hold up the
+ * commands queued behind them. Every layer is served by one worker, so the loads of a layer reach the stage in the
+ * order they were issued. Other commands wait for the loads of their layer before they run.
+ */
+class layer_loader
+{
+  public:
+    // With reply_when_queued the commands reply as soon as their load has been queued, and load errors are only
+    // logged. Otherwise they reply once the producer has been created and handed to the stage.
+    layer_loader(int threads, bool reply_when_queued);
+    ~layer_loader();
+
+    layer_loader(const layer_loader&)            = delete;
+    layer_loader& operator=(const layer_loader&) = delete;
+
+    // Runs load after the loads issued before it for the same layer.
+    std::future<std::wstring> enqueue(int channel_index, int layer_index, std::function<std::wstring()> load);
+
+    bool reply_when_queued() const;
+
+    // Blocks until every load issued for the layer has finished, or for the whole channel when layer_index is -1.
+    void wait(int channel_index, int layer_index) const;
+
+  private:
+    struct impl;
+    spl::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::amcp
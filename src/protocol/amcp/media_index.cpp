@@ -0,0 +1,431 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "media_index.h"
+
+#include <common/env.h>
+#include <common/filesystem.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <core/producer/frame_producer.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace caspar { namespace protocol { namespace amcp {
+
+namespace {
+
+struct entry
+{
+    std::wstring   id;
+    std::uintmax_t size  = 0;
+    std::time_t    mtime = 0;
+    bool           valid = false;
+    std::wstring   line;
+};
+
+struct catalogue
+{
+    std::map<std::wstring, entry>                  media;
+    std::unordered_map<std::wstring, std::wstring> cinf;
+    std::unordered_map<std::wstring, std::wstring> files; // by id, empty when several files share the id
+    std::wstring                                   cls;
+    std::wstring                                   tls;
+    std::wstring                                   fls;
+};
+
+std::wstring format_time(std::time_t time)
+{
+    std::tm tm{};
+#ifdef _MSC_VER
+    localtime_s(&tm, &time);
+#else
+    localtime_r(&time, &tm);
+#endif
+    wchar_t buffer[32];
+    std::wcsftime(buffer, sizeof(buffer) / sizeof(wchar_t), L"%Y%m%d%H%M%S", &tm);
+    return buffer;
+}
+
+std::wstring make_id(const boost::filesystem::path& file, const std::wstring& folder)
+{
+    auto id = get_relative_without_extension(file, folder).generic_wstring();
+    if (!id.empty() && (id[0] == L'/' || id[0] == L'\\'))
+        id.erase(0, 1);
+    return boost::to_upper_copy(id);
+}
+
+// Calls on_file for every regular file below folder and on_directory for every directory, including folder itself.
+void walk(const std::wstring&                                         folder,
+          const std::function<void(const boost::filesystem::path&)>& on_file,
+          const std::function<void(const boost::filesystem::path&)>& on_directory)
+{
+    namespace fs = boost::filesystem;
+
+    boost::system::error_code ec;
+    if (!fs::is_directory(folder, ec))
+        return;
+
+    on_directory(folder);
+
+    fs::recursive_directory_iterator it(folder, fs::directory_options::skip_permission_denied, ec), end;
+    for (; !ec && it != end; it.increment(ec)) {
+        const auto status = it->status(ec);
+        if (ec)
+            break;
+        if (fs::is_directory(status))
+            on_directory(it->path());
+        else if (fs::is_regular_file(status))
+            on_file(it->path());
+    }
+
+    if (ec)
+        CASPAR_LOG(warning) << L"[media_index] Failed to scan " << folder << L": " << u16(ec.message());
+}
+
+} // namespace
+
+struct media_index::impl
+{
+    using clock = std::chrono::steady_clock;
+
+    const spl::shared_ptr<const core::frame_producer_registry> producer_registry_;
+    const std::chrono::seconds                                 rescan_interval_;
+    const std::wstring                                         font_folder_;
+    tbb::task_arena                                            probe_arena_;
+
+    std::shared_ptr<const catalogue> catalogue_ = std::make_shared<catalogue>();
+    std::promise<void>               ready_;
+    std::shared_future<void>         ready_future_ = ready_.get_future().share();
+    bool                             is_ready_     = false;
+
+    std::atomic<bool> abort_{false};
+    std::thread       thread_;
+
+#if defined(__linux__)
+    int inotify_fd_ = -1;
+#endif
+
+    impl(spl::shared_ptr<const core::frame_producer_registry> producer_registry,
+         int                                                  probe_threads,
+         int                                                  rescan_interval_seconds,
+         std::wstring                                         font_folder)
+        : producer_registry_(std::move(producer_registry))
+        , rescan_interval_(std::max(1, rescan_interval_seconds))
+        , font_folder_(std::move(font_folder))
+        , probe_arena_(std::max(1, probe_threads))
+    {
+#if defined(__linux__)
+        inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd_ < 0)
+            CASPAR_LOG(warning) << L"[media_index] inotify unavailable, relying on periodic rescans.";
+#endif
+    }
+
+    ~impl()
+    {
+        abort_ = true;
+        if (thread_.joinable())
+            thread_.join();
+        if (!is_ready_)
+            ready_.set_value();
+#if defined(__linux__)
+        if (inotify_fd_ >= 0)
+            close(inotify_fd_);
+#endif
+    }
+
+    void start()
+    {
+        if (!thread_.joinable())
+            thread_ = std::thread([this] { run(); });
+    }
+
+    std::shared_ptr<const catalogue> get() const
+    {
+        ready_future_.wait();
+        return std::atomic_load(&catalogue_);
+    }
+
+    void run()
+    {
+        set_thread_name(L"media-index");
+
+        // Renaming or copying a tree emits a burst of events, wait for it to settle before rescanning.
+        const auto debounce = std::chrono::milliseconds(250);
+
+        auto next_rescan = clock::now();
+        auto changed     = false;
+        auto changed_at  = clock::now();
+
+        while (!abort_) {
+            auto now = clock::now();
+            if (now >= next_rescan || (changed && now - changed_at >= debounce)) {
+                changed = false;
+                try {
+                    std::atomic_store(&catalogue_, scan(std::atomic_load(&catalogue_)));
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+                if (!is_ready_) {
+                    is_ready_ = true;
+                    ready_.set_value();
+                }
+                now         = clock::now();
+                next_rescan = now + rescan_interval_;
+            }
+
+            // Never block longer than this so that shutdown stays responsive.
+            auto timeout = std::min<clock::duration>(next_rescan - now, debounce);
+            if (wait_for_changes(std::chrono::duration_cast<std::chrono::milliseconds>(timeout))) {
+                changed    = true;
+                changed_at = clock::now();
+            }
+        }
+    }
+
+    bool wait_for_changes(std::chrono::milliseconds timeout)
+    {
+#if defined(__linux__)
+        if (inotify_fd_ >= 0) {
+            pollfd fd{inotify_fd_, POLLIN, 0};
+            if (poll(&fd, 1, static_cast<int>(std::max<std::int64_t>(timeout.count(), 0))) <= 0)
+                return false;
+
+            // Only the fact that something changed matters, the rescan finds out what.
+            alignas(inotify_event) char buffer[4096];
+            auto                        changed = false;
+            while (read(inotify_fd_, buffer, sizeof(buffer)) > 0)
+                changed = true;
+            return changed;
+        }
+#endif
+        std::this_thread::sleep_for(timeout);
+        return false;
+    }
+
+    void watch(const boost::filesystem::path& directory)
+    {
+#if defined(__linux__)
+        // Adding a watch twice returns the existing one, watches of removed directories go away on their own.
+        if (inotify_fd_ >= 0)
+            inotify_add_watch(inotify_fd_,
+                              directory.string().c_str(),
+                              IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB);
+#endif
+    }
+
+    std::shared_ptr<const catalogue> scan(const std::shared_ptr<const catalogue>& previous)
+    {
+        auto next = std::make_shared<catalogue>();
+
+        const auto on_directory = [this](const boost::filesystem::path& dir) { watch(dir); };
+
+        std::vector<std::pair<std::wstring, entry*>> to_probe;
+
+        walk(
+            env::media_folder(),
+            [&](const boost::filesystem::path& file) {
+                boost::system::error_code ec;
+                const auto                size  = boost::filesystem::file_size(file, ec);
+                const auto                mtime = boost::filesystem::last_write_time(file, ec);
+                if (ec)
+                    return;
+
+                auto path = file.wstring();
+                auto it   = previous->media.find(path);
+                if (it != previous->media.end() && it->second.size == size && it->second.mtime == mtime) {
+                    next->media.emplace(std::move(path), it->second);
+                    return;
+                }
+
+                auto& e = next->media[path];
+                e.id    = make_id(file, env::media_folder());
+                e.size  = size;
+                e.mtime = mtime;
+                to_probe.emplace_back(std::move(path), &e);
+            },
+            on_directory);
+
+        if (!to_probe.empty()) {
+            probe_arena_.execute([&] {
+                tbb::parallel_for(std::size_t(0), to_probe.size(), [&](std::size_t n) {
+                    probe(to_probe[n].first, *to_probe[n].second);
+                });
+            });
+            CASPAR_LOG(debug) << L"[media_index] Probed " << to_probe.size() << L" files.";
+        }
+
+        std::vector<const entry*> media;
+        for (auto& p : next->media) {
+            if (p.second.valid)
+                media.push_back(&p.second);
+        }
+        std::sort(media.begin(), media.end(), [](auto lhs, auto rhs) { return lhs->id < rhs->id; });
+
+        next->cls = L"200 CLS OK\r\n";
+        for (auto e : media) {
+            next->cls += e->line;
+            next->cls += L"\r\n";
+
+            auto& cinf = next->cinf[e->id];
+            cinf += e->line;
+            cinf += L"\r\n";
+        }
+        for (auto& p : next->media) {
+            if (!p.second.valid)
+                continue;
+            auto it = next->files.emplace(p.second.id, p.first);
+            if (!it.second)
+                it.first->second.clear();
+        }
+        next->cls += L"\r\n";
+
+        next->tls = L"200 TLS OK\r\n" + list(env::template_folder(), on_directory, [](const std::wstring& ext) {
+                        return boost::iequals(ext, L".html") || boost::iequals(ext, L".htm") ||
+                               boost::iequals(ext, L".ft") || boost::iequals(ext, L".ct");
+                    });
+        next->fls = L"200 FLS OK\r\n" + list(font_folder_, on_directory, [](const std::wstring&) { return true; });
+
+        return next;
+    }
+
+    void probe(const std::wstring& path, entry& e) const
+    {
+        core::media_info info;
+        if (!producer_registry_->extract_media_info(path, info))
+            return;
+
+        e.valid = true;
+        e.line  = L"\"" + e.id + L"\" " + info.clip_type + L" " + std::to_wstring(e.size) + L" " +
+                 format_time(e.mtime) + L" " + std::to_wstring(info.duration) + L" " +
+                 std::to_wstring(info.time_base_numerator) + L"/" + std::to_wstring(info.time_base_denominator);
+    }
+
+    static std::wstring list(const std::wstring&                                         folder,
+                             const std::function<void(const boost::filesystem::path&)>& on_directory,
+                             const std::function<bool(const std::wstring&)>&             accept)
+    {
+        std::vector<std::wstring> lines;
+        walk(
+            folder,
+            [&](const boost::filesystem::path& file) {
+                if (!accept(file.extension().wstring()))
+                    return;
+
+                boost::system::error_code ec;
+                const auto                size  = boost::filesystem::file_size(file, ec);
+                const auto                mtime = boost::filesystem::last_write_time(file, ec);
+                if (ec)
+                    return;
+
+                lines.push_back(L"\"" + make_id(file, folder) + L"\" " + std::to_wstring(size) + L" " +
+                                format_time(mtime));
+            },
+            on_directory);
+        std::sort(lines.begin(), lines.end());
+
+        std::wstring result;
+        for (auto& line : lines) {
+            result += line;
+            result += L"\r\n";
+        }
+        return result + L"\r\n";
+    }
+};
+
+media_index::media_index(spl::shared_ptr<const core::frame_producer_registry> producer_registry,
+                         int                                                  probe_threads,
+                         int                                                  rescan_interval_seconds,
+                         std::wstring                                         font_folder)
+    : impl_(new impl(std::move(producer_registry), probe_threads, rescan_interval_seconds, std::move(font_folder)))
+{
+}
+
+media_index::~media_index() {}
+
+void media_index::start() { impl_->start(); }
+
+std::wstring media_index::cls() const { return impl_->get()->cls; }
+
+std::wstring media_index::cinf(const std::wstring& name) const
+{
+    auto catalogue = impl_->get();
+    auto it        = catalogue->cinf.find(boost::to_upper_copy(boost::replace_all_copy(name, L"\\", L"/")));
+    if (it == catalogue->cinf.end())
+        return L"404 CINF ERROR\r\n";
+    return L"201 CINF OK\r\n" + it->second;
+}
+
+std::optional<std::wstring> media_index::find(const std::wstring& name) const
+{
+    if (impl_->ready_future_.wait_for(std::chrono::seconds(0)) != std::future_status::ready ||
+        boost::filesystem::path(name).has_root_path())
+        return {};
+
+    auto catalogue = std::atomic_load(&impl_->catalogue_);
+    auto it        = catalogue->files.find(boost::to_upper_copy(boost::replace_all_copy(name, L"\\", L"/")));
+    if (it == catalogue->files.end())
+        return std::wstring();
+    if (it->second.empty())
+        return {};
+    return it->second;
+}
+
+std::vector<media_index::media_file> media_index::media() const
+{
+    std::vector<media_file> result;
+    for (auto& p : impl_->get()->media) {
+        if (p.second.valid)
+            result.push_back({p.second.id, p.first, p.second.mtime});
+    }
+    return result;
+}
+
+std::wstring media_index::tls() const { return impl_->get()->tls; }
+
+std::wstring media_index::fls() const { return impl_->get()->fls; }
+
+}}} // namespace caspar::protocol::amcp
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/fwd.h>
+
+#include <ctime>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+/**
+ * Keeps a catalogue of the media, template and font folders up to date in the
+ * background and answers CLS, CINF, TLS and FLS from it without going through
+ * the media scanner. Files are only probed again when their size or
+ * modification time changes.
+ */
+class media_index
+{
+  public:
+    struct media_file
+    {
+        std::wstring id; // as CLS lists it
+        std::wstring path;
+        std::time_t  mtime = 0;
+    };
+
+    media_index(spl::shared_ptr<const core::frame_producer_registry> producer_registry,
+                int                                                  probe_threads,
+                int                                                  rescan_interval_seconds,
+                std::wstring                                         font_folder);
+    ~media_index();
+
+    media_index(const media_index&)            = delete;
+    media_index& operator=(const media_index&) = delete;
+
+    // Starts the scanner, call once every module has registered its media info extractor.
+    void start();
+
+    // Complete AMCP replies, blocking only until the first scan has finished.
+    std::wstring cls() const;
+    std::wstring cinf(const std::wstring& name) const;
+    std::wstring tls() const;
+    std::wstring fls() const;
+
+    // The file a media name such as FOLDER/CLIP stands for, an empty path when there is no such media and std::nullopt
+    // when it isn't known (the first scan hasn't finished, the name is absolute or several files share it). Never
+    // blocks, used to pick producer factories.
+    std::optional<std::wstring> find(const std::wstring& name) const;
+
+    // Every file CLS lists, blocking until the first scan has finished.
+    std::vector<media_file> media() const;
+
+  private:
+    struct impl;
+    spl::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::amcp
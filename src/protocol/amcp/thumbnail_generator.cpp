@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "thumbnail_generator.h"
+#include "media_index.h"
+
+#include <common/base64.h>
+#include <common/env.h>
+#include <common/filesystem.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/os/filesystem.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/image/image_mixer.h>
+#include <core/producer/frame_producer.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <tbb/concurrent_queue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <ctime>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+namespace {
+
+std::wstring format_time(std::time_t time)
+{
+    std::tm tm{};
+#ifdef _MSC_VER
+    localtime_s(&tm, &time);
+#else
+    localtime_r(&time, &tm);
+#endif
+    wchar_t buffer[32];
+    std::wcsftime(buffer, sizeof(buffer) / sizeof(wchar_t), L"%Y%m%dT%H%M%S", &tm);
+    return buffer;
+}
+
+std::wstring normalize(const std::wstring& name)
+{
+    return boost::to_upper_copy(boost::replace_all_copy(name, L"\\", L"/"));
+}
+
+} // namespace
+
+struct thumbnail_generator::impl
+{
+    const spl::shared_ptr<const core::frame_producer_registry> producer_registry_;
+    const std::shared_ptr<core::image_mixer>                   image_mixer_;
+    const std::shared_ptr<media_index>                         media_index_;
+    const std::wstring                                         folder_;
+    const int                                                  width_;
+    const int                                                  height_;
+
+    tbb::concurrent_bounded_queue<std::function<void()>> queue_;
+    std::vector<std::thread>                             threads_;
+
+    // Who is waiting for the thumbnails queued or being written, so a thumbnail asked for twice is generated once.
+    std::mutex                                                     pending_mutex_;
+    std::map<std::wstring, std::vector<std::function<void(bool)>>> pending_;
+
+    impl(spl::shared_ptr<const core::frame_producer_registry> producer_registry,
+         std::shared_ptr<core::image_mixer>                   image_mixer,
+         std::shared_ptr<media_index>                         media_index,
+         std::wstring                                         folder,
+         int                                                  width,
+         int                                                  height,
+         int                                                  threads)
+        : producer_registry_(std::move(producer_registry))
+        , image_mixer_(std::move(image_mixer))
+        , media_index_(std::move(media_index))
+        , folder_(ensure_trailing_slash(std::move(folder)))
+        , width_(std::max(width, 1))
+        , height_(std::max(height, 0))
+    {
+        for (int n = 0; n < std::max(threads, 1); ++n) {
+            threads_.emplace_back([this] {
+                set_thread_name(L"thumbnails");
+                // Decoding threads started from here inherit the priority.
+                set_thread_background_priority();
+                while (true) {
+                    std::function<void()> task;
+                    queue_.pop(task);
+                    if (!task) {
+                        break;
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    ~impl()
+    {
+        queue_.clear();
+        for (size_t n = 0; n < threads_.size(); ++n) {
+            queue_.push(nullptr);
+        }
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    std::wstring thumbnail_path(const std::wstring& media) const
+    {
+        return folder_ + get_relative_without_extension(media, env::media_folder()).generic_wstring() + L".png";
+    }
+
+    std::optional<media_index::media_file> find(const std::wstring& name) const
+    {
+        const auto id = normalize(name);
+        for (auto& file : media_index_->media()) {
+            if (file.id == id)
+                return file;
+        }
+        return {};
+    }
+
+    // Calls done with whether the thumbnail could be written, from one of the thumbnail threads.
+    void schedule(const media_index::media_file& file, std::function<void(bool)> done)
+    {
+        auto target = thumbnail_path(file.path);
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            auto&                       waiting = pending_[target];
+            waiting.push_back(std::move(done));
+            if (waiting.size() > 1)
+                return;
+        }
+
+        queue_.push([this, path = file.path, target] {
+            auto written = false;
+            try {
+                written = write(path, target);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+
+            std::vector<std::function<void(bool)>> waiting;
+            {
+                std::lock_guard<std::mutex> lock(pending_mutex_);
+                waiting = std::move(pending_[target]);
+                pending_.erase(target);
+            }
+            for (auto& done : waiting)
+                done(written);
+        });
+    }
+
+    bool write(const std::wstring& path, const std::wstring& target) const
+    {
+        auto frame = producer_registry_->extract_thumbnail(path, *image_mixer_);
+        if (!frame || frame.width() == 0 || frame.height() == 0) {
+            CASPAR_LOG(debug) << L"[thumbnails] No picture to make a thumbnail of in " << path << L".";
+            return false;
+        }
+
+        const auto width  = width_;
+        const auto height = height_ > 0 ? height_
+                                        : std::max(1,
+                                                   static_cast<int>(std::lround(static_cast<double>(width) *
+                                                                                frame.height() / frame.width())));
+
+        // Drawn like any other frame at the size of a format, which is what scales it.
+        const auto format_desc = core::video_format_desc(
+            core::video_format::custom, 1, width, height, width, height, 25, 1, L"thumbnail", {1920});
+        auto image =
+            image_mixer_->read(core::draw_frame(std::move(frame)), format_desc, core::output_format::bgra).get();
+        if (image.size() < static_cast<std::size_t>(width) * height * 4)
+            return false;
+
+        boost::filesystem::create_directories(boost::filesystem::path(target).parent_path());
+        return producer_registry_->write_thumbnail(image, width, height, target);
+    }
+
+    std::future<std::wstring> generate(const std::wstring& name)
+    {
+        auto file = find(name);
+        if (!file)
+            return make_ready_future(std::wstring(L"404 THUMBNAIL GENERATE ERROR\r\n"));
+
+        auto promise = std::make_shared<std::promise<std::wstring>>();
+        schedule(*file, [promise](bool written) {
+            promise->set_value(written ? L"202 THUMBNAIL GENERATE OK\r\n" : L"501 THUMBNAIL GENERATE FAILED\r\n");
+        });
+        return promise->get_future();
+    }
+
+    // Media whose thumbnail is at least as new as the file is left alone.
+    std::future<std::wstring> generate_all()
+    {
+        std::vector<media_index::media_file> outdated;
+        for (auto& file : media_index_->media()) {
+            boost::system::error_code ec;
+            const auto                written = boost::filesystem::last_write_time(thumbnail_path(file.path), ec);
+            if (ec || written < file.mtime)
+                outdated.push_back(std::move(file));
+        }
+
+        const auto reply = std::wstring(L"202 THUMBNAIL GENERATE_ALL OK\r\n");
+        if (outdated.empty())
+            return make_ready_future(reply);
+
+        CASPAR_LOG(info) << L"[thumbnails] Generating " << outdated.size() << L" thumbnails.";
+
+        auto promise   = std::make_shared<std::promise<std::wstring>>();
+        auto remaining = std::make_shared<std::atomic<std::size_t>>(outdated.size());
+        for (auto& file : outdated) {
+            schedule(file, [promise, remaining, reply](bool) {
+                if (--*remaining == 0)
+                    promise->set_value(reply);
+            });
+        }
+        return promise->get_future();
+    }
+
+    std::wstring list() const
+    {
+        namespace fs = boost::filesystem;
+
+        std::vector<std::wstring> lines;
+
+        boost::system::error_code        ec;
+        fs::recursive_directory_iterator it(folder_, fs::directory_options::skip_permission_denied, ec), end;
+        for (; !ec && it != end; it.increment(ec)) {
+            if (!fs::is_regular_file(it->status(ec)) || !boost::iequals(it->path().extension().wstring(), L".png"))
+                continue;
+
+            const auto size  = fs::file_size(it->path(), ec);
+            const auto mtime = fs::last_write_time(it->path(), ec);
+            if (ec)
+                break;
+
+            const auto id = normalize(get_relative_without_extension(it->path(), folder_).generic_wstring());
+            lines.push_back(L"\"" + id + L"\" " + format_time(mtime) + L" " + std::to_wstring(size));
+        }
+        std::sort(lines.begin(), lines.end());
+
+        std::wstring result = L"200 THUMBNAIL LIST OK\r\n";
+        for (auto& line : lines) {
+            result += line;
+            result += L"\r\n";
+        }
+        return result + L"\r\n";
+    }
+
+    std::wstring retrieve(const std::wstring& name) const
+    {
+        auto file = find_case_insensitive(folder_ + boost::replace_all_copy(name, L"\\", L"/") + L".png");
+        if (!file)
+            return L"404 THUMBNAIL RETRIEVE ERROR\r\n";
+
+        boost::filesystem::ifstream in(*file, std::ios::binary);
+        std::vector<char>           data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (!in && !in.eof())
+            return L"404 THUMBNAIL RETRIEVE ERROR\r\n";
+
+        return L"201 THUMBNAIL RETRIEVE OK\r\n" + u16(to_base64(data.data(), data.size())) + L"\r\n";
+    }
+};
+
+thumbnail_generator::thumbnail_generator(spl::shared_ptr<const core::frame_producer_registry> producer_registry,
+                                         std::shared_ptr<core::image_mixer>                   image_mixer,
+                                         std::shared_ptr<media_index>                         media_index,
+                                         std::wstring                                         folder,
+                                         int                                                  width,
+                                         int                                                  height,
+                                         int                                                  threads)
+    : impl_(new impl(std::move(producer_registry),
+                     std::move(image_mixer),
+                     std::move(media_index),
+                     std::move(folder),
+                     width,
+                     height,
+                     threads))
+{
+}
+
+thumbnail_generator::~thumbnail_generator() {}
+
+bool thumbnail_generator::available() const { return impl_->producer_registry_->has_thumbnail_support(); }
+
+std::wstring thumbnail_generator::list() const { return impl_->list(); }
+
+std::wstring thumbnail_generator::retrieve(const std::wstring& name) const { return impl_->retrieve(name); }
+
+std::future<std::wstring> thumbnail_generator::generate(const std::wstring& name) { return impl_->generate(name); }
+
+std::future<std::wstring> thumbnail_generator::generate_all() { return impl_->generate_all(); }
+
+}}} // namespace caspar::protocol::amcp
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/fwd.h>
+
+#include <future>
+#include <memory>
+#include <string>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+class media_index;
+
+/**
+ * Generates the thumbnails of THUMBNAIL GENERATE and GENERATE_ALL in the server, instead of having the media scanner
+ * decode every file on the cpu. Modules decode a keyframe of the file, the gpu scales it and the png is written on a
+ * few threads that only run when the cpus would otherwise idle. LIST and RETRIEVE answer from the thumbnail folder.
+ */
+class thumbnail_generator
+{
+  public:
+    // A height of 0 keeps the aspect ratio of the media.
+    thumbnail_generator(spl::shared_ptr<const core::frame_producer_registry> producer_registry,
+                        std::shared_ptr<core::image_mixer>                   image_mixer,
+                        std::shared_ptr<media_index>                         media_index,
+                        std::wstring                                         folder,
+                        int                                                  width,
+                        int                                                  height,
+                        int                                                  threads);
+    ~thumbnail_generator();
+
+    thumbnail_generator(const thumbnail_generator&)            = delete;
+    thumbnail_generator& operator=(const thumbnail_generator&) = delete;
+
+    // False until a module that can decode and write thumbnails has registered, the media scanner answers until then.
+    bool available() const;
+
+    // Complete AMCP replies, the futures are ready once the thumbnails have been written.
+    std::wstring              list() const;
+    std::wstring              retrieve(const std::wstring& name) const;
+    std::future<std::wstring> generate(const std::wstring& name);
+    std::future<std::wstring> generate_all();
+
+  private:
+    struct impl;
+    spl::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::amcp
@@ -27,17 +27,30 @@
 #include "oscpack/OscOutboundPacketStream.h"
 
 #include <common/endian.h>
+#include <common/env.h>
 #include <common/utf.h>
 
 #include <core/monitor/monitor.h>
 
 #include <boost/asio.hpp>
+#include <boost/property_tree/ptree.hpp>
 
+#include <atomic>
+#include <cerrno>
+#include <chrono>
 #include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 
+#if defined(__linux__)
+#include <sys/socket.h>
+#endif
+
 using namespace boost::asio::ip;
 
 namespace caspar { namespace protocol { namespace osc {
@@ -63,17 +76,84 @@ struct param_visitor : public boost::static_visitor<void>
     void operator()(const std::wstring& value) { o << u8(value).c_str(); }
 };
 
+void write_message(::osc::OutboundPacketStream& o, const std::string& address, const core::monitor::vector_t& values)
+{
+    o << ::osc::BeginMessage(address.c_str());
+
+    param_visitor<::osc::OutboundPacketStream> param_visitor(o);
+    for (const auto& element : values) {
+        boost::apply_visitor(param_visitor, element);
+    }
+
+    o << ::osc::EndMessage;
+}
+
+// Whether address is below one of the prefixes. Prefixes match whole path segments, "/channel/1" does not match
+// "/channel/10". No prefixes match every address.
+static bool matches(const std::vector<std::string>* prefixes, const std::string& address)
+{
+    if (!prefixes)
+        return true;
+
+    for (auto& prefix : *prefixes) {
+        if (address.compare(0, prefix.size(), prefix) == 0 &&
+            (address.size() == prefix.size() || address[prefix.size()] == '/' || prefix.back() == '/'))
+            return true;
+    }
+
+    return false;
+}
+
 struct client::impl : public spl::enable_shared_from_this<client::impl>
 {
-    std::shared_ptr<boost::asio::io_context> service_;
-    udp::socket                              socket_;
-    std::map<udp::endpoint, int>             reference_counts_by_endpoint_;
-    std::vector<char>                        buffer_;
+    // Bundles are at most this big before the next message is started, and datagrams are sent in batches once the
+    // buffer has less than max_datagram_size left.
+    static constexpr std::size_t max_bundle_size   = 2048;
+    static constexpr std::size_t max_datagram_size = 65507;
+
+    // Sinks aren't held to datagrams, their bundles are only split to leave room in the buffer for the last message.
+    static constexpr std::size_t max_sink_bundle_size = 32768;
+
+    using sink_t = std::function<void(const char*, std::size_t)>;
+
+    struct destination
+    {
+        // The prefixes of each token checked out for the endpoint, an empty list subscribes to everything.
+        std::map<int, std::vector<std::string>>         filters;
+        std::shared_ptr<const std::vector<std::string>> prefixes; // union of filters, null for everything
+        sink_t                                          sink;     // or sent to the endpoint if empty
 
-    std::mutex              mutex_;
-    std::condition_variable cond_;
-    core::monitor::state    bundle_;
-    uint64_t                bundle_time_ = 0;
+        // Only touched from the sending thread.
+        core::monitor::data_map_t             sent;
+        std::chrono::steady_clock::time_point last_refresh;
+    };
+
+    struct target
+    {
+        udp::endpoint                                   endpoint;
+        std::shared_ptr<destination>                    dest;
+        std::shared_ptr<const std::vector<std::string>> prefixes;
+    };
+
+    struct datagram
+    {
+        const char*   data;
+        std::size_t   size;
+        udp::endpoint endpoint;
+    };
+
+    std::shared_ptr<boost::asio::io_context>              service_;
+    udp::socket                                           socket_;
+    std::map<udp::endpoint, std::shared_ptr<destination>> destinations_;
+    std::map<int, std::shared_ptr<destination>>           sinks_; // by filter
+    int                                                   next_filter_ = 0;
+    std::vector<char>                                     buffer_;
+    const std::chrono::milliseconds                       refresh_interval_;
+
+    std::mutex                mutex_;
+    std::condition_variable   cond_;
+    core::monitor::data_map_t bundle_; // the latest values of every channel since the last bundle
+    uint64_t                  bundle_time_ = 0;
 
     uint64_t time_ = 0;
 
@@ -85,13 +165,14 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
         : service_(std::move(service))
         , socket_(*service_, udp::v4())
         , buffer_(1000000)
+        , refresh_interval_(env::properties().get(L"configuration.osc.full-refresh", 1000))
     {
         thread_ = std::thread([=] {
             try {
                 while (!abort_request_) {
-                    core::monitor::state       bundle;
-                    uint64_t                   bundle_time;
-                    std::vector<udp::endpoint> endpoints;
+                    core::monitor::data_map_t bundle;
+                    uint64_t                  bundle_time;
+                    std::vector<target>       targets;
 
                     {
                         std::unique_lock<std::mutex> lock(mutex_);
@@ -101,48 +182,79 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
                             return;
                         }
 
-                        bundle       = std::move(bundle_);
+                        bundle.swap(bundle_);
                         bundle_time  = bundle_time_;
                         bundle_time_ = 0;
 
-                        for (auto& p : reference_counts_by_endpoint_) {
-                            endpoints.push_back(p.first);
+                        for (auto& p : destinations_) {
+                            targets.push_back(target{p.first, p.second, p.second->prefixes});
+                        }
+                        for (auto& p : sinks_) {
+                            targets.push_back(target{udp::endpoint(), p.second, p.second->prefixes});
                         }
                     }
 
-                    if (endpoints.empty()) {
-                        continue;
-                    }
+                    std::vector<datagram> datagrams;
+                    std::size_t           offset = 0;
 
-                    auto it = std::begin(bundle);
+                    for (auto& target : targets) {
+                        auto& dest = *target.dest;
 
-                    while (it != std::end(bundle)) {
-                        ::osc::OutboundPacketStream o(reinterpret_cast<char*>(buffer_.data()),
-                                                      static_cast<unsigned long>(buffer_.size()));
+                        // Forgetting what was sent makes every value go out again as it next arrives.
+                        const auto now = std::chrono::steady_clock::now();
+                        if (now - dest.last_refresh >= refresh_interval_) {
+                            dest.sent.clear();
+                            dest.last_refresh = now;
+                        }
 
-                        o << ::osc::BeginBundle(bundle_time);
+                        const auto bundle_size = dest.sink ? max_sink_bundle_size : max_bundle_size;
 
-                        // TODO (fix): < 2048 is a hack. Properly calculate if messages will fit.
-                        while (it != std::end(bundle) && o.Size() < 2048) {
-                            o << ::osc::BeginMessage(it->first.c_str());
+                        auto it = std::begin(bundle);
 
-                            param_visitor<decltype(o)> param_visitor(o);
-                            for (const auto& element : it->second) {
-                                boost::apply_visitor(param_visitor, element);
+                        while (it != std::end(bundle)) {
+                            if (buffer_.size() - offset < max_datagram_size) {
+                                send_datagrams(datagrams);
+                                datagrams.clear();
+                                offset = 0;
                             }
 
-                            o << ::osc::EndMessage;
+                            ::osc::OutboundPacketStream o(buffer_.data() + offset,
+                                                          static_cast<unsigned long>(max_datagram_size));
 
-                            ++it;
-                        }
+                            o << ::osc::BeginBundle(bundle_time);
+
+                            bool empty = true;
+                            while (it != std::end(bundle) && o.Size() < bundle_size) {
+                                auto& message = *it++;
 
-                        o << ::osc::EndBundle;
+                                if (!matches(target.prefixes.get(), message.first))
+                                    continue;
 
-                        boost::system::error_code ec;
-                        for (const auto& endpoint : endpoints) {
-                            socket_.send_to(boost::asio::buffer(o.Data(), o.Size()), endpoint, 0, ec);
+                                auto sent = dest.sent.lower_bound(message.first);
+                                if (sent != dest.sent.end() && sent->first == message.first) {
+                                    if (sent->second == message.second)
+                                        continue;
+                                    sent->second = message.second;
+                                } else {
+                                    dest.sent.emplace_hint(sent, message.first, message.second);
+                                }
+
+                                write_message(o, message.first, message.second);
+                                empty = false;
+                            }
+
+                            o << ::osc::EndBundle;
+
+                            if (!empty && dest.sink) {
+                                dest.sink(o.Data(), o.Size());
+                            } else if (!empty) {
+                                datagrams.push_back(datagram{o.Data(), o.Size(), target.endpoint});
+                                offset += o.Size();
+                            }
                         }
                     }
+
+                    send_datagrams(datagrams);
                 }
             } catch (...) {
                 CASPAR_LOG_CURRENT_EXCEPTION();
@@ -157,16 +269,76 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
         thread_.join();
     }
 
+    // Sends the bundles of all destinations with one system call where the platform has one. Failures are ignored
+    // like before, a destination that went away should not hold up the others.
+    void send_datagrams(const std::vector<datagram>& datagrams)
+    {
+#if defined(__linux__)
+        std::vector<udp::endpoint> endpoints(datagrams.size());
+        std::vector<mmsghdr>       messages(datagrams.size());
+        std::vector<iovec>         vectors(datagrams.size());
+        for (size_t n = 0; n < datagrams.size(); n++) {
+            vectors[n].iov_base = const_cast<char*>(datagrams[n].data);
+            vectors[n].iov_len  = datagrams[n].size;
+
+            endpoints[n]                    = datagrams[n].endpoint;
+            messages[n].msg_hdr             = {};
+            messages[n].msg_hdr.msg_name    = endpoints[n].data();
+            messages[n].msg_hdr.msg_namelen = static_cast<socklen_t>(endpoints[n].size());
+            messages[n].msg_hdr.msg_iov     = &vectors[n];
+            messages[n].msg_hdr.msg_iovlen  = 1;
+        }
+
+        size_t sent = 0;
+        while (sent < messages.size()) {
+            auto result = ::sendmmsg(
+                socket_.native_handle(), messages.data() + sent, static_cast<unsigned int>(messages.size() - sent), 0);
+            if (result < 0) {
+                if (errno == EINTR)
+                    continue;
+                // Skip the datagram that failed.
+                result = 1;
+            }
+            sent += result;
+        }
+#else
+        boost::system::error_code ec;
+        for (auto& datagram : datagrams) {
+            socket_.send_to(boost::asio::buffer(datagram.data, datagram.size), datagram.endpoint, 0, ec);
+        }
+#endif
+    }
+
+    static void update_prefixes(destination& dest)
+    {
+        auto prefixes = std::make_shared<std::vector<std::string>>();
+        for (auto& filter : dest.filters) {
+            if (filter.second.empty()) {
+                dest.prefixes = nullptr;
+                return;
+            }
+            prefixes->insert(prefixes->end(), filter.second.begin(), filter.second.end());
+        }
+        dest.prefixes = std::move(prefixes);
+    }
+
     // TODO (refactor) This is wierd...
-    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint)
+    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint,
+                                                 std::vector<std::string>              prefixes)
     {
         std::lock_guard<std::mutex> lock(mutex_);
 
-        ++reference_counts_by_endpoint_[endpoint];
+        auto& dest = destinations_[endpoint];
+        if (!dest)
+            dest = std::make_shared<destination>();
+
+        const auto filter     = next_filter_++;
+        dest->filters[filter] = std::move(prefixes);
+        update_prefixes(*dest);
 
         std::weak_ptr<impl> weak_self = shared_from_this();
 
-        return std::shared_ptr<void>(nullptr, [weak_self, endpoint](void*) {
+        return std::shared_ptr<void>(nullptr, [weak_self, endpoint, filter](void*) {
             auto strong = weak_self.lock();
 
             if (!strong)
@@ -176,14 +348,44 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
 
             std::lock_guard<std::mutex> lock(self.mutex_);
 
-            int reference_count_after = --self.reference_counts_by_endpoint_[endpoint];
+            auto it = self.destinations_.find(endpoint);
+            if (it == self.destinations_.end())
+                return;
+
+            it->second->filters.erase(filter);
 
-            if (reference_count_after == 0) {
-                self.reference_counts_by_endpoint_.erase(endpoint);
+            if (it->second->filters.empty()) {
+                self.destinations_.erase(it);
+            } else {
+                update_prefixes(*it->second);
             }
         });
     }
 
+    std::shared_ptr<void> get_subscription_token(sink_t sink, std::vector<std::string> prefixes)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const auto filter     = next_filter_++;
+        auto       dest       = std::make_shared<destination>();
+        dest->filters[filter] = std::move(prefixes);
+        dest->sink            = std::move(sink);
+        update_prefixes(*dest);
+        sinks_[filter] = std::move(dest);
+
+        std::weak_ptr<impl> weak_self = shared_from_this();
+
+        return std::shared_ptr<void>(nullptr, [weak_self, filter](void*) {
+            auto strong = weak_self.lock();
+
+            if (!strong)
+                return;
+
+            std::lock_guard<std::mutex> lock(strong->mutex_);
+            strong->sinks_.erase(filter);
+        });
+    }
+
     void send(const core::monitor::state& state)
     {
         {
@@ -191,7 +393,11 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
 
             // TODO: time_++ is a hack. Use proper channel time.
             bundle_time_ = time_++;
-            bundle_      = state;
+
+            // Every channel sends its own state, keep the others' values until the bundle has gone out.
+            for (auto& p : state) {
+                bundle_[p.first] = p.second;
+            }
         }
         cond_.notify_all();
     }
@@ -215,9 +421,16 @@ client& client::operator=(client&& other)
 
 client::~client() {}
 
-std::shared_ptr<void> client::get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint)
+std::shared_ptr<void> client::get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint,
+                                                     std::vector<std::string>              prefixes)
+{
+    return impl_->get_subscription_token(endpoint, std::move(prefixes));
+}
+
+std::shared_ptr<void> client::get_subscription_token(std::function<void(const char*, std::size_t)> sink,
+                                                     std::vector<std::string>                        prefixes)
 {
-    return impl_->get_subscription_token(endpoint);
+    return impl_->get_subscription_token(std::move(sink), std::move(prefixes));
 }
 
 void client::send(const core::monitor::state& state) { impl_->send(state); }
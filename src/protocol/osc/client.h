@@ -27,8 +27,21 @@
 #include <common/memory.h>
 #include <core/monitor/monitor.h>
 
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace osc {
+class OutboundPacketStream;
+}
+
 namespace caspar { namespace protocol { namespace osc {
 
+// Appends one message with the values of a monitor state entry to a packet, as the client does for each value that
+// changed.
+void write_message(::osc::OutboundPacketStream& o, const std::string& address, const core::monitor::vector_t& values);
+
 class client
 {
     client(const client&);
@@ -45,11 +58,27 @@ class client
      * the token is dropped unless another token to the same endpoint has
      * previously been checked out.
      *
+     * Only values that changed since they were last sent to the endpoint go
+     * out, and everything is sent again every full-refresh interval.
+     *
      * @param endpoint The UDP endpoint to send OSC messages to.
+     * @param prefixes The address prefixes to send, like /channel/1/stage.
+     *                 Empty sends everything. The endpoint gets the union of
+     *                 the prefixes of all its tokens.
      *
      * @return The token. It is ok for the token to outlive the client
      */
-    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint);
+    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint,
+                                                 std::vector<std::string>              prefixes = {});
+
+    /**
+     * Like the endpoint subscription, but hands each OSC bundle to sink
+     * instead. For connections that carry the bundles themselves, such as
+     * WebSockets. sink is called from the sending thread of the client and
+     * must copy the data and return quickly.
+     */
+    std::shared_ptr<void> get_subscription_token(std::function<void(const char* data, std::size_t size)> sink,
+                                                 std::vector<std::string>                                prefixes = {});
 
     ~client();
 
@@ -27,6 +27,7 @@
 #include <array>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 
@@ -41,15 +42,52 @@ namespace caspar { namespace IO {
 
 class connection;
 
-using connection_set = std::set<spl::shared_ptr<connection>>;
+// The open connections of one server. The io_service runs on several threads, so this is touched from the strands
+// of all its connections and from the acceptor at once.
+class connection_set
+{
+    mutable std::mutex                    mutex_;
+    std::set<spl::shared_ptr<connection>> connections_;
+
+  public:
+    std::size_t insert(const spl::shared_ptr<connection>& conn)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_.insert(conn);
+        return connections_.size();
+    }
+
+    std::size_t erase(const spl::shared_ptr<connection>& conn)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_.erase(conn);
+        return connections_.size();
+    }
+
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return connections_.size();
+    }
+
+    std::set<spl::shared_ptr<connection>> snapshot() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return connections_;
+    }
+};
 
 class connection : public spl::enable_shared_from_this<connection>
 {
     using lifecycle_map_type = tbb::concurrent_hash_map<std::wstring, std::shared_ptr<void>>;
     using send_queue         = tbb::concurrent_queue<std::string>;
 
+    // Replies queued while a write is in flight are sent together, up to this many bytes per write.
+    static constexpr std::size_t max_coalesced_write = 64 * 1024;
+
     const spl::shared_ptr<tcp::socket>       socket_;
     std::shared_ptr<boost::asio::io_service> service_;
+    boost::asio::io_service::strand          strand_;
     const std::wstring                       listen_port_;
     const spl::shared_ptr<connection_set>    connection_set_;
     protocol_strategy_factory<char>::ptr     protocol_factory_;
@@ -58,6 +96,7 @@ class connection : public spl::enable_shared_from_this<connection>
     std::array<char, 32768> data_;
     lifecycle_map_type      lifecycle_bound_objects_;
     send_queue              send_queue_;
+    std::string             write_buffer_;
     bool                    is_writing_;
 
     class connection_holder : public client_connection<char>
@@ -143,13 +182,13 @@ class connection : public spl::enable_shared_from_this<connection>
     {
         send_queue_.push(std::move(data));
         auto self = shared_from_this();
-        service_->dispatch([=] { self->do_write(); });
+        boost::asio::dispatch(strand_, [=] { self->do_write(); });
     }
 
     void disconnect()
     {
         std::weak_ptr<connection> self = shared_from_this();
-        service_->dispatch([=] {
+        boost::asio::dispatch(strand_, [=] {
             auto strong = self.lock();
 
             if (strong)
@@ -175,21 +214,39 @@ class connection : public spl::enable_shared_from_this<connection>
     }
 
   private:
-    void do_write() // always called from the asio-service-thread
+    void do_write() // always called from the connection's strand
     {
-        if (!is_writing_) {
-            std::string data;
-            if (send_queue_.try_pop(data)) {
-                write_some(std::move(data));
-            }
+        if (is_writing_)
+            return;
+
+        write_buffer_.clear();
+
+        std::string data;
+        while (write_buffer_.size() < max_coalesced_write && send_queue_.try_pop(data)) {
+            if (write_buffer_.empty())
+                write_buffer_.swap(data);
+            else
+                write_buffer_ += data;
         }
+
+        if (write_buffer_.empty())
+            return;
+
+        is_writing_ = true;
+        boost::asio::async_write(*socket_,
+                                 boost::asio::buffer(write_buffer_),
+                                 boost::asio::bind_executor(strand_,
+                                                            std::bind(&connection::handle_write,
+                                                                      shared_from_this(),
+                                                                      std::placeholders::_1,
+                                                                      std::placeholders::_2)));
     }
 
-    void stop() // always called from the asio-service-thread
+    void stop() // always called from the connection's strand
     {
-        connection_set_->erase(shared_from_this());
+        const auto remaining = connection_set_->erase(shared_from_this());
 
-        CASPAR_LOG(info) << print() << L" Client " << ipv4_address() << L" disconnected (" << connection_set_->size()
+        CASPAR_LOG(info) << print() << L" Client " << ipv4_address() << L" disconnected (" << remaining
                          << L" connections).";
 
         boost::system::error_code ec;
@@ -203,6 +260,7 @@ class connection : public spl::enable_shared_from_this<connection>
                const spl::shared_ptr<connection_set>&          connection_set)
         : socket_(socket)
         , service_(service)
+        , strand_(*service_)
         , listen_port_(socket_->is_open() ? std::to_wstring(socket_->local_endpoint().port()) : L"no-port")
         , connection_set_(connection_set)
         , protocol_factory_(protocol_factory)
@@ -213,7 +271,7 @@ class connection : public spl::enable_shared_from_this<connection>
     }
 
     void handle_read(const boost::system::error_code& error,
-                     size_t                           bytes_transferred) // always called from the asio-service-thread
+                     size_t                           bytes_transferred) // always called from the connection's strand
     {
         if (!error) {
             try {
@@ -229,42 +287,23 @@ class connection : public spl::enable_shared_from_this<connection>
             stop();
     }
 
-    void handle_write(const spl::shared_ptr<std::string>& str,
-                      const boost::system::error_code&    error,
-                      size_t bytes_transferred) // always called from the asio-service-thread
+    void handle_write(const boost::system::error_code& error,
+                      size_t bytes_transferred) // always called from the connection's strand
     {
         if (!error) {
-            if (bytes_transferred != str->size()) {
-                str->assign(str->substr(bytes_transferred));
-                socket_->async_write_some(boost::asio::buffer(str->data(), str->size()),
-                                          std::bind(&connection::handle_write,
-                                                    shared_from_this(),
-                                                    str,
-                                                    std::placeholders::_1,
-                                                    std::placeholders::_2));
-            } else {
-                is_writing_ = false;
-                do_write();
-            }
+            is_writing_ = false;
+            do_write();
         } else if (error != boost::asio::error::operation_aborted && socket_->is_open())
             stop();
     }
 
-    void read_some() // always called from the asio-service-thread
+    void read_some() // always called from the connection's strand
     {
         socket_->async_read_some(
             boost::asio::buffer(data_.data(), data_.size()),
-            std::bind(&connection::handle_read, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
-    }
-
-    void write_some(std::string&& data) // always called from the asio-service-thread
-    {
-        is_writing_ = true;
-        auto str    = spl::make_shared<std::string>(std::move(data));
-        socket_->async_write_some(
-            boost::asio::buffer(str->data(), str->size()),
-            std::bind(
-                &connection::handle_write, shared_from_this(), str, std::placeholders::_1, std::placeholders::_2));
+            boost::asio::bind_executor(
+                strand_,
+                std::bind(&connection::handle_read, shared_from_this(), std::placeholders::_1, std::placeholders::_2)));
     }
 
     friend struct AsyncEventServer::implementation;
@@ -273,15 +312,17 @@ class connection : public spl::enable_shared_from_this<connection>
 struct AsyncEventServer::implementation : public spl::enable_shared_from_this<implementation>
 {
     std::shared_ptr<boost::asio::io_service> service_;
+    boost::asio::io_service::strand          strand_;
     tcp::acceptor                            acceptor_;
     protocol_strategy_factory<char>::ptr     protocol_factory_;
     spl::shared_ptr<connection_set>          connection_set_;
-    std::vector<lifecycle_factory_t>         lifecycle_factories_;
+    std::vector<lifecycle_factory_t>         lifecycle_factories_; // only touched from strand_
 
     implementation(std::shared_ptr<boost::asio::io_service>    service,
                    const protocol_strategy_factory<char>::ptr& protocol,
                    unsigned short                              port)
         : service_(std::move(service))
+        , strand_(*service_)
         , acceptor_(*service_, tcp::endpoint(tcp::v4(), port))
         , protocol_factory_(protocol)
     {
@@ -299,20 +340,18 @@ struct AsyncEventServer::implementation : public spl::enable_shared_from_this<im
 
     ~implementation()
     {
-        auto conns_set = connection_set_;
-
-        service_->post([conns_set] {
-            auto connections = *conns_set;
-            for (auto& connection : connections)
-                connection->stop();
-        });
+        for (auto& connection : connection_set_->snapshot())
+            connection->disconnect();
     }
 
     void start_accept()
     {
         spl::shared_ptr<tcp::socket> socket(new tcp::socket(*service_));
         acceptor_.async_accept(
-            *socket, std::bind(&implementation::handle_accept, shared_from_this(), socket, std::placeholders::_1));
+            *socket,
+            boost::asio::bind_executor(
+                strand_,
+                std::bind(&implementation::handle_accept, shared_from_this(), socket, std::placeholders::_1)));
     }
 
     void handle_accept(const spl::shared_ptr<tcp::socket>& socket, const boost::system::error_code& error)
@@ -346,7 +385,7 @@ struct AsyncEventServer::implementation : public spl::enable_shared_from_this<im
     void add_client_lifecycle_object_factory(const lifecycle_factory_t& factory)
     {
         auto self = shared_from_this();
-        service_->post([=] { self->lifecycle_factories_.push_back(factory); });
+        boost::asio::post(strand_, [=] { self->lifecycle_factories_.push_back(factory); });
     }
 };
 
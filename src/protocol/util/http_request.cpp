@@ -1,105 +1,414 @@
 #include "http_request.h"
 
 #include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
 
+#include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
+
+#include <chrono>
+#include <future>
 #include <iomanip>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 namespace caspar { namespace http {
 
-HTTPResponse request(const std::string& host, const std::string& port, const std::string& path)
+namespace {
+
+using boost::asio::ip::tcp;
+
+// Servers drop idle keep-alive connections after a few seconds (node defaults to 5), don't reuse them past that.
+const auto idle_timeout    = std::chrono::seconds(4);
+const auto request_timeout = std::chrono::seconds(60);
+
+class connection_pool
 {
-    using boost::asio::ip::tcp;
-    using namespace boost;
+    struct idle_connection
+    {
+        std::shared_ptr<tcp::socket>          socket;
+        std::chrono::steady_clock::time_point since;
+    };
 
-    HTTPResponse res;
+    boost::asio::io_context                                                  io_context_;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_;
+    std::thread                                                              thread_;
 
-    asio::io_service io_service;
+    std::mutex                                          mutex_;
+    std::map<std::string, std::vector<idle_connection>> idle_;
 
-    // Get a list of endpoints corresponding to the server name.
-    tcp::resolver           resolver(io_service);
-    tcp::resolver::query    query(host, port, boost::asio::ip::resolver_query_base::numeric_service);
-    tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
+  public:
+    connection_pool()
+        : work_(boost::asio::make_work_guard(io_context_))
+        , thread_([this] {
+            set_thread_name(L"http-client");
+            io_context_.run();
+        })
+    {
+    }
 
-    // Try each endpoint until we successfully establish a connection.
-    tcp::socket               socket(io_service);
-    boost::system::error_code error;
-    asio::connect(socket, endpoint_iterator, error);
-    if (error == asio::error::connection_refused) {
-        res.status_code    = 503;
-        res.status_message = "Connection refused";
-        return res;
+    ~connection_pool()
+    {
+        work_.reset();
+        io_context_.stop();
+        thread_.join();
     }
-    if (error) {
-        CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
+
+    static connection_pool& instance()
+    {
+        static connection_pool pool;
+        return pool;
     }
 
-    // Form the request. We specify the "Connection: close" header so that the
-    // server will close the socket after transmitting the response. This will
-    // allow us to treat all data up until the EOF as the content.
-    asio::streambuf request;
-    std::ostream    request_stream(&request);
-    request_stream << "GET " << path << " HTTP/1.0\r\n";
-    request_stream << "Host: " << host << ":" << port << "\r\n";
-    request_stream << "Accept: */*\r\n";
-    request_stream << "Connection: close\r\n\r\n";
+    boost::asio::io_context& io_context() { return io_context_; }
+
+    std::shared_ptr<tcp::socket> checkout(const std::string& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
 
-    // Send the request.
-    asio::write(socket, request);
+        auto& idle = idle_[key];
+        while (!idle.empty()) {
+            auto connection = std::move(idle.back());
+            idle.pop_back();
+            if (std::chrono::steady_clock::now() - connection.since < idle_timeout && connection.socket->is_open())
+                return connection.socket;
+        }
+        return nullptr;
+    }
+
+    void checkin(const std::string& key, std::shared_ptr<tcp::socket> socket)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_[key].push_back({std::move(socket), std::chrono::steady_clock::now()});
+    }
+};
 
-    // Read the response status line. The response streambuf will automatically
-    // grow to accommodate the entire line. The growth may be limited by passing
-    // a maximum size to the streambuf constructor.
-    asio::streambuf response;
-    asio::read_until(socket, response, "\r\n");
+class pending_request : public std::enable_shared_from_this<pending_request>
+{
+    connection_pool&          pool_;
+    const std::string         host_;
+    const std::string         port_;
+    const std::string         key_;
+    const std::string         request_;
+    const response_handler_t  handler_;
+    tcp::resolver             resolver_;
+    boost::asio::steady_timer timer_;
 
-    // Check that response is OK.
-    std::istream response_stream(&response);
-    std::string  http_version;
-    response_stream >> http_version;
-    response_stream >> res.status_code;
-    std::getline(response_stream, res.status_message);
+    std::shared_ptr<tcp::socket> socket_;
+    bool                         reused_ = false;
+    boost::asio::streambuf       response_;
+    HTTPResponse                 res_;
+    bool                         keep_alive_ = true;
+    bool                         done_       = false;
 
-    if (!response_stream || http_version.substr(0, 5) != "HTTP/") {
-        // TODO
-        CASPAR_THROW_EXCEPTION(io_error() << msg_info("Invalid Response"));
+  public:
+    pending_request(connection_pool&   pool,
+                    const std::string& host,
+                    const std::string& port,
+                    const std::string& path,
+                    response_handler_t handler)
+        : pool_(pool)
+        , host_(host)
+        , port_(port)
+        , key_(host + ":" + port)
+        , request_("GET " + path + " HTTP/1.1\r\nHost: " + host + ":" + port +
+                   "\r\nAccept: */*\r\nConnection: keep-alive\r\n\r\n")
+        , handler_(std::move(handler))
+        , resolver_(pool.io_context())
+        , timer_(pool.io_context())
+    {
     }
 
-    if (res.status_code < 200 || res.status_code >= 300) {
-        // TODO
-        CASPAR_THROW_EXCEPTION(io_error() << msg_info("Invalid Response"));
+    void start()
+    {
+        auto self = shared_from_this();
+
+        timer_.expires_after(request_timeout);
+        timer_.async_wait([self](const boost::system::error_code& ec) {
+            if (ec)
+                return;
+            self->resolver_.cancel();
+            if (self->socket_)
+                self->socket_->close();
+        });
+
+        socket_ = pool_.checkout(key_);
+        reused_ = socket_ != nullptr;
+        if (reused_)
+            send();
+        else
+            connect();
     }
 
-    // Read the response headers, which are terminated by a blank line.
-    asio::read_until(socket, response, "\r\n\r\n");
+  private:
+    void connect()
+    {
+        auto self = shared_from_this();
+        resolver_.async_resolve(
+            host_,
+            port_,
+            tcp::resolver::numeric_service,
+            [self](const boost::system::error_code& ec, const tcp::resolver::results_type& endpoints) {
+                if (ec)
+                    return self->fail(ec);
 
-    // Process the response headers.
-    std::string header;
-    while (std::getline(response_stream, header) && header != "\r") {
-        // TODO
+                self->socket_ = std::make_shared<tcp::socket>(self->pool_.io_context());
+                boost::asio::async_connect(
+                    *self->socket_, endpoints, [self](const boost::system::error_code& ec, const tcp::endpoint&) {
+                        if (ec == boost::asio::error::connection_refused) {
+                            self->res_.status_code    = 503;
+                            self->res_.status_message = "Connection refused";
+                            return self->complete(nullptr);
+                        }
+                        if (ec)
+                            return self->fail(ec);
+                        self->send();
+                    });
+            });
     }
 
-    std::stringstream body;
+    void send()
+    {
+        auto self = shared_from_this();
+        boost::asio::async_write(
+            *socket_, boost::asio::buffer(request_), [self](const boost::system::error_code& ec, std::size_t) {
+                if (ec)
+                    return self->retry_or_fail(ec);
+                self->read_header();
+            });
+    }
 
-    // Write whatever content we already have to output.
-    if (response.size() > 0) {
-        body << &response;
+    void read_header()
+    {
+        auto self = shared_from_this();
+        boost::asio::async_read_until(
+            *socket_, response_, "\r\n\r\n", [self](const boost::system::error_code& ec, std::size_t) {
+                if (ec)
+                    return self->retry_or_fail(ec);
+                self->parse_header();
+            });
     }
 
-    // Read until EOF, writing data to output as we go.
-    while (asio::read(socket, response, asio::transfer_at_least(1), error)) {
-        body << &response;
+    void parse_header()
+    {
+        try {
+            parse_status_and_headers();
+        } catch (...) {
+            keep_alive_ = false;
+            complete(std::current_exception());
+        }
     }
 
-    if (error != asio::error::eof) {
-        CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
+    void parse_status_and_headers()
+    {
+        std::istream response_stream(&response_);
+        std::string  http_version;
+        response_stream >> http_version;
+        response_stream >> res_.status_code;
+        std::getline(response_stream, res_.status_message);
+        boost::trim(res_.status_message);
+
+        if (!response_stream || http_version.substr(0, 5) != "HTTP/")
+            return complete(std::make_exception_ptr(io_error() << msg_info("Invalid Response")));
+
+        if (res_.status_code < 200 || res_.status_code >= 300)
+            return complete(std::make_exception_ptr(io_error() << msg_info("Invalid Response")));
+
+        // Header names are stored lower case, their case carries no meaning.
+        std::string header;
+        while (std::getline(response_stream, header) && header != "\r") {
+            auto colon = header.find(':');
+            if (colon == std::string::npos)
+                continue;
+            res_.headers[boost::to_lower_copy(header.substr(0, colon))] = boost::trim_copy(header.substr(colon + 1));
+        }
+
+        keep_alive_ = http_version != "HTTP/1.0" && !boost::iequals(res_.headers["connection"], "close");
+
+        if (boost::iequals(res_.headers["transfer-encoding"], "chunked"))
+            return read_chunk_size();
+
+        auto content_length = res_.headers.find("content-length");
+        if (content_length != res_.headers.end())
+            return read_body(std::stoull(content_length->second));
+
+        // Without a length the body runs until the server closes the connection.
+        keep_alive_ = false;
+        read_until_eof();
+    }
+
+    void read_body(std::size_t length)
+    {
+        if (response_.size() >= length)
+            return finish_body(length);
+
+        auto self = shared_from_this();
+        boost::asio::async_read(*socket_,
+                                response_,
+                                boost::asio::transfer_exactly(length - response_.size()),
+                                [self, length](const boost::system::error_code& ec, std::size_t) {
+                                    if (ec)
+                                        return self->fail(ec);
+                                    self->finish_body(length);
+                                });
     }
 
-    res.body = body.str();
+    void finish_body(std::size_t length)
+    {
+        auto data = boost::asio::buffers_begin(response_.data());
+        res_.body.append(data, data + length);
+        response_.consume(length);
+        complete(nullptr);
+    }
+
+    void read_until_eof()
+    {
+        auto self = shared_from_this();
+        boost::asio::async_read(*socket_,
+                                response_,
+                                boost::asio::transfer_at_least(1),
+                                [self](const boost::system::error_code& ec, std::size_t) {
+                                    if (ec == boost::asio::error::eof)
+                                        return self->finish_body(self->response_.size());
+                                    if (ec)
+                                        return self->fail(ec);
+                                    self->read_until_eof();
+                                });
+    }
+
+    void read_chunk_size()
+    {
+        auto self = shared_from_this();
+        boost::asio::async_read_until(
+            *socket_, response_, "\r\n", [self](const boost::system::error_code& ec, std::size_t size) {
+                if (ec)
+                    return self->fail(ec);
+
+                auto        data = boost::asio::buffers_begin(self->response_.data());
+                std::string line(data, data + size);
+                self->response_.consume(size);
+
+                std::size_t length = 0;
+                try {
+                    length = std::stoull(line, nullptr, 16);
+                } catch (...) {
+                    self->keep_alive_ = false;
+                    return self->complete(std::current_exception());
+                }
+
+                if (length == 0)
+                    return self->read_trailer();
+                self->read_chunk(length);
+            });
+    }
+
+    void read_chunk(std::size_t length)
+    {
+        // The chunk data is followed by a CRLF.
+        const auto total = length + 2;
+        auto       self  = shared_from_this();
+        auto       done  = [self, length] {
+            auto data = boost::asio::buffers_begin(self->response_.data());
+            self->res_.body.append(data, data + length);
+            self->response_.consume(length + 2);
+            self->read_chunk_size();
+        };
+
+        if (response_.size() >= total)
+            return done();
+
+        boost::asio::async_read(*socket_,
+                                response_,
+                                boost::asio::transfer_exactly(total - response_.size()),
+                                [self, done](const boost::system::error_code& ec, std::size_t) {
+                                    if (ec)
+                                        return self->fail(ec);
+                                    done();
+                                });
+    }
+
+    void read_trailer()
+    {
+        auto self = shared_from_this();
+        boost::asio::async_read_until(
+            *socket_, response_, "\r\n", [self](const boost::system::error_code& ec, std::size_t size) {
+                if (ec)
+                    return self->fail(ec);
+
+                self->response_.consume(size);
+                if (size > 2)
+                    return self->read_trailer();
+                self->complete(nullptr);
+            });
+    }
+
+    void retry_or_fail(const boost::system::error_code& ec)
+    {
+        // A pooled connection may have been closed by the server while idle, which only shows once it is used.
+        if (reused_ && response_.size() == 0) {
+            reused_ = false;
+            socket_->close();
+            return connect();
+        }
+        fail(ec);
+    }
+
+    void fail(const boost::system::error_code& ec)
+    {
+        keep_alive_ = false;
+        complete(std::make_exception_ptr(io_error() << msg_info(ec.message())));
+    }
+
+    void complete(std::exception_ptr error)
+    {
+        if (done_)
+            return;
+        done_ = true;
+        timer_.cancel();
+
+        if (!error && keep_alive_ && socket_ && socket_->is_open() && response_.size() == 0)
+            pool_.checkin(key_, socket_);
+        else if (socket_)
+            socket_->close();
+
+        try {
+            handler_(error, std::move(res_));
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+};
+
+} // namespace
+
+void request_async(const std::string& host,
+                   const std::string& port,
+                   const std::string& path,
+                   response_handler_t handler)
+{
+    auto& pool = connection_pool::instance();
+    auto  req  = std::make_shared<pending_request>(pool, host, port, path, std::move(handler));
+    boost::asio::post(pool.io_context(), [req] { req->start(); });
+}
+
+HTTPResponse request(const std::string& host, const std::string& port, const std::string& path)
+{
+    std::promise<HTTPResponse> promise;
+    auto                       future = promise.get_future();
+
+    request_async(host, port, path, [&promise](std::exception_ptr error, HTTPResponse res) {
+        if (error)
+            promise.set_exception(error);
+        else
+            promise.set_value(std::move(res));
+    });
 
-    return res;
+    return future.get();
 }
 
 std::string url_encode(const std::string& str)
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <exception>
+#include <functional>
 #include <map>
 #include <string>
 
@@ -13,8 +15,17 @@ struct HTTPResponse
     std::string                        body;
 };
 
+using response_handler_t = std::function<void(std::exception_ptr error, HTTPResponse response)>;
+
 HTTPResponse request(const std::string& host, const std::string& port, const std::string& path);
 
+// Performs the request on a shared io thread, reusing idle keep-alive connections to the same host and port. The
+// handler is called on that thread and must not block.
+void request_async(const std::string& host,
+                   const std::string& port,
+                   const std::string& path,
+                   response_handler_t handler);
+
 std::string url_encode(const std::string& str);
 
 }} // namespace caspar::http
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metrics_server.h"
+
+#include <common/diagnostics/metrics.h>
+#include <common/log.h>
+
+#include <istream>
+#include <memory>
+#include <string>
+
+namespace caspar { namespace IO {
+
+using boost::asio::ip::tcp;
+
+namespace {
+
+// Scrapers send a single small request per connection, anything else is answered and the connection closed.
+class metrics_connection : public std::enable_shared_from_this<metrics_connection>
+{
+    tcp::socket            socket_;
+    boost::asio::streambuf request_{8192};
+    std::string            response_;
+
+  public:
+    explicit metrics_connection(tcp::socket socket)
+        : socket_(std::move(socket))
+    {
+    }
+
+    void start()
+    {
+        auto self = shared_from_this();
+        boost::asio::async_read_until(
+            socket_, request_, "\r\n\r\n", [self](const boost::system::error_code& ec, std::size_t) {
+                if (!ec)
+                    self->respond();
+            });
+    }
+
+  private:
+    void respond()
+    {
+        std::istream stream(&request_);
+        std::string  method;
+        std::string  target;
+        stream >> method >> target;
+
+        if (method != "GET") {
+            response_ = "HTTP/1.1 405 Method Not Allowed\r\nAllow: GET\r\n"
+                        "Content-Length: 0\r\nConnection: close\r\n\r\n";
+        } else if (target != "/metrics" && target.rfind("/metrics?", 0) != 0) {
+            response_ = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        } else {
+            auto body = diagnostics::metrics::write_text();
+            response_ = "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                        "Content-Length: " +
+                        std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        }
+
+        auto self = shared_from_this();
+        boost::asio::async_write(
+            socket_, boost::asio::buffer(response_), [self](const boost::system::error_code&, std::size_t) {
+                boost::system::error_code ec;
+                self->socket_.shutdown(tcp::socket::shutdown_both, ec);
+            });
+    }
+};
+
+} // namespace
+
+struct metrics_server::impl : public std::enable_shared_from_this<impl>
+{
+    std::shared_ptr<boost::asio::io_service> service_;
+    tcp::acceptor                            acceptor_;
+
+    impl(std::shared_ptr<boost::asio::io_service> service, unsigned short port)
+        : service_(std::move(service))
+        , acceptor_(*service_, tcp::endpoint(tcp::v4(), port))
+    {
+    }
+
+    void start_accept()
+    {
+        std::weak_ptr<impl> weak_self = shared_from_this();
+        acceptor_.async_accept([weak_self](const boost::system::error_code& ec, tcp::socket socket) {
+            auto self = weak_self.lock();
+            if (!self || ec == boost::asio::error::operation_aborted)
+                return;
+            if (!ec)
+                std::make_shared<metrics_connection>(std::move(socket))->start();
+            self->start_accept();
+        });
+    }
+
+    void stop()
+    {
+        boost::system::error_code ec;
+        acceptor_.close(ec);
+    }
+};
+
+metrics_server::metrics_server(std::shared_ptr<boost::asio::io_service> service, unsigned short port)
+    : impl_(spl::make_shared<impl>(std::move(service), port))
+{
+    impl_->start_accept();
+    CASPAR_LOG(info) << L"Serving metrics on port " << port;
+}
+
+metrics_server::~metrics_server()
+{
+    auto impl = impl_;
+    boost::asio::post(*impl->service_, [impl] { impl->stop(); });
+}
+
+}} // namespace caspar::IO
@@ -22,29 +22,48 @@
 namespace caspar { namespace IO {
 
 std::size_t tokenize(const std::wstring& message, std::list<std::wstring>& pTokenVector)
+{
+    std::vector<std::wstring_view> tokens;
+    std::wstring                   storage;
+    tokenize(message, tokens, storage);
+
+    pTokenVector.insert(pTokenVector.end(), tokens.begin(), tokens.end());
+    return pTokenVector.size();
+}
+
+std::size_t tokenize(std::wstring_view message, std::vector<std::wstring_view>& tokens, std::wstring& storage)
 {
     // split on whitespace but keep strings within quotationmarks
     // treat \ as the start of an escape-sequence: the following char will indicate what to actually put in the
     // string
 
-    std::wstring currentToken;
+    // No escape sequence or token separator makes the unescaped text longer than the message.
+    storage.clear();
+    storage.reserve(message.size());
+
+    std::size_t tokenStart = 0;
+
+    auto pushToken = [&] {
+        tokens.emplace_back(storage.data() + tokenStart, storage.size() - tokenStart);
+        tokenStart = storage.size();
+    };
 
     bool inQuote        = false;
     int  inParamList    = 0;
     bool getSpecialCode = false;
 
-    for (unsigned int charIndex = 0; charIndex < message.size(); ++charIndex) {
+    for (auto c : message) {
         if (getSpecialCode) {
             // insert code-handling here
-            switch (message[charIndex]) {
+            switch (c) {
                 case L'\\':
-                    currentToken += L"\\";
+                    storage += L'\\';
                     break;
                 case L'\"':
-                    currentToken += L"\"";
+                    storage += L'\"';
                     break;
                 case L'n':
-                    currentToken += L"\n";
+                    storage += L'\n';
                     break;
                 default:
                     break;
@@ -53,50 +72,46 @@ std::size_t tokenize(const std::wstring& message, std::list<std::wstring>& pToke
             continue;
         }
 
-        if (message[charIndex] == L'\\') {
+        if (c == L'\\') {
             getSpecialCode = true;
             continue;
         }
 
-        if (message[charIndex] == L' ' && inQuote == false && inParamList == 0) {
-            if (!currentToken.empty()) {
-                pTokenVector.push_back(currentToken);
-                currentToken.clear();
+        if (c == L' ' && inQuote == false && inParamList == 0) {
+            if (storage.size() > tokenStart) {
+                pushToken();
             }
             continue;
-        } else if (!inQuote && message[charIndex] == L'(') {
+        } else if (!inQuote && c == L'(') {
             inParamList++;
             // continue;
-        } else if (!inQuote && message[charIndex] == L')') {
+        } else if (!inQuote && c == L')') {
             inParamList--;
             if (inParamList == 0) {
-                currentToken += message[charIndex];
-                pTokenVector.push_back(currentToken);
-                currentToken.clear();
+                storage += c;
+                pushToken();
                 continue;
             }
             // continue;
-        } else if (message[charIndex] == L'\"') {
+        } else if (c == L'\"') {
             inQuote = !inQuote;
 
             if (inParamList == 0) {
                 if (!inQuote) {
-                    pTokenVector.push_back(currentToken);
-                    currentToken.clear();
+                    pushToken();
                 }
                 continue;
             }
         }
 
-        currentToken += message[charIndex];
+        storage += c;
     }
 
-    if (!currentToken.empty()) {
-        pTokenVector.push_back(currentToken);
-        currentToken.clear();
+    if (storage.size() > tokenStart) {
+        pushToken();
     }
 
-    return pTokenVector.size();
+    return tokens.size();
 }
 
 }} // namespace caspar::IO
@@ -21,9 +21,15 @@
 
 #include <list>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace caspar { namespace IO {
 
 std::size_t tokenize(const std::wstring& message, std::list<std::wstring>& pTokenVector);
 
+// Appends the tokens of message as views into storage, which holds them unescaped back to back. storage is reserved
+// to the size of message first so the views stay valid, and reusing both for every line avoids allocating.
+std::size_t tokenize(std::wstring_view message, std::vector<std::wstring_view>& tokens, std::wstring& storage);
+
 }} // namespace caspar::IO
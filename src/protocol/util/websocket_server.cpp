@@ -0,0 +1,527 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "websocket_server.h"
+
+#include "../osc/client.h"
+
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace IO {
+
+using boost::asio::ip::tcp;
+
+namespace http      = boost::beast::http;
+namespace websocket = boost::beast::websocket;
+
+namespace {
+
+class websocket_connection : public std::enable_shared_from_this<websocket_connection>
+{
+    // Commands are small, anything bigger is not meant for us.
+    static constexpr std::size_t max_message_size = 1024 * 1024;
+
+    // State pushed while this much is still waiting to be written is dropped, so that a client that doesn't keep up
+    // can't hold memory. It catches up with the next full refresh.
+    static constexpr std::size_t max_queued_state = 8 * 1024 * 1024;
+
+    // A client gets this long to complete the handshake. A connection silent for this long is pinged, and closed
+    // when it is still silent the next time around.
+    static constexpr std::chrono::seconds handshake_timeout{30};
+    static constexpr std::chrono::seconds idle_timeout{30};
+
+    struct message
+    {
+        std::string data;
+        bool        binary;
+    };
+
+    // Handed to the protocol, which then doesn't keep the connection alive.
+    class connection_holder : public client_connection<char>
+    {
+        std::weak_ptr<websocket_connection> connection_;
+
+      public:
+        explicit connection_holder(std::weak_ptr<websocket_connection> conn)
+            : connection_(std::move(conn))
+        {
+        }
+
+        void send(std::basic_string<char>&& data, bool skip_log) override
+        {
+            if (auto conn = connection_.lock())
+                conn->send(std::move(data), false);
+        }
+
+        void disconnect() override
+        {
+            if (auto conn = connection_.lock())
+                conn->disconnect();
+        }
+
+        std::wstring address() const override
+        {
+            if (auto conn = connection_.lock())
+                return conn->address_;
+            return L"[destroyed-connection]";
+        }
+
+        void add_lifecycle_bound_object(const std::wstring& key, const std::shared_ptr<void>& lifecycle_bound) override
+        {
+            if (auto conn = connection_.lock()) {
+                std::lock_guard<std::mutex> lock(conn->mutex_);
+                conn->lifecycle_bound_objects_[key] = lifecycle_bound;
+            }
+        }
+
+        std::shared_ptr<void> remove_lifecycle_bound_object(const std::wstring& key) override
+        {
+            auto conn = connection_.lock();
+            if (!conn)
+                return nullptr;
+
+            std::lock_guard<std::mutex> lock(conn->mutex_);
+            auto                        it = conn->lifecycle_bound_objects_.find(key);
+            if (it == conn->lifecycle_bound_objects_.end())
+                return nullptr;
+
+            auto result = std::move(it->second);
+            conn->lifecycle_bound_objects_.erase(it);
+            return result;
+        }
+    };
+
+    boost::asio::io_service::strand                 strand_;
+    websocket::stream<tcp::socket>                  ws_;
+    boost::asio::steady_timer                       timer_;
+    const std::wstring                              address_;
+    protocol_strategy_factory<char>::ptr            protocol_factory_;
+    std::weak_ptr<protocol::osc::client>            osc_client_;
+    std::shared_ptr<const std::vector<std::string>> allowed_origins_;
+    std::shared_ptr<protocol_strategy<char>>        protocol_;
+    boost::beast::flat_buffer                       buffer_;
+    http::request<http::string_body>                request_;
+    http::response<http::empty_body>                refusal_;
+
+    // Only touched from the strand of the socket.
+    std::deque<message>   queue_;
+    std::shared_ptr<void> subscription_;
+    bool                  accepted_ = false;
+    bool                  heard_    = false; // from the client since the idle timer last went off
+    bool                  closed_   = false;
+
+    std::atomic<std::size_t> queued_state_{0};
+
+    std::mutex                                    mutex_;
+    std::map<std::wstring, std::shared_ptr<void>> lifecycle_bound_objects_;
+
+  public:
+    websocket_connection(boost::asio::io_service&                        service,
+                         tcp::socket                                     socket,
+                         protocol_strategy_factory<char>::ptr            protocol_factory,
+                         std::weak_ptr<protocol::osc::client>            osc_client,
+                         std::shared_ptr<const std::vector<std::string>> allowed_origins)
+        : strand_(service)
+        , ws_(std::move(socket))
+        , timer_(service)
+        , address_(remote_address(ws_.next_layer()))
+        , protocol_factory_(std::move(protocol_factory))
+        , osc_client_(std::move(osc_client))
+        , allowed_origins_(std::move(allowed_origins))
+    {
+    }
+
+    ~websocket_connection() { CASPAR_LOG(debug) << L"websocket_server " << address_ << L" connection destroyed."; }
+
+    void start()
+    {
+        auto self = shared_from_this();
+        boost::asio::post(strand_, [self] {
+            self->wait(handshake_timeout);
+
+            // The upgrade request is read first so its Origin can be checked.
+            auto handler = self->on_strand([self](const error_code& ec, std::size_t) {
+                if (ec) {
+                    self->handshake_failed(ec);
+                    return;
+                }
+                self->upgrade();
+            });
+            http::async_read(self->ws_.next_layer(), self->buffer_, self->request_, std::move(handler));
+        });
+    }
+
+    // From any thread.
+    void send(std::string&& data, bool binary)
+    {
+        if (binary)
+            queued_state_ += data.size();
+
+        auto self = shared_from_this();
+        boost::asio::post(strand_, [self, data = std::move(data), binary]() mutable {
+            if (self->closed_) {
+                return;
+            }
+            self->queue_.push_back(message{std::move(data), binary});
+            if (self->queue_.size() == 1) {
+                self->write();
+            }
+        });
+    }
+
+    void disconnect()
+    {
+        auto self = shared_from_this();
+        boost::asio::post(strand_, [self] { self->close(); });
+    }
+
+  private:
+    using error_code = boost::system::error_code;
+
+    // Every handler of the connection runs on its strand, the io_service has several threads.
+    template <typename Handler>
+    boost::asio::executor_binder<std::decay_t<Handler>, boost::asio::io_service::strand> on_strand(Handler&& handler)
+    {
+        return boost::asio::bind_executor(strand_, std::forward<Handler>(handler));
+    }
+
+    void upgrade()
+    {
+        const auto origin = request_.find(http::field::origin);
+        if (!websocket::is_upgrade(request_) || (origin != request_.end() && !allowed(origin->value().to_string()))) {
+            CASPAR_LOG(warning) << L"websocket_server Refused connection from " << address_ << L" with origin "
+                                << (origin != request_.end() ? u16(origin->value().to_string()) : L"none");
+            refuse();
+            return;
+        }
+
+        ws_.read_message_max(max_message_size);
+
+        // Pongs, and the pings of clients that keep the connection alive themselves, count as hearing from them.
+        std::weak_ptr<websocket_connection> weak_self = shared_from_this();
+        ws_.control_callback([weak_self](websocket::frame_type, boost::beast::string_view) {
+            if (auto self = weak_self.lock())
+                self->heard_ = true;
+        });
+
+        auto self = shared_from_this();
+        ws_.async_accept(request_, on_strand([self](const error_code& ec) {
+            if (ec) {
+                self->handshake_failed(ec);
+                return;
+            }
+            CASPAR_LOG(info) << L"websocket_server Accepted connection from " << self->address_;
+            self->accepted_ = true;
+            self->heard_    = true;
+            self->wait(idle_timeout);
+            self->protocol_ = self->protocol_factory_->create(spl::make_shared<connection_holder>(self));
+            self->read();
+        }));
+    }
+
+    void handshake_failed(const error_code& ec)
+    {
+        CASPAR_LOG(debug) << L"websocket_server " << address_ << L" handshake failed: " << u16(ec.message());
+        close();
+    }
+
+    // Until the handshake has completed the connection is closed when the timer goes off. After it a silent client is
+    // pinged, and closed when it still hasn't answered the next time around.
+    void wait(std::chrono::seconds timeout)
+    {
+        timer_.expires_after(timeout);
+
+        auto self = shared_from_this();
+        timer_.async_wait(on_strand([self, timeout](const error_code& ec) {
+            if (ec || self->closed_) {
+                return;
+            }
+            if (!self->accepted_ || !self->heard_) {
+                CASPAR_LOG(info) << L"websocket_server Client " << self->address_ << L" timed out.";
+                self->close();
+                return;
+            }
+
+            self->heard_ = false;
+            self->ws_.async_ping({}, self->on_strand([](const error_code&) {}));
+            self->wait(timeout);
+        }));
+    }
+
+    bool allowed(const std::string& origin) const
+    {
+        return std::any_of(allowed_origins_->begin(), allowed_origins_->end(), [&](const std::string& allowed) {
+            return allowed == "*" || boost::iequals(allowed, origin);
+        });
+    }
+
+    void refuse()
+    {
+        refusal_.result(http::status::forbidden);
+        refusal_.version(request_.version());
+        refusal_.set(http::field::connection, "close");
+        refusal_.prepare_payload();
+
+        auto self = shared_from_this();
+        http::async_write(ws_.next_layer(), refusal_, on_strand([self](const error_code&, std::size_t) {
+            self->close();
+        }));
+    }
+
+    static std::wstring remote_address(const tcp::socket& socket)
+    {
+        error_code ec;
+        auto       endpoint = socket.remote_endpoint(ec);
+        return ec ? L"no-address" : u16(endpoint.address().to_string());
+    }
+
+    void read()
+    {
+        auto self = shared_from_this();
+        ws_.async_read(buffer_, on_strand([self](const error_code& ec, std::size_t) {
+            if (ec) {
+                self->close();
+                return;
+            }
+
+            self->heard_ = true;
+
+            const auto  buffers = self->buffer_.data();
+            std::string data(boost::asio::buffers_begin(buffers), boost::asio::buffers_end(buffers));
+            self->buffer_.consume(self->buffer_.size());
+            if (self->ws_.got_text()) {
+                self->receive(data);
+            }
+            self->read();
+        }));
+    }
+
+    void receive(const std::string& data)
+    {
+        std::vector<std::string> lines;
+        boost::split(lines, data, boost::is_any_of("\r\n"), boost::token_compress_on);
+
+        for (auto& line : lines) {
+            if (line.empty())
+                continue;
+
+            try {
+                if (!subscribe(line))
+                    protocol_->parse(line + "\r\n");
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+    }
+
+    // Handles SUBSCRIBE and UNSUBSCRIBE, which are about this connection rather than the server.
+    bool subscribe(const std::string& line)
+    {
+        std::vector<std::string> tokens;
+        boost::split(tokens, boost::trim_copy(line), boost::is_space(), boost::token_compress_on);
+
+        std::string reply;
+        if (tokens.size() >= 2 && boost::iequals(tokens[0], "REQ")) {
+            reply = "RES " + tokens[1] + " ";
+            tokens.erase(tokens.begin(), tokens.begin() + 2);
+        }
+        if (tokens.empty())
+            return false;
+
+        if (boost::iequals(tokens[0], "SUBSCRIBE")) {
+            auto osc_client = osc_client_.lock();
+            if (!osc_client) {
+                send(reply + "500 SUBSCRIBE FAILED\r\n", false);
+                return true;
+            }
+
+            std::weak_ptr<websocket_connection> weak_self = shared_from_this();
+            subscription_.reset();
+            subscription_ = osc_client->get_subscription_token(
+                [weak_self](const char* data, std::size_t size) {
+                    auto self = weak_self.lock();
+                    if (self && self->queued_state_ < max_queued_state)
+                        self->send(std::string(data, size), true);
+                },
+                std::vector<std::string>(tokens.begin() + 1, tokens.end()));
+            send(reply + "202 SUBSCRIBE OK\r\n", false);
+            return true;
+        }
+
+        if (boost::iequals(tokens[0], "UNSUBSCRIBE")) {
+            subscription_.reset();
+            send(reply + "202 UNSUBSCRIBE OK\r\n", false);
+            return true;
+        }
+
+        return false;
+    }
+
+    void write()
+    {
+        auto& front = queue_.front();
+        ws_.binary(front.binary);
+
+        auto self = shared_from_this();
+        ws_.async_write(boost::asio::buffer(front.data), on_strand([self](const error_code& ec, std::size_t) {
+            auto& sent = self->queue_.front();
+            if (sent.binary)
+                self->queued_state_ -= sent.data.size();
+            self->queue_.pop_front();
+
+            if (ec) {
+                self->close();
+            } else if (!self->queue_.empty()) {
+                self->write();
+            }
+        }));
+    }
+
+    // Lets go of everything that would keep the connection alive, the pending operations then finish it.
+    void close()
+    {
+        if (closed_)
+            return;
+        closed_ = true;
+
+        CASPAR_LOG(info) << L"websocket_server Client " << address_ << L" disconnected.";
+
+        subscription_.reset();
+        protocol_.reset();
+
+        std::map<std::wstring, std::shared_ptr<void>> lifecycle_bound_objects;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            lifecycle_bound_objects.swap(lifecycle_bound_objects_);
+        }
+
+        error_code ec;
+        timer_.cancel(ec);
+        ws_.next_layer().close(ec);
+    }
+};
+
+} // namespace
+
+struct websocket_server::impl : public std::enable_shared_from_this<impl>
+{
+    std::shared_ptr<boost::asio::io_service>        service_;
+    tcp::acceptor                                   acceptor_;
+    protocol_strategy_factory<char>::ptr            protocol_factory_;
+    std::weak_ptr<protocol::osc::client>            osc_client_;
+    std::shared_ptr<const std::vector<std::string>> allowed_origins_;
+
+    std::mutex                                       mutex_;
+    std::vector<std::weak_ptr<websocket_connection>> connections_;
+
+    impl(std::shared_ptr<boost::asio::io_service>      service,
+         unsigned short                                port,
+         protocol_strategy_factory<char>::ptr          protocol_factory,
+         const std::shared_ptr<protocol::osc::client>& osc_client,
+         std::vector<std::string>                      allowed_origins)
+        : service_(std::move(service))
+        , acceptor_(*service_, tcp::endpoint(tcp::v4(), port))
+        , protocol_factory_(std::move(protocol_factory))
+        , osc_client_(osc_client)
+        , allowed_origins_(std::make_shared<const std::vector<std::string>>(std::move(allowed_origins)))
+    {
+    }
+
+    void start_accept()
+    {
+        std::weak_ptr<impl> weak_self = shared_from_this();
+        acceptor_.async_accept(*service_,
+                               [weak_self](const boost::system::error_code& ec, tcp::socket socket) {
+                                   auto self = weak_self.lock();
+                                   if (!self || ec == boost::asio::error::operation_aborted)
+                                       return;
+                                   if (!ec)
+                                       self->accept(std::move(socket));
+                                   self->start_accept();
+                               });
+    }
+
+    void accept(tcp::socket socket)
+    {
+        boost::system::error_code ec;
+        socket.set_option(tcp::no_delay(true), ec);
+
+        // Each connection runs on its own strand, the io_service has several threads.
+        auto conn = std::make_shared<websocket_connection>(
+            *service_, std::move(socket), protocol_factory_, osc_client_, allowed_origins_);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            connections_.erase(std::remove_if(connections_.begin(),
+                                              connections_.end(),
+                                              [](auto& weak) { return weak.expired(); }),
+                               connections_.end());
+            connections_.push_back(conn);
+        }
+        conn->start();
+    }
+
+    void stop()
+    {
+        boost::system::error_code ec;
+        acceptor_.close(ec);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& weak : connections_) {
+            if (auto conn = weak.lock())
+                conn->disconnect();
+        }
+    }
+};
+
+websocket_server::websocket_server(std::shared_ptr<boost::asio::io_service>      service,
+                                   unsigned short                                port,
+                                   protocol_strategy_factory<char>::ptr          protocol_factory,
+                                   const std::shared_ptr<protocol::osc::client>& osc_client,
+                                   std::vector<std::string>                      allowed_origins)
+    : impl_(spl::make_shared<impl>(
+          std::move(service), port, std::move(protocol_factory), osc_client, std::move(allowed_origins)))
+{
+    impl_->start_accept();
+    CASPAR_LOG(info) << L"Serving WebSocket clients on port " << port;
+}
+
+websocket_server::~websocket_server()
+{
+    auto impl = impl_;
+    boost::asio::post(*impl->service_, [impl] { impl->stop(); });
+}
+
+}} // namespace caspar::IO
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "protocol_strategy.h"
+
+#include <common/memory.h>
+
+#include <boost/asio.hpp>
+
+#include <string>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace osc {
+class client;
+}}} // namespace caspar::protocol::osc
+
+namespace caspar { namespace IO {
+
+// Serves a protocol to WebSocket clients, so control UIs in browsers need neither a proxy nor polling. Each text
+// message holds one or more lines for the protocol and every reply is sent as a text message, REQ <id> in front of an
+// AMCP command tags its reply with RES <id> so commands can be sent without waiting for the replies in between.
+//
+// SUBSCRIBE [prefix ...] pushes the monitor state below the prefixes, or all of it, as binary messages of OSC bundles
+// the moment the channels produce it. Only values that changed go out, with everything again every osc full-refresh,
+// just as to OSC clients. UNSUBSCRIBE stops it, and both are answered like AMCP commands.
+//
+// Browsers let any page open a WebSocket to the server, so a handshake sent with an Origin is refused unless the
+// origin is one of allowed_origins, or the list holds "*". Clients that aren't browsers send no Origin and are let in.
+class websocket_server
+{
+  public:
+    websocket_server(std::shared_ptr<boost::asio::io_service>      service,
+                     unsigned short                                port,
+                     protocol_strategy_factory<char>::ptr          protocol_factory,
+                     const std::shared_ptr<protocol::osc::client>& osc_client,
+                     std::vector<std::string>                      allowed_origins);
+    ~websocket_server();
+
+    websocket_server(const websocket_server&)            = delete;
+    websocket_server& operator=(const websocket_server&) = delete;
+
+  private:
+    struct impl;
+    spl::shared_ptr<impl> impl_;
+};
+
+}} // namespace caspar::IO
@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Headless channel benchmark. Runs a number of channels with synthetic producers into a null consumer, as fast as the
+// channel can tick, and reports throughput, per-stage timings and GPU memory use. Running it with --mixer gpu and
+// --mixer cpu compares the two mixers, the spans of the gpu mixer are ogl.* and those of the cpu mixer cpu.*.
+//
+//   casparcg-bench [--config casparcg.config] [--format 1080p5000] [--channels 1] [--layers 10] [--frames 1000]
+//                  [--warmup 50] [--producer "#FF0000FF"]... [--transform none|grid|rotate] [--pipelined]
+//                  [--mixer gpu|cpu]
+
+#include "included_modules.h"
+
+#include <accelerator/accelerator.h>
+
+#include <common/diagnostics/trace.h>
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/consumer/frame_consumer.h>
+#include <core/consumer/output.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_transform.h>
+#include <core/mixer/image/image_mixer.h>
+#include <core/producer/cg_proxy.h>
+#include <core/producer/frame_producer.h>
+#include <core/producer/stage.h>
+#include <core/video_channel.h>
+#include <core/video_format.h>
+
+#include <protocol/amcp/amcp_command_repository.h>
+#include <protocol/amcp/amcp_command_repository_wrapper.h>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace caspar {
+
+struct bench_options
+{
+    std::wstring              config   = L"casparcg.config";
+    std::wstring              format   = L"1080p5000";
+    int                       channels = 1;
+    int                       layers   = 10;
+    int                       frames   = 1000;
+    int                       warmup   = 50;
+    std::vector<std::wstring> producers;
+    std::wstring              transform = L"none";
+    bool                      pipelined = false;
+    std::wstring              mixer     = L"gpu";
+};
+
+// Accepts every frame immediately and claims the clock, so the channel runs as fast as it can produce and mix.
+class null_consumer : public core::frame_consumer
+{
+    std::atomic<int64_t> frames_{0};
+
+  public:
+    core::send_result send(const core::video_field field, core::const_frame frame) override
+    {
+        if (field != core::video_field::b) {
+            frames_++;
+        }
+        return true;
+    }
+
+    void                 initialize(const core::video_format_desc& format_desc, int channel_index) override {}
+    core::monitor::state state() const override { return {}; }
+    std::wstring         print() const override { return L"null[]"; }
+    std::wstring         name() const override { return L"null"; }
+    bool                 has_synchronization_clock() const override { return true; }
+    int                  index() const override { return 10000; }
+
+    int64_t frames() const { return frames_; }
+};
+
+bench_options parse_options(int argc, char** argv)
+{
+    bench_options options;
+
+    for (int n = 1; n < argc; ++n) {
+        auto arg   = std::string(argv[n]);
+        auto value = [&]() -> std::wstring {
+            if (n + 1 >= argc)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info("Missing value for " + arg));
+            return u16(std::string(argv[++n]));
+        };
+
+        if (arg == "--config")
+            options.config = value();
+        else if (arg == "--format")
+            options.format = value();
+        else if (arg == "--channels")
+            options.channels = boost::lexical_cast<int>(value());
+        else if (arg == "--layers")
+            options.layers = boost::lexical_cast<int>(value());
+        else if (arg == "--frames")
+            options.frames = boost::lexical_cast<int>(value());
+        else if (arg == "--warmup")
+            options.warmup = boost::lexical_cast<int>(value());
+        else if (arg == "--producer")
+            options.producers.push_back(value());
+        else if (arg == "--transform")
+            options.transform = value();
+        else if (arg == "--pipelined")
+            options.pipelined = true;
+        else if (arg == "--mixer")
+            options.mixer = value();
+        else
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Unknown argument " + arg));
+    }
+
+    if (options.producers.empty())
+        options.producers.push_back(L"#FF0000FF");
+
+    if (options.mixer != L"gpu" && options.mixer != L"cpu")
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid mixer: " + options.mixer));
+
+    return options;
+}
+
+// Lays the layers out in a grid, optionally rotated, so the mixer has to do real transform work.
+void apply_transform(core::stage& stage, const bench_options& options, int layer)
+{
+    if (options.transform == L"none")
+        return;
+
+    auto cols  = static_cast<int>(std::ceil(std::sqrt(options.layers)));
+    auto delta = 1.0 / cols;
+    auto x     = (layer - 1) % cols;
+    auto y     = (layer - 1) / cols;
+    auto angle = options.transform == L"rotate" ? 15.0 * layer : 0.0;
+
+    stage
+        .apply_transform(
+            layer,
+            [=](core::frame_transform transform) {
+                transform.image_transform.fill_translation = {x * delta, y * delta};
+                transform.image_transform.fill_scale       = {delta, delta};
+                transform.image_transform.angle            = angle * 3.14159265358979323846 / 180.0;
+                return transform;
+            },
+            0,
+            tweener(L"linear"))
+        .get();
+}
+
+void print_stats(const std::vector<diagnostics::trace::event>& events)
+{
+    std::map<std::string, std::vector<double>> spans;
+    for (auto& e : events) {
+        spans[e.name].push_back(std::chrono::duration<double, std::milli>(e.end - e.begin).count());
+    }
+
+    std::wcout << std::endl
+               << std::left << std::setw(20) << L"span" << std::right << std::setw(10) << L"count" << std::setw(12)
+               << L"p50 ms" << std::setw(12) << L"p99 ms" << std::setw(12) << L"max ms" << std::endl;
+
+    for (auto& p : spans) {
+        auto& values = p.second;
+        std::sort(values.begin(), values.end());
+
+        auto percentile = [&](double q) {
+            return values[std::min(values.size() - 1, static_cast<size_t>(q * static_cast<double>(values.size())))];
+        };
+
+        std::wcout << std::left << std::setw(20) << u16(p.first) << std::right << std::setw(10) << values.size()
+                   << std::fixed << std::setprecision(3) << std::setw(12) << percentile(0.5) << std::setw(12)
+                   << percentile(0.99) << std::setw(12) << values.back() << std::endl;
+    }
+}
+
+int run(const bench_options& options)
+{
+    env::configure(options.config);
+
+    core::video_format_repository format_repository;
+    auto                          format_desc = format_repository.find(options.format);
+    if (format_desc.format == core::video_format::invalid)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video-mode: " + options.format));
+
+    accelerator::accelerator accelerator(format_repository);
+
+    auto cg_registry       = spl::make_shared<core::cg_producer_registry>();
+    auto producer_registry = spl::make_shared<core::frame_producer_registry>();
+    auto consumer_registry = spl::make_shared<core::frame_consumer_registry>();
+
+    // Modules only register commands during initialization, nothing is ever executed through this repository.
+    auto command_repo = std::make_shared<protocol::amcp::amcp_command_repository>(
+        spl::make_shared<std::vector<protocol::amcp::channel_context>>());
+    auto command_repo_wrapper = std::make_shared<protocol::amcp::amcp_command_repository_wrapper>(
+        command_repo, std::make_shared<protocol::amcp::command_context_factory>(nullptr));
+
+    initialize_modules(
+        core::module_dependencies(cg_registry, producer_registry, consumer_registry, command_repo_wrapper));
+
+    std::vector<spl::shared_ptr<core::video_channel>> channels;
+    std::vector<spl::shared_ptr<null_consumer>>       consumers;
+    for (int n = 1; n <= options.channels; ++n) {
+        auto mixer =
+            options.mixer == L"cpu" ? accelerator.create_cpu_image_mixer(n) : accelerator.create_image_mixer(n);
+        channels.push_back(spl::make_shared<core::video_channel>(
+            n, format_desc, std::move(mixer), [](core::monitor::state) {}, options.pipelined));
+        consumers.push_back(spl::make_shared<null_consumer>());
+        channels.back()->output().add(consumers.back());
+    }
+
+    for (auto& channel : channels) {
+        auto dependencies = core::frame_producer_dependencies(channel->frame_factory(),
+                                                              channels,
+                                                              format_repository,
+                                                              channel->stage()->video_format_desc(),
+                                                              producer_registry,
+                                                              cg_registry);
+
+        for (int layer = 1; layer <= options.layers; ++layer) {
+            auto& params   = options.producers.at((layer - 1) % options.producers.size());
+            auto  producer = producer_registry->create_producer(dependencies, params);
+            if (producer == core::frame_producer::empty())
+                CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(L"No producer for " + params));
+
+            channel->stage()->load(layer, producer, false, true).get();
+            apply_transform(*channel->stage(), options, layer);
+        }
+    }
+
+    auto wait_for_frames = [&](int64_t count) {
+        std::vector<int64_t> targets;
+        for (auto& consumer : consumers)
+            targets.push_back(consumer->frames() + count);
+
+        for (size_t n = 0; n < consumers.size(); ++n) {
+            while (consumers[n]->frames() < targets[n])
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    };
+
+    wait_for_frames(options.warmup);
+
+    // Room for the channel, stage and gpu spans of every frame.
+    diagnostics::trace::set_capacity(static_cast<size_t>(options.frames) * options.channels * (options.layers + 16));
+
+    auto start = std::chrono::steady_clock::now();
+    wait_for_frames(options.frames);
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    auto events = diagnostics::trace::events();
+    diagnostics::trace::set_capacity(0);
+
+    std::wcout << L"format:     " << format_desc.name << std::endl;
+    std::wcout << L"channels:   " << options.channels << std::endl;
+    std::wcout << L"layers:     " << options.layers << std::endl;
+    std::wcout << L"transform:  " << options.transform << std::endl;
+    std::wcout << L"pipelined:  " << std::boolalpha << options.pipelined << std::endl;
+    std::wcout << L"mixer:      " << options.mixer << std::endl;
+    std::wcout << L"frames/s:   " << std::fixed << std::setprecision(2) << options.frames / elapsed
+               << L" per channel (realtime " << format_desc.fps << L")" << std::endl;
+
+    print_stats(events);
+
+    // Getting the device of the cpu mixer would create one.
+    auto device = options.mixer == L"gpu" ? accelerator.get_device() : nullptr;
+    if (device) {
+        auto info = device->info();
+        std::wcout << std::endl
+                   << L"pooled device buffers: "
+                   << info.get<size_t>(L"gl.summary.pooled_device_buffers.total_size", 0) / (1024 * 1024) << L" MB" << std::endl
+                   << L"pooled host buffers:   "
+                   << (info.get<size_t>(L"gl.summary.pooled_host_buffers.total_read_size", 0) +
+                       info.get<size_t>(L"gl.summary.pooled_host_buffers.total_write_size", 0)) /
+                          (1024 * 1024)
+                   << L" MB" << std::endl;
+    }
+
+    core::destroy_producers_synchronously();
+    core::destroy_consumers_synchronously();
+    consumers.clear();
+    channels.clear();
+
+    uninitialize_modules();
+
+    return 0;
+}
+
+} // namespace caspar
+
+int main(int argc, char** argv)
+{
+    using namespace caspar;
+
+    try {
+        log::add_cout_sink();
+        log::set_log_level(L"warning");
+
+        return run(parse_options(argc, argv));
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        return 1;
+    }
+}
@@ -0,0 +1,402 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Consumer capacity benchmark. Runs each kind of consumer at the rate of each format on more and more channels at once,
+// one consumer to a channel fed by a synthetic producer, and reports how long the consumers take to send a frame, the
+// ticks the channels missed and the cpu each consumer costs. The capacity of a consumer and format is the most channels
+// that ran with no consumer failing, at most one tick in a thousand missed and 99% of the frames sent within a tick.
+//
+//   casparcg-consumer-bench [--config casparcg.config] [--format 1080i5000]... --consumer "DECKLINK %n"...
+//                           [--counts 1,2,4,8] [--seconds 10] [--warmup 2] [--producer "#FF808080"]
+//
+// A consumer is given like to ADD, %n is replaced by the number of its channel so each opens its own device or file,
+// as in "DECKLINK %n", "NDI NAME bench%n", "FILE bench%n.mov -codec:v libx264", "SCREEN" or "ARTNET".
+
+#include "included_modules.h"
+
+#include <accelerator/accelerator.h>
+
+#include <common/diagnostics/trace.h>
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/consumer/frame_consumer.h>
+#include <core/consumer/output.h>
+#include <core/mixer/image/image_mixer.h>
+#include <core/producer/cg_proxy.h>
+#include <core/producer/frame_producer.h>
+#include <core/producer/stage.h>
+#include <core/video_channel.h>
+#include <core/video_format.h>
+
+#include <protocol/amcp/amcp_command_repository.h>
+#include <protocol/amcp/amcp_command_repository_wrapper.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace caspar {
+
+struct consumer_bench_options
+{
+    std::wstring              config = L"casparcg.config";
+    std::vector<std::wstring> formats;
+    std::vector<std::wstring> consumers;
+    std::vector<int>          counts   = {1, 2, 4, 8};
+    double                    seconds  = 10.0;
+    double                    warmup   = 2.0;
+    std::wstring              producer = L"#FF808080";
+};
+
+struct step_result
+{
+    int     count    = 0;
+    bool    ok       = false;
+    size_t  sends    = 0;
+    double  send_p50 = 0.0; // ms, output.send and output.wait of a frame together
+    double  send_p99 = 0.0;
+    double  send_max = 0.0;
+    int64_t ticks    = 0;
+    int64_t drops    = 0;
+    double  cpu      = 0.0; // percent of a core per consumer, above the channels without consumers
+    int     failed   = 0;   // consumers the channels removed
+};
+
+// Counts the ticks of a channel while measuring, and those late by more than half a frame.
+struct tick_counter
+{
+    const double                          period;
+    std::atomic<bool>                     measuring{false};
+    std::atomic<int64_t>                  ticks{0};
+    std::atomic<int64_t>                  drops{0};
+    std::chrono::steady_clock::time_point last;
+
+    explicit tick_counter(double period)
+        : period(period)
+    {
+    }
+
+    void operator()()
+    {
+        const auto now = std::chrono::steady_clock::now();
+        if (measuring) {
+            ticks++;
+            if (std::chrono::duration<double>(now - last).count() > period * 1.5) {
+                drops++;
+            }
+        }
+        last = now;
+    }
+};
+
+double process_cpu_seconds()
+{
+#ifdef _MSC_VER
+    FILETIME creation;
+    FILETIME exit;
+    FILETIME kernel;
+    FILETIME user;
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+    auto to_seconds = [](const FILETIME& time) {
+        return (static_cast<double>(time.dwHighDateTime) * 4294967296.0 + time.dwLowDateTime) * 1e-7;
+    };
+    return to_seconds(kernel) + to_seconds(user);
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+}
+
+consumer_bench_options parse_options(int argc, char** argv)
+{
+    consumer_bench_options options;
+
+    for (int n = 1; n < argc; ++n) {
+        auto arg   = std::string(argv[n]);
+        auto value = [&]() -> std::wstring {
+            if (n + 1 >= argc)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info("Missing value for " + arg));
+            return u16(std::string(argv[++n]));
+        };
+
+        if (arg == "--config")
+            options.config = value();
+        else if (arg == "--format")
+            options.formats.push_back(value());
+        else if (arg == "--consumer")
+            options.consumers.push_back(value());
+        else if (arg == "--counts") {
+            std::vector<std::wstring> counts;
+            boost::split(counts, value(), boost::is_any_of(L","), boost::token_compress_on);
+            options.counts.clear();
+            for (auto& count : counts)
+                options.counts.push_back(boost::lexical_cast<int>(count));
+        } else if (arg == "--seconds")
+            options.seconds = boost::lexical_cast<double>(value());
+        else if (arg == "--warmup")
+            options.warmup = boost::lexical_cast<double>(value());
+        else if (arg == "--producer")
+            options.producer = value();
+        else
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Unknown argument " + arg));
+    }
+
+    if (options.consumers.empty())
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info("No --consumer given"));
+
+    if (options.formats.empty())
+        options.formats.push_back(L"1080i5000");
+
+    std::sort(options.counts.begin(), options.counts.end());
+    if (options.counts.empty() || options.counts.front() < 1)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid --counts"));
+
+    return options;
+}
+
+class consumer_bench
+{
+    const consumer_bench_options&                            options_;
+    core::video_format_repository                            format_repository_;
+    accelerator::accelerator                                 accelerator_{format_repository_};
+    spl::shared_ptr<core::cg_producer_registry>              cg_registry_;
+    spl::shared_ptr<core::frame_producer_registry>           producer_registry_;
+    spl::shared_ptr<core::frame_consumer_registry>           consumer_registry_;
+    std::shared_ptr<protocol::amcp::amcp_command_repository> command_repo_;
+
+  public:
+    explicit consumer_bench(const consumer_bench_options& options)
+        : options_(options)
+    {
+        // Modules only register commands during initialization, nothing is ever executed through this repository.
+        command_repo_ = std::make_shared<protocol::amcp::amcp_command_repository>(
+            spl::make_shared<std::vector<protocol::amcp::channel_context>>());
+        auto command_repo_wrapper = std::make_shared<protocol::amcp::amcp_command_repository_wrapper>(
+            command_repo_, std::make_shared<protocol::amcp::command_context_factory>(nullptr));
+
+        initialize_modules(
+            core::module_dependencies(cg_registry_, producer_registry_, consumer_registry_, command_repo_wrapper));
+    }
+
+    ~consumer_bench() { uninitialize_modules(); }
+
+    // count channels with one consumer each, or none for the baseline.
+    step_result run(const core::video_format_desc& format_desc, const std::wstring* consumer, int count)
+    {
+        std::vector<spl::shared_ptr<core::video_channel>> channels;
+        std::vector<std::shared_ptr<tick_counter>>        counters;
+        for (int n = 1; n <= count; ++n) {
+            auto counter = std::make_shared<tick_counter>(1.0 / format_desc.hz);
+            counters.push_back(counter);
+            channels.push_back(spl::make_shared<core::video_channel>(
+                n, format_desc, accelerator_.create_image_mixer(n), [counter](core::monitor::state) { (*counter)(); }));
+        }
+
+        std::vector<int> ports;
+        for (auto& channel : channels) {
+            auto dependencies = core::frame_producer_dependencies(channel->frame_factory(),
+                                                                  channels,
+                                                                  format_repository_,
+                                                                  format_desc,
+                                                                  producer_registry_,
+                                                                  cg_registry_);
+            auto producer     = producer_registry_->create_producer(dependencies, options_.producer);
+            if (producer == core::frame_producer::empty())
+                CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(L"No producer for " + options_.producer));
+            channel->stage()->load(1, producer, false, true).get();
+
+            if (consumer) {
+                auto params = boost::replace_all_copy(*consumer, L"%n", std::to_wstring(channel->index()));
+                std::vector<std::wstring> tokens;
+                boost::split(tokens, params, boost::is_space(), boost::token_compress_on);
+                auto created = consumer_registry_->create_consumer(tokens, format_repository_, channels);
+                ports.push_back(created->index());
+                channel->output().add(created);
+            }
+        }
+
+        std::this_thread::sleep_for(std::chrono::duration<double>(options_.warmup));
+
+        diagnostics::trace::set_capacity(static_cast<size_t>(options_.seconds * format_desc.hz * 2 + 1) * count * 16);
+        for (auto& counter : counters)
+            counter->measuring = true;
+        const auto cpu_start = process_cpu_seconds();
+        const auto start     = std::chrono::steady_clock::now();
+
+        std::this_thread::sleep_for(std::chrono::duration<double>(options_.seconds));
+
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const auto cpu     = process_cpu_seconds() - cpu_start;
+        for (auto& counter : counters)
+            counter->measuring = false;
+        auto events = diagnostics::trace::events();
+        diagnostics::trace::set_capacity(0);
+
+        step_result result;
+        result.count = count;
+        result.cpu   = cpu / elapsed * 100.0;
+        for (auto& counter : counters) {
+            result.ticks += counter->ticks;
+            result.drops += counter->drops;
+        }
+
+        // A send and the wait for it make up the time the consumer took, the nth of each on the thread of a channel
+        // belong together.
+        std::map<std::pair<int64_t, int64_t>, std::vector<double>> sends;
+        std::map<std::pair<int64_t, int64_t>, std::vector<double>> waits;
+        for (auto& e : events) {
+            if (e.begin < start)
+                continue;
+            const auto duration = std::chrono::duration<double, std::milli>(e.end - e.begin).count();
+            if (std::string(e.name) == "output.send")
+                sends[{e.tid, e.id}].push_back(duration);
+            else if (std::string(e.name) == "output.wait")
+                waits[{e.tid, e.id}].push_back(duration);
+        }
+        std::vector<double> values;
+        for (auto& p : sends) {
+            auto& wait = waits[p.first];
+            for (size_t n = 0; n < p.second.size(); ++n)
+                values.push_back(p.second[n] + (n < wait.size() ? wait[n] : 0.0));
+        }
+        std::sort(values.begin(), values.end());
+        if (!values.empty()) {
+            auto percentile = [&](double q) {
+                return values[std::min(values.size() - 1, static_cast<size_t>(q * static_cast<double>(values.size())))];
+            };
+            result.sends    = values.size();
+            result.send_p50 = percentile(0.5);
+            result.send_p99 = percentile(0.99);
+            result.send_max = values.back();
+        }
+
+        for (size_t n = 0; n < ports.size(); ++n) {
+            if (!channels[n]->output().remove(ports[n]))
+                result.failed++;
+        }
+
+        result.ok = result.failed == 0 && result.ticks > 0 && result.drops * 1000 <= result.ticks &&
+                    result.send_p99 < 1000.0 / format_desc.hz;
+
+        core::destroy_consumers_synchronously();
+        channels.clear();
+
+        return result;
+    }
+
+    int run()
+    {
+        std::wcout << std::left << std::setw(32) << L"consumer" << std::setw(12) << L"format" << std::right
+                   << std::setw(6) << L"count" << std::setw(10) << L"sends" << std::setw(10) << L"p50 ms"
+                   << std::setw(10) << L"p99 ms" << std::setw(10) << L"max ms" << std::setw(8) << L"drops"
+                   << std::setw(8) << L"failed" << std::setw(10) << L"cpu %" << std::endl;
+
+        std::vector<std::tuple<std::wstring, std::wstring, int>> capacities;
+        for (auto& format : options_.formats) {
+            auto format_desc = format_repository_.find(format);
+            if (format_desc.format == core::video_format::invalid)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video-mode: " + format));
+
+            // The cpu of the channels themselves at each count, taken off that of the consumers.
+            std::map<int, double> baseline;
+            for (auto count : options_.counts)
+                baseline[count] = run(format_desc, nullptr, count).cpu;
+
+            for (auto& consumer : options_.consumers) {
+                int capacity = 0;
+                for (auto count : options_.counts) {
+                    step_result result;
+                    try {
+                        result = run(format_desc, &consumer, count);
+                    } catch (...) {
+                        CASPAR_LOG_CURRENT_EXCEPTION();
+                        result.count  = count;
+                        result.failed = count;
+                    }
+                    result.cpu = std::max(0.0, result.cpu - baseline[count]) / count;
+
+                    std::wcout << std::left << std::setw(32) << consumer << std::setw(12) << format_desc.name
+                               << std::right << std::setw(6) << count << std::setw(10) << result.sends << std::fixed
+                               << std::setprecision(3) << std::setw(10) << result.send_p50 << std::setw(10)
+                               << result.send_p99 << std::setw(10) << result.send_max << std::setw(8) << result.drops
+                               << std::setw(8) << result.failed << std::setprecision(1) << std::setw(10)
+                               << result.cpu << std::endl;
+
+                    if (!result.ok)
+                        break;
+                    capacity = count;
+                }
+                capacities.emplace_back(consumer, format_desc.name, capacity);
+            }
+        }
+
+        std::wcout << std::endl << L"capacity" << std::endl;
+        for (auto& c : capacities) {
+            std::wcout << std::left << std::setw(32) << std::get<0>(c) << std::setw(12) << std::get<1>(c)
+                       << std::right << std::setw(6) << std::get<2>(c);
+            if (std::get<2>(c) == options_.counts.back())
+                std::wcout << L" or more";
+            std::wcout << std::endl;
+        }
+
+        core::destroy_producers_synchronously();
+        return 0;
+    }
+};
+
+} // namespace caspar
+
+int main(int argc, char** argv)
+{
+    using namespace caspar;
+
+    try {
+        log::add_cout_sink();
+        log::set_log_level(L"warning");
+
+        auto options = parse_options(argc, argv);
+        env::configure(options.config);
+
+        return consumer_bench(options).run();
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        return 1;
+    }
+}
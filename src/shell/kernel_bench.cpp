@@ -0,0 +1,577 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Microbenchmarks of the cpu kernels on the frame path. Kernels working on images run at SD, HD and UHD, the others
+// once. Results are printed as a table, as csv or as json in the layout of Google Benchmark, so its compare tools can
+// be used between builds.
+//
+//   casparcg-kernel-bench [--filter memshfl] [--sizes sd,hd,uhd] [--min-time 0.5] [--repetitions 3]
+//                         [--output text|csv|json]
+
+#include <common/diagnostics/graph.h>
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/memory.h>
+#include <common/memshfl.h>
+#include <common/tweener.h>
+#include <common/utf.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/audio/audio_mixer.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include <modules/artnet/util/fixture_calculation.h>
+#include <modules/decklink/consumer/frame.h>
+#include <modules/ffmpeg/util/av_util.h>
+
+#include <protocol/osc/client.h>
+#include <protocol/osc/oscpack/OscOutboundPacketStream.h>
+#include <protocol/util/tokenize.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace caspar {
+
+struct kernel_bench_options
+{
+    std::string              filter;
+    std::vector<std::string> sizes       = {"sd", "hd", "uhd"};
+    double                   min_time    = 0.5;
+    int                      repetitions = 3;
+    std::string              output      = "text";
+};
+
+// What a kernel returns for one size: the body to time and how many bytes one run of it touches, 0 if that isn't
+// meaningful.
+struct kernel_run
+{
+    std::function<void()> body;
+    std::size_t           bytes = 0;
+};
+
+struct kernel
+{
+    std::string                                                name;
+    bool                                                       sized;
+    std::function<kernel_run(const core::video_format_desc&)> setup;
+};
+
+struct kernel_result
+{
+    std::string  name;
+    std::int64_t iterations;
+    double       ns_per_iteration;
+    double       bytes_per_second;
+};
+
+// Keeps the compiler from dropping a result nobody reads.
+template <typename T>
+void keep(const T& value)
+{
+    static const void* volatile sink;
+    sink = &value;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+}
+
+kernel_bench_options parse_options(int argc, char** argv)
+{
+    kernel_bench_options options;
+
+    for (int n = 1; n < argc; ++n) {
+        auto arg   = std::string(argv[n]);
+        auto value = [&]() -> std::string {
+            if (n + 1 >= argc)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info("Missing value for " + arg));
+            return std::string(argv[++n]);
+        };
+
+        if (arg == "--filter")
+            options.filter = value();
+        else if (arg == "--sizes")
+            boost::split(options.sizes, value(), boost::is_any_of(","));
+        else if (arg == "--min-time")
+            options.min_time = boost::lexical_cast<double>(value());
+        else if (arg == "--repetitions")
+            options.repetitions = std::max(1, boost::lexical_cast<int>(value()));
+        else if (arg == "--output")
+            options.output = value();
+        else
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Unknown argument " + arg));
+    }
+
+    if (options.output != "text" && options.output != "csv" && options.output != "json")
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid output " + options.output));
+
+    return options;
+}
+
+core::video_format_desc format_for_size(const std::string& size)
+{
+    core::video_format_repository repository;
+
+    if (size == "sd")
+        return repository.find(L"PAL");
+    if (size == "hd")
+        return repository.find(L"1080p5000");
+    if (size == "uhd")
+        return repository.find(L"2160p5000");
+
+    CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid size " + size));
+}
+
+// A bgra frame of the format filled with a gradient, so nothing can take a shortcut on uniform data.
+core::const_frame make_bgra_frame(const core::video_format_desc& format_desc)
+{
+    core::pixel_format_desc desc(core::pixel_format::bgra);
+    desc.planes.emplace_back(format_desc.width, format_desc.height, 4);
+
+    array<std::uint8_t> image(desc.planes[0].size);
+    for (std::size_t n = 0; n < image.size(); ++n)
+        image.data()[n] = static_cast<std::uint8_t>(n * 7 + n / 4096);
+
+    core::const_image_data_t planes;
+    planes.emplace_back(std::move(image));
+    return core::const_frame(std::move(planes), array<const std::int32_t>(), desc);
+}
+
+// Hands out plain memory, like the mixer does without a gpu in the way.
+class cpu_frame_factory : public core::frame_factory
+{
+  public:
+    core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override
+    {
+        core::image_data_t planes;
+        for (auto& plane : desc.planes)
+            planes.emplace_back(plane.size);
+        return core::mutable_frame(tag, std::move(planes), array<std::int32_t>(), desc);
+    }
+
+    array<std::uint8_t> create_array(int size) override { return array<std::uint8_t>(size); }
+
+    core::mutable_frame create_frame(const void*                    tag,
+                                     const core::pixel_format_desc& desc,
+                                     core::image_data_t             image_data) override
+    {
+        return core::mutable_frame(tag, std::move(image_data), array<std::int32_t>(), desc);
+    }
+};
+
+// The state of a stage with a playing clip on each of 20 layers, about as much as a busy channel reports every tick.
+core::monitor::state make_stage_state()
+{
+    core::monitor::state state;
+    for (int layer = 1; layer <= 20; ++layer) {
+        auto foreground = state["channel"][1]["stage"]["layer"][layer]["foreground"];
+
+        foreground["producer"]             = std::string("ffmpeg");
+        foreground["file"]["name"]         = std::wstring(L"folder/clip") + std::to_wstring(layer) + L".mov";
+        foreground["file"]["path"]         = std::wstring(L"/media/folder/clip") + std::to_wstring(layer) + L".mov";
+        foreground["file"]["time"]         = {12.48 + layer, 60.0};
+        foreground["file"]["clip"]         = {0.0, 60.0};
+        foreground["file"]["streams"][0]   = {std::string("h264"), 1920, 1080};
+        foreground["file"]["streams"][1]   = {std::string("pcm_s24le"), 48000, 8};
+        foreground["loop"]                 = layer % 2 == 0;
+        foreground["paused"]               = false;
+        foreground["frame"]                = {static_cast<std::int64_t>(624 + layer), static_cast<std::int64_t>(3000)};
+        state["channel"][1]["stage"]["layer"][layer]["background"]["producer"] = std::string("empty");
+    }
+    return state;
+}
+
+std::vector<kernel> make_kernels()
+{
+    std::vector<kernel> kernels;
+
+    kernels.push_back({"memshfl", true, [](const core::video_format_desc& format_desc) {
+                           auto size   = static_cast<std::size_t>(format_desc.width) * format_desc.height * 4;
+                           auto source = create_aligned_buffer(size);
+                           auto dest   = create_aligned_buffer(size);
+                           std::memset(source.get(), 0x5A, size);
+
+                           return kernel_run{[=] {
+                                                 memshfl(dest.get(),
+                                                         source.get(),
+                                                         size,
+                                                         0x0F0F0F0F,
+                                                         0x0B0B0B0B,
+                                                         0x07070707,
+                                                         0x03030303);
+                                                 keep(dest);
+                                             },
+                                             size};
+                       }});
+
+    // The fast path copies whole lines, a sub-region goes through the per line path and key only adds the shuffle.
+    struct decklink_variant
+    {
+        const char* name;
+        int         src_x;
+        bool        key_only;
+    };
+    for (auto variant : {decklink_variant{"decklink_convert_frame", 0, false},
+                         decklink_variant{"decklink_convert_frame_region", 16, false},
+                         decklink_variant{"decklink_convert_to_key_only", 0, true}}) {
+        kernels.push_back({variant.name, true, [variant](const core::video_format_desc& format_desc) {
+                               decklink::port_configuration config;
+                               config.src_x    = variant.src_x;
+                               config.key_only = variant.key_only;
+
+                               auto frame = make_bgra_frame(format_desc);
+                               auto pool  = std::make_shared<decklink::frame_pool>();
+
+                               return kernel_run{[=] {
+                                                     auto image = decklink::convert_frame_for_port(format_desc,
+                                                                                                   format_desc,
+                                                                                                   config,
+                                                                                                   frame,
+                                                                                                   frame,
+                                                                                                   bmdProgressiveFrame,
+                                                                                                   *pool);
+                                                     keep(image);
+                                                 },
+                                                 format_desc.size};
+                           }});
+    }
+
+    kernels.push_back({"audio_mixer", true, [](const core::video_format_desc& format_desc) {
+                           // Every layer of a busy channel with audio, mixed at half volume.
+                           const int layers     = 8;
+                           auto      nb_samples = format_desc.audio_cadence.front();
+                           auto      channels   = format_desc.audio_channels;
+
+                           std::vector<core::const_frame> frames;
+                           for (int n = 0; n < layers; ++n) {
+                               std::vector<std::int32_t> samples(static_cast<std::size_t>(nb_samples) * channels);
+                               for (std::size_t s = 0; s < samples.size(); ++s)
+                                   samples[s] = static_cast<std::int32_t>((s * 2654435761u) >> 4) - (1 << 27);
+                               frames.emplace_back(core::const_image_data_t(),
+                                                   array<const std::int32_t>(std::move(samples)),
+                                                   core::pixel_format_desc(core::pixel_format::invalid));
+                           }
+
+                           core::frame_transform transform;
+                           transform.audio_transform.volume = 0.5;
+
+                           auto mixer = std::make_shared<core::audio_mixer>(spl::make_shared<diagnostics::graph>());
+
+                           return kernel_run{[=] {
+                                                 for (auto& frame : frames) {
+                                                     mixer->push(transform);
+                                                     mixer->visit(frame);
+                                                     mixer->pop();
+                                                 }
+                                                 keep((*mixer)(format_desc, nb_samples));
+                                             },
+                                             static_cast<std::size_t>(layers) * nb_samples * channels * 4};
+                       }});
+
+    kernels.push_back({"ffmpeg_make_frame", true, [](const core::video_format_desc& format_desc) {
+                           // A decoded yuv420p picture that didn't land in mixer memory, so every plane is copied.
+                           auto video    = ffmpeg::alloc_frame();
+                           video->format = AV_PIX_FMT_YUV420P;
+                           video->width  = format_desc.width;
+                           video->height = format_desc.height;
+                           if (av_frame_get_buffer(video.get(), 0) < 0)
+                               CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("av_frame_get_buffer failed"));
+                           for (int n = 0; n < 3; ++n) {
+                               auto height = n == 0 ? video->height : (video->height + 1) / 2;
+                               auto size   = static_cast<std::size_t>(video->linesize[n]) * height;
+                               std::memset(video->data[n], 0x30 + n, size);
+                           }
+
+                           auto factory = std::make_shared<cpu_frame_factory>();
+
+                           return kernel_run{[=] {
+                                                 keep(ffmpeg::make_frame(factory.get(), *factory, video, nullptr));
+                                             },
+                                             static_cast<std::size_t>(format_desc.width) * format_desc.height * 3 / 2};
+                       }});
+
+    kernels.push_back({"artnet_average_color", true, [](const core::video_format_desc& format_desc) {
+                           // A rotated strip of 32 fixtures across the middle of the frame.
+                           auto frame = make_bgra_frame(format_desc);
+
+                           artnet::box box{format_desc.width / 2.0f,
+                                           format_desc.height / 2.0f,
+                                           format_desc.width * 0.9f,
+                                           format_desc.height / 4.0f,
+                                           10.0f};
+
+                           std::vector<std::vector<artnet::span>> fixtures;
+                           std::size_t                            pixels = 0;
+                           for (int n = 0; n < 32; ++n) {
+                               fixtures.push_back(artnet::compute_spans(
+                                   artnet::compute_rect(box, n, 32), format_desc.width, format_desc.height));
+                               for (auto& span : fixtures.back())
+                                   pixels += span.end - span.begin + 1;
+                           }
+
+                           return kernel_run{[=] {
+                                                 for (auto& spans : fixtures)
+                                                     keep(artnet::average_color(frame, spans));
+                                             },
+                                             pixels * 4};
+                       }});
+
+    kernels.push_back({"tokenize", false, [](const core::video_format_desc&) {
+                           const std::wstring message =
+                               L"PLAY 1-10 \"folder/clip name with spaces\" LOOP SEEK 25 LENGTH 500 MIX 25 EASEINSINE";
+
+                           auto tokens  = std::make_shared<std::vector<std::wstring_view>>();
+                           auto storage = std::make_shared<std::wstring>();
+
+                           return kernel_run{[=] {
+                                                 tokens->clear();
+                                                 storage->clear();
+                                                 keep(IO::tokenize(message, *tokens, *storage));
+                                             },
+                                             message.size() * sizeof(wchar_t)};
+                       }});
+
+    kernels.push_back({"monitor_state", false, [](const core::video_format_desc&) {
+                           return kernel_run{[] { keep(make_stage_state()); }};
+                       }});
+
+    kernels.push_back({"osc_serialize", false, [](const core::video_format_desc&) {
+                           // Bundles of at most 2048 bytes, like the client sends to a new subscriber.
+                           auto state  = make_stage_state();
+                           auto buffer = std::make_shared<std::vector<char>>(1000000);
+
+                           return kernel_run{[=] {
+                                                 auto        it     = state.begin();
+                                                 std::size_t offset = 0;
+                                                 while (it != state.end()) {
+                                                     ::osc::OutboundPacketStream o(buffer->data() + offset, 65507);
+                                                     o << ::osc::BeginBundle(1);
+                                                     while (it != state.end() && o.Size() < 2048) {
+                                                         protocol::osc::write_message(o, it->first, it->second);
+                                                         ++it;
+                                                     }
+                                                     o << ::osc::EndBundle;
+                                                     offset += o.Size();
+                                                 }
+                                                 keep(offset);
+                                             }};
+                       }});
+
+    kernels.push_back({"image_transform_multiply", false, [](const core::video_format_desc&) {
+                           core::image_transform lhs;
+                           lhs.opacity          = 0.8;
+                           lhs.fill_translation = {0.1, 0.2};
+                           lhs.fill_scale       = {0.5, 0.5};
+                           lhs.angle            = 0.3;
+                           core::image_transform rhs;
+                           rhs.brightness       = 1.2;
+                           rhs.fill_translation = {0.25, 0.25};
+                           rhs.fill_scale       = {0.5, 0.5};
+                           rhs.crop.ul          = {0.1, 0.1};
+
+                           return kernel_run{[=] { keep(lhs * rhs); }};
+                       }});
+
+    kernels.push_back({"image_transform_tween", false, [](const core::video_format_desc&) {
+                           core::image_transform source;
+                           core::image_transform dest;
+                           dest.opacity          = 0.5;
+                           dest.fill_translation = {0.5, 0.5};
+                           dest.fill_scale       = {0.5, 0.5};
+                           dest.angle            = 1.0;
+                           dest.levels.gamma     = 1.5;
+
+                           tweener tween(L"easeinoutsine");
+
+                           return kernel_run{
+                               [=] { keep(core::image_transform::tween(12.0, source, dest, 25.0, tween)); }};
+                       }});
+
+    return kernels;
+}
+
+// Runs the body in batches growing until one takes at least min_time, and reports that batch.
+kernel_result measure(const std::string& name, const kernel_run& run, double min_time)
+{
+    using clock = std::chrono::steady_clock;
+
+    run.body();
+
+    std::int64_t iterations = 1;
+    while (true) {
+        auto start = clock::now();
+        for (std::int64_t n = 0; n < iterations; ++n)
+            run.body();
+        auto elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+        if (elapsed >= min_time || iterations >= (std::int64_t(1) << 40)) {
+            auto seconds = elapsed / static_cast<double>(iterations);
+            return kernel_result{name, iterations, seconds * 1e9, run.bytes > 0 ? run.bytes / seconds : 0.0};
+        }
+
+        // Aim a little past min_time, but don't jump more than tenfold on a batch too short to time well.
+        auto factor = elapsed > 0 ? std::min(10.0, std::max(1.5, 1.4 * min_time / elapsed)) : 10.0;
+        iterations  = static_cast<std::int64_t>(std::ceil(iterations * factor));
+    }
+}
+
+std::string cpu_model()
+{
+#if defined(__linux__)
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string   line;
+    while (std::getline(cpuinfo, line)) {
+        if (boost::starts_with(line, "model name")) {
+            auto colon = line.find(':');
+            if (colon != std::string::npos)
+                return boost::trim_copy(line.substr(colon + 1));
+        }
+    }
+#endif
+    return "";
+}
+
+std::string escape_json(const std::string& value)
+{
+    std::string result;
+    for (auto c : value) {
+        if (c == '"' || c == '\\')
+            result += '\\';
+        result += c;
+    }
+    return result;
+}
+
+void print_results(const kernel_bench_options& options, const std::vector<kernel_result>& results)
+{
+    if (options.output == "json") {
+        auto now = std::time(nullptr);
+        char date[32];
+        std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+        std::cout << "{\n  \"context\": {\n";
+        std::cout << "    \"date\": \"" << date << "\",\n";
+        std::cout << "    \"executable\": \"casparcg-kernel-bench\",\n";
+        std::cout << "    \"caspar_version\": \"" << escape_json(u8(env::version())) << "\",\n";
+        std::cout << "    \"cpu_model\": \"" << escape_json(cpu_model()) << "\",\n";
+        std::cout << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+        std::cout << "    \"repetitions\": " << options.repetitions << "\n";
+        std::cout << "  },\n  \"benchmarks\": [";
+        for (std::size_t n = 0; n < results.size(); ++n) {
+            auto& r = results[n];
+            std::cout << (n == 0 ? "\n" : ",\n") << "    {\"name\": \"" << escape_json(r.name)
+                      << "\", \"run_type\": \"iteration\", \"iterations\": " << r.iterations << std::fixed
+                      << std::setprecision(3) << ", \"real_time\": " << r.ns_per_iteration
+                      << ", \"cpu_time\": " << r.ns_per_iteration << ", \"time_unit\": \"ns\"";
+            if (r.bytes_per_second > 0)
+                std::cout << ", \"bytes_per_second\": " << std::setprecision(0) << r.bytes_per_second;
+            std::cout << "}";
+        }
+        std::cout << "\n  ]\n}" << std::endl;
+    } else if (options.output == "csv") {
+        std::cout << "name,iterations,ns_per_iteration,bytes_per_second" << std::endl;
+        for (auto& r : results)
+            std::cout << r.name << ',' << r.iterations << ',' << std::fixed << std::setprecision(3)
+                      << r.ns_per_iteration << ',' << std::setprecision(0) << r.bytes_per_second << std::endl;
+    } else {
+        std::cout << std::left << std::setw(36) << "kernel" << std::right << std::setw(14) << "iterations"
+                  << std::setw(16) << "ns/iteration" << std::setw(12) << "GB/s" << std::endl;
+        for (auto& r : results) {
+            std::cout << std::left << std::setw(36) << r.name << std::right << std::setw(14) << r.iterations
+                      << std::fixed << std::setprecision(1) << std::setw(16) << r.ns_per_iteration;
+            if (r.bytes_per_second > 0)
+                std::cout << std::setprecision(2) << std::setw(12) << r.bytes_per_second / 1e9;
+            std::cout << std::endl;
+        }
+    }
+}
+
+int run(const kernel_bench_options& options)
+{
+    std::vector<kernel_result> results;
+
+    for (auto& kernel : make_kernels()) {
+        auto sizes = kernel.sized ? options.sizes : std::vector<std::string>{""};
+        for (auto& size : sizes) {
+            auto name = size.empty() ? kernel.name : kernel.name + "/" + size;
+            if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+                continue;
+
+            auto run = kernel.setup(size.empty() ? core::video_format_desc() : format_for_size(size));
+
+            // The median of the repetitions, so one run disturbed by the rest of the machine doesn't count.
+            std::vector<kernel_result> repetitions;
+            for (int n = 0; n < options.repetitions; ++n)
+                repetitions.push_back(measure(name, run, options.min_time));
+            std::sort(repetitions.begin(), repetitions.end(), [](auto& lhs, auto& rhs) {
+                return lhs.ns_per_iteration < rhs.ns_per_iteration;
+            });
+            results.push_back(repetitions[repetitions.size() / 2]);
+
+            if (options.output == "text")
+                std::cerr << "." << std::flush;
+        }
+    }
+
+    if (options.output == "text")
+        std::cerr << std::endl;
+
+    print_results(options, results);
+
+    return 0;
+}
+
+} // namespace caspar
+
+int main(int argc, char** argv)
+{
+    using namespace caspar;
+
+    try {
+        log::add_cout_sink();
+        log::set_log_level(L"warning");
+
+        return run(parse_options(argc, argv));
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        return 1;
+    }
+}
@@ -45,7 +45,10 @@
 #include <boost/stacktrace.hpp>
 
 #include <atomic>
+#include <functional>
 #include <future>
+#include <memory>
+#include <mutex>
 #include <thread>
 
 #include <clocale>
@@ -79,40 +82,42 @@ void print_info()
     CASPAR_LOG(info) << L"Starting CasparCG Video and Graphics Playout Server " << env::version();
 }
 
-auto run(const std::wstring& config_file_name, std::atomic<bool>& should_wait_for_keypress)
+// Reads commands from the console for whichever server is running, the thread outlives warm restarts.
+class console_input
 {
-    auto promise  = std::make_shared<std::promise<bool>>();
-    auto future   = promise->get_future();
-    auto shutdown = [promise = std::move(promise)](bool restart) { promise->set_value(restart); };
-
-    print_info();
-
-    // Create server object which initializes channels, protocols and controllers.
-    std::unique_ptr<server> caspar_server(new server(shutdown));
-
-    // For example CEF resets the global locale, so this is to reset it back to "our" preference.
-    setup_global_locale();
-
-    std::wstringstream                                      str;
-    boost::property_tree::xml_writer_settings<std::wstring> w(' ', 3);
-    boost::property_tree::write_xml(str, env::properties(), w);
-    CASPAR_LOG(info) << boost::filesystem::absolute(config_file_name).lexically_normal()
-                     << L":\n-----------------------------------------\n"
-                     << str.str() << L"-----------------------------------------";
-
-    caspar_server->start();
-
-    // Create a dummy client which prints amcp responses to console.
-    auto console_client = spl::make_shared<IO::ConsoleClientInfo>();
+    std::mutex                                         mutex_;
+    std::shared_ptr<IO::protocol_strategy<wchar_t>>    amcp_;
+    std::function<void(protocol::amcp::shutdown_mode)> shutdown_;
+    std::once_flag                                     started_;
+
+  public:
+    void attach(std::shared_ptr<IO::protocol_strategy<wchar_t>>    amcp,
+                std::function<void(protocol::amcp::shutdown_mode)> shutdown,
+                std::atomic<bool>&                                 should_wait_for_keypress)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            amcp_     = std::move(amcp);
+            shutdown_ = std::move(shutdown);
+        }
 
-    auto amcp =
-        protocol::amcp::create_wchar_amcp_strategy_factory(L"Console", caspar_server->get_amcp_command_repository())
-            ->create(console_client);
+        // Use separate thread for the blocking console input, will be terminated
+        // anyway when the main thread terminates.
+        std::call_once(started_, [&] {
+            std::thread([this, &should_wait_for_keypress] { read(should_wait_for_keypress); }).detach();
+        });
+    }
 
-    // Use separate thread for the blocking console input, will be terminated
-    // anyway when the main thread terminates.
+    void detach()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        amcp_.reset();
+        shutdown_ = nullptr;
+    }
 
-    std::thread([&]() mutable {
+  private:
+    void read(std::atomic<bool>& should_wait_for_keypress)
+    {
         std::wstring wcmd;
         while (true) {
 #ifdef WIN32
@@ -135,27 +140,88 @@ auto run(const std::wstring& config_file_name, std::atomic<bool>& should_wait_fo
 #endif
 
             // If the cmd is empty, no point trying to parse it
-            if (!wcmd.empty()) {
-                if (boost::iequals(wcmd, L"EXIT") || boost::iequals(wcmd, L"Q") || boost::iequals(wcmd, L"QUIT") ||
-                    boost::iequals(wcmd, L"BYE")) {
-                    CASPAR_LOG(info) << L"Received message from Console: " << wcmd << L"\\r\\n";
-                    should_wait_for_keypress = true;
-                    shutdown(false); // false to not restart
-                    break;
-                }
+            if (wcmd.empty())
+                continue;
+
+            // Held while parsing, so a server being replaced doesn't go away under a command.
+            std::lock_guard<std::mutex> lock(mutex_);
 
+            if (boost::iequals(wcmd, L"EXIT") || boost::iequals(wcmd, L"Q") || boost::iequals(wcmd, L"QUIT") ||
+                boost::iequals(wcmd, L"BYE")) {
+                CASPAR_LOG(info) << L"Received message from Console: " << wcmd << L"\\r\\n";
+                should_wait_for_keypress = true;
+                if (shutdown_)
+                    shutdown_(protocol::amcp::shutdown_mode::exit);
+                break;
+            }
+
+            if (amcp_) {
                 wcmd += L"\r\n";
-                amcp->parse(wcmd);
+                amcp_->parse(wcmd);
             }
         }
-    }).detach();
+    }
+};
+
+console_input& console()
+{
+    static console_input input;
+    return input;
+}
+
+auto run(const std::wstring&                config_file_name,
+         std::atomic<bool>&                 should_wait_for_keypress,
+         std::shared_ptr<server_resources>& resources)
+{
+    auto promise  = std::make_shared<std::promise<protocol::amcp::shutdown_mode>>();
+    auto future   = promise->get_future();
+    auto shutdown = [promise = std::move(promise)](protocol::amcp::shutdown_mode mode) { promise->set_value(mode); };
+
+    print_info();
+
+    // Create server object which initializes channels, protocols and controllers.
+    std::unique_ptr<server> caspar_server(new server(shutdown, resources));
+    resources = caspar_server->resources();
+
+    // For example CEF resets the global locale, so this is to reset it back to "our" preference.
+    setup_global_locale();
+
+    std::wstringstream                                      str;
+    boost::property_tree::xml_writer_settings<std::wstring> w(' ', 3);
+    boost::property_tree::write_xml(str, env::properties(), w);
+    CASPAR_LOG(info) << boost::filesystem::absolute(config_file_name).lexically_normal()
+                     << L":\n-----------------------------------------\n"
+                     << str.str() << L"-----------------------------------------";
+
+    caspar_server->start();
+
+    // Create a dummy client which prints amcp responses to console.
+    auto console_client = spl::make_shared<IO::ConsoleClientInfo>();
+
+    auto amcp =
+        protocol::amcp::create_wchar_amcp_strategy_factory(L"Console", caspar_server->get_amcp_command_repository())
+            ->create(console_client);
+
+    console().attach(amcp, shutdown, should_wait_for_keypress);
     future.wait();
+    console().detach();
 
     caspar_server.reset();
 
     return future.get();
 }
 
+void configure_logging()
+{
+    log::set_log_column_alignment(env::properties().get(L"configuration.log-align-columns", true));
+
+    std::wstring target_level = env::properties().get(L"configuration.log-level", L"info");
+    if (!log::set_log_level(target_level)) {
+        log::set_log_level(L"info");
+        std::wcout << L"Failed to set log level [" << target_level << L"]" << std::endl;
+    }
+}
+
 void signal_handler(int signum)
 {
     ::signal(signum, SIG_DFL);
@@ -219,15 +285,7 @@ int main(int argc, char** argv)
         log::add_cout_sink();
         env::configure(config_file_name);
 
-        log::set_log_column_alignment(env::properties().get(L"configuration.log-align-columns", true));
-
-        {
-            std::wstring target_level = env::properties().get(L"configuration.log-level", L"info");
-            if (!log::set_log_level(target_level)) {
-                log::set_log_level(L"info");
-                std::wcout << L"Failed to set log level [" << target_level << L"]" << std::endl;
-            }
-        }
+        configure_logging();
 
         if (env::properties().get(L"configuration.debugging.remote", false))
             wait_for_remote_debugging();
@@ -251,8 +309,18 @@ int main(int argc, char** argv)
 
         std::atomic<bool> should_wait_for_keypress;
         should_wait_for_keypress = false;
-        auto should_restart      = run(config_file_name, should_wait_for_keypress);
-        return_code              = should_restart ? 5 : 0;
+
+        // A warm restart reads the configuration again and builds a new server on the resources of the old one.
+        std::shared_ptr<server_resources> resources;
+        auto                              mode = run(config_file_name, should_wait_for_keypress, resources);
+        while (mode == protocol::amcp::shutdown_mode::warm_restart) {
+            CASPAR_LOG(info) << L"Restarting CasparCG Server.";
+            env::configure(config_file_name);
+            configure_logging();
+            mode = run(config_file_name, should_wait_for_keypress, resources);
+        }
+        resources.reset();
+        return_code = mode == protocol::amcp::shutdown_mode::restart ? 5 : 0;
 
         CASPAR_LOG(info) << "Successfully shutdown CasparCG Server.";
 
@@ -276,5 +344,7 @@ int main(int argc, char** argv)
         std::this_thread::sleep_for(std::chrono::milliseconds(4000));
     }
 
+    log::flush();
+
     return return_code;
 }
@@ -0,0 +1,441 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Plays an AMCP trace recorded with <amcp><record> back against a server. Every recorded connection gets a connection
+// of its own and sends its commands at the recorded times, divided by the speed, and the reply latency is reported per
+// command.
+//
+//   casparcg-replay [--host 127.0.0.1] [--port 5250] [--speed 1] [--timeout 10] [--output text|csv] amcp.trace
+//
+// A speed of 0 sends every command as soon as the previous one of its connection has been sent.
+
+#include <common/except.h>
+#include <common/log.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace caspar {
+
+using replay_clock = std::chrono::steady_clock;
+
+struct replay_options
+{
+    std::string    host    = "127.0.0.1";
+    unsigned short port    = 5250;
+    double         speed   = 1.0;
+    double         timeout = 10.0;
+    std::string    output  = "text";
+    std::string    trace;
+};
+
+struct trace_command
+{
+    std::int64_t micros;
+    std::string  command;
+};
+
+struct trace_connection
+{
+    std::string                address;
+    std::vector<trace_command> commands;
+};
+
+// Latencies in ms by command, and the commands that failed or got no reply at all.
+class replay_stats
+{
+    struct entry
+    {
+        std::vector<double> latencies;
+        std::int64_t        errors     = 0;
+        std::int64_t        unanswered = 0;
+    };
+
+    std::mutex                   mutex_;
+    std::map<std::string, entry> entries_;
+    double                       max_lag_ = 0.0;
+
+  public:
+    void reply(const std::string& type, double latency, bool error)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto&                       e = entries_[type];
+        e.latencies.push_back(latency);
+        if (error)
+            ++e.errors;
+    }
+
+    void unanswered(const std::string& type)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++entries_[type].unanswered;
+    }
+
+    // How far behind the recorded schedule a command went out, the replay can't keep up when this grows.
+    void lag(double ms)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        max_lag_ = std::max(max_lag_, ms);
+    }
+
+    void print(const std::string& output)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto csv = output == "csv";
+        if (csv)
+            std::cout << "command,count,errors,unanswered,p50_ms,p90_ms,p99_ms,max_ms" << std::endl;
+        else
+            std::cout << std::left << std::setw(24) << "command" << std::right << std::setw(8) << "count"
+                      << std::setw(8) << "errors" << std::setw(12) << "unanswered" << std::setw(10) << "p50 ms"
+                      << std::setw(10) << "p90 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "max ms"
+                      << std::endl;
+
+        for (auto& p : entries_) {
+            auto& values = p.second.latencies;
+            std::sort(values.begin(), values.end());
+
+            auto percentile = [&](double q) {
+                if (values.empty())
+                    return 0.0;
+                return values[std::min(values.size() - 1, static_cast<size_t>(q * static_cast<double>(values.size())))];
+            };
+
+            std::cout << std::fixed << std::setprecision(3);
+            if (csv)
+                std::cout << p.first << ',' << values.size() << ',' << p.second.errors << ',' << p.second.unanswered
+                          << ',' << percentile(0.5) << ',' << percentile(0.9) << ',' << percentile(0.99) << ','
+                          << (values.empty() ? 0.0 : values.back()) << std::endl;
+            else
+                std::cout << std::left << std::setw(24) << p.first << std::right << std::setw(8) << values.size()
+                          << std::setw(8) << p.second.errors << std::setw(12) << p.second.unanswered << std::setw(10)
+                          << percentile(0.5) << std::setw(10) << percentile(0.9) << std::setw(10) << percentile(0.99)
+                          << std::setw(10) << (values.empty() ? 0.0 : values.back()) << std::endl;
+        }
+
+        if (!csv)
+            std::cout << std::endl << "max schedule lag: " << std::setprecision(1) << max_lag_ << " ms" << std::endl;
+    }
+};
+
+replay_options parse_options(int argc, char** argv)
+{
+    replay_options options;
+
+    for (int n = 1; n < argc; ++n) {
+        auto arg   = std::string(argv[n]);
+        auto value = [&]() -> std::string {
+            if (n + 1 >= argc)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info("Missing value for " + arg));
+            return std::string(argv[++n]);
+        };
+
+        if (arg == "--host")
+            options.host = value();
+        else if (arg == "--port")
+            options.port = boost::lexical_cast<unsigned short>(value());
+        else if (arg == "--speed")
+            options.speed = std::max(0.0, boost::lexical_cast<double>(value()));
+        else if (arg == "--timeout")
+            options.timeout = boost::lexical_cast<double>(value());
+        else if (arg == "--output")
+            options.output = value();
+        else if (boost::starts_with(arg, "--"))
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Unknown argument " + arg));
+        else
+            options.trace = arg;
+    }
+
+    if (options.trace.empty())
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info("No trace file given"));
+
+    return options;
+}
+
+std::map<int, trace_connection> read_trace(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info("Failed to open " + path));
+
+    std::map<int, trace_connection> connections;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream stream(line);
+        if (line[0] == 'C') {
+            char tag;
+            int  connection;
+            stream >> tag >> connection >> std::ws;
+            std::getline(stream, connections[connection].address);
+            continue;
+        }
+
+        std::int64_t micros;
+        int          connection;
+        if (!(stream >> micros >> connection))
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid trace line: " + line));
+        stream.get(); // the space before the command
+
+        std::string command;
+        std::getline(stream, command);
+        connections[connection].commands.push_back({micros, std::move(command)});
+    }
+
+    return connections;
+}
+
+// What a command is reported as: its name, and the sub command of the commands that have them, such as MIXER FILL.
+std::string command_type(const std::vector<std::string>& tokens)
+{
+    if (tokens.empty())
+        return "";
+
+    auto name = boost::to_upper_copy(tokens[0]);
+    if (name == "MIXER" || name == "CG" || name == "DATA" || name == "INFO" || name == "THUMBNAIL") {
+        for (size_t n = 1; n < tokens.size() && n < 3; ++n) {
+            // Skip the channel and layer.
+            if (!tokens[n].empty() && std::isdigit(static_cast<unsigned char>(tokens[n][0])))
+                continue;
+            return name + " " + boost::to_upper_copy(tokens[n]);
+        }
+    }
+    return name;
+}
+
+class replay_connection
+{
+    struct pending
+    {
+        std::string       type;
+        replay_clock::time_point sent;
+    };
+
+    const trace_connection&      trace_;
+    replay_stats&                stats_;
+    boost::asio::io_context      context_;
+    boost::asio::ip::tcp::socket socket_{context_};
+
+    std::mutex                     mutex_;
+    std::condition_variable        answered_;
+    std::map<std::string, pending> pending_;
+    int                            next_id_ = 0;
+
+  public:
+    replay_connection(const trace_connection& trace, replay_stats& stats, const replay_options& options)
+        : trace_(trace)
+        , stats_(stats)
+    {
+        boost::asio::ip::tcp::resolver resolver(context_);
+        boost::asio::connect(socket_, resolver.resolve(options.host, std::to_string(options.port)));
+    }
+
+    void run(replay_clock::time_point start, const replay_options& options)
+    {
+        std::thread reader([this] { read(); });
+
+        auto in_batch = false;
+        auto batch_id = std::string();
+
+        for (auto& command : trace_.commands) {
+            if (options.speed > 0) {
+                auto due = start + std::chrono::microseconds(static_cast<std::int64_t>(command.micros / options.speed));
+                std::this_thread::sleep_until(due);
+                stats_.lag(std::chrono::duration<double, std::milli>(replay_clock::now() - due).count());
+            }
+
+            // Replies are matched on request ids of our own, whatever the recorded client used.
+            auto body = boost::trim_copy(command.command);
+            if (boost::istarts_with(body, "REQ ")) {
+                auto end = body.find(' ', body.find_first_not_of(' ', 4));
+                body     = end == std::string::npos ? "" : boost::trim_left_copy(body.substr(end));
+            }
+            if (body.empty())
+                continue;
+
+            std::vector<std::string> tokens;
+            boost::split(tokens, body, boost::is_any_of(" "), boost::token_compress_on);
+            auto type = command_type(tokens);
+            auto line = std::string();
+
+            if (type == "BEGIN") {
+                batch_id = "r" + std::to_string(next_id_++);
+                in_batch = true;
+                line     = "REQ " + batch_id + " " + body;
+            } else if (in_batch && (type == "COMMIT" || type == "DISCARD")) {
+                in_batch = false;
+                if (type == "COMMIT")
+                    track(batch_id, "BATCH");
+                line = body;
+            } else if (in_batch) {
+                line = body;
+            } else if (type == "PING") {
+                auto id = "r" + std::to_string(next_id_++);
+                track(id, type);
+                line = "PING " + id;
+            } else {
+                auto id = "r" + std::to_string(next_id_++);
+                track(id, type);
+                line = "REQ " + id + " " + body;
+            }
+
+            line += "\r\n";
+            boost::system::error_code ec;
+            boost::asio::write(socket_, boost::asio::buffer(line), ec);
+            if (ec) {
+                CASPAR_LOG(error) << L"Connection to the server lost: " << ec.message();
+                break;
+            }
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto timeout = std::chrono::duration<double>(options.timeout);
+            answered_.wait_for(lock, timeout, [this] { return pending_.empty(); });
+            for (auto& p : pending_)
+                stats_.unanswered(p.second.type);
+            pending_.clear();
+        }
+
+        boost::system::error_code ec;
+        socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+        socket_.close(ec);
+        reader.join();
+    }
+
+  private:
+    void track(const std::string& id, const std::string& type)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_[id] = pending{type, replay_clock::now()};
+    }
+
+    void read()
+    {
+        boost::asio::streambuf buffer;
+        while (true) {
+            boost::system::error_code ec;
+            boost::asio::read_until(socket_, buffer, "\r\n", ec);
+            if (ec)
+                return;
+
+            std::istream stream(&buffer);
+            std::string  line;
+            std::getline(stream, line);
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+
+            std::vector<std::string> tokens;
+            boost::split(tokens, line, boost::is_any_of(" "), boost::token_compress_on);
+
+            std::string id;
+            auto        error = false;
+            if (tokens.size() >= 3 && tokens[0] == "RES") {
+                id    = tokens[1];
+                error = !tokens[2].empty() && tokens[2][0] >= '4';
+            } else if (tokens.size() >= 2 && tokens[0] == "PONG") {
+                id = tokens[1];
+            } else {
+                continue; // the data lines of a reply
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto                        it = pending_.find(id);
+            if (it == pending_.end())
+                continue;
+
+            auto latency = std::chrono::duration<double, std::milli>(replay_clock::now() - it->second.sent).count();
+            stats_.reply(it->second.type, latency, error);
+            pending_.erase(it);
+            answered_.notify_all();
+        }
+    }
+};
+
+int run(const replay_options& options)
+{
+    auto trace = read_trace(options.trace);
+
+    std::size_t count = 0;
+    for (auto& p : trace)
+        count += p.second.commands.size();
+    std::cerr << "Replaying " << count << " commands on " << trace.size() << " connections to " << options.host << ":"
+              << options.port << std::endl;
+
+    replay_stats                                    stats;
+    std::vector<std::unique_ptr<replay_connection>> connections;
+    for (auto& p : trace) {
+        if (!p.second.commands.empty())
+            connections.push_back(std::make_unique<replay_connection>(p.second, stats, options));
+    }
+
+    // All connections share the start, so they overlap like they did when they were recorded.
+    auto                     start = replay_clock::now();
+    std::vector<std::thread> threads;
+    for (auto& connection : connections)
+        threads.emplace_back([&, connection = connection.get()] { connection->run(start, options); });
+    for (auto& thread : threads)
+        thread.join();
+
+    std::cerr << "Replayed in " << std::fixed << std::setprecision(1)
+              << std::chrono::duration<double>(replay_clock::now() - start).count() << " s" << std::endl
+              << std::endl;
+
+    stats.print(options.output);
+
+    return 0;
+}
+
+} // namespace caspar
+
+int main(int argc, char** argv)
+{
+    using namespace caspar;
+
+    try {
+        log::add_cout_sink();
+        log::set_log_level(L"warning");
+
+        return run(parse_options(argc, argv));
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        return 1;
+    }
+}
@@ -24,13 +24,19 @@
 
 #include <accelerator/accelerator.h>
 
+#include <common/diagnostics/trace.h>
 #include <common/env.h>
 #include <common/except.h>
 #include <common/memory.h>
+#include <common/memory_pool.h>
+#include <common/os/thread.h>
 #include <common/ptree.h>
+#include <common/timer.h>
 #include <common/utf.h>
 
 #include <core/consumer/output.h>
+#include <core/consumer/ptp_clock.h>
+#include <core/consumer/sync_group.h>
 #include <core/diagnostics/call_context.h>
 #include <core/diagnostics/osd_graph.h>
 #include <core/mixer/image/image_mixer.h>
@@ -41,91 +47,159 @@
 #include <core/video_format.h>
 
 #include <modules/image/consumer/image_consumer.h>
+#include <modules/netroute/server/route_server.h>
 
 #include <protocol/amcp/AMCPCommandsImpl.h>
 #include <protocol/amcp/AMCPProtocolStrategy.h>
 #include <protocol/amcp/amcp_command_repository.h>
 #include <protocol/amcp/amcp_shared.h>
+#include <protocol/amcp/command_recorder.h>
+#include <protocol/amcp/data_store.h>
+#include <protocol/amcp/layer_loader.h>
+#include <protocol/amcp/media_index.h>
+#include <protocol/amcp/thumbnail_generator.h>
 #include <protocol/osc/client.h>
 #include <protocol/util/AsyncEventServer.h>
+#include <protocol/util/metrics_server.h>
+#include <protocol/util/websocket_server.h>
 #include <protocol/util/strategy_adapters.h>
 #include <protocol/util/tokenize.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 #include <boost/property_tree/ptree.hpp>
 
+#include <algorithm>
+#include <ctime>
+#include <future>
+#include <map>
 #include <thread>
 #include <utility>
+#include <vector>
 
 namespace caspar {
 using namespace core;
 using namespace protocol;
 
-std::shared_ptr<boost::asio::io_service> create_running_io_service()
+std::shared_ptr<boost::asio::io_service> create_running_io_service(int thread_count)
 {
-    auto service = std::make_shared<boost::asio::io_service>();
+    auto service = std::make_shared<boost::asio::io_service>(thread_count);
     // To keep the io_service::run() running although no pending async
     // operations are posted.
     auto work      = std::make_shared<boost::asio::io_service::work>(*service);
     auto weak_work = std::weak_ptr<boost::asio::io_service::work>(work);
-    auto thread    = std::make_shared<std::thread>([service, weak_work] {
-        while (auto strong = weak_work.lock()) {
-            try {
-                service->run();
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
+
+    // Every connection runs on its own strand, so a client flooding the server only holds up its own replies.
+    auto threads = std::make_shared<std::vector<std::thread>>();
+    for (int n = 0; n < thread_count; ++n) {
+        threads->emplace_back([service, weak_work, n] {
+            set_thread_name(L"asio " + std::to_wstring(n));
+
+            while (auto strong = weak_work.lock()) {
+                try {
+                    service->run();
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
             }
-        }
 
-        CASPAR_LOG(info) << "[asio] Global io_service uninitialized.";
-    });
+            CASPAR_LOG(info) << "[asio] Global io_service uninitialized.";
+        });
+    }
 
-    return std::shared_ptr<boost::asio::io_service>(service.get(), [service, work, thread](void*) mutable {
+    return std::shared_ptr<boost::asio::io_service>(service.get(), [service, work, threads](void*) mutable {
         CASPAR_LOG(info) << "[asio] Shutting down global io_service.";
         work.reset();
         service->stop();
-        if (thread->get_id() != std::this_thread::get_id())
-            thread->join();
-        else
-            thread->detach();
+        for (auto& thread : *threads) {
+            if (thread.get_id() != std::this_thread::get_id())
+                thread.join();
+            else
+                thread.detach();
+        }
     });
 }
 
+struct server_resources
+{
+    accelerator::accelerator                       accelerator{core::video_format_repository()};
+    spl::shared_ptr<core::cg_producer_registry>    cg_registry;
+    spl::shared_ptr<core::frame_producer_registry> producer_registry;
+    spl::shared_ptr<core::frame_consumer_registry> consumer_registry;
+
+    // What the modules registered, replayed on the command repository of every server after the first one.
+    std::vector<amcp::amcp_command_repository_wrapper::registration> module_commands;
+    bool                                                             modules_initialized = false;
+
+    server_resources() { caspar::core::diagnostics::osd::register_sink(); }
+
+    ~server_resources()
+    {
+        if (modules_initialized)
+            uninitialize_modules();
+        core::diagnostics::osd::shutdown();
+    }
+
+    server_resources(const server_resources&)            = delete;
+    server_resources& operator=(const server_resources&) = delete;
+};
+
 struct server::impl
 {
-    std::shared_ptr<boost::asio::io_service>               io_service_ = create_running_io_service();
+    std::shared_ptr<server_resources>                      resources_;
+    std::shared_ptr<boost::asio::io_service>               io_service_ =
+        create_running_io_service(std::max(1, env::properties().get(L"configuration.io-threads", 4)));
     video_format_repository                                video_format_repository_;
-    accelerator::accelerator                               accelerator_;
+    accelerator::accelerator&                              accelerator_;
     std::shared_ptr<amcp::amcp_command_repository>         amcp_command_repo_;
     std::shared_ptr<amcp::amcp_command_repository_wrapper> amcp_command_repo_wrapper_;
     std::shared_ptr<amcp::command_context_factory>         amcp_context_factory_;
+    std::shared_ptr<amcp::media_index>                     media_index_;
+    std::shared_ptr<amcp::thumbnail_generator>             thumbnails_;
+    std::shared_ptr<amcp::command_recorder>                command_recorder_;
     std::vector<spl::shared_ptr<IO::AsyncEventServer>>     async_servers_;
     std::shared_ptr<IO::AsyncEventServer>                  primary_amcp_server_;
+    std::shared_ptr<IO::metrics_server>                    metrics_server_;
+    std::vector<std::shared_ptr<IO::websocket_server>>     websocket_servers_;
+    std::shared_ptr<netroute::route_server>                route_server_;
     std::shared_ptr<osc::client>                           osc_client_ = std::make_shared<osc::client>(io_service_);
     std::vector<std::shared_ptr<void>>                     predefined_osc_subscriptions_;
     spl::shared_ptr<std::vector<protocol::amcp::channel_context>> channels_;
     spl::shared_ptr<core::cg_producer_registry>                   cg_registry_;
     spl::shared_ptr<core::frame_producer_registry>                producer_registry_;
     spl::shared_ptr<core::frame_consumer_registry>                consumer_registry_;
-    std::function<void(bool)>                                     shutdown_server_now_;
+    spl::shared_ptr<amcp::startup_report>                         startup_report_;
+    std::function<void(amcp::shutdown_mode)>                      shutdown_server_now_;
+    bool                                                          cpu_only_ = false; // no channel mixes on a gpu
 
     impl(const impl&)            = delete;
     impl& operator=(const impl&) = delete;
 
-    explicit impl(std::function<void(bool)> shutdown_server_now)
-        : video_format_repository_()
-        , accelerator_(video_format_repository_)
-        , producer_registry_(spl::make_shared<core::frame_producer_registry>())
-        , consumer_registry_(spl::make_shared<core::frame_consumer_registry>())
+    impl(std::function<void(amcp::shutdown_mode)> shutdown_server_now, std::shared_ptr<server_resources> resources)
+        : resources_(resources ? std::move(resources) : std::make_shared<server_resources>())
+        , video_format_repository_()
+        , accelerator_(resources_->accelerator)
+        , cg_registry_(resources_->cg_registry)
+        , producer_registry_(resources_->producer_registry)
+        , consumer_registry_(resources_->consumer_registry)
         , shutdown_server_now_(std::move(shutdown_server_now))
     {
-        caspar::core::diagnostics::osd::register_sink();
+        // The previous server joined the destroyers on its way out.
+        destroy_producers_asynchronously();
     }
 
     void start()
     {
+        caspar::timer startup_timer;
+
+        diagnostics::trace::set_capacity(env::properties().get(L"configuration.diagnostics.trace-buffer-size", 0));
+
+        // Before the channels and gpu devices start their threads.
+        setup_thread_affinity(env::properties());
+        setup_memory_pool(env::properties());
+
         setup_video_modes(env::properties());
         CASPAR_LOG(info) << L"Initialized video modes.";
 
@@ -135,10 +209,10 @@ struct server::impl
         setup_amcp_command_repo();
         CASPAR_LOG(info) << L"Initialized command repository.";
 
-        module_dependencies dependencies(
-            cg_registry_, producer_registry_, consumer_registry_, amcp_command_repo_wrapper_);
-        initialize_modules(dependencies);
-        CASPAR_LOG(info) << L"Initialized modules.";
+        setup_modules();
+
+        if (media_index_)
+            media_index_->start();
 
         setup_channel_producers_and_consumers(xml_channels);
         CASPAR_LOG(info) << L"Initialized startup producers.";
@@ -148,6 +222,13 @@ struct server::impl
 
         setup_osc(env::properties());
         CASPAR_LOG(info) << L"Initialized osc.";
+
+        setup_metrics(env::properties());
+
+        setup_net_routes(env::properties());
+
+        startup_report_->add(L"server", startup_timer.elapsed());
+        CASPAR_LOG(info) << L"Started in " << startup_timer.elapsed() << L" s.";
     }
 
     ~impl()
@@ -160,9 +241,15 @@ struct server::impl
         amcp_command_repo_wrapper_.reset();
         amcp_command_repo_.reset();
         amcp_context_factory_.reset();
+        thumbnails_.reset();
+        media_index_.reset();
 
         primary_amcp_server_.reset();
+        metrics_server_.reset();
+        route_server_.reset();
         async_servers_.clear();
+        websocket_servers_.clear();
+        command_recorder_.reset();
 
         destroy_producers_synchronously();
         destroy_consumers_synchronously();
@@ -170,9 +257,57 @@ struct server::impl
 
         while (weak_io_service.lock())
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
 
-        uninitialize_modules();
-        core::diagnostics::osd::shutdown();
+    void setup_modules()
+    {
+        // Modules are initialized once per process, a warm restart only gives their commands to the new repository.
+        if (resources_->modules_initialized) {
+            for (auto& registration : resources_->module_commands)
+                registration(*amcp_command_repo_wrapper_);
+            CASPAR_LOG(info) << L"Kept modules.";
+            return;
+        }
+
+        auto builtin_commands = amcp_command_repo_wrapper_->registrations().size();
+
+        module_dependencies dependencies(
+            cg_registry_, producer_registry_, consumer_registry_, amcp_command_repo_wrapper_);
+        resources_->modules_initialized = true;
+        initialize_modules(dependencies);
+
+        auto& registrations = amcp_command_repo_wrapper_->registrations();
+        resources_->module_commands.assign(registrations.begin() + builtin_commands, registrations.end());
+        CASPAR_LOG(info) << L"Initialized modules.";
+    }
+
+    void setup_thread_affinity(const boost::property_tree::wptree& pt)
+    {
+        static const std::pair<const wchar_t*, thread_role> roles[] = {{L"channel", thread_role::channel},
+                                                                       {L"gpu", thread_role::gpu},
+                                                                       {L"producer", thread_role::producer},
+                                                                       {L"consumer", thread_role::consumer}};
+
+        for (auto& role : roles) {
+            auto value = pt.get(L"configuration.thread-affinity." + std::wstring(role.first), std::wstring());
+            configure_thread_affinity(role.second, value);
+        }
+    }
+
+    void setup_memory_pool(const boost::property_tree::wptree& pt)
+    {
+        auto mode      = boost::to_lower_copy(pt.get(L"configuration.memory.huge-pages", std::wstring(L"off")));
+        auto pool_size = pt.get(L"configuration.memory.pool-size", 256);
+
+        auto pages = huge_pages::off;
+        if (mode == L"transparent")
+            pages = huge_pages::transparent;
+        else if (mode == L"reserved")
+            pages = huge_pages::reserved;
+        else if (mode != L"off")
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid memory huge-pages mode: " + mode));
+
+        configure_memory_pool(pages, static_cast<std::size_t>(std::max(pool_size, 0)) * 1024 * 1024);
     }
 
     void setup_video_modes(const boost::property_tree::wptree& pt)
@@ -247,7 +382,10 @@ struct server::impl
     {
         using boost::property_tree::wptree;
 
-        std::vector<wptree> xml_channels;
+        std::vector<wptree>                                       xml_channels;
+        std::map<std::wstring, std::shared_ptr<core::sync_group>> sync_groups;
+        std::map<std::wstring, std::wstring>                      sync_group_clocks;
+        int                                                       gpu_channels = 0;
 
         for (auto& xml_channel : pt | witerate_children(L"configuration.channels") | welement_context_iteration) {
             xml_channels.push_back(xml_channel.second);
@@ -258,12 +396,76 @@ struct server::impl
             if (format_desc.format == video_format::invalid)
                 CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video-mode: " + format_desc_str));
 
+            auto pipelined    = xml_channel.second.get(L"pipelined", false);
+            auto gpu          = xml_channel.second.get(L"gpu", 0);
+            auto group_name   = xml_channel.second.get(L"sync-group", L"");
+            auto proxy_scale  = xml_channel.second.get(L"proxy-scale", 1);
+            auto offline      = xml_channel.second.get(L"offline", false);
+            auto ptp_clock    = xml_channel.second.get(L"ptp-clock", L"");
+            auto gpu_priority = xml_channel.second.get(L"gpu-priority", L"normal");
+            auto analysis     = xml_channel.second.get(L"analysis", false);
+            auto mixer        = xml_channel.second.get(L"mixer", L"gpu");
+            auto loudness     = xml_channel.second.get(L"loudness", L"none");
+            if (proxy_scale != 1 && proxy_scale != 2 && proxy_scale != 4)
+                CASPAR_THROW_EXCEPTION(user_error()
+                                       << msg_info(L"Invalid proxy-scale: " + std::to_wstring(proxy_scale)));
+
+            if (gpu_priority != L"normal" && gpu_priority != L"background")
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid gpu-priority: " + gpu_priority));
+
+            if (mixer != L"gpu" && mixer != L"cpu")
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid mixer: " + mixer));
+
+            if (loudness != L"none" && loudness != L"channel" && loudness != L"layers")
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid loudness: " + loudness));
+
+            if (mixer == L"cpu" && (proxy_scale != 1 || analysis))
+                CASPAR_LOG(warning) << L"The cpu mixer ignores proxy-scale and analysis";
+
+            if (mixer == L"gpu")
+                gpu_channels++;
+
+            if (offline && !group_name.empty())
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Offline channels can't be in a sync-group"));
+
+            if (offline && !ptp_clock.empty())
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Offline channels can't have a ptp-clock"));
+
+            std::shared_ptr<core::clock_source> clock;
+            if (!ptp_clock.empty()) {
+                clock = core::create_ptp_clock(ptp_clock, format_desc);
+            }
+
+            std::shared_ptr<core::sync_group> sync_group;
+            if (!group_name.empty()) {
+                auto& group = sync_groups[group_name];
+                if (!group) {
+                    group                         = std::make_shared<core::sync_group>(group_name, format_desc, clock);
+                    sync_group_clocks[group_name] = ptp_clock;
+                } else if (!group->accepts(format_desc)) {
+                    CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Channels in sync-group " + group_name +
+                                                                    L" need the same frame rate: " + format_desc_str));
+                } else if (sync_group_clocks[group_name] != ptp_clock) {
+                    CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Channels in sync-group " + group_name +
+                                                                    L" need the same ptp-clock: " + ptp_clock));
+                }
+                sync_group = group;
+                clock      = nullptr;
+            }
+            caspar::timer timer;
+
             auto weak_client = std::weak_ptr<osc::client>(osc_client_);
             auto channel_id  = static_cast<int>(channels_->size() + 1);
             auto channel =
                 spl::make_shared<video_channel>(channel_id,
                                                 format_desc,
-                                                accelerator_.create_image_mixer(channel_id),
+                                                mixer == L"cpu"
+                                                    ? accelerator_.create_cpu_image_mixer(channel_id)
+                                                    : accelerator_.create_image_mixer(channel_id,
+                                                                                      gpu,
+                                                                                      proxy_scale,
+                                                                                      gpu_priority == L"background",
+                                                                                      analysis),
                                                 [channel_id, weak_client](core::monitor::state channel_state) {
                                                     monitor::state state;
                                                     state[""]["channel"][channel_id] = channel_state;
@@ -271,15 +473,62 @@ struct server::impl
                                                     if (client) {
                                                         client->send(std::move(state));
                                                     }
-                                                });
+                                                },
+                                                pipelined,
+                                                sync_group,
+                                                offline,
+                                                clock,
+                                                loudness == L"layers"    ? core::loudness_metering::layers
+                                                : loudness == L"channel" ? core::loudness_metering::channel
+                                                                         : core::loudness_metering::none);
 
             const std::wstring lifecycle_key = L"lock" + std::to_wstring(channel_id);
             channels_->emplace_back(channel, channel->stage(), lifecycle_key);
+
+            startup_report_->add(L"channel " + std::to_wstring(channel_id) + L" created", timer.elapsed());
         }
 
+        // Servers without a gpu make thumbnails on the cpu too, and have no device for GL INFO.
+        cpu_only_ = !xml_channels.empty() && gpu_channels == 0;
+
         return xml_channels;
     }
 
+    void setup_metrics(const boost::property_tree::wptree& pt)
+    {
+        if (!pt.get(L"configuration.metrics.enabled", false))
+            return;
+
+        auto port = pt.get<unsigned short>(L"configuration.metrics.port", 9250);
+        try {
+            metrics_server_ = std::make_shared<IO::metrics_server>(io_service_, port);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            CASPAR_LOG(error) << L"Failed to serve metrics on port " << port;
+        }
+    }
+
+    void setup_net_routes(const boost::property_tree::wptree& pt)
+    {
+        if (!pt.get(L"configuration.net-route.enabled", false))
+            return;
+
+        auto port = pt.get<unsigned short>(L"configuration.net-route.port", 5255);
+        auto mtu  = pt.get(L"configuration.net-route.mtu", 1500);
+
+        std::vector<spl::shared_ptr<core::video_channel>> channels;
+        for (auto& cc : *channels_) {
+            channels.emplace_back(cc.raw_channel);
+        }
+
+        try {
+            route_server_ = std::make_shared<netroute::route_server>(io_service_, port, mtu, std::move(channels));
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            CASPAR_LOG(error) << L"Failed to serve routes on port " << port;
+        }
+    }
+
     void setup_osc(const boost::property_tree::wptree& pt)
     {
         using boost::property_tree::wptree;
@@ -297,11 +546,20 @@ struct server::impl
                 const auto address = ptree_get<std::wstring>(predefined_client.second, L"address");
                 const auto port    = ptree_get<unsigned short>(predefined_client.second, L"port");
 
+                std::vector<std::string> prefixes;
+                if (predefined_client.second.get_child_optional(L"filters")) {
+                    for (auto& filter :
+                         predefined_client.second | witerate_children(L"filters") | welement_context_iteration) {
+                        ptree_verify_element_name(filter, L"filter");
+                        prefixes.push_back(u8(filter.second.get_value<std::wstring>()));
+                    }
+                }
+
                 boost::system::error_code ec;
                 auto                      ipaddr = address_v4::from_string(u8(address), ec);
                 if (!ec)
                     predefined_osc_subscriptions_.push_back(
-                        osc_client_->get_subscription_token(udp::endpoint(ipaddr, port)));
+                        osc_client_->get_subscription_token(udp::endpoint(ipaddr, port), std::move(prefixes)));
                 else
                     CASPAR_LOG(warning) << "Invalid OSC client. Must be valid ipv4 address: " << address;
             }
@@ -327,61 +585,192 @@ struct server::impl
             channels_vec.emplace_back(cc.raw_channel);
         }
 
+        // Channels don't depend on each other's startup, so each brings up its consumers and producers on a thread of
+        // its own and plays as soon as it is done. Opening a card can take seconds.
+        std::vector<std::future<void>> channels;
         for (auto& channel : *channels_) {
-            core::diagnostics::scoped_call_context save;
-            core::diagnostics::call_context::for_thread().video_channel = channel.raw_channel->index();
-
-            auto xml_channel = xml_channels.at(channel.raw_channel->index() - 1);
-
-            // Consumers
-            if (xml_channel.get_child_optional(L"consumers")) {
-                for (auto& xml_consumer : xml_channel | witerate_children(L"consumers") | welement_context_iteration) {
-                    auto name = xml_consumer.first;
-
-                    try {
-                        if (name != L"<xmlcomment>")
-                            channel.raw_channel->output().add(consumer_registry_->create_consumer(
-                                name, xml_consumer.second, video_format_repository_, channels_vec));
-                    } catch (...) {
-                        CASPAR_LOG_CURRENT_EXCEPTION();
+            channels.push_back(std::async(std::launch::async, [&, channel_ptr = &channel] {
+                setup_channel(*channel_ptr,
+                              xml_channels.at(channel_ptr->raw_channel->index() - 1),
+                              channels_vec,
+                              console_client);
+            }));
+        }
+        for (auto& channel : channels) {
+            channel.get();
+        }
+    }
+
+    void setup_channel(const protocol::amcp::channel_context&                  channel,
+                       const boost::property_tree::wptree&                      xml_channel,
+                       const std::vector<spl::shared_ptr<core::video_channel>>& channels_vec,
+                       const spl::shared_ptr<IO::ConsoleClientInfo>&            console_client)
+    {
+        core::diagnostics::scoped_call_context save;
+        core::diagnostics::call_context::for_thread().video_channel = channel.raw_channel->index();
+
+        caspar::timer timer;
+
+        setup_consumers(channel, xml_channel, channels_vec);
+
+        // Producers
+        if (xml_channel.get_child_optional(L"producers")) {
+            for (auto& xml_producer : xml_channel | witerate_children(L"producers") | welement_context_iteration) {
+                ptree_verify_element_name(xml_producer, L"producer");
+
+                const std::wstring command = xml_producer.second.get_value(L"");
+                const auto         attrs   = xml_producer.second.get_child(L"<xmlattr>");
+                const int          id      = attrs.get(L"id", -1);
+
+                try {
+                    std::list<std::wstring> tokens{
+                        L"PLAY", (boost::wformat(L"%i-%i") % channel.raw_channel->index() % id).str()};
+                    IO::tokenize(command, tokens);
+                    auto cmd = amcp_command_repo_->parse_command(console_client, tokens, L"");
+
+                    if (cmd) {
+                        std::wstring res = cmd->Execute(channels_).get();
+                        console_client->send(std::move(res), false);
                     }
+                } catch (const user_error&) {
+                    CASPAR_LOG(error) << "Failed to parse command: " << command;
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
                 }
             }
+        }
+
+        auto name = L"channel " + std::to_wstring(channel.raw_channel->index());
+        startup_report_->add(name, timer.elapsed());
+        CASPAR_LOG(info) << L"Started " << name << L" in " << timer.elapsed() << L" s.";
+    }
+
+    void setup_consumers(const protocol::amcp::channel_context&                  channel,
+                         const boost::property_tree::wptree&                      xml_channel,
+                         const std::vector<spl::shared_ptr<core::video_channel>>& channels_vec)
+    {
+        if (!xml_channel.get_child_optional(L"consumers")) {
+            return;
+        }
+
+        auto channel_index = channel.raw_channel->index();
+        auto in_context    = [channel_index](auto func) {
+            return std::async(std::launch::async, [channel_index, func = std::move(func)] {
+                core::diagnostics::scoped_call_context save;
+                core::diagnostics::call_context::for_thread().video_channel = channel_index;
+                return func();
+            });
+        };
+
+        // Created side by side and then initialized side by side.
+        std::vector<std::future<std::shared_ptr<core::frame_consumer>>> created;
+        for (auto& xml_consumer : xml_channel | witerate_children(L"consumers") | welement_context_iteration) {
+            auto name = xml_consumer.first;
+            if (name == L"<xmlcomment>") {
+                continue;
+            }
 
-            // Producers
-            if (xml_channel.get_child_optional(L"producers")) {
-                for (auto& xml_producer : xml_channel | witerate_children(L"producers") | welement_context_iteration) {
-                    ptree_verify_element_name(xml_producer, L"producer");
-
-                    const std::wstring command = xml_producer.second.get_value(L"");
-                    const auto         attrs   = xml_producer.second.get_child(L"<xmlattr>");
-                    const int          id      = attrs.get(L"id", -1);
-
-                    try {
-                        std::list<std::wstring> tokens{
-                            L"PLAY", (boost::wformat(L"%i-%i") % channel.raw_channel->index() % id).str()};
-                        IO::tokenize(command, tokens);
-                        auto cmd = amcp_command_repo_->parse_command(console_client, tokens, L"");
-
-                        if (cmd) {
-                            std::wstring res = cmd->Execute(channels_).get();
-                            console_client->send(std::move(res), false);
-                        }
-                    } catch (const user_error&) {
-                        CASPAR_LOG(error) << "Failed to parse command: " << command;
-                    } catch (...) {
-                        CASPAR_LOG_CURRENT_EXCEPTION();
-                    }
+            auto& config = xml_consumer.second;
+            created.push_back(in_context([=, &config, &channels_vec]() -> std::shared_ptr<core::frame_consumer> {
+                try {
+                    return consumer_registry_->create_consumer(name, config, video_format_repository_, channels_vec);
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                    return nullptr;
                 }
+            }));
+        }
+
+        // Of consumers that share an index only the last one is kept, like when adding them one after the other.
+        std::map<int, spl::shared_ptr<core::frame_consumer>> consumers;
+        for (auto& consumer : created) {
+            if (auto ptr = consumer.get()) {
+                consumers.insert_or_assign(ptr->index(), spl::make_shared_ptr(ptr));
             }
         }
+
+        std::vector<std::future<void>> initialized;
+        for (auto& consumer : consumers) {
+            initialized.push_back(in_context([&, consumer = consumer.second] {
+                caspar::timer timer;
+                try {
+                    channel.raw_channel->output().add(consumer);
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                    return;
+                }
+
+                auto name = consumer->print() + L" on channel " + std::to_wstring(channel_index);
+                startup_report_->add(name, timer.elapsed());
+                CASPAR_LOG(info) << L"Initialized " << name << L" in " << timer.elapsed() << L" s.";
+            }));
+        }
+        for (auto& consumer : initialized) {
+            consumer.get();
+        }
     }
 
     void setup_amcp_command_repo()
     {
         amcp_command_repo_ = std::make_shared<amcp::amcp_command_repository>(channels_);
 
-        auto ogl_device = accelerator_.get_device();
+        if (env::properties().get(L"configuration.amcp.media-index.enabled", true)) {
+            auto font_folder = boost::filesystem::path(
+                env::properties().get(L"configuration.amcp.media-index.font-path", std::wstring(L"font/")));
+            if (font_folder.is_relative())
+                font_folder = boost::filesystem::path(env::initial_folder()) / font_folder;
+
+            media_index_ = std::make_shared<amcp::media_index>(
+                producer_registry_,
+                env::properties().get(L"configuration.amcp.media-index.probe-threads", 2),
+                env::properties().get(L"configuration.amcp.media-index.rescan-interval", 60),
+                font_folder.wstring());
+
+            // Lets LOAD go straight to the factories for the kind of file a name stands for.
+            std::weak_ptr<amcp::media_index> weak_index = media_index_;
+            producer_registry_->set_media_resolver([weak_index](const std::wstring& name) {
+                auto index = weak_index.lock();
+                return index ? index->find(name) : std::optional<std::wstring>();
+            });
+        }
+
+        // Needs the index to find the media, the modules that make the thumbnails register later.
+        if (media_index_ && env::properties().get(L"configuration.amcp.thumbnails.enabled", true)) {
+            auto folder = boost::filesystem::path(
+                env::properties().get(L"configuration.amcp.thumbnails.path", std::wstring(L"thumbnail/")));
+            if (folder.is_relative())
+                folder = boost::filesystem::path(env::initial_folder()) / folder;
+
+            thumbnails_ = std::make_shared<amcp::thumbnail_generator>(
+                producer_registry_,
+                std::shared_ptr<core::image_mixer>(
+                    cpu_only_ ? accelerator_.create_cpu_image_mixer(0)
+                              : accelerator_.create_image_mixer(
+                                    0, env::properties().get(L"configuration.amcp.thumbnails.gpu", 0), 1, true)),
+                media_index_,
+                folder.wstring(),
+                env::properties().get(L"configuration.amcp.thumbnails.width", 256),
+                env::properties().get(L"configuration.amcp.thumbnails.height", 0),
+                env::properties().get(L"configuration.amcp.thumbnails.threads", 1));
+        }
+
+        std::shared_ptr<amcp::layer_loader> loader;
+        if (env::properties().get(L"configuration.amcp.async-load.enabled", true))
+            loader = std::make_shared<amcp::layer_loader>(
+                env::properties().get(L"configuration.amcp.async-load.threads", 4),
+                env::properties().get(L"configuration.amcp.async-load.reply", std::wstring(L"loaded")) == L"queued");
+
+        // Templates and control UIs subscribed to /data over OSC learn of changes without retrieving every entry.
+        auto weak_client = std::weak_ptr<osc::client>(osc_client_);
+        auto data        = spl::make_shared<amcp::data_store>(
+            env::data_folder(), [weak_client](const std::wstring& name, std::uint64_t revision) {
+                monitor::state state;
+                state[""]["data"][u8(name)] = revision;
+                if (auto client = weak_client.lock())
+                    client->send(std::move(state));
+            });
+
+        auto ogl_device = cpu_only_ ? nullptr : accelerator_.get_device();
         auto ctx        = std::make_shared<amcp::amcp_command_static_context>(
             video_format_repository_,
             cg_registry_,
@@ -392,7 +781,12 @@ struct server::impl
             u8(caspar::env::properties().get(L"configuration.amcp.media-server.host", L"127.0.0.1")),
             u8(caspar::env::properties().get(L"configuration.amcp.media-server.port", L"8000")),
             ogl_device,
-            spl::make_shared_ptr(osc_client_));
+            spl::make_shared_ptr(osc_client_),
+            media_index_,
+            thumbnails_,
+            loader,
+            startup_report_,
+            data);
 
         amcp_context_factory_ = std::make_shared<amcp::command_context_factory>(ctx);
 
@@ -405,6 +799,9 @@ struct server::impl
     void setup_controllers(const boost::property_tree::wptree& pt)
     {
         using boost::property_tree::wptree;
+
+        setup_command_recorder(pt);
+
         for (auto& xml_controller : pt | witerate_children(L"configuration.controllers") | welement_context_iteration) {
             auto name     = xml_controller.first;
             auto protocol = ptree_get<std::wstring>(xml_controller.second, L"protocol");
@@ -427,25 +824,67 @@ struct server::impl
                     throw;
                     // CASPAR_LOG_CURRENT_EXCEPTION();
                 }
+            } else if (name == L"websocket") {
+                auto port = ptree_get<unsigned int>(xml_controller.second, L"port");
+
+                std::vector<std::string> allowed_origins;
+                if (xml_controller.second.get_child_optional(L"allowed-origins")) {
+                    for (auto& origin :
+                         xml_controller.second | witerate_children(L"allowed-origins") | welement_context_iteration) {
+                        ptree_verify_element_name(origin, L"origin");
+                        allowed_origins.push_back(u8(boost::trim_copy(origin.second.get_value<std::wstring>())));
+                    }
+                }
+
+                try {
+                    websocket_servers_.push_back(std::make_shared<IO::websocket_server>(
+                        io_service_,
+                        static_cast<unsigned short>(port),
+                        create_protocol(protocol, L"WebSocket Port " + std::to_wstring(port)),
+                        osc_client_,
+                        std::move(allowed_origins)));
+                } catch (...) {
+                    CASPAR_LOG(fatal) << L"Failed to setup " << protocol << L" websocket controller on port " << port
+                                      << L". It is likely already in use";
+                    throw;
+                }
             } else
                 CASPAR_LOG(warning) << "Invalid controller: " << name;
         }
     }
 
+    void setup_command_recorder(const boost::property_tree::wptree& pt)
+    {
+        if (!pt.get(L"configuration.amcp.record.enabled", false))
+            return;
+
+        auto folder = boost::filesystem::path(
+            pt.get(L"configuration.amcp.record.path", env::log_to_file() ? env::log_folder() : env::data_folder()));
+        boost::filesystem::create_directories(folder);
+
+        auto now = std::time(nullptr);
+        char name[64];
+        std::strftime(name, sizeof(name), "amcp-%Y%m%d-%H%M%S.trace", std::localtime(&now));
+
+        command_recorder_ = std::make_shared<amcp::command_recorder>((folder / name).wstring());
+    }
+
     IO::protocol_strategy_factory<char>::ptr create_protocol(const std::wstring& name,
                                                              const std::wstring& port_description) const
     {
         using namespace IO;
 
         if (boost::iequals(name, L"AMCP"))
-            return amcp::create_char_amcp_strategy_factory(port_description, spl::make_shared_ptr(amcp_command_repo_));
+            return amcp::create_char_amcp_strategy_factory(
+                port_description, spl::make_shared_ptr(amcp_command_repo_), command_recorder_);
 
         CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid protocol: " + name));
     }
 };
 
-server::server(std::function<void(bool)> shutdown_server_now)
-    : impl_(new impl(std::move(shutdown_server_now)))
+server::server(std::function<void(protocol::amcp::shutdown_mode)> shutdown_server_now,
+               std::shared_ptr<server_resources>                  resources)
+    : impl_(new impl(std::move(shutdown_server_now), std::move(resources)))
 {
 }
 void                                                     server::start() { impl_->start(); }
@@ -453,5 +892,6 @@ spl::shared_ptr<protocol::amcp::amcp_command_repository> server::get_amcp_comman
 {
     return spl::make_shared_ptr(impl_->amcp_command_repo_);
 }
+std::shared_ptr<server_resources> server::resources() const { return impl_->resources_; }
 
 } // namespace caspar
@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <protocol/amcp/amcp_command_context.h>
 #include <protocol/amcp/amcp_command_repository.h>
 
 #include <functional>
@@ -28,12 +29,18 @@
 
 namespace caspar {
 
+// The gpu devices and the modules, which a warm restart carries over from one server to the next.
+struct server_resources;
+
 class server final
 {
   public:
-    explicit server(std::function<void(bool)> shutdown_server_now);
+    // Creates new resources unless given the ones of the server this one replaces.
+    explicit server(std::function<void(protocol::amcp::shutdown_mode)> shutdown_server_now,
+                    std::shared_ptr<server_resources>                  resources = nullptr);
     void                                                     start();
     spl::shared_ptr<protocol::amcp::amcp_command_repository> get_amcp_command_repository() const;
+    std::shared_ptr<server_resources>                        resources() const;
 
   private:
     struct impl;